@@ -53,6 +53,7 @@
 #include "Config.h"
 #include "DynamicString.h"
 #include "FileInfo.h"
+#include "HashTable.h"
 #include "Locale.h"
 #include "Logfile.h"
 #include "Requesters.h"
@@ -61,6 +62,51 @@
 #include "Debug.h"
 
 static void ClearABookGroup(struct ABookNode *group);
+static void FreeABookIndex(struct ABookIndex *index);
+
+// the fields of an address book entry covered by the lookup index
+enum ABookIndexField
+{
+  ABIF_ALIAS = 0,
+  ABIF_REALNAME,
+  ABIF_ADDRESS,
+  ABIF_MAX
+};
+
+// a single indexed field value of an address book entry
+struct ABookIndexEntry
+{
+  const char *key;          // case folded field value, owned by the hash table
+  ULONG ordinal;            // position of the entry within the address book
+  struct ABookNode *abn;
+};
+
+// a distinct case folded field value and the range of sorted
+// index entries sharing it
+struct ABookKeyToken
+{
+  struct HashEntryHeader hash;
+  char *key;
+  ULONG first;
+  ULONG count;
+};
+
+struct ABookFieldIndex
+{
+  struct HashTable *hash;          // exact lookups
+  struct ABookIndexEntry *entries; // sorted by key and ordinal for prefix lookups
+  ULONG numEntries;
+};
+
+struct ABookIndex
+{
+  ULONG generation;
+  struct ABookFieldIndex field[ABIF_MAX];
+};
+
+// every change to any address book increases this number and
+// causes the lookup indexes to be rebuilt on their next use
+static ULONG abookGeneration = 0;
 
 /// CreateABookNode
 struct ABookNode *CreateABookNode(enum ABookNodeType type)
@@ -101,6 +147,8 @@ void DeleteABookNode(struct ABookNode *abn)
 {
   ENTER();
 
+  InvalidateABookIndexes();
+
   if(abn->type == ABNT_GROUP)
   {
     ClearABookGroup(abn);
@@ -127,6 +175,8 @@ void AddABookNode(struct ABookNode *group, struct ABookNode *member, struct ABoo
   else
     Insert((struct List *)&group->GroupMembers, (struct Node *)member, (struct Node *)afterThis);
 
+  InvalidateABookIndexes();
+
   LEAVE();
 }
 
@@ -138,6 +188,8 @@ void RemoveABookNode(struct ABookNode *member)
 
   Remove((struct Node *)member);
 
+  InvalidateABookIndexes();
+
   LEAVE();
 }
 
@@ -156,6 +208,19 @@ void MoveABookNode(struct ABookNode *group, struct ABookNode *member, struct ABo
   LEAVE();
 }
 
+///
+/// InvalidateABookIndexes
+// must be called whenever the alias, real name or address of an entry which
+// is already part of an address book was modified
+void InvalidateABookIndexes(void)
+{
+  ENTER();
+
+  abookGeneration++;
+
+  LEAVE();
+}
+
 ///
 /// CompareABookNodes
 BOOL CompareABookNodes(const struct ABookNode *abn1, const struct ABookNode *abn2)
@@ -235,6 +300,7 @@ void InitABook(struct ABook *abook, const char *name)
 
   InitABookNode(&abook->rootGroup, ABNT_GROUP);
   strlcpy(abook->rootGroup.Alias, name != NULL ? name : "root", sizeof(abook->rootGroup.Alias));
+  abook->index = NULL;
   abook->modified = FALSE;
 
   LEAVE();
@@ -267,6 +333,7 @@ void ClearABook(struct ABook *abook)
   ENTER();
 
   ClearABookGroup(&abook->rootGroup);
+  FreeABookIndex(abook->index);
   InitABook(abook, NULL);
 
   LEAVE();
@@ -279,6 +346,7 @@ void MoveABookNodes(struct ABook *dst, struct ABook *src)
   ENTER();
 
   MoveList((struct List *)&dst->rootGroup.GroupMembers, (struct List *)&src->rootGroup.GroupMembers);
+  InvalidateABookIndexes();
 
   LEAVE();
 }
@@ -1907,6 +1975,472 @@ BOOL ImportXMLABook(const char *filename, struct ABook *abook, BOOL append)
 
 ///
 
+/// GetABookField
+// return the value of an indexed field of an address book entry
+static const char *GetABookField(const struct ABookNode *abn, enum ABookIndexField field)
+{
+  const char *value;
+
+  switch(field)
+  {
+    case ABIF_ALIAS:    value = abn->Alias;    break;
+    case ABIF_REALNAME: value = abn->RealName; break;
+    case ABIF_ADDRESS:  value = abn->Address;  break;
+    default:            value = "";            break;
+  }
+
+  return value;
+}
+
+///
+/// FoldABookKey
+// convert a string to lower case for case insensitive lookups, returns
+// FALSE if the string is too long to match any indexed field at all
+static BOOL FoldABookKey(const char *src, char *dst, size_t dstSize)
+{
+  BOOL result = FALSE;
+  size_t i;
+
+  for(i = 0; i < dstSize; i++)
+  {
+    if((dst[i] = (char)ToLower((ULONG)(unsigned char)src[i])) == '\0')
+    {
+      result = TRUE;
+      break;
+    }
+  }
+
+  return result;
+}
+
+///
+/// IsSearchedType
+// check if the type of an entry is one of the searched types
+static BOOL IsSearchedType(const struct ABookNode *abn, ULONG mode)
+{
+  BOOL result;
+
+  if(abn->type == ABNT_USER && isUserTypeSearch(mode) == TRUE)
+    result = TRUE;
+  else if(abn->type == ABNT_LIST && isListTypeSearch(mode) == TRUE)
+    result = TRUE;
+  else if(abn->type == ABNT_GROUP && isGroupTypeSearch(mode) == TRUE)
+    result = TRUE;
+  else
+    result = FALSE;
+
+  return result;
+}
+
+///
+/// FreeABookIndex
+static void FreeABookIndex(struct ABookIndex *index)
+{
+  ENTER();
+
+  if(index != NULL)
+  {
+    int i;
+
+    for(i = 0; i < ABIF_MAX; i++)
+    {
+      // the hash tables own the key strings
+      if(index->field[i].hash != NULL)
+        HashTableDestroy(index->field[i].hash);
+
+      free(index->field[i].entries);
+    }
+
+    free(index);
+  }
+
+  LEAVE();
+}
+
+///
+/// CountABookEntry
+static BOOL CountABookEntry(UNUSED const struct ABookNode *abn, UNUSED ULONG flags, void *userData)
+{
+  (*(ULONG *)userData)++;
+
+  return TRUE;
+}
+
+///
+
+struct IndexBuildStuff
+{
+  struct ABookIndex *index;
+  ULONG ordinal;
+};
+
+/// IndexABookEntry
+static BOOL IndexABookEntry(const struct ABookNode *abn, UNUSED ULONG flags, void *userData)
+{
+  struct IndexBuildStuff *stuff = (struct IndexBuildStuff *)userData;
+  BOOL result = TRUE;
+  int i;
+
+  for(i = 0; i < ABIF_MAX; i++)
+  {
+    struct ABookFieldIndex *fieldIndex = &stuff->index->field[i];
+    char key[SIZE_ADDRESS];
+    struct ABookKeyToken *token;
+
+    FoldABookKey(GetABookField(abn, i), key, sizeof(key));
+
+    // the hash table keeps a single copy of every distinct key
+    if((token = (struct ABookKeyToken *)HashTableOperate(fieldIndex->hash, key, htoAdd)) == NULL)
+    {
+      result = FALSE;
+      break;
+    }
+
+    if(token->key == NULL && (token->key = strdup(key)) == NULL)
+    {
+      HashTableRawRemove(fieldIndex->hash, &token->hash);
+      result = FALSE;
+      break;
+    }
+
+    fieldIndex->entries[fieldIndex->numEntries].key = token->key;
+    fieldIndex->entries[fieldIndex->numEntries].ordinal = stuff->ordinal;
+    fieldIndex->entries[fieldIndex->numEntries].abn = (struct ABookNode *)abn;
+    fieldIndex->numEntries++;
+  }
+
+  stuff->ordinal++;
+
+  return result;
+}
+
+///
+/// CompareABookIndexEntries
+static int CompareABookIndexEntries(const void *p1, const void *p2)
+{
+  const struct ABookIndexEntry *e1 = (const struct ABookIndexEntry *)p1;
+  const struct ABookIndexEntry *e2 = (const struct ABookIndexEntry *)p2;
+  int cmp;
+
+  // equal keys keep the order of the address book
+  if((cmp = strcmp(e1->key, e2->key)) == 0)
+    cmp = (e1->ordinal < e2->ordinal) ? -1 : (e1->ordinal > e2->ordinal);
+
+  return cmp;
+}
+
+///
+/// GetABookIndex
+// return the lookup index of an address book, (re)build it if the address
+// book has changed since its last use. Returns NULL if there is not enough
+// memory for the index.
+static struct ABookIndex *GetABookIndex(const struct ABook *abook)
+{
+  struct ABookIndex *index = abook->index;
+
+  ENTER();
+
+  if(index == NULL || index->generation != abookGeneration)
+  {
+    ULONG numNodes = 0;
+    BOOL success = FALSE;
+
+    FreeABookIndex(index);
+
+    IterateABook(abook, 0, CountABookEntry, &numNodes);
+
+    if((index = calloc(1, sizeof(*index))) != NULL)
+    {
+      int i;
+
+      success = TRUE;
+      for(i = 0; i < ABIF_MAX; i++)
+      {
+        if((index->field[i].hash = HashTableNew(HashTableGetDefaultStringOps(), NULL, sizeof(struct ABookKeyToken), numNodes)) == NULL ||
+           (index->field[i].entries = malloc((numNodes > 0 ? numNodes : 1) * sizeof(struct ABookIndexEntry))) == NULL)
+        {
+          success = FALSE;
+          break;
+        }
+      }
+
+      if(success == TRUE)
+      {
+        struct IndexBuildStuff stuff;
+
+        stuff.index = index;
+        stuff.ordinal = 0;
+        success = IterateABook(abook, 0, IndexABookEntry, &stuff);
+      }
+
+      if(success == TRUE)
+      {
+        for(i = 0; i < ABIF_MAX; i++)
+        {
+          struct ABookFieldIndex *fieldIndex = &index->field[i];
+          ULONG first;
+
+          qsort(fieldIndex->entries, fieldIndex->numEntries, sizeof(struct ABookIndexEntry), CompareABookIndexEntries);
+
+          // let every key token point to its range of sorted entries
+          for(first = 0; first < fieldIndex->numEntries; )
+          {
+            struct ABookKeyToken *token;
+            ULONG last = first+1;
+
+            while(last < fieldIndex->numEntries && fieldIndex->entries[last].key == fieldIndex->entries[first].key)
+              last++;
+
+            token = (struct ABookKeyToken *)HashTableOperate(fieldIndex->hash, fieldIndex->entries[first].key, htoLookup);
+            token->first = first;
+            token->count = last-first;
+
+            first = last;
+          }
+        }
+
+        index->generation = abookGeneration;
+
+        D(DBF_ABOOK, "built lookup index for %ld entries of address book '%s'", numNodes, abook->rootGroup.Alias);
+      }
+      else
+      {
+        E(DBF_ABOOK, "couldn't build lookup index for address book '%s'", abook->rootGroup.Alias);
+
+        FreeABookIndex(index);
+        index = NULL;
+      }
+    }
+
+    // the index is just a cache and doesn't change the address book's contents
+    ((struct ABook *)abook)->index = index;
+  }
+
+  RETURN(index);
+  return index;
+}
+
+///
+/// FindABookKeyRange
+// find the range of sorted index entries matching the given folded key either
+// exactly or as a prefix
+static void FindABookKeyRange(const struct ABookFieldIndex *fieldIndex, const char *key, BOOL prefix, ULONG *first, ULONG *last)
+{
+  *first = 0;
+  *last = 0;
+
+  if(prefix == TRUE)
+  {
+    size_t keyLen = strlen(key);
+    ULONG lo = 0;
+    ULONG hi = fieldIndex->numEntries;
+
+    // binary search for the first entry not less than the key
+    while(lo < hi)
+    {
+      ULONG mid = lo + (hi-lo)/2;
+
+      if(strcmp(fieldIndex->entries[mid].key, key) < 0)
+        lo = mid+1;
+      else
+        hi = mid;
+    }
+
+    // all keys starting with the prefix follow directly
+    hi = lo;
+    while(hi < fieldIndex->numEntries && strncmp(fieldIndex->entries[hi].key, key, keyLen) == 0)
+      hi++;
+
+    *first = lo;
+    *last = hi;
+  }
+  else
+  {
+    struct HashEntryHeader *entry;
+
+    if((entry = HashTableOperate(fieldIndex->hash, key, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+    {
+      struct ABookKeyToken *token = (struct ABookKeyToken *)entry;
+
+      *first = token->first;
+      *last = token->first + token->count;
+    }
+  }
+}
+
+///
+/// IndexSearchABook
+// search the lookup index of an address book with the same semantics as a
+// plain search through all entries, i.e. the number of hits is limited to 2
+// and the last hit in address book order is returned
+static ULONG IndexSearchABook(const struct ABookIndex *index, const char *text, ULONG mode, struct ABookNode **abn)
+{
+  const struct ABookIndexEntry *hit[2];
+  ULONG hits = 0;
+  char key[SIZE_ADDRESS];
+
+  ENTER();
+
+  // an overlong search text cannot match any entry
+  if(FoldABookKey(text, key, sizeof(key)) == TRUE)
+  {
+    int i;
+
+    for(i = 0; i < ABIF_MAX; i++)
+    {
+      ULONG first;
+      ULONG last;
+
+      if((i == ABIF_ALIAS && isAliasSearch(mode) == FALSE) ||
+         (i == ABIF_REALNAME && isRealNameSearch(mode) == FALSE) ||
+         (i == ABIF_ADDRESS && isAddressSearch(mode) == FALSE))
+      {
+        continue;
+      }
+
+      FindABookKeyRange(&index->field[i], key, isCompleteSearch(mode), &first, &last);
+
+      for(; first < last; first++)
+      {
+        const struct ABookIndexEntry *e = &index->field[i].entries[first];
+
+        if(IsSearchedType(e->abn, mode) == FALSE)
+          continue;
+
+        // an entry matching in several fields counts only once
+        if((hits > 0 && hit[0]->ordinal == e->ordinal) || (hits > 1 && hit[1]->ordinal == e->ordinal))
+          continue;
+
+        // remember the two first matching entries in address book order
+        if(hits < 2)
+          hit[hits++] = e;
+        else if(e->ordinal < hit[1]->ordinal)
+          hit[1] = e;
+        else if(isCompleteSearch(mode) == FALSE)
+        {
+          // exact matches are sorted by their ordinal, so
+          // there will be no better ones for this field
+          break;
+        }
+
+        if(hits == 2 && hit[1]->ordinal < hit[0]->ordinal)
+        {
+          const struct ABookIndexEntry *tmp = hit[0];
+
+          hit[0] = hit[1];
+          hit[1] = tmp;
+        }
+      }
+    }
+
+    if(hits > 0)
+      *abn = hit[hits-1]->abn;
+  }
+
+  RETURN(hits);
+  return hits;
+}
+
+///
+/// CompareABookIndexOrdinals
+static int CompareABookIndexOrdinals(const void *p1, const void *p2)
+{
+  const struct ABookIndexEntry *e1 = *(const struct ABookIndexEntry **)p1;
+  const struct ABookIndexEntry *e2 = *(const struct ABookIndexEntry **)p2;
+
+  return (e1->ordinal < e2->ordinal) ? -1 : (e1->ordinal > e2->ordinal);
+}
+
+///
+/// IndexPatternSearchABook
+// search the lookup index for a pattern without any wildcards, which is the
+// same as a case insensitive comparison. Returns -1 if the index cannot be
+// used for this search.
+static LONG IndexPatternSearchABook(const struct ABookIndex *index, const char *pattern, ULONG mode, char **aliases)
+{
+  LONG hits = -1;
+  char key[SIZE_ADDRESS];
+
+  ENTER();
+
+  if(isCommentSearch(mode) == FALSE && isUserInfoSearch(mode) == FALSE &&
+     strpbrk(pattern, "#?*%()|~[]'") == NULL)
+  {
+    hits = 0;
+
+    // an overlong pattern cannot match any entry
+    if(FoldABookKey(pattern, key, sizeof(key)) == TRUE)
+    {
+      ULONG first[ABIF_MAX];
+      ULONG last[ABIF_MAX];
+      ULONG numFound = 0;
+      int i;
+
+      for(i = 0; i < ABIF_MAX; i++)
+      {
+        first[i] = 0;
+        last[i] = 0;
+
+        if((i == ABIF_ALIAS && isAliasSearch(mode) == TRUE) ||
+           (i == ABIF_REALNAME && isRealNameSearch(mode) == TRUE) ||
+           (i == ABIF_ADDRESS && isAddressSearch(mode) == TRUE))
+        {
+          FindABookKeyRange(&index->field[i], key, FALSE, &first[i], &last[i]);
+          numFound += last[i]-first[i];
+        }
+      }
+
+      if(numFound > 0)
+      {
+        const struct ABookIndexEntry **found;
+
+        if((found = malloc(numFound * sizeof(*found))) != NULL)
+        {
+          ULONG n = 0;
+          ULONG j;
+
+          for(i = 0; i < ABIF_MAX; i++)
+          {
+            for(j = first[i]; j < last[i]; j++)
+            {
+              const struct ABookIndexEntry *e = &index->field[i].entries[j];
+
+              // groups are never found by a pattern search
+              if(e->abn->type != ABNT_GROUP && IsSearchedType(e->abn, mode) == TRUE)
+                found[n++] = e;
+            }
+          }
+
+          // report the hits in address book order and each entry only once
+          qsort(found, n, sizeof(*found), CompareABookIndexOrdinals);
+
+          for(j = 0; j < n; j++)
+          {
+            if(j > 0 && found[j]->ordinal == found[j-1]->ordinal)
+              continue;
+
+            D(DBF_ABOOK, "found pattern '%s' in entry with alias '%s'", pattern, found[j]->abn->Alias);
+
+            if(aliases != NULL)
+              aliases[hits] = (char *)found[j]->abn->Alias;
+
+            hits++;
+          }
+
+          free(found);
+        }
+        else
+          hits = -1;
+      }
+    }
+  }
+
+  RETURN(hits);
+  return hits;
+}
+
+///
+
 struct PlainSearchStuff
 {
   const char *text;
@@ -1983,19 +2517,29 @@ BOOL SearchABookEntry(const struct ABookNode *abn, UNUSED ULONG flags, void *use
 //  it will break if there is more then one entry
 ULONG SearchABook(const struct ABook *abook, const char *text, ULONG mode, struct ABookNode **abn)
 {
-  struct PlainSearchStuff stuff;
+  struct ABookIndex *index;
   ULONG hits;
 
   ENTER();
 
-  stuff.text = text;
-  stuff.textLen = strlen(text);
-  stuff.mode = mode;
-  stuff.result = abn;
-  stuff.hits = 0;
-  IterateABook(abook, 0, SearchABookEntry, &stuff);
+  if((index = GetABookIndex(abook)) != NULL)
+  {
+    hits = IndexSearchABook(index, text, mode, abn);
+  }
+  else
+  {
+    struct PlainSearchStuff stuff;
+
+    // fall back to a search through all entries
+    stuff.text = text;
+    stuff.textLen = strlen(text);
+    stuff.mode = mode;
+    stuff.result = abn;
+    stuff.hits = 0;
+    IterateABook(abook, 0, SearchABookEntry, &stuff);
 
-  hits = stuff.hits;
+    hits = stuff.hits;
+  }
 
   RETURN(hits);
   return hits;
@@ -2070,18 +2614,32 @@ BOOL PatternSearchABookEntry(const struct ABookNode *abn, UNUSED ULONG flags, vo
 //  it will break if there is more then one entry
 ULONG PatternSearchABook(const struct ABook *abook, const char *pattern, ULONG mode, char **aliases)
 {
-  struct PatternSearchStuff stuff;
+  struct ABookIndex *index;
+  LONG indexHits = -1;
   ULONG hits;
 
   ENTER();
 
-  stuff.pattern = pattern;
-  stuff.mode = mode;
-  stuff.aliases = aliases;
-  stuff.hits = 0;
-  IterateABook(abook, 0, PatternSearchABookEntry, &stuff);
+  // patterns without wildcards can be looked up in the index
+  if((index = GetABookIndex(abook)) != NULL)
+    indexHits = IndexPatternSearchABook(index, pattern, mode, aliases);
 
-  hits = stuff.hits;
+  if(indexHits >= 0)
+  {
+    hits = indexHits;
+  }
+  else
+  {
+    struct PatternSearchStuff stuff;
+
+    stuff.pattern = pattern;
+    stuff.mode = mode;
+    stuff.aliases = aliases;
+    stuff.hits = 0;
+    IterateABook(abook, 0, PatternSearchABookEntry, &stuff);
+
+    hits = stuff.hits;
+  }
 
   RETURN(hits);
   return hits;
@@ -2119,13 +2677,27 @@ struct ABookNode *CreateABookGroup(struct ABook *abook, const char *name)
 ///
 /// FindPersonInABook
 struct ABookNode *FindPersonInABook(const struct ABook *abook, const struct Person *pe)
+{
+  struct ABookNode *result;
+
+  ENTER();
+
+  result = FindAddressInABook(abook, pe->Address);
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// FindAddressInABook
+struct ABookNode *FindAddressInABook(const struct ABook *abook, const char *address)
 {
   struct ABookNode *result = NULL;
   struct ABookNode *abn;
 
   ENTER();
 
-  if(SearchABook(abook, pe->Address, ASM_ADDRESS|ASM_USER|ASM_COMPLETE, &abn) == 1)
+  if(SearchABook(abook, address, ASM_ADDRESS|ASM_USER|ASM_COMPLETE, &abn) == 1)
   {
     result = abn;
   }
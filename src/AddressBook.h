@@ -36,6 +36,7 @@
 
 // forward declarations
 struct Person;
+struct ABookIndex;
 
 enum ABookNodeType
 {
@@ -71,6 +72,7 @@ struct ABook
 {
   struct ABookNode  rootGroup;
   struct ABookNode *arexxABN;
+  struct ABookIndex *index;   // lookup index for SearchABook(), built on demand
   BOOL modified;
 };
 
@@ -106,6 +108,7 @@ void DeleteABookNode(struct ABookNode *abn);
 void AddABookNode(struct ABookNode *group, struct ABookNode *member, struct ABookNode *afterThis);
 void RemoveABookNode(struct ABookNode *member);
 void MoveABookNode(struct ABookNode *group, struct ABookNode *member, struct ABookNode *afterThis);
+void InvalidateABookIndexes(void);
 BOOL CompareABookNodes(const struct ABookNode *abn1, const struct ABookNode *abn2);
 void InitABook(struct ABook *abook, const char *name);
 void ClearABook(struct ABook *abook);
@@ -124,6 +127,7 @@ ULONG SearchABook(const struct ABook *abook, const char *text, ULONG mode, struc
 ULONG PatternSearchABook(const struct ABook *abook, const char *pattern, ULONG mode, char **aliases);
 struct ABookNode *CreateABookGroup(struct ABook *abook, const char *name);
 struct ABookNode *FindPersonInABook(const struct ABook *abook, const struct Person *pe);
+struct ABookNode *FindAddressInABook(const struct ABook *abook, const char *address);
 void CheckABookBirthdays(const struct ABook *abook, BOOL check);
 void FixAlias(const struct ABook *abook, struct ABookNode *abn, const struct ABookNode *excludeThis);
 void SetDefaultAlias(struct ABookNode *abn);
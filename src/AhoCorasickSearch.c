@@ -0,0 +1,308 @@
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "AhoCorasickSearch.h"
+#include "YAM_utilities.h"
+
+#include "Debug.h"
+
+/// FindChild
+// find the child of a node for a certain character, 0 is returned if
+// there is no such child
+static ULONG FindChild(const struct AhoCorasickContext *acc, ULONG node, UBYTE c)
+{
+  ULONG child;
+
+  if(node == 0)
+  {
+    child = acc->root[c];
+  }
+  else
+  {
+    for(child = acc->nodes[node].child; child != 0; child = acc->nodes[child].sibling)
+    {
+      if(acc->nodes[child].c == c)
+        break;
+    }
+  }
+
+  return child;
+}
+
+///
+/// AddNode
+// add a new child node to a node and return its number, 0 is returned
+// in case of an error
+static ULONG AddNode(struct AhoCorasickContext *acc, ULONG parent, UBYTE c)
+{
+  ULONG node = 0;
+
+  ENTER();
+
+  // enlarge the array if necessary
+  if(acc->numNodes >= acc->maxNodes)
+  {
+    ULONG newMax = acc->maxNodes * 2;
+    struct AhoCorasickNode *newNodes;
+
+    if((newNodes = realloc(acc->nodes, newMax * sizeof(*newNodes))) != NULL)
+    {
+      acc->nodes = newNodes;
+      acc->maxNodes = newMax;
+    }
+  }
+
+  if(acc->numNodes < acc->maxNodes)
+  {
+    struct AhoCorasickNode *acn;
+
+    node = acc->numNodes++;
+    acn = &acc->nodes[node];
+    memset(acn, 0, sizeof(*acn));
+    acn->firstID = -1;
+    acn->depth = acc->nodes[parent].depth + 1;
+    acn->c = c;
+
+    if(parent == 0)
+    {
+      acc->root[c] = node;
+    }
+    else
+    {
+      acn->sibling = acc->nodes[parent].child;
+      acc->nodes[parent].child = node;
+    }
+  }
+
+  RETURN(node);
+  return node;
+}
+
+///
+/// AhoCorasickInit
+// create a new empty context for an Aho-Corasick string search
+struct AhoCorasickContext *AhoCorasickInit(const BOOL caseSensitive)
+{
+  struct AhoCorasickContext *acc;
+
+  ENTER();
+
+  if((acc = calloc(1, sizeof(*acc))) != NULL)
+  {
+    acc->maxNodes = 64;
+    acc->caseSensitive = caseSensitive;
+
+    if((acc->nodes = malloc(acc->maxNodes * sizeof(*acc->nodes))) != NULL)
+    {
+      // set up the root node
+      memset(&acc->nodes[0], 0, sizeof(acc->nodes[0]));
+      acc->nodes[0].firstID = -1;
+      acc->numNodes = 1;
+    }
+    else
+    {
+      free(acc);
+      acc = NULL;
+    }
+  }
+
+  RETURN(acc);
+  return acc;
+}
+
+///
+/// AhoCorasickAddPattern
+// add a pattern to the automaton, empty patterns are not allowed
+BOOL AhoCorasickAddPattern(struct AhoCorasickContext *acc, const char *pattern, const ULONG id)
+{
+  BOOL success = FALSE;
+
+  ENTER();
+
+  if(acc != NULL && acc->prepared == FALSE && pattern != NULL && pattern[0] != '\0')
+  {
+    ULONG node = 0;
+    const char *p;
+
+    // follow the existing path as far as possible and add new nodes for the rest
+    for(p = pattern; *p != '\0' && (p == pattern || node != 0); p++)
+    {
+      char c = (acc->caseSensitive == TRUE) ? *p : tolower(*p);
+      ULONG child;
+
+      if((child = FindChild(acc, node, (UBYTE)c)) == 0)
+        child = AddNode(acc, node, (UBYTE)c);
+
+      node = child;
+    }
+
+    // enlarge the array of IDs if necessary
+    if(node != 0 && acc->numIDs >= acc->maxIDs)
+    {
+      ULONG newMax = (acc->maxIDs > 0) ? acc->maxIDs * 2 : 16;
+      struct AhoCorasickID *newIDs;
+
+      if((newIDs = realloc(acc->ids, newMax * sizeof(*newIDs))) != NULL)
+      {
+        acc->ids = newIDs;
+        acc->maxIDs = newMax;
+      }
+    }
+
+    if(node != 0 && acc->numIDs < acc->maxIDs)
+    {
+      acc->ids[acc->numIDs].id = id;
+      acc->ids[acc->numIDs].next = acc->nodes[node].firstID;
+      acc->nodes[node].firstID = acc->numIDs;
+      acc->numIDs++;
+
+      success = TRUE;
+    }
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// AhoCorasickPrepare
+// calculate the failure links of all nodes, no more patterns can be added
+// afterwards
+BOOL AhoCorasickPrepare(struct AhoCorasickContext *acc)
+{
+  BOOL success = FALSE;
+  ULONG *queue;
+
+  ENTER();
+
+  // the nodes are visited in breadth first order, so that the failure
+  // links of all shorter strings are known already
+  if(acc != NULL && (queue = malloc(acc->numNodes * sizeof(*queue))) != NULL)
+  {
+    ULONG head = 0;
+    ULONG tail = 0;
+    ULONG i;
+
+    for(i=0; i < ARRAY_SIZE(acc->root); i++)
+    {
+      if(acc->root[i] != 0)
+        queue[tail++] = acc->root[i];
+    }
+
+    while(head < tail)
+    {
+      ULONG node = queue[head++];
+      ULONG child;
+
+      for(child = acc->nodes[node].child; child != 0; child = acc->nodes[child].sibling)
+      {
+        struct AhoCorasickNode *acn = &acc->nodes[child];
+        ULONG fail = acc->nodes[node].fail;
+        ULONG next;
+
+        while((next = FindChild(acc, fail, acn->c)) == 0 && fail != 0)
+          fail = acc->nodes[fail].fail;
+
+        acn->fail = next;
+        acn->output = (acc->nodes[next].firstID != -1) ? next : acc->nodes[next].output;
+
+        queue[tail++] = child;
+      }
+    }
+
+    free(queue);
+
+    acc->prepared = TRUE;
+    success = TRUE;
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// AhoCorasickCleanup
+// free the context of an Aho-Corasick search
+void AhoCorasickCleanup(struct AhoCorasickContext *acc)
+{
+  ENTER();
+
+  if(acc != NULL)
+  {
+    free(acc->nodes);
+    free(acc->ids);
+    free(acc);
+  }
+
+  LEAVE();
+}
+
+///
+/// AhoCorasickSearch
+// search all patterns in a string with a single pass, the context must be
+// prepared first using AhoCorasickPrepare()
+void AhoCorasickSearch(const struct AhoCorasickContext *acc, const char *string, AhoCorasickMatchFunc *matchFunc, void *userData)
+{
+  ENTER();
+
+  if(acc != NULL && acc->prepared == TRUE)
+  {
+    const struct AhoCorasickNode *nodes = acc->nodes;
+    BOOL caseSensitive = acc->caseSensitive;
+    ULONG node = 0;
+    const char *s;
+
+    for(s = string; *s != '\0'; s++)
+    {
+      char c = (caseSensitive == TRUE) ? *s : tolower(*s);
+      ULONG next;
+      ULONG out;
+
+      while((next = FindChild(acc, node, (UBYTE)c)) == 0 && node != 0)
+        node = nodes[node].fail;
+
+      node = next;
+
+      // report all patterns ending at this position
+      for(out = (nodes[node].firstID != -1) ? node : nodes[node].output; out != 0; out = nodes[out].output)
+      {
+        LONG id;
+
+        for(id = nodes[out].firstID; id != -1; id = acc->ids[id].next)
+          matchFunc(acc->ids[id].id, s - nodes[out].depth + 1, userData);
+      }
+    }
+  }
+
+  LEAVE();
+}
+
+///
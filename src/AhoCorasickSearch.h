@@ -0,0 +1,86 @@
+#ifndef AHOCORASICKSEARCH_H
+#define AHOCORASICKSEARCH_H 1
+
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+
+#include <exec/types.h>
+
+/*
+ An implementation of the Aho/Corasick multiple string search algorithm.
+ All patterns are added to a context structure created by AhoCorasickInit()
+ and then AhoCorasickPrepare() must be called once to set up the failure
+ links of the automaton. Afterwards a single pass over a string reports
+ all occurences of all patterns to a callback function. Finally the
+ context must be freed using AhoCorasickCleanup().
+
+ Details about the Aho/Corasick string search algorithm can be found here:
+   http://en.wikipedia.org/wiki/Aho%E2%80%93Corasick_string_matching_algorithm
+*/
+
+// called for each occurence of a pattern, 'match' points to the first
+// character of the occurence within the searched string
+typedef void AhoCorasickMatchFunc(ULONG id, const char *match, void *userData);
+
+struct AhoCorasickNode
+{
+  ULONG child;     // the first child node, 0 if there is none
+  ULONG sibling;   // the next node with the same parent, 0 if there is none
+  ULONG fail;      // the node of the longest proper suffix
+  ULONG output;    // the next node along the failure links which ends a pattern
+  LONG firstID;    // the first pattern ending in this node, -1 if there is none
+  ULONG depth;     // the length of the string leading to this node
+  UBYTE c;         // the character leading to this node
+};
+
+struct AhoCorasickID
+{
+  ULONG id;        // the ID of the pattern
+  LONG next;       // the next pattern ending in the same node, -1 if there is none
+};
+
+struct AhoCorasickContext
+{
+  struct AhoCorasickNode *nodes; // all nodes, the first one is the root
+  ULONG numNodes;
+  ULONG maxNodes;
+  struct AhoCorasickID *ids;     // the IDs of all patterns
+  ULONG numIDs;
+  ULONG maxIDs;
+  ULONG root[256];               // the children of the root node for faster lookups
+  BOOL caseSensitive;
+  BOOL prepared;
+};
+
+struct AhoCorasickContext *AhoCorasickInit(const BOOL caseSensitive);
+BOOL AhoCorasickAddPattern(struct AhoCorasickContext *acc, const char *pattern, const ULONG id);
+BOOL AhoCorasickPrepare(struct AhoCorasickContext *acc);
+void AhoCorasickCleanup(struct AhoCorasickContext *acc);
+void AhoCorasickSearch(const struct AhoCorasickContext *acc, const char *string, AhoCorasickMatchFunc *matchFunc, void *userData);
+
+#endif /* AHOCORASICKSEARCH_H */
@@ -31,6 +31,9 @@
 #include <math.h>
 #include <float.h>
 
+#include <clib/alib_protos.h>
+#include <libraries/iffparse.h>
+#include <libraries/mui.h>
 #include <proto/exec.h>
 #include <proto/dos.h>
 
@@ -49,6 +52,7 @@
 #include "FileInfo.h"
 #include "Locale.h"
 #include "MethodStack.h"
+#include "Threads.h"
 
 #include "Debug.h"
 
@@ -57,6 +61,29 @@
 #define BAYES_MAX_TOKEN_LENGTH  12
 
 #define SPAMDATAFILE            ".spamdata"
+#define SPAMLOGFILE             ".spamdata.log"
+#define SPAMTEMPFILE            ".spamdata.tmp"
+
+#define SPAMDATA_VER            (MAKE_ID('Y','S','D','2'))
+#define SPAMLOG_VER             (MAKE_ID('Y','S','L','1'))
+
+// the training log is merged into the training data file as soon as it is
+// larger than this and larger than a quarter of the training data file
+#define MIN_MERGE_LOG_SIZE      (64 * 1024)
+
+// the number of threads for classifying a batch of mails and the minimum
+// number of mails for each thread
+#define CLASSIFY_THREADS          4
+#define CLASSIFY_MAILS_PER_THREAD 8
+
+// the shared data of a batch classification
+struct BayesClassifyData
+{
+  const struct Mail **mails;    // the mails to be classified
+  BOOL *isSpam;                 // the results
+  BOOL *whiteListed;            // mails of white listed senders are not analyzed
+  struct BusyNode *busy;        // the progress gauge, may be NULL
+};
 
 // some compilers (vbcc) don't define this, so lets do it ourself
 #ifndef M_LN2
@@ -74,6 +101,27 @@ struct Token
   double distance;
 };
 
+// the header of the training data file, which is followed by the sorted non-spam
+// and spam words and finally the word strings. The file is used in memory exactly
+// as it is stored on disk.
+struct BaseHeader
+{
+  ULONG magic;        // version of the training data file (SPAMDATA_VER)
+  ULONG serial;       // generation of the file, the training log must match
+  ULONG goodCount;    // number of non-spam mails
+  ULONG badCount;     // number of spam mails
+  ULONG numGood;      // number of non-spam words
+  ULONG numBad;       // number of spam words
+  ULONG wordsSize;    // size of the word strings
+};
+
+struct BaseToken
+{
+  ULONG word;         // offset of the word within the word strings
+  ULONG length;       // length of the word
+  ULONG count;        // number of occurences
+};
+
 struct TokenEnumeration
 {
   ULONG entrySize;
@@ -83,7 +131,7 @@ struct TokenEnumeration
   char *entryLimit;
 };
 
-// the magic data we expect upon reading the data file
+// the magic data we expect upon reading an old style data file
 static const unsigned char magicCookie[] = { '\xFE', '\xED', '\xFA', '\xCE' };
 
 /*** Static functions ***/
@@ -132,46 +180,6 @@ static BOOL tokenizerClearTokens(struct Tokenizer *t)
   return ok;
 }
 
-///
-/// optimizeToken
-// optimize a token table
-static enum HashTableOperator optimizeToken(UNUSED struct HashTable *table,
-                                            struct HashEntryHeader *entry,
-                                            UNUSED ULONG number,
-                                            void *arg)
-{
-  enum HashTableOperator result;
-  struct Token *token = (struct Token *)entry;
-
-  ENTER();
-
-  // Check whether the token's count value is less or equal to the
-  // threshold. If yes, then this token should be removed.
-  if(token->count <= (ULONG)arg)
-    result = htoNext|htoRemove;
-  else
-    result = htoNext;
-
-  RETURN(result);
-  return result;
-}
-
-///
-/// tokenizerOptimizeTokens
-// Optimize a token table and return the number of removed words
-static ULONG tokenizerOptimizeTokens(struct Tokenizer *t,
-                                     const ULONG maxCount)
-{
-  ULONG num;
-
-  ENTER();
-
-  num = HashTableEnumerate(&t->tokenTable, optimizeToken, (void *)maxCount);
-
-  RETURN(num);
-  return num;
-}
-
 ///
 /// tokenizerGet
 // look up a word in the token table
@@ -240,31 +248,6 @@ static struct Token *tokenizerAdd(struct Tokenizer *t,
   return token;
 }
 
-///
-/// tokenizerRemove
-// remove <count> occurences of word from the token table
-static void tokenizerRemove(struct Tokenizer *t,
-                            const char *word,
-                            const ULONG count)
-{
-  struct Token *token;
-
-  ENTER();
-
-  if((token = tokenizerGet(t, word)) != NULL)
-  {
-    if(token->count >= count)
-    {
-      token->count -= count;
-
-      if(token->count == 0)
-        HashTableRawRemove(&t->tokenTable, (struct HashEntryHeader *)token);
-    }
-  }
-
-  LEAVE();
-}
-
 ///
 /// isDecimalNumber
 // check if <word> is a decimal number
@@ -669,41 +652,6 @@ static struct Token *tokenizerCopyTokens(const struct Tokenizer *t)
   return tokens;
 }
 
-///
-/// tokenizerForgetTokens
-// remove all words of the enumeration from the token table
-static void tokenizerForgetTokens(struct Tokenizer *t,
-                                  struct TokenEnumeration *te)
-{
-  struct Token *token;
-
-  ENTER();
-
-  // if we are forgetting the tokens for a message, should only substract 1 from the occurence
-  // count for that token in the training set, because we assume we only bumped the training
-  // set count once per message containing the token
-  while((token = tokenEnumerationNext(te)) != NULL)
-    tokenizerRemove(t, token->word, 1);
-
-  LEAVE();
-}
-
-///
-/// tokenizerRememberTokens
-// put all words of the enumeration back into the token table
-static void tokenizerRememberTokens(struct Tokenizer *t,
-                                    struct TokenEnumeration *te)
-{
-  struct Token *token;
-
-  ENTER();
-
-  while((token = tokenEnumerationNext(te)) != NULL)
-    tokenizerAdd(t, token->word, NULL, 1);
-
-  LEAVE();
-}
-
 ///
 /// tokenAnalyzerInit
 // initialize the analyzer
@@ -717,17 +665,66 @@ static BOOL tokenAnalyzerInit(void)
   G->spamFilter.goodCount = 0;
   G->spamFilter.badCount = 0;
   G->spamFilter.numDirtyingMessages = 0;
+  G->spamFilter.goodTokens.base = NULL;
+  G->spamFilter.goodTokens.numBase = 0;
+  G->spamFilter.goodTokens.numWords = 0;
+  G->spamFilter.badTokens.base = NULL;
+  G->spamFilter.badTokens.numBase = 0;
+  G->spamFilter.badTokens.numWords = 0;
+  G->spamFilter.baseImage = NULL;
+  G->spamFilter.baseSize = 0;
+  G->spamFilter.baseWords = NULL;
+  G->spamFilter.baseWordsSize = 0;
+  G->spamFilter.serial = 0;
+  G->spamFilter.logStream = NULL;
 
   memset(&G->spamFilter.lockSema, 0, sizeof(G->spamFilter.lockSema));
   InitSemaphore(&G->spamFilter.lockSema);
 
-  if(tokenizerInit(&G->spamFilter.goodTokens) == TRUE && tokenizerInit(&G->spamFilter.badTokens) == TRUE)
+  if(tokenizerInit(&G->spamFilter.goodTokens.changes) == TRUE && tokenizerInit(&G->spamFilter.badTokens.changes) == TRUE)
     result = TRUE;
 
   RETURN(result);
   return result;
 }
 
+///
+/// tokenAnalyzerFreeBase
+// forget about the words of the training data file
+static void tokenAnalyzerFreeBase(void)
+{
+  ENTER();
+
+  free(G->spamFilter.baseImage);
+  G->spamFilter.baseImage = NULL;
+  G->spamFilter.baseSize = 0;
+  G->spamFilter.baseWords = NULL;
+  G->spamFilter.baseWordsSize = 0;
+
+  G->spamFilter.goodTokens.base = NULL;
+  G->spamFilter.goodTokens.numBase = 0;
+  G->spamFilter.badTokens.base = NULL;
+  G->spamFilter.badTokens.numBase = 0;
+
+  LEAVE();
+}
+
+///
+/// tokenAnalyzerCloseLog
+// close the training log
+static void tokenAnalyzerCloseLog(void)
+{
+  ENTER();
+
+  if(G->spamFilter.logStream != NULL)
+  {
+    fclose(G->spamFilter.logStream);
+    G->spamFilter.logStream = NULL;
+  }
+
+  LEAVE();
+}
+
 ///
 /// tokenAnalyzerCleanup
 // clean up the analyzer
@@ -737,8 +734,10 @@ static void tokenAnalyzerCleanup(void)
 
   ObtainSemaphore(&G->spamFilter.lockSema);
 
-  tokenizerCleanup(&G->spamFilter.goodTokens);
-  tokenizerCleanup(&G->spamFilter.badTokens);
+  tokenizerCleanup(&G->spamFilter.goodTokens.changes);
+  tokenizerCleanup(&G->spamFilter.badTokens.changes);
+  tokenAnalyzerFreeBase();
+  tokenAnalyzerCloseLog();
 
   ReleaseSemaphore(&G->spamFilter.lockSema);
 
@@ -746,45 +745,297 @@ static void tokenAnalyzerCleanup(void)
 }
 
 ///
-/// writeTokens
-// write the tokens of a token table to a stream
-static BOOL writeTokens(FILE *stream,
-                        const struct Tokenizer *t)
+/// corpusGetBase
+// look up a word in the sorted words of the training data file
+static const struct BaseToken *corpusGetBase(const struct TokenCorpus *corpus,
+                                             const char *word)
 {
-  ULONG tokenCount = t->tokenTable.entryCount;
+  const struct BaseToken *result = NULL;
+  ULONG low = 0;
+  ULONG high = corpus->numBase;
 
   ENTER();
 
-  if(WriteUInt32(stream, tokenCount) != 1)
+  while(low < high)
   {
-    RETURN(FALSE);
-    return FALSE;
+    ULONG mid = low + (high - low) / 2;
+    const struct BaseToken *token = &corpus->base[mid];
+    int cmp;
+
+    // don't trust the offsets of a damaged file
+    if(token->word >= G->spamFilter.baseWordsSize)
+      break;
+
+    cmp = strcmp(word, &G->spamFilter.baseWords[token->word]);
+    if(cmp == 0)
+    {
+      result = token;
+      break;
+    }
+    else if(cmp < 0)
+      high = mid;
+    else
+      low = mid + 1;
   }
 
-  if(tokenCount > 0)
+  RETURN(result);
+  return result;
+}
+
+///
+/// corpusGetCount
+// return how often a word occured in the corpus
+static ULONG corpusGetCount(struct TokenCorpus *corpus,
+                            const char *word)
+{
+  struct Token *token;
+  ULONG count;
+
+  ENTER();
+
+  // the changed words take precedence over the training data file
+  if((token = tokenizerGet(&corpus->changes, word)) != NULL)
   {
-    struct TokenEnumeration te;
-    ULONG i;
+    count = token->count;
+  }
+  else
+  {
+    const struct BaseToken *baseToken;
 
-    tokenEnumerationInit(&te, t);
-    for(i = 0; i < tokenCount; i++)
+    if((baseToken = corpusGetBase(corpus, word)) != NULL)
+      count = baseToken->count;
+    else
+      count = 0;
+  }
+
+  RETURN(count);
+  return count;
+}
+
+///
+/// corpusChangeToken
+// add or remove one occurence of a word to/from the corpus
+static void corpusChangeToken(struct TokenCorpus *corpus,
+                              const char *word,
+                              const BOOL add)
+{
+  struct Token *token;
+  const struct BaseToken *baseToken;
+
+  ENTER();
+
+  baseToken = corpusGetBase(corpus, word);
+
+  if((token = tokenizerGet(&corpus->changes, word)) == NULL)
+  {
+    // remember the word as changed, starting with the count of the training data file
+    token = tokenizerAdd(&corpus->changes, word, NULL, (baseToken != NULL) ? baseToken->count : 0);
+  }
+
+  if(token != NULL)
+  {
+    if(add == TRUE)
     {
-      struct Token *token = tokenEnumerationNext(&te);
-      ULONG length = token->length;
+      if(token->count == 0)
+        corpus->numWords++;
 
-      if(WriteUInt32(stream, token->count) != 1)
-        break;
+      token->count++;
+    }
+    else
+    {
+      if(token->count > 0)
+      {
+        token->count--;
 
-      if(WriteUInt32(stream, length) != 1)
-        break;
+        if(token->count == 0)
+          corpus->numWords--;
+      }
 
-      if(fwrite(token->word, length, 1, stream) != 1)
-        break;
+      // a word of the training data file must be kept with a zero count to hide
+      // the old count, other words can be forgotten completely
+      if(token->count == 0 && baseToken == NULL)
+        HashTableRawRemove(&corpus->changes.tokenTable, (struct HashEntryHeader *)token);
     }
   }
 
-  RETURN(TRUE);
-  return TRUE;
+  LEAVE();
+}
+
+///
+/// corpusForgetTokens
+// remove all words of the enumeration from the corpus
+static void corpusForgetTokens(struct TokenCorpus *corpus,
+                               struct TokenEnumeration *te)
+{
+  struct Token *token;
+
+  ENTER();
+
+  // if we are forgetting the tokens for a message, should only substract 1 from the occurence
+  // count for that token in the training set, because we assume we only bumped the training
+  // set count once per message containing the token
+  while((token = tokenEnumerationNext(te)) != NULL)
+    corpusChangeToken(corpus, token->word, FALSE);
+
+  LEAVE();
+}
+
+///
+/// corpusRememberTokens
+// put all words of the enumeration back into the corpus
+static void corpusRememberTokens(struct TokenCorpus *corpus,
+                                 struct TokenEnumeration *te)
+{
+  struct Token *token;
+
+  ENTER();
+
+  while((token = tokenEnumerationNext(te)) != NULL)
+    corpusChangeToken(corpus, token->word, TRUE);
+
+  LEAVE();
+}
+
+///
+/// corpusClear
+// forget all words of a corpus
+static void corpusClear(struct TokenCorpus *corpus)
+{
+  ENTER();
+
+  tokenizerClearTokens(&corpus->changes);
+  corpus->base = NULL;
+  corpus->numBase = 0;
+  corpus->numWords = 0;
+
+  LEAVE();
+}
+
+///
+/// compareWords
+// compare two tokens by their words
+static int compareWords(const void *p1,
+                        const void *p2)
+{
+  const struct Token *t1 = (const struct Token *)p1;
+  const struct Token *t2 = (const struct Token *)p2;
+  int cmp;
+
+  ENTER();
+
+  cmp = strcmp(t1->word, t2->word);
+
+  RETURN(cmp);
+  return cmp;
+}
+
+///
+/// corpusMerge
+// merge the sorted changed words of a corpus with the words of the training data
+// file, dropping all words which occured <maxCount> times or less. If <out> is NULL
+// the resulting words are just counted.
+static ULONG corpusMerge(const struct TokenCorpus *corpus,
+                         const struct Token *changes,
+                         const ULONG numChanges,
+                         const ULONG maxCount,
+                         struct BaseToken *out,
+                         char *words,
+                         ULONG *wordsSize)
+{
+  ULONG numOut = 0;
+  ULONG b = 0;
+  ULONG c = 0;
+
+  ENTER();
+
+  while(b < corpus->numBase || c < numChanges)
+  {
+    const char *word;
+    ULONG length;
+    ULONG count;
+    int cmp;
+
+    if(b >= corpus->numBase)
+      cmp = 1;
+    else if(c >= numChanges)
+      cmp = -1;
+    else if(corpus->base[b].word >= G->spamFilter.baseWordsSize)
+      cmp = -1;
+    else
+      cmp = strcmp(&G->spamFilter.baseWords[corpus->base[b].word], changes[c].word);
+
+    if(cmp < 0)
+    {
+      // an unchanged word of the training data file, skip it if it is damaged
+      if(corpus->base[b].word < G->spamFilter.baseWordsSize)
+      {
+        word = &G->spamFilter.baseWords[corpus->base[b].word];
+        length = strlen(word);
+        count = corpus->base[b].count;
+      }
+      else
+      {
+        word = NULL;
+        length = 0;
+        count = 0;
+      }
+      b++;
+    }
+    else
+    {
+      // a changed word, which overrides the same word of the training data file
+      word = changes[c].word;
+      length = changes[c].length;
+      count = changes[c].count;
+      c++;
+
+      if(cmp == 0)
+        b++;
+    }
+
+    if(word != NULL && count > maxCount)
+    {
+      if(out != NULL)
+      {
+        out[numOut].word = *wordsSize;
+        out[numOut].length = length;
+        out[numOut].count = count;
+        memcpy(&words[*wordsSize], word, length+1);
+      }
+
+      *wordsSize += length+1;
+      numOut++;
+    }
+  }
+
+  RETURN(numOut);
+  return numOut;
+}
+
+///
+/// corpusSortChanges
+// build an alphabetically sorted copy of the changed words of a corpus
+static BOOL corpusSortChanges(const struct TokenCorpus *corpus,
+                              struct Token **changes,
+                              ULONG *numChanges)
+{
+  BOOL result = TRUE;
+
+  ENTER();
+
+  *numChanges = corpus->changes.tokenTable.entryCount;
+  *changes = NULL;
+
+  if(*numChanges > 0)
+  {
+    if((*changes = tokenizerCopyTokens(&corpus->changes)) != NULL)
+      qsort(*changes, *numChanges, sizeof(**changes), compareWords);
+    else
+      result = FALSE;
+  }
+
+  RETURN(result);
+  return result;
 }
 
 ///
@@ -885,21 +1136,24 @@ static void tokenAnalyzerResetTrainingData(void)
 
   ObtainSemaphore(&G->spamFilter.lockSema);
 
-  if(G->spamFilter.goodCount != 0 || G->spamFilter.goodTokens.tokenTable.entryCount != 0)
-  {
-    tokenizerClearTokens(&G->spamFilter.goodTokens);
-    G->spamFilter.goodCount = 0;
-  }
+  corpusClear(&G->spamFilter.goodTokens);
+  G->spamFilter.goodCount = 0;
 
-  if(G->spamFilter.badCount != 0 || G->spamFilter.badTokens.tokenTable.entryCount != 0)
-  {
-    tokenizerClearTokens(&G->spamFilter.badTokens);
-    G->spamFilter.badCount = 0;
-  }
+  corpusClear(&G->spamFilter.badTokens);
+  G->spamFilter.badCount = 0;
+
+  tokenAnalyzerFreeBase();
+  tokenAnalyzerCloseLog();
+  G->spamFilter.serial = 0;
 
   // prepare the filename for analysis
   AddPath(fname, G->MA_MailDir, SPAMDATAFILE, sizeof(fname));
 
+  if(FileExists(fname) == TRUE)
+    DeleteFile(fname);
+
+  AddPath(fname, G->MA_MailDir, SPAMLOGFILE, sizeof(fname));
+
   if(FileExists(fname) == TRUE)
     DeleteFile(fname);
 
@@ -909,63 +1163,392 @@ static void tokenAnalyzerResetTrainingData(void)
 }
 
 ///
-/// tokenAnalyzerOptimizeTrainingData
-// Optimize the training data by filtering out words which occured only once so far
-static void tokenAnalyzerOptimizeTrainingData(void)
+/// tokenAnalyzerWriteTrainingData
+// merge the changed words into the training data file and write it to disk,
+// dropping all words which occured <maxCount> times or less. The new file
+// replaces the old one in memory, too, and the training log is no longer
+// needed afterwards. Must be called with the semaphore obtained exclusively.
+static BOOL tokenAnalyzerWriteTrainingData(const ULONG maxCount)
 {
+  BOOL result = FALSE;
+  struct Token *goodChanges = NULL;
+  struct Token *badChanges = NULL;
+  ULONG numGoodChanges;
+  ULONG numBadChanges;
+
   ENTER();
 
-  ObtainSemaphore(&G->spamFilter.lockSema);
+  STARTCLOCK(DBF_SPAM);
 
-  if(G->spamFilter.goodTokens.tokenTable.entryCount != 0)
-    G->spamFilter.numDirtyingMessages += tokenizerOptimizeTokens(&G->spamFilter.goodTokens, 1);
+  if(corpusSortChanges(&G->spamFilter.goodTokens, &goodChanges, &numGoodChanges) == TRUE &&
+     corpusSortChanges(&G->spamFilter.badTokens, &badChanges, &numBadChanges) == TRUE)
+  {
+    ULONG numGood;
+    ULONG numBad;
+    ULONG wordsSize = 0;
+    ULONG imageSize;
+    char *image;
 
-  if(G->spamFilter.badTokens.tokenTable.entryCount != 0)
-    G->spamFilter.numDirtyingMessages += tokenizerOptimizeTokens(&G->spamFilter.badTokens, 1);
+    // count the resulting words first to get the exact size of the file
+    numGood = corpusMerge(&G->spamFilter.goodTokens, goodChanges, numGoodChanges, maxCount, NULL, NULL, &wordsSize);
+    numBad = corpusMerge(&G->spamFilter.badTokens, badChanges, numBadChanges, maxCount, NULL, NULL, &wordsSize);
 
-  ReleaseSemaphore(&G->spamFilter.lockSema);
+    imageSize = sizeof(struct BaseHeader) + (numGood + numBad) * sizeof(struct BaseToken) + wordsSize;
+
+    if((image = malloc(imageSize)) != NULL)
+    {
+      struct BaseHeader *header = (struct BaseHeader *)image;
+      struct BaseToken *goodBase = (struct BaseToken *)&header[1];
+      struct BaseToken *badBase = &goodBase[numGood];
+      char *words = (char *)&badBase[numBad];
+      char fname[SIZE_PATHFILE];
+      char tname[SIZE_PATHFILE];
+      FILE *stream;
+
+      header->magic = SPAMDATA_VER;
+      header->serial = G->spamFilter.serial + 1;
+      header->goodCount = G->spamFilter.goodCount;
+      header->badCount = G->spamFilter.badCount;
+      header->numGood = numGood;
+      header->numBad = numBad;
+      header->wordsSize = wordsSize;
+
+      wordsSize = 0;
+      corpusMerge(&G->spamFilter.goodTokens, goodChanges, numGoodChanges, maxCount, goodBase, words, &wordsSize);
+      corpusMerge(&G->spamFilter.badTokens, badChanges, numBadChanges, maxCount, badBase, words, &wordsSize);
+
+      AddPath(fname, G->MA_MailDir, SPAMDATAFILE, sizeof(fname));
+      AddPath(tname, G->MA_MailDir, SPAMTEMPFILE, sizeof(tname));
+
+      // write the new file under a temporary name first, so a failure doesn't
+      // destroy the existing training data
+      if((stream = fopen(tname, "wb")) != NULL)
+      {
+        BOOL written;
+
+        written = (fwrite(image, imageSize, 1, stream) == 1);
+
+        if(fclose(stream) != 0)
+          written = FALSE;
+
+        if(written == TRUE)
+        {
+          DeleteFile(fname);
+
+          if(RenameFile(tname, fname) == TRUE)
+          {
+            // the log belongs to the previous file, it is obsolete now
+            tokenAnalyzerCloseLog();
+            AddPath(fname, G->MA_MailDir, SPAMLOGFILE, sizeof(fname));
+            DeleteFile(fname);
+
+            // the changed words point into the tables which are cleared now,
+            // hence this must happen after the words have been merged
+            tokenizerClearTokens(&G->spamFilter.goodTokens.changes);
+            tokenizerClearTokens(&G->spamFilter.badTokens.changes);
+
+            // use the new file from now on
+            tokenAnalyzerFreeBase();
+            G->spamFilter.baseImage = image;
+            G->spamFilter.baseSize = imageSize;
+            G->spamFilter.baseWords = words;
+            G->spamFilter.baseWordsSize = wordsSize;
+            G->spamFilter.serial = header->serial;
+            G->spamFilter.goodTokens.base = goodBase;
+            G->spamFilter.goodTokens.numBase = numGood;
+            G->spamFilter.goodTokens.numWords = numGood;
+            G->spamFilter.badTokens.base = badBase;
+            G->spamFilter.badTokens.numBase = numBad;
+            G->spamFilter.badTokens.numWords = numBad;
+
+            // make sure the image isn't free()'d
+            image = NULL;
+
+            G->spamFilter.numDirtyingMessages = 0;
+
+            D(DBF_SPAM, "wrote training data with %ld good and %ld bad words", numGood, numBad);
+
+            result = TRUE;
+          }
+          else
+            E(DBF_SPAM, "could not rename '%s' to '%s'", tname, fname);
+        }
+        else
+        {
+          E(DBF_SPAM, "could not write training data file '%s'", tname);
+          DeleteFile(tname);
+        }
+      }
+
+      free(image);
+    }
+  }
+
+  free(goodChanges);
+  free(badChanges);
+
+  STOPCLOCK(DBF_SPAM, "writing training data");
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// tokenAnalyzerOptimizeTrainingData
+// Optimize the training data by filtering out words which occured only once so far
+static void tokenAnalyzerOptimizeTrainingData(void)
+{
+  ENTER();
+
+  ObtainSemaphore(&G->spamFilter.lockSema);
+
+  if(G->spamFilter.goodTokens.numWords != 0 || G->spamFilter.badTokens.numWords != 0)
+    tokenAnalyzerWriteTrainingData(1);
+
+  ReleaseSemaphore(&G->spamFilter.lockSema);
 
   LEAVE();
 }
 
 ///
-/// tokenAnalyzerWriteTraningData
-// write the accumulated training data to disk
-static void tokenAnalyzerWriteTrainingData(void)
+/// tokenAnalyzerApplyClassification
+// substract the tokens from the old class and add them to the new class
+static void tokenAnalyzerApplyClassification(const struct Tokenizer *t,
+                                             const enum BayesClassification oldClass,
+                                             const enum BayesClassification newClass)
 {
-  char fname[SIZE_PATHFILE];
-  FILE *stream;
+  struct TokenEnumeration te;
 
   ENTER();
 
-  // prepare the filename for saving
-  AddPath(fname, G->MA_MailDir, SPAMDATAFILE, sizeof(fname));
+  switch(oldClass)
+  {
+    case BC_SPAM:
+    {
+      // remove tokens from spam corpus
+      if(G->spamFilter.badCount > 0)
+      {
+        G->spamFilter.badCount--;
+        G->spamFilter.numDirtyingMessages++;
+        tokenEnumerationInit(&te, t);
+        corpusForgetTokens(&G->spamFilter.badTokens, &te);
+      }
+    }
+    break;
+
+    case BC_HAM:
+    {
+      // remove tokens from ham corpus
+      if(G->spamFilter.goodCount > 0)
+      {
+        G->spamFilter.goodCount--;
+        G->spamFilter.numDirtyingMessages++;
+        tokenEnumerationInit(&te, t);
+        corpusForgetTokens(&G->spamFilter.goodTokens, &te);
+      }
+    }
+    break;
+
+    case BC_OTHER:
+      // nothing
+    break;
+  }
 
-  // open the .spamdata file for binary write
-  if((stream = fopen(fname, "wb")) != NULL)
+  switch(newClass)
   {
-    setvbuf(stream, NULL, _IOFBF, SIZE_FILEBUF);
+    case BC_SPAM:
+    {
+      // put tokens into spam corpus
+      G->spamFilter.badCount++;
+      G->spamFilter.numDirtyingMessages++;
+      tokenEnumerationInit(&te, t);
+      corpusRememberTokens(&G->spamFilter.badTokens, &te);
+    }
+    break;
 
-    if(fwrite(magicCookie, sizeof(magicCookie), 1, stream) == 1 &&
-       WriteUInt32(stream, G->spamFilter.goodCount) == 1 &&
-       WriteUInt32(stream, G->spamFilter.badCount) == 1 &&
-       writeTokens(stream, &G->spamFilter.goodTokens) == 1 &&
-       writeTokens(stream, &G->spamFilter.badTokens) == 1)
+    case BC_HAM:
     {
-      // everything is ok
-      fclose(stream);
-      G->spamFilter.numDirtyingMessages = 0;
+      // put tokens into ham corpus
+      G->spamFilter.goodCount++;
+      G->spamFilter.numDirtyingMessages++;
+      tokenEnumerationInit(&te, t);
+      corpusRememberTokens(&G->spamFilter.goodTokens, &te);
+    }
+    break;
+
+    case BC_OTHER:
+      // nothing
+    break;
+  }
+
+  LEAVE();
+}
+
+///
+/// tokenAnalyzerWriteLog
+// append a classification change to the training log
+static void tokenAnalyzerWriteLog(const struct Tokenizer *t,
+                                  const enum BayesClassification oldClass,
+                                  const enum BayesClassification newClass)
+{
+  ENTER();
+
+  if(G->spamFilter.logStream == NULL)
+  {
+    char fname[SIZE_PATHFILE];
+    BOOL newLog;
+
+    AddPath(fname, G->MA_MailDir, SPAMLOGFILE, sizeof(fname));
+    newLog = (FileExists(fname) == FALSE);
+
+    if((G->spamFilter.logStream = fopen(fname, "ab")) != NULL)
+    {
+      setvbuf(G->spamFilter.logStream, NULL, _IOFBF, SIZE_FILEBUF);
+
+      // a new log starts with the generation of the training data file it belongs to
+      if(newLog == TRUE)
+      {
+        WriteUInt32(G->spamFilter.logStream, SPAMLOG_VER);
+        WriteUInt32(G->spamFilter.logStream, G->spamFilter.serial);
+      }
     }
     else
+      E(DBF_SPAM, "could not open training log '%s'", fname);
+  }
+
+  if(G->spamFilter.logStream != NULL)
+  {
+    FILE *stream = G->spamFilter.logStream;
+    struct TokenEnumeration te;
+    struct Token *token;
+
+    WriteUInt32(stream, oldClass);
+    WriteUInt32(stream, newClass);
+    WriteUInt32(stream, t->tokenTable.entryCount);
+
+    tokenEnumerationInit(&te, t);
+    while((token = tokenEnumerationNext(&te)) != NULL)
     {
-      // anything went wrong, so delete the training data file
+      WriteUInt32(stream, token->length);
+      fwrite(token->word, token->length, 1, stream);
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// tokenAnalyzerReadLog
+// replay the classification changes of the training log
+static BOOL tokenAnalyzerReadLog(void)
+{
+  BOOL result = TRUE;
+  char fname[SIZE_PATHFILE];
+  LONG fileSize;
+
+  ENTER();
+
+  AddPath(fname, G->MA_MailDir, SPAMLOGFILE, sizeof(fname));
+
+  if(ObtainFileInfo(fname, FI_SIZE, &fileSize) == TRUE && fileSize > 0)
+  {
+    FILE *stream;
+
+    if((stream = fopen(fname, "rb")) != NULL)
+    {
+      ULONG version;
+      ULONG serial;
+      BOOL outdated = FALSE;
+      BOOL damaged = FALSE;
+
+      setvbuf(stream, NULL, _IOFBF, SIZE_FILEBUF);
+
+      if(ReadUInt32(stream, &version) == 1 && version == SPAMLOG_VER &&
+         ReadUInt32(stream, &serial) == 1 && serial == G->spamFilter.serial)
+      {
+        ULONG bufferSize = BAYES_MAX_TOKEN_LENGTH * 4;
+        char *buffer;
+
+        if((buffer = malloc(bufferSize)) != NULL)
+        {
+          ULONG oldClass;
+          ULONG newClass;
+          ULONG numTokens;
+          ULONG numRecords = 0;
+
+          while(result == TRUE && damaged == FALSE && ReadUInt32(stream, &oldClass) == 1)
+          {
+            struct Tokenizer t;
+
+            if(oldClass > BC_OTHER ||
+               ReadUInt32(stream, &newClass) != 1 || newClass > BC_OTHER ||
+               ReadUInt32(stream, &numTokens) != 1 || numTokens > (ULONG)fileSize)
+            {
+              damaged = TRUE;
+            }
+            else if(tokenizerInit(&t) == TRUE)
+            {
+              ULONG i;
+
+              for(i = 0; i < numTokens && damaged == FALSE; i++)
+              {
+                ULONG length;
+
+                if(ReadUInt32(stream, &length) == 1 && length < bufferSize &&
+                   fread(buffer, length, 1, stream) == 1)
+                {
+                  buffer[length] = '\0';
+                  tokenizerAdd(&t, buffer, NULL, 1);
+                }
+                else
+                  damaged = TRUE;
+              }
+
+              // a partly written record is ignored completely
+              if(damaged == FALSE)
+              {
+                tokenAnalyzerApplyClassification(&t, oldClass, newClass);
+                numRecords++;
+              }
+
+              tokenizerCleanup(&t);
+            }
+            else
+              result = FALSE;
+          }
+
+          D(DBF_SPAM, "replayed %ld records of training log", numRecords);
+
+          free(buffer);
+        }
+        else
+          result = FALSE;
+      }
+      else
+      {
+        // the log belongs to another training data file
+        W(DBF_SPAM, "ignoring outdated training log '%s'", fname);
+        outdated = TRUE;
+      }
+
       fclose(stream);
 
-      DeleteFile(fname);
+      if(outdated == TRUE)
+      {
+        DeleteFile(fname);
+      }
+      else if(damaged == TRUE && result == TRUE)
+      {
+        // new records must not be appended to a damaged log, hence we merge
+        // everything we got so far, which also removes the log
+        W(DBF_SPAM, "training log '%s' is damaged", fname);
+        result = tokenAnalyzerWriteTrainingData(0);
+      }
     }
   }
 
-  LEAVE();
+  RETURN(result);
+  return result;
 }
 
 ///
@@ -978,10 +1561,18 @@ static void tokenAnalyzerReadTrainingData(void)
 
   ENTER();
 
+  STARTCLOCK(DBF_SPAM);
+
   // prepare the filename for loading
   AddPath(fname, G->MA_MailDir, SPAMDATAFILE, sizeof(fname));
 
-  if(ObtainFileInfo(fname, FI_SIZE, &fileSize) == TRUE && fileSize > 0)
+  if(ObtainFileInfo(fname, FI_SIZE, &fileSize) == FALSE || fileSize == 0)
+  {
+    // without a training data file there might be a training log nevertheless
+    if(tokenAnalyzerReadLog() == FALSE)
+      tokenAnalyzerResetTrainingData();
+  }
+  else
   {
     FILE *stream;
 
@@ -990,6 +1581,7 @@ static void tokenAnalyzerReadTrainingData(void)
     {
       unsigned char cookie[4];
       BOOL success = FALSE;
+      BOOL convert = FALSE;
 
       setvbuf(stream, NULL, _IOFBF, SIZE_FILEBUF);
 
@@ -997,22 +1589,83 @@ static void tokenAnalyzerReadTrainingData(void)
 
       if(memcmp(cookie, magicCookie, sizeof(cookie)) == 0)
       {
+        // the old format is read word by word and converted afterwards
         if(ReadUInt32(stream, &G->spamFilter.goodCount) == 1 &&
            ReadUInt32(stream, &G->spamFilter.badCount) == 1)
         {
           SHOWVALUE(DBF_SPAM, G->spamFilter.goodCount);
           SHOWVALUE(DBF_SPAM, G->spamFilter.badCount);
 
-          if(readTokens(stream, &G->spamFilter.goodTokens, fileSize) == TRUE &&
-             readTokens(stream, &G->spamFilter.badTokens, fileSize) == TRUE)
+          if(readTokens(stream, &G->spamFilter.goodTokens.changes, fileSize) == TRUE &&
+             readTokens(stream, &G->spamFilter.badTokens.changes, fileSize) == TRUE)
           {
+            G->spamFilter.goodTokens.numWords = G->spamFilter.goodTokens.changes.tokenTable.entryCount;
+            G->spamFilter.badTokens.numWords = G->spamFilter.badTokens.changes.tokenTable.entryCount;
             success = TRUE;
+            convert = TRUE;
+          }
+        }
+      }
+      else if((ULONG)fileSize > sizeof(struct BaseHeader))
+      {
+        char *image;
+
+        // the sorted tables are used exactly as they are stored, no parsing required
+        if((image = malloc(fileSize)) != NULL)
+        {
+          rewind(stream);
+
+          if(fread(image, fileSize, 1, stream) == 1)
+          {
+            struct BaseHeader *header = (struct BaseHeader *)image;
+            ULONG tableSize = (header->numGood + header->numBad) * sizeof(struct BaseToken);
+
+            if(header->magic == SPAMDATA_VER &&
+               header->numGood <= (ULONG)fileSize / sizeof(struct BaseToken) &&
+               header->numBad <= (ULONG)fileSize / sizeof(struct BaseToken) &&
+               sizeof(*header) + tableSize + header->wordsSize == (ULONG)fileSize &&
+               header->wordsSize > 0 && image[fileSize-1] == '\0')
+            {
+              struct BaseToken *goodBase = (struct BaseToken *)&header[1];
+
+              G->spamFilter.baseImage = image;
+              G->spamFilter.baseSize = fileSize;
+              G->spamFilter.baseWords = image + sizeof(*header) + tableSize;
+              G->spamFilter.baseWordsSize = header->wordsSize;
+              G->spamFilter.serial = header->serial;
+              G->spamFilter.goodCount = header->goodCount;
+              G->spamFilter.badCount = header->badCount;
+              G->spamFilter.goodTokens.base = goodBase;
+              G->spamFilter.goodTokens.numBase = header->numGood;
+              G->spamFilter.goodTokens.numWords = header->numGood;
+              G->spamFilter.badTokens.base = &goodBase[header->numGood];
+              G->spamFilter.badTokens.numBase = header->numBad;
+              G->spamFilter.badTokens.numWords = header->numBad;
+
+              SHOWVALUE(DBF_SPAM, G->spamFilter.goodCount);
+              SHOWVALUE(DBF_SPAM, G->spamFilter.badCount);
+
+              // make sure the image isn't free()'d
+              image = NULL;
+              success = TRUE;
+            }
           }
+
+          free(image);
         }
       }
 
       fclose(stream);
 
+      if(success == TRUE)
+      {
+        // now apply all changes since the file was written
+        if(convert == FALSE)
+          success = tokenAnalyzerReadLog();
+        else
+          success = tokenAnalyzerWriteTrainingData(0);
+      }
+
       if(success == FALSE)
       {
         // something went wrong during the read process, reset everything
@@ -1021,6 +1674,8 @@ static void tokenAnalyzerReadTrainingData(void)
     }
   }
 
+  STOPCLOCK(DBF_SPAM, "reading training data");
+
   LEAVE();
 }
 
@@ -1032,71 +1687,17 @@ static void tokenAnalyzerSetClassification(const struct Tokenizer *t,
                                            const enum BayesClassification oldClass,
                                            const enum BayesClassification newClass)
 {
-  struct TokenEnumeration te;
-
   ENTER();
 
-  tokenEnumerationInit(&te, t);
-
   ObtainSemaphore(&G->spamFilter.lockSema);
 
   if(oldClass != newClass)
   {
-    switch(oldClass)
-    {
-      case BC_SPAM:
-      {
-        // remove tokens from spam corpus
-        if(G->spamFilter.badCount > 0)
-        {
-          G->spamFilter.badCount--;
-          G->spamFilter.numDirtyingMessages++;
-          tokenizerForgetTokens(&G->spamFilter.badTokens, &te);
-        }
-      }
-      break;
-
-      case BC_HAM:
-      {
-        // remove tokens from ham corpus
-        if(G->spamFilter.goodCount > 0)
-        {
-          G->spamFilter.goodCount--;
-          G->spamFilter.numDirtyingMessages++;
-          tokenizerForgetTokens(&G->spamFilter.goodTokens, &te);
-        }
-      }
-      break;
-
-      case BC_OTHER:
-        // nothing
-      break;
-    }
-
-    switch(newClass)
-    {
-      case BC_SPAM:
-      {
-        // put tokens into spam corpus
-        G->spamFilter.badCount++;
-        G->spamFilter.numDirtyingMessages++;
-        tokenizerRememberTokens(&G->spamFilter.badTokens, &te);
-      }
-      break;
-
-      case BC_HAM:
-      {
-        // put tokens into ham corpus
-        G->spamFilter.goodCount++;
-        G->spamFilter.numDirtyingMessages++;
-        tokenizerRememberTokens(&G->spamFilter.goodTokens, &te);
-      }
-      break;
+    tokenAnalyzerApplyClassification(t, oldClass, newClass);
 
-      case BC_OTHER:
-        // nothing
-      break;
-    }
+    // remember the change in the log, the training data file is rewritten only
+    // once in a while
+    tokenAnalyzerWriteLog(t, oldClass, newClass);
   }
 
   ReleaseSemaphore(&G->spamFilter.lockSema);
@@ -1359,22 +1960,18 @@ static INLINE double chi2P(double chi2, double nu, int *error)
 }
 
 ///
-/// tokenAnalyzerClassifyMessage
-// classify a mail based upon the information gathered so far
-static BOOL tokenAnalyzerClassifyMessage(const struct Tokenizer *t,
-                                         const struct Mail *mail)
+/// senderIsWhiteListed
+// check whether the sender of a mail is known to send no spam at all
+static BOOL senderIsWhiteListed(const struct Mail *mail)
 {
-  BOOL isSpam;
   BOOL isInWhiteList;
 
   ENTER();
 
-  D(DBF_SPAM, "analyzing mail from '%s' with subject '%s'", mail->From.Address, mail->Subject);
-
   if(C->SpamAddressBookIsWhiteList == TRUE)
   {
     // try to find the sender's address in the address book
-    isInWhiteList = (FindPersonInABook(&G->abook, &mail->From) != NULL);
+    isInWhiteList = (FindAddressInABook(&G->abook, mail->From.Address) != NULL);
   }
   else
   {
@@ -1382,181 +1979,204 @@ static BOOL tokenAnalyzerClassifyMessage(const struct Tokenizer *t,
     isInWhiteList = FALSE;
   }
 
-  if(isInWhiteList == FALSE)
-  {
-    // the mail's sender was not found in the address book, so let's analyze the mail contents
-    struct Token *tokens = NULL;
+  if(isInWhiteList == TRUE)
+    D(DBF_SPAM, "found sender '%s' in address book, assuming non-spam", mail->From.Address);
 
-    ObtainSemaphoreShared(&G->spamFilter.lockSema);
+  RETURN(isInWhiteList);
+  return isInWhiteList;
+}
+
+///
+/// tokenAnalyzerClassifyTokens
+// classify the tokens of a mail based upon the information gathered so far,
+// the training data is only read and may be shared by several threads
+static BOOL tokenAnalyzerClassifyTokens(const struct Tokenizer *t)
+{
+  BOOL isSpam;
+  struct Token *tokens = NULL;
+
+  ENTER();
+
+  ObtainSemaphoreShared(&G->spamFilter.lockSema);
 
-    SHOWVALUE(DBF_SPAM, G->spamFilter.goodCount);
-    SHOWVALUE(DBF_SPAM, G->spamFilter.badCount);
+  SHOWVALUE(DBF_SPAM, G->spamFilter.goodCount);
+  SHOWVALUE(DBF_SPAM, G->spamFilter.badCount);
 
-    if((tokens = tokenizerCopyTokens(t)) != NULL)
+  if((tokens = tokenizerCopyTokens(t)) != NULL)
+  {
+    double nGood = G->spamFilter.goodCount;
+
+    if(nGood != 0 || G->spamFilter.goodTokens.numWords != 0)
     {
-      double nGood = G->spamFilter.goodCount;
+      double nBad = G->spamFilter.badCount;
 
-      if(nGood != 0 || G->spamFilter.goodTokens.tokenTable.entryCount != 0)
+      if(nBad != 0 || G->spamFilter.badTokens.numWords != 0)
       {
-        double nBad = G->spamFilter.badCount;
-
-        if(nBad != 0 || G->spamFilter.badTokens.tokenTable.entryCount != 0)
+        ULONG i;
+        ULONG goodClues = 0;
+        ULONG count = t->tokenTable.entryCount;
+        ULONG first;
+        ULONG last;
+        ULONG Hexp;
+        ULONG Sexp;
+        double prob;
+        double H;
+        double S;
+
+        for(i = 0; i < count; i++)
         {
-          ULONG i;
-          ULONG goodClues = 0;
-          ULONG count = t->tokenTable.entryCount;
-          ULONG first;
-          ULONG last;
-          ULONG Hexp;
-          ULONG Sexp;
-          double prob;
-          double H;
-          double S;
-
-          for(i = 0; i < count; i++)
+          struct Token *token = &tokens[i];
+          const char *word = token->word;
+          double hamCount;
+          double spamCount;
+          double denom;
+          double tokenProb;
+          double n;
+          double distance;
+
+          hamCount = corpusGetCount(&G->spamFilter.goodTokens, word);
+          spamCount = corpusGetCount(&G->spamFilter.badTokens, word);
+
+          denom = hamCount * nBad + spamCount * nGood;
+          // avoid division by zero error
+          if(denom == 0.0)
+            denom = nBad + nGood;
+
+          tokenProb = (spamCount * nGood) / denom;
+          n = hamCount + spamCount;
+          tokenProb = (0.225 + n * tokenProb) / (0.45 + n);
+          distance = fabs(tokenProb - 0.5);
+
+          if(distance >= 0.1)
           {
-            struct Token *token = &tokens[i];
-            const char *word = token->word;
-            struct Token *_t;
-            double hamCount;
-            double spamCount;
-            double denom;
-            double tokenProb;
-            double n;
-            double distance;
-
-            _t = tokenizerGet(&G->spamFilter.goodTokens, word);
-            hamCount = (_t != NULL) ? _t->count : 0;
-            _t = tokenizerGet(&G->spamFilter.badTokens, word);
-            spamCount = (_t != NULL) ? _t->count : 0;
-
-            denom = hamCount * nBad + spamCount * nGood;
-            // avoid division by zero error
-            if(denom == 0.0)
-              denom = nBad + nGood;
-
-            tokenProb = (spamCount * nGood) / denom;
-            n = hamCount + spamCount;
-            tokenProb = (0.225 + n * tokenProb) / (0.45 + n);
-            distance = fabs(tokenProb - 0.5);
-
-            if(distance >= 0.1)
-            {
-              D(DBF_SPAM, "probability for token '%s' is %.2f", word, tokenProb);
-              goodClues++;
-              token->distance = distance;
-              token->probability = tokenProb;
-            }
-            else
-            {
-              // ignore this clue
-              token->distance = -1.0;
-            }
+            D(DBF_SPAM, "probability for token '%s' is %.2f", word, tokenProb);
+            goodClues++;
+            token->distance = distance;
+            token->probability = tokenProb;
+          }
+          else
+          {
+            // ignore this clue
+            token->distance = -1.0;
           }
+        }
 
-          D(DBF_SPAM, "found %ld good clues in the first scan", goodClues);
+        D(DBF_SPAM, "found %ld good clues in the first scan", goodClues);
 
-          // sort array of token distances
-          qsort(tokens, count, sizeof(*tokens), compareTokens);
+        // sort array of token distances
+        qsort(tokens, count, sizeof(*tokens), compareTokens);
 
-          first = (goodClues > 150) ? count - 150 : 0;
-          last = count;
-          H = 1.0;
-          S = 1.0;
-          Hexp = 0;
-          Sexp = 0;
+        first = (goodClues > 150) ? count - 150 : 0;
+        last = count;
+        H = 1.0;
+        S = 1.0;
+        Hexp = 0;
+        Sexp = 0;
 
-          // reset this counter, so we can check later the real number of *really* good clues
-          goodClues = 0;
+        // reset this counter, so we can check later the real number of *really* good clues
+        goodClues = 0;
 
-          for(i = first; i < last; i++)
+        for(i = first; i < last; i++)
+        {
+          if(tokens[i].distance != -1.0)
           {
-            if(tokens[i].distance != -1.0)
-            {
-              double value;
-              int e;
+            double value;
+            int e;
 
-              goodClues++;
-              value = tokens[i].probability;
-              S *= (1.0 - value);
-              H *= value;
+            goodClues++;
+            value = tokens[i].probability;
+            S *= (1.0 - value);
+            H *= value;
 
-              // if the probability values become too small we rescale them
-              if(S < 1e-200)
-              {
-                S = frexp(S, &e);
-                Sexp += e;
-              }
-              if(H < 1e-200)
-              {
-                H = frexp(H, &e);
-                Hexp += e;
-              }
+            // if the probability values become too small we rescale them
+            if(S < 1e-200)
+            {
+              S = frexp(S, &e);
+              Sexp += e;
+            }
+            if(H < 1e-200)
+            {
+              H = frexp(H, &e);
+              Hexp += e;
             }
           }
+        }
 
-          S = log(S) + Sexp * M_LN2;
-          H = log(H) + Hexp * M_LN2;
+        S = log(S) + Sexp * M_LN2;
+        H = log(H) + Hexp * M_LN2;
 
-          D(DBF_SPAM, "found %ld good clues in the second scan", goodClues);
+        D(DBF_SPAM, "found %ld good clues in the second scan", goodClues);
 
-          if(goodClues > 0)
-          {
-            int chiError = 0;
+        if(goodClues > 0)
+        {
+          int chiError = 0;
 
-            S = chi2P(-2.0 * S, 2.0 * goodClues, &chiError);
+          S = chi2P(-2.0 * S, 2.0 * goodClues, &chiError);
 
-            if(chiError == 0)
-              H = chi2P(-2.0 * H, 2.0 * goodClues, &chiError);
+          if(chiError == 0)
+            H = chi2P(-2.0 * H, 2.0 * goodClues, &chiError);
 
-            // if any error, then toss the complete calculation
-            if(chiError != 0)
-            {
-              E(DBF_SPAM, "chi2P error, H=%.8f, S=%.8f, good clues=%ld", H, S, goodClues);
-              prob = 0.5;
-            }
-            else
-              prob = (S - H + 1.0) / 2.0;
+          // if any error, then toss the complete calculation
+          if(chiError != 0)
+          {
+            E(DBF_SPAM, "chi2P error, H=%.8f, S=%.8f, good clues=%ld", H, S, goodClues);
+            prob = 0.5;
           }
           else
-            prob = 0.5;
-
-          D(DBF_SPAM, "spam probability is %.2f, ham score: %.2f, spam score: %.2f", prob, H, S);
-          isSpam = (prob * 100 >= C->SpamProbabilityThreshold);
+            prob = (S - H + 1.0) / 2.0;
         }
         else
-        {
-          // no bad tokens so far, assume ham
-          E(DBF_SPAM, "no bad tokens so far, assuming non-spam");
-          isSpam = FALSE;
-        }
+          prob = 0.5;
+
+        D(DBF_SPAM, "spam probability is %.2f, ham score: %.2f, spam score: %.2f", prob, H, S);
+        isSpam = (prob * 100 >= C->SpamProbabilityThreshold);
       }
       else
       {
-        // no good tokens so far, assume spam
-        E(DBF_SPAM, "no good tokens so far, assuming spam");
-        isSpam = TRUE;
+        // no bad tokens so far, assume ham
+        E(DBF_SPAM, "no bad tokens so far, assuming non-spam");
+        isSpam = FALSE;
       }
-
-      free(tokens);
     }
     else
     {
-      // cannot copy tokens, assume spam
-      E(DBF_SPAM, "cannot copy tokens, assuming spam");
+      // no good tokens so far, assume spam
+      E(DBF_SPAM, "no good tokens so far, assuming spam");
       isSpam = TRUE;
     }
 
-    ReleaseSemaphore(&G->spamFilter.lockSema);
-
+    free(tokens);
   }
   else
   {
-    // sender found in address book, assume ham
-    D(DBF_SPAM, "found sender '%s' in address book, assuming non-spam", mail->From.Address);
-    isSpam = FALSE;
+    // cannot copy tokens, assume spam
+    E(DBF_SPAM, "cannot copy tokens, assuming spam");
+    isSpam = TRUE;
   }
 
+  ReleaseSemaphore(&G->spamFilter.lockSema);
+
+  RETURN(isSpam);
+  return isSpam;
+}
+
+///
+/// tokenAnalyzerClassifyMessage
+// classify a mail based upon the information gathered so far
+static BOOL tokenAnalyzerClassifyMessage(const struct Tokenizer *t,
+                                         const struct Mail *mail)
+{
+  BOOL isSpam;
+
+  ENTER();
+
+  D(DBF_SPAM, "analyzing mail from '%s' with subject '%s'", mail->From.Address, mail->Subject);
+
+  if(senderIsWhiteListed(mail) == TRUE)
+    isSpam = FALSE;
+  else
+    isSpam = tokenAnalyzerClassifyTokens(t);
+
   RETURN(isSpam);
   return isSpam;
 }
@@ -1594,18 +2214,10 @@ void BayesFilterCleanup(void)
   // check whether BayesFilterInit() has been called before, otherwise we must not access the semaphore
   if(G->spamFilter.initialized == TRUE)
   {
-    ObtainSemaphore(&G->spamFilter.lockSema);
-
-    // only write the spam training data to disk if there are any tokens and if something has changed since the last flush
-    if(G->spamFilter.numDirtyingMessages > 0 && (G->spamFilter.goodCount > 0 || G->spamFilter.badCount > 0))
-    {
-      tokenAnalyzerWriteTrainingData();
-    }
-
+    // all changes are in the training log already, which is
+    // merged into the training data file upon the next flush
     tokenAnalyzerCleanup();
 
-    ReleaseSemaphore(&G->spamFilter.lockSema);
-
     // we are no longer initialized
     G->spamFilter.initialized = FALSE;
   }
@@ -1678,6 +2290,116 @@ BOOL BayesFilterClassifyMessage(const struct Mail *mail)
   return isSpam;
 }
 
+///
+/// ClassifyBatchMessage
+// classify a single mail of a batch, this is called by several threads at once
+static void ClassifyBatchMessage(APTR userData, ULONG index)
+{
+  struct BayesClassifyData *data = (struct BayesClassifyData *)userData;
+
+  ENTER();
+
+  // white listed senders have been handled by the main thread already
+  if(data->whiteListed[index] == FALSE)
+  {
+    struct Tokenizer t;
+
+    if(tokenizerInit(&t) == TRUE)
+    {
+      D(DBF_SPAM, "classifying mail with subject '%s'", data->mails[index]->Subject);
+
+      tokenizeMail(&t, data->mails[index]);
+
+      // each mail is handled by exactly one thread, hence no locking
+      // is required to store the result
+      data->isSpam[index] = tokenAnalyzerClassifyTokens(&t);
+
+      tokenizerCleanup(&t);
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// ClassifyBatchProgress
+// update the progress gauge of a batch classification
+static BOOL ClassifyBatchProgress(APTR userData, ULONG done, ULONG count)
+{
+  struct BayesClassifyData *data = (struct BayesClassifyData *)userData;
+  BOOL result = TRUE;
+
+  ENTER();
+
+  if(data->busy != NULL && BusyProgress(data->busy, done, count) == FALSE)
+  {
+    D(DBF_SPAM, "classification aborted by user");
+    result = FALSE;
+  }
+
+  // give the GUI the chance to refresh
+  DoMethod(G->App, MUIM_Application_InputBuffered);
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// BayesFilterClassifyMessages
+// classify a number of mails at once. The mails are tokenized and analyzed
+// by a number of threads while the main thread takes part in the work as
+// well and keeps the progress gauge up to date. The results are stored in
+// the 'isSpam' array. Returns FALSE if the user aborted the classification.
+BOOL BayesFilterClassifyMessages(const struct Mail **mails, BOOL *isSpam, ULONG numMails, struct BusyNode *busy)
+{
+  BOOL result = TRUE;
+  struct BayesClassifyData data;
+
+  ENTER();
+
+  memset(&data, 0, sizeof(data));
+  data.mails = mails;
+  data.isSpam = isSpam;
+  data.busy = busy;
+
+  if(numMails > 0 &&
+     (data.whiteListed = calloc(numMails, sizeof(*data.whiteListed))) != NULL)
+  {
+    ULONG i;
+
+    STARTCLOCK(DBF_SPAM);
+
+    // the address book must be accessed by the main thread only
+    for(i=0; i < numMails; i++)
+    {
+      isSpam[i] = FALSE;
+      data.whiteListed[i] = senderIsWhiteListed(mails[i]);
+    }
+
+    result = RunParallel(numMails, CLASSIFY_THREADS, CLASSIFY_MAILS_PER_THREAD, ClassifyBatchMessage, ClassifyBatchProgress, &data);
+
+    STOPCLOCK(DBF_SPAM, "classifying mails");
+  }
+  else if(numMails > 0)
+  {
+    ULONG i;
+
+    // classify the mails one by one if we are short of memory
+    for(i=0; i < numMails && result == TRUE; i++)
+    {
+      isSpam[i] = BayesFilterClassifyMessage(mails[i]);
+
+      if(busy != NULL && BusyProgress(busy, i+1, numMails) == FALSE)
+        result = FALSE;
+    }
+  }
+
+  free(data.whiteListed);
+
+  RETURN(result);
+  return result;
+}
+
 ///
 /// BayesFilterSetClassification
 // change the classification of a message
@@ -1737,7 +2459,7 @@ ULONG BayesFilterNumberOfSpamClassifiedWords(void)
   ENTER();
 
   ObtainSemaphoreShared(&G->spamFilter.lockSema);
-  num = G->spamFilter.badTokens.tokenTable.entryCount;
+  num = G->spamFilter.badTokens.numWords;
   ReleaseSemaphore(&G->spamFilter.lockSema);
 
   RETURN(num);
@@ -1771,7 +2493,7 @@ ULONG BayesFilterNumberOfHamClassifiedWords(void)
   ENTER();
 
   ObtainSemaphoreShared(&G->spamFilter.lockSema);
-  num = G->spamFilter.goodTokens.tokenTable.entryCount;
+  num = G->spamFilter.goodTokens.numWords;
   ReleaseSemaphore(&G->spamFilter.lockSema);
 
   RETURN(num);
@@ -1793,9 +2515,21 @@ void BayesFilterFlushTrainingData(void)
 
   BusyText(busy, tr(MSG_BUSYFLUSHINGSPAMTRAININGDATA), "");
 
+  if(G->spamFilter.logStream != NULL)
+    fflush(G->spamFilter.logStream);
+
   if(C->SpamFlushTrainingDataThreshold > 0 && G->spamFilter.numDirtyingMessages > (ULONG)C->SpamFlushTrainingDataThreshold)
   {
-    tokenAnalyzerWriteTrainingData();
+    if(G->spamFilter.logStream != NULL)
+    {
+      LONG logSize;
+
+      // merge the log into the training data file only if it became large
+      // compared to the file, this keeps the effort per change constant
+      if((logSize = ftell(G->spamFilter.logStream)) > MIN_MERGE_LOG_SIZE && (ULONG)logSize > G->spamFilter.baseSize / 4)
+        tokenAnalyzerWriteTrainingData(0);
+    }
+
     G->spamFilter.numDirtyingMessages = 0;
   }
 
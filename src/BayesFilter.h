@@ -28,12 +28,16 @@
 
 ***************************************************************************/
 
+#include <stdio.h>
+
 #include <exec/semaphores.h>
 
 #include "HashTable.h"
 
 // forward declarations
 struct Mail;
+struct BusyNode;
+struct BaseToken;
 
 /*
  YAM's spam filter is based upon Mozilla Thunderbird's junk filter.
@@ -64,13 +68,27 @@ struct Tokenizer
   struct HashTable tokenTable;
 };
 
+struct TokenCorpus
+{
+  struct Tokenizer changes;        // words changed since the training data file was written
+  const struct BaseToken *base;    // sorted words of the training data file
+  ULONG numBase;                   // number of words in the training data file
+  ULONG numWords;                  // number of distinct words including the changes
+};
+
 struct TokenAnalyzer
 {
-  struct Tokenizer goodTokens;     // non-spam words
-  struct Tokenizer badTokens;      // spam words
+  struct TokenCorpus goodTokens;   // non-spam words
+  struct TokenCorpus badTokens;    // spam words
   ULONG goodCount;                 // number of non-spam words
   ULONG badCount;                  // number of spam words
   ULONG numDirtyingMessages;       // number of modifications since last save operation
+  APTR baseImage;                  // the training data file as read from disk
+  ULONG baseSize;                  // size of the training data file
+  const char *baseWords;           // the word strings of the training data file
+  ULONG baseWordsSize;             // size of the word strings
+  ULONG serial;                    // generation of the training data file
+  FILE *logStream;                 // the training log, opened on demand
   struct SignalSemaphore lockSema; // semaphore for multi-threading
   BOOL initialized;                // has this structure been initialized?
 };
@@ -79,6 +97,7 @@ struct TokenAnalyzer
 BOOL BayesFilterInit(void);
 void BayesFilterCleanup(void);
 BOOL BayesFilterClassifyMessage(const struct Mail *mail);
+BOOL BayesFilterClassifyMessages(const struct Mail **mails, BOOL *isSpam, ULONG numMails, struct BusyNode *busy);
 void BayesFilterSetClassification(const struct Mail *mail, const enum BayesClassification newClass);
 ULONG BayesFilterNumberOfSpamClassifiedMails(void);
 ULONG BayesFilterNumberOfSpamClassifiedWords(void);
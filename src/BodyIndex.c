@@ -0,0 +1,1132 @@
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <clib/alib_protos.h>
+#include <libraries/iffparse.h>
+#include <proto/dos.h>
+#include <proto/exec.h>
+
+#include "extrasrc.h"
+
+#include "YAM.h"
+#include "YAM_folderconfig.h"
+#include "YAM_mainFolder.h"
+#include "YAM_utilities.h"
+
+#include "BodyIndex.h"
+#include "Config.h"
+#include "FileInfo.h"
+#include "HashTable.h"
+#include "MailList.h"
+
+#include "Debug.h"
+
+#include "amiga-align.h"
+
+/*
+** structure of the .bodyindex file of a folder
+**
+** The header is followed by 'numDocs' records of struct BodyIndexDoc and
+** 'numTerms' terms. Each term consists of a ULONG with the padded size of
+** the term string, a ULONG with the number of mails containing the term,
+** the NUL terminated and padded term string and finally the numbers of
+** the mails as ULONGs.
+**
+** DO NOT CHANGE ALIGNMENT here or the .bodyindex
+** files of a folder will be corrupt !
+**
+*/
+struct BodyIndexHeader
+{
+  ULONG ID;           // version of the body index (BODYINDEX_VER)
+  ULONG textFlags;    // the configuration the texts were indexed with
+  ULONG numDocs;      // number of mail records
+  ULONG numTerms;     // number of terms
+};
+
+struct BodyIndexDoc
+{
+  char  key[20];      // the date and counter part of the mail file name, empty if removed
+  LONG  size;         // the size of the mail
+  ULONG cMsgID;       // the compressed message ID of the mail
+};
+
+#include "default-align.h"
+
+// whenever you change something up there you need to increase this version ID!
+#define BODYINDEX_VER (MAKE_ID('Y','B','I','1'))
+
+// the configuration options which affect the texts returned by RE_ReadInMessage()
+#define BODYINDEX_TEXTFLAGS ((C->DisplayAllTexts ? (1<<0) : 0) | (C->DisplayAllAltPart ? (1<<1) : 0))
+
+// characters which make up a term
+#define isTermChar(c) (isalnum(c) || (c) >= 0x80)
+
+// a term together with the numbers of all mails containing it
+struct BodyIndexTerm
+{
+  struct HashEntryHeader hash; // standard hash table header
+  char *term;                  // the term in lower case
+  ULONG *docs;                 // the numbers of the mails in ascending order
+  ULONG numDocs;               // the number of mails
+  ULONG maxDocs;               // the allocated number of mails
+};
+
+// the number of a mail within the index
+struct BodyIndexKey
+{
+  struct HashEntryHeader hash; // standard hash table header
+  char *key;                   // the key of the mail
+  ULONG doc;                   // the number of the mail
+};
+
+struct BodyIndex
+{
+  struct SignalSemaphore *lock; // protects the index
+  struct HashTable *terms;      // all terms
+  struct HashTable *keys;       // the numbers of all mails by their key
+  struct BodyIndexDoc *docs;    // all mails
+  ULONG numDocs;                // the number of mails
+  ULONG maxDocs;                // the allocated number of mails
+  ULONG generation;             // increased whenever the mails are renumbered
+  BOOL modified;                // TRUE if the index needs to be saved
+};
+
+// the kind of terms a token of a query can match
+enum BodyIndexTokenType
+{
+  BITT_EQUAL=0, // the token is surrounded by separators
+  BITT_PREFIX,  // the token is preceded by a separator
+  BITT_SUFFIX,  // the token is followed by a separator
+  BITT_INFIX    // the token is not delimited at all
+};
+
+struct BodyIndexToken
+{
+  char *token;                  // the token in lower case
+  size_t length;                // the length of the token
+  enum BodyIndexTokenType type; // the terms the token matches
+};
+
+struct BodyIndexQuery
+{
+  struct BodyIndexToken *tokens; // the tokens of the searched string
+  ULONG numTokens;               // the number of tokens
+  const struct BodyIndex *index; // the index the candidates were calculated for
+  ULONG generation;              // the generation of the index
+  UBYTE *candidates;             // bit set of all mails which might match
+  ULONG numCandidates;           // the number of mails covered by the bit set
+};
+
+// data passed to the term enumerators
+struct BodyIndexEnumData
+{
+  const struct BodyIndexToken *token; // the token to be matched
+  UBYTE *docSet;                      // the mails containing a matching term
+  ULONG *remap;                       // new numbers of the mails while compacting
+  FILE *fh;                           // the file to write the terms to
+  BOOL success;                       // FALSE if writing failed
+};
+
+/*** Private functions ***/
+/// FreeTermDocs
+// HashTableEnumerate() callback to free the mail numbers of all terms
+static enum HashTableOperator FreeTermDocs(UNUSED struct HashTable *table,
+                                           struct HashEntryHeader *entry,
+                                           UNUSED ULONG number,
+                                           UNUSED void *arg)
+{
+  struct BodyIndexTerm *term = (struct BodyIndexTerm *)entry;
+
+  ENTER();
+
+  free(term->docs);
+  term->docs = NULL;
+
+  RETURN(htoNext);
+  return htoNext;
+}
+
+///
+/// DeleteBodyIndex
+// free a body index
+static void DeleteBodyIndex(struct BodyIndex *index)
+{
+  ENTER();
+
+  if(index != NULL)
+  {
+    if(index->terms != NULL)
+    {
+      HashTableEnumerate(index->terms, FreeTermDocs, NULL);
+      HashTableDestroy(index->terms);
+    }
+
+    if(index->keys != NULL)
+      HashTableDestroy(index->keys);
+
+    if(index->lock != NULL)
+      FreeSysObject(ASOT_SEMAPHORE, index->lock);
+
+    free(index->docs);
+    free(index);
+  }
+
+  LEAVE();
+}
+
+///
+/// CreateBodyIndex
+// create a new empty body index
+static struct BodyIndex *CreateBodyIndex(void)
+{
+  struct BodyIndex *index;
+
+  ENTER();
+
+  if((index = calloc(1, sizeof(*index))) != NULL)
+  {
+    if((index->lock = AllocSysObjectTags(ASOT_SEMAPHORE, TAG_DONE)) == NULL ||
+       (index->terms = HashTableNew(HashTableGetDefaultStringOps(), NULL, sizeof(struct BodyIndexTerm), 1024)) == NULL ||
+       (index->keys = HashTableNew(HashTableGetDefaultStringOps(), NULL, sizeof(struct BodyIndexKey), 256)) == NULL)
+    {
+      DeleteBodyIndex(index);
+      index = NULL;
+    }
+  }
+
+  RETURN(index);
+  return index;
+}
+
+///
+/// AddDoc
+// add a mail record to a body index and return its number
+static BOOL AddDoc(struct BodyIndex *index, const struct BodyIndexDoc *doc, ULONG *docNum)
+{
+  BOOL success = FALSE;
+
+  ENTER();
+
+  // enlarge the array if necessary
+  if(index->numDocs >= index->maxDocs)
+  {
+    ULONG newMax = (index->maxDocs > 0) ? index->maxDocs * 2 : 256;
+    struct BodyIndexDoc *newDocs;
+
+    if((newDocs = realloc(index->docs, newMax * sizeof(*newDocs))) != NULL)
+    {
+      index->docs = newDocs;
+      index->maxDocs = newMax;
+    }
+  }
+
+  if(index->numDocs < index->maxDocs)
+  {
+    struct HashEntryHeader *entry;
+
+    // removed mails keep their slot until the index is compacted
+    if(doc->key[0] == '\0')
+      success = TRUE;
+    else if((entry = HashTableOperate(index->keys, doc->key, htoAdd)) != NULL)
+    {
+      struct BodyIndexKey *key = (struct BodyIndexKey *)entry;
+
+      if(key->key == NULL)
+        key->key = strdup(doc->key);
+
+      if(key->key != NULL)
+      {
+        key->doc = index->numDocs;
+        success = TRUE;
+      }
+      else
+        HashTableRawRemove(index->keys, entry);
+    }
+
+    if(success == TRUE)
+    {
+      memcpy(&index->docs[index->numDocs], doc, sizeof(*doc));
+      *docNum = index->numDocs;
+      index->numDocs++;
+    }
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// AddTermDoc
+// add a mail number to a term, the numbers must be added in ascending order
+static BOOL AddTermDoc(struct BodyIndex *index, const char *termString, ULONG docNum)
+{
+  BOOL success = FALSE;
+  struct HashEntryHeader *entry;
+
+  ENTER();
+
+  if((entry = HashTableOperate(index->terms, termString, htoAdd)) != NULL)
+  {
+    struct BodyIndexTerm *term = (struct BodyIndexTerm *)entry;
+
+    if(term->term == NULL && (term->term = strdup(termString)) == NULL)
+    {
+      HashTableRawRemove(index->terms, entry);
+    }
+    else if(term->numDocs > 0 && term->docs[term->numDocs-1] == docNum)
+    {
+      // the term occurs several times in the same mail
+      success = TRUE;
+    }
+    else
+    {
+      // enlarge the array if necessary
+      if(term->numDocs >= term->maxDocs)
+      {
+        ULONG newMax = (term->maxDocs > 0) ? term->maxDocs * 2 : 4;
+        ULONG *newDocs;
+
+        if((newDocs = realloc(term->docs, newMax * sizeof(*newDocs))) != NULL)
+        {
+          term->docs = newDocs;
+          term->maxDocs = newMax;
+        }
+      }
+
+      if(term->numDocs < term->maxDocs)
+      {
+        term->docs[term->numDocs++] = docNum;
+        success = TRUE;
+      }
+    }
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// FindDoc
+// find the number of a mail within the index, mails which changed since
+// they were indexed are not found
+static BOOL FindDoc(struct BodyIndex *index, const struct Mail *mail, ULONG *docNum)
+{
+  BOOL found = FALSE;
+  char key[MAILKEY_LEN+1];
+  struct HashEntryHeader *entry;
+
+  ENTER();
+
+  if(GetMailKey(mail, key) == TRUE &&
+     (entry = HashTableOperate(index->keys, key, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+  {
+    ULONG doc = ((struct BodyIndexKey *)entry)->doc;
+
+    if(index->docs[doc].size == mail->Size && index->docs[doc].cMsgID == mail->cMsgID)
+    {
+      *docNum = doc;
+      found = TRUE;
+    }
+  }
+
+  RETURN(found);
+  return found;
+}
+
+///
+/// RemoveDoc
+// remove a mail from the index, the mail numbers of the terms are cleaned up
+// when the index is compacted
+static void RemoveDoc(struct BodyIndex *index, const char *key)
+{
+  struct HashEntryHeader *entry;
+
+  ENTER();
+
+  if((entry = HashTableOperate(index->keys, key, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+  {
+    ULONG doc = ((struct BodyIndexKey *)entry)->doc;
+
+    // the key might point to the mail record itself, hence clear it last
+    HashTableOperate(index->keys, key, htoRemove);
+    index->docs[doc].key[0] = '\0';
+    index->modified = TRUE;
+  }
+
+  LEAVE();
+}
+
+///
+/// LoadBodyIndex
+// load the body index of a folder, an empty index is returned if there is no
+// usable index file
+static struct BodyIndex *LoadBodyIndex(const struct Folder *folder)
+{
+  struct BodyIndex *index;
+
+  ENTER();
+
+  if((index = CreateBodyIndex()) != NULL)
+  {
+    char fileName[SIZE_PATHFILE];
+    LONG fileSize;
+    FILE *fh;
+    BOOL valid = FALSE;
+
+    AddPath(fileName, folder->Fullpath, ".bodyindex", sizeof(fileName));
+
+    if(ObtainFileInfo(fileName, FI_SIZE, &fileSize) == TRUE && fileSize >= (LONG)sizeof(struct BodyIndexHeader) &&
+       (fh = fopen(fileName, "r")) != NULL)
+    {
+      char *data;
+
+      // read the complete file with a single call
+      if((data = malloc(fileSize)) != NULL)
+      {
+        if(fread(data, fileSize, 1, fh) == 1)
+        {
+          struct BodyIndexHeader *header = (struct BodyIndexHeader *)data;
+          ULONG offset = sizeof(*header);
+
+          if(header->ID == BODYINDEX_VER && header->textFlags == BODYINDEX_TEXTFLAGS &&
+             header->numDocs <= (fileSize - offset) / sizeof(struct BodyIndexDoc))
+          {
+            struct BodyIndexDoc *docs = (struct BodyIndexDoc *)&data[offset];
+            ULONG i;
+
+            valid = TRUE;
+
+            for(i=0; i < header->numDocs && valid == TRUE; i++)
+            {
+              ULONG docNum;
+
+              docs[i].key[sizeof(docs[i].key)-1] = '\0';
+              valid = AddDoc(index, &docs[i], &docNum);
+            }
+            offset += header->numDocs * sizeof(struct BodyIndexDoc);
+
+            for(i=0; i < header->numTerms && valid == TRUE; i++)
+            {
+              ULONG termSize;
+              ULONG numDocs;
+
+              valid = FALSE;
+
+              if(offset + 2*sizeof(ULONG) <= (ULONG)fileSize)
+              {
+                termSize = ((ULONG *)&data[offset])[0];
+                numDocs = ((ULONG *)&data[offset])[1];
+                offset += 2*sizeof(ULONG);
+
+                if(termSize > 0 && termSize % sizeof(ULONG) == 0 && termSize <= fileSize - offset &&
+                   numDocs > 0 && numDocs <= (fileSize - offset - termSize) / sizeof(ULONG))
+                {
+                  char *termString = &data[offset];
+                  ULONG *docNums = (ULONG *)&data[offset + termSize];
+                  struct HashEntryHeader *entry;
+
+                  termString[termSize-1] = '\0';
+                  offset += termSize + numDocs * sizeof(ULONG);
+
+                  if((entry = HashTableOperate(index->terms, termString, htoAdd)) != NULL)
+                  {
+                    struct BodyIndexTerm *term = (struct BodyIndexTerm *)entry;
+
+                    if(term->term == NULL && (term->term = strdup(termString)) != NULL &&
+                       (term->docs = malloc(numDocs * sizeof(*term->docs))) != NULL)
+                    {
+                      memcpy(term->docs, docNums, numDocs * sizeof(*term->docs));
+                      term->numDocs = numDocs;
+                      term->maxDocs = numDocs;
+
+                      // the last mail number is the largest one
+                      valid = (docNums[numDocs-1] < index->numDocs);
+                    }
+                  }
+                }
+              }
+            }
+
+            if(valid == TRUE)
+              D(DBF_FOLDER, "loaded body index of folder '%s' with %ld mails and %ld terms", folder->Name, index->numDocs, header->numTerms);
+          }
+        }
+
+        free(data);
+      }
+
+      fclose(fh);
+
+      if(valid == FALSE)
+      {
+        W(DBF_FOLDER, "body index '%s' is outdated or corrupt, starting over", fileName);
+
+        DeleteBodyIndex(index);
+        index = CreateBodyIndex();
+      }
+    }
+  }
+
+  RETURN(index);
+  return index;
+}
+
+///
+/// GetBodyIndex
+// get the body index of a folder, load it if necessary
+static struct BodyIndex *GetBodyIndex(struct Folder *folder)
+{
+  struct BodyIndex *index = NULL;
+
+  ENTER();
+
+  if(C->BodySearchIndex == TRUE && folder != NULL && isGroupFolder(folder) == FALSE)
+  {
+    if(folder->bodyIndex == NULL)
+      folder->bodyIndex = LoadBodyIndex(folder);
+
+    index = folder->bodyIndex;
+  }
+
+  RETURN(index);
+  return index;
+}
+
+///
+/// CompactTermDocs
+// HashTableEnumerate() callback to renumber the mails of all terms and to
+// remove terms of removed mails only
+static enum HashTableOperator CompactTermDocs(UNUSED struct HashTable *table,
+                                              struct HashEntryHeader *entry,
+                                              UNUSED ULONG number,
+                                              void *arg)
+{
+  struct BodyIndexTerm *term = (struct BodyIndexTerm *)entry;
+  struct BodyIndexEnumData *enumData = (struct BodyIndexEnumData *)arg;
+  enum HashTableOperator op = htoNext;
+  ULONG i;
+  ULONG j;
+
+  ENTER();
+
+  for(i=0, j=0; i < term->numDocs; i++)
+  {
+    ULONG newNum = enumData->remap[term->docs[i]];
+
+    // removed mails are mapped to ~0
+    if(newNum != ~0UL)
+      term->docs[j++] = newNum;
+  }
+  term->numDocs = j;
+
+  if(term->numDocs == 0)
+  {
+    free(term->docs);
+    term->docs = NULL;
+    op = htoRemove;
+  }
+
+  RETURN(op);
+  return op;
+}
+
+///
+/// CompactBodyIndex
+// remove all traces of removed mails from the index
+static BOOL CompactBodyIndex(struct BodyIndex *index)
+{
+  BOOL success = FALSE;
+  struct BodyIndexEnumData enumData;
+
+  ENTER();
+
+  memset(&enumData, 0, sizeof(enumData));
+
+  if((enumData.remap = malloc((index->numDocs + 1) * sizeof(*enumData.remap))) != NULL)
+  {
+    ULONG i;
+    ULONG j;
+
+    for(i=0, j=0; i < index->numDocs; i++)
+    {
+      if(index->docs[i].key[0] != '\0')
+      {
+        struct HashEntryHeader *entry;
+
+        if((entry = HashTableOperate(index->keys, index->docs[i].key, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+          ((struct BodyIndexKey *)entry)->doc = j;
+
+        memmove(&index->docs[j], &index->docs[i], sizeof(index->docs[j]));
+        enumData.remap[i] = j++;
+      }
+      else
+        enumData.remap[i] = ~0UL;
+    }
+
+    if(j != index->numDocs)
+    {
+      D(DBF_FOLDER, "compacted body index from %ld to %ld mails", index->numDocs, j);
+
+      index->numDocs = j;
+      HashTableEnumerate(index->terms, CompactTermDocs, &enumData);
+
+      // previously calculated query results are invalid now
+      index->generation++;
+    }
+
+    free(enumData.remap);
+    success = TRUE;
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// WriteTerm
+// HashTableEnumerate() callback to write all terms to the index file
+static enum HashTableOperator WriteTerm(UNUSED struct HashTable *table,
+                                        struct HashEntryHeader *entry,
+                                        UNUSED ULONG number,
+                                        void *arg)
+{
+  struct BodyIndexTerm *term = (struct BodyIndexTerm *)entry;
+  struct BodyIndexEnumData *enumData = (struct BodyIndexEnumData *)arg;
+  enum HashTableOperator op = htoNext;
+  size_t length = strlen(term->term) + 1;
+  ULONG sizes[2];
+  ULONG pad = 0;
+
+  ENTER();
+
+  // pad the term to keep the following mail numbers aligned
+  sizes[0] = (length + sizeof(ULONG) - 1) & ~(sizeof(ULONG) - 1);
+  sizes[1] = term->numDocs;
+
+  if(fwrite(sizes, sizeof(sizes), 1, enumData->fh) != 1 ||
+     fwrite(term->term, length, 1, enumData->fh) != 1 ||
+     (sizes[0] > length && fwrite(&pad, sizes[0] - length, 1, enumData->fh) != 1) ||
+     fwrite(term->docs, term->numDocs * sizeof(*term->docs), 1, enumData->fh) != 1)
+  {
+    enumData->success = FALSE;
+    op = htoStop;
+  }
+
+  RETURN(op);
+  return op;
+}
+
+///
+/// SaveBodyIndex
+// save the body index of a folder
+static BOOL SaveBodyIndex(const struct Folder *folder, struct BodyIndex *index)
+{
+  BOOL success = FALSE;
+  char fileName[SIZE_PATHFILE];
+  FILE *fh;
+
+  ENTER();
+
+  AddPath(fileName, folder->Fullpath, ".bodyindex", sizeof(fileName));
+
+  if(CompactBodyIndex(index) == TRUE && (fh = fopen(fileName, "w")) != NULL)
+  {
+    struct BodyIndexHeader header;
+    struct BodyIndexEnumData enumData;
+
+    setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
+
+    header.ID = BODYINDEX_VER;
+    header.textFlags = BODYINDEX_TEXTFLAGS;
+    header.numDocs = index->numDocs;
+    header.numTerms = index->terms->entryCount;
+
+    memset(&enumData, 0, sizeof(enumData));
+    enumData.fh = fh;
+    enumData.success = TRUE;
+
+    if(fwrite(&header, sizeof(header), 1, fh) == 1 &&
+       (index->numDocs == 0 || fwrite(index->docs, index->numDocs * sizeof(*index->docs), 1, fh) == 1))
+    {
+      HashTableEnumerate(index->terms, WriteTerm, &enumData);
+      success = enumData.success;
+    }
+
+    if(fclose(fh) != 0)
+      success = FALSE;
+
+    if(success == TRUE)
+    {
+      D(DBF_FOLDER, "saved body index of folder '%s' with %ld mails and %ld terms", folder->Name, header.numDocs, header.numTerms);
+      index->modified = FALSE;
+    }
+    else
+    {
+      E(DBF_FOLDER, "couldn't save body index '%s'", fileName);
+      DeleteFile(fileName);
+    }
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// MatchToken
+// HashTableEnumerate() callback to collect the mails of all terms matching a
+// token of a query
+static enum HashTableOperator MatchToken(UNUSED struct HashTable *table,
+                                         struct HashEntryHeader *entry,
+                                         UNUSED ULONG number,
+                                         void *arg)
+{
+  struct BodyIndexTerm *term = (struct BodyIndexTerm *)entry;
+  struct BodyIndexEnumData *enumData = (struct BodyIndexEnumData *)arg;
+  const struct BodyIndexToken *token = enumData->token;
+  BOOL match = FALSE;
+
+  switch(token->type)
+  {
+    case BITT_EQUAL:
+      match = (strcmp(term->term, token->token) == 0);
+    break;
+
+    case BITT_PREFIX:
+      match = (strncmp(term->term, token->token, token->length) == 0);
+    break;
+
+    case BITT_SUFFIX:
+    {
+      size_t length = strlen(term->term);
+
+      match = (length >= token->length && strcmp(&term->term[length - token->length], token->token) == 0);
+    }
+    break;
+
+    case BITT_INFIX:
+      match = (strstr(term->term, token->token) != NULL);
+    break;
+  }
+
+  if(match == TRUE)
+  {
+    ULONG i;
+
+    for(i=0; i < term->numDocs; i++)
+      enumData->docSet[term->docs[i] / 8] |= 1 << (term->docs[i] % 8);
+  }
+
+  return htoNext;
+}
+
+///
+/// CalculateCandidates
+// calculate the set of mails which might match a query
+static BOOL CalculateCandidates(struct BodyIndexQuery *query, struct BodyIndex *index)
+{
+  BOOL success = FALSE;
+  ULONG setSize = (index->numDocs + 7) / 8 + 1;
+  UBYTE *candidates;
+
+  ENTER();
+
+  STARTCLOCK(DBF_FOLDER);
+
+  free(query->candidates);
+  query->candidates = NULL;
+  query->index = NULL;
+
+  if((candidates = malloc(setSize)) != NULL)
+  {
+    struct BodyIndexEnumData enumData;
+    ULONG i;
+
+    memset(&enumData, 0, sizeof(enumData));
+
+    // all mails are candidates at first
+    memset(candidates, 0xff, setSize);
+    success = TRUE;
+
+    // a matching mail must contain a matching term for each token
+    for(i=0; i < query->numTokens; i++)
+    {
+      ULONG j;
+
+      if((enumData.docSet = calloc(1, setSize)) == NULL)
+      {
+        success = FALSE;
+        break;
+      }
+
+      enumData.token = &query->tokens[i];
+      if(enumData.token->type == BITT_EQUAL)
+      {
+        struct HashEntryHeader *entry;
+
+        // no need to check each term
+        if((entry = HashTableOperate(index->terms, enumData.token->token, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+          MatchToken(index->terms, entry, 0, &enumData);
+      }
+      else
+        HashTableEnumerate(index->terms, MatchToken, &enumData);
+
+      for(j=0; j < setSize; j++)
+        candidates[j] &= enumData.docSet[j];
+
+      free(enumData.docSet);
+    }
+
+    if(success == TRUE)
+    {
+      query->candidates = candidates;
+      query->numCandidates = index->numDocs;
+      query->index = index;
+      query->generation = index->generation;
+    }
+    else
+      free(candidates);
+  }
+
+  STOPCLOCK(DBF_FOLDER, "calculating body index candidates");
+
+  RETURN(success);
+  return success;
+}
+
+///
+
+/*** Public functions ***/
+/// BodyIndexPrepareQuery
+// prepare a query for a substring search, NULL is returned if the index
+// cannot help searching the given string
+struct BodyIndexQuery *BodyIndexPrepareQuery(const char *pattern)
+{
+  struct BodyIndexQuery *query = NULL;
+  char *lowerPattern;
+
+  ENTER();
+
+  if(C->BodySearchIndex == TRUE && (lowerPattern = strdup(pattern)) != NULL)
+  {
+    size_t patternLength = strlen(lowerPattern);
+
+    ToLowerCase(lowerPattern);
+
+    // there cannot be more tokens than half the length of the string
+    if((query = calloc(1, sizeof(*query))) != NULL &&
+       (query->tokens = calloc(patternLength / 2 + 1, sizeof(*query->tokens))) != NULL)
+    {
+      char *p = lowerPattern;
+
+      while(*p != '\0')
+      {
+        if(isTermChar((unsigned char)*p))
+        {
+          struct BodyIndexToken *token = &query->tokens[query->numTokens];
+          char *start = p;
+          BOOL leftBound;
+          BOOL rightBound;
+
+          while(isTermChar((unsigned char)*p))
+            p++;
+
+          // a token which is delimited by a separator in the search string
+          // must be delimited in the same way in the text
+          leftBound = (start != lowerPattern);
+          rightBound = (*p != '\0');
+
+          if(leftBound == TRUE && rightBound == TRUE)
+            token->type = BITT_EQUAL;
+          else if(leftBound == TRUE)
+            token->type = BITT_PREFIX;
+          else if(rightBound == TRUE)
+            token->type = BITT_SUFFIX;
+          else
+            token->type = BITT_INFIX;
+
+          token->length = p - start;
+          if((token->token = malloc(token->length + 1)) != NULL)
+          {
+            strlcpy(token->token, start, token->length + 1);
+            query->numTokens++;
+          }
+        }
+        else
+          p++;
+      }
+    }
+
+    // a string without any term characters cannot be looked up
+    if(query != NULL && query->numTokens == 0)
+    {
+      BodyIndexFreeQuery(query);
+      query = NULL;
+    }
+
+    free(lowerPattern);
+  }
+
+  RETURN(query);
+  return query;
+}
+
+///
+/// BodyIndexFreeQuery
+// free a query
+void BodyIndexFreeQuery(struct BodyIndexQuery *query)
+{
+  ENTER();
+
+  if(query != NULL)
+  {
+    if(query->tokens != NULL)
+    {
+      ULONG i;
+
+      for(i=0; i < query->numTokens; i++)
+        free(query->tokens[i].token);
+
+      free(query->tokens);
+    }
+
+    free(query->candidates);
+    free(query);
+  }
+
+  LEAVE();
+}
+
+///
+/// BodyIndexMatchMail
+// check whether a mail might match a query
+enum BodyIndexMatch BodyIndexMatchMail(struct BodyIndexQuery *query, const struct Mail *mail)
+{
+  enum BodyIndexMatch match = BIM_UNKNOWN;
+  struct BodyIndex *index;
+
+  ENTER();
+
+  if(query != NULL && (index = GetBodyIndex(mail->Folder)) != NULL)
+  {
+    ULONG docNum;
+
+    ObtainSemaphore(index->lock);
+
+    if(FindDoc(index, mail, &docNum) == TRUE)
+    {
+      // the candidates must be recalculated if the index was renumbered or
+      // if the mail was added to the index after the last calculation
+      if(query->index == index && query->generation == index->generation && docNum < query->numCandidates)
+        match = BIM_POSSIBLE;
+      else if(CalculateCandidates(query, index) == TRUE)
+        match = BIM_POSSIBLE;
+
+      if(match == BIM_POSSIBLE && isFlagClear(query->candidates[docNum / 8], 1 << (docNum % 8)))
+        match = BIM_NONE;
+    }
+
+    ReleaseSemaphore(index->lock);
+  }
+
+  RETURN(match);
+  return match;
+}
+
+///
+/// BodyIndexAddMail
+// add the decoded text of a mail to the body index of its folder
+void BodyIndexAddMail(const struct Mail *mail, const char *text)
+{
+  struct BodyIndex *index;
+  struct BodyIndexDoc doc;
+
+  ENTER();
+
+  memset(&doc, 0, sizeof(doc));
+
+  if(GetMailKey(mail, doc.key) == TRUE && (index = GetBodyIndex(mail->Folder)) != NULL)
+  {
+    ULONG docNum;
+
+    ObtainSemaphore(index->lock);
+
+    if(FindDoc(index, mail, &docNum) == FALSE)
+    {
+      char *lowerText;
+
+      // forget about an outdated version of the mail
+      RemoveDoc(index, doc.key);
+
+      doc.size = mail->Size;
+      doc.cMsgID = mail->cMsgID;
+
+      if((lowerText = strdup(text)) != NULL)
+      {
+        if(AddDoc(index, &doc, &docNum) == TRUE)
+        {
+          char *p = lowerText;
+          BOOL success = TRUE;
+
+          ToLowerCase(lowerText);
+
+          while(*p != '\0' && success == TRUE)
+          {
+            if(isTermChar((unsigned char)*p))
+            {
+              char *start = p;
+              char c;
+
+              while(isTermChar((unsigned char)*p))
+                p++;
+
+              // terminate the term temporarily
+              c = *p;
+              *p = '\0';
+              success = AddTermDoc(index, start, docNum);
+              *p = c;
+            }
+            else
+              p++;
+          }
+
+          // a partially indexed mail must not be used
+          if(success == FALSE)
+          {
+            E(DBF_FOLDER, "couldn't add mail '%s' to body index", mail->MailFile);
+            RemoveDoc(index, doc.key);
+          }
+
+          index->modified = TRUE;
+        }
+
+        free(lowerText);
+      }
+    }
+
+    ReleaseSemaphore(index->lock);
+  }
+
+  LEAVE();
+}
+
+///
+/// BodyIndexRemoveMail
+// remove a mail from the body index of its folder
+void BodyIndexRemoveMail(const struct Mail *mail)
+{
+  char key[MAILKEY_LEN+1];
+
+  ENTER();
+
+  // there is nothing to do if the index is not loaded
+  if(mail->Folder != NULL && mail->Folder->bodyIndex != NULL && GetMailKey(mail, key) == TRUE)
+  {
+    struct BodyIndex *index = mail->Folder->bodyIndex;
+
+    ObtainSemaphore(index->lock);
+    RemoveDoc(index, key);
+    ReleaseSemaphore(index->lock);
+  }
+
+  LEAVE();
+}
+
+///
+/// BodyIndexFlush
+// save the body index of a folder if it was modified
+void BodyIndexFlush(struct Folder *folder)
+{
+  struct BodyIndex *index = folder->bodyIndex;
+
+  ENTER();
+
+  if(index != NULL)
+  {
+    ObtainSemaphore(index->lock);
+
+    // forget about mails which were removed while the index was not loaded
+    if(folder->LoadedMode == LM_VALID)
+    {
+      UBYTE *present;
+
+      if((present = calloc(1, index->numDocs / 8 + 1)) != NULL)
+      {
+        struct MailNode *mnode;
+        ULONG i;
+
+        LockMailListShared(folder->messages);
+
+        ForEachMailNode(folder->messages, mnode)
+        {
+          ULONG docNum;
+
+          if(FindDoc(index, mnode->mail, &docNum) == TRUE)
+            present[docNum / 8] |= 1 << (docNum % 8);
+        }
+
+        UnlockMailList(folder->messages);
+
+        for(i=0; i < index->numDocs; i++)
+        {
+          if(index->docs[i].key[0] != '\0' && isFlagClear(present[i / 8], 1 << (i % 8)))
+            RemoveDoc(index, index->docs[i].key);
+        }
+
+        free(present);
+      }
+    }
+
+    if(index->modified == TRUE)
+      SaveBodyIndex(folder, index);
+
+    ReleaseSemaphore(index->lock);
+  }
+
+  LEAVE();
+}
+
+///
+/// BodyIndexFree
+// free the body index of a folder without saving it
+void BodyIndexFree(struct Folder *folder)
+{
+  ENTER();
+
+  if(folder->bodyIndex != NULL)
+  {
+    DeleteBodyIndex(folder->bodyIndex);
+    folder->bodyIndex = NULL;
+  }
+
+  LEAVE();
+}
+
+///
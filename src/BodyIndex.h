@@ -0,0 +1,64 @@
+#ifndef BODYINDEX_H
+#define BODYINDEX_H 1
+
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+
+#include <exec/types.h>
+
+// forward declarations
+struct Folder;
+struct Mail;
+struct BodyIndex;
+struct BodyIndexQuery;
+
+/*
+ A persistent full text index of the mail bodies of a folder. The index
+ maps each word of the decoded message texts to the list of mails it
+ occurs in and is used as a prefilter for substring searches in mail
+ bodies. Mails are added to the index whenever their text is searched
+ through anyway, mails which the index cannot rule out must still be
+ searched through the usual way.
+*/
+
+enum BodyIndexMatch
+{
+  BIM_UNKNOWN=0, // the mail is not part of the index
+  BIM_NONE,      // the mail cannot contain the searched string
+  BIM_POSSIBLE   // the mail might contain the searched string
+};
+
+struct BodyIndexQuery *BodyIndexPrepareQuery(const char *pattern);
+void BodyIndexFreeQuery(struct BodyIndexQuery *query);
+enum BodyIndexMatch BodyIndexMatchMail(struct BodyIndexQuery *query, const struct Mail *mail);
+void BodyIndexAddMail(const struct Mail *mail, const char *text);
+void BodyIndexRemoveMail(const struct Mail *mail);
+void BodyIndexFlush(struct Folder *folder);
+void BodyIndexFree(struct Folder *folder);
+
+#endif /* BODYINDEX_H */
@@ -150,7 +150,7 @@ BOOL BusyProgress(struct BusyNode *busy, int progress, int max)
         if(busy->type == BUSY_PROGRESS_ABORT)
           goOn = PushMethodOnStackWait(G->App, 3, MUIM_YAMApplication_BusyProgress, progress, max);
         else
-          PushMethodOnStack(G->App, 4, MUIM_YAMApplication_BusyProgress, busy, progress, max);
+          PushCoalescedMethodOnStack(G->App, MSC_REPLACE, 4, MUIM_YAMApplication_BusyProgress, busy, progress, max);
       }
     }
     else
@@ -494,6 +494,8 @@ BOOL CompareConfigs(const struct Config *c1, const struct Config *c2)
      c1->SpamFlushTrainingDataInterval   == c2->SpamFlushTrainingDataInterval &&
      c1->SpamFlushTrainingDataThreshold  == c2->SpamFlushTrainingDataThreshold &&
      c1->SocketTimeout                   == c2->SocketTimeout &&
+     c1->MaxFetchThreads                 == c2->MaxFetchThreads &&
+     c1->MaxFetchPerHost                 == c2->MaxFetchPerHost &&
      c1->PrintMethod                     == c2->PrintMethod &&
      c1->LogfileMode                     == c2->LogfileMode &&
      c1->MDN_NoRecipient                 == c2->MDN_NoRecipient &&
@@ -573,6 +575,7 @@ BOOL CompareConfigs(const struct Config *c1, const struct Config *c2)
      c1->ConfirmRemoveAttachments        == c2->ConfirmRemoveAttachments &&
      c1->OverrideFromAddress             == c2->OverrideFromAddress &&
      c1->ShowPackerProgress              == c2->ShowPackerProgress &&
+     c1->BodySearchIndex                 == c2->BodySearchIndex &&
 
      c1->SocketOptions.SendBuffer        == c2->SocketOptions.SendBuffer &&
      c1->SocketOptions.RecvBuffer        == c2->SocketOptions.RecvBuffer &&
@@ -975,12 +978,15 @@ void SetDefaultConfig(struct Config *co, enum ConfigPage page)
     co->SocketOptions.NoDelay     = FALSE;
     co->SocketOptions.LowDelay    = FALSE;
     co->SocketTimeout = 30; // 30s socket timeout per default
+    co->MaxFetchThreads = 4; // 4 parallel mail downloads per default
+    co->MaxFetchPerHost = 2; // 2 connections to the same POP3 host per default
     co->TRBufferSize = 8192; // 8K buffer per default
     co->EmbeddedMailDelay = 200; // 200ms delay per default
     co->KeepAliveInterval = 30;  // 30s interval per default
     co->AutoClip = FALSE;
     co->ShowFilterStats = TRUE;
     co->ConfirmRemoveAttachments = TRUE;
+    co->BodySearchIndex = FALSE;
 
     // set the default styles of the folder listtree and
     // mail list items.
@@ -1991,6 +1997,8 @@ int LoadConfig(struct Config *co, const char *fname)
             }
           }
           else if(stricmp(buf, "SocketTimeout") == 0)            co->SocketTimeout = atoi(value);
+          else if(stricmp(buf, "MaxFetchThreads") == 0)          co->MaxFetchThreads = atoi(value);
+          else if(stricmp(buf, "MaxFetchPerHost") == 0)          co->MaxFetchPerHost = atoi(value);
           else if(stricmp(buf, "TRBufferSize") == 0)             co->TRBufferSize = atoi(value);
           else if(stricmp(buf, "EmbeddedMailDelay") == 0)        co->EmbeddedMailDelay = atoi(value);
           else if(stricmp(buf, "KeepAliveInterval") == 0)        co->KeepAliveInterval = atoi(value);
@@ -2008,6 +2016,7 @@ int LoadConfig(struct Config *co, const char *fname)
           else if(stricmp(buf, "DefaultSSLCiphers") == 0)        strlcpy(co->DefaultSSLCiphers, value, sizeof(co->DefaultSSLCiphers));
           else if(stricmp(buf, "MachineFQDN") == 0)              strlcpy(co->MachineFQDN, value, sizeof(co->MachineFQDN));
           else if(stricmp(buf, "OverrideFromAddress") == 0)      co->OverrideFromAddress = Txt2Bool(value);
+          else if(stricmp(buf, "BodySearchIndex") == 0)          co->BodySearchIndex = Txt2Bool(value);
 
 /* Obsolete options (previous YAM version write them, we just read them) */
           else if(version < LATEST_CFG_VERSION)
@@ -2754,6 +2763,8 @@ BOOL SaveConfig(struct Config *co, const char *fname, BOOL savePrivateData)
 
     fprintf(fh, "SocketOptions            =%s\n", buf);
     fprintf(fh, "SocketTimeout            = %d\n", co->SocketTimeout);
+    fprintf(fh, "MaxFetchThreads          = %d\n", co->MaxFetchThreads);
+    fprintf(fh, "MaxFetchPerHost          = %d\n", co->MaxFetchPerHost);
     fprintf(fh, "TRBufferSize             = %d\n", co->TRBufferSize);
     fprintf(fh, "EmbeddedMailDelay        = %d\n", co->EmbeddedMailDelay);
     fprintf(fh, "KeepAliveInterval        = %d\n", co->KeepAliveInterval);
@@ -2773,6 +2784,7 @@ BOOL SaveConfig(struct Config *co, const char *fname, BOOL savePrivateData)
     fprintf(fh, "DefaultSSLCiphers        = %s\n", co->DefaultSSLCiphers);
     fprintf(fh, "MachineFQDN              = %s\n", co->MachineFQDN);
     fprintf(fh, "OverrideFromAddress      = %s\n", Bool2Txt(co->OverrideFromAddress));
+    fprintf(fh, "BodySearchIndex          = %s\n", Bool2Txt(co->BodySearchIndex));
 
     // analyze if we really didn't meet an error during the
     // numerous write operations
@@ -3836,6 +3848,7 @@ BOOL CheckConfigDiffs(const BOOL *visited)
           if((spamFolder = FO_GetFolderByType(FT_SPAM, NULL)) != NULL)
           {
             // delete the folder on disk
+            MA_CancelIndexPreload(spamFolder);
             DeleteMailDir(spamFolder->Fullpath, FALSE);
 
             // remove all mails from our internal list
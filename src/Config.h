@@ -141,6 +141,8 @@ struct Config
   int   SpamFlushTrainingDataInterval;
   int   SpamFlushTrainingDataThreshold;
   int   SocketTimeout;
+  int   MaxFetchThreads;
+  int   MaxFetchPerHost;
 
   enum  PrintMethod        PrintMethod;
   enum  LFMode             LogfileMode;
@@ -227,6 +229,7 @@ struct Config
   BOOL  OverrideFromAddress;
   BOOL  ShowPackerProgress;
   BOOL  AttachmentReminder;
+  BOOL  BodySearchIndex;
 
   struct MUI_PenSpec   ColoredText;
   struct MUI_PenSpec   Color1stLevel;
@@ -445,6 +445,67 @@ size_t dstrfread(char **dstr, size_t size, FILE *stream)
   return nread;
 }
 
+///
+/// dstrmemcpy
+// fill a dynamic string with the given amount of bytes from memory, the source
+// may contain NUL bytes
+char *dstrmemcpy(char **dstr, const char *src, size_t size)
+{
+  struct DynamicString *ds = NULL;
+  char *result = NULL;
+
+  ENTER();
+
+  // if dstr itself is NULL we replace dstr with a new local
+  // version
+  if(dstr == NULL)
+    dstr = &result;
+
+  if(*dstr == NULL)
+  {
+    if((ds = dstrallocInternal(size)) != NULL)
+      *dstr = DSTR_TO_STR(ds);
+  }
+  else
+  {
+    ds = STR_TO_DSTR(*dstr);
+
+    CHECK_DSTR(ds);
+
+    // make sure the string buffer is large enough to keep the
+    // requested amount of characters + NUL byte
+    if(size+1 > ds->size)
+    {
+      struct DynamicString *newdstr;
+
+      // allocate a new buffer and replace the old one with it
+      if((newdstr = dstrallocInternal(size)) != NULL)
+      {
+        free(ds);
+        ds = newdstr;
+        *dstr = DSTR_TO_STR(ds);
+      }
+      else
+        ds = NULL;
+    }
+  }
+
+  if(ds != NULL)
+  {
+    // copy the bytes and NUL terminate the string
+    if(size != 0)
+      memcpy(ds->str, src, size);
+
+    ds->strlen = size;
+    ds->str[size] = '\0';
+
+    result = *dstr;
+  }
+
+  RETURN(result);
+  return result;
+}
+
 ///
 /// dstrfree
 // free a dynamic string buffer
@@ -43,6 +43,7 @@ char *dstrins(char **dstr, const char *src, size_t pos);
 size_t dstrlen(const char *dstr);
 size_t dstrsize(const char *dstr);
 size_t dstrfread(char **dstr, size_t size, FILE *fh);
+char *dstrmemcpy(char **dstr, const char *src, size_t size);
 void dstrfree(const char *dstr);
 
 #endif /* DYNAMICSTRING_H */
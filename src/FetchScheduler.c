@@ -0,0 +1,490 @@
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <clib/alib_protos.h>
+#include <proto/exec.h>
+
+#include "extrasrc.h"
+
+#include "YAM.h"
+#include "YAM_find.h"
+#include "YAM_main.h"
+#include "YAM_mainFolder.h"
+#include "YAM_utilities.h"
+
+#include "mui/YAMApplication.h"
+#include "tcp/pop3.h"
+
+#include "Config.h"
+#include "FetchScheduler.h"
+#include "MailList.h"
+#include "MailServers.h"
+
+#include "Debug.h"
+
+// a download of mails from a single POP3 server
+struct FetchJob
+{
+  struct MinNode node;
+  int serverID;                         // the ID of the POP3 server
+  char hostname[SIZE_HOST];             // the server's host, to limit the connections per host
+  ULONG flags;                          // the RECEIVEF_#? flags of the download
+  struct DownloadResult downloadResult; // the statistics of the download
+  struct MailList *mails;               // the mails downloaded by this job
+};
+
+// the downloads of the current mail check. All downloads are started and
+// finished by the main thread, the lock is required only because mails
+// might be removed from the lists of downloaded mails by other threads.
+struct FetchScheduler
+{
+  struct SignalSemaphore *lock; // protects the lists below
+  struct MinList waiting;       // downloads waiting for a free slot
+  struct MinList running;       // downloads in progress
+  struct MinList finished;      // finished downloads waiting to be filtered
+  struct MinList filtering;     // finished downloads being filtered right now
+  ULONG numRunning;             // the number of downloads in progress
+};
+
+// the scheduler is set up by the first mail check
+static struct FetchScheduler *scheduler = NULL;
+
+/*** Static functions ***/
+/// DeleteFetchJob
+// free a download and its list of downloaded mails
+static void DeleteFetchJob(struct FetchJob *job)
+{
+  ENTER();
+
+  DeleteMailList(job->mails);
+  free(job);
+
+  LEAVE();
+}
+
+///
+/// FindFetchJob
+// find a download of a server in a list of downloads
+static struct FetchJob *FindFetchJob(const struct MinList *list, const int serverID)
+{
+  struct FetchJob *result = NULL;
+  struct FetchJob *job;
+
+  ENTER();
+
+  IterateList(list, struct FetchJob *, job)
+  {
+    if(job->serverID == serverID)
+    {
+      result = job;
+      break;
+    }
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// CountHostConnections
+// count the downloads in progress from the same host
+static ULONG CountHostConnections(const char *hostname)
+{
+  ULONG count = 0;
+  struct FetchJob *job;
+
+  ENTER();
+
+  IterateList(&scheduler->running, struct FetchJob *, job)
+  {
+    if(stricmp(job->hostname, hostname) == 0)
+      count++;
+  }
+
+  RETURN(count);
+  return count;
+}
+
+///
+/// StartWaitingJobs
+// start as many waiting downloads as the configured limits permit, downloads
+// from a host with too many connections already are skipped for now
+static void StartWaitingJobs(void)
+{
+  ULONG maxRunning = MAX(1, C->MaxFetchThreads);
+  ULONG maxPerHost = MAX(1, C->MaxFetchPerHost);
+  struct FetchJob *job;
+  struct FetchJob *succ;
+
+  ENTER();
+
+  // make sure the mail server nodes do not vanish
+  ObtainSemaphoreShared(G->configSemaphore);
+
+  SafeIterateList(&scheduler->waiting, struct FetchJob *, job, succ)
+  {
+    struct MailServerNode *msn;
+
+    if(scheduler->numRunning >= maxRunning)
+      break;
+
+    if(CountHostConnections(job->hostname) >= maxPerHost)
+    {
+      D(DBF_NET, "host '%s' has too many connections, download postponed", job->hostname);
+      continue;
+    }
+
+    ObtainSemaphore(scheduler->lock);
+    Remove((struct Node *)job);
+    ReleaseSemaphore(scheduler->lock);
+
+    // the server might have been removed from the configuration in the meantime
+    if((msn = FindMailServer(&C->pop3ServerList, job->serverID)) != NULL &&
+       ReceiveMailsFromPOP(msn, job->flags | RECEIVEF_SCHEDULED, &job->downloadResult) == TRUE)
+    {
+      D(DBF_NET, "started download from server '%s', %ld downloads in progress", msn->description, scheduler->numRunning+1);
+
+      ObtainSemaphore(scheduler->lock);
+      AddTail((struct List *)&scheduler->running, (struct Node *)job);
+      scheduler->numRunning++;
+      ReleaseSemaphore(scheduler->lock);
+    }
+    else
+    {
+      W(DBF_NET, "could not start download from server with ID %08lx", job->serverID);
+      DeleteFetchJob(job);
+    }
+  }
+
+  ReleaseSemaphore(G->configSemaphore);
+
+  LEAVE();
+}
+
+///
+/// IsFetchIdle
+// check whether all downloads are done and no filtering is in progress
+static BOOL IsFetchIdle(void)
+{
+  return (scheduler->numRunning == 0 && IsMinListEmpty(&scheduler->waiting) == TRUE && IsMinListEmpty(&scheduler->filtering) == TRUE);
+}
+
+///
+/// FilterFetchedMails
+// apply the filters to the mails of all finished downloads at once and
+// notify the user about the new mails of each account
+static void FilterFetchedMails(void)
+{
+  struct MailList *mails;
+  struct FetchJob *job;
+  struct FetchJob *succ;
+
+  ENTER();
+
+  // a mail check started while the filters are applied adds its downloads
+  // to the finished ones again, these are filtered right afterwards
+  ObtainSemaphore(scheduler->lock);
+  MoveList((struct List *)&scheduler->filtering, (struct List *)&scheduler->finished);
+  ReleaseSemaphore(scheduler->lock);
+
+  if((mails = CreateMailList()) != NULL)
+  {
+    ObtainSemaphore(scheduler->lock);
+
+    IterateList(&scheduler->filtering, struct FetchJob *, job)
+    {
+      struct MailNode *mnode;
+
+      LockMailList(job->mails);
+
+      ForEachMailNode(job->mails, mnode)
+        AddNewMailNode(mails, mnode->mail);
+
+      UnlockMailList(job->mails);
+    }
+
+    ReleaseSemaphore(scheduler->lock);
+
+    D(DBF_NET, "filter %ld downloaded mails", mails->count);
+
+    if(IsMailListEmpty(mails) == FALSE)
+    {
+      struct FilterResult filterResult;
+
+      memset(&filterResult, 0, sizeof(filterResult));
+
+      DoMethod(G->App, MUIM_YAMApplication_FilterNewMails, mails, &filterResult);
+
+      ObtainSemaphoreShared(G->configSemaphore);
+
+      IterateList(&scheduler->filtering, struct FetchJob *, job)
+      {
+        struct MailServerNode *msn;
+
+        if(job->downloadResult.downloaded > 0 && (msn = FindMailServer(&C->pop3ServerList, job->serverID)) != NULL)
+        {
+          struct FilterResult jobResult;
+          struct MailNode *mnode;
+
+          // the filter statistics cover all accounts, but the number of spam
+          // mails decides whether an account has new mails at all
+          memcpy(&jobResult, &filterResult, sizeof(jobResult));
+          jobResult.Spam = 0;
+
+          LockMailList(job->mails);
+
+          ForEachMailNode(job->mails, mnode)
+          {
+            if(hasStatusAutoSpam(mnode->mail))
+              jobResult.Spam++;
+          }
+
+          UnlockMailList(job->mails);
+
+          DoMethod(G->App, MUIM_YAMApplication_NewMailAlert, msn, &job->downloadResult, &jobResult, job->flags);
+        }
+      }
+
+      ReleaseSemaphore(G->configSemaphore);
+    }
+
+    DeleteMailList(mails);
+  }
+
+  ObtainSemaphore(scheduler->lock);
+
+  SafeIterateList(&scheduler->filtering, struct FetchJob *, job, succ)
+  {
+    Remove((struct Node *)job);
+    DeleteFetchJob(job);
+  }
+
+  ReleaseSemaphore(scheduler->lock);
+
+  LEAVE();
+}
+
+///
+
+/*** Public functions ***/
+/// ScheduleMailFetch
+// queue a download of mails from a POP3 server and start it as soon as the
+// limits for parallel downloads permit. The mails of all downloads of a mail
+// check are filtered together after the last download has finished.
+BOOL ScheduleMailFetch(struct MailServerNode *msn, const ULONG flags)
+{
+  BOOL success = FALSE;
+
+  ENTER();
+
+  if(scheduler == NULL && (scheduler = calloc(1, sizeof(*scheduler))) != NULL)
+  {
+    if((scheduler->lock = AllocSysObjectTags(ASOT_SEMAPHORE, TAG_DONE)) != NULL)
+    {
+      NewMinList(&scheduler->waiting);
+      NewMinList(&scheduler->running);
+      NewMinList(&scheduler->finished);
+      NewMinList(&scheduler->filtering);
+    }
+    else
+    {
+      free(scheduler);
+      scheduler = NULL;
+    }
+  }
+
+  if(scheduler != NULL)
+  {
+    if(FindFetchJob(&scheduler->waiting, msn->id) != NULL || FindFetchJob(&scheduler->running, msn->id) != NULL)
+    {
+      W(DBF_NET, "download from server '%s' is already scheduled", msn->description);
+    }
+    else
+    {
+      struct FetchJob *job;
+
+      if((job = calloc(1, sizeof(*job))) != NULL)
+      {
+        if((job->mails = CreateMailList()) != NULL)
+        {
+          job->serverID = msn->id;
+          strlcpy(job->hostname, msn->hostname, sizeof(job->hostname));
+          job->flags = flags;
+
+          ObtainSemaphore(scheduler->lock);
+          AddTail((struct List *)&scheduler->waiting, (struct Node *)job);
+          ReleaseSemaphore(scheduler->lock);
+
+          D(DBF_NET, "scheduled download from server '%s'", msn->description);
+
+          StartWaitingJobs();
+
+          success = TRUE;
+        }
+        else
+          free(job);
+      }
+    }
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// FinishMailFetch
+// take over the downloaded mails of a finished download and start the next
+// one, called by the main thread while the server is still "in use". After
+// the last download the mails of all downloads are filtered.
+void FinishMailFetch(struct MailServerNode *msn)
+{
+  ENTER();
+
+  if(scheduler != NULL)
+  {
+    struct FetchJob *job;
+
+    ObtainSemaphore(scheduler->lock);
+
+    if((job = FindFetchJob(&scheduler->running, msn->id)) != NULL)
+    {
+      Remove((struct Node *)job);
+      scheduler->numRunning--;
+
+      // move the mails over to the finished download, the server's list
+      // is used by the next download again
+      MoveMailList(job->mails, msn->downloadedMails);
+
+      AddTail((struct List *)&scheduler->finished, (struct Node *)job);
+    }
+
+    ReleaseSemaphore(scheduler->lock);
+
+    D(DBF_NET, "download from server '%s' finished, %ld downloads in progress", msn->description, scheduler->numRunning);
+
+    // don't start anything new if we are going down
+    if(job != NULL && G->Terminating == FALSE)
+    {
+      StartWaitingJobs();
+
+      // filter the mails after the last download, including those of
+      // downloads which finished during the filtering
+      while(IsFetchIdle() == TRUE && IsMinListEmpty(&scheduler->finished) == FALSE)
+        FilterFetchedMails();
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// ForgetFetchedMail
+// remove a mail from the finished downloads, so it will not be filtered
+// anymore when the last download finishes
+void ForgetFetchedMail(struct Mail *mail)
+{
+  ENTER();
+
+  if(scheduler != NULL)
+  {
+    struct MinList *lists[2];
+    BOOL found = FALSE;
+    ULONG i;
+
+    lists[0] = &scheduler->finished;
+    lists[1] = &scheduler->filtering;
+
+    ObtainSemaphore(scheduler->lock);
+
+    // a mail cannot be part of more than one download
+    for(i=0; i < ARRAY_SIZE(lists) && found == FALSE; i++)
+    {
+      struct FetchJob *job;
+
+      IterateList(lists[i], struct FetchJob *, job)
+      {
+        struct MailNode *mnode;
+
+        LockMailList(job->mails);
+
+        if((mnode = FindMailByAddress(job->mails, mail)) != NULL)
+        {
+          D(DBF_NET, "removing mail with subject '%s' from fetched mails", mail->Subject);
+          RemoveMailNode(job->mails, mnode);
+          DeleteMailNode(mnode);
+          found = TRUE;
+        }
+
+        UnlockMailList(job->mails);
+
+        if(found == TRUE)
+          break;
+      }
+    }
+
+    ReleaseSemaphore(scheduler->lock);
+  }
+
+  LEAVE();
+}
+
+///
+/// CleanupFetchScheduler
+// free all downloads, the threads must have been aborted before
+void CleanupFetchScheduler(void)
+{
+  ENTER();
+
+  if(scheduler != NULL)
+  {
+    struct FetchJob *job;
+    struct FetchJob *succ;
+
+    SafeIterateList(&scheduler->waiting, struct FetchJob *, job, succ)
+      DeleteFetchJob(job);
+
+    SafeIterateList(&scheduler->running, struct FetchJob *, job, succ)
+      DeleteFetchJob(job);
+
+    SafeIterateList(&scheduler->finished, struct FetchJob *, job, succ)
+      DeleteFetchJob(job);
+
+    SafeIterateList(&scheduler->filtering, struct FetchJob *, job, succ)
+      DeleteFetchJob(job);
+
+    FreeSysObject(ASOT_SEMAPHORE, scheduler->lock);
+    free(scheduler);
+    scheduler = NULL;
+  }
+
+  LEAVE();
+}
+
+///
@@ -32,11 +32,26 @@
 
 #include "extrasrc.h"
 
+#include "YAM_mainFolder.h"
+
+#include "BodyIndex.h"
 #include "FolderList.h"
+#include "HashTable.h"
 #include "MailList.h"
+#include "MailThreads.h"
 
 #include "Debug.h"
 
+// the mails of a folder sharing the same compressed message ID
+struct MsgIDMails
+{
+  struct HashEntryHeader hash; // standard hash table header
+  IPTR cMsgID;                 // the compressed message ID
+  struct Mail **mails;         // the mails with this ID
+  ULONG numMails;              // the number of mails
+  ULONG maxMails;              // the allocated number of mails
+};
+
 /// InitFolderList
 // initialize a folder list
 void InitFolderList(struct FolderList *flist)
@@ -326,6 +341,9 @@ void FreeFolder(struct Folder *folder)
 {
   ENTER();
 
+  ClearMsgIDTables(folder);
+  MailThreadsFree(folder);
+  BodyIndexFree(folder);
   DeleteMailList(folder->messages);
   free(folder);
 
@@ -342,6 +360,12 @@ void MoveFolderContents(struct Folder *to, struct Folder *from)
   // move over all messages
   MoveMailList(to->messages, from->messages);
 
+  // the message ID tables and the threads will be rebuilt on demand
+  ClearMsgIDTables(to);
+  ClearMsgIDTables(from);
+  MailThreadsFree(to);
+  MailThreadsFree(from);
+
   // adjust the stats
   to->Size += from->Size;
   to->Total += from->Total;
@@ -359,6 +383,210 @@ void MoveFolderContents(struct Folder *to, struct Folder *from)
   LEAVE();
 }
 
+///
+/// AddMsgIDMail
+// add a mail to a message ID table
+static void AddMsgIDMail(struct HashTable *table, unsigned long cMsgID, struct Mail *mail)
+{
+  struct HashEntryHeader *entry;
+
+  ENTER();
+
+  // mails without an ID are never looked up
+  if(cMsgID != 0 && (entry = HashTableOperate(table, (void *)cMsgID, htoAdd)) != NULL)
+  {
+    struct MsgIDMails *idMails = (struct MsgIDMails *)entry;
+
+    idMails->cMsgID = cMsgID;
+
+    // enlarge the array if necessary
+    if(idMails->numMails >= idMails->maxMails)
+    {
+      ULONG newMax = idMails->maxMails + 4;
+      struct Mail **newMails;
+
+      if((newMails = realloc(idMails->mails, newMax * sizeof(*newMails))) != NULL)
+      {
+        idMails->mails = newMails;
+        idMails->maxMails = newMax;
+      }
+    }
+
+    if(idMails->numMails < idMails->maxMails)
+      idMails->mails[idMails->numMails++] = mail;
+    else if(idMails->numMails == 0)
+      HashTableRawRemove(table, entry);
+  }
+
+  LEAVE();
+}
+
+///
+/// RemoveMsgIDMail
+// remove a mail from a message ID table
+static void RemoveMsgIDMail(struct HashTable *table, unsigned long cMsgID, const struct Mail *mail)
+{
+  struct HashEntryHeader *entry;
+
+  ENTER();
+
+  if(cMsgID != 0 && (entry = HashTableOperate(table, (void *)cMsgID, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+  {
+    struct MsgIDMails *idMails = (struct MsgIDMails *)entry;
+    ULONG i;
+
+    for(i=0; i < idMails->numMails; i++)
+    {
+      if(idMails->mails[i] == mail)
+      {
+        // keep the remaining mails in their order
+        idMails->numMails--;
+        memmove(&idMails->mails[i], &idMails->mails[i+1], (idMails->numMails - i) * sizeof(*idMails->mails));
+        break;
+      }
+    }
+
+    if(idMails->numMails == 0)
+    {
+      free(idMails->mails);
+      HashTableRawRemove(table, entry);
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// FreeMsgIDMails
+// HashTableEnumerate() callback to free the mail arrays of a message ID table
+static enum HashTableOperator FreeMsgIDMails(UNUSED struct HashTable *table,
+                                             struct HashEntryHeader *entry,
+                                             UNUSED ULONG number,
+                                             UNUSED void *arg)
+{
+  struct MsgIDMails *idMails = (struct MsgIDMails *)entry;
+
+  ENTER();
+
+  free(idMails->mails);
+  idMails->mails = NULL;
+
+  RETURN(htoNext);
+  return htoNext;
+}
+
+///
+/// AddMailToMsgIDTables
+// add a mail to the message ID tables of a folder, the folder's mail
+// list must be locked exclusively
+void AddMailToMsgIDTables(struct Folder *folder, struct Mail *mail)
+{
+  ENTER();
+
+  // nothing to do as long as the tables were not built yet
+  if(folder->msgIDTable != NULL)
+  {
+    AddMsgIDMail(folder->msgIDTable, mail->cMsgID, mail);
+    AddMsgIDMail(folder->irtMsgIDTable, mail->cIRTMsgID, mail);
+  }
+
+  LEAVE();
+}
+
+///
+/// RemoveMailFromMsgIDTables
+// remove a mail from the message ID tables of a folder, the folder's mail
+// list must be locked exclusively
+void RemoveMailFromMsgIDTables(struct Folder *folder, const struct Mail *mail)
+{
+  ENTER();
+
+  if(folder->msgIDTable != NULL)
+  {
+    RemoveMsgIDMail(folder->msgIDTable, mail->cMsgID, mail);
+    RemoveMsgIDMail(folder->irtMsgIDTable, mail->cIRTMsgID, mail);
+  }
+
+  LEAVE();
+}
+
+///
+/// ClearMsgIDTables
+// free the message ID tables of a folder, they will be rebuilt on demand
+void ClearMsgIDTables(struct Folder *folder)
+{
+  ENTER();
+
+  if(folder->msgIDTable != NULL)
+  {
+    HashTableEnumerate(folder->msgIDTable, FreeMsgIDMails, NULL);
+    HashTableDestroy(folder->msgIDTable);
+    folder->msgIDTable = NULL;
+  }
+
+  if(folder->irtMsgIDTable != NULL)
+  {
+    HashTableEnumerate(folder->irtMsgIDTable, FreeMsgIDMails, NULL);
+    HashTableDestroy(folder->irtMsgIDTable);
+    folder->irtMsgIDTable = NULL;
+  }
+
+  LEAVE();
+}
+
+///
+/// LookupMsgIDTable
+// find all mails of a folder with the given compressed message ID or with
+// the given compressed In-Reply-To message ID. The tables are built upon
+// the first lookup, hence the folder's mail list must be locked exclusively.
+// The returned array is valid until the mail list is modified.
+struct Mail **LookupMsgIDTable(struct Folder *folder, unsigned long cMsgID, BOOL inReplyTo, ULONG *numMails)
+{
+  struct Mail **mails = NULL;
+
+  ENTER();
+
+  *numMails = 0;
+
+  if(folder->msgIDTable == NULL)
+  {
+    folder->msgIDTable = HashTableNew(HashTableGetDefaultOps(), NULL, sizeof(struct MsgIDMails), folder->messages->count);
+    folder->irtMsgIDTable = HashTableNew(HashTableGetDefaultOps(), NULL, sizeof(struct MsgIDMails), folder->messages->count);
+
+    if(folder->msgIDTable != NULL && folder->irtMsgIDTable != NULL)
+    {
+      struct MailNode *mnode;
+
+      ForEachMailNode(folder->messages, mnode)
+        AddMailToMsgIDTables(folder, mnode->mail);
+
+      D(DBF_FOLDER, "built message ID tables of folder '%s' with %ld mails", folder->Name, folder->messages->count);
+    }
+    else
+    {
+      E(DBF_FOLDER, "couldn't create message ID tables of folder '%s'", folder->Name);
+      ClearMsgIDTables(folder);
+    }
+  }
+
+  if(folder->msgIDTable != NULL && cMsgID != 0)
+  {
+    struct HashTable *table = (inReplyTo == TRUE) ? folder->irtMsgIDTable : folder->msgIDTable;
+    struct HashEntryHeader *entry;
+
+    if((entry = HashTableOperate(table, (void *)cMsgID, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+    {
+      struct MsgIDMails *idMails = (struct MsgIDMails *)entry;
+
+      mails = idMails->mails;
+      *numMails = idMails->numMails;
+    }
+  }
+
+  RETURN(mails);
+  return mails;
+}
+
 ///
 /// IsUniqueFolderID
 // check for a unique folder ID
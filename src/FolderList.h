@@ -38,6 +38,7 @@
 // forward declarations
 struct SignalSemaphore;
 struct Folder;
+struct Mail;
 
 struct FolderList
 {
@@ -66,6 +67,10 @@ struct Folder *AllocFolder();
 void InitFolder(struct Folder *folder, enum FolderType type);
 void FreeFolder(struct Folder *folder);
 void MoveFolderContents(struct Folder *to, struct Folder *from);
+void AddMailToMsgIDTables(struct Folder *folder, struct Mail *mail);
+void RemoveMailFromMsgIDTables(struct Folder *folder, const struct Mail *mail);
+void ClearMsgIDTables(struct Folder *folder);
+struct Mail **LookupMsgIDTable(struct Folder *folder, unsigned long cMsgID, BOOL inReplyTo, ULONG *numMails);
 BOOL IsUniqueFolderID(const struct FolderList *flist, const int id);
 struct Folder *FindFolderByID(const struct FolderList *flist, const int id);
 
@@ -0,0 +1,382 @@
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <clib/alib_protos.h>
+#include <proto/dos.h>
+#include <proto/exec.h>
+
+#include "extrasrc.h"
+
+#include "YAM.h"
+#include "YAM_folderconfig.h"
+#include "YAM_mainFolder.h"
+#include "YAM_read.h"
+#include "YAM_utilities.h"
+
+#include "FileInfo.h"
+#include "HeaderCache.h"
+#include "Threads.h"
+
+#include "Debug.h"
+
+// the maximum number of mails to keep the headers of
+#define HEADERCACHE_SIZE 16
+
+struct HeaderCacheNode
+{
+  struct MinNode node;            // for placing the node into the cache
+  const struct Folder *folder;    // the folder of the mail
+  char mailFile[SIZE_MFILE];      // the file name of the mail
+  struct DateStamp date;          // the modification date of the mail file
+  struct ExtendedMail *email;     // the examined mail, NULL if not yet examined
+  struct MinList *headerList;     // the main header of the mail, NULL if not yet read
+};
+
+struct HeaderCache
+{
+  struct MinList nodes;           // the cached mails, most recently used first
+  ULONG numNodes;                 // the number of cached mails
+  ULONG nesting;                  // the number of HeaderCacheBegin() calls without HeaderCacheEnd()
+  ULONG hits;                     // the number of requests served from the cache
+  ULONG misses;                   // the number of requests which required parsing the mail
+};
+
+static struct HeaderCache headerCache;
+
+/*** Private functions ***/
+/// ReadMailHeaders
+// read the main header of a mail file
+static struct MinList *ReadMailHeaders(const struct Mail *mail)
+{
+  char fullfile[SIZE_PATHFILE];
+  char mailfile[SIZE_PATHFILE];
+  struct MinList *headerList = NULL;
+
+  ENTER();
+
+  GetMailFile(mailfile, sizeof(mailfile), NULL, mail);
+
+  if(StartUnpack(mailfile, fullfile, mail->Folder) != NULL)
+  {
+    FILE *fh;
+
+    if((fh = fopen(fullfile, "r")) != NULL)
+    {
+      if((headerList = AllocSysObjectTags(ASOT_LIST,
+        ASOLIST_Min, TRUE,
+        TAG_DONE)) != NULL)
+      {
+        setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
+
+        if(MA_ReadHeader(mailfile, fh, headerList, RHM_MAINHEADER) == FALSE)
+        {
+          ClearHeaderList(headerList);
+          FreeSysObject(ASOT_LIST, headerList);
+          headerList = NULL;
+        }
+      }
+
+      // close the file
+      fclose(fh);
+    }
+
+    FinishUnpack(fullfile);
+  }
+
+  RETURN(headerList);
+  return headerList;
+}
+
+///
+/// FreeMailHeaders
+// free the main header of a mail
+static void FreeMailHeaders(struct MinList *headerList)
+{
+  ENTER();
+
+  if(headerList != NULL)
+  {
+    ClearHeaderList(headerList);
+    FreeSysObject(ASOT_LIST, headerList);
+  }
+
+  LEAVE();
+}
+
+///
+/// DeleteHeaderCacheNode
+// remove a mail from the cache and free all its data
+static void DeleteHeaderCacheNode(struct HeaderCacheNode *hcn)
+{
+  ENTER();
+
+  Remove((struct Node *)hcn);
+  headerCache.numNodes--;
+
+  if(hcn->email != NULL)
+    MA_FreeEMailStruct(hcn->email);
+  FreeMailHeaders(hcn->headerList);
+  free(hcn);
+
+  LEAVE();
+}
+
+///
+/// FindHeaderCacheNode
+// find the cache entry of a mail, a new entry is created if the mail is
+// not yet cached or if the mail file was modified since it was cached
+static struct HeaderCacheNode *FindHeaderCacheNode(const struct Mail *mail)
+{
+  struct HeaderCacheNode *result = NULL;
+
+  ENTER();
+
+  // the cache is used by the main thread only
+  if(headerCache.nesting > 0 && mail->Folder != NULL && IsMainThread() == TRUE)
+  {
+    char mailfile[SIZE_PATHFILE];
+    struct DateStamp date;
+
+    GetMailFile(mailfile, sizeof(mailfile), NULL, mail);
+
+    if(ObtainFileInfo(mailfile, FI_DATE, &date) == TRUE)
+    {
+      struct HeaderCacheNode *hcn;
+      struct HeaderCacheNode *next;
+
+      SafeIterateList(&headerCache.nodes, struct HeaderCacheNode *, hcn, next)
+      {
+        if(hcn->folder == mail->Folder && strcmp(hcn->mailFile, mail->MailFile) == 0)
+        {
+          if(CompareDates(&hcn->date, &date) == 0)
+          {
+            // move the node to the front of the list
+            Remove((struct Node *)hcn);
+            AddHead((struct List *)&headerCache.nodes, (struct Node *)hcn);
+            result = hcn;
+          }
+          else
+          {
+            // forget about the outdated data
+            DeleteHeaderCacheNode(hcn);
+          }
+
+          break;
+        }
+      }
+
+      if(result == NULL)
+      {
+        // throw away the least recently used mail if the cache is full
+        if(headerCache.numNodes >= HEADERCACHE_SIZE)
+          DeleteHeaderCacheNode((struct HeaderCacheNode *)GetTail((struct List *)&headerCache.nodes));
+
+        if((result = calloc(1, sizeof(*result))) != NULL)
+        {
+          result->folder = mail->Folder;
+          strlcpy(result->mailFile, mail->MailFile, sizeof(result->mailFile));
+          memcpy(&result->date, &date, sizeof(result->date));
+
+          AddHead((struct List *)&headerCache.nodes, (struct Node *)result);
+          headerCache.numNodes++;
+        }
+      }
+    }
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// IsCachedData
+// check whether some data belongs to a cached mail
+static BOOL IsCachedData(const void *data)
+{
+  BOOL cached = FALSE;
+
+  ENTER();
+
+  if(headerCache.nesting > 0 && IsMainThread() == TRUE)
+  {
+    struct HeaderCacheNode *hcn;
+
+    IterateList(&headerCache.nodes, struct HeaderCacheNode *, hcn)
+    {
+      if(data == hcn->email || data == hcn->headerList)
+      {
+        cached = TRUE;
+        break;
+      }
+    }
+  }
+
+  RETURN(cached);
+  return cached;
+}
+
+///
+
+/*** Public functions ***/
+/// HeaderCacheBegin
+// start caching the headers of examined mails, must be called by the main
+// thread only
+void HeaderCacheBegin(void)
+{
+  ENTER();
+
+  if(headerCache.nesting == 0)
+  {
+    NewMinList(&headerCache.nodes);
+    headerCache.numNodes = 0;
+    headerCache.hits = 0;
+    headerCache.misses = 0;
+  }
+
+  headerCache.nesting++;
+
+  LEAVE();
+}
+
+///
+/// HeaderCacheEnd
+// stop caching the headers of examined mails and free all cached data
+void HeaderCacheEnd(void)
+{
+  ENTER();
+
+  if(headerCache.nesting > 0)
+  {
+    headerCache.nesting--;
+
+    if(headerCache.nesting == 0)
+    {
+      struct HeaderCacheNode *hcn;
+
+      D(DBF_FILTER, "header cache statistics: %ld hits, %ld misses", headerCache.hits, headerCache.misses);
+
+      while((hcn = (struct HeaderCacheNode *)GetHead((struct List *)&headerCache.nodes)) != NULL)
+        DeleteHeaderCacheNode(hcn);
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// ObtainExtendedMail
+// get the examined version of a mail including all recipients, the result
+// must be released by ReleaseExtendedMail()
+struct ExtendedMail *ObtainExtendedMail(const struct Mail *mail)
+{
+  struct ExtendedMail *email;
+  struct HeaderCacheNode *hcn;
+
+  ENTER();
+
+  if((hcn = FindHeaderCacheNode(mail)) != NULL)
+  {
+    if(hcn->email != NULL)
+    {
+      headerCache.hits++;
+    }
+    else
+    {
+      headerCache.misses++;
+      hcn->email = MA_ExamineMail(mail->Folder, mail->MailFile, TRUE);
+    }
+
+    email = hcn->email;
+  }
+  else
+    email = MA_ExamineMail(mail->Folder, mail->MailFile, TRUE);
+
+  RETURN(email);
+  return email;
+}
+
+///
+/// ReleaseExtendedMail
+// release an examined mail obtained by ObtainExtendedMail()
+void ReleaseExtendedMail(struct ExtendedMail *email)
+{
+  ENTER();
+
+  if(email != NULL && IsCachedData(email) == FALSE)
+    MA_FreeEMailStruct(email);
+
+  LEAVE();
+}
+
+///
+/// ObtainMailHeaders
+// get the list of main header lines of a mail, the result must be released
+// by ReleaseMailHeaders()
+struct MinList *ObtainMailHeaders(const struct Mail *mail)
+{
+  struct MinList *headerList;
+  struct HeaderCacheNode *hcn;
+
+  ENTER();
+
+  if((hcn = FindHeaderCacheNode(mail)) != NULL)
+  {
+    if(hcn->headerList != NULL)
+    {
+      headerCache.hits++;
+    }
+    else
+    {
+      headerCache.misses++;
+      hcn->headerList = ReadMailHeaders(mail);
+    }
+
+    headerList = hcn->headerList;
+  }
+  else
+    headerList = ReadMailHeaders(mail);
+
+  RETURN(headerList);
+  return headerList;
+}
+
+///
+/// ReleaseMailHeaders
+// release a list of header lines obtained by ObtainMailHeaders()
+void ReleaseMailHeaders(struct MinList *headerList)
+{
+  ENTER();
+
+  if(headerList != NULL && IsCachedData(headerList) == FALSE)
+    FreeMailHeaders(headerList);
+
+  LEAVE();
+}
+
+///
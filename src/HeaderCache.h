@@ -0,0 +1,54 @@
+#ifndef HEADERCACHE_H
+#define HEADERCACHE_H 1
+
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+
+#include <exec/types.h>
+
+// forward declarations
+struct Mail;
+struct ExtendedMail;
+struct MinList;
+
+/*
+ A small cache of the parsed headers of the most recently examined mails.
+ While a filter run is active the filter rules share the headers of a
+ mail instead of parsing the mail file again for each single rule.
+ Outside of a filter run or on other threads than the main thread all
+ functions fall back to parsing the mail file every time.
+*/
+
+void HeaderCacheBegin(void);
+void HeaderCacheEnd(void);
+struct ExtendedMail *ObtainExtendedMail(const struct Mail *mail);
+void ReleaseExtendedMail(struct ExtendedMail *email);
+struct MinList *ObtainMailHeaders(const struct Mail *mail);
+void ReleaseMailHeaders(struct MinList *headerList);
+
+#endif /* HEADERCACHE_H */
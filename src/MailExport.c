@@ -249,7 +249,7 @@ BOOL ExportMails(const char *fname, struct MailList *mlist, const ULONG flags)
                     }
 
                     // update the transfer status
-                    PushMethodOnStack(tc->transferGroup, 3, MUIM_TransferControlGroup_Update, curlen, tr(MSG_TR_Exporting));
+                    PushCoalescedMethodOnStack(tc->transferGroup, MSC_ACCUMULATE, 3, MUIM_TransferControlGroup_Update, curlen, tr(MSG_TR_Exporting));
                   }
 
                   // check why we exited the while() loop and if everything is fine
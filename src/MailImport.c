@@ -969,7 +969,7 @@ static void ProcessImport(struct TransferContext *tc, const char *importFile, st
                 }
 
                 // update the transfer statistics
-                PushMethodOnStack(tc->transferGroup, 3, MUIM_TransferControlGroup_Update, lineLength+1, tr(MSG_TR_Importing));
+                PushCoalescedMethodOnStack(tc->transferGroup, MSC_ACCUMULATE, 3, MUIM_TransferControlGroup_Update, lineLength+1, tr(MSG_TR_Importing));
               }
 
               fclose(ofh);
@@ -37,9 +37,68 @@
 #include "YAM_mainFolder.h"
 
 #include "MailList.h"
+#include "MailSort.h"
+#include "StringPool.h"
 
 #include "Debug.h"
 
+#if defined(DEBUG)
+// allocation counters for the debug build, these are modified with multitasking
+// disabled because extended mails are allocated by several threads in parallel
+struct AllocCounter
+{
+  LONG current; // number of currently allocated objects
+  LONG peak;    // maximum number of objects allocated at the same time
+  LONG total;   // total number of allocations
+};
+
+static struct AllocCounter mailAllocs;
+static struct AllocCounter mailNodeAllocs;
+static struct AllocCounter extendedMailAllocs;
+
+/// CountAlloc
+static void CountAlloc(struct AllocCounter *counter)
+{
+  Forbid();
+  counter->current++;
+  counter->total++;
+  if(counter->current > counter->peak)
+    counter->peak = counter->current;
+  Permit();
+}
+
+///
+/// CountFree
+static void CountFree(struct AllocCounter *counter)
+{
+  Forbid();
+  counter->current--;
+  Permit();
+}
+
+///
+/// DumpMailAllocations
+// output the allocation statistics and complain about leaked objects
+void DumpMailAllocations(void)
+{
+  ENTER();
+
+  D(DBF_MAIL, "mails:          %ld allocated, %ld at peak, %ld in total", mailAllocs.current, mailAllocs.peak, mailAllocs.total);
+  D(DBF_MAIL, "mail nodes:     %ld allocated, %ld at peak, %ld in total", mailNodeAllocs.current, mailNodeAllocs.peak, mailNodeAllocs.total);
+  D(DBF_MAIL, "extended mails: %ld allocated, %ld at peak, %ld in total", extendedMailAllocs.current, extendedMailAllocs.peak, extendedMailAllocs.total);
+
+  if(mailAllocs.current != 0 || mailNodeAllocs.current != 0 || extendedMailAllocs.current != 0)
+    W(DBF_MAIL, "there are still %ld mails, %ld mail nodes and %ld extended mails allocated", mailAllocs.current, mailNodeAllocs.current, extendedMailAllocs.current);
+
+  LEAVE();
+}
+
+///
+#else
+#define CountAlloc(counter)  ((void)0)
+#define CountFree(counter)   ((void)0)
+#endif
+
 /// InitMailList
 // initialize a mail list
 void InitMailList(struct MailList *mlist)
@@ -209,6 +268,8 @@ struct MailNode *AddNewMailNode(struct MailList *mlist, struct Mail *mail)
   {
     if((mnode = ItemPoolAlloc(G->mailNodeItemPool)) != NULL)
     {
+      CountAlloc(&mailNodeAllocs);
+
       // initialize the node's contents
       mnode->mail = mail;
 
@@ -279,20 +340,71 @@ void DeleteMailNode(struct MailNode *mnode)
   // decrease the mail's reference counter and try to free it
   DereferenceMail(mnode->mail);
   ItemPoolFree(G->mailNodeItemPool, mnode);
+  CountFree(&mailNodeAllocs);
 
   LEAVE();
 }
 
+///
+
+// the comparison function passed to SortMailList()
+struct MailNodeCompare
+{
+  int (* compare)(const struct MailNode *m1, const struct MailNode *m2);
+};
+
+/// CompareMailNodes
+// call the comparison function passed to SortMailList()
+static int CompareMailNodes(const void *p1, const void *p2, const void *userData)
+{
+  const struct MailNodeCompare *mnc = userData;
+
+  return mnc->compare((const struct MailNode *)p1, (const struct MailNode *)p2);
+}
+
 ///
 /// SortMailList
 // sort a list of mails with a comparison function
+// if locking of the list is needed this must be done by the calling function
 void SortMailList(struct MailList *mlist, int (* compare)(const struct MailNode *m1, const struct MailNode *m2))
 {
   ENTER();
 
   // sort only if there is something to sort at all
   if(mlist != NULL && mlist->count > 1)
-    SortExecList(&mlist->list, (int (*)(const struct MinNode *, const struct MinNode *))compare);
+  {
+    struct MailNode **array;
+    BOOL sorted = FALSE;
+
+    // sorting an array of the nodes is much faster than sorting the list
+    // itself, because the nodes don't need to be walked over and over again
+    if((array = malloc(mlist->count * sizeof(*array))) != NULL)
+    {
+      struct MailNodeCompare mnc;
+      struct MailNode *mnode;
+      ULONG i = 0;
+
+      ForEachMailNode(mlist, mnode)
+        array[i++] = mnode;
+
+      mnc.compare = compare;
+      if(SortPointerArray((void **)array, mlist->count, CompareMailNodes, &mnc, FALSE) == TRUE)
+      {
+        // relink the nodes in their new order
+        NewMinList(&mlist->list);
+        for(i=0; i < mlist->count; i++)
+          AddTail((struct List *)&mlist->list, (struct Node *)&array[i]->node);
+
+        sorted = TRUE;
+      }
+
+      free(array);
+    }
+
+    // fall back to sorting the list directly if we are short of memory
+    if(sorted == FALSE)
+      SortExecList(&mlist->list, (int (*)(const struct MinNode *, const struct MinNode *))compare);
+  }
 
   LEAVE();
 }
@@ -415,12 +527,186 @@ struct Mail *AllocMail(void)
 
   ENTER();
 
-  mail = ItemPoolAlloc(G->mailItemPool);
+  if((mail = ItemPoolAlloc(G->mailItemPool)) != NULL)
+  {
+    CountAlloc(&mailAllocs);
+    InitMailStrings(mail);
+  }
 
   RETURN(mail);
   return mail;
 }
 
+///
+/// InitMailStrings
+// let all string pointers of a cleared mail structure point to empty strings
+void InitMailStrings(struct Mail *mail)
+{
+  ENTER();
+
+  mail->From.Address = InternString(NULL);
+  mail->From.RealName = InternString(NULL);
+  mail->To.Address = InternString(NULL);
+  mail->To.RealName = InternString(NULL);
+  mail->ReplyTo.Address = InternString(NULL);
+  mail->ReplyTo.RealName = InternString(NULL);
+  mail->tzAbbr = InternString(NULL);
+  mail->MailAccount = InternString(NULL);
+  mail->Subject = InternString(NULL);
+
+  LEAVE();
+}
+
+///
+/// SetMailSubject
+// replace the subject of a mail, the mail gets its own copy
+void SetMailSubject(struct Mail *mail, const char *subject)
+{
+  const char *newSubject = InternString(NULL);
+
+  ENTER();
+
+  // empty subjects don't need any memory at all
+  if(subject != NULL && subject[0] != '\0')
+  {
+    // truncate overlong subjects just like before
+    size_t len = strlen(subject);
+    char *copy;
+
+    if(len >= SIZE_SUBJECT)
+      len = SIZE_SUBJECT-1;
+
+    if((copy = malloc(len+1)) != NULL)
+    {
+      memcpy(copy, subject, len);
+      copy[len] = '\0';
+      newSubject = copy;
+    }
+  }
+
+  FreeMailSubject(mail);
+  mail->Subject = newSubject;
+
+  LEAVE();
+}
+
+///
+/// FreeMailSubject
+// free the subject of a mail
+void FreeMailSubject(struct Mail *mail)
+{
+  ENTER();
+
+  // only non-empty subjects are allocated
+  if(mail->Subject != NULL && mail->Subject[0] != '\0')
+    free((char *)mail->Subject);
+
+  mail->Subject = InternString(NULL);
+
+  LEAVE();
+}
+
+///
+/// SetMailPerson
+// set the address and real name of a mail's sender or recipient
+void SetMailPerson(struct MailPerson *mpe, const char *address, const char *realName)
+{
+  ENTER();
+
+  SetPooledString(&mpe->Address, address, SIZE_ADDRESS);
+  SetPooledString(&mpe->RealName, realName, SIZE_REALNAME);
+
+  LEAVE();
+}
+
+///
+/// GetMailPerson
+// copy a mail's sender or recipient to a person structure
+struct Person *GetMailPerson(const struct MailPerson *mpe, struct Person *pe)
+{
+  ENTER();
+
+  strlcpy(pe->Address, mpe->Address, sizeof(pe->Address));
+  strlcpy(pe->RealName, mpe->RealName, sizeof(pe->RealName));
+
+  RETURN(pe);
+  return pe;
+}
+
+///
+/// CopyMailData
+// copy all data of a mail to another uninitialized mail structure. The copy
+// gets its own message ID, references and subject and new references to the
+// pooled strings, hence it must be freed by FreeMailData() separately.
+void CopyMailData(struct Mail *dst, const struct Mail *src)
+{
+  ENTER();
+
+  memcpy(dst, src, sizeof(*dst));
+
+  // the copy needs its own copy of the message ID
+  if(src->MsgID != NULL)
+    dst->MsgID = strdup(src->MsgID);
+
+  // and of the references
+  if(src->cRefMsgIDs != NULL)
+  {
+    size_t size = sizeof(*src->cRefMsgIDs);
+    ULONG i;
+
+    for(i=0; src->cRefMsgIDs[i] != 0; i++)
+      size += sizeof(*src->cRefMsgIDs);
+
+    if((dst->cRefMsgIDs = malloc(size)) != NULL)
+      memcpy(dst->cRefMsgIDs, src->cRefMsgIDs, size);
+  }
+
+  // and of the subject
+  dst->Subject = InternString(NULL);
+  SetMailSubject(dst, src->Subject);
+
+  // all other strings are pooled
+  ReferenceString(dst->From.Address);
+  ReferenceString(dst->From.RealName);
+  ReferenceString(dst->To.Address);
+  ReferenceString(dst->To.RealName);
+  ReferenceString(dst->ReplyTo.Address);
+  ReferenceString(dst->ReplyTo.RealName);
+  ReferenceString(dst->tzAbbr);
+  ReferenceString(dst->MailAccount);
+
+  LEAVE();
+}
+
+///
+/// FreeMailData
+// free all data of a mail, but not the mail structure itself. All strings
+// are empty afterwards.
+void FreeMailData(struct Mail *mail)
+{
+  ENTER();
+
+  free(mail->MsgID);
+  mail->MsgID = NULL;
+
+  free(mail->cRefMsgIDs);
+  mail->cRefMsgIDs = NULL;
+
+  FreeMailSubject(mail);
+
+  ReleaseString(mail->From.Address);
+  ReleaseString(mail->From.RealName);
+  ReleaseString(mail->To.Address);
+  ReleaseString(mail->To.RealName);
+  ReleaseString(mail->ReplyTo.Address);
+  ReleaseString(mail->ReplyTo.RealName);
+  ReleaseString(mail->tzAbbr);
+  ReleaseString(mail->MailAccount);
+  InitMailStrings(mail);
+
+  LEAVE();
+}
+
 ///
 /// CloneMail
 // create a clone of a mail structure
@@ -432,7 +718,9 @@ struct Mail *CloneMail(const struct Mail *mail)
 
   if((clone = ItemPoolAlloc(G->mailItemPool)) != NULL)
   {
-    memcpy(clone, mail, sizeof(*clone));
+    CountAlloc(&mailAllocs);
+
+    CopyMailData(clone, mail);
 
     // start with a reference counter of zero
     clone->RefCounter = 0;
@@ -452,7 +740,11 @@ void FreeMail(struct Mail *mail)
   if(mail != NULL)
   {
     if(mail->RefCounter == 0)
+    {
+      FreeMailData(mail);
       ItemPoolFree(G->mailItemPool, mail);
+      CountFree(&mailAllocs);
+    }
     else
       W(DBF_MAIL, "FreeMail attempt on mail (%08lx) with RefCounter > 0 (%d)", mail, mail->RefCounter);
   }
@@ -460,6 +752,42 @@ void FreeMail(struct Mail *mail)
   LEAVE();
 }
 
+///
+/// AllocExtendedMail
+// allocate a cleared extended mail structure, this function is thread safe
+struct ExtendedMail *AllocExtendedMail(void)
+{
+  struct ExtendedMail *email;
+
+  ENTER();
+
+  if((email = ItemPoolAlloc(G->extendedMailItemPool)) != NULL)
+  {
+    CountAlloc(&extendedMailAllocs);
+    InitMailStrings(&email->Mail);
+  }
+
+  RETURN(email);
+  return email;
+}
+
+///
+/// FreeExtendedMail
+// free an extended mail structure, all embedded strings and arrays must
+// have been freed before (see FreeMailData()), this function is thread safe
+void FreeExtendedMail(struct ExtendedMail *email)
+{
+  ENTER();
+
+  if(email != NULL)
+  {
+    ItemPoolFree(G->extendedMailItemPool, email);
+    CountFree(&extendedMailAllocs);
+  }
+
+  LEAVE();
+}
+
 ///
 /// ReferenceMail
 // increase a mail's reference counter
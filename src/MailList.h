@@ -38,6 +38,9 @@
 // forward declarations
 struct SignalSemaphore;
 struct Mail;
+struct ExtendedMail;
+struct MailPerson;
+struct Person;
 
 struct MailList
 {
@@ -68,10 +71,23 @@ struct MailNode *FindMailByAddress(const struct MailList *mlist, const struct Ma
 struct MailNode *FindMailByFilename(const struct MailList *mlist, const char *filename);
 struct MailNode *TakeMailNode(struct MailList *mlist);
 struct Mail *AllocMail(void);
+void InitMailStrings(struct Mail *mail);
+void SetMailSubject(struct Mail *mail, const char *subject);
+void FreeMailSubject(struct Mail *mail);
+void SetMailPerson(struct MailPerson *mpe, const char *address, const char *realName);
+struct Person *GetMailPerson(const struct MailPerson *mpe, struct Person *pe);
+void CopyMailData(struct Mail *dst, const struct Mail *src);
+void FreeMailData(struct Mail *mail);
 struct Mail *CloneMail(const struct Mail *mail);
 void ReferenceMail(struct Mail *mail);
 void DereferenceMail(struct Mail *mail);
 void FreeMail(struct Mail *mail);
+struct ExtendedMail *AllocExtendedMail(void);
+void FreeExtendedMail(struct ExtendedMail *email);
+
+#if defined(DEBUG)
+void DumpMailAllocations(void);
+#endif
 
 // public comparison functions
 int CompareMailsByDate(const struct MailNode *m1, const struct MailNode *m2);
@@ -0,0 +1,364 @@
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <proto/dos.h>
+#include <proto/exec.h>
+
+#include "extrasrc.h"
+
+#include "YAM.h"
+#include "YAM_utilities.h"
+
+#include "MailSort.h"
+#include "Threads.h"
+
+#include "Debug.h"
+
+// short runs are sorted by insertion sort before they are merged
+#define INSERTION_SORT_RUN      16
+
+// the maximum number of parts which are sorted in parallel and the minimum
+// number of entries for each part
+#define MAILSORT_PARTS          4
+#define MAILSORT_MIN_PART_SIZE  16384
+
+struct SortContext
+{
+  int (* compare)(const void *p1, const void *p2, const void *userData);
+  const void *userData;
+};
+
+// a part of an array which is sorted by a thread
+struct MailSortChunk
+{
+  void **array;              // the part of the array to be sorted
+  void **temp;               // the corresponding part of the temporary array
+  ULONG count;               // the number of entries in this part
+};
+
+// the shared data of a parallel sort
+struct MailSortData
+{
+  struct SortContext context;
+  struct MailSortChunk chunk[MAILSORT_PARTS];
+};
+
+/*** Static functions ***/
+/// InsertionSort
+// sort a short run of entries
+static void InsertionSort(void **array, ULONG count, const struct SortContext *ctx)
+{
+  ULONG i;
+
+  for(i=1; i < count; i++)
+  {
+    void *entry = array[i];
+    ULONG j = i;
+
+    while(j > 0 && ctx->compare(array[j-1], entry, ctx->userData) > 0)
+    {
+      array[j] = array[j-1];
+      j--;
+    }
+
+    array[j] = entry;
+  }
+}
+
+///
+/// MergeRuns
+// merge the two sorted runs src[start..mid) and src[mid..end) into dst,
+// equal entries keep their order
+static void MergeRuns(void **src, void **dst, ULONG start, ULONG mid, ULONG end, const struct SortContext *ctx)
+{
+  ULONG i = start;
+  ULONG j = mid;
+  ULONG k = start;
+
+  // nothing to merge if both runs are in order already
+  if(mid < end && ctx->compare(src[mid-1], src[mid], ctx->userData) <= 0)
+  {
+    memcpy(&dst[start], &src[start], (end-start) * sizeof(*dst));
+    return;
+  }
+
+  while(i < mid && j < end)
+  {
+    if(ctx->compare(src[i], src[j], ctx->userData) <= 0)
+      dst[k++] = src[i++];
+    else
+      dst[k++] = src[j++];
+  }
+
+  if(i < mid)
+    memcpy(&dst[k], &src[i], (mid-i) * sizeof(*dst));
+  else if(j < end)
+    memcpy(&dst[k], &src[j], (end-j) * sizeof(*dst));
+}
+
+///
+/// MergeSort
+// sort an array using a bottom up merge sort, temp must be as large as the array
+static void MergeSort(void **array, void **temp, ULONG count, const struct SortContext *ctx)
+{
+  void **src = array;
+  void **dst = temp;
+  ULONG width;
+  ULONG start;
+
+  for(start=0; start < count; start += INSERTION_SORT_RUN)
+    InsertionSort(&array[start], MIN(INSERTION_SORT_RUN, count-start), ctx);
+
+  for(width=INSERTION_SORT_RUN; width < count; width *= 2)
+  {
+    void **swap;
+
+    for(start=0; start < count; start += 2*width)
+    {
+      ULONG mid = MIN(start+width, count);
+      ULONG end = MIN(start+2*width, count);
+
+      MergeRuns(src, dst, start, mid, end, ctx);
+    }
+
+    swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if(src != array)
+    memcpy(array, src, count * sizeof(*array));
+}
+
+///
+/// CompareKeys
+// compare two sort keys of the same type
+static int CompareKeys(const struct MailSortKey *key1, const struct MailSortKey *key2, enum MailSortKeyType type)
+{
+  if(key1->hi != key2->hi)
+    return (key1->hi < key2->hi) ? -1 : 1;
+
+  if(key1->lo != key2->lo)
+    return (key1->lo < key2->lo) ? -1 : 1;
+
+  switch(type)
+  {
+    case MSK_TEXT:
+      return strcmp(key1->text, key2->text);
+
+    case MSK_TEXT_NOCASE:
+      return stricmp(key1->text, key2->text);
+
+    default:
+      return 0;
+  }
+}
+
+///
+/// CompareEntries
+// compare two mail sort entries by all keys of the sort order
+static int CompareEntries(const void *p1, const void *p2, const void *userData)
+{
+  const struct MailSortEntry *e1 = p1;
+  const struct MailSortEntry *e2 = p2;
+  const struct MailSortOrder *order = userData;
+  ULONG i;
+
+  for(i=0; i < order->numKeys; i++)
+  {
+    int cmp = CompareKeys(&e1->key[i], &e2->key[i], order->type[i]);
+
+    if(cmp != 0)
+      return (order->reverse[i] == TRUE) ? -cmp : cmp;
+  }
+
+  // keep the previous order of equal mails
+  if(e1->index != e2->index)
+    return (e1->index < e2->index) ? -1 : 1;
+
+  return 0;
+}
+
+///
+
+/*** Public functions ***/
+/// SetMailSortText
+// set up a sort key for a string, the string itself must stay valid
+// until the sort is finished
+void SetMailSortText(struct MailSortKey *key, const char *text, BOOL ignoreCase)
+{
+  const unsigned char *s = (const unsigned char *)text;
+  ULONG prefix[2] = { 0, 0 };
+  int i;
+
+  for(i=0; i < 8 && s[i] != '\0'; i++)
+  {
+    ULONG c = (ignoreCase == TRUE) ? (ULONG)tolower(s[i]) : (ULONG)s[i];
+
+    prefix[i/4] |= c << (24 - (i%4) * 8);
+  }
+
+  key->hi = prefix[0];
+  key->lo = prefix[1];
+  key->text = text;
+}
+
+///
+/// SortMailEntries
+// sort an array of mail sort entries, large arrays are sorted in parallel
+BOOL SortMailEntries(struct MailSortEntry **entries, ULONG numEntries, const struct MailSortOrder *order)
+{
+  BOOL result;
+
+  ENTER();
+
+  result = SortPointerArray((void **)entries, numEntries, CompareEntries, order, TRUE);
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// SortChunk
+// sort a part of an array, this is called by several threads at once
+static void SortChunk(APTR userData, ULONG index)
+{
+  struct MailSortData *data = (struct MailSortData *)userData;
+  struct MailSortChunk *chunk = &data->chunk[index];
+
+  ENTER();
+
+  MergeSort(chunk->array, chunk->temp, chunk->count, &data->context);
+
+  LEAVE();
+}
+
+///
+/// SortPointerArray
+// sort an array of pointers with a stable merge sort. If parallel sorting is
+// allowed large arrays are split into several parts which are sorted by
+// threads and merged afterwards, the comparison function must be thread safe
+// in this case. Returns FALSE if there was not enough memory.
+BOOL SortPointerArray(void **array, ULONG count, int (* compare)(const void *p1, const void *p2, const void *userData), const void *userData, BOOL parallel)
+{
+  BOOL result = TRUE;
+
+  ENTER();
+
+  if(count > 1)
+  {
+    void **temp;
+
+    if((temp = malloc(count * sizeof(*temp))) != NULL)
+    {
+      struct MailSortData data;
+      ULONG numParts = 1;
+
+      memset(&data, 0, sizeof(data));
+      data.context.compare = compare;
+      data.context.userData = userData;
+
+      if(parallel == TRUE && count >= 2*MAILSORT_MIN_PART_SIZE)
+        numParts = MIN(MAILSORT_PARTS, count / MAILSORT_MIN_PART_SIZE);
+
+      STARTCLOCK(DBF_MAIL);
+
+      if(numParts > 1)
+      {
+        ULONG partSize = count / numParts;
+        ULONG runStart[MAILSORT_PARTS+1];
+        ULONG numRuns;
+        void **src;
+        void **dst;
+        ULONG i;
+
+        for(i=0; i < numParts; i++)
+        {
+          struct MailSortChunk *chunk = &data.chunk[i];
+
+          runStart[i] = i * partSize;
+          chunk->array = &array[runStart[i]];
+          chunk->temp = &temp[runStart[i]];
+          chunk->count = (i == numParts-1) ? count - runStart[i] : partSize;
+        }
+        runStart[numParts] = count;
+
+        // sort the parts in parallel, one of them is sorted by ourself
+        RunParallel(numParts, numParts-1, 1, SortChunk, NULL, &data);
+
+        // now merge the sorted parts
+        src = array;
+        dst = temp;
+        numRuns = numParts;
+
+        while(numRuns > 1)
+        {
+          void **swap;
+          ULONG newRuns = 0;
+
+          for(i=0; i < numRuns; i += 2)
+          {
+            if(i+1 < numRuns)
+              MergeRuns(src, dst, runStart[i], runStart[i+1], runStart[i+2], &data.context);
+            else
+              memcpy(&dst[runStart[i]], &src[runStart[i]], (runStart[i+1]-runStart[i]) * sizeof(*dst));
+
+            runStart[newRuns++] = runStart[i];
+          }
+          runStart[newRuns] = count;
+          numRuns = newRuns;
+
+          swap = src;
+          src = dst;
+          dst = swap;
+        }
+
+        if(src != array)
+          memcpy(array, src, count * sizeof(*array));
+      }
+      else
+        MergeSort(array, temp, count, &data.context);
+
+      STOPCLOCK(DBF_MAIL, "sorting array");
+
+      D(DBF_MAIL, "sorted %ld entries in %ld parts", count, numParts);
+
+      free(temp);
+    }
+    else
+      result = FALSE;
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
@@ -0,0 +1,74 @@
+#ifndef MAILSORT_H
+#define MAILSORT_H 1
+
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+#include <exec/types.h>
+
+// forward declarations
+struct Mail;
+
+// the maximum number of keys to sort by
+#define MAILSORT_MAXKEYS 2
+
+enum MailSortKeyType
+{
+  MSK_NUMBER,      // the key consists of the two numbers only
+  MSK_TEXT,        // the key is a string which is compared case sensitive
+  MSK_TEXT_NOCASE  // the key is a string which is compared case insensitive
+};
+
+// a precalculated sort key, numbers are compared as unsigned values, for
+// strings the first eight (case folded) characters are stored in the two
+// numbers and the string itself is compared only if these are equal
+struct MailSortKey
+{
+  ULONG hi;
+  ULONG lo;
+  const char *text;
+};
+
+struct MailSortEntry
+{
+  struct MailSortKey key[MAILSORT_MAXKEYS];
+  struct Mail *mail;
+  ULONG index;      // the original position of the mail
+};
+
+struct MailSortOrder
+{
+  ULONG numKeys;                                // number of keys to compare
+  enum MailSortKeyType type[MAILSORT_MAXKEYS];  // the types of the keys
+  BOOL reverse[MAILSORT_MAXKEYS];               // TRUE for descending order
+};
+
+void SetMailSortText(struct MailSortKey *key, const char *text, BOOL ignoreCase);
+BOOL SortMailEntries(struct MailSortEntry **entries, ULONG numEntries, const struct MailSortOrder *order);
+BOOL SortPointerArray(void **array, ULONG count, int (* compare)(const void *p1, const void *p2, const void *userData), const void *userData, BOOL parallel);
+
+#endif /* MAILSORT_H */
@@ -0,0 +1,990 @@
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <libraries/iffparse.h>
+#include <proto/dos.h>
+#include <proto/exec.h>
+
+#include "extrasrc.h"
+
+#include "YAM.h"
+#include "YAM_folderconfig.h"
+#include "YAM_mainFolder.h"
+#include "YAM_utilities.h"
+
+#include "FileInfo.h"
+#include "HashTable.h"
+#include "MailList.h"
+#include "MailThreads.h"
+
+#include "Debug.h"
+
+#include "amiga-align.h"
+
+/*
+** structure of the .threads file of a folder
+**
+** The header is followed by 'numThreads' records of struct MailThreadRecord.
+** The records are saved in depth first order, hence the parent of a message
+** always precedes the message itself and replies to the same message keep
+** their order.
+**
+** DO NOT CHANGE ALIGNMENT here or the .threads
+** files of a folder will be corrupt !
+**
+*/
+struct MailThreadsHeader
+{
+  ULONG ID;           // version of the threads file (MAILTHREADS_VER)
+  ULONG numThreads;   // number of message records
+};
+
+struct MailThreadRecord
+{
+  char  key[20];      // the date and counter part of the mail file name, empty if not part of the folder
+  ULONG cMsgID;       // the compressed message ID
+  ULONG parent;       // the record number of the parent message, NO_PARENT for the start of a thread
+};
+
+#include "default-align.h"
+
+// whenever you change something up there you need to increase this version ID!
+#define MAILTHREADS_VER (MAKE_ID('Y','T','H','1'))
+
+// the parent record number of a message starting a thread
+#define NO_PARENT 0xffffffffUL
+
+// a thread by compressed message ID or by mail
+struct MailThreadEntry
+{
+  struct HashEntryHeader hash; // standard hash table header
+  IPTR key;                    // the compressed message ID or the address of the mail
+  struct MailThread *thread;   // the thread
+};
+
+// a record of the threads file by the key of its mail
+struct MailThreadKey
+{
+  struct HashEntryHeader hash; // standard hash table header
+  char *key;                   // the key of the mail
+  ULONG record;                // the number of the record
+};
+
+struct MailThreadIndex
+{
+  APTR pool;                   // item pool for all threads
+  struct HashTable *ids;       // the threads by compressed message ID
+  struct HashTable *mails;     // the threads by mail
+  struct MailThread *roots;    // the first message starting a thread
+  ULONG numThreads;            // the number of threads
+  BOOL modified;               // TRUE if the threads need to be saved
+};
+
+/*** Private functions ***/
+/// DeleteIndex
+// free a thread index
+static void DeleteIndex(struct MailThreadIndex *index)
+{
+  ENTER();
+
+  if(index != NULL)
+  {
+    if(index->ids != NULL)
+      HashTableDestroy(index->ids);
+
+    if(index->mails != NULL)
+      HashTableDestroy(index->mails);
+
+    // this frees all threads at once
+    if(index->pool != NULL)
+      FreeSysObject(ASOT_ITEMPOOL, index->pool);
+
+    free(index);
+  }
+
+  LEAVE();
+}
+
+///
+/// CreateIndex
+// create an empty thread index for the given number of mails
+static struct MailThreadIndex *CreateIndex(ULONG numMails)
+{
+  struct MailThreadIndex *index;
+
+  ENTER();
+
+  if((index = calloc(1, sizeof(*index))) != NULL)
+  {
+    index->pool = AllocSysObjectTags(ASOT_ITEMPOOL,
+      ASOITEM_MFlags, MEMF_SHARED,
+      ASOITEM_ItemSize, sizeof(struct MailThread),
+      ASOITEM_BatchSize, 512,
+      ASOITEM_GCPolicy, ITEMGC_AFTERCOUNT,
+      TAG_DONE);
+    index->ids = HashTableNew(HashTableGetDefaultOps(), NULL, sizeof(struct MailThreadEntry), numMails);
+    index->mails = HashTableNew(HashTableGetDefaultOps(), NULL, sizeof(struct MailThreadEntry), numMails);
+
+    if(index->pool == NULL || index->ids == NULL || index->mails == NULL)
+    {
+      DeleteIndex(index);
+      index = NULL;
+    }
+  }
+
+  RETURN(index);
+  return index;
+}
+
+///
+/// UnlinkThread
+// remove a thread from the replies of its parent
+static void UnlinkThread(struct MailThreadIndex *index, struct MailThread *thread)
+{
+  if(thread->prev != NULL)
+    thread->prev->next = thread->next;
+  else if(thread->parent != NULL)
+    thread->parent->child = thread->next;
+  else
+    index->roots = thread->next;
+
+  if(thread->next != NULL)
+    thread->next->prev = thread->prev;
+
+  thread->parent = NULL;
+  thread->prev = NULL;
+  thread->next = NULL;
+}
+
+///
+/// LinkThread
+// make an unlinked thread the last reply to the given parent or, if the parent
+// is NULL, the start of a new thread
+static void LinkThread(struct MailThreadIndex *index, struct MailThread *parent, struct MailThread *thread)
+{
+  thread->parent = parent;
+
+  if(parent != NULL)
+  {
+    struct MailThread *last = parent->child;
+
+    if(last != NULL)
+    {
+      while(last->next != NULL)
+        last = last->next;
+
+      last->next = thread;
+      thread->prev = last;
+    }
+    else
+      parent->child = thread;
+  }
+  else
+  {
+    // the order of the threads doesn't matter
+    if(index->roots != NULL)
+      index->roots->prev = thread;
+
+    thread->next = index->roots;
+    index->roots = thread;
+  }
+}
+
+///
+/// IsAncestor
+// check if a thread is the given thread itself or one of its parents
+static BOOL IsAncestor(const struct MailThread *ancestor, const struct MailThread *thread)
+{
+  while(thread != NULL)
+  {
+    if(thread == ancestor)
+      return TRUE;
+
+    thread = thread->parent;
+  }
+
+  return FALSE;
+}
+
+///
+/// NewThread
+// allocate a new thread for the given message ID which is not linked to anything
+static struct MailThread *NewThread(struct MailThreadIndex *index, unsigned long cMsgID)
+{
+  struct MailThread *thread;
+
+  if((thread = ItemPoolAlloc(index->pool)) != NULL)
+  {
+    memset(thread, 0, sizeof(*thread));
+    thread->cMsgID = cMsgID;
+    index->numThreads++;
+  }
+
+  return thread;
+}
+
+///
+/// RegisterThread
+// make a thread the one to be found by its message ID
+static BOOL RegisterThread(struct MailThreadIndex *index, struct MailThread *thread)
+{
+  struct HashEntryHeader *entry;
+  BOOL success = FALSE;
+
+  if((entry = HashTableOperate(index->ids, (void *)thread->cMsgID, htoAdd)) != NULL)
+  {
+    struct MailThreadEntry *idEntry = (struct MailThreadEntry *)entry;
+
+    idEntry->key = thread->cMsgID;
+    idEntry->thread = thread;
+    success = TRUE;
+  }
+
+  return success;
+}
+
+///
+/// FreeThread
+// free an unlinked thread without replies
+static void FreeThread(struct MailThreadIndex *index, struct MailThread *thread)
+{
+  struct HashEntryHeader *entry;
+
+  // duplicate messages are not found by their message ID
+  if(thread->cMsgID != 0 && (entry = HashTableOperate(index->ids, (void *)thread->cMsgID, htoLookup)) != NULL &&
+     HASH_ENTRY_IS_LIVE(entry) && ((struct MailThreadEntry *)entry)->thread == thread)
+  {
+    HashTableRawRemove(index->ids, entry);
+  }
+
+  ItemPoolFree(index->pool, thread);
+  index->numThreads--;
+}
+
+///
+/// PruneThread
+// free a thread which has neither a mail nor replies, and all its parents
+// which are left in the same state by this
+static void PruneThread(struct MailThreadIndex *index, struct MailThread *thread)
+{
+  while(thread != NULL && thread->mail == NULL && thread->child == NULL)
+  {
+    struct MailThread *parent = thread->parent;
+
+    UnlinkThread(index, thread);
+    FreeThread(index, thread);
+
+    thread = parent;
+  }
+}
+
+///
+/// GetIDThread
+// get the thread of a message ID, create an unlinked one if there is none yet
+static struct MailThread *GetIDThread(struct MailThreadIndex *index, unsigned long cMsgID)
+{
+  struct MailThread *thread = NULL;
+  struct HashEntryHeader *entry;
+
+  if((entry = HashTableOperate(index->ids, (void *)cMsgID, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+  {
+    thread = ((struct MailThreadEntry *)entry)->thread;
+  }
+  else if((thread = NewThread(index, cMsgID)) != NULL)
+  {
+    if(RegisterThread(index, thread) == TRUE)
+      LinkThread(index, NULL, thread);
+    else
+    {
+      FreeThread(index, thread);
+      thread = NULL;
+    }
+  }
+
+  return thread;
+}
+
+///
+/// FindMailThread
+// find the thread of a mail
+static struct MailThread *FindMailThread(struct MailThreadIndex *index, const struct Mail *mail)
+{
+  struct MailThread *thread = NULL;
+  struct HashEntryHeader *entry;
+
+  if((entry = HashTableOperate(index->mails, mail, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+    thread = ((struct MailThreadEntry *)entry)->thread;
+
+  return thread;
+}
+
+///
+/// SetThreadMail
+// attach a mail to a thread
+static BOOL SetThreadMail(struct MailThreadIndex *index, struct MailThread *thread, struct Mail *mail)
+{
+  struct HashEntryHeader *entry;
+  BOOL success = FALSE;
+
+  if((entry = HashTableOperate(index->mails, mail, htoAdd)) != NULL)
+  {
+    struct MailThreadEntry *mailEntry = (struct MailThreadEntry *)entry;
+
+    mailEntry->key = (IPTR)mail;
+    mailEntry->thread = thread;
+    thread->mail = mail;
+    success = TRUE;
+  }
+
+  return success;
+}
+
+///
+/// AddThreadMail
+// add a mail to the threads, the messages it refers to are linked to each
+// other as well if they are not linked yet
+static void AddThreadMail(struct MailThreadIndex *index, struct Mail *mail)
+{
+  struct MailThread *parent = NULL;
+  struct MailThread *thread = NULL;
+
+  ENTER();
+
+  if(FindMailThread(index, mail) == NULL)
+  {
+    if(mail->cRefMsgIDs != NULL)
+    {
+      ULONG i;
+
+      // the references start with the first message of the thread and end
+      // with the direct parent of the mail
+      for(i=0; mail->cRefMsgIDs[i] != 0; i++)
+      {
+        struct MailThread *ref;
+
+        if((ref = GetIDThread(index, mail->cRefMsgIDs[i])) != NULL)
+        {
+          // existing links are kept, but loops must be avoided
+          if(parent != NULL && ref->parent == NULL && IsAncestor(ref, parent) == FALSE)
+          {
+            UnlinkThread(index, ref);
+            LinkThread(index, parent, ref);
+          }
+
+          parent = ref;
+        }
+      }
+    }
+    else if(mail->cIRTMsgID != 0)
+      parent = GetIDThread(index, mail->cIRTMsgID);
+
+    // a message which is already part of the folder gets a thread of its own
+    if(mail->cMsgID != 0 && (thread = GetIDThread(index, mail->cMsgID)) != NULL && thread->mail != NULL)
+    {
+      D(DBF_FOLDER, "mail '%s' is a duplicate of mail '%s'", mail->MailFile, thread->mail->MailFile);
+
+      if((thread = NewThread(index, mail->cMsgID)) != NULL)
+        LinkThread(index, NULL, thread);
+    }
+    else if(thread == NULL && (thread = NewThread(index, 0)) != NULL)
+      LinkThread(index, NULL, thread);
+
+    if(thread != NULL)
+    {
+      if(SetThreadMail(index, thread, mail) == TRUE)
+      {
+        // the mail's own references decide about its parent
+        if(parent != NULL && parent != thread->parent && IsAncestor(thread, parent) == FALSE)
+        {
+          UnlinkThread(index, thread);
+          LinkThread(index, parent, thread);
+        }
+      }
+      else
+      {
+        E(DBF_FOLDER, "couldn't add mail '%s' to threads", mail->MailFile);
+        PruneThread(index, thread);
+      }
+    }
+
+    // the parent might have been created for nothing
+    if(parent != NULL)
+      PruneThread(index, parent);
+
+    index->modified = TRUE;
+  }
+
+  LEAVE();
+}
+
+///
+/// RememberReferences
+// store the compressed message IDs of the parents of a mail's thread in the
+// mail, in case the mail is added to another folder afterwards
+static void RememberReferences(struct Mail *mail, const struct MailThread *thread)
+{
+  unsigned long refs[MAILTHREAD_MAXREFS];
+  ULONG numRefs = 0;
+  const struct MailThread *parent;
+
+  ENTER();
+
+  for(parent = thread->parent; parent != NULL && numRefs < MAILTHREAD_MAXREFS; parent = parent->parent)
+  {
+    if(parent->cMsgID != 0)
+      refs[numRefs++] = parent->cMsgID;
+  }
+
+  if(numRefs > 0 && (mail->cRefMsgIDs = malloc((numRefs + 1) * sizeof(*mail->cRefMsgIDs))) != NULL)
+  {
+    ULONG i;
+
+    // the references start with the first message of the thread
+    for(i=0; i < numRefs; i++)
+      mail->cRefMsgIDs[i] = refs[numRefs-1-i];
+
+    mail->cRefMsgIDs[numRefs] = 0;
+  }
+
+  LEAVE();
+}
+
+///
+/// BuildIndex
+// build the threads of a folder from its mails
+static struct MailThreadIndex *BuildIndex(const struct Folder *folder)
+{
+  struct MailThreadIndex *index;
+
+  ENTER();
+
+  if((index = CreateIndex(folder->messages->count)) != NULL)
+  {
+    struct MailNode *mnode;
+
+    ForEachMailNode(folder->messages, mnode)
+      AddThreadMail(index, mnode->mail);
+
+    index->modified = TRUE;
+
+    D(DBF_FOLDER, "built %ld threads of folder '%s' with %ld mails", index->numThreads, folder->Name, folder->messages->count);
+  }
+
+  RETURN(index);
+  return index;
+}
+
+///
+/// ReadIndex
+// create the threads from the records of a threads file and match them with
+// the mails of the folder, mails without a record are added afterwards
+static BOOL ReadIndex(struct MailThreadIndex *index, const struct Folder *folder, struct MailThreadRecord *records, ULONG numRecords)
+{
+  BOOL valid = FALSE;
+  struct MailThread **threads;
+
+  ENTER();
+
+  if((threads = calloc(numRecords + 1, sizeof(*threads))) != NULL)
+  {
+    struct HashTable *keys;
+
+    if((keys = HashTableNew(HashTableGetDefaultStringOps(), NULL, sizeof(struct MailThreadKey), numRecords)) != NULL)
+    {
+      struct MailNode *mnode;
+      ULONG i;
+
+      valid = TRUE;
+
+      for(i=0; i < numRecords && valid == TRUE; i++)
+      {
+        struct MailThreadRecord *record = &records[i];
+
+        record->key[sizeof(record->key)-1] = '\0';
+
+        // parents must precede their replies
+        if((record->parent != NO_PARENT && record->parent >= i) || (threads[i] = NewThread(index, record->cMsgID)) == NULL)
+          valid = FALSE;
+        else if(record->key[0] != '\0')
+        {
+          struct HashEntryHeader *entry;
+
+          if((entry = HashTableOperate(keys, record->key, htoAdd)) != NULL)
+          {
+            struct MailThreadKey *key = (struct MailThreadKey *)entry;
+
+            // a duplicate key refers to the last record
+            if(key->key == NULL && (key->key = strdup(record->key)) == NULL)
+              valid = FALSE;
+
+            key->record = i;
+          }
+          else
+            valid = FALSE;
+        }
+      }
+
+      if(valid == TRUE)
+      {
+        // link the threads backwards and make each one the first reply of
+        // its parent, this keeps the order of the records
+        for(i=numRecords; i > 0; i--)
+        {
+          struct MailThread *thread = threads[i-1];
+          struct MailThread *parent = (records[i-1].parent != NO_PARENT) ? threads[records[i-1].parent] : NULL;
+
+          thread->parent = parent;
+          thread->next = (parent != NULL) ? parent->child : index->roots;
+
+          if(thread->next != NULL)
+            thread->next->prev = thread;
+
+          if(parent != NULL)
+            parent->child = thread;
+          else
+            index->roots = thread;
+        }
+
+        // now find the mails of all records
+        ForEachMailNode(folder->messages, mnode)
+        {
+          struct Mail *mail = mnode->mail;
+          char key[MAILKEY_LEN+1];
+          struct HashEntryHeader *entry;
+
+          if(GetMailKey(mail, key) == TRUE &&
+             (entry = HashTableOperate(keys, key, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+          {
+            struct MailThread *thread = threads[((struct MailThreadKey *)entry)->record];
+
+            // the mail file might have been replaced by a different mail
+            if(thread->mail == NULL && thread->cMsgID == mail->cMsgID)
+              SetThreadMail(index, thread, mail);
+          }
+        }
+
+        // make the threads findable by their message IDs, duplicates
+        // without mail are dropped below
+        for(i=0; i < numRecords; i++)
+        {
+          struct MailThread *thread = threads[i];
+          struct HashEntryHeader *entry;
+
+          if(thread->cMsgID != 0 && (entry = HashTableOperate(index->ids, (void *)thread->cMsgID, htoAdd)) != NULL)
+          {
+            struct MailThreadEntry *idEntry = (struct MailThreadEntry *)entry;
+
+            if(idEntry->thread == NULL || (idEntry->thread->mail == NULL && thread->mail != NULL))
+            {
+              idEntry->key = thread->cMsgID;
+              idEntry->thread = thread;
+            }
+          }
+        }
+
+        // forget about mails which were removed while the threads were
+        // not loaded, replies are always pruned before their parents
+        for(i=numRecords; i > 0; i--)
+        {
+          struct MailThread *thread = threads[i-1];
+
+          if(thread->mail == NULL && thread->child == NULL)
+          {
+            UnlinkThread(index, thread);
+            FreeThread(index, thread);
+            index->modified = TRUE;
+          }
+        }
+
+        // finally add the mails which were added while the threads were
+        // not loaded
+        ForEachMailNode(folder->messages, mnode)
+        {
+          if(FindMailThread(index, mnode->mail) == NULL)
+            AddThreadMail(index, mnode->mail);
+        }
+      }
+
+      HashTableDestroy(keys);
+    }
+
+    free(threads);
+  }
+
+  RETURN(valid);
+  return valid;
+}
+
+///
+/// LoadIndex
+// load the threads of a folder, they are built from the folder's mails if
+// there is no usable threads file
+static struct MailThreadIndex *LoadIndex(const struct Folder *folder)
+{
+  struct MailThreadIndex *index = NULL;
+  char fileName[SIZE_PATHFILE];
+  LONG fileSize;
+  FILE *fh;
+
+  ENTER();
+
+  AddPath(fileName, folder->Fullpath, ".threads", sizeof(fileName));
+
+  if(ObtainFileInfo(fileName, FI_SIZE, &fileSize) == TRUE && fileSize >= (LONG)sizeof(struct MailThreadsHeader) &&
+     (fh = fopen(fileName, "r")) != NULL)
+  {
+    char *data;
+
+    // read the complete file with a single call
+    if((data = malloc(fileSize)) != NULL)
+    {
+      if(fread(data, fileSize, 1, fh) == 1)
+      {
+        struct MailThreadsHeader *header = (struct MailThreadsHeader *)data;
+
+        if(header->ID == MAILTHREADS_VER &&
+           header->numThreads <= (fileSize - sizeof(*header)) / sizeof(struct MailThreadRecord) &&
+           (index = CreateIndex(MAX(header->numThreads, (ULONG)folder->messages->count))) != NULL)
+        {
+          if(ReadIndex(index, folder, (struct MailThreadRecord *)&data[sizeof(*header)], header->numThreads) == TRUE)
+          {
+            D(DBF_FOLDER, "loaded %ld threads of folder '%s'", index->numThreads, folder->Name);
+          }
+          else
+          {
+            DeleteIndex(index);
+            index = NULL;
+          }
+        }
+      }
+
+      free(data);
+    }
+
+    fclose(fh);
+
+    if(index == NULL)
+      W(DBF_FOLDER, "threads file '%s' is outdated or corrupt, starting over", fileName);
+  }
+
+  if(index == NULL)
+    index = BuildIndex(folder);
+
+  RETURN(index);
+  return index;
+}
+
+///
+/// SaveIndex
+// save the threads of a folder
+static BOOL SaveIndex(const struct Folder *folder, struct MailThreadIndex *index)
+{
+  BOOL success = FALSE;
+  char fileName[SIZE_PATHFILE];
+  FILE *fh;
+
+  ENTER();
+
+  AddPath(fileName, folder->Fullpath, ".threads", sizeof(fileName));
+
+  if((fh = fopen(fileName, "w")) != NULL)
+  {
+    struct MailThreadsHeader header;
+    struct MailThread *thread = index->roots;
+    ULONG number = 0;
+
+    setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
+
+    header.ID = MAILTHREADS_VER;
+    header.numThreads = index->numThreads;
+
+    success = (fwrite(&header, sizeof(header), 1, fh) == 1);
+
+    // walk through all threads in depth first order
+    while(thread != NULL && success == TRUE)
+    {
+      struct MailThreadRecord record;
+
+      memset(&record, 0, sizeof(record));
+
+      if(thread->mail != NULL)
+        GetMailKey(thread->mail, record.key);
+
+      record.cMsgID = thread->cMsgID;
+      record.parent = (thread->parent != NULL) ? thread->parent->number : NO_PARENT;
+      thread->number = number++;
+
+      success = (fwrite(&record, sizeof(record), 1, fh) == 1);
+
+      if(thread->child != NULL)
+        thread = thread->child;
+      else
+      {
+        while(thread != NULL && thread->next == NULL)
+          thread = thread->parent;
+
+        if(thread != NULL)
+          thread = thread->next;
+      }
+    }
+
+    if(number != index->numThreads)
+      success = FALSE;
+
+    if(fclose(fh) != 0)
+      success = FALSE;
+
+    if(success == TRUE)
+    {
+      D(DBF_FOLDER, "saved %ld threads of folder '%s'", number, folder->Name);
+      index->modified = FALSE;
+    }
+    else
+    {
+      E(DBF_FOLDER, "couldn't save threads file '%s'", fileName);
+      DeleteFile(fileName);
+    }
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// GetIndex
+// get the threads of a folder, load them if necessary
+static struct MailThreadIndex *GetIndex(struct Folder *folder)
+{
+  ENTER();
+
+  if(folder->threadIndex == NULL && isGroupFolder(folder) == FALSE && folder->LoadedMode == LM_VALID)
+    folder->threadIndex = LoadIndex(folder);
+
+  RETURN(folder->threadIndex);
+  return folder->threadIndex;
+}
+
+///
+
+/*** Public functions ***/
+/// MailThreadsGetRoots
+// get the first message starting a thread, all others follow via the 'next' pointer
+struct MailThread *MailThreadsGetRoots(struct Folder *folder)
+{
+  struct MailThreadIndex *index;
+  struct MailThread *roots = NULL;
+
+  ENTER();
+
+  if((index = GetIndex(folder)) != NULL)
+    roots = index->roots;
+
+  RETURN(roots);
+  return roots;
+}
+
+///
+/// MailThreadsFind
+// find the thread of a message by its compressed message ID, the message
+// doesn't need to be part of the folder
+struct MailThread *MailThreadsFind(struct Folder *folder, unsigned long cMsgID)
+{
+  struct MailThreadIndex *index;
+  struct MailThread *thread = NULL;
+
+  ENTER();
+
+  if(cMsgID != 0 && (index = GetIndex(folder)) != NULL)
+  {
+    struct HashEntryHeader *entry;
+
+    if((entry = HashTableOperate(index->ids, (void *)cMsgID, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+      thread = ((struct MailThreadEntry *)entry)->thread;
+  }
+
+  RETURN(thread);
+  return thread;
+}
+
+///
+/// MailThreadsGetParentMail
+// get the nearest mail the message of a thread replies to
+struct Mail *MailThreadsGetParentMail(const struct MailThread *thread)
+{
+  struct Mail *mail = NULL;
+
+  ENTER();
+
+  for(thread = thread->parent; thread != NULL; thread = thread->parent)
+  {
+    if(thread->mail != NULL)
+    {
+      mail = thread->mail;
+      break;
+    }
+  }
+
+  RETURN(mail);
+  return mail;
+}
+
+///
+/// MailThreadsGetFirstReply
+// get the first mail replying to the message of a thread, either directly or
+// via messages which are not part of the folder
+struct Mail *MailThreadsGetFirstReply(const struct MailThread *thread)
+{
+  const struct MailThread *reply = thread->child;
+  struct Mail *mail = NULL;
+
+  ENTER();
+
+  while(reply != NULL)
+  {
+    if(reply->mail != NULL)
+    {
+      mail = reply->mail;
+      break;
+    }
+
+    // descend into messages without mail, they always have replies
+    if(reply->child != NULL)
+      reply = reply->child;
+    else
+    {
+      while(reply != thread && reply->next == NULL)
+        reply = reply->parent;
+
+      reply = (reply != thread) ? reply->next : NULL;
+    }
+  }
+
+  RETURN(mail);
+  return mail;
+}
+
+///
+/// MailThreadsAddMail
+// add a mail which was just added to a folder to the folder's threads
+void MailThreadsAddMail(struct Folder *folder, struct Mail *mail)
+{
+  struct MailThreadIndex *index;
+
+  ENTER();
+
+  // the threads are loaded now, otherwise the mail's references would be lost
+  if((index = GetIndex(folder)) != NULL)
+    AddThreadMail(index, mail);
+
+  LEAVE();
+}
+
+///
+/// MailThreadsRemoveMail
+// remove a mail from the threads of a folder
+void MailThreadsRemoveMail(struct Folder *folder, struct Mail *mail)
+{
+  struct MailThreadIndex *index = folder->threadIndex;
+
+  ENTER();
+
+  // there is nothing to do if the threads are not loaded
+  if(index != NULL)
+  {
+    struct HashEntryHeader *entry;
+
+    if((entry = HashTableOperate(index->mails, mail, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+    {
+      struct MailThread *thread = ((struct MailThreadEntry *)entry)->thread;
+
+      HashTableRawRemove(index->mails, entry);
+
+      if(mail->cRefMsgIDs == NULL)
+        RememberReferences(mail, thread);
+
+      // the message stays as long as it connects any replies
+      thread->mail = NULL;
+      PruneThread(index, thread);
+
+      index->modified = TRUE;
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// MailThreadsRebuild
+// build the threads of a folder from scratch, i.e. after a rescan
+void MailThreadsRebuild(struct Folder *folder)
+{
+  ENTER();
+
+  MailThreadsFree(folder);
+
+  if(isGroupFolder(folder) == FALSE)
+    folder->threadIndex = BuildIndex(folder);
+
+  LEAVE();
+}
+
+///
+/// MailThreadsFlush
+// save the threads of a folder if they were modified
+void MailThreadsFlush(struct Folder *folder)
+{
+  ENTER();
+
+  LockMailList(folder->messages);
+
+  if(folder->threadIndex != NULL && folder->threadIndex->modified == TRUE)
+    SaveIndex(folder, folder->threadIndex);
+
+  UnlockMailList(folder->messages);
+
+  LEAVE();
+}
+
+///
+/// MailThreadsFree
+// free the threads of a folder without saving them
+void MailThreadsFree(struct Folder *folder)
+{
+  ENTER();
+
+  if(folder->threadIndex != NULL)
+  {
+    DeleteIndex(folder->threadIndex);
+    folder->threadIndex = NULL;
+  }
+
+  LEAVE();
+}
+
+///
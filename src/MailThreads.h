@@ -0,0 +1,74 @@
+#ifndef MAILTHREADS_H
+#define MAILTHREADS_H 1
+
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+
+#include <exec/types.h>
+
+// forward declarations
+struct Folder;
+struct Mail;
+
+/*
+ The threads of a folder. Each message known from the folder's mails
+ or from their References: and In-Reply-To: headers is represented by a
+ struct MailThread, which is linked to the message it replies to and to
+ the replies to itself (see http://www.jwz.org/doc/threading.html).
+ Messages which are referenced, but which are not part of the folder
+ still connect their replies but have no mail. The threads are kept in
+ the .threads file of the folder, so the mail files don't need to be
+ read again to rebuild them. All functions require the folder's mail
+ list to be locked exclusively.
+*/
+
+struct MailThread
+{
+  struct MailThread *parent; // the message this one replies to, NULL for the start of a thread
+  struct MailThread *child;  // the first reply to this message
+  struct MailThread *prev;   // the previous reply to the same message
+  struct MailThread *next;   // the next reply to the same message
+  struct Mail *mail;         // the mail, NULL if the message is not part of the folder
+  unsigned long cMsgID;      // the compressed message ID
+  ULONG number;              // the record number while the threads are saved
+};
+
+// the maximum number of compressed IDs taken from the References: header
+#define MAILTHREAD_MAXREFS 32
+
+struct MailThread *MailThreadsGetRoots(struct Folder *folder);
+struct MailThread *MailThreadsFind(struct Folder *folder, unsigned long cMsgID);
+struct Mail *MailThreadsGetParentMail(const struct MailThread *thread);
+struct Mail *MailThreadsGetFirstReply(const struct MailThread *thread);
+void MailThreadsAddMail(struct Folder *folder, struct Mail *mail);
+void MailThreadsRemoveMail(struct Folder *folder, struct Mail *mail);
+void MailThreadsRebuild(struct Folder *folder);
+void MailThreadsFlush(struct Folder *folder);
+void MailThreadsFree(struct Folder *folder);
+
+#endif /* MAILTHREADS_H */
@@ -64,6 +64,194 @@ struct PushedMethod
 
 #define PMF_SYNC       (1<<0)
 
+// asynchronous method calls are queued in a preallocated ring buffer to
+// avoid any allocation, calls which don't fit into it are pushed as
+// separate messages like synchronous calls. As long as such a message is
+// pending all further calls are pushed as messages as well, because the
+// queue is always handled before the messages.
+#define METHODQUEUE_SLOTS    256
+#define METHODQUEUE_MAXARGS  8
+
+struct QueuedMethod
+{
+  Object *object;                    // pointer to the object for receiving the method call
+  ULONG argCount;                    // number of arguments to follow
+  enum MethodCoalesce coalesce;      // how this call may be merged with a later one
+  IPTR args[METHODQUEUE_MAXARGS];    // the method ID and its parameters
+};
+
+struct MethodQueue
+{
+  struct SignalSemaphore *lock;      // protects everything below
+  ULONG first;                       // the slot of the next method to be dispatched
+  ULONG count;                       // the number of pending methods
+  ULONG pushed;                      // the number of pending asynchronous methods pushed as message
+  ULONG enqueued;                    // statistics: methods put into the queue
+  ULONG coalesced;                   // statistics: methods merged with a pending one
+  ULONG dispatched;                  // statistics: methods handled
+  ULONG overflowed;                  // statistics: methods pushed as message instead
+  struct QueuedMethod slot[METHODQUEUE_SLOTS];
+};
+
+static struct MethodQueue *methodQueue;
+
+/// CoalesceMethod
+// try to merge a method call with the latest pending call for the same
+// object, the queue must be locked by the caller. Only the latest call is
+// checked, thus calls for an object are never reordered.
+static BOOL CoalesceMethod(Object *obj, enum MethodCoalesce coalesce, ULONG argCount, const IPTR *args)
+{
+  ULONG i;
+
+  for(i=methodQueue->count; i > 0; i--)
+  {
+    struct QueuedMethod *qm = &methodQueue->slot[(methodQueue->first + i - 1) % METHODQUEUE_SLOTS];
+
+    if(qm->object == obj)
+    {
+      if(qm->coalesce != coalesce || qm->argCount != argCount || qm->args[0] != args[0])
+        return FALSE;
+
+      switch(coalesce)
+      {
+        case MSC_REPLACE:
+        {
+          // the first parameter identifies the call, i.e. the attribute of MUIM_Set
+          if(argCount > 1 && qm->args[1] != args[1])
+            return FALSE;
+
+          memcpy(qm->args, args, argCount*sizeof(IPTR));
+        }
+        break;
+
+        case MSC_ACCUMULATE:
+        {
+          // the first parameter is a positive increment, all others must be equal
+          if(argCount < 2 || (LONG)qm->args[1] <= 0 || (LONG)args[1] <= 0 ||
+             memcmp(&qm->args[2], &args[2], (argCount-2)*sizeof(IPTR)) != 0)
+          {
+            return FALSE;
+          }
+
+          qm->args[1] += args[1];
+        }
+        break;
+
+        default:
+          return FALSE;
+      }
+
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+///
+/// QueueMethod
+// put an asynchronous method call into the queue, returns FALSE if the
+// call must be pushed as message instead. In this case the caller must
+// either push the message or call ForgetPushedMethod().
+static BOOL QueueMethod(Object *obj, enum MethodCoalesce coalesce, ULONG argCount, const IPTR *args)
+{
+  BOOL queued = FALSE;
+  BOOL wasEmpty = FALSE;
+
+  ObtainSemaphore(methodQueue->lock);
+
+  if(methodQueue->pushed > 0 || argCount > METHODQUEUE_MAXARGS)
+  {
+    // earlier calls are waiting as messages, this call must neither be
+    // queued nor merged or it would overtake them
+    methodQueue->pushed++;
+    methodQueue->overflowed++;
+  }
+  else if(coalesce != MSC_NONE && CoalesceMethod(obj, coalesce, argCount, args) == TRUE)
+  {
+    methodQueue->coalesced++;
+    queued = TRUE;
+  }
+  else if(methodQueue->count < METHODQUEUE_SLOTS)
+  {
+    struct QueuedMethod *qm = &methodQueue->slot[(methodQueue->first + methodQueue->count) % METHODQUEUE_SLOTS];
+
+    qm->object = obj;
+    qm->argCount = argCount;
+    qm->coalesce = coalesce;
+    memcpy(qm->args, args, argCount*sizeof(IPTR));
+
+    wasEmpty = (methodQueue->count == 0);
+    methodQueue->count++;
+    methodQueue->enqueued++;
+    queued = TRUE;
+  }
+  else
+  {
+    methodQueue->pushed++;
+    methodQueue->overflowed++;
+  }
+
+  ReleaseSemaphore(methodQueue->lock);
+
+  // wake up the main thread if it doesn't know about pending methods yet
+  if(wasEmpty == TRUE)
+    Signal(G->methodStack->mp_SigTask, 1UL << G->methodStack->mp_SigBit);
+
+  return queued;
+}
+
+///
+/// ForgetPushedMethod
+// an asynchronous method call which was not queued has been taken from the
+// port or could not be pushed at all
+static void ForgetPushedMethod(void)
+{
+  ObtainSemaphore(methodQueue->lock);
+  methodQueue->pushed--;
+  ReleaseSemaphore(methodQueue->lock);
+}
+
+///
+/// DispatchQueuedMethods
+// handle all methods of the queue, the methods are copied before they are
+// handled to allow them to push further methods
+static void DispatchQueuedMethods(void)
+{
+  do
+  {
+    struct QueuedMethod qm;
+    BOOL found = FALSE;
+
+    ObtainSemaphore(methodQueue->lock);
+
+    if(methodQueue->count > 0)
+    {
+      struct QueuedMethod *first = &methodQueue->slot[methodQueue->first];
+
+      qm.object = first->object;
+      qm.argCount = first->argCount;
+      memcpy(qm.args, first->args, first->argCount*sizeof(IPTR));
+
+      methodQueue->first = (methodQueue->first + 1) % METHODQUEUE_SLOTS;
+      methodQueue->count--;
+      methodQueue->dispatched++;
+      found = TRUE;
+    }
+
+    ReleaseSemaphore(methodQueue->lock);
+
+    if(found == FALSE)
+      break;
+
+    // perform the desired action
+    DoMethodA(qm.object, (Msg)qm.args);
+  }
+  while(TRUE);
+}
+
+///
+
 /// InitMethodStack
 // initialize the global method stack
 BOOL InitMethodStack(void)
@@ -74,7 +262,11 @@ BOOL InitMethodStack(void)
 
   if((G->methodStack = AllocSysObjectTags(ASOT_PORT, TAG_DONE)) != NULL)
   {
-    success = TRUE;
+    if((methodQueue = calloc(1, sizeof(*methodQueue))) != NULL)
+    {
+      if((methodQueue->lock = AllocSysObjectTags(ASOT_SEMAPHORE, TAG_DONE)) != NULL)
+        success = TRUE;
+    }
   }
 
   RETURN(success);
@@ -106,6 +298,19 @@ void CleanupMethodStack(void)
     G->methodStack = NULL;
   }
 
+  if(methodQueue != NULL)
+  {
+    // the queued methods are dropped without handling them
+    D(DBF_STARTUP, "method queue: %ld enqueued, %ld coalesced, %ld dispatched, %ld overflowed, %ld dropped",
+      methodQueue->enqueued, methodQueue->coalesced, methodQueue->dispatched, methodQueue->overflowed, methodQueue->count);
+
+    if(methodQueue->lock != NULL)
+      FreeSysObject(ASOT_SEMAPHORE, methodQueue->lock);
+
+    free(methodQueue);
+    methodQueue = NULL;
+  }
+
   LEAVE();
 }
 
@@ -113,15 +318,33 @@ void CleanupMethodStack(void)
 /// PushMethodOnStack
 // push a method with all given parameters on the method stack
 BOOL PushMethodOnStackA(Object *obj, ULONG argCount, struct TagItem *tags)
+{
+  return PushCoalescedMethodOnStackA(obj, MSC_NONE, argCount, tags);
+}
+
+///
+/// PushCoalescedMethodOnStack
+// push a method with all given parameters on the method stack. If the latest
+// pending method for the same object is the same method it will be merged
+// with the new call as specified by coalesce instead of calling it twice.
+BOOL PushCoalescedMethodOnStackA(Object *obj, enum MethodCoalesce coalesce, ULONG argCount, struct TagItem *tags)
 {
   struct PushedMethod *pm;
   BOOL success = FALSE;
 
   ENTER();
 
-  if((pm = AllocSysObjectTags(ASOT_MESSAGE,
+  if(QueueMethod(obj, coalesce, argCount, (IPTR *)tags) == TRUE)
+  {
+    success = TRUE;
+  }
+  else if((pm = AllocSysObjectTags(ASOT_MESSAGE,
     ASOMSG_Size, sizeof(*pm),
-    TAG_DONE)) != NULL)
+    TAG_DONE)) == NULL)
+  {
+    ForgetPushedMethod();
+  }
+  else
   {
     // fill in the data
     pm->object = obj;
@@ -209,6 +432,11 @@ void CheckMethodStack(void)
 
   ENTER();
 
+  // handle the queued methods first, these were pushed before any
+  // synchronous method of the same thread and before any asynchronous
+  // method which had to be pushed as message
+  DispatchQueuedMethods();
+
   // try to pop a method from the stack
   while((msg = GetMsg(G->methodStack)) != NULL)
   {
@@ -228,6 +456,10 @@ void CheckMethodStack(void)
     }
     else
     {
+      // further asynchronous methods may be queued again as soon as
+      // no more of them are waiting in the port
+      ForgetPushedMethod();
+
       // perform the desired action
       DoMethodA(pm->object, (Msg)pm->args);
 
@@ -235,6 +467,9 @@ void CheckMethodStack(void)
       free(pm->args);
       FreeSysObject(ASOT_MESSAGE, pm);
     }
+
+    // handle the methods which have been queued in the meantime
+    DispatchQueuedMethods();
   }
 
   LEAVE();
@@ -34,10 +34,21 @@
   #include <intuition/classusr.h> // Object
 #endif
 
+// how an asynchronous method call may be merged with the latest pending
+// call of the same method for the same object
+enum MethodCoalesce
+{
+  MSC_NONE = 0,    // never merge, every call is handled
+  MSC_REPLACE,     // the new parameters replace the pending ones if the first parameter is equal
+  MSC_ACCUMULATE   // the first parameter is a positive increment which is added to the pending one
+};
+
 BOOL InitMethodStack(void);
 void CleanupMethodStack(void);
 BOOL PushMethodOnStackA(Object *obj, ULONG argCount, struct TagItem *tags);
 #define PushMethodOnStack(obj, argCount, ...) ({ ULONG _tags[] = { SDI_VACAST(__VA_ARGS__) }; PushMethodOnStackA(obj, argCount, (struct TagItem *)_tags); })
+BOOL PushCoalescedMethodOnStackA(Object *obj, enum MethodCoalesce coalesce, ULONG argCount, struct TagItem *tags);
+#define PushCoalescedMethodOnStack(obj, coalesce, argCount, ...) ({ ULONG _tags[] = { SDI_VACAST(__VA_ARGS__) }; PushCoalescedMethodOnStackA(obj, coalesce, argCount, (struct TagItem *)_tags); })
 IPTR PushMethodOnStackWaitA(Object *obj, ULONG argCount, struct TagItem *tags);
 #define PushMethodOnStackWait(obj, argCount, ...) ({ ULONG _tags[] = { SDI_VACAST(__VA_ARGS__) }; PushMethodOnStackWaitA(obj, argCount, (struct TagItem *)_tags); })
 void CheckMethodStack(void);
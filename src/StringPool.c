@@ -0,0 +1,289 @@
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <proto/exec.h>
+
+#include "YAM.h"
+
+#include "HashTable.h"
+#include "StringPool.h"
+
+#include "Debug.h"
+
+struct StringPoolToken
+{
+  struct HashEntryHeader hash; // a standard hash entry header
+  char *string;                // the pooled string, part of a struct PooledString
+};
+
+// a pooled string together with the number of its users
+struct PooledString
+{
+  ULONG refCount;              // number of references to this string
+  char string[1];              // the string itself, allocated with its actual length
+};
+
+#define STRING2POOLED(str)     ((struct PooledString *)((str) - offsetof(struct PooledString, string)))
+
+// the one and only empty string
+static const char emptyString[] = "";
+
+/// ClearPoolToken
+// HashTable callback function to clear a pooled string
+static void ClearPoolToken(struct HashTable *table, struct HashEntryHeader *entry)
+{
+  struct StringPoolToken *token = (struct StringPoolToken *)entry;
+
+  if(token->string != NULL)
+    free(STRING2POOLED(token->string));
+
+  memset(entry, 0, table->entrySize);
+}
+
+///
+/// DestroyPoolToken
+// HashTable callback function to free a pooled string
+static void DestroyPoolToken(UNUSED struct HashTable *table, const struct HashEntryHeader *entry)
+{
+  const struct StringPoolToken *token = (const struct StringPoolToken *)entry;
+
+  if(token->string != NULL)
+    free(STRING2POOLED(token->string));
+}
+
+///
+/// stringPoolOps
+// the pooled strings are allocated together with their reference counter
+static const struct HashTableOps stringPoolOps =
+{
+  DefaultHashAllocTable,
+  DefaultHashFreeTable,
+  DefaultHashGetKey,
+  StringHashHashKey,
+  StringHashMatchEntry,
+  DefaultHashMoveEntry,
+  ClearPoolToken,
+  DefaultHashFinalize,
+  NULL,
+  DestroyPoolToken
+};
+
+///
+
+/// StringPoolSetup
+// set up the global string pool
+BOOL StringPoolSetup(void)
+{
+  BOOL result = FALSE;
+
+  ENTER();
+
+  if((G->stringPoolSemaphore = AllocSysObjectTags(ASOT_SEMAPHORE, TAG_DONE)) != NULL)
+  {
+    if((G->stringPoolHashTable = HashTableNew(&stringPoolOps, NULL, sizeof(struct StringPoolToken), 4096)) != NULL)
+      result = TRUE;
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// StringPoolCleanup
+// free the global string pool including all pooled strings
+void StringPoolCleanup(void)
+{
+  ENTER();
+
+  if(G->stringPoolHashTable != NULL)
+  {
+    // all mails have been freed already, hence the pool should be empty
+    D(DBF_UTIL, "string pool contains %ld strings", G->stringPoolHashTable->entryCount);
+
+    HashTableDestroy(G->stringPoolHashTable);
+    G->stringPoolHashTable = NULL;
+  }
+
+  if(G->stringPoolSemaphore != NULL)
+  {
+    FreeSysObject(ASOT_SEMAPHORE, G->stringPoolSemaphore);
+    G->stringPoolSemaphore = NULL;
+  }
+
+  LEAVE();
+}
+
+///
+/// InternString
+// return the pooled copy of a string, the string is added to the pool if
+// it is not yet known. Each call adds a reference to the string which must
+// be given up by ReleaseString() again. In case there is not enough memory
+// for a new string an empty string is returned. This function is thread safe.
+const char *InternString(const char *str)
+{
+  const char *result = emptyString;
+
+  ENTER();
+
+  if(str != NULL && str[0] != '\0')
+  {
+    struct StringPoolToken *token;
+
+    ObtainSemaphore(G->stringPoolSemaphore);
+
+    if((token = (struct StringPoolToken *)HashTableOperate(G->stringPoolHashTable, str, htoAdd)) != NULL)
+    {
+      if(token->string != NULL)
+      {
+        STRING2POOLED(token->string)->refCount++;
+        result = token->string;
+      }
+      else
+      {
+        // a new token has no string yet
+        size_t len = strlen(str);
+        struct PooledString *ps;
+
+        if((ps = malloc(sizeof(*ps) + len)) != NULL)
+        {
+          ps->refCount = 1;
+          memcpy(ps->string, str, len+1);
+          token->string = ps->string;
+          result = token->string;
+        }
+        else
+        {
+          E(DBF_UTIL, "couldn't add string '%s' to pool", str);
+          HashTableRawRemove(G->stringPoolHashTable, &token->hash);
+        }
+      }
+    }
+    else
+      E(DBF_UTIL, "couldn't add string '%s' to pool", str);
+
+    ReleaseSemaphore(G->stringPoolSemaphore);
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// InternStringSize
+// like InternString(), but the pooled string is truncated to at most size-1
+// characters just like strlcpy() would do
+const char *InternStringSize(const char *str, size_t size)
+{
+  const char *result;
+
+  ENTER();
+
+  if(str != NULL && size > 0 && strlen(str) >= size)
+  {
+    char *truncated;
+
+    if((truncated = malloc(size)) != NULL)
+    {
+      strlcpy(truncated, str, size);
+      result = InternString(truncated);
+      free(truncated);
+    }
+    else
+      result = InternString(NULL);
+  }
+  else
+    result = InternString(str);
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// ReferenceString
+// add another reference to a string returned by InternString(), this
+// function is thread safe
+const char *ReferenceString(const char *str)
+{
+  ENTER();
+
+  // the empty string is never pooled
+  if(str != NULL && str[0] != '\0')
+  {
+    ObtainSemaphore(G->stringPoolSemaphore);
+    STRING2POOLED(str)->refCount++;
+    ReleaseSemaphore(G->stringPoolSemaphore);
+  }
+
+  RETURN(str);
+  return str;
+}
+
+///
+/// ReleaseString
+// give up a reference to a string returned by InternString() or
+// ReferenceString(), the string is removed from the pool as soon as
+// nobody uses it anymore. This function is thread safe.
+void ReleaseString(const char *str)
+{
+  ENTER();
+
+  // the empty string is never pooled
+  if(str != NULL && str[0] != '\0')
+  {
+    ObtainSemaphore(G->stringPoolSemaphore);
+
+    if(--STRING2POOLED(str)->refCount == 0)
+      HashTableOperate(G->stringPoolHashTable, str, htoRemove);
+
+    ReleaseSemaphore(G->stringPoolSemaphore);
+  }
+
+  LEAVE();
+}
+
+///
+/// SetPooledString
+// replace a pooled string by the pooled copy of another string, which is
+// truncated to at most size-1 characters
+void SetPooledString(const char **ptr, const char *str, size_t size)
+{
+  const char *old = *ptr;
+
+  ENTER();
+
+  // intern the new string first, it might be the same as the old one
+  *ptr = InternStringSize(str, size);
+  ReleaseString(old);
+
+  LEAVE();
+}
+
+///
@@ -0,0 +1,47 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+/***************************************************************************
+
+ YAM - Yet Another Mailer
+ Copyright (C) 1995-2000 Marcel Beck
+ Copyright (C) 2000-2018 YAM Open Source Team
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ YAM Official Support Site :  http://www.yam.ch
+ YAM OpenSource project    :  http://sourceforge.net/projects/yamos/
+
+ $Id$
+
+***************************************************************************/
+
+#include <exec/types.h>
+
+// Strings which are shared by a huge number of mails, like addresses, real names
+// or account names, are kept only once in a global pool. Each user of a pooled
+// string holds a reference to it and the string is freed as soon as the last
+// reference is released. Empty strings are never added to the pool, but all
+// map to one shared static empty string.
+
+BOOL StringPoolSetup(void);
+void StringPoolCleanup(void);
+const char *InternString(const char *str);
+const char *InternStringSize(const char *str, size_t size);
+const char *ReferenceString(const char *str);
+void ReleaseString(const char *str);
+void SetPooledString(const char **ptr, const char *str, size_t size);
+
+#endif /* STRINGPOOL_H */
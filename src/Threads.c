@@ -55,12 +55,14 @@
 #endif
 
 #include "YAM.h"
+#include "YAM_mainFolder.h"
 #include "YAM_utilities.h"
 
 #include "SDI_stdarg.h"
 
 #include "extrasrc.h"
 
+#include "BayesFilter.h"
 #include "Locale.h"
 #include "MailExport.h"
 #include "MailImport.h"
@@ -122,6 +124,21 @@ struct ThreadMessage
 // deadlock situation.
 static struct ThreadMessage startupMessage;
 
+// the shared state of a job whose items are handled by several threads
+struct ParallelJob
+{
+  struct SignalSemaphore *lock;  // protects the counters below
+  struct Task *waiter;           // the task waiting for the job to be finished
+  ULONG waitMask;                // the signal to wake up the waiting task
+  void (* function)(APTR userData, ULONG index);
+  APTR userData;
+  ULONG count;                   // the number of items
+  ULONG next;                    // the next item to be handled
+  ULONG done;                    // the number of finished items
+  ULONG activeThreads;           // the number of threads still working
+  BOOL aborted;                  // no further items are handed out
+};
+
 /// FreeThreadTags
 // free a previously cloned tag list, respecting duplicated strings
 static void FreeThreadTags(struct TagItem *tags)
@@ -204,6 +221,66 @@ static struct TagItem *CloneThreadTags(const struct TagItem *tags)
   return clone;
 }
 
+///
+/// RunNextParallelItem
+// handle the next pending item of a parallel job, returns FALSE if there
+// is nothing left to do
+static BOOL RunNextParallelItem(struct ParallelJob *job)
+{
+  BOOL pending = FALSE;
+  ULONG i = 0;
+
+  ENTER();
+
+  ObtainSemaphore(job->lock);
+  if(job->aborted == FALSE && job->next < job->count)
+  {
+    i = job->next++;
+    pending = TRUE;
+  }
+  ReleaseSemaphore(job->lock);
+
+  if(pending == TRUE)
+  {
+    // each item is handled by exactly one thread
+    job->function(job->userData, i);
+
+    ObtainSemaphore(job->lock);
+    job->done++;
+    // let the waiting task update its progress
+    Signal(job->waiter, job->waitMask);
+    ReleaseSemaphore(job->lock);
+  }
+
+  RETURN(pending);
+  return pending;
+}
+
+///
+/// ParallelThread
+// thread entry point to handle the pending items of a parallel job
+static LONG ParallelThread(struct ParallelJob *job)
+{
+  LONG handled = 0;
+
+  ENTER();
+
+  while(ThreadWasAborted() == FALSE && RunNextParallelItem(job) == TRUE)
+    handled++;
+
+  D(DBF_THREAD, "thread '%s' handled %ld items", ThreadName(), handled);
+
+  // tell the waiting task that we are done, the job must not be
+  // touched anymore as soon as the semaphore is released
+  ObtainSemaphore(job->lock);
+  job->activeThreads--;
+  Signal(job->waiter, job->waitMask);
+  ReleaseSemaphore(job->lock);
+
+  RETURN(handled);
+  return handled;
+}
+
 ///
 /// DoThreadMessage
 // perform the requested action
@@ -279,6 +356,18 @@ static LONG DoThreadMessage(struct ThreadMessage *msg)
                            GetTagData(TT_DownloadURL_Flags, 0, msg->actionTags));
     }
     break;
+
+    case TA_Parallel:
+    {
+      result = ParallelThread((struct ParallelJob *)GetTagData(TT_Parallel_Job, (IPTR)NULL, msg->actionTags));
+    }
+    break;
+
+    case TA_PreloadIndexes:
+    {
+      result = MA_PreloadIndexes((struct IndexPreloader *)GetTagData(TT_PreloadIndexes_Data, (IPTR)NULL, msg->actionTags));
+    }
+    break;
   }
 
   D(DBF_THREAD, "thread '%s' finished action %ld, result %ld", msg->thread->name, msg->action, result);
@@ -1244,3 +1333,116 @@ void StopThreadTimer(void)
 }
 
 ///
+/// RunParallel
+// call a function for 'count' items. If called by the main thread the items
+// are handed out to up to 'maxThreads' threads, each of which should get at
+// least 'minItemsPerThread' items, while the main thread takes part in the
+// work as well. The optional progress function is called by the main thread
+// whenever items have been finished, if it returns FALSE no further items are
+// handed out. Returns FALSE if the job was aborted this way.
+BOOL RunParallel(ULONG count, ULONG maxThreads, ULONG minItemsPerThread, void (* function)(APTR userData, ULONG index), BOOL (* progress)(APTR userData, ULONG done, ULONG count), APTR userData)
+{
+  BOOL result = TRUE;
+  struct ParallelJob job;
+  LONG waitSignal = -1;
+
+  ENTER();
+
+  memset(&job, 0, sizeof(job));
+  job.function = function;
+  job.userData = userData;
+  job.count = count;
+
+  // only the main thread is able to start further threads
+  if(IsMainThread() == TRUE && maxThreads > 0 && count > minItemsPerThread &&
+     (waitSignal = AllocSignal(-1)) != -1 &&
+     (job.lock = AllocSysObjectTags(ASOT_SEMAPHORE, TAG_DONE)) != NULL)
+  {
+    ULONG i;
+
+    job.waiter = FindTask(NULL);
+    job.waitMask = (1UL << waitSignal);
+
+    // start the threads, but don't bother for a handful of items only
+    for(i=0; i < maxThreads && count > (i+1) * minItemsPerThread; i++)
+    {
+      ObtainSemaphore(job.lock);
+      job.activeThreads++;
+      ReleaseSemaphore(job.lock);
+
+      if(DoAction(NULL, TA_Parallel, TT_Parallel_Job, &job,
+                                     TAG_DONE) == NULL)
+      {
+        W(DBF_THREAD, "could start only %ld threads for a parallel job", i);
+
+        ObtainSemaphore(job.lock);
+        job.activeThreads--;
+        ReleaseSemaphore(job.lock);
+
+        break;
+      }
+    }
+
+    while(TRUE)
+    {
+      BOOL pending;
+      ULONG done;
+      ULONG activeThreads;
+
+      // handle an item ourself, this guarantees progress even if
+      // no thread could be started at all
+      pending = RunNextParallelItem(&job);
+
+      ObtainSemaphore(job.lock);
+      done = job.done;
+      activeThreads = job.activeThreads;
+      ReleaseSemaphore(job.lock);
+
+      if(result == TRUE && progress != NULL && progress(userData, done, count) == FALSE)
+      {
+        // let the threads stop as soon as possible
+        ObtainSemaphore(job.lock);
+        job.aborted = TRUE;
+        ReleaseSemaphore(job.lock);
+
+        result = FALSE;
+      }
+
+      if(pending == FALSE)
+      {
+        if(activeThreads == 0)
+          break;
+
+        // wait for the threads to finish their last items
+        Wait(job.waitMask);
+      }
+    }
+
+    // a thread may have signalled us after we checked for the last time
+    SetSignal(0, job.waitMask);
+  }
+  else
+  {
+    ULONG i;
+
+    // no threads, handle the items one by one
+    for(i=0; i < count && result == TRUE; i++)
+    {
+      function(userData, i);
+
+      if(progress != NULL && progress(userData, i+1, count) == FALSE)
+        result = FALSE;
+    }
+  }
+
+  if(job.lock != NULL)
+    FreeSysObject(ASOT_SEMAPHORE, job.lock);
+
+  if(waitSignal != -1)
+    FreeSignal(waitSignal);
+
+  RETURN(result);
+  return result;
+}
+
+///
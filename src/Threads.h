@@ -44,6 +44,8 @@ enum ThreadAction
   TA_ImportMails,
   TA_ExportMails,
   TA_DownloadURL,
+  TA_Parallel,
+  TA_PreloadIndexes,
 };
 
 #define TT_Priority                                0xf001 // priority of the thread
@@ -74,6 +76,10 @@ enum ThreadAction
 #define TT_DownloadURL_Filename      (TAG_STRING | (TAG_USER + 3))
 #define TT_DownloadURL_Flags                       (TAG_USER + 4)
 
+#define TT_Parallel_Job                            (TAG_USER + 1)
+
+#define TT_PreloadIndexes_Data                     (TAG_USER + 1)
+
 /*** Thread system init/cleanup functions ***/
 BOOL InitThreads(void);
 void CleanupThreads(void);
@@ -97,6 +103,7 @@ BOOL InitThreadTimer(void);
 void CleanupThreadTimer(void);
 void StartThreadTimer(ULONG seconds, ULONG micros);
 void StopThreadTimer(void);
+BOOL RunParallel(ULONG count, ULONG maxThreads, ULONG minItemsPerThread, void (* function)(APTR userData, ULONG index), BOOL (* progress)(APTR userData, ULONG done, ULONG count), APTR userData);
 
 #endif /* THREADS_H */
 
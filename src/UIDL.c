@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <libraries/iffparse.h>
 #include <proto/dos.h>
 #if defined(__amigaos4__)
 #include <dos/obsolete.h>
@@ -45,6 +46,98 @@
 
 #include "Debug.h"
 
+/*
+** structure of the binary UIDL database
+**
+** The file starts with this header, whose values are stored in big endian
+** byte order, followed by a Bloom filter of 'bloomBits' bits. Then follow
+** the offsets of the 'sortedRecords' sorted UIDLs relative to the first of
+** them as big endian 32 bit values and finally the sorted UIDLs themselves
+** as NUL terminated strings. UIDLs which are seen for the first time are
+** appended unsorted to the end of the file. The file is compacted, i.e.
+** rewritten completely in sorted order, when many UIDLs belong to mails
+** which no longer exist on the server or have been appended.
+**
+** The offsets and the sorted UIDLs are read in one go as soon as the Bloom
+** filter reports the first possible hit, afterwards they are searched in
+** memory by a binary search. The appended UIDLs are added to the hash
+** table right away.
+*/
+struct UIDLFileHeader
+{
+  ULONG ID;            // version of the database (should be UIDL_FILE_VER)
+  ULONG bloomBits;     // size of the Bloom filter in bits, a power of two
+  ULONG records;       // number of sorted and appended UIDLs
+  ULONG sortedRecords; // number of sorted UIDLs
+  ULONG sortedSize;    // size of the sorted UIDLs in bytes
+};
+
+// the size of the header within the file
+#define UIDL_HEADER_SIZE         (5 * sizeof(ULONG))
+
+// whenever you change something up there (in UIDLFileHeader) you
+// need to increase this version ID!
+#define UIDL_FILE_VER (MAKE_ID('Y','U','D','2'))
+
+// the file offsets of the offset table and of the sorted UIDLs
+#define UIDL_TABLE_OFFSET(h)     (UIDL_HEADER_SIZE + (h)->bloomBits / 8)
+#define UIDL_STRINGS_OFFSET(h)   (UIDL_TABLE_OFFSET(h) + (h)->sortedRecords * sizeof(ULONG))
+
+// the Bloom filter uses 10 bits per UIDL and 7 hash functions, which
+// results in a false positive rate of about 1%
+#define UIDL_BLOOM_BITS_PER_UIDL 10
+#define UIDL_BLOOM_HASHES        7
+#define UIDL_BLOOM_MIN_BITS      8192
+
+// the database is compacted as soon as at least every 8th UIDL belongs
+// to a mail which no longer exists on the server or is not sorted
+#define UIDL_COMPACT_RATIO       8
+
+// the UIDL string points into a buffer of the database file and
+// must not be freed
+#define UIDLF_FILE    (1<<7)
+
+/// ClearUIDLtoken
+// HashTable callback function to clear an UIDLtoken
+static void ClearUIDLtoken(struct HashTable *table, struct HashEntryHeader *entry)
+{
+  struct UIDLtoken *token = (struct UIDLtoken *)entry;
+
+  if(isFlagClear(token->flags, UIDLF_FILE))
+    free((char *)token->uidl);
+
+  memset(entry, 0, table->entrySize);
+}
+
+///
+/// DestroyUIDLtoken
+// HashTable callback function to free an UIDLtoken
+static void DestroyUIDLtoken(UNUSED struct HashTable *table, const struct HashEntryHeader *entry)
+{
+  const struct UIDLtoken *token = (const struct UIDLtoken *)entry;
+
+  if(isFlagClear(token->flags, UIDLF_FILE))
+    free((char *)token->uidl);
+}
+
+///
+/// uidlHashOps
+// the UIDLs are strings, but not all of them are allocated separately
+static const struct HashTableOps uidlHashOps =
+{
+  DefaultHashAllocTable,
+  DefaultHashFreeTable,
+  DefaultHashGetKey,
+  StringHashHashKey,
+  StringHashMatchEntry,
+  DefaultHashMoveEntry,
+  ClearUIDLtoken,
+  DefaultHashFinalize,
+  NULL,
+  DestroyUIDLtoken
+};
+
+///
 /// BuildUIDLFilename
 // set up a name for a UIDL file to be accessed
 static void BuildUIDLFilename(const struct MailServerNode *msn, char *uidlPath, const size_t uidlPathSize)
@@ -72,19 +165,801 @@ static void BuildUIDLFilename(const struct MailServerNode *msn, char *uidlPath,
   LEAVE();
 }
 
+///
+/// ReadUIDLheader
+// read the header of a binary UIDL database
+static BOOL ReadUIDLheader(FILE *fh, struct UIDLFileHeader *header)
+{
+  BOOL result = FALSE;
+
+  if(ReadUInt32(fh, &header->ID) == 1 &&
+     ReadUInt32(fh, &header->bloomBits) == 1 &&
+     ReadUInt32(fh, &header->records) == 1 &&
+     ReadUInt32(fh, &header->sortedRecords) == 1 &&
+     ReadUInt32(fh, &header->sortedSize) == 1)
+  {
+    result = TRUE;
+  }
+
+  return result;
+}
+
+///
+/// WriteUIDLheader
+// write the header of a binary UIDL database
+static BOOL WriteUIDLheader(FILE *fh, const struct UIDLFileHeader *header)
+{
+  BOOL result = FALSE;
+
+  if(WriteUInt32(fh, header->ID) == 1 &&
+     WriteUInt32(fh, header->bloomBits) == 1 &&
+     WriteUInt32(fh, header->records) == 1 &&
+     WriteUInt32(fh, header->sortedRecords) == 1 &&
+     WriteUInt32(fh, header->sortedSize) == 1)
+  {
+    result = TRUE;
+  }
+
+  return result;
+}
+
+///
+/// GetBloomBits
+// calculate the size of a Bloom filter for a number of UIDLs, there is
+// room for another 50% of UIDLs before the database must be compacted
+static ULONG GetBloomBits(const ULONG records)
+{
+  ULONG bits = UIDL_BLOOM_MIN_BITS;
+
+  while(bits < (records + records/2) * UIDL_BLOOM_BITS_PER_UIDL && bits < (1UL << 31))
+    bits <<= 1;
+
+  return bits;
+}
+
+///
+/// GetBloomHashes
+// calculate the two base hashes of a UIDL, all hash functions of the Bloom
+// filter are derived from these (double hashing)
+static void GetBloomHashes(const char *uidl, ULONG *h1, ULONG *h2)
+{
+  const unsigned char *s = (const unsigned char *)uidl;
+  ULONG fnv = 2166136261UL;
+  ULONG djb = 5381;
+
+  while(*s != '\0')
+  {
+    fnv = (fnv ^ *s) * 16777619UL;
+    djb = ((djb << 5) + djb) ^ *s;
+    s++;
+  }
+
+  *h1 = fnv;
+  // an odd step visits all bits of a filter whose size is a power of two
+  *h2 = djb | 1;
+}
+
+///
+/// AddToBloomFilter
+// set the bits of a UIDL in a Bloom filter, the numbers of the modified
+// bytes are returned in byteNums if this is not NULL
+static void AddToBloomFilter(UBYTE *bloom, const ULONG bloomBits, const char *uidl, ULONG *byteNums)
+{
+  ULONG h1;
+  ULONG h2;
+  int i;
+
+  GetBloomHashes(uidl, &h1, &h2);
+
+  for(i=0; i < UIDL_BLOOM_HASHES; i++)
+  {
+    ULONG bit = (h1 + i * h2) & (bloomBits - 1);
+
+    bloom[bit / 8] |= (1 << (bit % 8));
+
+    if(byteNums != NULL)
+      byteNums[i] = bit / 8;
+  }
+}
+
+///
+/// IsInBloomFilter
+// check whether a UIDL might be part of a Bloom filter, FALSE means it
+// definitely is not
+static BOOL IsInBloomFilter(const UBYTE *bloom, const ULONG bloomBits, const char *uidl)
+{
+  ULONG h1;
+  ULONG h2;
+  int i;
+
+  GetBloomHashes(uidl, &h1, &h2);
+
+  for(i=0; i < UIDL_BLOOM_HASHES; i++)
+  {
+    ULONG bit = (h1 + i * h2) & (bloomBits - 1);
+
+    if(isFlagClear(bloom[bit / 8], 1 << (bit % 8)))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+///
+/// InsertUIDL
+// add a UIDL to the hash table or update the flags of an existing entry
+static struct UIDLtoken *InsertUIDL(struct UIDLhash *uidlHash, const char *uidl, const ULONG flags)
+{
+  struct UIDLtoken *token = NULL;
+  struct HashEntryHeader *entry;
+
+  if((entry = HashTableOperate(uidlHash->hash, uidl, htoAdd)) != NULL)
+  {
+    token = (struct UIDLtoken *)entry;
+
+    if(token->uidl != NULL)
+    {
+      // the UIDL is known already
+      token->flags |= (flags & ~UIDLF_FILE);
+    }
+    else
+    {
+      token->flags = flags;
+
+      // UIDLs of the database file are not copied
+      if(isFlagSet(flags, UIDLF_FILE))
+        token->uidl = uidl;
+      else if((token->uidl = strdup(uidl)) == NULL)
+      {
+        HashTableRawRemove(uidlHash->hash, entry);
+        token = NULL;
+      }
+    }
+  }
+
+  return token;
+}
+
+///
+/// CloseUIDLfile
+// close the database file, no further UIDLs are searched in it afterwards
+static void CloseUIDLfile(struct UIDLhash *uidlHash)
+{
+  ENTER();
+
+  if(uidlHash->fileHandle != NULL)
+  {
+    fclose(uidlHash->fileHandle);
+    uidlHash->fileHandle = NULL;
+  }
+
+  LEAVE();
+}
+
+///
+/// ReadSortedUIDLs
+// read the offsets and the sorted UIDLs of the database file with a single
+// read operation, the file is not needed anymore afterwards
+static BOOL ReadSortedUIDLs(struct UIDLhash *uidlHash)
+{
+  BOOL result;
+
+  ENTER();
+
+  if(uidlHash->sortedTable == NULL && uidlHash->fileHandle != NULL)
+  {
+    size_t tableSize = uidlHash->sortedRecords * sizeof(ULONG);
+
+    if((uidlHash->sortedTable = malloc(tableSize + uidlHash->sortedSize + 1)) != NULL &&
+       fseek(uidlHash->fileHandle, UIDL_TABLE_OFFSET(uidlHash), SEEK_SET) == 0 &&
+       fread(uidlHash->sortedTable, tableSize + uidlHash->sortedSize, 1, uidlHash->fileHandle) == 1)
+    {
+      ULONG i;
+
+      uidlHash->sortedBuffer = (char *)uidlHash->sortedTable + tableSize;
+
+      // terminate a possibly incomplete last UIDL
+      uidlHash->sortedBuffer[uidlHash->sortedSize] = '\0';
+
+      // the offsets are stored in big endian byte order
+      for(i=0; i < uidlHash->sortedRecords; i++)
+      {
+        const UBYTE *b = (const UBYTE *)&uidlHash->sortedTable[i];
+
+        uidlHash->sortedTable[i] = ((ULONG)b[0] << 24) | ((ULONG)b[1] << 16) | ((ULONG)b[2] << 8) | (ULONG)b[3];
+      }
+
+      D(DBF_UIDL, "read %ld sorted UIDLs of database file", uidlHash->sortedRecords);
+    }
+    else
+    {
+      E(DBF_UIDL, "couldn't read sorted UIDLs of database file");
+
+      free(uidlHash->sortedTable);
+      uidlHash->sortedTable = NULL;
+    }
+
+    CloseUIDLfile(uidlHash);
+  }
+
+  result = (uidlHash->sortedTable != NULL);
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// FindSortedUIDL
+// search a UIDL among the sorted UIDLs of the database file, returns the
+// UIDL within the buffer of the sorted UIDLs or NULL if it is not known
+static const char *FindSortedUIDL(const struct UIDLhash *uidlHash, const char *uidl)
+{
+  const char *found = NULL;
+  ULONG lo = 0;
+  ULONG hi = uidlHash->sortedRecords;
+
+  ENTER();
+
+  while(lo < hi)
+  {
+    ULONG mid = lo + (hi - lo) / 2;
+    ULONG offset = uidlHash->sortedTable[mid];
+    int cmp;
+
+    if(offset >= uidlHash->sortedSize)
+    {
+      W(DBF_UIDL, "invalid offset of sorted UIDL %ld of database file", mid);
+      break;
+    }
+
+    if((cmp = strcmp(uidl, &uidlHash->sortedBuffer[offset])) == 0)
+    {
+      found = &uidlHash->sortedBuffer[offset];
+      break;
+    }
+    else if(cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  RETURN(found);
+  return found;
+}
+
+///
+/// LoadUIDLfile
+// add the sorted UIDLs of the database file to the hash table, this is
+// required only if the file is rewritten and all known UIDLs must be kept
+static BOOL LoadUIDLfile(struct UIDLhash *uidlHash)
+{
+  ENTER();
+
+  if(uidlHash->fileLoaded == FALSE && ReadSortedUIDLs(uidlHash) == TRUE)
+  {
+    char *uidl = uidlHash->sortedBuffer;
+    char *end = &uidlHash->sortedBuffer[uidlHash->sortedSize];
+
+    while(uidl < end)
+    {
+      size_t len = strlen(uidl);
+
+      if(len > 0)
+        InsertUIDL(uidlHash, uidl, UIDLF_OLD|UIDLF_FILE);
+
+      uidl += len+1;
+    }
+
+    D(DBF_UIDL, "loaded %ld sorted UIDLs of database file", uidlHash->sortedRecords);
+
+    uidlHash->fileLoaded = TRUE;
+  }
+
+  RETURN(uidlHash->fileLoaded);
+  return uidlHash->fileLoaded;
+}
+
+///
+/// LookupUIDL
+// find a UIDL in the hash table. The sorted UIDLs of the database file are
+// searched only if the Bloom filter reports a possible hit, a UIDL found
+// there is added to the hash table.
+static struct UIDLtoken *LookupUIDL(struct UIDLhash *uidlHash, const char *uidl)
+{
+  struct UIDLtoken *token = NULL;
+  struct HashEntryHeader *entry;
+
+  if((entry = HashTableOperate(uidlHash->hash, uidl, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+  {
+    token = (struct UIDLtoken *)entry;
+  }
+  else if(uidlHash->fileLoaded == FALSE &&
+          IsInBloomFilter(uidlHash->bloom, uidlHash->bloomBits, uidl) == TRUE &&
+          ReadSortedUIDLs(uidlHash) == TRUE)
+  {
+    const char *fileUIDL;
+
+    // the token refers to the UIDL within the buffer of the sorted UIDLs
+    if((fileUIDL = FindSortedUIDL(uidlHash, uidl)) != NULL)
+      token = InsertUIDL(uidlHash, fileUIDL, UIDLF_OLD|UIDLF_FILE);
+  }
+
+  return token;
+}
+
+///
+/// ReadUIDLtextFile
+// read an old style text UIDL file, every line contains a single UIDL
+static void ReadUIDLtextFile(struct UIDLhash *uidlHash, FILE *fh, const char *uidlPath, const BOOL oldUIDLFile)
+{
+  char *uidl = NULL;
+  size_t uidlLen = 0;
+  BOOL validFile = FALSE;
+
+  ENTER();
+
+  if(oldUIDLFile == TRUE)
+  {
+    // old UIDL files are considered to be always valid
+    validFile = TRUE;
+  }
+  else
+  {
+    // new UIDL files must contain the usual header
+    if(GetLine(&uidl, &uidlLen, fh) >= 0 && strncmp(uidl, "UIDL", 4) == 0)
+      validFile = TRUE;
+  }
+
+  if(validFile == TRUE)
+  {
+    // add all read UIDLs to the hash marking them as OLD
+    while(GetLine(&uidl, &uidlLen, fh) >= 0)
+    {
+      if(InsertUIDL(uidlHash, uidl, UIDLF_OLD) != NULL)
+        uidlHash->fileRecords++;
+    }
+
+    // convert the file to the binary format
+    uidlHash->rewrite = TRUE;
+  }
+  else
+    W(DBF_UIDL, "file '%s' is no valid UIDL database file", uidlPath);
+
+  free(uidl);
+
+  LEAVE();
+}
+
+///
+/// ReadUIDLfile
+// read the header and the Bloom filter of a binary UIDL database. The sorted
+// UIDLs are read from the file only if required, the appended UIDLs are
+// kept in a buffer and are added to the hash table right away.
+static BOOL ReadUIDLfile(struct UIDLhash *uidlHash, FILE *fh, const char *uidlPath, const LONG size)
+{
+  struct UIDLFileHeader header;
+  BOOL result = FALSE;
+
+  ENTER();
+
+  if(ReadUIDLheader(fh, &header) == TRUE && header.ID == UIDL_FILE_VER)
+  {
+    ULONG bloomSize = header.bloomBits / 8;
+
+    // the Bloom filter size must be a power of two and all parts
+    // of the database must fit into the file
+    if(header.bloomBits >= UIDL_BLOOM_MIN_BITS && (header.bloomBits & (header.bloomBits-1)) == 0 &&
+       (ULONG)size >= UIDL_TABLE_OFFSET(&header) &&
+       header.sortedRecords <= ((ULONG)size - UIDL_TABLE_OFFSET(&header)) / sizeof(ULONG) &&
+       header.sortedSize <= (ULONG)size - UIDL_STRINGS_OFFSET(&header))
+    {
+      ULONG sortedEnd = UIDL_STRINGS_OFFSET(&header) + header.sortedSize;
+      ULONG tailSize = size - sortedEnd;
+
+      if((uidlHash->bloom = malloc(bloomSize)) != NULL &&
+         (uidlHash->fileBuffer = malloc(tailSize + 1)) != NULL)
+      {
+        if(fread(uidlHash->bloom, bloomSize, 1, fh) == 1 &&
+           fseek(fh, sortedEnd, SEEK_SET) == 0 &&
+           (tailSize == 0 || fread(uidlHash->fileBuffer, tailSize, 1, fh) == 1))
+        {
+          char *uidl = uidlHash->fileBuffer;
+          char *end = &uidlHash->fileBuffer[tailSize];
+          ULONG records = 0;
+
+          // terminate a possibly incomplete last UIDL
+          uidlHash->fileBuffer[tailSize] = '\0';
+
+          // the appended UIDLs are not sorted and are added to the hash table
+          while(uidl < end)
+          {
+            size_t len = strlen(uidl);
+
+            if(len > 0)
+            {
+              InsertUIDL(uidlHash, uidl, UIDLF_OLD|UIDLF_FILE);
+              records++;
+            }
+
+            uidl += len+1;
+          }
+
+          uidlHash->bloomBits = header.bloomBits;
+          uidlHash->sortedRecords = header.sortedRecords;
+          uidlHash->sortedSize = header.sortedSize;
+          uidlHash->fileRecords = header.sortedRecords + records;
+
+          D(DBF_UIDL, "read UIDL database '%s' with %ld sorted and %ld appended UIDLs", uidlPath, header.sortedRecords, records);
+
+          result = TRUE;
+        }
+      }
+
+      if(result == FALSE)
+      {
+        free(uidlHash->bloom);
+        uidlHash->bloom = NULL;
+        free(uidlHash->fileBuffer);
+        uidlHash->fileBuffer = NULL;
+      }
+    }
+  }
+
+  if(result == FALSE)
+    W(DBF_UIDL, "file '%s' is no valid UIDL database file", uidlPath);
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// CountUIDLtoken
+// HashTable callback function to count the UIDLs to be kept
+static enum HashTableOperator CountUIDLtoken(UNUSED struct HashTable *table,
+                                             struct HashEntryHeader *entry,
+                                             UNUSED ULONG number,
+                                             void *arg)
+{
+  struct UIDLtoken *token = (struct UIDLtoken *)entry;
+  ULONG *counts = (ULONG *)arg;
+
+  // counts[0]: UIDLs not part of the database file yet
+  // counts[1]: UIDLs of the database file which still exist on the server
+  if(isFlagSet(token->flags, UIDLF_NEW))
+  {
+    if(isFlagSet(token->flags, UIDLF_OLD))
+      counts[1]++;
+    else
+      counts[0]++;
+  }
+
+  return htoNext;
+}
+
+///
+/// WriteUIDLcontext
+// the data required to write the UIDLs to the database file
+struct WriteUIDLcontext
+{
+  FILE *fh;
+  UBYTE *bloom;
+  ULONG bloomBits;
+  const char **uidls; // collect the UIDLs to be sorted instead of writing them
+  ULONG maxRecords;   // the number of UIDLs which can be collected
+  ULONG records;
+  BOOL keepOld;       // keep the UIDLs which were not seen on the server
+  BOOL newOnly;       // write the UIDLs which are not part of the database file only
+  BOOL error;
+};
+
+///
+/// WriteUIDLtoken
+// HashTable callback function to save an UIDLtoken
+static enum HashTableOperator WriteUIDLtoken(UNUSED struct HashTable *table,
+                                             struct HashEntryHeader *entry,
+                                             UNUSED ULONG number,
+                                             void *arg)
+{
+  struct UIDLtoken *token = (struct UIDLtoken *)entry;
+  struct WriteUIDLcontext *ctx = (struct WriteUIDLcontext *)arg;
+  BOOL write;
+
+  // Check whether the UIDL is a new one (received from the server), then we keep it.
+  // Otherwise (OLD set, but not NEW) we skip it, because the mail belonging to this
+  // UIDL does no longer exist on the server and we can forget about it. Without a
+  // complete list of the server's UIDLs all known UIDLs are kept.
+  if(ctx->newOnly == TRUE)
+    write = (isFlagSet(token->flags, UIDLF_NEW) && isFlagClear(token->flags, UIDLF_OLD));
+  else
+    write = (isFlagSet(token->flags, UIDLF_NEW) || ctx->keepOld == TRUE);
+
+  if(write == TRUE)
+  {
+    if(ctx->uidls != NULL)
+    {
+      if(ctx->records >= ctx->maxRecords)
+      {
+        ctx->error = TRUE;
+        return htoStop;
+      }
+
+      ctx->uidls[ctx->records++] = token->uidl;
+    }
+    else if(fwrite(token->uidl, strlen(token->uidl)+1, 1, ctx->fh) == 1)
+    {
+      ctx->records++;
+      D(DBF_UIDL, "saved UIDL '%s' to .uidl file", token->uidl);
+    }
+    else
+    {
+      ctx->error = TRUE;
+      return htoStop;
+    }
+  }
+  else if(ctx->newOnly == FALSE)
+    D(DBF_UIDL, "outdated UIDL '%s' found and deleted", token->uidl);
+
+  return htoNext;
+}
+
+///
+/// CompareUIDLs
+// qsort() callback to sort the UIDLs of the database file
+static int CompareUIDLs(const void *p1, const void *p2)
+{
+  const char *uidl1 = *(const char * const *)p1;
+  const char *uidl2 = *(const char * const *)p2;
+
+  return strcmp(uidl1, uidl2);
+}
+
+///
+/// CompactUIDLfile
+// rewrite the complete database file with all UIDLs in sorted order
+static void CompactUIDLfile(struct UIDLhash *uidlHash, const char *uidlPath, const ULONG records)
+{
+  struct WriteUIDLcontext ctx;
+
+  ENTER();
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.keepOld = (uidlHash->serverListComplete == FALSE);
+  ctx.bloomBits = GetBloomBits(records);
+  ctx.maxRecords = uidlHash->hash->entryCount;
+
+  if((ctx.bloom = calloc(1, ctx.bloomBits / 8)) != NULL &&
+     (ctx.uidls = malloc((ctx.maxRecords + 1) * sizeof(*ctx.uidls))) != NULL)
+  {
+    HashTableEnumerate(uidlHash->hash, WriteUIDLtoken, &ctx);
+
+    if(ctx.error == FALSE)
+    {
+      struct UIDLFileHeader header;
+      ULONG i;
+
+      qsort(ctx.uidls, ctx.records, sizeof(*ctx.uidls), CompareUIDLs);
+
+      header.ID = UIDL_FILE_VER;
+      header.bloomBits = ctx.bloomBits;
+      header.records = ctx.records;
+      header.sortedRecords = ctx.records;
+      header.sortedSize = 0;
+
+      for(i=0; i < ctx.records; i++)
+      {
+        AddToBloomFilter(ctx.bloom, ctx.bloomBits, ctx.uidls[i], NULL);
+        header.sortedSize += strlen(ctx.uidls[i]) + 1;
+      }
+
+      if((ctx.fh = fopen(uidlPath, "w")) != NULL)
+      {
+        setvbuf(ctx.fh, NULL, _IOFBF, SIZE_FILEBUF);
+
+        if(WriteUIDLheader(ctx.fh, &header) == FALSE ||
+           fwrite(ctx.bloom, ctx.bloomBits / 8, 1, ctx.fh) != 1)
+        {
+          ctx.error = TRUE;
+        }
+        else
+        {
+          ULONG offset = 0;
+
+          // the offsets of the sorted UIDLs for the binary search
+          for(i=0; i < ctx.records && ctx.error == FALSE; i++)
+          {
+            if(WriteUInt32(ctx.fh, offset) != 1)
+              ctx.error = TRUE;
+
+            offset += strlen(ctx.uidls[i]) + 1;
+          }
+
+          for(i=0; i < ctx.records && ctx.error == FALSE; i++)
+          {
+            if(fwrite(ctx.uidls[i], strlen(ctx.uidls[i])+1, 1, ctx.fh) != 1)
+              ctx.error = TRUE;
+          }
+        }
+
+        if(fclose(ctx.fh) != 0)
+          ctx.error = TRUE;
+
+        if(ctx.error == TRUE)
+          E(DBF_UIDL, "couldn't write UIDL database '%s'", uidlPath);
+        else
+          D(DBF_UIDL, "compacted UIDL database '%s' to %ld UIDLs", uidlPath, ctx.records);
+      }
+      else
+        E(DBF_UIDL, "couldn't open '%s' for writing", uidlPath);
+    }
+    else
+      E(DBF_UIDL, "couldn't collect the UIDLs to be saved");
+  }
+
+  free(ctx.uidls);
+  free(ctx.bloom);
+
+  LEAVE();
+}
+
+///
+/// AppendUIDLtoken
+// HashTable callback function to append a new UIDL to the database file
+static enum HashTableOperator AppendUIDLtoken(UNUSED struct HashTable *table,
+                                              struct HashEntryHeader *entry,
+                                              UNUSED ULONG number,
+                                              void *arg)
+{
+  struct UIDLtoken *token = (struct UIDLtoken *)entry;
+  struct WriteUIDLcontext *ctx = (struct WriteUIDLcontext *)arg;
+
+  if(isFlagSet(token->flags, UIDLF_NEW) && isFlagClear(token->flags, UIDLF_OLD))
+  {
+    ULONG byteNums[UIDL_BLOOM_HASHES];
+    int i;
+
+    AddToBloomFilter(ctx->bloom, ctx->bloomBits, token->uidl, byteNums);
+
+    // write the modified bytes of the Bloom filter only
+    for(i=0; i < UIDL_BLOOM_HASHES; i++)
+    {
+      if(fseek(ctx->fh, UIDL_HEADER_SIZE + byteNums[i], SEEK_SET) != 0 ||
+         fputc(ctx->bloom[byteNums[i]], ctx->fh) == EOF)
+      {
+        ctx->error = TRUE;
+        return htoStop;
+      }
+    }
+  }
+
+  return htoNext;
+}
+
+///
+/// AppendUIDLfile
+// append the new UIDLs unsorted to the database file. The Bloom filter is
+// updated first and the number of UIDLs in the header last, an interrupted
+// append thus never causes a known UIDL to be reported as unknown.
+static void AppendUIDLfile(struct UIDLhash *uidlHash, const char *uidlPath, const ULONG newRecords)
+{
+  struct WriteUIDLcontext ctx;
+
+  ENTER();
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.bloom = uidlHash->bloom;
+  ctx.bloomBits = uidlHash->bloomBits;
+  ctx.newOnly = TRUE;
+
+  if((ctx.fh = fopen(uidlPath, "r+")) != NULL)
+  {
+    HashTableEnumerate(uidlHash->hash, AppendUIDLtoken, &ctx);
+
+    if(ctx.error == FALSE && fseek(ctx.fh, 0, SEEK_END) == 0)
+    {
+      struct UIDLFileHeader header;
+
+      HashTableEnumerate(uidlHash->hash, WriteUIDLtoken, &ctx);
+
+      header.ID = UIDL_FILE_VER;
+      header.bloomBits = ctx.bloomBits;
+      header.records = uidlHash->fileRecords + newRecords;
+      header.sortedRecords = uidlHash->sortedRecords;
+      header.sortedSize = uidlHash->sortedSize;
+
+      if(ctx.error == TRUE || fseek(ctx.fh, 0, SEEK_SET) != 0 || WriteUIDLheader(ctx.fh, &header) == FALSE)
+        ctx.error = TRUE;
+    }
+    else
+      ctx.error = TRUE;
+
+    if(fclose(ctx.fh) != 0)
+      ctx.error = TRUE;
+
+    if(ctx.error == TRUE)
+      E(DBF_UIDL, "couldn't append to UIDL database '%s'", uidlPath);
+    else
+      D(DBF_UIDL, "appended %ld UIDLs to UIDL database '%s'", ctx.records, uidlPath);
+  }
+  else
+    E(DBF_UIDL, "couldn't open '%s' for appending", uidlPath);
+
+  LEAVE();
+}
+
+///
+/// SaveUIDLfile
+// save the changes of the UIDL database. New UIDLs are appended to the file,
+// the file is rewritten in sorted order only if many UIDLs belong to mails
+// which no longer exist on the server, if many UIDLs are not sorted or if
+// the Bloom filter is too full.
+static void SaveUIDLfile(struct UIDLhash *uidlHash)
+{
+  char uidlPath[SIZE_PATHFILE];
+  ULONG counts[2] = { 0, 0 };
+  ULONG newRecords;
+  ULONG seenRecords;
+  ULONG staleRecords = 0;
+  BOOL compact;
+
+  ENTER();
+
+  HashTableEnumerate(uidlHash->hash, CountUIDLtoken, counts);
+  newRecords = counts[0];
+  seenRecords = counts[1];
+
+  // UIDLs of the database file which were not looked up are not
+  // part of the hash table and hence were not seen on the server
+  if(uidlHash->serverListComplete == TRUE && uidlHash->fileRecords > seenRecords)
+    staleRecords = uidlHash->fileRecords - seenRecords;
+
+  D(DBF_UIDL, "UIDL database: %ld UIDLs, %ld new, %ld outdated", uidlHash->fileRecords, newRecords, staleRecords);
+
+  compact = (uidlHash->rewrite == TRUE || uidlHash->bloom == NULL ||
+             (staleRecords > 0 && staleRecords * UIDL_COMPACT_RATIO >= uidlHash->fileRecords) ||
+             (uidlHash->fileRecords - uidlHash->sortedRecords + newRecords) * UIDL_COMPACT_RATIO >= uidlHash->fileRecords + newRecords ||
+             (uidlHash->fileRecords + newRecords) * UIDL_BLOOM_BITS_PER_UIDL > uidlHash->bloomBits);
+
+  // don't rewrite the file without need
+  if(compact == TRUE && uidlHash->isDirty == FALSE && uidlHash->rewrite == FALSE && staleRecords == 0)
+    compact = FALSE;
+
+  // without the complete list of the server's UIDLs we don't know which
+  // UIDLs are outdated, hence all of them must be kept
+  if(compact == TRUE && uidlHash->serverListComplete == FALSE && LoadUIDLfile(uidlHash) == FALSE)
+    compact = FALSE;
+
+  // the file must not be open anymore while it is being written
+  CloseUIDLfile(uidlHash);
+
+  // we are saving account specific .uidl files only, the old one will be kept
+  // in case it still contains UIDLs of multiple accounts
+  BuildUIDLFilename(uidlHash->mailServer, uidlPath, sizeof(uidlPath));
+
+  if(compact == TRUE)
+  {
+    ULONG records = (uidlHash->serverListComplete == TRUE) ? newRecords + seenRecords : uidlHash->hash->entryCount;
+
+    CompactUIDLfile(uidlHash, uidlPath, records);
+  }
+  else if(newRecords > 0 && uidlHash->bloom != NULL)
+    AppendUIDLfile(uidlHash, uidlPath, newRecords);
+
+  LEAVE();
+}
+
 ///
 /// InitUIDLhash
-// Initialize the UIDL list and load it from the .uidl file
+// Initialize the UIDL list and read the .uidl file
 struct UIDLhash *InitUIDLhash(const struct MailServerNode *msn)
 {
   struct UIDLhash *uidlHash;
 
   ENTER();
 
-  if((uidlHash = malloc(sizeof(*uidlHash))) != NULL)
+  if((uidlHash = calloc(1, sizeof(*uidlHash))) != NULL)
   {
     // allocate a new hashtable for managing the UIDL data
-    if((uidlHash->hash = HashTableNew(HashTableGetDefaultStringOps(), NULL, sizeof(struct UIDLtoken), 512)) != NULL)
+    if((uidlHash->hash = HashTableNew(&uidlHashOps, NULL, sizeof(struct UIDLtoken), 512)) != NULL)
     {
       char uidlPath[SIZE_PATHFILE];
       LONG size;
@@ -112,49 +987,51 @@ struct UIDLhash *InitUIDLhash(const struct MailServerNode *msn)
 
       if(fh != NULL)
       {
-        // now read in the UIDL/MsgIDs line-by-line
-        char *uidl = NULL;
-        size_t uidlLen = 0;
-        BOOL validFile = FALSE;
+        ULONG id = 0;
 
         D(DBF_UIDL, "opened UIDL database file '%s'", uidlPath);
 
-        setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
-
+        // the binary database is read in large blocks, a large buffer
+        // is useful for reading the old text files only
         if(oldUIDLFile == TRUE)
+          setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
+
+        // binary databases start with their version ID, text files with "UIDL"
+        if(oldUIDLFile == FALSE && ReadUInt32(fh, &id) == 1 && id == UIDL_FILE_VER)
         {
-          // old UIDL files are considered to be always valid
-          validFile = TRUE;
+          rewind(fh);
+
+          // keep the file open until the sorted UIDLs are needed
+          if(ReadUIDLfile(uidlHash, fh, uidlPath, size) == TRUE && uidlHash->sortedRecords > 0)
+          {
+            uidlHash->fileHandle = fh;
+            fh = NULL;
+          }
+          else
+            uidlHash->fileLoaded = TRUE;
         }
         else
         {
-          // new UIDL files must contain the usual header
-          if(GetLine(&uidl, &uidlLen, fh) >= 0 && strncmp(uidl, "UIDL", 4) == 0)
-            validFile = TRUE;
-        }
-
-        if(validFile == TRUE)
-        {
-          // add all read UIDLs to the hash marking them as OLD
-          while(GetLine(&uidl, &uidlLen, fh) >= 0)
-            AddUIDLtoHash(uidlHash, uidl, UIDLF_OLD);
+          rewind(fh);
+          ReadUIDLtextFile(uidlHash, fh, uidlPath, oldUIDLFile);
+          uidlHash->fileLoaded = TRUE;
         }
-        else
-          W(DBF_UIDL, "file '%s' is no valid UIDL database file", uidlPath);
-
-        fclose(fh);
 
-        free(uidl);
+        if(fh != NULL)
+          fclose(fh);
       }
       else
+      {
         W(DBF_UIDL, "UIDL database file '%s' does not exist", uidlPath);
+        uidlHash->fileLoaded = TRUE;
+      }
 
       // remember the mail server to be able to regenerate the file name upon cleanup
       uidlHash->mailServer = (struct MailServerNode *)msn;
       // we start with an unmodified hash table
       uidlHash->isDirty = FALSE;
 
-      SHOWVALUE(DBF_UIDL, uidlHash->hash->entryCount);
+      SHOWVALUE(DBF_UIDL, uidlHash->fileRecords);
     }
     else
     {
@@ -170,35 +1047,6 @@ struct UIDLhash *InitUIDLhash(const struct MailServerNode *msn)
   return uidlHash;
 }
 
-///
-/// SaveUIDLtoken
-// HashTable callback function to save an UIDLtoken
-static enum HashTableOperator SaveUIDLtoken(UNUSED struct HashTable *table,
-                                            struct HashEntryHeader *entry,
-                                            UNUSED ULONG number,
-                                            void *arg)
-{
-  struct UIDLtoken *token = (struct UIDLtoken *)entry;
-
-  ENTER();
-
-  // Check whether the UIDL is a new one (received from the server), then we keep it.
-  // Otherwise (OLD set, but not NEW) we skip it, because the mail belonging to this
-  // UIDL does no longer exist on the server and we can forget about it.
-  if(isFlagSet(token->flags, UIDLF_NEW))
-  {
-    FILE *fh = (FILE *)arg;
-
-    fprintf(fh, "%s\n", token->uidl);
-    D(DBF_UIDL, "saved UIDL '%s' to .uidl file", token->uidl);
-  }
-  else
-    D(DBF_UIDL, "outdated UIDL '%s' found and deleted", token->uidl);
-
-  RETURN(htoNext);
-  return htoNext;
-}
-
 ///
 /// CleanupUIDLhash
 // Cleanup the whole UIDL hash
@@ -210,32 +1058,10 @@ void CleanupUIDLhash(struct UIDLhash *uidlHash)
   {
     if(uidlHash->hash != NULL)
     {
-      // save the UIDLs only if something has been changed
-      if(uidlHash->isDirty == TRUE)
-      {
-        char uidlPath[SIZE_PATHFILE];
-        FILE *fh;
-
-        // we are saving account specific .uidl files only, the old one will be kept
-        // in case it still contains UIDLs of multiple accounts
-        BuildUIDLFilename(uidlHash->mailServer, uidlPath, sizeof(uidlPath));
-
-        // before we go and destroy the UIDL hash we have to
-        // write it to the .uidl file back again.
-        if((fh = fopen(uidlPath, "w")) != NULL)
-        {
-          setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
-
-          fprintf(fh, "UIDL - YAM UIDL database for %s@%s\n", uidlHash->mailServer->username, uidlHash->mailServer->hostname);
-
-          // call HashTableEnumerate with the SaveUIDLtoken callback function
-          HashTableEnumerate(uidlHash->hash, SaveUIDLtoken, fh);
-
-          fclose(fh);
-        }
-        else
-          E(DBF_UIDL, "couldn't open '%s' for writing", uidlPath);
-      }
+      // save the UIDLs only if something has been changed or if
+      // outdated UIDLs might be dropped
+      if(uidlHash->isDirty == TRUE || uidlHash->rewrite == TRUE || uidlHash->serverListComplete == TRUE)
+        SaveUIDLfile(uidlHash);
 
       // now we can destroy the uidl hash
       HashTableDestroy(uidlHash->hash);
@@ -243,6 +1069,11 @@ void CleanupUIDLhash(struct UIDLhash *uidlHash)
       D(DBF_UIDL, "destroyed UIDL hash table");
     }
 
+    CloseUIDLfile(uidlHash);
+
+    free(uidlHash->sortedTable);
+    free(uidlHash->fileBuffer);
+    free(uidlHash->bloom);
     free(uidlHash);
 
     D(DBF_UIDL, "cleaned up UIDLhash");
@@ -256,27 +1087,15 @@ void CleanupUIDLhash(struct UIDLhash *uidlHash)
 // adds the UIDL of a mail transfer node to the hash
 struct UIDLtoken *AddUIDLtoHash(struct UIDLhash *uidlHash, const char *uidl, const ULONG flags)
 {
-  struct UIDLtoken *token = NULL;
-  struct HashEntryHeader *entry;
+  struct UIDLtoken *token;
 
   ENTER();
 
-  if((entry = HashTableOperate(uidlHash->hash, uidl, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
-  {
-    token = (struct UIDLtoken *)entry;
-
-    token->flags |= flags;
+  // the UIDL might be known from the database file
+  LookupUIDL(uidlHash, uidl);
 
-    D(DBF_UIDL, "updated flags for UIDL '%s' (%08lx)", uidl, token);
-    uidlHash->isDirty = TRUE;
-  }
-  else if((entry = HashTableOperate(uidlHash->hash, uidl, htoAdd)) != NULL)
+  if((token = InsertUIDL(uidlHash, uidl, flags)) != NULL)
   {
-    token = (struct UIDLtoken *)entry;
-
-    token->uidl = strdup(uidl);
-    token->flags = flags;
-
     D(DBF_UIDL, "added UIDL '%s' (%08lx) to hash", uidl, token);
     uidlHash->isDirty = TRUE;
   }
@@ -289,18 +1108,16 @@ struct UIDLtoken *AddUIDLtoHash(struct UIDLhash *uidlHash, const char *uidl, con
 
 ///
 /// FindUIDL
-// try to find a UIDL in the hash
-struct UIDLtoken *FindUIDL(const struct UIDLhash *uidlHash, const char *uidl)
+// try to find a UIDL in the hash. The Bloom filter tells whether a UIDL might
+// be part of the database file at all, thus the file is searched only if the
+// UIDL is possibly known.
+struct UIDLtoken *FindUIDL(struct UIDLhash *uidlHash, const char *uidl)
 {
-  struct UIDLtoken *token = NULL;
-  struct HashEntryHeader *entry;
+  struct UIDLtoken *token;
 
   ENTER();
 
-  if((entry = HashTableOperate(uidlHash->hash, uidl, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
-  {
-    token = (struct UIDLtoken *)entry;
-  }
+  token = LookupUIDL(uidlHash, uidl);
 
   RETURN(token);
   return token;
@@ -28,6 +28,8 @@
 
 ***************************************************************************/
 
+#include <stdio.h>
+
 #include "HashTable.h"
 
 struct MailServerNode;
@@ -36,6 +38,18 @@ struct UIDLhash
 {
   struct HashTable *hash;            // the hash table to hold all data
   struct MailServerNode *mailServer; // the mail server for which the data are to be managed
+  FILE *fileHandle;                  // the database file until its sorted UIDLs are read
+  char *fileBuffer;                  // the appended UIDLs of the database file
+  ULONG *sortedTable;                // the offsets followed by the sorted UIDLs of the database file, if loaded
+  char *sortedBuffer;                // the sorted UIDLs within sortedTable
+  ULONG fileRecords;                 // the number of UIDLs in the database file
+  ULONG sortedRecords;               // the number of sorted UIDLs in the database file
+  ULONG sortedSize;                  // the size of the sorted UIDLs in the database file
+  UBYTE *bloom;                      // Bloom filter of the UIDLs in the database file
+  ULONG bloomBits;                   // the size of the Bloom filter in bits
+  BOOL fileLoaded;                   // are all UIDLs of the database file part of the hash table?
+  BOOL rewrite;                      // must the database file be rewritten completely?
+  BOOL serverListComplete;           // did we get the UIDLs of all mails on the server?
   BOOL isDirty;                      // did anything change during the POP/IMAP session?
 };
 
@@ -51,7 +65,7 @@ struct UIDLtoken
 
 struct UIDLhash *InitUIDLhash(const struct MailServerNode *msn);
 struct UIDLtoken *AddUIDLtoHash(struct UIDLhash *uidlHash, const char *uidl, const ULONG flags);
-struct UIDLtoken *FindUIDL(const struct UIDLhash *uidlHash, const char *uidl);
+struct UIDLtoken *FindUIDL(struct UIDLhash *uidlHash, const char *uidl);
 void CleanupUIDLhash(struct UIDLhash *uidlHash);
 void DeleteUIDLfile(const struct MailServerNode *msn);
 
@@ -103,6 +103,7 @@
 #include "Busy.h"
 #include "Config.h"
 #include "DockyIcon.h"
+#include "FetchScheduler.h"
 #include "FileInfo.h"
 #include "MUIObjects.h"
 #include "FolderList.h"
@@ -114,6 +115,7 @@
 #include "MethodStack.h"
 #include "Requesters.h"
 #include "Rexx.h"
+#include "StringPool.h"
 #include "Threads.h"
 #include "Timer.h"
 #include "TZone.h"
@@ -725,9 +727,15 @@ static void Terminate(void)
   // we are going down from now on
   G->Terminating = TRUE;
 
+  D(DBF_STARTUP, "stopping index preloading...");
+  MA_StopIndexPreload();
+
   D(DBF_STARTUP, "aborting all working threads...");
   AbortWorkingThreads();
 
+  D(DBF_STARTUP, "freeing scheduled mail downloads...");
+  CleanupFetchScheduler();
+
   D(DBF_STARTUP, "cleaning up thread system...");
   CleanupThreads();
 
@@ -975,6 +983,10 @@ static void Terminate(void)
   free(G->virtualMailpart[1]);
 
   // free the item pools
+  #if defined(DEBUG)
+  DumpMailAllocations();
+  #endif
+
   if(G->mailItemPool != NULL)
   {
     FreeSysObject(ASOT_ITEMPOOL, G->mailItemPool);
@@ -987,6 +999,15 @@ static void Terminate(void)
     G->mailNodeItemPool = NULL;
   }
 
+  if(G->extendedMailItemPool != NULL)
+  {
+    FreeSysObject(ASOT_ITEMPOOL, G->extendedMailItemPool);
+    G->extendedMailItemPool = NULL;
+  }
+
+  // free the pooled strings of all mails
+  StringPoolCleanup();
+
   if(G->mailsInTransfer != NULL)
   {
     if(IsMailListEmpty(G->mailsInTransfer) == FALSE)
@@ -1691,19 +1712,11 @@ static void InitAfterLogin(void)
     if(isGroupFolder(folder))
       continue;
 
-    if((C->LoadAllFolders == TRUE || isIncomingFolder(folder) || isOutgoingFolder(folder) || isDraftsFolder(folder) || isTrashFolder(folder)) &&
-       !isProtectedFolder(folder) &&
-       !isArchiveFolder(folder))
-    {
-      // call the getIndex function which on one hand loads the full .index file
-      // and makes sure that all "new" mail is marked to unread if the user
-      // enabled the C->UpdateNewMail option in the configuration.
-      MA_GetIndex(folder);
-    }
-    else if(folder->LoadedMode != LM_VALID)
+    if(folder->LoadedMode != LM_VALID)
     {
       // do not load the full index, do load only the header of the .index
-      // which summarizes everything
+      // which summarizes everything. The full indexes of the commonly used
+      // folders are loaded in the background after all folders are set up.
       folder->LoadedMode = MA_LoadIndex(folder, FALSE);
 
       // if the user wishs to make sure all "new" mail is flagged as
@@ -1735,6 +1748,10 @@ static void InitAfterLogin(void)
   SplashProgress(tr(MSG_RebuildIndices), 60);
   MA_RebuildIndexes();
 
+  // now load the indexes of the incoming, outgoing, drafts and trash folders
+  // in the background
+  MA_StartIndexPreload();
+
   SplashProgress(tr(MSG_LOADINGUPDATESTATE), 70);
   LoadUpdateState();
 
@@ -2501,12 +2518,14 @@ int main(int argc, char **argv)
     if((G->virtualMailpart[1] = calloc(1, sizeof(*G->virtualMailpart[1]))) == NULL)
       break;
 
-    // setup the item pools for mails and mail nodes
+    // setup the item pools for mails and mail nodes, these are protected
+    // because folder indexes are preloaded by a separate thread
     if((G->mailItemPool = AllocSysObjectTags(ASOT_ITEMPOOL,
       ASOITEM_MFlags, MEMF_SHARED|MEMF_CLEAR,
       ASOITEM_ItemSize, sizeof(struct Mail),
       ASOITEM_BatchSize, 1000,
       ASOITEM_GCPolicy, ITEMGC_AFTERCOUNT,
+      ASOITEM_Protected, TRUE,
       TAG_DONE)) == NULL)
     {
       // break out immediately to signal an error!
@@ -2518,6 +2537,21 @@ int main(int argc, char **argv)
       ASOITEM_ItemSize, sizeof(struct MailNode),
       ASOITEM_BatchSize, 1000,
       ASOITEM_GCPolicy, ITEMGC_AFTERCOUNT,
+      ASOITEM_Protected, TRUE,
+      TAG_DONE)) == NULL)
+    {
+      // break out immediately to signal an error!
+      break;
+    }
+
+    // extended mails are examined by several threads in parallel
+    // while scanning folders, hence this pool must be protected
+    if((G->extendedMailItemPool = AllocSysObjectTags(ASOT_ITEMPOOL,
+      ASOITEM_MFlags, MEMF_SHARED|MEMF_CLEAR,
+      ASOITEM_ItemSize, sizeof(struct ExtendedMail),
+      ASOITEM_BatchSize, 64,
+      ASOITEM_GCPolicy, ITEMGC_AFTERCOUNT,
+      ASOITEM_Protected, TRUE,
       TAG_DONE)) == NULL)
     {
       // break out immediately to signal an error!
@@ -2530,6 +2564,13 @@ int main(int argc, char **argv)
       break;
     }
 
+    // setup the pool for the strings shared by all mails
+    if(StringPoolSetup() == FALSE)
+    {
+      // break out immediately to signal an error!
+      break;
+    }
+
     // install the low memory handler
     if((G->lowMemHandler = AllocSysObjectTags(ASOT_INTERRUPT,
       ASOINTR_Code, (ULONG)LowMemHandler,
@@ -2732,6 +2773,7 @@ int main(int argc, char **argv)
           // flush the item pools as well
           ItemPoolGC(G->mailItemPool);
           ItemPoolGC(G->mailNodeItemPool);
+          ItemPoolGC(G->extendedMailItemPool);
           #endif
           G->LowMemSituation = FALSE;
         }
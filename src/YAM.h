@@ -116,16 +116,19 @@ struct Global
   struct codeset *         editorCodeset;        // the codeset YAM will use for external editors
   struct codesetList *     codesetsList;
   struct HashTable *       imageCacheHashTable;
+  struct HashTable *       stringPoolHashTable;  // pooled strings shared by all mails
   struct FolderList *      folders;
   struct MinList *         xpkPackerList;
   struct SignalSemaphore * globalSemaphore;      // a semaphore for certain variables in this structure, i.e. currentFolder
   struct SignalSemaphore * connectionSemaphore;  // a semaphore to lock all connections agains each other
   struct SignalSemaphore * hostResolveSemaphore; // a semaphore to lock all host resolve (gethostbyname) calls
   struct SignalSemaphore * configSemaphore;      // a semaphore to prevent concurrent changes to the configuration
+  struct SignalSemaphore * stringPoolSemaphore;  // a semaphore to protect the string pool
   struct Part *            virtualMailpart[2];   // two virtual mail parts for the attachment requester window
   struct Folder *          currentFolder;        // the currently active folder
   APTR                     mailItemPool;         // item pool for struct Mail
   APTR                     mailNodeItemPool;     // item pool for struct MailNode
+  APTR                     extendedMailItemPool; // item pool for struct ExtendedMail
   struct Screen *          workbenchScreen;
   struct MailList *        mailsInTransfer;      // list of mail currently being sent
   struct Interrupt *       lowMemHandler;        // low memory handler to flush all indexes
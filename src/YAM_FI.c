@@ -62,12 +62,15 @@
 #include "mui/WriteWindow.h"
 #include "mui/YAMApplication.h"
 
+#include "AhoCorasickSearch.h"
 #include "BayesFilter.h"
+#include "BodyIndex.h"
 #include "BoyerMooreSearch.h"
 #include "Busy.h"
 #include "Config.h"
 #include "DynamicString.h"
 #include "FolderList.h"
+#include "HeaderCache.h"
 #include "Locale.h"
 #include "Logfile.h"
 #include "MailList.h"
@@ -101,6 +104,73 @@ static BOOL CopySearchData(struct Search *dstSearch, struct Search *srcSearch);
 // X - Spam
 const char mailStatusCycleMap[11] = { 'U', 'O', 'F', 'R', 'W', 'E', 'H', 'S', 'M', 'X', '\0' };
 
+///
+/// Compiled filter rules
+// the data of a mail the compiled searches are matched against
+enum MatcherSource
+{
+  MSRC_PERSONS=0, // the names or addresses of an address field
+  MSRC_SUBJECT,   // the subject
+  MSRC_HEADERS,   // all header lines or the lines of a certain field
+  MSRC_BODY       // the decoded text
+};
+
+// how the result of a compiled search is derived from its pattern
+enum MatcherResult
+{
+  MRES_ANY_MATCH=0,  // any string contains the pattern
+  MRES_ANY_MISMATCH, // any string doesn't contain the pattern
+  MRES_NO_MATCH      // no string contains the pattern
+};
+
+// all patterns which are matched against the same data
+struct MatcherGroup
+{
+  struct MinNode node;              // for placing the group into the matcher
+  enum MatcherSource source;        // the data to match against
+  enum FastSearch fast;             // the address field for MSRC_PERSONS
+  int persMode;                     // match names instead of addresses for MSRC_PERSONS
+  char field[SIZE_DEFAULT];         // the header field for MSRC_HEADERS, empty for all lines
+  size_t fieldLength;               // the length of the header field name
+  struct AhoCorasickContext *acc;   // the automaton of all patterns
+  ULONG *patterns;                  // the numbers of all patterns
+  ULONG numPatterns;
+  ULONG maxPatterns;
+  BOOL evaluated;                   // TRUE if the group was matched against the current mail
+};
+
+struct MatcherPattern
+{
+  const char *pattern;              // the string to search
+  size_t length;                    // the length of the string
+  BOOL caseSensitive;               // perform a case sensitive search
+  BOOL lineMatch;                   // TRUE if the current string contains the pattern
+  BOOL anyMatch;                    // TRUE if any string contains the pattern
+  BOOL anyMismatch;                 // TRUE if any string doesn't contain the pattern
+  struct MatcherGroup *group;       // the group the pattern belongs to
+};
+
+struct MatcherRule
+{
+  enum MatcherResult result;        // how to derive the result
+  BOOL skipEncrypted;               // don't match encrypted mails at all
+  LONG pattern;                     // the pattern to match against headers or address fields, -1 if none
+  LONG bodyPattern;                 // the pattern to match against the body, -1 if none
+};
+
+struct FilterMatcher
+{
+  struct MinList groups;            // all groups of patterns
+  struct MatcherPattern *patterns;  // all patterns
+  ULONG numPatterns;
+  ULONG maxPatterns;
+  struct MatcherRule *rules;        // all compiled searches
+  ULONG numRules;
+  ULONG maxRules;
+  ULONG refCount;                   // the number of searches using the matcher
+  const struct Mail *mail;          // the mail the groups were evaluated for
+};
+
 ///
 /// FI_MatchString
 //  Matches string against pattern
@@ -201,6 +271,21 @@ static BOOL FI_MatchPerson(const struct Search *search, const struct Person *pe)
   return match;
 }
 
+///
+/// FI_MatchMailPerson
+//  Matches string against the name or address of a mail's sender/recipient
+static BOOL FI_MatchMailPerson(const struct Search *search, const struct MailPerson *mpe)
+{
+  BOOL match;
+
+  ENTER();
+
+  match = FI_MatchString(search, search->PersMode ? mpe->RealName : mpe->Address);
+
+  RETURN(match);
+  return match;
+}
+
 ///
 /// FI_SearchPatternFast
 //  Searches string in standard header fields
@@ -217,11 +302,11 @@ static BOOL FI_SearchPatternFast(const struct Search *search, const struct Mail
     {
       struct ExtendedMail *email;
 
-      if(FI_MatchPerson(search, &mail->From) == TRUE)
+      if(FI_MatchMailPerson(search, &mail->From) == TRUE)
       {
         found = TRUE;
       }
-      else if(isMultiSenderMail(mail) && (email = MA_ExamineMail(mail->Folder, mail->MailFile, TRUE)) != NULL)
+      else if(isMultiSenderMail(mail) && (email = ObtainExtendedMail(mail)) != NULL)
       {
         int i;
 
@@ -234,7 +319,7 @@ static BOOL FI_SearchPatternFast(const struct Search *search, const struct Mail
           }
         }
 
-        MA_FreeEMailStruct(email);
+        ReleaseExtendedMail(email);
       }
     }
     break;
@@ -244,11 +329,11 @@ static BOOL FI_SearchPatternFast(const struct Search *search, const struct Mail
     {
       struct ExtendedMail *email;
 
-      if(FI_MatchPerson(search, &mail->To) == TRUE)
+      if(FI_MatchMailPerson(search, &mail->To) == TRUE)
       {
         found = TRUE;
       }
-      else if(isMultiRCPTMail(mail) && (email = MA_ExamineMail(mail->Folder, mail->MailFile, TRUE)) != NULL)
+      else if(isMultiRCPTMail(mail) && (email = ObtainExtendedMail(mail)) != NULL)
       {
         int i;
 
@@ -261,7 +346,7 @@ static BOOL FI_SearchPatternFast(const struct Search *search, const struct Mail
           }
         }
 
-        MA_FreeEMailStruct(email);
+        ReleaseExtendedMail(email);
       }
     }
     break;
@@ -271,7 +356,7 @@ static BOOL FI_SearchPatternFast(const struct Search *search, const struct Mail
     {
       struct ExtendedMail *email;
 
-      if(isMultiRCPTMail(mail) && (email = MA_ExamineMail(mail->Folder, mail->MailFile, TRUE)) != NULL)
+      if(isMultiRCPTMail(mail) && (email = ObtainExtendedMail(mail)) != NULL)
       {
         int i;
 
@@ -284,7 +369,7 @@ static BOOL FI_SearchPatternFast(const struct Search *search, const struct Mail
           }
         }
 
-        MA_FreeEMailStruct(email);
+        ReleaseExtendedMail(email);
       }
     }
     break;
@@ -294,11 +379,11 @@ static BOOL FI_SearchPatternFast(const struct Search *search, const struct Mail
     {
       struct ExtendedMail *email;
 
-      if(FI_MatchPerson(search, &mail->ReplyTo) == TRUE)
+      if(FI_MatchMailPerson(search, &mail->ReplyTo) == TRUE)
       {
         found = TRUE;
       }
-      else if(isMultiReplyToMail(mail) && (email = MA_ExamineMail(mail->Folder, mail->MailFile, TRUE)) != NULL)
+      else if(isMultiReplyToMail(mail) && (email = ObtainExtendedMail(mail)) != NULL)
       {
         int i;
 
@@ -311,7 +396,7 @@ static BOOL FI_SearchPatternFast(const struct Search *search, const struct Mail
           }
         }
 
-        MA_FreeEMailStruct(email);
+        ReleaseExtendedMail(email);
       }
     }
     break;
@@ -446,6 +531,10 @@ static BOOL FI_SearchPatternInBody(const struct Search *search, const struct Mai
       char *rptr = cmsg;
       char *ptr;
 
+      // remember the text for future searches before it is split into lines
+      if(search->bodyQuery != NULL)
+        BodyIndexAddMail(mail, cmsg);
+
       while(*rptr != '\0' && found == FALSE)
       {
         for(ptr = rptr; *ptr && *ptr != '\n'; ptr++);
@@ -479,82 +568,54 @@ static BOOL FI_SearchPatternInBody(const struct Search *search, const struct Mai
 //  Searches string in header field(s)
 static BOOL FI_SearchPatternInHeader(const struct Search *search, const struct Mail *mail)
 {
-  char fullfile[SIZE_PATHFILE];
-  char mailfile[SIZE_PATHFILE];
   BOOL found = FALSE;
+  struct MinList *headerList;
 
   ENTER();
 
-  GetMailFile(mailfile, sizeof(mailfile), NULL, mail);
-
-  if(StartUnpack(mailfile, fullfile, mail->Folder) != NULL)
+  if((headerList = ObtainMailHeaders(mail)) != NULL)
   {
-    FILE *fh;
+    int searchLen = 0;
+    struct HeaderNode *hdrNode;
 
-    if((fh = fopen(fullfile, "r")) != NULL)
+    // prepare the search length ahead of the iteration
+    if(search->Field[0] != '\0')
     {
-      struct MinList *headerList;
-
-      if((headerList = AllocSysObjectTags(ASOT_LIST,
-        ASOLIST_Min, TRUE,
-        TAG_DONE)) != NULL)
-      {
-        setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
-
-        if(MA_ReadHeader(mailfile, fh, headerList, RHM_MAINHEADER) == TRUE)
-        {
-          int searchLen = 0;
-          struct HeaderNode *hdrNode;
-
-          // prepare the search length ahead of the iteration
-          if(search->Field[0] != '\0')
-          {
-            char *ptr;
-
-            // if the field is specified we search if it was specified with a ':'
-            // at the end
-            if((ptr = strchr(search->Field, ':')) != NULL)
-              searchLen = ptr-(search->Field);
-            else
-              searchLen = strlen(search->Field);
-          }
-
-          IterateList(headerList, struct HeaderNode *, hdrNode)
-          {
-            // if the field is explicitly specified we search for it or
-            // otherwise skip our search
-            if(search->Field[0] != '\0')
-            {
-              // the search length has been calculated before
-              if(strnicmp(hdrNode->name, search->Field, searchLen) != 0)
-                continue;
-            }
-
-            found = FI_MatchString(search, hdrNode->content);
+      char *ptr;
 
-            // bail out as soon as we found a matching string
-            if(found == TRUE)
-              break;
-          }
-        }
+      // if the field is specified we search if it was specified with a ':'
+      // at the end
+      if((ptr = strchr(search->Field, ':')) != NULL)
+        searchLen = ptr-(search->Field);
+      else
+        searchLen = strlen(search->Field);
+    }
 
-        // free our temporary headerList
-        ClearHeaderList(headerList);
-        FreeSysObject(ASOT_LIST, headerList);
+    IterateList(headerList, struct HeaderNode *, hdrNode)
+    {
+      // if the field is explicitly specified we search for it or
+      // otherwise skip our search
+      if(search->Field[0] != '\0')
+      {
+        // the search length has been calculated before
+        if(strnicmp(hdrNode->name, search->Field, searchLen) != 0)
+          continue;
       }
 
-      // close the file
-      fclose(fh);
+      found = FI_MatchString(search, hdrNode->content);
+
+      // bail out as soon as we found a matching string
+      if(found == TRUE)
+        break;
     }
 
-    FinishUnpack(fullfile);
+    ReleaseMailHeaders(headerList);
   }
 
   RETURN(found);
   return found;
 }
 
-///
 /// FI_IsFastSearch
 //  Checks if quick search is available for selected header field
 static enum FastSearch FI_IsFastSearch(const char *field)
@@ -793,6 +854,10 @@ BOOL FI_PrepareSearch(struct Search *search, const enum SearchMode mode,
         // do a substring search using the Boyer/Moore algorithm
         if((search->bmContext = BoyerMooreInit(search->Match, isFlagSet(flags, SEARCHF_CASE_SENSITIVE))) == NULL)
           success = FALSE;
+
+        // body searches may skip mails which cannot contain the string at all
+        if(success == TRUE && (mode == SM_BODY || mode == SM_WHOLE))
+          search->bodyQuery = BodyIndexPrepareQuery(search->Match);
       }
       else
       {
@@ -898,7 +963,8 @@ BOOL FI_DoSearch(struct Search *search, const struct Mail *mail)
 
         // always perform a matching search
         search->Compare = CP_EQUAL;
-        found = FI_SearchPatternInBody(search, mail);
+        if(BodyIndexMatchMail(search->bodyQuery, mail) != BIM_NONE)
+          found = FI_SearchPatternInBody(search, mail);
         search->Compare = oldCompare;
 
         // invert the result in case a non-matching search was requested
@@ -926,7 +992,7 @@ BOOL FI_DoSearch(struct Search *search, const struct Mail *mail)
         // always perform a matching search
         search->Compare = CP_EQUAL;
         found = FI_SearchPatternInHeader(search, mail);
-        if(found == FALSE)
+        if(found == FALSE && BodyIndexMatchMail(search->bodyQuery, mail) != BIM_NONE)
           found = FI_SearchPatternInBody(search, mail);
         search->Compare = oldCompare;
 
@@ -1019,6 +1085,591 @@ BOOL FI_DoSearch(struct Search *search, const struct Mail *mail)
   return found;
 }
 
+///
+/// FI_FindMatcherGroup
+//  Finds or creates the group of compiled rules matching the same data
+static struct MatcherGroup *FI_FindMatcherGroup(struct FilterMatcher *matcher, enum MatcherSource source, const struct Search *search)
+{
+  struct MatcherGroup *group;
+  const char *field = (source == MSRC_HEADERS) ? search->Field : "";
+  enum FastSearch fast = (source == MSRC_PERSONS) ? search->Fast : FS_NONE;
+  int persMode = (source == MSRC_PERSONS) ? search->PersMode : 0;
+  BOOL found = FALSE;
+
+  ENTER();
+
+  IterateList(&matcher->groups, struct MatcherGroup *, group)
+  {
+    if(group->source == source && group->fast == fast && group->persMode == persMode && stricmp(group->field, field) == 0)
+    {
+      found = TRUE;
+      break;
+    }
+  }
+
+  if(found == FALSE)
+  {
+    if((group = calloc(1, sizeof(*group))) != NULL)
+    {
+      group->source = source;
+      group->fast = fast;
+      group->persMode = persMode;
+      strlcpy(group->field, field, sizeof(group->field));
+
+      // a field name may be specified with a trailing ':'
+      if((group->fieldLength = strcspn(group->field, ":")) == 0)
+        group->field[0] = '\0';
+
+      if((group->acc = AhoCorasickInit(FALSE)) != NULL)
+      {
+        AddTail((struct List *)&matcher->groups, (struct Node *)group);
+      }
+      else
+      {
+        free(group);
+        group = NULL;
+      }
+    }
+  }
+
+  RETURN(group);
+  return group;
+}
+
+///
+/// FI_AddMatcherPattern
+//  Adds the pattern of a search to a group of compiled rules and returns
+//  its number or -1 in case of an error
+static LONG FI_AddMatcherPattern(struct FilterMatcher *matcher, enum MatcherSource source, const struct Search *search)
+{
+  LONG result = -1;
+  struct MatcherGroup *group;
+
+  ENTER();
+
+  // enlarge the arrays if necessary
+  if(matcher->numPatterns >= matcher->maxPatterns)
+  {
+    ULONG newMax = (matcher->maxPatterns > 0) ? matcher->maxPatterns * 2 : 32;
+    struct MatcherPattern *newPatterns;
+
+    if((newPatterns = realloc(matcher->patterns, newMax * sizeof(*newPatterns))) != NULL)
+    {
+      matcher->patterns = newPatterns;
+      matcher->maxPatterns = newMax;
+    }
+  }
+
+  if(matcher->numPatterns < matcher->maxPatterns && (group = FI_FindMatcherGroup(matcher, source, search)) != NULL)
+  {
+    if(group->numPatterns >= group->maxPatterns)
+    {
+      ULONG newMax = (group->maxPatterns > 0) ? group->maxPatterns * 2 : 8;
+      ULONG *newPatterns;
+
+      if((newPatterns = realloc(group->patterns, newMax * sizeof(*newPatterns))) != NULL)
+      {
+        group->patterns = newPatterns;
+        group->maxPatterns = newMax;
+      }
+    }
+
+    if(group->numPatterns < group->maxPatterns && AhoCorasickAddPattern(group->acc, search->Match, matcher->numPatterns) == TRUE)
+    {
+      struct MatcherPattern *pattern = &matcher->patterns[matcher->numPatterns];
+
+      memset(pattern, 0, sizeof(*pattern));
+      pattern->pattern = search->Match;
+      pattern->length = strlen(search->Match);
+      pattern->caseSensitive = isFlagSet(search->flags, SEARCHF_CASE_SENSITIVE);
+      pattern->group = group;
+
+      group->patterns[group->numPatterns++] = matcher->numPatterns;
+      result = matcher->numPatterns++;
+    }
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// FI_CompileSearch
+//  Adds a search to the compiled rules if it is a plain substring search
+static BOOL FI_CompileSearch(struct FilterMatcher *matcher, struct Search *search)
+{
+  BOOL success = FALSE;
+
+  ENTER();
+
+  if((search->Compare == CP_EQUAL || search->Compare == CP_NOTEQUAL) &&
+     isFlagSet(search->flags, SEARCHF_SUBSTRING) && isFlagClear(search->flags, SEARCHF_DOS_PATTERN) &&
+     search->bmContext != NULL && search->Match[0] != '\0')
+  {
+    struct MatcherRule rule;
+
+    memset(&rule, 0, sizeof(rule));
+    rule.pattern = -1;
+    rule.bodyPattern = -1;
+
+    switch(search->Mode)
+    {
+      case SM_FROM:
+      case SM_TO:
+      case SM_CC:
+      case SM_REPLYTO:
+      case SM_SUBJECT:
+      case SM_HEADLINE:
+      {
+        // the string is matched against each single address or header
+        // line, a non-matching search is fulfilled by any non-matching one
+        rule.result = (search->Compare == CP_EQUAL) ? MRES_ANY_MATCH : MRES_ANY_MISMATCH;
+
+        if(search->Fast >= FS_FROM && search->Fast <= FS_REPLYTO)
+          rule.pattern = FI_AddMatcherPattern(matcher, MSRC_PERSONS, search);
+        else if(search->Fast == FS_SUBJECT)
+          rule.pattern = FI_AddMatcherPattern(matcher, MSRC_SUBJECT, search);
+        else if(search->Fast == FS_NONE)
+          rule.pattern = FI_AddMatcherPattern(matcher, MSRC_HEADERS, search);
+
+        success = (rule.pattern != -1);
+      }
+      break;
+
+      case SM_HEADER:
+      {
+        // a non-matching search is fulfilled if no header line matches
+        rule.result = (search->Compare == CP_EQUAL) ? MRES_ANY_MATCH : MRES_NO_MATCH;
+        rule.pattern = FI_AddMatcherPattern(matcher, MSRC_HEADERS, search);
+
+        success = (rule.pattern != -1);
+      }
+      break;
+
+      case SM_BODY:
+      {
+        rule.result = (search->Compare == CP_EQUAL) ? MRES_ANY_MATCH : MRES_NO_MATCH;
+        rule.skipEncrypted = isFlagSet(search->flags, SEARCHF_SKIP_ENCRYPTED);
+        rule.bodyPattern = FI_AddMatcherPattern(matcher, MSRC_BODY, search);
+
+        success = (rule.bodyPattern != -1);
+      }
+      break;
+
+      case SM_WHOLE:
+      {
+        rule.result = (search->Compare == CP_EQUAL) ? MRES_ANY_MATCH : MRES_NO_MATCH;
+        rule.skipEncrypted = isFlagSet(search->flags, SEARCHF_SKIP_ENCRYPTED);
+        rule.pattern = FI_AddMatcherPattern(matcher, MSRC_HEADERS, search);
+        rule.bodyPattern = FI_AddMatcherPattern(matcher, MSRC_BODY, search);
+
+        success = (rule.pattern != -1 && rule.bodyPattern != -1);
+      }
+      break;
+
+      default:
+        // all other searches are performed one by one
+      break;
+    }
+
+    if(success == TRUE)
+    {
+      // enlarge the array if necessary
+      if(matcher->numRules >= matcher->maxRules)
+      {
+        ULONG newMax = (matcher->maxRules > 0) ? matcher->maxRules * 2 : 32;
+        struct MatcherRule *newRules;
+
+        if((newRules = realloc(matcher->rules, newMax * sizeof(*newRules))) != NULL)
+        {
+          matcher->rules = newRules;
+          matcher->maxRules = newMax;
+        }
+      }
+
+      if(matcher->numRules < matcher->maxRules)
+      {
+        memcpy(&matcher->rules[matcher->numRules], &rule, sizeof(rule));
+        search->matcher = matcher;
+        search->matcherRule = matcher->numRules++;
+        matcher->refCount++;
+      }
+      else
+        success = FALSE;
+    }
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// FI_ReleaseFilterMatcher
+//  Releases a reference to the compiled rules and frees them with the last one
+static void FI_ReleaseFilterMatcher(struct FilterMatcher *matcher)
+{
+  ENTER();
+
+  if(matcher != NULL && --matcher->refCount == 0)
+  {
+    struct MatcherGroup *group;
+    struct MatcherGroup *next;
+
+    SafeIterateList(&matcher->groups, struct MatcherGroup *, group, next)
+    {
+      AhoCorasickCleanup(group->acc);
+      free(group->patterns);
+      free(group);
+    }
+
+    free(matcher->patterns);
+    free(matcher->rules);
+    free(matcher);
+  }
+
+  LEAVE();
+}
+
+///
+/// FI_CompileFilterList
+//  Compiles all plain substring searches of a filter list, so that all
+//  filters can be checked with a single pass over the data of a mail
+static void FI_CompileFilterList(const struct MinList *filterList)
+{
+  struct FilterMatcher *matcher;
+
+  ENTER();
+
+  if((matcher = calloc(1, sizeof(*matcher))) != NULL)
+  {
+    struct FilterNode *filter;
+    struct MatcherGroup *group;
+    ULONG numGroups = 0;
+    ULONG numSearches = 0;
+
+    NewMinList(&matcher->groups);
+
+    // the list itself holds a reference until all searches are compiled
+    matcher->refCount = 1;
+
+    IterateList(filterList, struct FilterNode *, filter)
+    {
+      struct RuleNode *rule;
+
+      IterateList(&filter->ruleList, struct RuleNode *, rule)
+      {
+        if(rule->search != NULL)
+        {
+          numSearches++;
+          FI_CompileSearch(matcher, rule->search);
+        }
+      }
+    }
+
+    IterateList(&matcher->groups, struct MatcherGroup *, group)
+    {
+      AhoCorasickPrepare(group->acc);
+      numGroups++;
+    }
+
+    D(DBF_FILTER, "compiled %ld of %ld rules into %ld groups", matcher->numRules, numSearches, numGroups);
+
+    FI_ReleaseFilterMatcher(matcher);
+  }
+
+  LEAVE();
+}
+
+///
+/// FI_MatcherFoundPattern
+//  AhoCorasickSearch() callback to remember a found pattern
+static void FI_MatcherFoundPattern(ULONG id, const char *match, void *userData)
+{
+  struct FilterMatcher *matcher = (struct FilterMatcher *)userData;
+  struct MatcherPattern *pattern = &matcher->patterns[id];
+
+  // the automaton ignores the case, so case sensitive patterns
+  // must be checked again
+  if(pattern->caseSensitive == FALSE || strncmp(match, pattern->pattern, pattern->length) == 0)
+    pattern->lineMatch = TRUE;
+}
+
+///
+/// FI_MatchGroupString
+//  Matches a single string against all patterns of a group
+static void FI_MatchGroupString(struct FilterMatcher *matcher, struct MatcherGroup *group, const char *string)
+{
+  ULONG i;
+
+  ENTER();
+
+  for(i=0; i < group->numPatterns; i++)
+    matcher->patterns[group->patterns[i]].lineMatch = FALSE;
+
+  AhoCorasickSearch(group->acc, string, FI_MatcherFoundPattern, matcher);
+
+  for(i=0; i < group->numPatterns; i++)
+  {
+    struct MatcherPattern *pattern = &matcher->patterns[group->patterns[i]];
+
+    if(pattern->lineMatch == TRUE)
+      pattern->anyMatch = TRUE;
+    else
+      pattern->anyMismatch = TRUE;
+  }
+
+  LEAVE();
+}
+
+///
+/// FI_MatchGroupPersons
+//  Matches all persons of a mail's address field against a group
+static void FI_MatchGroupPersons(struct FilterMatcher *matcher, struct MatcherGroup *group, const struct Mail *mail)
+{
+  const struct MailPerson *mpe = NULL;
+  const struct Person *pe = NULL;
+  BOOL multiple = FALSE;
+
+  ENTER();
+
+  switch(group->fast)
+  {
+    case FS_FROM:
+      mpe = &mail->From;
+      multiple = isMultiSenderMail(mail);
+    break;
+
+    case FS_TO:
+      mpe = &mail->To;
+      multiple = isMultiRCPTMail(mail);
+    break;
+
+    case FS_CC:
+      // the Cc: addresses are not part of the mail structure
+      multiple = isMultiRCPTMail(mail);
+    break;
+
+    case FS_REPLYTO:
+      mpe = &mail->ReplyTo;
+      multiple = isMultiReplyToMail(mail);
+    break;
+
+    default:
+      // nothing
+    break;
+  }
+
+  if(mpe != NULL)
+    FI_MatchGroupString(matcher, group, group->persMode ? mpe->RealName : mpe->Address);
+
+  if(multiple == TRUE)
+  {
+    struct ExtendedMail *email;
+
+    if((email = ObtainExtendedMail(mail)) != NULL)
+    {
+      int num = 0;
+      int i;
+
+      switch(group->fast)
+      {
+        case FS_FROM:    pe = email->SFrom;    num = email->NumSFrom;    break;
+        case FS_TO:      pe = email->STo;      num = email->NumSTo;      break;
+        case FS_CC:      pe = email->CC;       num = email->NumCC;       break;
+        case FS_REPLYTO: pe = email->SReplyTo; num = email->NumSReplyTo; break;
+        default:                                                         break;
+      }
+
+      for(i=0; i < num; i++)
+        FI_MatchGroupString(matcher, group, group->persMode ? pe[i].RealName : pe[i].Address);
+
+      ReleaseExtendedMail(email);
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// FI_EvaluateMatcherGroup
+//  Matches the data of a mail against all patterns of a group at once
+static void FI_EvaluateMatcherGroup(struct FilterMatcher *matcher, struct MatcherGroup *group, const struct Mail *mail)
+{
+  ULONG i;
+
+  ENTER();
+
+  for(i=0; i < group->numPatterns; i++)
+  {
+    matcher->patterns[group->patterns[i]].anyMatch = FALSE;
+    matcher->patterns[group->patterns[i]].anyMismatch = FALSE;
+  }
+
+  switch(group->source)
+  {
+    case MSRC_PERSONS:
+    {
+      FI_MatchGroupPersons(matcher, group, mail);
+    }
+    break;
+
+    case MSRC_SUBJECT:
+    {
+      FI_MatchGroupString(matcher, group, mail->Subject);
+    }
+    break;
+
+    case MSRC_HEADERS:
+    {
+      struct MinList *headerList;
+
+      if((headerList = ObtainMailHeaders(mail)) != NULL)
+      {
+        struct HeaderNode *hdrNode;
+
+        IterateList(headerList, struct HeaderNode *, hdrNode)
+        {
+          if(group->field[0] == '\0' || strnicmp(hdrNode->name, group->field, group->fieldLength) == 0)
+            FI_MatchGroupString(matcher, group, hdrNode->content);
+        }
+
+        ReleaseMailHeaders(headerList);
+      }
+    }
+    break;
+
+    case MSRC_BODY:
+    {
+      struct ReadMailData *rmData;
+
+      if((rmData = AllocPrivateRMData(mail, PM_TEXTS|PM_QUIET)) != NULL)
+      {
+        char *cmsg;
+
+        // the patterns cannot span several lines, so the text can be
+        // searched as a whole
+        if((cmsg = RE_ReadInMessage(rmData, RIM_QUIET)) != NULL)
+        {
+          FI_MatchGroupString(matcher, group, cmsg);
+          dstrfree(cmsg);
+        }
+
+        FreePrivateRMData(rmData);
+      }
+    }
+    break;
+  }
+
+  group->evaluated = TRUE;
+
+  LEAVE();
+}
+
+///
+/// FI_MatchCompiledSearch
+//  Checks if a mail fulfills a compiled search, the data of the mail is
+//  matched against all compiled searches on first use
+static BOOL FI_MatchCompiledSearch(const struct Search *search, const struct Mail *mail)
+{
+  struct FilterMatcher *matcher = search->matcher;
+  const struct MatcherRule *rule = &matcher->rules[search->matcherRule];
+  BOOL found = FALSE;
+
+  ENTER();
+
+  // forget about the results of the previous mail
+  if(matcher->mail != mail)
+  {
+    struct MatcherGroup *group;
+
+    IterateList(&matcher->groups, struct MatcherGroup *, group)
+      group->evaluated = FALSE;
+
+    matcher->mail = mail;
+  }
+
+  if(rule->skipEncrypted == FALSE || isMP_CryptedMail(mail) == FALSE)
+  {
+    BOOL anyMatch = FALSE;
+    BOOL anyMismatch = FALSE;
+
+    if(rule->pattern != -1)
+    {
+      struct MatcherPattern *pattern = &matcher->patterns[rule->pattern];
+
+      if(pattern->group->evaluated == FALSE)
+        FI_EvaluateMatcherGroup(matcher, pattern->group, mail);
+
+      anyMatch = pattern->anyMatch;
+      anyMismatch = pattern->anyMismatch;
+    }
+
+    // the body must be checked only if the headers don't match
+    if(anyMatch == FALSE && rule->bodyPattern != -1)
+    {
+      struct MatcherPattern *pattern = &matcher->patterns[rule->bodyPattern];
+
+      if(pattern->group->evaluated == FALSE)
+        FI_EvaluateMatcherGroup(matcher, pattern->group, mail);
+
+      anyMatch = pattern->anyMatch;
+    }
+
+    switch(rule->result)
+    {
+      case MRES_ANY_MATCH:
+        found = anyMatch;
+      break;
+
+      case MRES_ANY_MISMATCH:
+        found = anyMismatch;
+      break;
+
+      case MRES_NO_MATCH:
+        found = !anyMatch;
+      break;
+    }
+  }
+
+  D(DBF_FILTER, "  compiled search for '%s' %s", search->Match, found ? "matched" : "NOT matched");
+
+  RETURN(found);
+  return found;
+}
+
+///
+/// FI_ResetFilterMatcher
+//  Makes sure the compiled searches of a filter list don't use the results
+//  of a previous mail
+static void FI_ResetFilterMatcher(const struct MinList *filterList)
+{
+  struct FilterNode *filter;
+  BOOL done = FALSE;
+
+  ENTER();
+
+  // all compiled searches of a list share the same matcher
+  IterateList(filterList, struct FilterNode *, filter)
+  {
+    struct RuleNode *rule;
+
+    IterateList(&filter->ruleList, struct RuleNode *, rule)
+    {
+      if(rule->search != NULL && rule->search->matcher != NULL)
+      {
+        rule->search->matcher->mail = NULL;
+        done = TRUE;
+        break;
+      }
+    }
+
+    if(done == TRUE)
+      break;
+  }
+
+  LEAVE();
+}
+
 ///
 /// DoFilterSearch()
 //  Does a complex search with combined criterias based on the rules of a filter
@@ -1044,7 +1695,14 @@ BOOL DoFilterSearch(const struct FilterNode *filter, const struct Mail *mail)
 
     if(rule->search != NULL)
     {
-      if(FI_DoSearch(rule->search, mail) == TRUE)
+      BOOL found;
+
+      if(rule->search->matcher != NULL)
+        found = FI_MatchCompiledSearch(rule->search, mail);
+      else
+        found = FI_DoSearch(rule->search, mail);
+
+      if(found == TRUE)
         matchedRules++;
     }
   }
@@ -1083,9 +1741,10 @@ BOOL DoFilterSearch(const struct FilterNode *filter, const struct Mail *mail)
 }
 
 ///
-/// FI_FilterSingleMail
-//  applies the configured filters on a single mail
-BOOL FI_FilterSingleMail(const struct MinList *filterList, struct Mail *mail, int *matches, struct FilterResult *result)
+/// FilterSingleMail
+//  applies the configured filters on a single mail, moves are collected in
+//  the given batch if possible
+static BOOL FilterSingleMail(const struct MinList *filterList, struct Mail *mail, int *matches, struct FilterResult *result, struct MoveCopyBatch *moveBatch)
 {
   BOOL success = TRUE;
   struct FilterNode *filter;
@@ -1093,6 +1752,8 @@ BOOL FI_FilterSingleMail(const struct MinList *filterList, struct Mail *mail, in
 
   ENTER();
 
+  FI_ResetFilterMatcher(filterList);
+
   IterateList(filterList, struct FilterNode *, filter)
   {
     if(DoFilterSearch(filter, mail) == TRUE)
@@ -1101,7 +1762,7 @@ BOOL FI_FilterSingleMail(const struct MinList *filterList, struct Mail *mail, in
 
       // if ExecuteFilterAction returns FALSE then the filter search should be aborted
       // completley
-      if(ExecuteFilterAction(filter, mail, result) == FALSE)
+      if(ExecuteFilterAction(filter, mail, result, moveBatch) == FALSE)
       {
         success = FALSE;
         break;
@@ -1116,6 +1777,21 @@ BOOL FI_FilterSingleMail(const struct MinList *filterList, struct Mail *mail, in
   return success;
 }
 
+///
+/// FI_FilterSingleMail
+//  applies the configured filters on a single mail
+BOOL FI_FilterSingleMail(const struct MinList *filterList, struct Mail *mail, int *matches, struct FilterResult *result)
+{
+  BOOL success;
+
+  ENTER();
+
+  success = FilterSingleMail(filterList, mail, matches, result, NULL);
+
+  RETURN(success);
+  return success;
+}
+
 ///
 /// FreeSearchData
 // Function to free the search data
@@ -1140,6 +1816,13 @@ void FreeSearchData(struct Search *search)
     search->bmContext = NULL;
   }
 
+  BodyIndexFreeQuery(search->bodyQuery);
+  search->bodyQuery = NULL;
+
+  // release the compiled rules
+  FI_ReleaseFilterMatcher(search->matcher);
+  search->matcher = NULL;
+
   LEAVE();
 }
 
@@ -1341,6 +2024,11 @@ struct MinList *CloneFilterList(enum ApplyFilterMode mode)
           }
         }
       }
+
+      // remote filters are checked against the headers of mails on the server
+      // only, all other filters are checked in a single pass over each mail
+      if(mode != APPLY_REMOTE)
+        FI_CompileFilterList(clonedList);
     }
   }
 
@@ -1352,8 +2040,9 @@ struct MinList *CloneFilterList(enum ApplyFilterMode mode)
 ///
 /// ExecuteFilterAction
 //  Applies filter action to a message and return TRUE if the filter search
-//  should continue or FALSE if it should stop afterwards
-BOOL ExecuteFilterAction(const struct FilterNode *filter, struct Mail *mail, struct FilterResult *result)
+//  should continue or FALSE if it should stop afterwards. Moves are collected
+//  in the given batch if possible, otherwise they are done immediately.
+BOOL ExecuteFilterAction(const struct FilterNode *filter, struct Mail *mail, struct FilterResult *result, struct MoveCopyBatch *moveBatch)
 {
   BOOL success = TRUE;
 
@@ -1488,30 +2177,18 @@ BOOL ExecuteFilterAction(const struct FilterNode *filter, struct Mail *mail, str
       if(mail->Folder != fo)
       {
         char originator[SIZE_DEFAULT];
-        BOOL accessFreed = FALSE;
-        enum LoadedMode oldLoadedMode = fo->LoadedMode;
+        const ULONG flags = MVCPF_CLOSE_WINDOWS|MVCPF_QUIET|MVCPF_FREE_ACCESS;
 
         if(result != NULL)
-        result->Moved++;
-
-        // temporarily grant free access to the folder, but only if it has no free access yet
-        if(fo->LoadedMode != LM_VALID && isProtectedFolder(fo) && isFreeAccess(fo) == FALSE)
-        {
-          setFlag(fo->Flags, FOFL_FREEXS);
-          accessFreed = TRUE;
-        }
+          result->Moved++;
 
         // setup the current filter name as originator for the move
         snprintf(originator, sizeof(originator), tr(MSG_LOG_FILTER_ORIGINATOR), filter->name);
-        MA_MoveCopy(mail, fo, originator, MVCPF_CLOSE_WINDOWS|MVCPF_QUIET);
 
-        // restore the old access mode if it was changed before
-        if(accessFreed)
+        // collect the mail for a combined move of all filtered mails if possible
+        if(moveBatch == NULL || MA_AddToMoveCopyBatch(moveBatch, mail, fo, originator, flags) == FALSE)
         {
-          // restore old index settings
-          // if it was not yet loaded before, the MA_MoveCopy() call changed this to "loaded"
-          fo->LoadedMode = oldLoadedMode;
-          clearFlag(fo->Flags, FOFL_FREEXS);
+          MA_MoveCopy(mail, fo, originator, flags);
         }
 
         // signal failure, although everything was successful yet
@@ -1553,6 +2230,35 @@ BOOL ExecuteFilterAction(const struct FilterNode *filter, struct Mail *mail, str
   return success;
 }
 
+///
+/// FI_NeedsClassification
+// check whether a mail must be passed to the spam filter
+static BOOL FI_NeedsClassification(const struct Mail *mail, const int mode)
+{
+  BOOL doClassification;
+
+  ENTER();
+
+  if(mode == APPLY_AUTO && C->SpamFilterForNewMail == TRUE && mail->Folder != NULL && isTrashFolder(mail->Folder) == FALSE)
+  {
+    // classify this mail if we are allowed to check new mails automatically
+    doClassification = TRUE;
+  }
+  else if(mode == APPLY_SPAM && hasStatusSpam(mail) == FALSE && hasStatusHam(mail) == FALSE)
+  {
+    // classify mails if the user triggered this and the mail is not yet classified
+    doClassification = TRUE;
+  }
+  else
+  {
+    // don't try to classify this mail
+    doClassification = FALSE;
+  }
+
+  RETURN(doClassification);
+  return doClassification;
+}
+
 ///
 /// FilterMails
 // Apply filters
@@ -1575,12 +2281,16 @@ void FilterMails(const struct MailList *mlist, const int mode, struct FilterResu
     BOOL noFilters = IsMinListEmpty(filterList);
     struct TimeVal lastStatsUpdate;
     struct FilterResult lastResult;
+    struct Mail **classifyMails = NULL;
+    BOOL *classifyResults = NULL;
+    ULONG numClassify = 0;
+    ULONG classifyIndex = 0;
+    BOOL aborted = FALSE;
+    struct MoveCopyBatch *moveBatch;
 
     set(G->MA->GUI.PG_MAILLIST, MUIA_NList_Quiet, TRUE);
     G->AppIconQuiet = TRUE;
 
-    LockMailList(mlist);
-
     busy = BusyBegin(BUSY_PROGRESS_ABORT);
     // we use another Busy Gauge information if this is
     // a spam classification session. And we build an interruptable
@@ -1592,65 +2302,102 @@ void FilterMails(const struct MailList *mlist, const int mode, struct FilterResu
 
     DoMethod(G->App, MUIM_YAMApplication_StartMacro, MACRO_PREFILTER, NULL);
 
+    // let all rules share the parsed headers of a mail
+    HeaderCacheBegin();
+
     memset(&lastStatsUpdate, 0, sizeof(lastStatsUpdate));
     memset(&lastResult, 0, sizeof(lastResult));
 
+    // moves are collected and done at once after all mails were filtered
+    moveBatch = MA_CreateMoveCopyBatch();
+
+    // classify all candidate mails at once before the filters are applied,
+    // this lets several threads share the work
+    if(C->SpamFilterEnabled == TRUE && (mode == APPLY_AUTO || mode == APPLY_SPAM))
+    {
+      // only collect the candidates while the list is locked, the
+      // collected mails are referenced until we are done with them
+      LockMailList(mlist);
+
+      if(mlist->count > 0 &&
+         (classifyMails = malloc(mlist->count * sizeof(*classifyMails))) != NULL &&
+         (classifyResults = malloc(mlist->count * sizeof(*classifyResults))) != NULL)
+      {
+        ForEachMailNode(mlist, mnode)
+        {
+          struct Mail *mail = mnode->mail;
+
+          if(mail != NULL && FI_NeedsClassification(mail, mode) == TRUE)
+          {
+            ReferenceMail(mail);
+            classifyMails[numClassify++] = mail;
+          }
+        }
+
+        D(DBF_FILTER, "classifying %ld of %ld messages", numClassify, mlist->count);
+      }
+
+      UnlockMailList(mlist);
+
+      if(classifyResults != NULL &&
+         BayesFilterClassifyMessages((const struct Mail **)classifyMails, classifyResults, numClassify, busy) == FALSE)
+      {
+        aborted = TRUE;
+      }
+    }
+
+    LockMailList(mlist);
+
     m = 0;
     ForEachMailNode(mlist, mnode)
     {
       struct Mail *mail = mnode->mail;
       BOOL wasSpam = FALSE;
 
+      // stop if the user aborted the classification already
+      if(aborted == TRUE)
+        break;
+
       if(mail != NULL)
       {
+        BOOL isSpam = FALSE;
+
         D(DBF_FILTER, "about to apply filters to message with subject '%s' in folder '%s'", mail->Subject, (mail->Folder != NULL) ? mail->Folder->Name : "<NULL>");
 
-        if(C->SpamFilterEnabled == TRUE && (mode == APPLY_AUTO || mode == APPLY_SPAM))
+        if(classifyIndex < numClassify && classifyMails[classifyIndex] == mail)
         {
-          BOOL doClassification;
-
-          D(DBF_FILTER, "about to apply spam filter to message with subject '%s'", mail->Subject);
-
-          if(mode == APPLY_AUTO && C->SpamFilterForNewMail == TRUE && mail->Folder != NULL && isTrashFolder(mail->Folder) == FALSE)
-          {
-            // classify this mail if we are allowed to check new mails automatically
-            doClassification = TRUE;
-          }
-          else if(mode == APPLY_SPAM && hasStatusSpam(mail) == FALSE && hasStatusHam(mail) == FALSE)
-          {
-            // classify mails if the user triggered this and the mail is not yet classified
-            doClassification = TRUE;
-          }
-          else
-          {
-            // don't try to classify this mail
-            doClassification = FALSE;
-          }
+          // use the result of the batch classification
+          isSpam = classifyResults[classifyIndex];
+          classifyIndex++;
+        }
+        else if(classifyResults == NULL && C->SpamFilterEnabled == TRUE && (mode == APPLY_AUTO || mode == APPLY_SPAM) &&
+                FI_NeedsClassification(mail, mode) == TRUE)
+        {
+          // we were short of memory for the batch classification
+          D(DBF_FILTER, "classifying message with subject '%s'", mail->Subject);
 
-          if(doClassification == TRUE)
-          {
-            D(DBF_FILTER, "classifying message with subject '%s'", mail->Subject);
+          isSpam = BayesFilterClassifyMessage(mail);
+        }
 
-            if(BayesFilterClassifyMessage(mail) == TRUE)
-            {
-              D(DBF_FILTER, "message was classified as spam");
+        if(isSpam == TRUE)
+        {
+          D(DBF_FILTER, "message with subject '%s' was classified as spam", mail->Subject);
 
-              // set the SPAM flags, but clear the NEW and READ flags only if desired
-              if(C->SpamMarkAsRead == TRUE)
-                setStatusToReadAutoSpam(mail);
-              else
-                setStatusToAutoSpam(mail);
+          // set the SPAM flags, but clear the NEW and READ flags only if desired
+          if(C->SpamMarkAsRead == TRUE)
+            setStatusToReadAutoSpam(mail);
+          else
+            setStatusToAutoSpam(mail);
 
-              // move newly recognized spam to the spam folder
-              MA_MoveCopy(mail, spamfolder, "spam filter", MVCPF_QUIET);
-              wasSpam = TRUE;
+          // move newly recognized spam to the spam folder
+          if(moveBatch == NULL || MA_AddToMoveCopyBatch(moveBatch, mail, spamfolder, "spam filter", MVCPF_QUIET) == FALSE)
+            MA_MoveCopy(mail, spamfolder, "spam filter", MVCPF_QUIET);
+          wasSpam = TRUE;
 
-              // update the stats
-              result->Spam++;
-              // we just checked the mail
-              result->Checked++;
-            }
-          }
+          // update the stats
+          result->Spam++;
+          // we just checked the mail
+          result->Checked++;
         }
 
         if(noFilters == FALSE && wasSpam == FALSE)
@@ -1660,13 +2407,16 @@ void FilterMails(const struct MailList *mlist, const int mode, struct FilterResu
           result->Checked++;
 
           // now we process the search
-          FI_FilterSingleMail(filterList, mail, &matches, result);
+          FilterSingleMail(filterList, mail, &matches, result, moveBatch);
         }
 
         // we update the busy gauge and
         // see if we have to exit/abort in case it returns FALSE
         if(BusyProgress(busy, ++m, mlist->count) == FALSE)
+        {
+          aborted = TRUE;
           break;
+        }
 
         // check if some mails were deleted, moved or recognized as spam
         if((lastResult.Moved != result->Moved || lastResult.Deleted != result->Deleted || lastResult.Spam != result->Spam))
@@ -1684,6 +2434,30 @@ void FilterMails(const struct MailList *mlist, const int mode, struct FilterResu
 
     UnlockMailList(mlist);
 
+    HeaderCacheEnd();
+
+    if(moveBatch != NULL)
+    {
+      // the batch holds only mails which were filtered completely before
+      // the user possibly aborted, their other filter actions have been
+      // applied already. Hence the moves must be done as well and cannot
+      // be aborted. The batch is freed by this call.
+      struct BusyNode *moveBusy = BusyBegin(BUSY_PROGRESS);
+
+      if(aborted == TRUE)
+        D(DBF_FILTER, "filtering aborted by user, moving the mails filtered so far");
+
+      MA_ExecuteMoveCopyBatch(moveBatch, moveBusy);
+
+      BusyEnd(moveBusy);
+    }
+
+    for(m=0; m < numClassify; m++)
+      DereferenceMail(classifyMails[m]);
+
+    free(classifyMails);
+    free(classifyResults);
+
     DeleteFilterList(filterList);
 
     if(result->Checked != 0)
@@ -1790,6 +2564,8 @@ static BOOL CopySearchData(struct Search *dstSearch, struct Search *srcSearch)
   memcpy(dstSearch, srcSearch, sizeof(*dstSearch));
 
   dstSearch->bmContext = NULL;
+  dstSearch->bodyQuery = NULL;
+  dstSearch->matcher = NULL;
 
   // now we have to copy the patternList as well
   NewMinList(&dstSearch->patternList);
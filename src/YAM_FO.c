@@ -1488,6 +1488,23 @@ BOOL FO_MoveFolderDir(struct Folder *fo, struct Folder *oldfo)
     }
     else
     {
+      // the .journal file belongs to the .index file, if it cannot be
+      // moved the .index file is out of date and must be rebuilt
+      AddPath(srcbuf, oldfo->Fullpath, ".journal", sizeof(srcbuf));
+      AddPath(dstbuf, fo->Fullpath, ".journal", sizeof(dstbuf));
+      if(FileExists(srcbuf) == TRUE && MoveFile(srcbuf, dstbuf) == FALSE)
+      {
+        W(DBF_FOLDER, "failed to move file '%s' to '%s'", srcbuf, dstbuf);
+        AddPath(dstbuf, fo->Fullpath, ".index", sizeof(dstbuf));
+        DeleteFile(dstbuf);
+      }
+
+      // the body index is rebuilt on demand, so failing to move it is no error
+      AddPath(srcbuf, oldfo->Fullpath, ".bodyindex", sizeof(srcbuf));
+      AddPath(dstbuf, fo->Fullpath, ".bodyindex", sizeof(dstbuf));
+      if(FileExists(srcbuf) == TRUE && MoveFile(srcbuf, dstbuf) == FALSE)
+        W(DBF_FOLDER, "failed to move file '%s' to '%s'", srcbuf, dstbuf);
+
       // now we try to move the .fimage file aswell
       AddPath(srcbuf, oldfo->Fullpath, ".fimage", sizeof(srcbuf));
       AddPath(dstbuf, fo->Fullpath, ".fimage", sizeof(dstbuf));
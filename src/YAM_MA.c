@@ -88,6 +88,7 @@
 #include "Busy.h"
 #include "Config.h"
 #include "DynamicString.h"
+#include "FetchScheduler.h"
 #include "FileInfo.h"
 #include "FolderList.h"
 #include "HTML2Mail.h"
@@ -96,6 +97,7 @@
 #include "MailExport.h"
 #include "MailList.h"
 #include "MailServers.h"
+#include "MailThreads.h"
 #include "MethodStack.h"
 #include "MimeTypes.h"
 #include "MUIObjects.h"
@@ -106,6 +108,25 @@
 
 #include "Debug.h"
 
+// lists with at least this number of mails are moved or copied at once
+#define MOVECOPY_BATCH_MIN 32
+
+// mails which are moved or copied to the same folder
+struct MoveCopyGroup
+{
+  struct MinNode node;
+  struct Folder *to;                  // the destination folder
+  struct MailList *mails;             // the mails to be moved or copied
+  ULONG flags;                        // the MVCPF_* flags
+  char originator[SIZE_DEFAULT];      // who initiated the operation
+};
+
+// mails collected for a later move or copy operation
+struct MoveCopyBatch
+{
+  struct MinList groups;              // the mails grouped per destination
+};
+
 /* local protos */
 static void MA_MoveCopySingle(struct Mail *mail, struct Folder *to, const char *originator, const ULONG flags);
 
@@ -415,6 +436,7 @@ void MA_ChangeMailStatus(struct Mail *mail, int addflags, int clearflags)
     if(IsMainThread() == TRUE)
     {
       struct Folder *folder = mail->Folder;
+      char oldMailFile[SIZE_MFILE];
 
       // first substract the mail's old status from the folder's stats
       if(hasStatusNew(mail))
@@ -439,11 +461,14 @@ void MA_ChangeMailStatus(struct Mail *mail, int addflags, int clearflags)
       if(hasStatusSent(mail))
         folder->Sent++;
 
+      // remember the old file name for the index journal
+      strlcpy(oldMailFile, mail->MailFile, sizeof(oldMailFile));
+
       // set the comment to the Mailfile
       MA_UpdateMailFile(mail);
 
-      // flag the index as expired
-      MA_ExpireIndex(mail->Folder);
+      // record the status change in the folder's index journal
+      MA_JournalIndex(mail->Folder, IJT_STATUS, oldMailFile, mail);
 
       // update the status of the readmaildata (window)
       // of the mail here
@@ -781,6 +806,120 @@ void MA_DeleteSingle(struct Mail *mail, const ULONG delFlags)
   LEAVE();
 }
 
+///
+/// GetMoveClassification
+//  Returns the spam classification a mail gets when it is moved from one
+//  folder to another, BC_OTHER if nothing changes
+static enum BayesClassification GetMoveClassification(const struct Mail *mail, const struct Folder *from, const struct Folder *to)
+{
+  enum BayesClassification newClass = BC_OTHER;
+
+  ENTER();
+
+  if(C->SpamFilterEnabled == TRUE && C->SpamMarkOnMove == TRUE)
+  {
+    // if we are moving a (non-)spam mail out of the spam folder then this one will be marked as non-spam
+    if(isSpamFolder(from) && hasStatusSpam(mail))
+      newClass = BC_HAM;
+    // if we are moving a non-spam mail to the spam folder then this one will be marked as spam
+    else if(isSpamFolder(to) && !hasStatusSpam(mail))
+      newClass = BC_SPAM;
+  }
+
+  RETURN(newClass);
+  return newClass;
+}
+
+///
+/// ClassifyMovedMail
+//  Applies the classification obtained by GetMoveClassification() to a moved mail
+static void ClassifyMovedMail(struct Mail *mail, enum BayesClassification newClass)
+{
+  ENTER();
+
+  switch(newClass)
+  {
+    case BC_HAM:
+    {
+      BayesFilterSetClassification(mail, BC_HAM);
+      setStatusToHam(mail);
+    }
+    break;
+
+    case BC_SPAM:
+    {
+      BayesFilterSetClassification(mail, BC_SPAM);
+      setStatusToUserSpam(mail);
+    }
+    break;
+
+    default:
+      // nothing to do
+    break;
+  }
+
+  LEAVE();
+}
+
+///
+/// ReportTransferError
+//  Tells the user that a mail file could not be transferred
+static void ReportTransferError(int result, const struct Mail *mail, const struct Folder *to)
+{
+  ENTER();
+
+  E(DBF_MAIL, "transfer of mail file '%s' failed: %ld", mail->MailFile, result);
+
+  switch(result)
+  {
+    case -2:
+      ER_NewError(tr(MSG_ER_XPKUSAGE), mail->MailFile);
+    break;
+
+    default:
+      ER_NewError(tr(MSG_ER_TRANSFERMAIL), mail->MailFile, to->Name);
+    break;
+  }
+
+  LEAVE();
+}
+
+///
+/// GrantFolderAccess
+//  Temporarily grants free access to a protected folder which is not loaded
+//  yet if MVCPF_FREE_ACCESS is set, i.e. for filters moving mails into it
+static BOOL GrantFolderAccess(struct Folder *folder, const ULONG flags, enum LoadedMode *oldLoadedMode)
+{
+  BOOL granted = FALSE;
+
+  ENTER();
+
+  *oldLoadedMode = folder->LoadedMode;
+
+  if(isFlagSet(flags, MVCPF_FREE_ACCESS) && folder->LoadedMode != LM_VALID && isProtectedFolder(folder) && isFreeAccess(folder) == FALSE)
+  {
+    setFlag(folder->Flags, FOFL_FREEXS);
+    granted = TRUE;
+  }
+
+  RETURN(granted);
+  return granted;
+}
+
+///
+/// RevokeFolderAccess
+//  Revokes the access granted by GrantFolderAccess()
+static void RevokeFolderAccess(struct Folder *folder, enum LoadedMode oldLoadedMode)
+{
+  ENTER();
+
+  // moving the mails changed the folder to "loaded", restore the old state
+  folder->LoadedMode = oldLoadedMode;
+  clearFlag(folder->Flags, FOFL_FREEXS);
+
+  LEAVE();
+}
+
 ///
 /// MA_MoveCopySingle
 //  Moves or copies a single message from one folder to another
@@ -841,38 +980,11 @@ static void MA_MoveCopySingle(struct Mail *mail, struct Folder *to, const char *
       if(to == GetCurrentFolder())
         DoMethod(G->MA->GUI.PG_MAILLIST, MUIM_NList_InsertSingle, newMail, MUIV_NList_Insert_Sorted);
 
-      if(C->SpamFilterEnabled == TRUE && C->SpamMarkOnMove == TRUE)
-      {
-        if(isSpamFolder(from) && hasStatusSpam(newMail))
-        {
-          // if we are moving a (non-)spam mail out of the spam folder then this one will be marked as non-spam
-          BayesFilterSetClassification(newMail, BC_HAM);
-          setStatusToHam(newMail);
-        }
-        else if(isSpamFolder(to) && !hasStatusSpam(newMail))
-        {
-          // if we are moving a non-spam mail to the spam folder then this one will be marked as spam
-          BayesFilterSetClassification(newMail, BC_SPAM);
-          setStatusToUserSpam(newMail);
-        }
-      }
+      ClassifyMovedMail(newMail, GetMoveClassification(newMail, from, to));
     }
   }
   else
-  {
-    E(DBF_MAIL, "MA_MoveCopySingle error: %ld", result);
-
-    switch(result)
-    {
-      case -2:
-        ER_NewError(tr(MSG_ER_XPKUSAGE), mail->MailFile);
-      break;
-
-      default:
-        ER_NewError(tr(MSG_ER_TRANSFERMAIL), mail->MailFile, to->Name);
-      break;
-    }
-  }
+    ReportTransferError(result, mail, to);
 
   LEAVE();
 }
@@ -902,15 +1014,21 @@ void MA_MoveCopy(struct Mail *mail, struct Folder *tobox, const char *originator
   // if a specific mail should be moved we do it now.
   if(mail != NULL)
   {
+    enum LoadedMode oldLoadedMode;
+    BOOL accessGranted;
+
+    accessGranted = GrantFolderAccess(tobox, flags, &oldLoadedMode);
+
     selected = 1;
     MA_MoveCopySingle(mail, tobox, originator, flags);
+
+    if(accessGranted == TRUE)
+      RevokeFolderAccess(tobox, oldLoadedMode);
   }
   else if((mlist = MA_CreateMarkedList(G->MA->GUI.PG_MAILLIST, FALSE)) != NULL)
   {
     struct BusyNode *busy = NULL;
     char selectedStr[SIZE_SMALL];
-    struct MailNode *mnode;
-    ULONG i;
 
     // get the list of the currently marked mails
     selected = mlist->count;
@@ -924,18 +1042,7 @@ void MA_MoveCopy(struct Mail *mail, struct Folder *tobox, const char *originator
       BusyText(busy, tr(MSG_BusyMoving), selectedStr);
     }
 
-    i = 0;
-    ForEachMailNode(mlist, mnode)
-    {
-      MA_MoveCopySingle(mnode->mail, tobox, originator, flags);
-
-      // if BusyProgress() returns FALSE, then the user aborted
-      if(BusyProgress(busy, ++i, selected) == FALSE)
-      {
-        selected = i;
-        break;
-      }
-    }
+    selected = MA_MoveCopyMails(mlist, tobox, originator, flags, busy);
     BusyEnd(busy);
 
     set(G->MA->GUI.PG_MAILLIST, MUIA_NList_Quiet, FALSE);
@@ -968,6 +1075,247 @@ void MA_MoveCopy(struct Mail *mail, struct Folder *tobox, const char *originator
   LEAVE();
 }
 
+///
+/// MA_MoveCopyMails
+//  Moves or copies a list of messages to another folder. Short lists are
+//  handled mail by mail with all changes recorded in the index journals.
+//  For longer lists only the mail files are transferred one by one, while
+//  the folders' mail lists are updated at once and each affected index is
+//  saved just once at the end. Mails which are moved to the folder they are
+//  in already are skipped. Returns the number of moved or copied mails.
+ULONG MA_MoveCopyMails(const struct MailList *mlist, struct Folder *to, const char *originator, const ULONG flags, struct BusyNode *busy)
+{
+  ULONG processed = 0;
+  ULONG done = 0;
+  enum LoadedMode oldLoadedMode;
+  BOOL accessGranted;
+  struct MailList *transferred = NULL;
+  enum BayesClassification *newClass = NULL;
+  struct MailNode *mnode;
+
+  ENTER();
+
+  accessGranted = GrantFolderAccess(to, flags, &oldLoadedMode);
+
+  if(mlist->count < MOVECOPY_BATCH_MIN ||
+     MA_GetIndex(to) == FALSE ||
+     (transferred = CreateMailList()) == NULL ||
+     (newClass = malloc(mlist->count * sizeof(*newClass))) == NULL)
+  {
+    ForEachMailNode(mlist, mnode)
+    {
+      if(isFlagSet(flags, MVCPF_COPY) || mnode->mail->Folder != to)
+      {
+        MA_MoveCopySingle(mnode->mail, to, originator, flags);
+        processed++;
+      }
+
+      // if BusyProgress() returns FALSE, then the user aborted
+      if(BusyProgress(busy, ++done, mlist->count) == FALSE)
+        break;
+    }
+  }
+  else
+  {
+    BOOL copy = isFlagSet(flags, MVCPF_COPY);
+    ULONG i;
+
+    D(DBF_MAIL, "%s %ld mails to folder '%s' at once", copy ? "copying" : "moving", mlist->count, to->Name);
+
+    // first transfer all the mail files, same volume moves are simple renames
+    ForEachMailNode(mlist, mnode)
+    {
+      struct Mail *mail = mnode->mail;
+      struct Folder *from = mail->Folder;
+
+      if(copy == TRUE || from != to)
+      {
+        char mfile[SIZE_MFILE];
+        int result;
+
+        processed++;
+
+        strlcpy(mfile, mail->MailFile, sizeof(mfile));
+
+        if((result = TransferMailFile(copy, mail, to)) >= 0)
+        {
+          struct Mail *newMail;
+
+          if(copy == TRUE)
+          {
+            AppendToLogfile(LF_VERBOSE, 25, tr(MSG_LOG_COPY_MAIL), originator, AddrName(mail->From), mail->Subject, from->Name, to->Name);
+
+            newMail = CloneMail(mail);
+
+            // restore the old filename in case it was changed by TransferMailFile()
+            strlcpy(mail->MailFile, mfile, sizeof(mail->MailFile));
+          }
+          else
+          {
+            AppendToLogfile(LF_VERBOSE, 23, tr(MSG_LOG_MOVE_MAIL), originator, AddrName(mail->From), mail->Subject, from->Name, to->Name);
+
+            newMail = mail;
+          }
+
+          if(newMail != NULL)
+          {
+            newClass[transferred->count] = GetMoveClassification(newMail, from, to);
+            AddNewMailNode(transferred, newMail);
+          }
+        }
+        else
+          ReportTransferError(result, mail, to);
+      }
+
+      // if BusyProgress() returns FALSE, then the user aborted
+      if(BusyProgress(busy, ++done, mlist->count) == FALSE)
+        break;
+    }
+
+    if(copy == FALSE)
+    {
+      // remove the moved mails from their folders, usually they all come from
+      // the same folder. All mails of a folder lose their folder pointer while
+      // being removed, hence each folder is handled only once.
+      ForEachMailNode(transferred, mnode)
+      {
+        struct Folder *from = mnode->mail->Folder;
+
+        if(from != NULL)
+        {
+          RemoveMailsFromFolder(transferred, from, isFlagSet(flags, MVCPF_CLOSE_WINDOWS), isFlagSet(flags, MVCPF_CHECK_CONNECTIONS));
+
+          if(isModified(from))
+            MA_SaveIndex(from);
+        }
+      }
+    }
+
+    AddMailsToFolder(transferred, to, FALSE);
+
+    i = 0;
+    ForEachMailNode(transferred, mnode)
+      ClassifyMovedMail(mnode->mail, newClass[i++]);
+
+    if(to == GetCurrentFolder())
+    {
+      if(xget(G->MA->GUI.PG_MAILLIST, MUIA_MainMailListGroup_ActiveList) == LT_MAIN)
+      {
+        DoMethod(G->MA->GUI.PG_MAILLIST, MUIM_MainMailListGroup_DisplayMailsOfFolder, to);
+      }
+      else
+      {
+        ForEachMailNode(transferred, mnode)
+          DoMethod(G->MA->GUI.PG_MAILLIST, MUIM_NList_InsertSingle, mnode->mail, MUIV_NList_Insert_Sorted);
+      }
+    }
+
+    if(isModified(to))
+      MA_SaveIndex(to);
+  }
+
+  free(newClass);
+  DeleteMailList(transferred);
+
+  if(accessGranted == TRUE)
+    RevokeFolderAccess(to, oldLoadedMode);
+
+  RETURN(processed);
+  return processed;
+}
+
+///
+/// MA_CreateMoveCopyBatch
+//  Creates a batch which collects mails to be moved or copied later
+struct MoveCopyBatch *MA_CreateMoveCopyBatch(void)
+{
+  struct MoveCopyBatch *batch;
+
+  ENTER();
+
+  if((batch = calloc(1, sizeof(*batch))) != NULL)
+    NewMinList(&batch->groups);
+
+  RETURN(batch);
+  return batch;
+}
+
+///
+/// MA_AddToMoveCopyBatch
+//  Adds a mail to a batch, mails with the same destination, originator and
+//  flags are grouped. Returns FALSE if the mail could not be added, the
+//  caller should move it directly in this case.
+BOOL MA_AddToMoveCopyBatch(struct MoveCopyBatch *batch, struct Mail *mail, struct Folder *to, const char *originator, const ULONG flags)
+{
+  BOOL added = FALSE;
+  struct MoveCopyGroup *group;
+  BOOL found = FALSE;
+
+  ENTER();
+
+  IterateList(&batch->groups, struct MoveCopyGroup *, group)
+  {
+    if(group->to == to && group->flags == flags && strcmp(group->originator, originator) == 0)
+    {
+      found = TRUE;
+      break;
+    }
+  }
+
+  if(found == FALSE)
+  {
+    if((group = calloc(1, sizeof(*group))) != NULL)
+    {
+      if((group->mails = CreateMailList()) != NULL)
+      {
+        group->to = to;
+        group->flags = flags;
+        strlcpy(group->originator, originator, sizeof(group->originator));
+        AddTail((struct List *)&batch->groups, (struct Node *)&group->node);
+        found = TRUE;
+      }
+      else
+      {
+        free(group);
+      }
+    }
+  }
+
+  if(found == TRUE && AddNewMailNode(group->mails, mail) != NULL)
+    added = TRUE;
+
+  RETURN(added);
+  return added;
+}
+
+///
+/// MA_ExecuteMoveCopyBatch
+//  Moves or copies all mails of a batch group by group and frees the batch
+void MA_ExecuteMoveCopyBatch(struct MoveCopyBatch *batch, struct BusyNode *busy)
+{
+  struct MoveCopyGroup *group;
+  struct MoveCopyGroup *next;
+
+  ENTER();
+
+  SafeIterateList(&batch->groups, struct MoveCopyGroup *, group, next)
+  {
+    char numStr[SIZE_SMALL];
+
+    snprintf(numStr, sizeof(numStr), "%ld", group->mails->count);
+    BusyText(busy, tr(MSG_BusyMoving), numStr);
+
+    MA_MoveCopyMails(group->mails, group->to, group->originator, group->flags, busy);
+
+    DeleteMailList(group->mails);
+    free(group);
+  }
+
+  free(batch);
+
+  LEAVE();
+}
+
 ///
 /// MA_ToStatusHeader
 // Function that converts the current flags of a message
@@ -1139,38 +1487,38 @@ unsigned int MA_FromXStatusHeader(char *xstatusflags)
 /*** Mail Thread Nagivation ***/
 /// FindThreadInFolder
 // Find the next/prev message in a thread within one folder
-struct Mail *FindThreadInFolder(const struct Mail *srcMail, const struct Folder *folder, const BOOL nextThread)
+struct Mail *FindThreadInFolder(const struct Mail *srcMail, struct Folder *folder, const BOOL nextThread)
 {
   struct Mail *result = NULL;
-  struct MailNode *mnode;
+  struct MailThread *thread;
 
   ENTER();
 
-  LockMailListShared(folder->messages);
+  // the threads might have to be loaded first, so we need
+  // exclusive access to the mail list
+  LockMailList(folder->messages);
 
-  ForEachMailNode(folder->messages, mnode)
+  // the srcMail's message is known to the folder if any of its mails
+  // refers to it, even if the srcMail itself belongs to another folder
+  if((thread = MailThreadsFind(folder, srcMail->cMsgID)) != NULL)
   {
-    struct Mail *mail = mnode->mail;
-
     if(nextThread == TRUE)
     {
       // find the answer to the srcMail
-      if(mail->cIRTMsgID != 0 && mail->cIRTMsgID == srcMail->cMsgID)
-      {
-        result = mail;
-        break;
-      }
+      result = MailThreadsGetFirstReply(thread);
     }
     else
     {
       // else we have to find the question to the srcMail
-      if(mail->cMsgID != 0 && mail->cMsgID == srcMail->cIRTMsgID)
-      {
-        result = mail;
-        break;
-      }
+      result = MailThreadsGetParentMail(thread);
     }
   }
+  else if(nextThread == FALSE && (thread = MailThreadsFind(folder, srcMail->cIRTMsgID)) != NULL)
+  {
+    // the question might be part of this folder even if the srcMail's
+    // references are unknown
+    result = (thread->mail != NULL) ? thread->mail : MailThreadsGetParentMail(thread);
+  }
 
   UnlockMailList(folder->messages);
 
@@ -2249,7 +2597,7 @@ void MA_GetAddress(struct MailList *mlist, struct MUI_NListtree_TreeNode *dropTa
   BOOL isSentFolder = (folder != NULL) ? isSentMailFolder(folder) : FALSE;
   BOOL isMLFolder = (folder != NULL) ? folder->MLSupport : FALSE;
   struct ExtendedMail *email;
-  struct Person *pe = NULL;
+  const struct MailPerson *pe = NULL;
   struct ABookNode abn;
 
   ENTER();
@@ -2463,9 +2811,28 @@ BOOL ReceiveMailsFromPOP(struct MailServerNode *msn, const ULONG flags, struct D
   return success;
 }
 
+///
+/// PopNowFromServer
+//  Fetches new mail from a single POP3 account
+static BOOL PopNowFromServer(struct MailServerNode *msn, const ULONG flags, struct DownloadResult *dlResult)
+{
+  BOOL success;
+
+  ENTER();
+
+  if(dlResult == NULL && isFlagClear(flags, RECEIVEF_SIGNAL))
+    success = ScheduleMailFetch(msn, flags);
+  else
+    success = ReceiveMailsFromPOP(msn, flags, dlResult);
+
+  RETURN(success);
+  return success;
+}
+
 ///
 /// MA_PopNow
-//  Fetches new mail from POP3 account(s)
+//  Fetches new mail from POP3 account(s). The downloads are started by the
+//  fetch scheduler, unless the caller is waiting for the download result.
 BOOL MA_PopNow(struct MailServerNode *msn, const ULONG flags, struct DownloadResult *dlResult)
 {
   BOOL success = FALSE;
@@ -2497,7 +2864,7 @@ BOOL MA_PopNow(struct MailServerNode *msn, const ULONG flags, struct DownloadRes
         // download mails from this server if this either is no startup action
         // or "download on startup" is enabled
         if(isFlagClear(flags, RECEIVEF_STARTUP) || hasServerDownloadOnStartup(msn) == TRUE)
-          success &= ReceiveMailsFromPOP(msn, flags, dlResult);
+          success &= PopNowFromServer(msn, flags, dlResult);
       }
       else
         W(DBF_NET, "POP3 server of identity '%s' is inactive'", msn->description);
@@ -2506,7 +2873,7 @@ BOOL MA_PopNow(struct MailServerNode *msn, const ULONG flags, struct DownloadRes
   else
   {
     // we ignore the active state and possible startup flags for single servers
-    success = ReceiveMailsFromPOP(msn, flags, dlResult);
+    success = PopNowFromServer(msn, flags, dlResult);
   }
 
   // now we are done
@@ -3233,7 +3600,7 @@ void MA_ChangeSubject(struct Mail *mail, char *subj)
           mail->Size = -1;
 
         AppendToLogfile(LF_ALL, 82, tr(MSG_LOG_ChangingSubject), mail->Subject, mail->MailFile, fo->Name, subj);
-        strlcpy(mail->Subject, subj, sizeof(mail->Subject));
+        SetMailSubject(mail, subj);
         MA_ExpireIndex(fo);
 
         if(fo->Mode > FM_SIMPLE)
@@ -3319,11 +3686,11 @@ MakeHook(MA_ChangeSubjectHook, MA_ChangeSubjectFunc);
 ///
 /// MA_GetRealSubject
 //  Strips reply prefix / mailing list name from subject
-char *MA_GetRealSubject(char *sub)
+const char *MA_GetRealSubject(const char *sub)
 {
-  char *p;
+  const char *p;
   int sublen;
-  char *result = sub;
+  const char *result = sub;
 
   ENTER();
 
@@ -3333,7 +3700,7 @@ char *MA_GetRealSubject(char *sub)
   {
     if(sub[2] == ':' && !sub[3])
     {
-      result = (char *)"";
+      result = "";
     }
     // check if the subject contains some strings embedded in brackets like [test]
     // and return only the real subject after the last bracket.
@@ -63,6 +63,7 @@
 #include "mui/MainMailListGroup.h"
 #include "mui/QuickSearchBar.h"
 #include "mui/ReadMailGroup.h"
+#include "mui/YAMApplication.h"
 #include "mime/base64.h"
 #include "mime/rfc2047.h"
 
@@ -72,12 +73,17 @@
 #include "DynamicString.h"
 #include "FileInfo.h"
 #include "FolderList.h"
+#include "HashTable.h"
 #include "Locale.h"
 #include "MailList.h"
+#include "MailThreads.h"
+#include "MethodStack.h"
 #include "MUIObjects.h"
 #include "Requesters.h"
 #include "Rexx.h"
 #include "Signature.h"
+#include "StringPool.h"
+#include "Threads.h"
 #include "UserIdentity.h"
 
 #include "Debug.h"
@@ -127,6 +133,7 @@ struct ComprMail
   // 6. line: 'reply-to' address
   // 7. line: 'reply-to' realname
   // 8. line: hostname of server this mail was transfered to/from
+  // 9. line: the full message ID
   //
   // NOTE: removing/changing any of the above information in the 'moreBytes'
   // area requires a version bump in FINDEX_VER so that an index rescan is
@@ -134,7 +141,7 @@ struct ComprMail
   // without bumping the index because the routines in LoadIndex() take care
   // of that.
 
-  #define COMPRMAIL_MORELINES 8
+  #define COMPRMAIL_MORELINES 9
 };
 
 /*
@@ -158,10 +165,196 @@ struct FIndex
 // need to increase this version ID!
 #define FINDEX_VER  (MAKE_ID('Y','I','N','8'))
 
+/*
+** structure of a fixed-stride mail record
+**
+** Unlike struct ComprMail this record has a fixed size. All strings are
+** kept in a separate heap following the record array and are referenced by
+** their offset within that heap. Equal strings (i.e. the same sender
+** address in thousands of mails) are stored only once.
+**
+** DO NOT CHANGE ALIGNMENT here or the .index
+** files of a folder will be corrupt !
+**
+*/
+struct StrideMail
+{
+  char             mailFile[SIZE_MFILE]; // mail filename without path
+  struct DateStamp date;                 // the creation date of the mail (UTC)
+  struct TimeVal   transDate;            // the received/sent date with ms (UTC)
+  unsigned int     sflags;               // mail status flags
+  unsigned int     mflags;               // general mail flags
+  unsigned long    cMsgID;               // compressed MessageID
+  unsigned long    cIRTMsgID;            // compressed InReturnTo MessageID
+  long             size;                 // the total size of the message
+  ULONG            strings[COMPRMAIL_MORELINES]; // heap offsets of the strings, same order
+                                                 // as the 'moreBytes' lines of struct ComprMail
+};
+
+/*
+** structure of the fixed-stride Folder Index
+**
+** The file consists of this header, followed by 'recordCount' records of
+** struct StrideMail and finally the UTF8 encoded string heap of 'heapSize'
+** bytes. Offset 0 of the heap is always the empty string.
+**
+** The leading struct FIndex is shared with the FINDEX_VER format, so the
+** folder statistics can be read without knowing the actual format.
+**
+** DO NOT CHANGE ALIGNMENT here or the .index
+** files of a folder will be corrupt !
+**
+*/
+struct FIndexHeap
+{
+  struct FIndex fi;   // common index header (fi.ID == FINDEX_HEAP_VER)
+  ULONG recordSize;   // size of a single record (sizeof(struct StrideMail))
+  ULONG recordCount;  // number of records following the header
+  ULONG heapSize;     // size of the string heap following the records
+};
+
+// whenever you change something up there (in FIndexHeap or StrideMail) you
+// need to increase this version ID!
+#define FINDEX_HEAP_VER (MAKE_ID('Y','I','N','A'))
+
+/*
+** structure of a record of the Folder Index journal
+**
+** The .journal file of a folder starts with the FJOURNAL_VER ID followed
+** by any number of these records. Each record describes a single change
+** which happened after the .index file was saved. Records of type IJT_ADD
+** are followed by 'cmail.moreBytes' bytes of strings, just like in the
+** FINDEX_VER format.
+**
+** DO NOT CHANGE ALIGNMENT here or the .journal
+** files of a folder will be corrupt !
+**
+*/
+struct FJournalRecord
+{
+  ULONG            type;                 // type of change (enum IndexJournalType)
+  char             mailFile[SIZE_MFILE]; // mail filename before the change
+  int              Total;                // number of total mails after the change
+  int              New;                  // number of new mails after the change
+  int              Unread;               // number of unread mails after the change
+  int              Size;                 // size of folder after the change
+  struct ComprMail cmail;                // the mail's data after the change
+};
+
+// whenever you change something up there (in FJournalRecord) you
+// need to increase this version ID!
+#define FJOURNAL_VER (MAKE_ID('Y','J','N','1'))
+
 #include "default-align.h"
 
+// the number of journal records after which the index is rewritten
+#define FJOURNAL_LIMIT 256
+// the maximum size of the strings following a journal record
+#define FJOURNAL_STRINGS_SIZE (4*SIZE_LARGE)
+
+// an already converted string of the heap of a FINDEX_HEAP_VER index
+struct IndexHeapString
+{
+  struct HashEntryHeader hash; // standard hash table header
+  IPTR offset;                 // the offset of the string within the heap
+  char *string;                // the string converted to the local charset
+};
+
+// a string of the heap of a FINDEX_HEAP_VER index to be saved
+struct IndexSaveString
+{
+  struct HashEntryHeader hash; // standard hash table header
+  char *string;                // the string in the local charset
+  ULONG offset;                // the offset of the string within the heap
+};
+
+// the string heap of a FINDEX_HEAP_VER index while it is being built
+struct IndexHeap
+{
+  char *buffer;                // the heap data
+  ULONG size;                  // the allocated size of the buffer
+  ULONG used;                  // the number of bytes used so far
+};
+
+// a mail of a folder while the index journal is replayed
+struct JournalMail
+{
+  struct HashEntryHeader hash; // standard hash table header
+  char *mailFile;              // the mail's file name
+  struct MailNode *mnode;      // the mail's node in the folder's mail list
+};
+
+// the number of threads examining mail files while a folder is scanned
+#define SCAN_THREADS 4
+// the minimum number of mail files per thread to make it worth starting it
+#define SCAN_FILES_PER_THREAD 16
+
+// the maximum length of a single header line of a mail stream, the rest of
+// longer lines is dropped (RFC 5322 limits lines to 998 characters)
+#define MAILSTREAM_MAX_LINE (64*1024L)
+
+// a mail file found while a folder is scanned
+struct ScanMailFile
+{
+  struct Folder *folder;       // the folder the file belongs to
+  char fileName[SIZE_MFILE];   // the file name
+  struct Mail *mail;           // the examined mail, NULL if the file could not be examined
+};
+
+// the shared state of the threads examining the mail files of scanned folders
+struct ScanMailBoxData
+{
+  struct ScanMailFile *files;   // the files to be examined
+  ULONG numFiles;               // the number of files
+  ULONG maxFiles;               // the allocated number of files
+  struct BusyNode *busy;        // the progress gauge
+};
+
+// the states of a folder index which is loaded in the background
+enum IndexPreloadState
+{
+  IPS_QUEUED = 0,              // the index waits to be loaded
+  IPS_LOADING,                 // the index is being loaded right now
+  IPS_DONE                     // loading finished, successfully or not
+};
+
+// a folder whose index is loaded in the background
+struct IndexPreload
+{
+  struct MinNode node;         // to be placed in the preloader's queue
+  struct Folder *folder;       // the folder to be loaded
+  struct Folder *tempFolder;   // the loaded mails
+  ULONG indexDate;             // the date of the folder's .index file
+  enum IndexPreloadState state;
+  BOOL loaded;                 // TRUE if the index was loaded without problems
+  BOOL legacyFormat;           // TRUE if the index has the old format
+  BOOL tornJournal;            // TRUE if the journal ends with an incomplete record
+};
+
+// a task waiting for the thread preloading indexes
+struct IndexPreloadWaiter
+{
+  struct MinNode node;         // to be placed in the preloader's list of waiters
+  struct Task *task;           // the waiting task
+  ULONG mask;                  // the signal to wake up the task
+};
+
+// the shared state of the main thread and the thread preloading indexes
+struct IndexPreloader
+{
+  struct SignalSemaphore *lock; // protects everything below
+  struct MinList queue;         // the folders to be loaded, highest priority first
+  struct MinList waiters;       // the tasks to be signalled when a folder is done
+  BOOL running;                 // TRUE as long as the thread is working
+  BOOL stop;                    // TRUE if the thread should stop as soon as possible
+};
+
+// the preloader started after the folders have been set up
+static struct IndexPreloader *preloader = NULL;
+
 /* local protos */
 static BOOL MA_ScanMailBox(struct Folder *folder);
+static BOOL ScanMailBoxes(struct Folder **folders, BOOL *results, ULONG numFolders);
 
 /***************************************************************************
  Module: Main - Folder handling
@@ -267,400 +460,458 @@ static void MA_ValidateStatus(struct Folder *folder)
 }
 
 ///
-/// MA_LoadIndex
-//  Loads a folder index from disk
-enum LoadedMode MA_LoadIndex(struct Folder *folder, BOOL full)
+/// ComprMailToMail
+//  Copies the data of a struct ComprMail to a mail. If 'moreBytes' is not
+//  NULL it must point to the already converted linefeed separated strings
+//  which will be split up. Note that this modifies the string.
+static void ComprMailToMail(struct Mail *mail, const struct ComprMail *cmail, char *moreBytes)
 {
-  char indexFileName[SIZE_PATHFILE];
-  ULONG indexFileSize;
-  enum LoadedMode indexloaded = LM_UNLOAD;
-  BOOL corrupt = FALSE;
-  BOOL error = FALSE;
-
   ENTER();
 
-  D(DBF_FOLDER, "Loading index for folder '%s'", folder->Name);
-
-  AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
-
-  // Check the size of the index file. Even an empty folder has an index
-  // file with a size of at least sizeof(struct FIndex).
-  if(ObtainFileInfo(indexFileName, FI_SIZE, &indexFileSize) == TRUE && indexFileSize >= sizeof(struct FIndex))
+  if(moreBytes != NULL)
   {
-    FILE *fh;
+    char *line = moreBytes;
+    char *nextLine;
+    int lineNr = 0;
 
-    if((fh = fopen(indexFileName, "r")) != NULL)
+    do
     {
-      struct BusyNode *busy;
-      struct FIndex fi;
+      if((nextLine = strchr(line, '\n')) != NULL)
+        *nextLine++ = '\0';
 
-      setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
+      lineNr++;
 
-      busy = BusyBegin(BUSY_TEXT);
-      BusyText(busy, tr(MSG_BusyLoadingIndex), folder->Name);
-      if(fread(&fi, sizeof(fi), 1, fh) != 1)
-      {
-        E(DBF_FOLDER, "error while loading struct FIndex from .index file");
-        error = TRUE;
-      }
-      else if(fi.ID == FINDEX_VER)
+      switch(lineNr)
       {
-        folder->Total  = fi.Total;
-        folder->New    = fi.New;
-        folder->Unread = fi.Unread;
-        folder->Size   = fi.Size;
-        indexloaded = LM_FLUSHED;
+        case 1:
+          SetMailSubject(mail, line);
+        break;
 
-        if(full == TRUE)
+        case 2:
+          SetPooledString(&mail->From.Address, line, SIZE_ADDRESS);
+        break;
+
+        case 3:
+          SetPooledString(&mail->From.RealName, line, SIZE_REALNAME);
+        break;
+
+        case 4:
+          SetPooledString(&mail->To.Address, line, SIZE_ADDRESS);
+        break;
+
+        case 5:
+          SetPooledString(&mail->To.RealName, line, SIZE_REALNAME);
+        break;
+
+        case 6:
+          SetPooledString(&mail->ReplyTo.Address, line, SIZE_ADDRESS);
+        break;
+
+        case 7:
+          SetPooledString(&mail->ReplyTo.RealName, line, SIZE_REALNAME);
+        break;
+
+        case 8:
+          SetPooledString(&mail->MailAccount, line, SIZE_DEFAULT);
+        break;
+
+        case 9:
         {
-          struct Folder *tempFolder;
+          free(mail->MsgID);
+          mail->MsgID = (line[0] != '\0') ? strdup(line) : NULL;
+        }
+        break;
+      }
 
-          ClearFolderMails(folder, TRUE);
+      line = nextLine;
+    }
+    while(line != NULL && lineNr < COMPRMAIL_MORELINES);
+  }
 
-          // allocate a temporary folder structure to avoid having to lock the real folder's
-          // mail list for each single mail we get from the index
-          if((tempFolder = AllocFolder()) != NULL)
-          {
-            BOOL systemIsUTF8 = (G->systemCodeset != NULL && G->systemCodeset->name != NULL && stricmp(G->systemCodeset->name, "utf-8") == 0);
+  mail->mflags = cmail->mflags;
+  mail->sflags = cmail->sflags;
+  // we have to make sure that the volatile flag field isn't loaded
+  setVOLValue(mail, 0);
+  strlcpy(mail->MailFile, cmail->mailFile, sizeof(mail->MailFile));
+  mail->Date = cmail->date;
+  mail->transDate = cmail->transDate;
+  mail->cMsgID = cmail->cMsgID;
+  mail->cIRTMsgID = cmail->cIRTMsgID;
+  mail->Size = cmail->size;
 
-            do
-            {
-              struct Mail *mail;
-              struct ComprMail cmail;
-              char utf8buf[SIZE_LARGE];
-              char *buf;
-              char *line;
-              char *nextLine;
-              int lineNr;
-
-              if(fread(&cmail, sizeof(struct ComprMail), 1, fh) != 1)
-              {
-                // check if we are here because of an error or EOF
-                if(ferror(fh) != 0 || feof(fh) == 0)
-                {
-                  E(DBF_FOLDER, "error while loading ComprMail struct from .index file");
-                  error = TRUE;
-                }
+  LEAVE();
+}
 
-                // if we end up here it is just a EOF and no error.
-                break;
-              }
+///
+/// FreeIndexHeapString
+//  HashTableEnumerate() callback to free the converted heap strings
+static enum HashTableOperator FreeIndexHeapString(UNUSED struct HashTable *table,
+                                                  struct HashEntryHeader *entry,
+                                                  UNUSED ULONG number,
+                                                  UNUSED void *arg)
+{
+  struct IndexHeapString *hstr = (struct IndexHeapString *)entry;
 
-              if(cmail.moreBytes > sizeof(utf8buf)-1)
-              {
-                ER_NewError(tr(MSG_ER_INDEX_CORRUPTED), indexFileName, folder->Name, ftell(fh), cmail.mailFile, cmail.moreBytes);
-                corrupt = TRUE;
-                break;
-              }
+  ENTER();
 
-              // read the moreBytes data
-              if(fread(utf8buf, cmail.moreBytes, 1, fh) != 1)
-              {
-                E(DBF_FOLDER, "fread error while reading index file");
-                error = TRUE;
-                break;
-              }
+  CodesetsFreeA(hstr->string, NULL);
+  hstr->string = NULL;
 
-              // make sure to NUL terminate the utf8 string
-              utf8buf[cmail.moreBytes] = '\0';
+  RETURN(htoNext);
+  return htoNext;
+}
 
-              if(systemIsUTF8 == TRUE)
-              {
-                // no conversion required
-                buf = utf8buf;
-			  }
-			  else
-			  {
-                // convert the utf8 encoded buffer to the local charset
-                if((buf = CodesetsUTF8ToStr(CSA_Source,          utf8buf,
-                                            CSA_SourceLen,       cmail.moreBytes,
-                                            CSA_DestCodeset,     G->systemCodeset,
-                                            CSA_MapForeignChars, C->MapForeignChars,
-                                            TAG_DONE)) == NULL)
-                {
-                  E(DBF_FOLDER, "error while converting UTF8 data to local charset");
-                  error = TRUE;
-                  break;
-                }
-              }
+///
+/// GetIndexHeapString
+//  Returns a string of the heap of a FINDEX_HEAP_VER index in the local charset.
+//  Each distinct string is converted only once, further requests for the same
+//  heap offset are answered from the given cache.
+static const char *GetIndexHeapString(const char *heap, ULONG offset, struct HashTable *cache)
+{
+  const char *string = NULL;
 
-              // create a new mail structure
-              if((mail = AllocMail()) != NULL)
-              {
-                line = buf;
-                lineNr = 0;
-                do
-                {
-                  if((nextLine = strchr(line, '\n')) != NULL)
-                    *nextLine++ = '\0';
+  ENTER();
 
-                  lineNr++;
+  if(cache == NULL)
+  {
+    // no conversion required
+    string = &heap[offset];
+  }
+  else
+  {
+    struct HashEntryHeader *entry;
 
-                  switch(lineNr)
-                  {
-                    case 1:
-                      strlcpy(mail->Subject, line, sizeof(mail->Subject));
-                    break;
+    if((entry = HashTableOperate(cache, (void *)offset, htoAdd)) != NULL)
+    {
+      struct IndexHeapString *hstr = (struct IndexHeapString *)entry;
+
+      if(hstr->string == NULL)
+      {
+        // this offset was not seen yet, convert the utf8 string to the local charset
+        hstr->offset = offset;
+        if((hstr->string = CodesetsUTF8ToStr(CSA_Source,          &heap[offset],
+                                             CSA_DestCodeset,     G->systemCodeset,
+                                             CSA_MapForeignChars, C->MapForeignChars,
+                                             TAG_DONE)) == NULL)
+        {
+          E(DBF_FOLDER, "error while converting UTF8 data to local charset");
+          HashTableRawRemove(cache, entry);
+        }
+      }
+
+      string = hstr->string;
+    }
+  }
+
+  RETURN(string);
+  return string;
+}
 
-                    case 2:
-                      strlcpy(mail->From.Address, line, sizeof(mail->From.Address));
-                    break;
+///
+/// LoadIndexHeapMails
+//  Loads the mails of a FINDEX_HEAP_VER index. The records and the string
+//  heap are read in one go and the mails are added to the given temporary
+//  folder. Returns FALSE in case of a read error and sets 'corrupt' in case
+//  of inconsistent data.
+static BOOL LoadIndexHeapMails(FILE *fh, const char *indexFileName, ULONG indexFileSize, struct Folder *folder, struct Folder *tempFolder, BOOL *corrupt)
+{
+  BOOL success = FALSE;
+  struct FIndexHeap fih;
+
+  ENTER();
+
+  // read the complete header again, the common part was read already
+  if(fseek(fh, 0, SEEK_SET) != 0 || fread(&fih, sizeof(fih), 1, fh) != 1)
+  {
+    E(DBF_FOLDER, "error while loading struct FIndexHeap from .index file");
+  }
+  else if(fih.recordSize != sizeof(struct StrideMail) || fih.heapSize == 0 ||
+          indexFileSize < sizeof(fih) ||
+          fih.heapSize > indexFileSize - sizeof(fih) ||
+          fih.recordCount > (indexFileSize - sizeof(fih) - fih.heapSize) / fih.recordSize ||
+          indexFileSize != sizeof(fih) + fih.recordCount * fih.recordSize + fih.heapSize)
+  {
+    // each size of the header is checked against the file size before they are
+    // combined, so a corrupted header cannot overflow the calculation
+    E(DBF_FOLDER, "index file '%s' has inconsistent sizes: records %ld*%ld, heap %ld, file %ld", indexFileName, fih.recordCount, fih.recordSize, fih.heapSize, indexFileSize);
+    *corrupt = TRUE;
+    success = TRUE;
+  }
+  else
+  {
+    ULONG dataSize = indexFileSize - sizeof(fih);
+    char *data;
 
-                    case 3:
-                      strlcpy(mail->From.RealName, line, sizeof(mail->From.RealName));
-                    break;
+    // read all records and the string heap with a single call instead of
+    // doing lots of small reads
+    if((data = malloc(dataSize)) != NULL)
+    {
+      if(fread(data, dataSize, 1, fh) == 1)
+      {
+        struct StrideMail *records = (struct StrideMail *)data;
+        const char *heap = &data[fih.recordCount * fih.recordSize];
 
-                    case 4:
-                      strlcpy(mail->To.Address, line, sizeof(mail->To.Address));
-                    break;
+        // the heap must end with a NUL byte, otherwise the last string is not terminated
+        if(heap[fih.heapSize-1] != '\0')
+        {
+          E(DBF_FOLDER, "string heap of index file '%s' is not terminated", indexFileName);
+          *corrupt = TRUE;
+          success = TRUE;
+        }
+        else
+        {
+          BOOL systemIsUTF8 = (G->systemCodeset != NULL && G->systemCodeset->name != NULL && stricmp(G->systemCodeset->name, "utf-8") == 0);
+          struct HashTable *cache = NULL;
 
-                    case 5:
-                      strlcpy(mail->To.RealName, line, sizeof(mail->To.RealName));
-                    break;
+          // a cache for the converted strings is needed only if the system
+          // does not use UTF8 itself
+          if(systemIsUTF8 == TRUE || (cache = HashTableNew(HashTableGetDefaultOps(), NULL, sizeof(struct IndexHeapString), 512)) != NULL)
+          {
+            ULONG i;
 
-                    case 6:
-                      strlcpy(mail->ReplyTo.Address, line, sizeof(mail->ReplyTo.Address));
-                    break;
+            success = TRUE;
 
-                    case 7:
-                      strlcpy(mail->ReplyTo.RealName, line, sizeof(mail->ReplyTo.RealName));
-                    break;
+            for(i=0; i < fih.recordCount; i++)
+            {
+              struct StrideMail *smail = &records[i];
+              const char *strings[COMPRMAIL_MORELINES];
+              struct Mail *mail;
+              int j;
 
-                    case 8:
-                      strlcpy(mail->MailAccount, line, sizeof(mail->MailAccount));
-                    break;
-                  }
+              for(j=0; j < COMPRMAIL_MORELINES; j++)
+              {
+                if(smail->strings[j] >= fih.heapSize)
+                {
+                  ER_NewError(tr(MSG_ER_INDEX_CORRUPTED), indexFileName, folder->Name, sizeof(fih) + i * fih.recordSize, smail->mailFile, smail->strings[j]);
+                  *corrupt = TRUE;
+                  break;
+                }
 
-                  line = nextLine;
+                // the message ID is plain ASCII and unique per mail, so don't waste the cache on it
+                if((strings[j] = GetIndexHeapString(heap, smail->strings[j], j < COMPRMAIL_MORELINES-1 ? cache : NULL)) == NULL)
+                {
+                  success = FALSE;
+                  break;
                 }
-                while(line != NULL && lineNr < COMPRMAIL_MORELINES);
+              }
+
+              if(*corrupt == TRUE || success == FALSE)
+                break;
 
-                mail->mflags = cmail.mflags;
-                mail->sflags = cmail.sflags;
+              // create a new mail structure
+              if((mail = AllocMail()) != NULL)
+              {
+                SetMailSubject(mail, strings[0]);
+                SetMailPerson(&mail->From, strings[1], strings[2]);
+                SetMailPerson(&mail->To, strings[3], strings[4]);
+                SetMailPerson(&mail->ReplyTo, strings[5], strings[6]);
+                SetPooledString(&mail->MailAccount, strings[7], SIZE_DEFAULT);
+                if(strings[8][0] != '\0')
+                  mail->MsgID = strdup(strings[8]);
+
+                mail->mflags = smail->mflags;
+                mail->sflags = smail->sflags;
                 // we have to make sure that the volatile flag field isn't loaded
                 setVOLValue(mail, 0);
-                strlcpy(mail->MailFile, cmail.mailFile, sizeof(mail->MailFile));
-                mail->Date = cmail.date;
-                mail->transDate = cmail.transDate;
-                mail->cMsgID = cmail.cMsgID;
-                mail->cIRTMsgID = cmail.cIRTMsgID;
-                mail->Size = cmail.size;
-
-                // finally add the new mail structure to the temporary folder
-                // no message list locking or index expiring is necessary here,
-                // because it is a temporary folder which is not publically known
+                strlcpy(mail->MailFile, smail->mailFile, sizeof(mail->MailFile));
+                mail->Date = smail->date;
+                mail->transDate = smail->transDate;
+                mail->cMsgID = smail->cMsgID;
+                mail->cIRTMsgID = smail->cIRTMsgID;
+                mail->Size = smail->size;
+
+                // add the new mail structure to the temporary folder and set
+                // the mail's folder pointer to the correct current folder
+                // afterwards, see MA_LoadIndex() for details
                 AddMailToFolderSimple(mail, tempFolder);
-
-                // the AddMailToFolderSimple() call set the mail's folder pointer to the
-                // temporary folder. But since this is a temporary one only and will be
-                // invalid after leaving this function we must set the mail's folder
-                // pointer to the correct current folder.
                 mail->Folder = folder;
               }
               else
-                error = TRUE;
-
-              if(systemIsUTF8 == FALSE)
               {
-                // free the codesets buffer
-                CodesetsFreeA(buf, NULL);
+                success = FALSE;
+                break;
               }
             }
-            while(error == FALSE);
-          }
 
-          // if everything went well then move all mails from the temporary folder
-          // to the real folder
-          if(error == FALSE)
-            MoveFolderContents(folder, tempFolder);
-
-          // free the temporary folder in any case
-          FreeFolder(tempFolder);
+            if(cache != NULL)
+            {
+              HashTableEnumerate(cache, FreeIndexHeapString, NULL);
+              HashTableDestroy(cache);
+            }
+          }
         }
       }
+      else
+        E(DBF_FOLDER, "fread error while reading index file");
 
-      if(ferror(fh) != 0)
-      {
-        E(DBF_FOLDER, "ferror() returned != 0");
-        error = TRUE;
-      }
-
-      BusyEnd(busy);
-      fclose(fh);
-    }
-    else if(errno != ENOENT)
-    {
-      E(DBF_FOLDER, "fopen() on '%s' failed.", indexFileName);
-      error = TRUE;
+      free(data);
     }
   }
-  else
-  {
-    E(DBF_FOLDER, "index file '%s' of folder '%s' has invalid size %ld (minimum required %ld)", indexFileName, folder->Name, indexFileSize, sizeof(struct FIndex));
-    // report this index file as corrupted if it is smaller than the required minimum size, but not empty
-    if(indexFileSize > 0)
-      corrupt = TRUE;
-  }
 
-  // in case an error occurred we report it
-  // to the user
-  if(error == TRUE)
-  {
-    E(DBF_FOLDER, "error %ld occurred while trying to load the index file '%s'", errno, indexFileName);
-    ClearFolderMails(folder, TRUE);
-    indexloaded = LM_UNLOAD;
+  RETURN(success);
+  return success;
+}
 
-    // report failure
-    ER_NewError(tr(MSG_ER_CANNOT_READ_INDEX), indexFileName, folder->Name);
-  }
-  else if(corrupt == TRUE || indexloaded == LM_UNLOAD)
-  {
-    W(DBF_FOLDER, "%s .index file '%s' detected, %s", corrupt ? "corrupt" : "missing",
-                                                      indexFileName,
-                                                      full ? "rebuilding..." : "skipping...");
+///
+/// CountMailStats
+//  Adds (delta > 0) or subtracts (delta < 0) a mail to/from a folder's statistics
+static void CountMailStats(struct Folder *folder, const struct Mail *mail, int delta)
+{
+  ENTER();
 
-    // clear the mail list of the folder
-    ClearFolderMails(folder, TRUE);
+  folder->Total += delta;
+  folder->Size += delta * mail->Size;
 
-    // if the "full" mode was requested we make sure we
-    // rescan the index accordingly
-    if(full == TRUE)
-    {
-      // rebuild the index (rescanning the mailbox directory)
-      if(MA_ScanMailBox(folder) == TRUE && MA_SaveIndex(folder) == TRUE)
-        indexloaded = LM_VALID;
-    }
-  }
-  else if(full == TRUE)
-  {
-    indexloaded = LM_VALID;
-    clearFlag(folder->Flags, FOFL_MODIFY);
-  }
+  if(hasStatusNew(mail))
+    folder->New += delta;
 
-  RETURN(indexloaded);
-  return indexloaded;
+  if(!hasStatusRead(mail))
+    folder->Unread += delta;
+
+  if(hasStatusSent(mail))
+    folder->Sent += delta;
+
+  LEAVE();
 }
 
 ///
-/// MA_SaveIndex
-//  Saves a folder index to disk
-BOOL MA_SaveIndex(struct Folder *folder)
+/// AddJournalMail
+//  Adds a mail node to the hash table used during replaying an index journal
+static BOOL AddJournalMail(struct HashTable *mailTable, struct MailNode *mnode)
 {
   BOOL success = FALSE;
-  char indexFileName[SIZE_PATHFILE];
-  FILE *fh;
+  struct HashEntryHeader *entry;
 
   ENTER();
 
-  D(DBF_FOLDER, "save index of folder '%s'", folder->Name);
+  if((entry = HashTableOperate(mailTable, mnode->mail->MailFile, htoAdd)) != NULL)
+  {
+    struct JournalMail *jmail = (struct JournalMail *)entry;
 
-  AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
+    if((jmail->mailFile = strdup(mnode->mail->MailFile)) != NULL)
+    {
+      jmail->mnode = mnode;
+      success = TRUE;
+    }
+    else
+      HashTableRawRemove(mailTable, entry);
+  }
 
-  if((fh = fopen(indexFileName, "w")) != NULL)
-  {
-    struct BusyNode *busy;
-    struct FIndex fi;
-    struct MailNode *mnode;
+  RETURN(success);
+  return success;
+}
 
-    setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
+///
+/// ApplyJournalRecord
+//  Applies a single index journal record to the mails loaded into the
+//  temporary folder. Changes which are already part of the index (i.e.
+//  because the journal could not be deleted after saving the index) are
+//  skipped.
+static BOOL ApplyJournalRecord(struct Folder *folder, struct Folder *tempFolder, struct HashTable *mailTable, struct FJournalRecord *jr, char *utf8buf, BOOL systemIsUTF8)
+{
+  BOOL success = TRUE;
+  struct HashEntryHeader *entry;
+  struct MailNode *mnode = NULL;
 
-    busy = BusyBegin(BUSY_TEXT);
-    BusyText(busy, tr(MSG_BusySavingIndex), folder->Name);
+  ENTER();
 
-    // lets prepare the Folder Index struct and write it out
-    // we clear it first, so that the reserved field is also 0
-    memset(&fi, 0, sizeof(struct FIndex));
-    fi.ID = FINDEX_VER;
-    fi.Total = folder->Total;
-    fi.New = folder->New;
-    fi.Unread = folder->Unread;
-    fi.Size = folder->Size;
+  if((entry = HashTableOperate(mailTable, jr->mailFile, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+    mnode = ((struct JournalMail *)entry)->mnode;
 
-    // write the index header out first
-    if(fwrite(&fi, sizeof(fi), 1, fh) == 1)
+  switch(jr->type)
+  {
+    case IJT_STATUS:
     {
-      BOOL systemIsUTF8 = (G->systemCodeset != NULL && G->systemCodeset->name != NULL && stricmp(G->systemCodeset->name, "utf-8") == 0);
+      if(mnode != NULL)
+      {
+        struct Mail *mail = mnode->mail;
 
-      // assume success at first
-      success = TRUE;
+        // the file name of the mail changes together with its status,
+        // so the mail must be rehashed with its new name
+        HashTableRawRemove(mailTable, entry);
 
-      LockMailListShared(folder->messages);
-      ForEachMailNode(folder->messages, mnode)
+        CountMailStats(tempFolder, mail, -1);
+        ComprMailToMail(mail, &jr->cmail, NULL);
+        CountMailStats(tempFolder, mail, +1);
+
+        success = AddJournalMail(mailTable, mnode);
+      }
+    }
+    break;
+
+    case IJT_ADD:
+    {
+      if(mnode == NULL)
       {
-        struct Mail *mail = mnode->mail;
-        struct ComprMail cmail;
-        char buf[SIZE_LARGE];
-        UTF8 *utf8buf;
-
-        // create the moreBytes string we append at the end
-        snprintf(buf, sizeof(buf), "%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n",
-                                   mail->Subject,
-                                   mail->From.Address, mail->From.RealName,
-                                   mail->To.Address, mail->To.RealName,
-                                   mail->ReplyTo.Address, mail->ReplyTo.RealName,
-                                   mail->MailAccount);
+        char *buf;
 
         if(systemIsUTF8 == TRUE)
         {
-          // no conversion required;
-          utf8buf = (UTF8 *)buf;
-		}
-		else
-		{
-          // convert the buffer string to UTF8
-          // the length of the generated string is directly put into the moreBytes variable
-          utf8buf = CodesetsUTF8Create(CSA_Source, buf,
-                                       CSA_SourceCodeset, G->systemCodeset,
-                                       CSA_DestLenPtr, &cmail.moreBytes,
-                                       TAG_DONE);
+          // no conversion required
+          buf = utf8buf;
+        }
+        else
+        {
+          // convert the utf8 encoded buffer to the local charset
+          buf = CodesetsUTF8ToStr(CSA_Source,          utf8buf,
+                                  CSA_SourceLen,       jr->cmail.moreBytes,
+                                  CSA_DestCodeset,     G->systemCodeset,
+                                  CSA_MapForeignChars, C->MapForeignChars,
+                                  TAG_DONE);
         }
 
-        if(utf8buf != NULL)
+        if(buf != NULL)
         {
-          strlcpy(cmail.mailFile, mail->MailFile, sizeof(cmail.mailFile));
-          cmail.date = mail->Date;
-          cmail.transDate = mail->transDate;
-          cmail.sflags = mail->sflags;
-          cmail.mflags = mail->mflags;
-          // we have to make sure that the volatile flag field isn't saved
-          setVOLValue(&cmail, 0);
-          cmail.cMsgID = mail->cMsgID;
-          cmail.cIRTMsgID = mail->cIRTMsgID;
-          cmail.size = mail->Size;
+          struct Mail *mail;
 
-          if(fwrite(&cmail, sizeof(cmail), 1, fh) != 1 ||
-             fwrite(utf8buf, cmail.moreBytes, 1, fh) != 1)
+          if((mail = AllocMail()) != NULL)
           {
-            E(DBF_FOLDER, "couldn't write index data of mail '%s'", cmail.mailFile);
-            success = FALSE;
+            ComprMailToMail(mail, &jr->cmail, buf);
+
+            // add the mail to the temporary folder, see MA_LoadIndex() for details
+            AddMailToFolderSimple(mail, tempFolder);
+            mail->Folder = folder;
+
+            success = AddJournalMail(mailTable, LastMailNode(tempFolder->messages));
           }
+          else
+            success = FALSE;
 
           if(systemIsUTF8 == FALSE)
           {
             // free the codesets buffer
-            CodesetsFreeA(utf8buf, NULL);
+            CodesetsFreeA(buf, NULL);
           }
         }
         else
+        {
+          E(DBF_FOLDER, "error while converting UTF8 data to local charset");
           success = FALSE;
-
-        // break out if something went wrong
-        if(success == FALSE)
-          break;
+        }
       }
+    }
+    break;
 
-      UnlockMailList(folder->messages);
+    case IJT_REMOVE:
+    {
+      if(mnode != NULL)
+      {
+        HashTableRawRemove(mailTable, entry);
 
-      clearFlag(folder->Flags, FOFL_MODIFY);
+        CountMailStats(tempFolder, mnode->mail, -1);
+        RemoveMailFromMsgIDTables(tempFolder, mnode->mail);
+        RemoveMailNode(tempFolder->messages, mnode);
+        DeleteMailNode(mnode);
+      }
     }
+    break;
 
-    fclose(fh);
-    BusyEnd(busy);
-  }
-  else
-  {
-    W(DBF_FOLDER, "saving index file '%s' of folder '%s' failed", indexFileName, folder->Name);
-    ER_NewError(tr(MSG_ER_CANNOT_WRITE_INDEX), indexFileName, folder->Name);
+    default:
+    {
+      E(DBF_FOLDER, "unknown index journal record type %ld", jr->type);
+      success = FALSE;
+    }
+    break;
   }
 
   RETURN(success);
@@ -668,683 +919,798 @@ BOOL MA_SaveIndex(struct Folder *folder)
 }
 
 ///
-/// MA_GetIndex
-//  Opens/unlocks a folder
-BOOL MA_GetIndex(struct Folder *folder)
+/// ReplayIndexJournal
+//  Replays the index journal of a folder on top of the just loaded index.
+//  If a temporary folder is given the recorded changes are applied to the
+//  mails within and the number of records is stored there, otherwise only
+//  the folder's statistics are updated. Returns FALSE if the journal is
+//  unusable. 'torn' is set if the journal ends with an incomplete record,
+//  i.e. after a crash.
+static BOOL ReplayIndexJournal(struct Folder *folder, struct Folder *tempFolder, BOOL *torn)
 {
-  BOOL result = FALSE;
+  BOOL success = TRUE;
+  char journalFileName[SIZE_PATHFILE];
+  ULONG records = 0;
+  FILE *fh;
 
   ENTER();
 
-  if(folder != NULL && isGroupFolder(folder) == FALSE)
+  AddPath(journalFileName, folder->Fullpath, ".journal", sizeof(journalFileName));
+
+  if((fh = fopen(journalFileName, "r")) != NULL)
   {
-    D(DBF_FOLDER, "folder: '%s' path: '%s' type: %ld mode: %ld pw '%s'", folder->Name, folder->Fullpath, folder->Type, folder->LoadedMode, folder->Password);
+    ULONG id;
 
-    // check that the folder is in a valid state for
-    // getting the index
-    if(folder->LoadedMode != LM_VALID && folder->LoadedMode != LM_REBUILD)
-    {
-      BOOL canLoadIndex;
+    setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
 
-      // check the protected status of the folder and prompt
-      // the user for the password in case it is required.
-      if(isProtectedFolder(folder) == FALSE || folder->Password[0] == '\0')
-        canLoadIndex = TRUE;
-      else
-        canLoadIndex = MA_PromptFolderPassword(folder, G->MA->GUI.WI);
+    if(fread(&id, sizeof(id), 1, fh) != 1 || id != FJOURNAL_VER)
+    {
+      W(DBF_FOLDER, "index journal '%s' has an unknown format", journalFileName);
+      success = FALSE;
+    }
+    else
+    {
+      BOOL systemIsUTF8 = (G->systemCodeset != NULL && G->systemCodeset->name != NULL && stricmp(G->systemCodeset->name, "utf-8") == 0);
+      struct HashTable *mailTable = NULL;
+      struct FJournalRecord jr;
+      long recordEnd = ftell(fh);
 
-      if(canLoadIndex == TRUE)
+      while(fread(&jr, sizeof(jr), 1, fh) == 1)
       {
-        // load the index file (and eventually rebuild it)
-        folder->LoadedMode = MA_LoadIndex(folder, TRUE);
+        char utf8buf[FJOURNAL_STRINGS_SIZE];
 
-        // we need to refresh the entry in the folder listtree this folder belongs to
-        // but only if there is a GUI already!
-        if(folder->LoadedMode == LM_VALID)
+        if(jr.cmail.moreBytes > sizeof(utf8buf)-1)
         {
-          MA_ValidateStatus(folder);
+          E(DBF_FOLDER, "index journal '%s' is corrupt near mail '%s'", journalFileName, jr.mailFile);
+          success = FALSE;
+          break;
+        }
+
+        if(jr.cmail.moreBytes > 0 && fread(utf8buf, jr.cmail.moreBytes, 1, fh) != 1)
+          break;
+
+        // make sure to NUL terminate the utf8 string
+        utf8buf[jr.cmail.moreBytes] = '\0';
+
+        if(tempFolder != NULL)
+        {
+          // the hash table of the loaded mails is set up upon the first
+          // record only, most folders don't have a journal at all
+          if(mailTable == NULL)
+          {
+            struct MailNode *mnode;
+
+            if((mailTable = HashTableNew(HashTableGetDefaultStringOps(), NULL, sizeof(struct JournalMail), tempFolder->Total)) == NULL)
+            {
+              success = FALSE;
+              break;
+            }
+
+            ForEachMailNode(tempFolder->messages, mnode)
+            {
+              if(AddJournalMail(mailTable, mnode) == FALSE)
+              {
+                success = FALSE;
+                break;
+              }
+            }
+
+            if(success == FALSE)
+              break;
+          }
+
+          if(ApplyJournalRecord(folder, tempFolder, mailTable, &jr, utf8buf, systemIsUTF8) == FALSE)
+          {
+            success = FALSE;
+            break;
+          }
         }
         else
-          W(DBF_MAIL, "status of loaded folder '%s' != LM_VALID (%ld)", folder->Name, folder->LoadedMode);
+        {
+          // take over the statistics after the recorded change
+          folder->Total  = jr.Total;
+          folder->New    = jr.New;
+          folder->Unread = jr.Unread;
+          folder->Size   = jr.Size;
+        }
 
-        if(G->MA != NULL)
-          DisplayStatistics(folder, FALSE);
+        records++;
+        recordEnd = ftell(fh);
       }
-      else
-        W(DBF_FOLDER, "password of protected folder '%s' could not be verified!", folder->Name);
-    }
-
-    // set the lastAccessTime of the folder to the current time
-    // so that the index expunge timer knows when to free the folder
-    // index in case it hasn't been touched for a certain time
-    folder->lastAccessTime = GetDateStamp();
 
-    // check if the index is valid
-    result = (BOOL)(folder->LoadedMode == LM_VALID);
-  }
+      // anything left behind the last complete record is an incomplete record
+      if(success == TRUE && ferror(fh) == 0 && fseek(fh, 0, SEEK_END) == 0 && ftell(fh) != recordEnd)
+      {
+        W(DBF_FOLDER, "index journal '%s' ends with an incomplete record", journalFileName);
+        *torn = TRUE;
+      }
 
-  RETURN(result);
-  return result;
-}
+      if(mailTable != NULL)
+        HashTableDestroy(mailTable);
+    }
 
-///
-/// MA_ExpireIndex
-//  Invalidates a folder index
-void MA_ExpireIndex(struct Folder *folder)
-{
-  ENTER();
+    if(ferror(fh) != 0)
+    {
+      E(DBF_FOLDER, "error while reading index journal '%s'", journalFileName);
+      success = FALSE;
+    }
 
-  if(!isModified(folder))
-  {
-    char indexFileName[SIZE_PATHFILE];
+    D(DBF_FOLDER, "replayed %ld records of index journal '%s'", records, journalFileName);
 
-    AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
-    DeleteFile(indexFileName);
+    fclose(fh);
   }
 
-  setFlag(folder->Flags, FOFL_MODIFY);
+  if(tempFolder != NULL)
+    tempFolder->journalRecords = records;
+  else
+    folder->journalRecords = records;
 
-  LEAVE();
+  RETURN(success);
+  return success;
 }
 
 ///
-/// MA_RebuildIndexes
-//  Rebuild indices of all folders
-void MA_RebuildIndexes(void)
+/// LoadIndexMails
+//  Loads the mails of an index whose header was read already into a
+//  temporary folder and replays the index journal on top of them. This
+//  does not touch the real folder, hence it may be called by a thread.
+static BOOL LoadIndexMails(FILE *fh, const char *indexFileName, ULONG indexFileSize, ULONG indexID, struct Folder *folder, struct Folder *tempFolder, BOOL *corrupt, BOOL *legacyFormat, BOOL *tornJournal)
 {
-  struct FolderNode *fnode;
+  BOOL error = FALSE;
 
   ENTER();
 
-  LockFolderListShared(G->folders);
-
-  ForEachFolderNode(G->folders, fnode)
+  if(indexID == FINDEX_HEAP_VER)
+  {
+    if(LoadIndexHeapMails(fh, indexFileName, indexFileSize, folder, tempFolder, corrupt) == FALSE)
+      error = TRUE;
+  }
+  else
   {
-    struct Folder *folder = fnode->folder;
+    BOOL systemIsUTF8 = (G->systemCodeset != NULL && G->systemCodeset->name != NULL && stricmp(G->systemCodeset->name, "utf-8") == 0);
 
-    if(folder != NULL && !isGroupFolder(folder))
+    do
     {
-      char indexFileName[SIZE_PATHFILE];
-      ULONG dirDate;
-      ULONG indexDate;
-
-      AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
+      struct Mail *mail;
+      struct ComprMail cmail;
+      char utf8buf[SIZE_LARGE];
+      char *buf;
 
-      // get date of the folder directory and the .index file
-      // itself
-      if(ObtainFileInfo(folder->Fullpath, FI_TIME, &dirDate) == TRUE &&
-         ObtainFileInfo(indexFileName, FI_TIME, &indexDate) == TRUE)
+      if(fread(&cmail, sizeof(struct ComprMail), 1, fh) != 1)
       {
-        // only consider starting to rebuilding the .index if
-        // either the date of the directory is greater than the
-        // date of the .index file itself, or if there is no index
-        // file date at all (no file present)
-        if(dirDate > indexDate + 30)
+        // check if we are here because of an error or EOF
+        if(ferror(fh) != 0 || feof(fh) == 0)
         {
-          ULONG dirProtection;
-          ULONG indexProtection;
-
-          // get the protection bits of the folder index file
-          // and the folder directory, and if both have the A
-          // bit set we skip the index rescanning process because
-          // the A bits might have been set by a backup program
-          if(ObtainFileInfo(folder->Fullpath, FI_PROTECTION, &dirProtection) == TRUE &&
-             ObtainFileInfo(indexFileName, FI_PROTECTION, &indexProtection) == TRUE)
-          {
-            if(isFlagClear(indexProtection, FIBF_ARCHIVE) ||
-               isFlagClear(dirProtection, FIBF_ARCHIVE))
-            {
-              // lets first delete the .index file to
-              // make sure MA_GetIndex() is going to
-              // rebuild it.
-              if(indexDate > 0)
-                DeleteFile(indexFileName);
-
-              // then lets call GetIndex() to start rebuilding
-              // the .index - but only if this folder is one of the folders
-              // that should update it indexes during startup
-              if((isIncomingFolder(folder) || isOutgoingFolder(folder) ||
-                  isTrashFolder(folder) || C->LoadAllFolders) &&
-                 !isProtectedFolder(folder))
-              {
-                if(MA_GetIndex(folder) == TRUE)
-                {
-                  // if we finally rebuilt the .index we
-                  // immediatly flush it here so that another
-                  // following index rebuild doesn't take
-                  // all remaining memory.
-                  if((isSentFolder(folder) || !isDefaultFolder(folder)) &&
-                      folder->LoadedMode == LM_VALID &&
-                      isFreeAccess(folder))
-                  {
-                    if(isModified(folder))
-                      MA_SaveIndex(folder);
-
-                    ClearFolderMails(folder, FALSE);
-                    folder->LoadedMode = LM_FLUSHED;
-                    clearFlag(folder->Flags, FOFL_FREEXS);
-                  }
-                }
-              }
-              else
-              {
-                // otherwise we make sure everything is cleared
-                ClearFolderMails(folder, FALSE);
-                folder->LoadedMode = LM_FLUSHED;
-                clearFlag(folder->Flags, FOFL_FREEXS);
-              }
-            }
-          }
+          E(DBF_FOLDER, "error while loading ComprMail struct from .index file");
+          error = TRUE;
         }
+
+        // if we end up here it is just a EOF and no error.
+        break;
       }
-    }
-  }
 
-  UnlockFolderList(G->folders);
+      if(cmail.moreBytes > sizeof(utf8buf)-1)
+      {
+        ER_NewError(tr(MSG_ER_INDEX_CORRUPTED), indexFileName, folder->Name, ftell(fh), cmail.mailFile, cmail.moreBytes);
+        *corrupt = TRUE;
+        break;
+      }
 
-  LEAVE();
-}
+      // read the moreBytes data
+      if(fread(utf8buf, cmail.moreBytes, 1, fh) != 1)
+      {
+        E(DBF_FOLDER, "fread error while reading index file");
+        error = TRUE;
+        break;
+      }
 
-///
+      // make sure to NUL terminate the utf8 string
+      utf8buf[cmail.moreBytes] = '\0';
 
-/*** Private functions ***/
-/// MA_ChangeFolder
-//  Changes to another folder
-void MA_ChangeFolder(struct Folder *folder, BOOL set_active)
-{
-  struct Folder *current;
-
-  ENTER();
-
-  if((current = GetCurrentFolder()) != NULL)
-  {
-    BOOL folderChanged = TRUE;
-
-    if(folder == NULL)
-      folder = current;
-    else if(folder == current)
-      folderChanged = FALSE;
-    else if(set_active == TRUE)
-    {
-      ActivateFolder(folder);
-      current = folder;
-    }
-
-    if(folder != NULL && folderChanged == TRUE)
-    {
-      struct MA_GUIData *gui = &G->MA->GUI;
-
-      // in case the main window has an embedded read pane, we have to
-      // clear it before changing the actual folder
-      if(C->EmbeddedReadPane == TRUE)
-        DoMethod(gui->MN_EMBEDDEDREADPANE, MUIM_ReadMailGroup_Clear, MUIF_NONE);
-
-      // if this folder should be disabled, lets do it now
-      if(isGroupFolder(folder) || MA_GetIndex(folder) == FALSE)
+      if(systemIsUTF8 == TRUE)
       {
-        DoMethod(gui->PG_MAILLIST, MUIM_NList_Clear);
-        xset(gui->PG_MAILLIST, MUIA_Disabled,     TRUE,
-                               MUIA_NList_Active, MUIV_NList_Active_Off);
-
-        // set the quickbar as disabled as well and abort a search still in progress
-        if(C->QuickSearchBarPos != QSB_POS_OFF)
-        {
-          xset(gui->GR_QUICKSEARCHBAR, MUIA_Disabled, TRUE,
-                                       MUIA_QuickSearchBar_AbortSearch, TRUE);
-        }
-
-        // also set an embedded read pane as disabled.
-        if(C->EmbeddedReadPane == TRUE)
-          set(gui->MN_EMBEDDEDREADPANE, MUIA_Disabled, TRUE);
-
-        DoMethod(gui->IB_INFOBAR, MUIM_InfoBar_SetFolder, folder);
-
-        // make sure the main mail list noticies that
-        // the selection has changed so that if a user reactivates a valid
-        // folder the main mail list will get updated accordingly.
-        MA_ChangeSelected(TRUE);
+        // no conversion required
+        buf = utf8buf;
       }
-      else if(folder == current) // check again for the current folder
+      else
       {
-        // set the SortFlag in the NList accordingly
-        MA_SetSortFlag();
-
-        // Now we update the InfoBar accordingly
-        DoMethod(gui->IB_INFOBAR, MUIM_InfoBar_SetFolder, folder);
-
-        // enable an embedded read pane again
-        if(C->EmbeddedReadPane == TRUE)
-          set(gui->MN_EMBEDDEDREADPANE, MUIA_Disabled, FALSE);
-
-        // In case the main window has an quicksearchbar, we have to
-        // clear it as well before changing the folder. We also abort
-        // a search still being in progress.
-        if(C->QuickSearchBarPos != QSB_POS_OFF)
+        // convert the utf8 encoded buffer to the local charset
+        if((buf = CodesetsUTF8ToStr(CSA_Source,          utf8buf,
+                                    CSA_SourceLen,       cmail.moreBytes,
+                                    CSA_DestCodeset,     G->systemCodeset,
+                                    CSA_MapForeignChars, C->MapForeignChars,
+                                    TAG_DONE)) == NULL)
         {
-          set(gui->GR_QUICKSEARCHBAR, MUIA_QuickSearchBar_AbortSearch, TRUE);
-          DoMethod(gui->GR_QUICKSEARCHBAR, MUIM_QuickSearchBar_Clear);
+          E(DBF_FOLDER, "error while converting UTF8 data to local charset");
+          error = TRUE;
+          break;
         }
+      }
 
-        // create the Mail List and display it
-        DoMethod(gui->PG_MAILLIST, MUIM_MainMailListGroup_DisplayMailsOfFolder, folder);
+      // create a new mail structure
+      if((mail = AllocMail()) != NULL)
+      {
+        ComprMailToMail(mail, &cmail, buf);
+
+        // finally add the new mail structure to the temporary folder
+        // no message list locking or index expiring is necessary here,
+        // because it is a temporary folder which is not publically known
+        AddMailToFolderSimple(mail, tempFolder);
+
+        // the AddMailToFolderSimple() call set the mail's folder pointer to the
+        // temporary folder. But since this is a temporary one only and will be
+        // invalid after leaving this function we must set the mail's folder
+        // pointer to the correct current folder.
+        mail->Folder = folder;
+      }
+      else
+        error = TRUE;
 
-        // Force an update of the current mail.
-        // Usually this should be done upon a notification trigger by NList.
-        // Unfortunately NList doesn't seem to trigger notifications in "quiet"
-        // mode. But we are lucky here, because the update must be done manually
-        // for empty folders anyway, hence this call doesn't hurt.
-        MA_ChangeSelected(TRUE);
+      if(systemIsUTF8 == FALSE)
+      {
+        // free the codesets buffer
+        CodesetsFreeA(buf, NULL);
       }
     }
+    while(error == FALSE);
+
+    // this is an index in the old format, make sure it gets
+    // converted to the new format upon the next save
+    *legacyFormat = TRUE;
   }
 
-  LEAVE();
+  // apply all changes which were recorded after the index was saved
+  if(error == FALSE && *corrupt == FALSE && ReplayIndexJournal(folder, tempFolder, tornJournal) == FALSE)
+    *corrupt = TRUE;
+
+  RETURN((BOOL)(error == FALSE));
+  return (BOOL)(error == FALSE);
 }
 
 ///
-/// MA_ConvertOldMailFile
-// This function takes a fileinfoblock and a folder and converts the
-// oldstyle mailfile referred by fib to a new YAM 2.5+ conform mail file.
-static char *MA_ConvertOldMailFile(char *filename, struct Folder *folder)
+/// MA_LoadIndex
+//  Loads a folder index from disk
+enum LoadedMode MA_LoadIndex(struct Folder *folder, BOOL full)
 {
-  char dateFilePart[13];  // the base64 encoded date part occupies 12+1 bytes
-  char statusFilePart[4]; // we only need 3+1 bytes for the status flags here
-  char oldFilePath[SIZE_PATHFILE+1];
-  char *statusPartPtr = statusFilePart;
-  char *comment;
-  char *ptr;
-  char *result = filename;
+  char indexFileName[SIZE_PATHFILE];
+  ULONG indexFileSize;
+  enum LoadedMode indexloaded = LM_UNLOAD;
+  BOOL corrupt = FALSE;
+  BOOL error = FALSE;
+  BOOL legacyFormat = FALSE;
+  BOOL tornJournal = FALSE;
 
   ENTER();
 
-  // clear
-  dateFilePart[0] = '\0';
-  statusFilePart[0] = '\0';
+  D(DBF_FOLDER, "Loading index for folder '%s'", folder->Name);
 
-  // construct the full path of the old filename
-  // and get the file comment
-  AddPath(oldFilePath, folder->Fullpath, filename, sizeof(oldFilePath));
-  if(ObtainFileInfo(oldFilePath, FI_COMMENT, &comment) == FALSE || comment == NULL)
-  {
-    RETURN(NULL);
-    return NULL;
-  }
+  AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
 
-  // for a proper conversion we have to take mainly the file comment into
-  // account as in there all status information aswell as the transfer
-  // data was stored in YAM versions prior to 2.5
-  if(comment[0] != '\0')
+  // Check the size of the index file. Even an empty folder has an index
+  // file with a size of at least sizeof(struct FIndex).
+  if(ObtainFileInfo(indexFileName, FI_SIZE, &indexFileSize) == TRUE && indexFileSize >= sizeof(struct FIndex))
   {
-    // read out the mailstatus - which was normally the first character
-    // of the comment
-    switch(comment[0])
-    {
-      case 'U':
-        // nothing
-      break;
-
-      case 'R':
-        *statusPartPtr++ = SCHAR_READ;
-        *statusPartPtr++ = SCHAR_REPLIED;
-      break;
+    FILE *fh;
 
-      case 'F':
-        *statusPartPtr++ = SCHAR_READ;
-        *statusPartPtr++ = SCHAR_FORWARDED;
-      break;
+    if((fh = fopen(indexFileName, "r")) != NULL)
+    {
+      struct BusyNode *busy;
+      struct FIndex fi;
 
-      case 'W':
-        *statusPartPtr++ = SCHAR_READ;
-      break;
+      setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
 
-      case 'H':
-        *statusPartPtr++ = SCHAR_READ;
-      break;
+      busy = BusyBegin(BUSY_TEXT);
+      BusyText(busy, tr(MSG_BusyLoadingIndex), folder->Name);
+      if(fread(&fi, sizeof(fi), 1, fh) != 1)
+      {
+        E(DBF_FOLDER, "error while loading struct FIndex from .index file");
+        error = TRUE;
+      }
+      else if(fi.ID == FINDEX_VER || fi.ID == FINDEX_HEAP_VER)
+      {
+        folder->Total  = fi.Total;
+        folder->New    = fi.New;
+        folder->Unread = fi.Unread;
+        folder->Size   = fi.Size;
+        indexloaded = LM_FLUSHED;
 
-      case 'O':
-        *statusPartPtr++ = SCHAR_READ;
-      break;
+        if(full == TRUE)
+        {
+          struct Folder *tempFolder;
 
-      case 'E':
-        *statusPartPtr++ = SCHAR_ERROR;
-      break;
+          STARTCLOCK(DBF_FOLDER);
 
-      case 'S':
-        *statusPartPtr++ = SCHAR_READ;
-        *statusPartPtr++ = SCHAR_SENT;
-      break;
+          ClearFolderMails(folder, TRUE);
 
-      case 'N':
-      default:
-        *statusPartPtr++ = SCHAR_NEW;
-      break;
-    }
+          // allocate a temporary folder structure to avoid having to lock the real folder's
+          // mail list for each single mail we get from the index
+          if((tempFolder = AllocFolder()) != NULL)
+          {
+            if(LoadIndexMails(fh, indexFileName, indexFileSize, fi.ID, folder, tempFolder, &corrupt, &legacyFormat, &tornJournal) == FALSE)
+              error = TRUE;
+          }
+          else
+            error = TRUE;
 
-    // now we check if second char is present and if we set the mailfag
-    // as "marked" and the arexx permanent flag
-    if(comment[1] != '\0' && comment[1] != ' ')
-    {
-      int pval = 0;
+          // if everything went well then move all mails from the temporary folder
+          // to the real folder
+          if(error == FALSE)
+          {
+            folder->journalRecords = tempFolder->journalRecords;
+            MoveFolderContents(folder, tempFolder);
+          }
 
-      // we have to check for the permanent flag also.
-      if(comment[1] >= 'M' && comment[1] <= 'M'+7)
-      {
-        *statusPartPtr++ = SCHAR_MARKED;
+          // free the temporary folder in any case
+          if(tempFolder != NULL)
+            FreeFolder(tempFolder);
 
-        pval = comment[1]-'M';
+          STOPCLOCK(DBF_FOLDER, "loading index");
+        }
+        else if(ReplayIndexJournal(folder, NULL, &tornJournal) == FALSE)
+        {
+          // the journal is unusable, this requires a rebuild of the index
+          corrupt = TRUE;
+        }
       }
-      else if(comment[1] >= '1' && comment[1] <= '7')
+
+      if(ferror(fh) != 0)
       {
-        pval = comment[1]-'1'+1;
+        E(DBF_FOLDER, "ferror() returned != 0");
+        error = TRUE;
       }
 
-      if(pval > 0)
-        *statusPartPtr++ = '0'+pval;
+      BusyEnd(busy);
+      fclose(fh);
     }
-
-    *statusPartPtr = '\0'; // NUL terminate the status part
-
-    // we check if this comment also has the transfer Date included
-    // we only take the string if it is exactly 12bytes long or
-    // otherwise it could be some weird data in the Comment string
-    if(comment[1] != '\0' && comment[2] != '\0' && comment[14] == '\0')
+    else if(errno != ENOENT)
     {
-      // ok we have the transfer Date, so lets put it at the beginning of
-      // the new filename
-      strlcpy(dateFilePart, &comment[2], sizeof(dateFilePart));
+      E(DBF_FOLDER, "fopen() on '%s' failed.", indexFileName);
+      error = TRUE;
     }
   }
+  else
+  {
+    E(DBF_FOLDER, "index file '%s' of folder '%s' has invalid size %ld (minimum required %ld)", indexFileName, folder->Name, indexFileSize, sizeof(struct FIndex));
+    // report this index file as corrupted if it is smaller than the required minimum size, but not empty
+    if(indexFileSize > 0)
+      corrupt = TRUE;
+  }
 
-  // free the duplicated comment again
-  free(comment);
-
-  if(dateFilePart[0] == '\0')
+  // in case an error occurred we report it
+  // to the user
+  if(error == TRUE)
   {
-    struct TimeVal newDate;
-    char *b64_dateFilePart = NULL;
+    E(DBF_FOLDER, "error %ld occurred while trying to load the index file '%s'", errno, indexFileName);
+    ClearFolderMails(folder, TRUE);
+    indexloaded = LM_UNLOAD;
 
-    // so we don't seem to have a transfer Date in the file comment.
-    // What we do now is that we take the date from the original file
-    // (the first 5 numerical numbers are the days)
-    newDate.Seconds = atol(filename) * 24 * 60 * 60;
-    newDate.Microseconds = 0;
+    // report failure
+    ER_NewError(tr(MSG_ER_CANNOT_READ_INDEX), indexFileName, folder->Name);
+  }
+  else if(corrupt == TRUE || indexloaded == LM_UNLOAD)
+  {
+    W(DBF_FOLDER, "%s .index file '%s' detected, %s", corrupt ? "corrupt" : "missing",
+                                                      indexFileName,
+                                                      full ? "rebuilding..." : "skipping...");
 
-    // encode this date as a base64 encoded string
-    if(base64encode(&b64_dateFilePart, (char *)&newDate, sizeof(newDate)) > 0)
-    {
-      if(strlcpy(dateFilePart, b64_dateFilePart, sizeof(dateFilePart)) > sizeof(dateFilePart))
-        W(DBF_ALWAYS, "length of b64_dateFilePart > dateFilePart");
+    // clear the mail list of the folder
+    ClearFolderMails(folder, TRUE);
 
-      free(b64_dateFilePart);
+    // if the "full" mode was requested we make sure we
+    // rescan the index accordingly
+    if(full == TRUE)
+    {
+      // rebuild the index (rescanning the mailbox directory)
+      if(MA_ScanMailBox(folder) == TRUE && MA_SaveIndex(folder) == TRUE)
+        indexloaded = LM_VALID;
     }
+  }
+  else if(full == TRUE)
+  {
+    indexloaded = LM_VALID;
+
+    // an index in the old format will be saved in the new format as soon as possible,
+    // the same applies to an index with a journal which cannot be appended to anymore
+    if(legacyFormat == TRUE || tornJournal == TRUE)
+      setFlag(folder->Flags, FOFL_MODIFY);
     else
-      E(DBF_ALWAYS, "Error when trying to base64 encode dateFilePart");
+      clearFlag(folder->Flags, FOFL_MODIFY);
+
+    // let the next index flush compact a large journal
+    if(folder->journalRecords >= FJOURNAL_LIMIT)
+      setFlag(folder->Flags, FOFL_COMPACT);
   }
 
-  // as the dateFilePart may contain slashes "/" we have to replace them
-  // with "-" chars to don't drive the filesystem crazy :)
-  ptr = dateFilePart;
-  while((ptr = strchr(ptr, '/')) != NULL)
-    *ptr = '-';
+  RETURN(indexloaded);
+  return indexloaded;
+}
 
-  do
-  {
-    static char newFileName[SIZE_MFILE];
-    char newFilePath[SIZE_PATHFILE+1];
+///
+/// AddIndexHeapString
+//  Adds a string to the heap of a FINDEX_HEAP_VER index and returns its
+//  offset within the heap. Strings which are part of the heap already are
+//  not added again, instead the offset of the existing string is returned.
+static BOOL AddIndexHeapString(struct HashTable *strings, struct IndexHeap *heap, const char *str, BOOL systemIsUTF8, ULONG *offset)
+{
+  BOOL success = FALSE;
+  struct HashEntryHeader *entry;
 
-    // ok, now we should have all main parts of the new filename, so we
-    // can concatenate it to one new filename and try to rename the old
-    // style mailfile to the newstyle equivalent.
-    snprintf(newFileName, sizeof(newFileName), "%s.001,%s", dateFilePart, statusFilePart);
+  ENTER();
 
-    // so, now we should be finished with finding the new filename of the mail file.
-    // lets try to rename it with the dos.library's Rename() function
-    if(AddPath(newFilePath, folder->Fullpath, newFileName, sizeof(newFilePath)) == NULL)
+  if(str[0] == '\0')
+  {
+    // the empty string is always located at the beginning of the heap
+    *offset = 0;
+    success = TRUE;
+  }
+  else if((entry = HashTableOperate(strings, str, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
+  {
+    // this string has been added before
+    *offset = ((struct IndexSaveString *)entry)->offset;
+    success = TRUE;
+  }
+  else
+  {
+    UTF8 *utf8buf;
+    ULONG utf8len;
+
+    if(systemIsUTF8 == TRUE)
     {
-      result = NULL;
-      break;
+      // no conversion required
+      utf8buf = (UTF8 *)str;
+      utf8len = strlen(str);
+    }
+    else
+    {
+      // convert the string to UTF8
+      utf8buf = CodesetsUTF8Create(CSA_Source, str,
+                                   CSA_SourceCodeset, G->systemCodeset,
+                                   CSA_DestLenPtr, &utf8len,
+                                   TAG_DONE);
     }
 
-    // try to rename it and if it fails go and find out if we have to increase
-    // the mail counter or not.
-    if(Rename(oldFilePath, newFilePath) == 0)
+    if(utf8buf != NULL)
     {
-      char pattern[15+1];
-      LONG mailCounter;
+      // enlarge the heap if the string and its NUL terminator don't fit anymore
+      if(heap->used + utf8len + 1 > heap->size)
+      {
+        ULONG newSize = heap->size * 2;
+        char *newBuffer;
 
-      // search for files matching the dateFilePart
-      snprintf(pattern, sizeof(pattern), "%s.#?", dateFilePart);
-      mailCounter = FileCount(folder->Fullpath, pattern);
+        while(heap->used + utf8len + 1 > newSize)
+          newSize *= 2;
 
-      // if we didn't find any matching file then this signals
-      // another error than an already existing file!
-      if(mailCounter <= 0)
-      {
-        E(DBF_FOLDER, "  error on renaming '%s' to '%s'", oldFilePath, newFilePath);
-        result = NULL;
-        break;
+        if((newBuffer = realloc(heap->buffer, newSize)) != NULL)
+        {
+          heap->buffer = newBuffer;
+          heap->size = newSize;
+        }
       }
 
-      // let us now try it again to rename the file
-      snprintf(newFileName, sizeof(newFileName), "%s.%03d,%s", dateFilePart, (unsigned int)(++mailCounter), statusFilePart);
-      if(AddPath(newFilePath, folder->Fullpath, newFileName, sizeof(newFilePath)) == NULL)
+      if(heap->used + utf8len + 1 <= heap->size && (entry = HashTableOperate(strings, str, htoAdd)) != NULL)
       {
-        result = NULL;
-        break;
+        struct IndexSaveString *hstr = (struct IndexSaveString *)entry;
+
+        // the hash table takes care of the key which must be a copy
+        // of the string, because the mail may vanish at any time
+        if((hstr->string = strdup(str)) != NULL)
+        {
+          hstr->offset = heap->used;
+
+          memcpy(&heap->buffer[heap->used], utf8buf, utf8len);
+          heap->buffer[heap->used + utf8len] = '\0';
+          heap->used += utf8len + 1;
+
+          *offset = hstr->offset;
+          success = TRUE;
+        }
+        else
+          HashTableRawRemove(strings, entry);
       }
 
-      // try to rename it and if it fails finally return an error
-      if(Rename(oldFilePath, newFilePath) == 0)
+      if(systemIsUTF8 == FALSE)
       {
-        E(DBF_FOLDER, "  error on renaming '%s' to '%s'", oldFilePath, newFilePath);
-        result = NULL;
-        break;
+        // free the codesets buffer
+        CodesetsFreeA(utf8buf, NULL);
       }
     }
-
-    result = newFileName;
-
-    // and to make everything as clean as possible, lets erase
-    // the filecomment as YAM 2.5+ doesn't require file comments anymore
-    SetComment(newFilePath, "");
   }
-  while(FALSE);
-
-  // return failure if we didn't change anything
-  if(result == filename)
-    result = NULL;
 
-  RETURN(result);
-  return result;
+  RETURN(success);
+  return success;
 }
+
 ///
-/// CompressMsgID
-//  Creates a crc32 checksum of the MsgID, so that it can be used later
-//  for the follow-up algorithms aso.
-static unsigned long CompressMsgID(const char *msgid)
+/// MA_SaveIndex
+//  Saves a folder index to disk
+BOOL MA_SaveIndex(struct Folder *folder)
 {
-  unsigned long id = 0;
+  BOOL success = FALSE;
+  char indexFileName[SIZE_PATHFILE];
+  FILE *fh;
 
   ENTER();
 
-  // if the MsgID is valid we calculate the CRC32 checksum and as it
-  // consists only of one cycle through the crc function we call it
-  // with -1
-  if(IsStrEmpty(msgid) == FALSE)
+  D(DBF_FOLDER, "save index of folder '%s'", folder->Name);
+
+  // a preloaded index would be outdated
+  MA_CancelIndexPreload(folder);
+
+  AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
+
+  if((fh = fopen(indexFileName, "w")) != NULL)
   {
-    char *end;
-    size_t len;
+    struct BusyNode *busy;
+    struct FIndexHeap fih;
+    struct HashTable *strings;
 
-    // skip the leading angle bracket (see RFC 4130)
-    if(msgid[0] == '<')
-      msgid++;
+    setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
 
-    // find the trailing angle bracket and skip it (see RFC 4130)
-    if((end = strchr(msgid, '>')) != NULL)
-      len = end-msgid+1;
-    else
+    busy = BusyBegin(BUSY_TEXT);
+    BusyText(busy, tr(MSG_BusySavingIndex), folder->Name);
+
+    STARTCLOCK(DBF_FOLDER);
+
+    // lets prepare the Folder Index struct and write it out
+    // we clear it first, so that the reserved field is also 0
+    memset(&fih, 0, sizeof(fih));
+    fih.fi.ID = FINDEX_HEAP_VER;
+    fih.fi.Total = folder->Total;
+    fih.fi.New = folder->New;
+    fih.fi.Unread = folder->Unread;
+    fih.fi.Size = folder->Size;
+    fih.recordSize = sizeof(struct StrideMail);
+
+    // write a preliminary index header out first, the final one including
+    // the number of records and the heap size follows when everything is done
+    if(fwrite(&fih, sizeof(fih), 1, fh) == 1)
     {
-      W(DBF_MAIL, "can't find closing '>' in msgid '%s'", msgid);
-      len = strlen(msgid);
-    }
+      if((strings = HashTableNew(HashTableGetDefaultStringOps(), NULL, sizeof(struct IndexSaveString), 512)) != NULL)
+      {
+        BOOL systemIsUTF8 = (G->systemCodeset != NULL && G->systemCodeset->name != NULL && stricmp(G->systemCodeset->name, "utf-8") == 0);
+        struct IndexHeap heap;
 
-    // calculate the CRC32 checksum for the compressed
-    // message ID
-    id = CRC32(msgid, len, -1L);
-  }
-  else
-    W(DBF_MAIL, "couldn't calculate compressed MsgID from empty string");
+        heap.size = SIZE_FILEBUF;
+        heap.used = 0;
 
-  RETURN(id);
-  return id;
-}
+        if((heap.buffer = malloc(heap.size)) != NULL)
+        {
+          struct MailNode *mnode;
 
-///
-/// FindMailByMsgID
-// find a mail by message-id in the given folder
-struct Mail *FindMailByMsgID(struct Folder *folder, const char *msgid)
-{
-  struct Mail *result = NULL;
-  struct MailNode *mnode;
-  unsigned long msgidCRC;
+          // the empty string is always located at offset 0
+          heap.buffer[heap.used++] = '\0';
 
-  ENTER();
+          // assume success at first
+          success = TRUE;
 
-  msgidCRC = CompressMsgID(msgid);
+          LockMailListShared(folder->messages);
+          ForEachMailNode(folder->messages, mnode)
+          {
+            struct Mail *mail = mnode->mail;
+            struct StrideMail smail;
+            const char *mailStrings[COMPRMAIL_MORELINES];
+            int i;
 
-  LockMailList(folder->messages);
+            // clear the record first to get reproducible padding bytes
+            memset(&smail, 0, sizeof(smail));
 
-  ForEachMailNode(folder->messages, mnode)
-  {
-    struct Mail *mail = mnode->mail;
+            mailStrings[0] = mail->Subject;
+            mailStrings[1] = mail->From.Address;
+            mailStrings[2] = mail->From.RealName;
+            mailStrings[3] = mail->To.Address;
+            mailStrings[4] = mail->To.RealName;
+            mailStrings[5] = mail->ReplyTo.Address;
+            mailStrings[6] = mail->ReplyTo.RealName;
+            mailStrings[7] = mail->MailAccount;
+            mailStrings[8] = (mail->MsgID != NULL) ? mail->MsgID : "";
 
-    // compare the compressed message-ids only for speed reasons
-    if(mail->cMsgID == msgidCRC)
-    {
-      // now go into detail and check if the full message-id matches
-      struct ExtendedMail *email;
+            for(i=0; i < COMPRMAIL_MORELINES; i++)
+            {
+              if(AddIndexHeapString(strings, &heap, mailStrings[i], systemIsUTF8, &smail.strings[i]) == FALSE)
+              {
+                E(DBF_FOLDER, "couldn't add string '%s' of mail '%s' to index heap", mailStrings[i], mail->MailFile);
+                success = FALSE;
+                break;
+              }
+            }
 
-      if((email = MA_ExamineMail(folder, mail->MailFile, TRUE)) != NULL)
-      {
-        if(strcmp(email->messageID, msgid) == 0)
-        {
-          // return the mail
-          result = mail;
+            if(success == TRUE)
+            {
+              strlcpy(smail.mailFile, mail->MailFile, sizeof(smail.mailFile));
+              smail.date = mail->Date;
+              smail.transDate = mail->transDate;
+              smail.sflags = mail->sflags;
+              smail.mflags = mail->mflags;
+              // we have to make sure that the volatile flag field isn't saved
+              setVOLValue(&smail, 0);
+              smail.cMsgID = mail->cMsgID;
+              smail.cIRTMsgID = mail->cIRTMsgID;
+              smail.size = mail->Size;
+
+              if(fwrite(&smail, sizeof(smail), 1, fh) == 1)
+                fih.recordCount++;
+              else
+              {
+                E(DBF_FOLDER, "couldn't write index data of mail '%s'", smail.mailFile);
+                success = FALSE;
+              }
+            }
+
+            // break out if something went wrong
+            if(success == FALSE)
+              break;
+          }
+
+          UnlockMailList(folder->messages);
+
+          if(success == TRUE)
+          {
+            // append the string heap and finally rewrite the header
+            fih.heapSize = heap.used;
+
+            if(fwrite(heap.buffer, heap.used, 1, fh) != 1 ||
+               fseek(fh, 0, SEEK_SET) != 0 ||
+               fwrite(&fih, sizeof(fih), 1, fh) != 1)
+            {
+              E(DBF_FOLDER, "couldn't write string heap of index file '%s'", indexFileName);
+              success = FALSE;
+            }
+            else
+              D(DBF_FOLDER, "saved %ld records with %ld bytes of unique strings", fih.recordCount, fih.heapSize);
+          }
+
+          free(heap.buffer);
         }
 
-        MA_FreeEMailStruct(email);
+        HashTableDestroy(strings);
       }
 
-      if(result != NULL)
-        break;
+      clearFlag(folder->Flags, FOFL_MODIFY);
     }
-  }
 
-  UnlockMailList(folder->messages);
+    STOPCLOCK(DBF_FOLDER, "saving index");
 
-  RETURN(result);
-  return result;
+    fclose(fh);
+    BusyEnd(busy);
+
+    if(success == TRUE)
+    {
+      char journalFileName[SIZE_PATHFILE];
+
+      // all changes recorded in the journal are part of the index now
+      AddPath(journalFileName, folder->Fullpath, ".journal", sizeof(journalFileName));
+      DeleteFile(journalFileName);
+
+      folder->journalRecords = 0;
+      clearFlag(folder->Flags, FOFL_COMPACT);
+    }
+  }
+  else
+  {
+    W(DBF_FOLDER, "saving index file '%s' of folder '%s' failed", indexFileName, folder->Name);
+    ER_NewError(tr(MSG_ER_CANNOT_WRITE_INDEX), indexFileName, folder->Name);
+  }
+
+  RETURN(success);
+  return success;
 }
 
 ///
-
-/*** Mail header scanning ***/
-/// MA_NewMailFile
-//  Function that creates a new plain mail filename or by taking provided
-//  data into account. It returns the full path to the new mail file in the
-//  folder and also writes it into the mailfile parameter
-BOOL MA_NewMailFile(const struct Folder *folder, char *fullPath, const size_t fullPathSize)
+/// FreeIndexPreload
+//  Frees a preload which is not part of the queue anymore
+static void FreeIndexPreload(struct IndexPreload *preload)
 {
-  char *dateFilePart = NULL;
-  char newFileName[SIZE_MFILE];
-  char *ptr;
-  struct TimeVal curDate;
-  int mCounter;
-  BOOL result;
-
   ENTER();
 
-  // take the current time and use it as the datePart of the
-  // new mailfile name
-  GetSysTimeUTC(&curDate);
+  if(preload->tempFolder != NULL)
+    FreeFolder(preload->tempFolder);
 
-  // encode this date as a base64 encoded string
-  base64encode(&dateFilePart, (char *)&curDate, sizeof(curDate));
+  free(preload);
 
-  // as the dateFilePart may contain slashes "/" we have to replace them
-  // with "-" chars to not drive the filesystem crazy :)
-  ptr = dateFilePart;
-  while((ptr = strchr(ptr, '/')) != NULL)
-    *ptr = '-';
+  LEAVE();
+}
 
-  mCounter = 0;
-  do
-  {
-    snprintf(newFileName, sizeof(newFileName), "%s.%03d,N", dateFilePart, ++mCounter);
+///
+/// WaitIndexPreloader
+//  Waits until the preloader has finished a folder or has stopped. The
+//  preloader's lock must be held and is released while waiting.
+static void WaitIndexPreloader(void)
+{
+  LONG waitSignal;
 
-    AddPath(fullPath, folder->Fullpath, newFileName, fullPathSize);
+  ENTER();
 
-    // don't care about duplicate files in the drafts folder
-    if(isDraftsFolder(folder) == TRUE)
-      break;
-  }
-  while(mCounter < 999 && FileExists(fullPath) == TRUE);
+  if((waitSignal = AllocSignal(-1)) != -1)
+  {
+    struct IndexPreloadWaiter waiter;
 
-  result = (mCounter < 999);
+    waiter.task = FindTask(NULL);
+    waiter.mask = (1UL << waitSignal);
+    AddTail((struct List *)&preloader->waiters, (struct Node *)&waiter);
 
-  free(dateFilePart);
+    ReleaseSemaphore(preloader->lock);
+    Wait(waiter.mask);
+    ObtainSemaphore(preloader->lock);
 
-  RETURN(result);
-  return result;
+    Remove((struct Node *)&waiter);
+    FreeSignal(waitSignal);
+  }
+  else
+  {
+    // no free signal left, check again a little later
+    ReleaseSemaphore(preloader->lock);
+    Delay(1);
+    ObtainSemaphore(preloader->lock);
+  }
+
+  LEAVE();
 }
 
 ///
-/// MA_DetectUUE
-//  Checks if message contains an uuencoded file
-static BOOL MA_DetectUUE(FILE *fh)
+/// SignalIndexPreloadWaiters
+//  Wakes up all tasks waiting for the preloader, the preloader's lock must
+//  be held
+static void SignalIndexPreloadWaiters(struct IndexPreloader *data)
 {
-  char *buffer = NULL;
-  size_t size = 0;
-  BOOL found = FALSE;
+  struct IndexPreloadWaiter *waiter;
 
   ENTER();
 
-  // Now we process the whole mailfile and check if there is any line that
-  // starts with "begin xxx"
-  while(GetLine(&buffer, &size, fh) >= 7)
+  IterateList(&data->waiters, struct IndexPreloadWaiter *, waiter)
   {
-    // lets check for digit first because this will throw out many others first
-    if(isdigit((int)buffer[6]) && strncmp(buffer, "begin ", 6) == 0)
-    {
-      found = TRUE;
-      break;
-    }
+    Signal(waiter->task, waiter->mask);
   }
 
-  free(buffer);
-
-  RETURN(found);
-  return found;
+  LEAVE();
 }
 
 ///
-/// FindHeader
-// search for a specific header line
-static struct HeaderNode *FindHeader(struct MinList *headerList, const char *name)
+/// RemoveIndexPreload
+//  Removes the preload of a folder from the queue. If the folder is being
+//  loaded right now we wait until the preloader has finished it.
+static struct IndexPreload *RemoveIndexPreload(const struct Folder *folder)
 {
-  struct HeaderNode *result = NULL;
-  struct HeaderNode *hdrNode;
+  struct IndexPreload *result = NULL;
 
   ENTER();
 
-  IterateList(headerList, struct HeaderNode *, hdrNode)
+  if(preloader != NULL)
   {
-    // compare the names
-    if(stricmp(hdrNode->name, name) == 0)
+    ObtainSemaphore(preloader->lock);
+
+    do
     {
-      result = hdrNode;
-      break;
+      struct IndexPreload *preload;
+      BOOL loading = FALSE;
+
+      IterateList(&preloader->queue, struct IndexPreload *, preload)
+      {
+        if(preload->folder == folder)
+        {
+          if(preload->state == IPS_LOADING)
+          {
+            loading = TRUE;
+          }
+          else
+          {
+            Remove((struct Node *)preload);
+            result = preload;
+          }
+
+          break;
+        }
+      }
+
+      if(loading == FALSE)
+        break;
+
+      D(DBF_FOLDER, "waiting for preloaded index of folder '%s'", folder->Name);
+
+      WaitIndexPreloader();
     }
+    while(TRUE);
+
+    ReleaseSemaphore(preloader->lock);
   }
 
   RETURN(result);
@@ -1352,901 +1718,3077 @@ static struct HeaderNode *FindHeader(struct MinList *headerList, const char *nam
 }
 
 ///
-/// SplitAddressLine
-// split a line of addresses into its parts
-static char **SplitAddressLine(const char *line, ULONG *numParts)
+/// ClaimIndexLoad
+//  Marks the index of a folder as being loaded by the calling task. The
+//  state is checked and changed with the folder's mail list locked, so an
+//  index is never loaded or taken over by two tasks at once. Threads wait
+//  until another task has finished loading the index. The main thread does
+//  not wait, because the loading thread might wait for the main thread.
+//  Returns TRUE if the caller must load the index, the previous state is
+//  returned in oldMode in this case.
+static BOOL ClaimIndexLoad(struct Folder *folder, enum LoadedMode *oldMode)
 {
-  char **parts = NULL;
-  int numCommas;
-  const char *cptr;
-  char *lineCopy;
+  BOOL claimed = FALSE;
 
   ENTER();
 
-  *numParts = 0;
-
-  // Count the number of commas in the given line. This is a rough estimation
-  // about how many recipients may exist at most.
-  numCommas = 0;
-  cptr = line;
   do
   {
-    if((cptr = MyStrChr(cptr, ',')) != NULL)
+    enum LoadedMode mode;
+
+    LockMailList(folder->messages);
+
+    mode = folder->LoadedMode;
+    if(mode != LM_VALID && mode != LM_REBUILD && mode != LM_LOADING)
     {
-      cptr++;
-      numCommas++;
+      *oldMode = mode;
+      folder->LoadedMode = LM_LOADING;
+      claimed = TRUE;
     }
+
+    UnlockMailList(folder->messages);
+
+    if(mode != LM_LOADING || IsMainThread() == TRUE)
+      break;
+
+    D(DBF_FOLDER, "waiting for index of folder '%s' to be loaded", folder->Name);
+
+    Delay(1);
   }
-  while(cptr != NULL);
+  while(TRUE);
 
-  SHOWVALUE(DBF_MIME, numCommas);
+  RETURN(claimed);
+  return claimed;
+}
 
-  // we must duplicate the line as we are going to modify it
-  if((lineCopy = strdup(line)) != NULL)
-  {
-    SHOWSTRING(DBF_MIME, lineCopy);
+///
+/// SetLoadedMode
+//  Sets the state of a folder's index after it has been claimed
+static void SetLoadedMode(struct Folder *folder, enum LoadedMode mode)
+{
+  ENTER();
 
-    // Get some memory for the part pointers. We allocate one more than we
-    // counted before, because there is one more recipient than the number
-    // of commas. And even one more to NUL terminate the char** array
-    if((parts = calloc(numCommas+2, sizeof(char *))) != NULL)
-    {
-      char *ptr = lineCopy;
-      ULONG cnt = 0;
+  LockMailList(folder->messages);
+  folder->LoadedMode = mode;
+  UnlockMailList(folder->messages);
 
-      // split the line into the individual parts separated by commas
-      do
-      {
-        char *e;
-        char *p;
+  LEAVE();
+}
 
-        // find the next comma, but respect quotes
-        if((e = MyStrChr(ptr, ',')) != NULL)
-        {
-          // terminate the part string
-          *e++ = '\0';
-        }
+///
+/// TakeIndexPreload
+//  Takes over the mails of a folder which were loaded in the background.
+//  A folder which is still queued is dropped from the queue, because the
+//  caller is going to load it anyway. Returns TRUE if the folder's mails
+//  are valid afterwards.
+static BOOL TakeIndexPreload(struct Folder *folder)
+{
+  BOOL taken = FALSE;
+  struct IndexPreload *preload;
 
-        p = TrimStart(ptr);
-        if(*p != '\0')
-        {
-          // remember the duplicated non-empty part
-          if((parts[cnt] = strdup(p)) == NULL)
-          {
-            // abort in case we couldn't duplicate the string
-            break;
-          }
-          cnt++;
-        }
+  ENTER();
 
-        ptr = e;
-        if(ptr != NULL)
-          ptr = TrimStart(ptr);
-      }
-      while(ptr != NULL);
+  if((preload = RemoveIndexPreload(folder)) != NULL)
+  {
+    if(preload->loaded == TRUE)
+    {
+      D(DBF_FOLDER, "taking over preloaded index of folder '%s'", folder->Name);
 
-      *numParts = cnt;
+      // same as the final steps of MA_LoadIndex()
+      ClearFolderMails(folder, TRUE);
+      folder->journalRecords = preload->tempFolder->journalRecords;
+      MoveFolderContents(folder, preload->tempFolder);
+      SetLoadedMode(folder, LM_VALID);
+
+      if(preload->legacyFormat == TRUE || preload->tornJournal == TRUE)
+        setFlag(folder->Flags, FOFL_MODIFY);
+      else
+        clearFlag(folder->Flags, FOFL_MODIFY);
+
+      if(folder->journalRecords >= FJOURNAL_LIMIT)
+        setFlag(folder->Flags, FOFL_COMPACT);
+
+      taken = TRUE;
     }
 
-    // the duplicated line can be freed again
-    free(lineCopy);
+    FreeIndexPreload(preload);
   }
 
-  D(DBF_MIME, "splitted line into %ld parts", *numParts);
-
-  RETURN(parts);
-  return parts;
+  RETURN(taken);
+  return taken;
 }
 
 ///
-/// IsValidAddressLine
-// check whether the given line of addresses is valid, i.e. all name+address
-// parts are correctly quoted
-static char *ValidateAddressLine(const char *line)
+/// PreloadIndex
+//  Loads the mails of a folder's index into the temporary folder of a
+//  preload. Missing or corrupt indexes are left to MA_LoadIndex(), which
+//  rebuilds them as soon as the folder is needed.
+static BOOL PreloadIndex(struct IndexPreload *preload)
 {
-  char *validLine = NULL;
-  char **parts;
-  ULONG numParts;
+  struct Folder *folder = preload->folder;
+  char indexFileName[SIZE_PATHFILE];
+  ULONG indexFileSize;
+  BOOL loaded = FALSE;
 
   ENTER();
 
-  // Certain MS software creates invalid address lines if the recipients name contains
-  // accented characters and has reversed first and last name separated by a comma.
-  // In this case the complete name will be encoded as quoted printable *without* being
-  // enclosed in quotes.
-  // For example a mail contains this address line:
-  // =?iso-8859-1?Q?_DoE9=2C_John= <john.doe@anonymous.com>
-  // After decoding the string looks like this (note the missing quotes):
-  // Do, John <john.doe@anonymous.com>
-  // If such a line is parsed as usual assuming that two full addresses are separated
-  // by a comma then we will get two false recipients:
-  // 1. "Do"
-  // 2. "John <john.doe@anonymous.com>"
-  // none of which is really correct.
-  // Therefore we split the complete string into parts separated by commas while respecting
-  // correctly quoted commas. After that the parts are combined again to an address line
-  // and any missing quotes will be inserted as necessary.
-
-  SHOWSTRING(DBF_MIME, line);
+  AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
 
-  // split the line into its parts
-  if((parts = SplitAddressLine(line, &numParts)) != NULL)
+  if(ObtainFileInfo(indexFileName, FI_SIZE, &indexFileSize) == TRUE && indexFileSize >= sizeof(struct FIndex))
   {
-    if(numParts == 1)
-    {
-      // a single part is just taken as it is
-      dstrcpy(&validLine, parts[0]);
-    }
-    else if(numParts >= 2)
+    FILE *fh;
+
+    if((fh = fopen(indexFileName, "r")) != NULL)
     {
-      ULONG i = 0;
-      char *part;
-      BOOL openQuotePending = FALSE;
+      struct FIndex fi;
 
-      // now check if each part contains at least the @ character to make
-      // it a valid address
-      while(i < numParts)
+      setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
+
+      if(fread(&fi, sizeof(fi), 1, fh) == 1 && (fi.ID == FINDEX_VER || fi.ID == FINDEX_HEAP_VER) &&
+         (preload->tempFolder = AllocFolder()) != NULL)
       {
-        part = parts[i];
-        i++;
-        if(part != NULL)
+        BOOL corrupt = FALSE;
+
+        STARTCLOCK(DBF_FOLDER);
+
+        if(LoadIndexMails(fh, indexFileName, indexFileSize, fi.ID, folder, preload->tempFolder, &corrupt, &preload->legacyFormat, &preload->tornJournal) == TRUE &&
+           corrupt == FALSE && ferror(fh) == 0)
         {
-          SHOWSTRING(DBF_MIME, part);
+          loaded = TRUE;
+        }
 
-          if(validLine != NULL)
-            dstrcat(&validLine, ", ");
+        STOPCLOCK(DBF_FOLDER, "preloading index");
+      }
 
-          if(strchr(part, '@') == NULL)
-          {
-            BOOL atAppended = FALSE;
+      fclose(fh);
+    }
+  }
 
-            D(DBF_MIME, "line part '%s' contains no '@' character", part);
+  RETURN(loaded);
+  return loaded;
+}
 
-            // Now we combine a new recipient of the current and the following parts
-            // until we finally find a part which contains the @ character.
+///
+/// IsPreloadedBefore
+//  Returns TRUE if the first folder's index should be preloaded before the
+//  second one. The incoming folder comes first, then the most recently
+//  changed indexes.
+static BOOL IsPreloadedBefore(const struct IndexPreload *p1, const struct IndexPreload *p2)
+{
+  BOOL incoming1 = isIncomingFolder(p1->folder);
+  BOOL incoming2 = isIncomingFolder(p2->folder);
+  BOOL before;
 
-            // Most probably the @-less part was created because there was an unquoted
-            // comma, so we add the missing quotes. They cause no harm.
-            dstrcat(&validLine, "\"");
-            dstrcat(&validLine, part);
-            openQuotePending = TRUE;
+  if(incoming1 != incoming2)
+    before = incoming1;
+  else
+    before = (p1->indexDate > p2->indexDate);
 
-            do
-            {
-              dstrcat(&validLine, ", ");
+  return before;
+}
 
-              part = parts[i];
-              i++;
-              if(part != NULL)
-              {
-                SHOWSTRING(DBF_MIME, part);
+///
+/// MA_GetIndex
+//  Opens/unlocks a folder
+BOOL MA_GetIndex(struct Folder *folder)
+{
+  BOOL result = FALSE;
+
+  ENTER();
+
+  if(folder != NULL && isGroupFolder(folder) == FALSE)
+  {
+    enum LoadedMode oldMode;
+
+    D(DBF_FOLDER, "folder: '%s' path: '%s' type: %ld mode: %ld pw '%s'", folder->Name, folder->Fullpath, folder->Type, folder->LoadedMode, folder->Password);
+
+    // check that the folder is in a valid state for
+    // getting the index and that nobody else is loading it
+    if(ClaimIndexLoad(folder, &oldMode) == TRUE)
+    {
+      BOOL canLoadIndex;
+
+      // check the protected status of the folder and prompt
+      // the user for the password in case it is required.
+      if(isProtectedFolder(folder) == FALSE || folder->Password[0] == '\0')
+        canLoadIndex = TRUE;
+      else
+        canLoadIndex = MA_PromptFolderPassword(folder, G->MA->GUI.WI);
+
+      if(canLoadIndex == TRUE)
+      {
+        // take over the mails preloaded in the background, otherwise load
+        // the index file (and eventually rebuild it)
+        if(TakeIndexPreload(folder) == FALSE)
+          SetLoadedMode(folder, MA_LoadIndex(folder, TRUE));
+
+        // we need to refresh the entry in the folder listtree this folder belongs to
+        // but only if there is a GUI already!
+        if(folder->LoadedMode == LM_VALID)
+        {
+          MA_ValidateStatus(folder);
+        }
+        else
+          W(DBF_MAIL, "status of loaded folder '%s' != LM_VALID (%ld)", folder->Name, folder->LoadedMode);
+
+        if(G->MA != NULL)
+          DisplayStatistics(folder, FALSE);
+      }
+      else
+      {
+        W(DBF_FOLDER, "password of protected folder '%s' could not be verified!", folder->Name);
+        SetLoadedMode(folder, oldMode);
+      }
+    }
+
+    // set the lastAccessTime of the folder to the current time
+    // so that the index expunge timer knows when to free the folder
+    // index in case it hasn't been touched for a certain time
+    folder->lastAccessTime = GetDateStamp();
+
+    // check if the index is valid
+    result = (BOOL)(folder->LoadedMode == LM_VALID);
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// MA_StartIndexPreload
+//  Starts loading the indexes of the folders which should be available
+//  right after startup in the background. The main thread has to wait only
+//  if one of these folders is needed before it was loaded.
+void MA_StartIndexPreload(void)
+{
+  ENTER();
+
+  if(preloader == NULL && (preloader = calloc(1, sizeof(*preloader))) != NULL)
+  {
+    if((preloader->lock = AllocSysObjectTags(ASOT_SEMAPHORE, TAG_DONE)) != NULL)
+    {
+      struct FolderNode *fnode;
+
+      NewMinList(&preloader->queue);
+      NewMinList(&preloader->waiters);
+
+      LockFolderListShared(G->folders);
+
+      ForEachFolderNode(G->folders, fnode)
+      {
+        struct Folder *folder = fnode->folder;
+
+        // only folders with a valid .index header are preloaded, all others
+        // must be rebuilt by MA_GetIndex() anyway
+        if(folder != NULL && !isGroupFolder(folder) && folder->LoadedMode == LM_FLUSHED &&
+           (C->LoadAllFolders == TRUE || isIncomingFolder(folder) || isOutgoingFolder(folder) || isDraftsFolder(folder) || isTrashFolder(folder)) &&
+           !isProtectedFolder(folder) &&
+           !isArchiveFolder(folder))
+        {
+          struct IndexPreload *preload;
+
+          if((preload = calloc(1, sizeof(*preload))) != NULL)
+          {
+            char indexFileName[SIZE_PATHFILE];
+            struct IndexPreload *pred = NULL;
+            struct IndexPreload *other;
+
+            preload->folder = folder;
+            preload->state = IPS_QUEUED;
+
+            AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
+            ObtainFileInfo(indexFileName, FI_TIME, &preload->indexDate);
+
+            // keep the queue ordered by priority
+            IterateList(&preloader->queue, struct IndexPreload *, other)
+            {
+              if(IsPreloadedBefore(preload, other) == TRUE)
+                break;
+
+              pred = other;
+            }
+
+            Insert((struct List *)&preloader->queue, (struct Node *)preload, (struct Node *)pred);
+          }
+        }
+      }
+
+      UnlockFolderList(G->folders);
+
+      if(IsMinListEmpty(&preloader->queue) == FALSE)
+      {
+        preloader->running = TRUE;
+
+        if(DoAction(NULL, TA_PreloadIndexes, TT_PreloadIndexes_Data, preloader,
+                                             TAG_DONE) == NULL)
+        {
+          // the queued folders will be loaded upon their first use
+          W(DBF_FOLDER, "could not start thread to preload folder indexes");
+          preloader->running = FALSE;
+        }
+      }
+    }
+    else
+    {
+      free(preloader);
+      preloader = NULL;
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// MA_StopIndexPreload
+//  Stops loading indexes in the background and frees all preloaded mails
+//  which have not been taken over yet
+void MA_StopIndexPreload(void)
+{
+  ENTER();
+
+  if(preloader != NULL)
+  {
+    struct IndexPreload *preload;
+    struct IndexPreload *succ;
+
+    // let the thread stop after the current folder and wait for it
+    ObtainSemaphore(preloader->lock);
+
+    preloader->stop = TRUE;
+    while(preloader->running == TRUE)
+      WaitIndexPreloader();
+
+    ReleaseSemaphore(preloader->lock);
+
+    SafeIterateList(&preloader->queue, struct IndexPreload *, preload, succ)
+    {
+      FreeIndexPreload(preload);
+    }
+
+    FreeSysObject(ASOT_SEMAPHORE, preloader->lock);
+    free(preloader);
+    preloader = NULL;
+  }
+
+  LEAVE();
+}
+
+///
+/// MA_CancelIndexPreload
+//  Drops the preload of a folder, i.e. because the folder is about to be
+//  deleted or its index becomes invalid
+void MA_CancelIndexPreload(struct Folder *folder)
+{
+  struct IndexPreload *preload;
+
+  ENTER();
+
+  if((preload = RemoveIndexPreload(folder)) != NULL)
+  {
+    D(DBF_FOLDER, "cancelled preload of folder '%s'", folder->Name);
+    FreeIndexPreload(preload);
+  }
+
+  LEAVE();
+}
+
+///
+/// MA_FinishIndexPreload
+//  Takes over the mails of a folder as soon as the preloader has finished
+//  it, called by the main thread upon the preloader's notification
+void MA_FinishIndexPreload(struct Folder *folder)
+{
+  ENTER();
+
+  if(preloader != NULL)
+  {
+    struct IndexPreload *preload;
+    BOOL done = FALSE;
+
+    ObtainSemaphore(preloader->lock);
+
+    IterateList(&preloader->queue, struct IndexPreload *, preload)
+    {
+      if(preload->folder == folder)
+      {
+        done = (preload->state == IPS_DONE);
+        break;
+      }
+    }
+
+    ReleaseSemaphore(preloader->lock);
+
+    // MA_GetIndex() takes over the preloaded mails, if the index was
+    // loaded otherwise in the meantime the preload is outdated
+    if(done == TRUE)
+    {
+      MA_GetIndex(folder);
+      MA_CancelIndexPreload(folder);
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// MA_PreloadIndexes
+//  Thread entry point to load the indexes of the queued folders one by one
+LONG MA_PreloadIndexes(struct IndexPreloader *data)
+{
+  LONG preloaded = 0;
+
+  ENTER();
+
+  do
+  {
+    struct IndexPreload *preload = NULL;
+    struct IndexPreload *next;
+    struct Folder *folder;
+    BOOL loaded;
+
+    // pick the queued folder with the highest priority
+    ObtainSemaphore(data->lock);
+
+    if(data->stop == FALSE && ThreadWasAborted() == FALSE)
+    {
+      IterateList(&data->queue, struct IndexPreload *, next)
+      {
+        if(next->state == IPS_QUEUED)
+        {
+          next->state = IPS_LOADING;
+          preload = next;
+          break;
+        }
+      }
+    }
+
+    // tell the waiting tasks that we are done
+    if(preload == NULL)
+    {
+      data->running = FALSE;
+      SignalIndexPreloadWaiters(data);
+    }
+
+    ReleaseSemaphore(data->lock);
+
+    if(preload == NULL)
+      break;
+
+    // the preload may be freed as soon as it is marked as done
+    folder = preload->folder;
+
+    D(DBF_FOLDER, "preloading index of folder '%s'", folder->Name);
+
+    loaded = PreloadIndex(preload);
+
+    ObtainSemaphore(data->lock);
+    preload->loaded = loaded;
+    preload->state = IPS_DONE;
+    SignalIndexPreloadWaiters(data);
+    ReleaseSemaphore(data->lock);
+
+    if(loaded == TRUE)
+    {
+      preloaded++;
+
+      // let the main thread take over the mails
+      PushMethodOnStack(G->App, 2, MUIM_YAMApplication_FinishIndexPreload, folder);
+    }
+  }
+  while(TRUE);
+
+  D(DBF_FOLDER, "thread '%s' preloaded %ld indexes", ThreadName(), preloaded);
+
+  RETURN(preloaded);
+  return preloaded;
+}
+
+///
+/// MA_ExpireIndex
+//  Invalidates a folder index
+void MA_ExpireIndex(struct Folder *folder)
+{
+  ENTER();
+
+  // a preloaded index would be outdated
+  MA_CancelIndexPreload(folder);
+
+  if(!isModified(folder))
+  {
+    char indexFileName[SIZE_PATHFILE];
+    char journalFileName[SIZE_PATHFILE];
+
+    AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
+    DeleteFile(indexFileName);
+
+    // the journal is useless without the index
+    AddPath(journalFileName, folder->Fullpath, ".journal", sizeof(journalFileName));
+    DeleteFile(journalFileName);
+    folder->journalRecords = 0;
+  }
+
+  setFlag(folder->Flags, FOFL_MODIFY);
+
+  LEAVE();
+}
+
+///
+/// MA_JournalIndex
+//  Records a single change of a folder in its index journal instead of
+//  rewriting the complete index. The change must have been applied to the
+//  folder already. If recording is not possible the index is expired.
+void MA_JournalIndex(struct Folder *folder, enum IndexJournalType type, const char *mailFile, const struct Mail *mail)
+{
+  BOOL recorded = FALSE;
+  char indexFileName[SIZE_PATHFILE];
+
+  ENTER();
+
+  // a preloaded index would miss this change
+  MA_CancelIndexPreload(folder);
+
+  AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
+
+  // the journal makes sense only as long as the index file reflects the
+  // folder's mails, otherwise the complete index is rewritten anyway
+  if(!isModified(folder) && FileExists(indexFileName) == TRUE)
+  {
+    char journalFileName[SIZE_PATHFILE];
+    BOOL newJournal;
+    FILE *fh;
+
+    AddPath(journalFileName, folder->Fullpath, ".journal", sizeof(journalFileName));
+    newJournal = (FileExists(journalFileName) == FALSE);
+
+    if((fh = fopen(journalFileName, "a")) != NULL)
+    {
+      struct FJournalRecord jr;
+      char *buf = NULL;
+      UTF8 *utf8buf = NULL;
+      BOOL systemIsUTF8 = (G->systemCodeset != NULL && G->systemCodeset->name != NULL && stricmp(G->systemCodeset->name, "utf-8") == 0);
+
+      // we clear it first, so that unused fields are also 0
+      memset(&jr, 0, sizeof(jr));
+      jr.type = type;
+      strlcpy(jr.mailFile, mailFile, sizeof(jr.mailFile));
+      jr.Total = folder->Total;
+      jr.New = folder->New;
+      jr.Unread = folder->Unread;
+      jr.Size = folder->Size;
+      strlcpy(jr.cmail.mailFile, mail->MailFile, sizeof(jr.cmail.mailFile));
+      jr.cmail.date = mail->Date;
+      jr.cmail.transDate = mail->transDate;
+      jr.cmail.sflags = mail->sflags;
+      jr.cmail.mflags = mail->mflags;
+      // we have to make sure that the volatile flag field isn't saved
+      setVOLValue(&jr.cmail, 0);
+      jr.cmail.cMsgID = mail->cMsgID;
+      jr.cmail.cIRTMsgID = mail->cIRTMsgID;
+      jr.cmail.size = mail->Size;
+
+      recorded = TRUE;
+
+      if(type == IJT_ADD)
+      {
+        // only new mails need the strings, just like the FINDEX_VER format,
+        // the message ID must not be truncated, hence no fixed size buffer
+        if(asprintf(&buf, "%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n",
+                          mail->Subject,
+                          mail->From.Address, mail->From.RealName,
+                          mail->To.Address, mail->To.RealName,
+                          mail->ReplyTo.Address, mail->ReplyTo.RealName,
+                          mail->MailAccount,
+                          (mail->MsgID != NULL) ? mail->MsgID : "") == -1)
+        {
+          buf = NULL;
+        }
+        else if(systemIsUTF8 == TRUE)
+        {
+          // no conversion required
+          utf8buf = (UTF8 *)buf;
+          jr.cmail.moreBytes = strlen(buf);
+        }
+        else
+        {
+          utf8buf = CodesetsUTF8Create(CSA_Source, buf,
+                                       CSA_SourceCodeset, G->systemCodeset,
+                                       CSA_DestLenPtr, &jr.cmail.moreBytes,
+                                       TAG_DONE);
+        }
+
+        // the strings must fit into the buffer used when replaying the journal
+        if(utf8buf == NULL || jr.cmail.moreBytes >= FJOURNAL_STRINGS_SIZE)
+          recorded = FALSE;
+      }
+
+      if(recorded == TRUE)
+      {
+        ULONG id = FJOURNAL_VER;
+
+        // a new journal starts with its version ID
+        if((newJournal == TRUE && fwrite(&id, sizeof(id), 1, fh) != 1) ||
+           fwrite(&jr, sizeof(jr), 1, fh) != 1 ||
+           (jr.cmail.moreBytes > 0 && fwrite(utf8buf, jr.cmail.moreBytes, 1, fh) != 1))
+        {
+          E(DBF_FOLDER, "couldn't write index journal record of mail '%s'", mailFile);
+          recorded = FALSE;
+        }
+      }
+
+      if(utf8buf != NULL && systemIsUTF8 == FALSE)
+      {
+        // free the codesets buffer
+        CodesetsFreeA(utf8buf, NULL);
+      }
+
+      free(buf);
+
+      if(fclose(fh) != 0)
+        recorded = FALSE;
+    }
+
+    if(recorded == TRUE)
+    {
+      D(DBF_FOLDER, "recorded change %ld of mail '%s' in index journal of folder '%s'", type, mailFile, folder->Name);
+
+      // let the next index flush rewrite the index once the journal grew too large
+      folder->journalRecords++;
+      if(folder->journalRecords >= FJOURNAL_LIMIT)
+        setFlag(folder->Flags, FOFL_COMPACT);
+    }
+  }
+
+  // fall back to a complete rewrite of the index
+  if(recorded == FALSE)
+    MA_ExpireIndex(folder);
+
+  LEAVE();
+}
+
+///
+/// MA_RebuildIndexes
+//  Rebuild indices of all folders
+void MA_RebuildIndexes(void)
+{
+  struct Folder **rebuildFolders;
+  struct Folder **scanFolders;
+  BOOL *scanResults;
+  ULONG numRebuild = 0;
+  ULONG numScan = 0;
+
+  ENTER();
+
+  LockFolderListShared(G->folders);
+
+  rebuildFolders = calloc(G->folders->count + 1, sizeof(*rebuildFolders));
+  scanFolders = calloc(G->folders->count + 1, sizeof(*scanFolders));
+  scanResults = calloc(G->folders->count + 1, sizeof(*scanResults));
+
+  if(rebuildFolders != NULL && scanFolders != NULL && scanResults != NULL)
+  {
+    struct FolderNode *fnode;
+    ULONG i;
+
+    // first find out which folders need a rebuilt index
+    ForEachFolderNode(G->folders, fnode)
+    {
+      struct Folder *folder = fnode->folder;
+
+      if(folder != NULL && !isGroupFolder(folder))
+      {
+        char indexFileName[SIZE_PATHFILE];
+        char journalFileName[SIZE_PATHFILE];
+        ULONG dirDate;
+        ULONG indexDate;
+        ULONG journalDate;
+
+        AddPath(indexFileName, folder->Fullpath, ".index", sizeof(indexFileName));
+        AddPath(journalFileName, folder->Fullpath, ".journal", sizeof(journalFileName));
+
+        // get date of the folder directory and the .index file
+        // itself
+        if(ObtainFileInfo(folder->Fullpath, FI_TIME, &dirDate) == TRUE &&
+           ObtainFileInfo(indexFileName, FI_TIME, &indexDate) == TRUE)
+        {
+          // changes recorded in the journal are part of the index as well
+          if(indexDate > 0 && ObtainFileInfo(journalFileName, FI_TIME, &journalDate) == TRUE && journalDate > indexDate)
+            indexDate = journalDate;
+
+          // only consider starting to rebuilding the .index if
+          // either the date of the directory is greater than the
+          // date of the .index file itself, or if there is no index
+          // file date at all (no file present)
+          if(dirDate > indexDate + 30)
+          {
+            ULONG dirProtection;
+            ULONG indexProtection;
+
+            // get the protection bits of the folder index file
+            // and the folder directory, and if both have the A
+            // bit set we skip the index rescanning process because
+            // the A bits might have been set by a backup program
+            if(ObtainFileInfo(folder->Fullpath, FI_PROTECTION, &dirProtection) == TRUE &&
+               ObtainFileInfo(indexFileName, FI_PROTECTION, &indexProtection) == TRUE)
+            {
+              if(isFlagClear(indexProtection, FIBF_ARCHIVE) ||
+                 isFlagClear(dirProtection, FIBF_ARCHIVE))
+              {
+                // lets first delete the .index file to
+                // make sure MA_GetIndex() is going to
+                // rebuild it.
+                if(indexDate > 0)
+                {
+                  DeleteFile(indexFileName);
+                  DeleteFile(journalFileName);
+                }
+
+                // the folders that should update their indexes during startup
+                // are rescanned all at once
+                if((isIncomingFolder(folder) || isOutgoingFolder(folder) ||
+                    isTrashFolder(folder) || C->LoadAllFolders) &&
+                   !isProtectedFolder(folder) &&
+                   folder->LoadedMode != LM_VALID && folder->LoadedMode != LM_REBUILD)
+                {
+                  ClearFolderMails(folder, TRUE);
+                  scanFolders[numScan++] = folder;
+                }
+
+                rebuildFolders[numRebuild++] = folder;
+              }
+            }
+          }
+        }
+      }
+    }
+
+    // now rescan the mail files of all these folders concurrently
+    if(numScan > 0)
+    {
+      ScanMailBoxes(scanFolders, scanResults, numScan);
+
+      for(i=0; i < numScan; i++)
+      {
+        struct Folder *folder = scanFolders[i];
+
+        if(scanResults[i] == TRUE && MA_SaveIndex(folder) == TRUE)
+        {
+          folder->LoadedMode = LM_VALID;
+          MA_ValidateStatus(folder);
+        }
+        else
+        {
+          // MA_GetIndex() will try again
+          ClearFolderMails(folder, TRUE);
+          folder->LoadedMode = LM_UNLOAD;
+        }
+
+        if(G->MA != NULL)
+          DisplayStatistics(folder, FALSE);
+      }
+    }
+
+    for(i=0; i < numRebuild; i++)
+    {
+      struct Folder *folder = rebuildFolders[i];
+
+      // then lets call GetIndex() to finish rebuilding
+      // the .index - but only if this folder is one of the folders
+      // that should update it indexes during startup
+      if((isIncomingFolder(folder) || isOutgoingFolder(folder) ||
+          isTrashFolder(folder) || C->LoadAllFolders) &&
+         !isProtectedFolder(folder))
+      {
+        if(MA_GetIndex(folder) == TRUE)
+        {
+          // if we finally rebuilt the .index we
+          // immediatly flush it here so that another
+          // following index rebuild doesn't take
+          // all remaining memory.
+          if((isSentFolder(folder) || !isDefaultFolder(folder)) &&
+              folder->LoadedMode == LM_VALID &&
+              isFreeAccess(folder))
+          {
+            if(isModified(folder))
+              MA_SaveIndex(folder);
+
+            ClearFolderMails(folder, FALSE);
+            folder->LoadedMode = LM_FLUSHED;
+            clearFlag(folder->Flags, FOFL_FREEXS);
+          }
+        }
+      }
+      else
+      {
+        // otherwise we make sure everything is cleared
+        ClearFolderMails(folder, FALSE);
+        folder->LoadedMode = LM_FLUSHED;
+        clearFlag(folder->Flags, FOFL_FREEXS);
+      }
+    }
+  }
+
+  free(rebuildFolders);
+  free(scanFolders);
+  free(scanResults);
+
+  UnlockFolderList(G->folders);
+
+  LEAVE();
+}
+
+///
+
+/*** Private functions ***/
+/// MA_ChangeFolder
+//  Changes to another folder
+void MA_ChangeFolder(struct Folder *folder, BOOL set_active)
+{
+  struct Folder *current;
+
+  ENTER();
+
+  if((current = GetCurrentFolder()) != NULL)
+  {
+    BOOL folderChanged = TRUE;
+
+    if(folder == NULL)
+      folder = current;
+    else if(folder == current)
+      folderChanged = FALSE;
+    else if(set_active == TRUE)
+    {
+      ActivateFolder(folder);
+      current = folder;
+    }
+
+    if(folder != NULL && folderChanged == TRUE)
+    {
+      struct MA_GUIData *gui = &G->MA->GUI;
+
+      // in case the main window has an embedded read pane, we have to
+      // clear it before changing the actual folder
+      if(C->EmbeddedReadPane == TRUE)
+        DoMethod(gui->MN_EMBEDDEDREADPANE, MUIM_ReadMailGroup_Clear, MUIF_NONE);
+
+      // if this folder should be disabled, lets do it now
+      if(isGroupFolder(folder) || MA_GetIndex(folder) == FALSE)
+      {
+        DoMethod(gui->PG_MAILLIST, MUIM_NList_Clear);
+        xset(gui->PG_MAILLIST, MUIA_Disabled,     TRUE,
+                               MUIA_NList_Active, MUIV_NList_Active_Off);
+
+        // set the quickbar as disabled as well and abort a search still in progress
+        if(C->QuickSearchBarPos != QSB_POS_OFF)
+        {
+          xset(gui->GR_QUICKSEARCHBAR, MUIA_Disabled, TRUE,
+                                       MUIA_QuickSearchBar_AbortSearch, TRUE);
+        }
+
+        // also set an embedded read pane as disabled.
+        if(C->EmbeddedReadPane == TRUE)
+          set(gui->MN_EMBEDDEDREADPANE, MUIA_Disabled, TRUE);
+
+        DoMethod(gui->IB_INFOBAR, MUIM_InfoBar_SetFolder, folder);
+
+        // make sure the main mail list noticies that
+        // the selection has changed so that if a user reactivates a valid
+        // folder the main mail list will get updated accordingly.
+        MA_ChangeSelected(TRUE);
+      }
+      else if(folder == current) // check again for the current folder
+      {
+        // set the SortFlag in the NList accordingly
+        MA_SetSortFlag();
+
+        // Now we update the InfoBar accordingly
+        DoMethod(gui->IB_INFOBAR, MUIM_InfoBar_SetFolder, folder);
+
+        // enable an embedded read pane again
+        if(C->EmbeddedReadPane == TRUE)
+          set(gui->MN_EMBEDDEDREADPANE, MUIA_Disabled, FALSE);
+
+        // In case the main window has an quicksearchbar, we have to
+        // clear it as well before changing the folder. We also abort
+        // a search still being in progress.
+        if(C->QuickSearchBarPos != QSB_POS_OFF)
+        {
+          set(gui->GR_QUICKSEARCHBAR, MUIA_QuickSearchBar_AbortSearch, TRUE);
+          DoMethod(gui->GR_QUICKSEARCHBAR, MUIM_QuickSearchBar_Clear);
+        }
+
+        // create the Mail List and display it
+        DoMethod(gui->PG_MAILLIST, MUIM_MainMailListGroup_DisplayMailsOfFolder, folder);
+
+        // Force an update of the current mail.
+        // Usually this should be done upon a notification trigger by NList.
+        // Unfortunately NList doesn't seem to trigger notifications in "quiet"
+        // mode. But we are lucky here, because the update must be done manually
+        // for empty folders anyway, hence this call doesn't hurt.
+        MA_ChangeSelected(TRUE);
+      }
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// MA_ConvertOldMailFile
+// This function takes a fileinfoblock and a folder and converts the
+// oldstyle mailfile referred by fib to a new YAM 2.5+ conform mail file.
+static char *MA_ConvertOldMailFile(char *filename, struct Folder *folder)
+{
+  char dateFilePart[13];  // the base64 encoded date part occupies 12+1 bytes
+  char statusFilePart[4]; // we only need 3+1 bytes for the status flags here
+  char oldFilePath[SIZE_PATHFILE+1];
+  char *statusPartPtr = statusFilePart;
+  char *comment;
+  char *ptr;
+  char *result = filename;
+
+  ENTER();
+
+  // clear
+  dateFilePart[0] = '\0';
+  statusFilePart[0] = '\0';
+
+  // construct the full path of the old filename
+  // and get the file comment
+  AddPath(oldFilePath, folder->Fullpath, filename, sizeof(oldFilePath));
+  if(ObtainFileInfo(oldFilePath, FI_COMMENT, &comment) == FALSE || comment == NULL)
+  {
+    RETURN(NULL);
+    return NULL;
+  }
+
+  // for a proper conversion we have to take mainly the file comment into
+  // account as in there all status information aswell as the transfer
+  // data was stored in YAM versions prior to 2.5
+  if(comment[0] != '\0')
+  {
+    // read out the mailstatus - which was normally the first character
+    // of the comment
+    switch(comment[0])
+    {
+      case 'U':
+        // nothing
+      break;
+
+      case 'R':
+        *statusPartPtr++ = SCHAR_READ;
+        *statusPartPtr++ = SCHAR_REPLIED;
+      break;
+
+      case 'F':
+        *statusPartPtr++ = SCHAR_READ;
+        *statusPartPtr++ = SCHAR_FORWARDED;
+      break;
+
+      case 'W':
+        *statusPartPtr++ = SCHAR_READ;
+      break;
+
+      case 'H':
+        *statusPartPtr++ = SCHAR_READ;
+      break;
+
+      case 'O':
+        *statusPartPtr++ = SCHAR_READ;
+      break;
+
+      case 'E':
+        *statusPartPtr++ = SCHAR_ERROR;
+      break;
+
+      case 'S':
+        *statusPartPtr++ = SCHAR_READ;
+        *statusPartPtr++ = SCHAR_SENT;
+      break;
+
+      case 'N':
+      default:
+        *statusPartPtr++ = SCHAR_NEW;
+      break;
+    }
+
+    // now we check if second char is present and if we set the mailfag
+    // as "marked" and the arexx permanent flag
+    if(comment[1] != '\0' && comment[1] != ' ')
+    {
+      int pval = 0;
+
+      // we have to check for the permanent flag also.
+      if(comment[1] >= 'M' && comment[1] <= 'M'+7)
+      {
+        *statusPartPtr++ = SCHAR_MARKED;
+
+        pval = comment[1]-'M';
+      }
+      else if(comment[1] >= '1' && comment[1] <= '7')
+      {
+        pval = comment[1]-'1'+1;
+      }
+
+      if(pval > 0)
+        *statusPartPtr++ = '0'+pval;
+    }
+
+    *statusPartPtr = '\0'; // NUL terminate the status part
+
+    // we check if this comment also has the transfer Date included
+    // we only take the string if it is exactly 12bytes long or
+    // otherwise it could be some weird data in the Comment string
+    if(comment[1] != '\0' && comment[2] != '\0' && comment[14] == '\0')
+    {
+      // ok we have the transfer Date, so lets put it at the beginning of
+      // the new filename
+      strlcpy(dateFilePart, &comment[2], sizeof(dateFilePart));
+    }
+  }
+
+  // free the duplicated comment again
+  free(comment);
+
+  if(dateFilePart[0] == '\0')
+  {
+    struct TimeVal newDate;
+    char *b64_dateFilePart = NULL;
+
+    // so we don't seem to have a transfer Date in the file comment.
+    // What we do now is that we take the date from the original file
+    // (the first 5 numerical numbers are the days)
+    newDate.Seconds = atol(filename) * 24 * 60 * 60;
+    newDate.Microseconds = 0;
+
+    // encode this date as a base64 encoded string
+    if(base64encode(&b64_dateFilePart, (char *)&newDate, sizeof(newDate)) > 0)
+    {
+      if(strlcpy(dateFilePart, b64_dateFilePart, sizeof(dateFilePart)) > sizeof(dateFilePart))
+        W(DBF_ALWAYS, "length of b64_dateFilePart > dateFilePart");
+
+      free(b64_dateFilePart);
+    }
+    else
+      E(DBF_ALWAYS, "Error when trying to base64 encode dateFilePart");
+  }
+
+  // as the dateFilePart may contain slashes "/" we have to replace them
+  // with "-" chars to don't drive the filesystem crazy :)
+  ptr = dateFilePart;
+  while((ptr = strchr(ptr, '/')) != NULL)
+    *ptr = '-';
+
+  do
+  {
+    static char newFileName[SIZE_MFILE];
+    char newFilePath[SIZE_PATHFILE+1];
+
+    // ok, now we should have all main parts of the new filename, so we
+    // can concatenate it to one new filename and try to rename the old
+    // style mailfile to the newstyle equivalent.
+    snprintf(newFileName, sizeof(newFileName), "%s.001,%s", dateFilePart, statusFilePart);
+
+    // so, now we should be finished with finding the new filename of the mail file.
+    // lets try to rename it with the dos.library's Rename() function
+    if(AddPath(newFilePath, folder->Fullpath, newFileName, sizeof(newFilePath)) == NULL)
+    {
+      result = NULL;
+      break;
+    }
+
+    // try to rename it and if it fails go and find out if we have to increase
+    // the mail counter or not.
+    if(Rename(oldFilePath, newFilePath) == 0)
+    {
+      char pattern[15+1];
+      LONG mailCounter;
+
+      // search for files matching the dateFilePart
+      snprintf(pattern, sizeof(pattern), "%s.#?", dateFilePart);
+      mailCounter = FileCount(folder->Fullpath, pattern);
+
+      // if we didn't find any matching file then this signals
+      // another error than an already existing file!
+      if(mailCounter <= 0)
+      {
+        E(DBF_FOLDER, "  error on renaming '%s' to '%s'", oldFilePath, newFilePath);
+        result = NULL;
+        break;
+      }
+
+      // let us now try it again to rename the file
+      snprintf(newFileName, sizeof(newFileName), "%s.%03d,%s", dateFilePart, (unsigned int)(++mailCounter), statusFilePart);
+      if(AddPath(newFilePath, folder->Fullpath, newFileName, sizeof(newFilePath)) == NULL)
+      {
+        result = NULL;
+        break;
+      }
+
+      // try to rename it and if it fails finally return an error
+      if(Rename(oldFilePath, newFilePath) == 0)
+      {
+        E(DBF_FOLDER, "  error on renaming '%s' to '%s'", oldFilePath, newFilePath);
+        result = NULL;
+        break;
+      }
+    }
+
+    result = newFileName;
+
+    // and to make everything as clean as possible, lets erase
+    // the filecomment as YAM 2.5+ doesn't require file comments anymore
+    SetComment(newFilePath, "");
+  }
+  while(FALSE);
+
+  // return failure if we didn't change anything
+  if(result == filename)
+    result = NULL;
+
+  RETURN(result);
+  return result;
+}
+///
+/// CompressMsgID
+//  Creates a crc32 checksum of the MsgID, so that it can be used later
+//  for the follow-up algorithms aso.
+static unsigned long CompressMsgID(const char *msgid)
+{
+  unsigned long id = 0;
+
+  ENTER();
+
+  // if the MsgID is valid we calculate the CRC32 checksum and as it
+  // consists only of one cycle through the crc function we call it
+  // with -1
+  if(IsStrEmpty(msgid) == FALSE)
+  {
+    char *end;
+    size_t len;
+
+    // skip the leading angle bracket (see RFC 4130)
+    if(msgid[0] == '<')
+      msgid++;
+
+    // find the trailing angle bracket and skip it (see RFC 4130)
+    if((end = strchr(msgid, '>')) != NULL)
+      len = end-msgid+1;
+    else
+    {
+      W(DBF_MAIL, "can't find closing '>' in msgid '%s'", msgid);
+      len = strlen(msgid);
+    }
+
+    // calculate the CRC32 checksum for the compressed
+    // message ID
+    id = CRC32(msgid, len, -1L);
+  }
+  else
+    W(DBF_MAIL, "couldn't calculate compressed MsgID from empty string");
+
+  RETURN(id);
+  return id;
+}
+
+///
+/// CompressReferences
+//  Creates the list of compressed message IDs of the References: header
+//  followed by the In-Reply-To: message ID, unless this is the last
+//  reference anyway. Only the last MAILTHREAD_MAXREFS IDs are kept.
+static unsigned long *CompressReferences(const char *references, unsigned long cIRTMsgID)
+{
+  unsigned long *refs = NULL;
+  ULONG numRefs = 0;
+  ULONG skipRefs = 0;
+  const char *p;
+
+  ENTER();
+
+  if(references != NULL)
+  {
+    // count the references first
+    for(p = references; (p = strchr(p, '<')) != NULL; p++)
+      numRefs++;
+
+    if(numRefs > MAILTHREAD_MAXREFS)
+    {
+      skipRefs = numRefs - MAILTHREAD_MAXREFS;
+      numRefs = MAILTHREAD_MAXREFS;
+    }
+  }
+
+  if((numRefs > 0 || cIRTMsgID != 0) && (refs = malloc((numRefs + 2) * sizeof(*refs))) != NULL)
+  {
+    ULONG i = 0;
+
+    if(numRefs > 0)
+    {
+      for(p = references; (p = strchr(p, '<')) != NULL; p++)
+      {
+        unsigned long id;
+
+        if(skipRefs > 0)
+          skipRefs--;
+        else if((id = CompressMsgID(p)) != 0 && (i == 0 || refs[i-1] != id))
+          refs[i++] = id;
+      }
+    }
+
+    if(cIRTMsgID != 0 && (i == 0 || refs[i-1] != cIRTMsgID))
+      refs[i++] = cIRTMsgID;
+
+    refs[i] = 0;
+  }
+
+  RETURN(refs);
+  return refs;
+}
+
+///
+/// FindMailByMsgID
+// find a mail by message-id in the given folder
+struct Mail *FindMailByMsgID(struct Folder *folder, const char *msgid)
+{
+  struct Mail *result = NULL;
+  struct Mail **mails;
+  ULONG numMails;
+  unsigned long msgidCRC;
+
+  ENTER();
+
+  msgidCRC = CompressMsgID(msgid);
+
+  LockMailList(folder->messages);
+
+  // the compressed message-ids are looked up for speed reasons
+  if((mails = LookupMsgIDTable(folder, msgidCRC, FALSE, &numMails)) != NULL)
+  {
+    ULONG i;
+
+    for(i=0; i < numMails; i++)
+    {
+      struct Mail *mail = mails[i];
+
+      // now go into detail and check if the full message-id matches
+      if(mail->MsgID != NULL)
+      {
+        if(strcmp(mail->MsgID, msgid) == 0)
+          result = mail;
+      }
+      else
+      {
+        struct ExtendedMail *email;
+
+        // the index didn't know the full message-id, so we have to
+        // check the mail file itself
+        if((email = MA_ExamineMail(folder, mail->MailFile, TRUE)) != NULL)
+        {
+          if(strcmp(email->messageID, msgid) == 0)
+          {
+            // return the mail
+            result = mail;
+          }
+
+          MA_FreeEMailStruct(email);
+        }
+      }
+
+      if(result != NULL)
+        break;
+    }
+  }
+
+  UnlockMailList(folder->messages);
+
+  RETURN(result);
+  return result;
+}
+
+///
+
+/*** Mail header scanning ***/
+/// MA_NewMailFile
+//  Function that creates a new plain mail filename or by taking provided
+//  data into account. It returns the full path to the new mail file in the
+//  folder and also writes it into the mailfile parameter
+BOOL MA_NewMailFile(const struct Folder *folder, char *fullPath, const size_t fullPathSize)
+{
+  char *dateFilePart = NULL;
+  char newFileName[SIZE_MFILE];
+  char *ptr;
+  struct TimeVal curDate;
+  int mCounter;
+  BOOL result;
+
+  ENTER();
+
+  // take the current time and use it as the datePart of the
+  // new mailfile name
+  GetSysTimeUTC(&curDate);
+
+  // encode this date as a base64 encoded string
+  base64encode(&dateFilePart, (char *)&curDate, sizeof(curDate));
+
+  // as the dateFilePart may contain slashes "/" we have to replace them
+  // with "-" chars to not drive the filesystem crazy :)
+  ptr = dateFilePart;
+  while((ptr = strchr(ptr, '/')) != NULL)
+    *ptr = '-';
+
+  mCounter = 0;
+  do
+  {
+    snprintf(newFileName, sizeof(newFileName), "%s.%03d,N", dateFilePart, ++mCounter);
+
+    AddPath(fullPath, folder->Fullpath, newFileName, fullPathSize);
+
+    // don't care about duplicate files in the drafts folder
+    if(isDraftsFolder(folder) == TRUE)
+      break;
+  }
+  while(mCounter < 999 && FileExists(fullPath) == TRUE);
+
+  result = (mCounter < 999);
+
+  free(dateFilePart);
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// MA_DetectUUE
+//  Checks if message contains an uuencoded file
+static BOOL MA_DetectUUE(FILE *fh)
+{
+  char *buffer = NULL;
+  size_t size = 0;
+  BOOL found = FALSE;
+
+  ENTER();
+
+  // Now we process the whole mailfile and check if there is any line that
+  // starts with "begin xxx"
+  while(GetLine(&buffer, &size, fh) >= 7)
+  {
+    // lets check for digit first because this will throw out many others first
+    if(isdigit((int)buffer[6]) && strncmp(buffer, "begin ", 6) == 0)
+    {
+      found = TRUE;
+      break;
+    }
+  }
+
+  free(buffer);
+
+  RETURN(found);
+  return found;
+}
+
+///
+/// FindHeader
+// search for a specific header line
+static struct HeaderNode *FindHeader(struct MinList *headerList, const char *name)
+{
+  struct HeaderNode *result = NULL;
+  struct HeaderNode *hdrNode;
+
+  ENTER();
+
+  IterateList(headerList, struct HeaderNode *, hdrNode)
+  {
+    // compare the names
+    if(stricmp(hdrNode->name, name) == 0)
+    {
+      result = hdrNode;
+      break;
+    }
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// SplitAddressLine
+// split a line of addresses into its parts
+static char **SplitAddressLine(const char *line, ULONG *numParts)
+{
+  char **parts = NULL;
+  int numCommas;
+  const char *cptr;
+  char *lineCopy;
+
+  ENTER();
+
+  *numParts = 0;
+
+  // Count the number of commas in the given line. This is a rough estimation
+  // about how many recipients may exist at most.
+  numCommas = 0;
+  cptr = line;
+  do
+  {
+    if((cptr = MyStrChr(cptr, ',')) != NULL)
+    {
+      cptr++;
+      numCommas++;
+    }
+  }
+  while(cptr != NULL);
+
+  SHOWVALUE(DBF_MIME, numCommas);
+
+  // we must duplicate the line as we are going to modify it
+  if((lineCopy = strdup(line)) != NULL)
+  {
+    SHOWSTRING(DBF_MIME, lineCopy);
+
+    // Get some memory for the part pointers. We allocate one more than we
+    // counted before, because there is one more recipient than the number
+    // of commas. And even one more to NUL terminate the char** array
+    if((parts = calloc(numCommas+2, sizeof(char *))) != NULL)
+    {
+      char *ptr = lineCopy;
+      ULONG cnt = 0;
+
+      // split the line into the individual parts separated by commas
+      do
+      {
+        char *e;
+        char *p;
+
+        // find the next comma, but respect quotes
+        if((e = MyStrChr(ptr, ',')) != NULL)
+        {
+          // terminate the part string
+          *e++ = '\0';
+        }
+
+        p = TrimStart(ptr);
+        if(*p != '\0')
+        {
+          // remember the duplicated non-empty part
+          if((parts[cnt] = strdup(p)) == NULL)
+          {
+            // abort in case we couldn't duplicate the string
+            break;
+          }
+          cnt++;
+        }
+
+        ptr = e;
+        if(ptr != NULL)
+          ptr = TrimStart(ptr);
+      }
+      while(ptr != NULL);
+
+      *numParts = cnt;
+    }
+
+    // the duplicated line can be freed again
+    free(lineCopy);
+  }
+
+  D(DBF_MIME, "splitted line into %ld parts", *numParts);
+
+  RETURN(parts);
+  return parts;
+}
+
+///
+/// IsValidAddressLine
+// check whether the given line of addresses is valid, i.e. all name+address
+// parts are correctly quoted
+static char *ValidateAddressLine(const char *line)
+{
+  char *validLine = NULL;
+  char **parts;
+  ULONG numParts;
+
+  ENTER();
+
+  // Certain MS software creates invalid address lines if the recipients name contains
+  // accented characters and has reversed first and last name separated by a comma.
+  // In this case the complete name will be encoded as quoted printable *without* being
+  // enclosed in quotes.
+  // For example a mail contains this address line:
+  // =?iso-8859-1?Q?_DoE9=2C_John= <john.doe@anonymous.com>
+  // After decoding the string looks like this (note the missing quotes):
+  // Do, John <john.doe@anonymous.com>
+  // If such a line is parsed as usual assuming that two full addresses are separated
+  // by a comma then we will get two false recipients:
+  // 1. "Do"
+  // 2. "John <john.doe@anonymous.com>"
+  // none of which is really correct.
+  // Therefore we split the complete string into parts separated by commas while respecting
+  // correctly quoted commas. After that the parts are combined again to an address line
+  // and any missing quotes will be inserted as necessary.
+
+  SHOWSTRING(DBF_MIME, line);
+
+  // split the line into its parts
+  if((parts = SplitAddressLine(line, &numParts)) != NULL)
+  {
+    if(numParts == 1)
+    {
+      // a single part is just taken as it is
+      dstrcpy(&validLine, parts[0]);
+    }
+    else if(numParts >= 2)
+    {
+      ULONG i = 0;
+      char *part;
+      BOOL openQuotePending = FALSE;
+
+      // now check if each part contains at least the @ character to make
+      // it a valid address
+      while(i < numParts)
+      {
+        part = parts[i];
+        i++;
+        if(part != NULL)
+        {
+          SHOWSTRING(DBF_MIME, part);
+
+          if(validLine != NULL)
+            dstrcat(&validLine, ", ");
+
+          if(strchr(part, '@') == NULL)
+          {
+            BOOL atAppended = FALSE;
+
+            D(DBF_MIME, "line part '%s' contains no '@' character", part);
+
+            // Now we combine a new recipient of the current and the following parts
+            // until we finally find a part which contains the @ character.
+
+            // Most probably the @-less part was created because there was an unquoted
+            // comma, so we add the missing quotes. They cause no harm.
+            dstrcat(&validLine, "\"");
+            dstrcat(&validLine, part);
+            openQuotePending = TRUE;
+
+            do
+            {
+              dstrcat(&validLine, ", ");
+
+              part = parts[i];
+              i++;
+              if(part != NULL)
+              {
+                SHOWSTRING(DBF_MIME, part);
+
+                // check whether this is the part containing the address
+                if(strchr(part, '@') != NULL)
+                {
+                  char *addrStart;
+
+                  // look for the beginning of the address
+                  if((addrStart = strstr(part, " <")) != NULL)
+                  {
+                    // temporarily terminate the part before the address and add it to the line
+                    *addrStart = '\0';
+
+                    // append the first part
+                    dstrcat(&validLine, part);
+
+                    // add the closing quote
+                    dstrcat(&validLine, "\"");
+                    openQuotePending = FALSE;
+
+                    // restore the space and continue with the remaining part
+                    *addrStart = ' ';
+                    part = addrStart;
+                  }
+                  atAppended = TRUE;
+                }
+
+                dstrcat(&validLine, part);
+              }
+            }
+            while(i < numParts && atAppended == FALSE);
+          }
+          else
+          {
+            // this is a valid part, just append it
+            dstrcat(&validLine, part);
+          }
+        }
+      }
+
+      // close any still opened quote
+      if(openQuotePending == TRUE)
+        dstrcat(&validLine, "\"");
+    }
+
+    // free the array of parts
+    FreeStrArray(parts);
+  }
+
+  RETURN(validLine);
+  return validLine;
+}
+
+///
+/// InitHeaderParser
+//  Prepares parsing the header lines of a mail line by line
+static void InitHeaderParser(struct HeaderParser *hp, const char *mailFile, struct MinList *headerList)
+{
+  ENTER();
+
+  // clear the headerList first
+  NewMinList(headerList);
+
+  hp->headerList = headerList;
+  hp->hdrNode = NULL;
+  hp->mailFile = mailFile;
+
+  LEAVE();
+}
+
+///
+/// CompleteHeaderNode
+//  Decodes the header line parsed so far and adds it to the list of headers,
+//  returns FALSE in case of an error
+static BOOL CompleteHeaderNode(struct HeaderParser *hp)
+{
+  struct HeaderNode *hdrNode = hp->hdrNode;
+  BOOL success = TRUE;
+  char *ptr;
+  int len;
+
+  ENTER();
+
+  hp->hdrNode = NULL;
+
+  // we first decode the header according to RFC 2047 which
+  // should give us the full charset interpretation
+  if((len = rfc2047_decode(hdrNode->content, hdrNode->content, dstrlen(hdrNode->content))) == -1)
+  {
+    E(DBF_FOLDER, "ERROR: malloc() error during rfc2047() decoding");
+    FreeHeaderNode(hdrNode);
+    success = FALSE;
+  }
+  else
+  {
+    if(len == -2)
+    {
+      W(DBF_FOLDER, "WARNING: unknown header encoding found");
+
+      // signal an error but continue.
+      ER_NewError(tr(MSG_ER_UNKNOWN_HEADER_ENCODING), hdrNode->content, hp->mailFile);
+    }
+    else if(len == -3)
+    {
+      W(DBF_FOLDER, "WARNING: rfc2047 (base64) header decoding failed");
+    }
+
+    // now that we have decoded the headerline accoring to rfc2047
+    // we have to strip out eventually existing ESC sequences as
+    // this can be dangerous with MUI.
+    for(ptr=hdrNode->content; *ptr; ptr++)
+    {
+      // if we find an ESC sequence, strip it!
+      if(*ptr == 0x1b)
+        *ptr = ' ';
+    }
+
+    // the headerNode seems to be finished so we put it into our
+    // headerList
+    D(DBF_MIME, "add header '%s' with content '%s'", hdrNode->name, hdrNode->content);
+    AddTail((struct List *)hp->headerList, (struct Node *)hdrNode);
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// ParseHeaderLine
+//  Parses a single non-empty header line without its line end, lines
+//  which belong together are concatenated. Returns FALSE in case of an error.
+static BOOL ParseHeaderLine(struct HeaderParser *hp, char *line)
+{
+  BOOL success = TRUE;
+
+  ENTER();
+
+  // if the start of this line is a space or a tabulator sign
+  // this line belongs to the last header also and we have to
+  // add it to the last one.
+  if(line[0] == ' ' || line[0] == '\t')
+  {
+    if(hp->hdrNode != NULL)
+    {
+      char *ptr;
+
+      // move to the "real" start of the string so that we can copy
+      // from there to our previous header.
+      for(ptr = line; *ptr && isspace(*ptr); ptr++);
+
+      // insert a space in case we are extending a previously parsed content
+      if(dstrlen(hp->hdrNode->content) != 0)
+        dstrcat(&hp->hdrNode->content, " ");
+
+      // now concatenate this new headerstring to our previous one
+      dstrcat(&hp->hdrNode->content, ptr);
+    }
+  }
+  else
+  {
+    // it seems that we have found another header line because
+    // it didn't start with a linear-white-space, so lets
+    // first validate the previous one, if it exists.
+    if(hp->hdrNode != NULL && CompleteHeaderNode(hp) == FALSE)
+    {
+      success = FALSE;
+    }
+    // now that we have finished the last header line
+    // we can finally start processing a new one.
+    // Which means we allocate a new HeaderNode and try to get out the header
+    // name
+    else if((hp->hdrNode = AllocHeaderNode()) != NULL)
+    {
+      char *ptr;
+
+      // now we try to find the name of the header (ends with a ':' and no white space
+      // or control character in between
+      for(ptr = line; *ptr; ptr++)
+      {
+        if(*ptr == ':')
+          break;
+        else if(*ptr < 33 || *ptr > 126)
+        {
+          ptr = NULL;
+          break;
+        }
+      }
+
+      if(IsStrEmpty(ptr) == FALSE)
+      {
+        *ptr++ = '\0';
+
+        // use our dstrcpy() function to copy the name of the header
+        // into our ->name element
+        if(dstrcpy(&hp->hdrNode->name, line) != NULL)
+        {
+          // now we copy also the rest of buffer into the contents
+          // of the headerNode
+          // NOTE: this might be an empty string in case the contents
+          // start on the next line. Thus we must not check the return
+          // value to indicate that something has been copied.
+          dstrcpy(&hp->hdrNode->content, Trim(ptr));
+
+          // everything seemed to work fine, so lets continue
+          RETURN(success);
+          return success;
+        }
+      }
+
+      // if we end up here then something went wrong and we have to clear
+      // the header node and stuff
+      FreeHeaderNode(hp->hdrNode);
+      hp->hdrNode = NULL;
+    }
+    else
+      success = FALSE;
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// FinishHeaderParser
+//  Completes the last header line after the end of the header has been
+//  reached. If parsing failed before the pending line is just discarded.
+static BOOL FinishHeaderParser(struct HeaderParser *hp, BOOL success)
+{
+  ENTER();
+
+  if(hp->hdrNode != NULL)
+  {
+    if(success == TRUE)
+      success = CompleteHeaderNode(hp);
+    else
+    {
+      FreeHeaderNode(hp->hdrNode);
+      hp->hdrNode = NULL;
+    }
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// RepairAddressHeaders
+//  Validates the address lines of mails created by broken software
+static void RepairAddressHeaders(struct MinList *headerList)
+{
+  struct HeaderNode *microsuckHeader;
+
+  ENTER();
+
+  // So far only Microsoft Exchange seems to generate broken address lines.
+  // Time will show if this will become an longer list...
+  if((microsuckHeader = FindHeader(headerList, "x-mimeole")) != NULL && strstr(microsuckHeader->content, "Microsoft Exchange") != NULL)
+  {
+    const char *addressLineNames[] =
+    {
+      "from", "to", "reply-to", "cc", "bcc"
+    };
+    ULONG i;
+
+    D(DBF_MIME, "mail was created by possibly broken Microsoft software ('%s'), validating address lines", microsuckHeader->content);
+
+    // iterate over the possibly malformed header lines
+    for(i = 0; i < ARRAY_SIZE(addressLineNames); i++)
+    {
+      struct HeaderNode *addressHeader;
+
+      if((addressHeader = FindHeader(headerList, addressLineNames[i])) != NULL)
+      {
+        // Check whether potential EMail address are valid.
+        // Buggy Microsoft software very often creates invalid addresses,
+        // i.e 'lastname, firstname <address>' without the necessary quotes around the name
+        char *validLine;
+
+        D(DBF_MIME, "validating '%s' header with content '%s'", addressHeader->name, addressHeader->content);
+
+        if((validLine = ValidateAddressLine(addressHeader->content)) != NULL)
+        {
+          dstrfree(addressHeader->content);
+          addressHeader->content = validLine;
+        }
+      }
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// MA_ReadHeader
+//  Reads header lines of a message into memory
+BOOL MA_ReadHeader(const char *mailFile, FILE *fh, struct MinList *headerList, enum ReadHeaderMode mode)
+{
+  BOOL success = FALSE;
+
+  ENTER();
+
+  if(headerList != NULL)
+  {
+    struct HeaderParser hp;
+    unsigned int linesread = 0;
+    char *buffer = NULL;
+    size_t size = 0;
+
+    D(DBF_MIME, "reading header lines of mail file '%s'", mailFile);
+
+    InitHeaderParser(&hp, mailFile, headerList);
+    success = TRUE;
+
+    // we read out the whole header line by line up to the first empty
+    // line, the parser concatenates lines that are belonging together.
+    while(GetLine(&buffer, &size, fh) >= 0 && (++linesread, buffer[0] != '\0'))
+    {
+      if(ParseHeaderLine(&hp, buffer) == FALSE)
+      {
+        success = FALSE;
+        break;
+      }
+    }
+
+    success = FinishHeaderParser(&hp, success);
+
+    // if we haven't had success in reading the headers
+    // we make sure we clean everything up. If we read no
+    // headers at all we return a failure. But if we were able to
+    // read a single empty line it is a signal that this part of
+    // the mail doesn't have any header at all (which may be valid)
+    if(success == FALSE)
+      ClearHeaderList(headerList);
+    else if(IsMinListEmpty(headerList) == TRUE &&
+            (mode == RHM_MAINHEADER || IsStrEmpty(buffer) == FALSE || linesread != 1))
+    {
+      W(DBF_MAIL, "no required header data found while scanning '%s'", mailFile);
+      success = FALSE;
+    }
+
+    free(buffer);
+  }
+
+  if(success == TRUE)
+    RepairAddressHeaders(headerList);
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// MA_FreeEMailStruct
+//  Frees an extended email structure
+void MA_FreeEMailStruct(struct ExtendedMail *email)
+{
+  ENTER();
+
+  if(email != NULL)
+  {
+    dstrfree(email->SenderInfo);
+    email->SenderInfo = NULL;
+
+    dstrfree(email->extraHeaders);
+    email->extraHeaders = NULL;
+
+    dstrfree(email->messageID);
+    email->messageID = NULL;
+
+    FreeMailData(&email->Mail);
+
+    dstrfree(email->inReplyToMsgID);
+    email->inReplyToMsgID = NULL;
+
+    dstrfree(email->references);
+    email->references = NULL;
+
+    if(email->SFrom != NULL)
+    {
+      ASSERT(email->NumSFrom > 0);
+
+      free(email->SFrom);
+      email->SFrom = NULL;
+      email->NumSFrom = 0;
+    }
+
+    if(email->STo != NULL)
+    {
+      ASSERT(email->NumSTo > 0);
+
+      free(email->STo);
+      email->STo = NULL;
+      email->NumSTo = 0;
+    }
+
+    if(email->SReplyTo != NULL)
+    {
+      ASSERT(email->NumSReplyTo > 0);
+
+      free(email->SReplyTo);
+      email->SReplyTo = NULL;
+      email->NumSReplyTo = 0;
+    }
+
+    if(email->CC != NULL)
+    {
+      ASSERT(email->NumCC > 0);
+
+      free(email->CC);
+      email->CC = NULL;
+      email->NumCC = 0;
+    }
+
+    if(email->BCC != NULL)
+    {
+      ASSERT(email->NumBCC > 0);
+
+      free(email->BCC);
+      email->BCC = NULL;
+      email->NumBCC = 0;
+    }
+
+    if(email->ResentTo != NULL)
+    {
+      ASSERT(email->NumResentTo > 0);
+
+      free(email->ResentTo);
+      email->ResentTo = NULL;
+      email->NumResentTo = 0;
+    }
+
+    if(email->ResentCC != NULL)
+    {
+      ASSERT(email->NumResentCC > 0);
+
+      free(email->ResentCC);
+      email->ResentCC = NULL;
+      email->NumResentCC = 0;
+    }
+
+    if(email->ResentBCC != NULL)
+    {
+      ASSERT(email->NumResentBCC > 0);
+
+      free(email->ResentBCC);
+      email->ResentBCC = NULL;
+      email->NumResentBCC = 0;
+    }
+
+    if(email->FollowUpTo != NULL)
+    {
+      ASSERT(email->NumFollowUpTo > 0);
+
+      free(email->FollowUpTo);
+      email->FollowUpTo = NULL;
+      email->NumFollowUpTo = 0;
+    }
+
+    if(email->MailReplyTo != NULL)
+    {
+      ASSERT(email->NumMailReplyTo > 0);
+
+      free(email->MailReplyTo);
+      email->MailReplyTo = NULL;
+      email->NumMailReplyTo = 0;
+    }
+
+    FreeExtendedMail(email);
+  }
+
+  LEAVE();
+}
+
+///
+/// MA_GetRecipients
+//  Extracts recipients from a header field
+static int MA_GetRecipients(char *h, struct Person **per)
+{
+  int cnt = 0;
+  char *p = h;
+
+  ENTER();
+
+  while(*p != '\0')
+  {
+    cnt++;
+    if((p = MyStrChr(p, ',')) != NULL)
+      p++;
+    else
+      break;
+  }
 
-                // check whether this is the part containing the address
-                if(strchr(part, '@') != NULL)
-                {
-                  char *addrStart;
+  if(cnt > 0)
+  {
+    // allocate enough memory to carry all
+    // found recipients in an array of struct Person
+    // structures.
+    if((*per = calloc(cnt, sizeof(struct Person))) != NULL)
+    {
+      struct Person *cur = *per;
 
-                  // look for the beginning of the address
-                  if((addrStart = strstr(part, " <")) != NULL)
-                  {
-                    // temporarily terminate the part before the address and add it to the line
-                    *addrStart = '\0';
+      for(p=h; *p; cur++)
+      {
+        char *next;
 
-                    // append the first part
-                    dstrcat(&validLine, part);
+        if((next = MyStrChr(p, ',')) != NULL)
+          *next++ = '\0';
 
-                    // add the closing quote
-                    dstrcat(&validLine, "\"");
-                    openQuotePending = FALSE;
+        ExtractAddress(p, cur);
 
-                    // restore the space and continue with the remaining part
-                    *addrStart = ' ';
-                    part = addrStart;
-                  }
-                  atAppended = TRUE;
-                }
+        D(DBF_MIME, "extracted rcpt: '%s' '%s'", cur->RealName, cur->Address);
 
-                dstrcat(&validLine, part);
-              }
-            }
-            while(i < numParts && atAppended == FALSE);
-          }
-          else
-          {
-            // this is a valid part, just append it
-            dstrcat(&validLine, part);
-          }
-        }
+        p = next;
+        if(p == NULL)
+          break;
       }
-
-      // close any still opened quote
-      if(openQuotePending == TRUE)
-        dstrcat(&validLine, "\"");
     }
-
-    // free the array of parts
-    FreeStrArray(parts);
+    else
+      cnt = 0;
   }
+  else
+    *per = NULL;
 
-  RETURN(validLine);
-  return validLine;
+  RETURN(cnt);
+  return cnt;
 }
 
 ///
-/// MA_ReadHeader
-//  Reads header lines of a message into memory
-BOOL MA_ReadHeader(const char *mailFile, FILE *fh, struct MinList *headerList, enum ReadHeaderMode mode)
+/// MA_ScanDate
+//  Converts textual date header into datestamp format
+static BOOL MA_ScanDate(struct Mail *mail, const char *date)
 {
   BOOL success = FALSE;
+  int count = 0;
+  int day = 0;
+  int mon = 0;
+  int year = 0;
+  int hour = 0;
+  int min = 0;
+  int sec = 0;
+  int gmtOffset = INT_MIN; // INT_MIN means not set
+  char *s;
+  char tdate[SIZE_SMALL];
+  char ttime[SIZE_SMALL];
+  char tzAbbr[SIZE_SMALL];
+  struct DateTime dt;
+  BOOL nonRFC2822 = FALSE;
 
   ENTER();
 
-  if(headerList != NULL)
+  D(DBF_MAIL, "parse date from '%s'", date);
+
+  // make sure to skip the weekday definition if it exists
+  if((s = strpbrk(date, " |;,")) != NULL)
   {
-    unsigned int linesread = 0;
-    char *buffer = NULL;
-    size_t size = 0;
-    BOOL finished = FALSE;
-    struct HeaderNode *hdrNode = NULL;
+    // check if we did reach here because the whole
+    // weekday definition was missing
+    if(isspace(*s) && isdigit(*date))
+      s = (char *)date;
+    else
+      s++;
+  }
+  else
+  {
+    W(DBF_MAIL, "no starting separator found");
 
-    D(DBF_MIME, "reading header lines of mail file '%s'", mailFile);
+    s = (char *)date;
+  }
+
+  // ensure a valid time zone abbreviation string
+  // in case the parsing process fails to find one
+  tzAbbr[0] = '\0';
+
+  // skip leading spaces
+  while(*s && isspace(*s))
+    s++;
+
+  while(*s)
+  {
+    char *e;
 
-    // clear the headerList first
-    NewMinList(headerList);
+    if((e = strpbrk(s, " |;,")) == NULL)
+      e = s+strlen(s);
 
-    // we read out the whole header line by line and
-    // concatenate lines that are belonging together.
-    while((GetLine(&buffer, &size, fh) >= 0 && (++linesread, buffer[0] != '\0')) ||
-          (finished == FALSE && (finished = TRUE)))
+    switch(count)
     {
-      // if the start of this line is a space or a tabulator sign
-      // this line belongs to the last header also and we have to
-      // add it to the last one.
-      if((buffer[0] == ' ' || buffer[0] == '\t') && finished == FALSE)
+      // get the day
+      case 0:
       {
-        if(hdrNode != NULL)
-        {
-          char *ptr;
+        char *end;
 
-          // move to the "real" start of the string so that we can copy
-          // from there to our previous header.
-          for(ptr = buffer; *ptr && isspace(*ptr); ptr++);
+        day = strtol(s, &end, 10);
+        if(day <= 0 || day > 31)
+        {
+          W(DBF_MAIL, "couldn't parse day from '%s'", s);
 
-          // insert a space in case we are extending a previously parsed content
-          if(dstrlen(hdrNode->content) != 0)
-            dstrcat(&hdrNode->content, " ");
+          day = 1;
+        }
 
-          // now concatenate this new headerstring to our previous one
-          dstrcat(&hdrNode->content, ptr);
+        // gracefully handle possible non RFC-2822 conformant dates which use
+        // a '-' character instead of a space as separator
+        if(end != e && end[0] == '-')
+        {
+          W(DBF_MAIL, "non RFC 2822 conformant date string '%s'", date);
+          nonRFC2822 = TRUE;
+          e = &end[1];
         }
       }
-      else
+      break;
+
+      // get the month
+      case 1:
       {
-        // it seems that we have found another header line because
-        // it didn't start with a linear-white-space, so lets
-        // first validate the previous one, if it exists.
-        if(hdrNode != NULL)
+        for(mon = 1; mon <= 12; mon++)
         {
-          char *ptr;
-          int len;
+          if(strnicmp(s, months[mon-1], 3) == 0)
+            break;
+        }
 
-          // we first decode the header according to RFC 2047 which
-          // should give us the full charset interpretation
-          if((len = rfc2047_decode(hdrNode->content, hdrNode->content, dstrlen(hdrNode->content))) == -1)
-          {
-            E(DBF_FOLDER, "ERROR: malloc() error during rfc2047() decoding");
-            break; // break-out
-          }
-          else if(len == -2)
-          {
-            W(DBF_FOLDER, "WARNING: unknown header encoding found");
+        if(mon > 12)
+        {
+          W(DBF_MAIL, "couldn't parse month from '%s'", s);
+          mon = 1;
+        }
 
-            // signal an error but continue.
-            ER_NewError(tr(MSG_ER_UNKNOWN_HEADER_ENCODING), hdrNode->content, mailFile);
-          }
-          else if(len == -3)
-          {
-            W(DBF_FOLDER, "WARNING: rfc2047 (base64) header decoding failed");
-          }
+        // gracefully handle possible non RFC-2822 conformant dates which use
+        // a '-' character instead of a space as separator
+        if(nonRFC2822 == TRUE && strlen(s) >= 4 && s[3] == '-')
+          e = &s[4];
+      }
+      break;
 
-          // now that we have decoded the headerline accoring to rfc2047
-          // we have to strip out eventually existing ESC sequences as
-          // this can be dangerous with MUI.
-          for(ptr=hdrNode->content; *ptr; ptr++)
-          {
-            // if we find an ESC sequence, strip it!
-            if(*ptr == 0x1b)
-              *ptr = ' ';
-          }
+      // get the year
+      case 2:
+      {
+        char *end;
 
-          // the headerNode seems to be finished so we put it into our
-          // headerList
-          D(DBF_MIME, "add header '%s' with content '%s'", hdrNode->name, hdrNode->content);
-          AddTail((struct List *)headerList, (struct Node *)hdrNode);
+        year = strtol(s, &end, 10);
+        // gracefully handle the obsolete 2-digit year specs
+        if(year < 100)
+        {
+          W(DBF_MAIL, "obsolete year spec '%s' found", s);
+          // numbers from 78 to 99 are considered to be 1978 to 1999,
+          // everything else is 2000 to 2077
+          if(year >= 78)
+            year += 1900;
+          else
+            year += 2000;
         }
 
-        // if we are finished we break out here
-        if(finished == TRUE)
+        if(year < 1978 || year > 2038)
         {
-          success = TRUE;
-          break;
+          W(DBF_MAIL, "couldn't parse year from '%s'", s);
+          year = 1978;
         }
 
-        // now that we have finished the last header line
-        // we can finally start processing a new one.
-        // Which means we allocate a new HeaderNode and try to get out the header
-        // name
-        if((hdrNode = AllocHeaderNode()) != NULL)
-        {
-          char *ptr;
+        // no further special handling for non RFC 2822 conformant dates required
+      }
+      break;
 
-          // now we try to find the name of the header (ends with a ':' and no white space
-          // or control character in between
-          for(ptr = buffer; *ptr; ptr++)
+      // get the time values
+      case 3:
+      {
+        if(sscanf(s, "%d:%d:%d", &hour, &min, &sec) != 3)
+        {
+          if(sscanf(s, "%d:%d", &hour, &min) == 2)
+            sec = 0;
+          else
           {
-            if(*ptr == ':')
-              break;
-            else if(*ptr < 33 || *ptr > 126)
-            {
-              ptr = NULL;
-              break;
-            }
+            W(DBF_MAIL, "couldn't parse time from '%s'", s);
+
+            hour = 0;
+            min = 0;
+            sec = 0;
           }
+        }
+      }
+      break;
+
+      // get the gmt offset (+0000 / -0000)
+      case 4:
+      {
+        // skip any leading parentheses
+        while(*s && *s == '(')
+          s++;
+
+        // check that the gmtOffset string starts with "+" or "-" or
+        // with a numeric value or otherwise the date string doesn't
+        // have a GMT offset but comes with a timezone abbreviation
+        if(*s == '+' || *s == '-' || isdigit(*s))
+        {
+          if(isdigit(*s))
+            gmtOffset = atoi(s);
+          else
+            gmtOffset = atoi(&s[1]);
 
-          if(IsStrEmpty(ptr) == FALSE)
+          if(gmtOffset != 0 && gmtOffset/100 == 0)
           {
-            *ptr++ = '\0';
+            char *c;
+
+            // multiply by 100 so that we have now a correct format
+            gmtOffset *= 100;
+
+            // then check if we have a : to seperate HH:MM and add the minutes
+            // to tzcorr
+            if((c = strchr(s, ':')))
+              gmtOffset += atoi(c);
+          }
+
+          // now we have to distingush between + and -
+          if(s[0] == '-')
+            gmtOffset = -gmtOffset;
+
+          // convert to minutes now
+          gmtOffset = (gmtOffset/100)*60 + (gmtOffset%100);
+        }
+        else
+        {
+          W(DBF_MAIL, "no GMT offset found in date string '%s'", date);
+
+          // make sure the next iteration ends up at the same position
+          e = s;
+        }
+      }
+      break;
+
+      // the textual timezone abbreviation (e.g. 'CET')
+      case 5:
+      {
+        // skip any leading parentheses
+        while(*s && *s == '(')
+          s++;
 
-            // use our dstrcpy() function to copy the name of the header
-            // into our ->name element
-            if(dstrcpy(&hdrNode->name, buffer) != NULL)
-            {
-              // now we copy also the rest of buffer into the contents
-              // of the headerNode
-              // NOTE: this might be an empty string in case the contents
-              // start on the next line. Thus we must not check the return
-              // value to indicate that something has been copied.
-              dstrcpy(&hdrNode->content, Trim(ptr));
-
-              // everything seemed to work fine, so lets continue
-              continue;
-            }
-          }
+        // make sure the first char is A-Za-z
+        if(isalpha(*s))
+        {
+          // remove any ending parentheses
+          while(*(e-1) && *(e-1) == ')')
+            e--;
 
-          // if we end up here then something went wrong and we have to clear
-          // the header node and stuff
-          FreeHeaderNode(hdrNode);
-          hdrNode = NULL;
+          strlcpy(tzAbbr, s, MIN(sizeof(tzAbbr), (unsigned int)(e-s+1)));
         }
         else
-          break;
+          W(DBF_MAIL, "no timezone abbreviation found in date string '%s'", date);
       }
+      break;
     }
 
-    // if we haven't had success in reading the headers
-    // we make sure we clean everything up. If we read no
-    // headers at all we return a failure. But if we were able to
-    // read a single empty line it is a signal that this part of
-    // the mail doesn't have any header at all (which may be valid)
-    if(success == FALSE)
-      ClearHeaderList(headerList);
-    else if(IsMinListEmpty(headerList) == TRUE &&
-            (mode == RHM_MAINHEADER || IsStrEmpty(buffer) == FALSE || linesread != 1))
+    // if we iterated until 4 we can break out
+    if(count == 5)
+      break;
+
+    count++;
+
+    // set the next start to our last search
+    if(*e)
     {
-      W(DBF_MAIL, "no required header data found while scanning '%s'", mailFile);
-      success = FALSE;
-    }
+      // skip leading spaces
+      while(*e && isspace(*e))
+        e++;
 
-    free(buffer);
+      s = e;
+    }
+    else
+      break;
   }
 
-  if(success == TRUE)
+  // then format a standard DateStamp string like string
+  // so that we can use StrToDate()
+  snprintf(tdate, sizeof(tdate), "%02d-%02d-%02d", mon, day, year % 100);
+  snprintf(ttime, sizeof(ttime), "%02d:%02d:%02d", hour, min, sec);
+  dt.dat_Format  = FORMAT_USA;
+  dt.dat_Flags   = 0;
+  dt.dat_StrDate = tdate;
+  dt.dat_StrTime = ttime;
+  if(StrToDate(&dt))
   {
-    struct HeaderNode *microsuckHeader;
+    struct DateStamp *ds = &dt.dat_Stamp;
 
-    // So far only Microsoft Exchange seems to generate broken address lines.
-    // Time will show if this will become an longer list...
-    if((microsuckHeader = FindHeader(headerList, "x-mimeole")) != NULL && strstr(microsuckHeader->content, "Microsoft Exchange") != NULL)
-    {
-      const char *addressLineNames[] =
-      {
-        "from", "to", "reply-to", "cc", "bcc"
-      };
-      ULONG i;
+    // lets see if we found a valid GMT offset
+    if(gmtOffset != INT_MIN)
+      mail->gmtOffset = gmtOffset;
+    else if(tzAbbr[0] != '\0')
+      mail->gmtOffset = TZtoMinutes(tzAbbr);
 
-      D(DBF_MIME, "mail was created by possibly broken Microsoft software ('%s'), validating address lines", microsuckHeader->content);
+    // save the tzone abbreviation
+    SetPooledString(&mail->tzAbbr, tzAbbr, SIZE_SMALL);
 
-      // iterate over the possibly malformed header lines
-      for(i = 0; i < ARRAY_SIZE(addressLineNames); i++)
-      {
-        struct HeaderNode *addressHeader;
+    // bring the date in relation to UTC
+    ds->ds_Minute -= mail->gmtOffset;
 
-        if((addressHeader = FindHeader(headerList, addressLineNames[i])) != NULL)
-        {
-          // Check whether potential EMail address are valid.
-          // Buggy Microsoft software very often creates invalid addresses,
-          // i.e 'lastname, firstname <address>' without the necessary quotes around the name
-          char *validLine;
+    // we need to check the datestamp variable that it is still in it's borders
+    // after the UTC correction
+    while(ds->ds_Minute < 0)     { ds->ds_Minute += 1440; ds->ds_Days--; }
+    while(ds->ds_Minute >= 1440) { ds->ds_Minute -= 1440; ds->ds_Days++; }
 
-          D(DBF_MIME, "validating '%s' header with content '%s'", addressHeader->name, addressHeader->content);
+    // now we do copy the datestamp stuff over the one from our mail
+    memcpy(&mail->Date, ds, sizeof(mail->Date));
 
-          if((validLine = ValidateAddressLine(addressHeader->content)) != NULL)
-          {
-            dstrfree(addressHeader->content);
-            addressHeader->content = validLine;
-          }
-        }
-      }
-    }
+    success = TRUE;
   }
 
   RETURN(success);
   return success;
 }
-
 ///
-/// MA_FreeEMailStruct
-//  Frees an extended email structure
-void MA_FreeEMailStruct(struct ExtendedMail *email)
+/// ExamineMailHeaders
+//  Fills the mail structure from the parsed header lines of a mail
+static void ExamineMailHeaders(struct ExtendedMail *email, const struct Folder *folder, struct MinList *headerList, const BOOL deep)
 {
+  struct Mail *mail = &email->Mail;
+  struct Person pe;
+  BOOL dateFound = FALSE;
+  BOOL foundFrom = FALSE;
+  BOOL foundTo = FALSE;
+  BOOL foundReplyTo = FALSE;
+  char *ptr;
+  char dateFilePart[12+1];
+  struct HeaderNode *hdrNode;
+  struct UserIdentityNode *fromUIN = NULL;
+  struct UserIdentityNode *toUIN = NULL;
+  struct UserIdentityNode *replyToUIN = NULL;
+  struct UserIdentityNode *ccUIN = NULL;
+  struct UserIdentityNode *bccUIN = NULL;
+
   ENTER();
 
-  if(email != NULL)
+  // Now we process the read header to set all flags accordingly.
+  // The identities found within this loop must not be used immediately
+  // for the mail's identity pointer as the single header lines might
+  // appear in arbitrary order.
+  IterateList(headerList, struct HeaderNode *, hdrNode)
   {
-    dstrfree(email->SenderInfo);
-    email->SenderInfo = NULL;
+    char *field = hdrNode->name;
+    char *value = hdrNode->content;
 
-    dstrfree(email->extraHeaders);
-    email->extraHeaders = NULL;
+    if(stricmp(field, "from") == 0)
+    {
+      char *p;
+      foundFrom = TRUE;
 
-    dstrfree(email->messageID);
-    email->messageID = NULL;
+      // find out if there are more than one From: address
+      if((p = MyStrChr(value, ',')) != NULL)
+       *p++ = '\0';
 
-    dstrfree(email->inReplyToMsgID);
-    email->inReplyToMsgID = NULL;
+      // extract the main mail address
+      ExtractAddress(value, &pe);
+      SetMailPerson(&mail->From, pe.Address, pe.RealName);
 
-    dstrfree(email->references);
-    email->references = NULL;
+      // we have to check if we can match the user identity
+      // from the email address
+      if(deep == TRUE)
+      {
+        fromUIN = FindUserIdentityByAddress(&C->userIdentityList, mail->From.Address);
+        D(DBF_MAIL, "finduinByAddr (from): '%s' %08lx", mail->From.Address, fromUIN);
+      }
 
-    if(email->SFrom != NULL)
-    {
-      ASSERT(email->NumSFrom > 0);
+      // if we have more addresses waiting we
+      // go and process them yet
+      if(p != NULL)
+      {
+        if(deep == TRUE)
+        {
+          if(email->NumSFrom == 0)
+            email->NumSFrom = MA_GetRecipients(p, &(email->SFrom));
 
-      free(email->SFrom);
-      email->SFrom = NULL;
-      email->NumSFrom = 0;
-    }
+          if(email->NumSFrom > 0)
+          {
+            int i;
 
-    if(email->STo != NULL)
-    {
-      ASSERT(email->NumSTo > 0);
+            // if we haven't found the identity yet we process the
+            // other from addresses
+            for(i=0; fromUIN == NULL && i < email->NumSFrom; i++)
+            {
+              fromUIN = FindUserIdentityByAddress(&C->userIdentityList, email->SFrom[i].Address);
+              D(DBF_MAIL, "finduinByAddr (from): '%s' %08lx", email->SFrom[i].Address, fromUIN);
+            }
 
-      free(email->STo);
-      email->STo = NULL;
-      email->NumSTo = 0;
-    }
+            setFlag(mail->mflags, MFLAG_MULTISENDER);
+          }
+        }
+        else if(strlen(p) >= 7) // minimum rcpts size "a@bc.de"
+          setFlag(mail->mflags, MFLAG_MULTISENDER);
+      }
 
-    if(email->SReplyTo != NULL)
+      D(DBF_MIME, "'From' senders: %ld", email->NumSFrom+1);
+    }
+    else if(stricmp(field, "reply-to") == 0)
     {
-      ASSERT(email->NumSReplyTo > 0);
+      char *p;
 
-      free(email->SReplyTo);
-      email->SReplyTo = NULL;
-      email->NumSReplyTo = 0;
-    }
+      foundReplyTo = TRUE;
 
-    if(email->CC != NULL)
-    {
-      ASSERT(email->NumCC > 0);
+      // find out if there are more than one ReplyTo: address
+      if((p = MyStrChr(value, ',')) != NULL)
+       *p++ = '\0';
 
-      free(email->CC);
-      email->CC = NULL;
-      email->NumCC = 0;
-    }
+      ExtractAddress(value, &pe);
+      SetMailPerson(&mail->ReplyTo, pe.Address, pe.RealName);
 
-    if(email->BCC != NULL)
-    {
-      ASSERT(email->NumBCC > 0);
+      // we have to check if we can match the user identity
+      // from the email address
+      if(deep == TRUE)
+      {
+        replyToUIN = FindUserIdentityByAddress(&C->userIdentityList, mail->ReplyTo.Address);
+        D(DBF_MAIL, "finduinByAddr (replyto): '%s' %08lx", mail->ReplyTo.Address, replyToUIN);
+      }
 
-      free(email->BCC);
-      email->BCC = NULL;
-      email->NumBCC = 0;
-    }
+      // if we have more addresses waiting we
+      // go and process them yet
+      if(p != NULL)
+      {
+        if(deep == TRUE)
+        {
+          if(email->NumSReplyTo == 0)
+            email->NumSReplyTo = MA_GetRecipients(p, &(email->SReplyTo));
 
-    if(email->ResentTo != NULL)
-    {
-      ASSERT(email->NumResentTo > 0);
+          if(email->NumSReplyTo > 0)
+          {
+            int i;
 
-      free(email->ResentTo);
-      email->ResentTo = NULL;
-      email->NumResentTo = 0;
-    }
+            // if we haven't found the identity yet we process the
+            // other from addresses
+            for(i=0; replyToUIN == NULL && i < email->NumSReplyTo; i++)
+            {
+              replyToUIN = FindUserIdentityByAddress(&C->userIdentityList, email->SReplyTo[i].Address);
+              D(DBF_MAIL, "finduinByAddr (replyto): '%s' %08lx", email->SReplyTo[i].Address, replyToUIN);
+            }
 
-    if(email->ResentCC != NULL)
-    {
-      ASSERT(email->NumResentCC > 0);
+            setFlag(mail->mflags, MFLAG_MULTIREPLYTO);
+          }
+        }
+        else if(strlen(p) >= 7) // minimum rcpts size "a@bc.de"
+          setFlag(mail->mflags, MFLAG_MULTIREPLYTO);
+      }
 
-      free(email->ResentCC);
-      email->ResentCC = NULL;
-      email->NumResentCC = 0;
+      D(DBF_MIME, "'ReplyTo' recipients: %ld", email->NumSReplyTo+1);
     }
-
-    if(email->ResentBCC != NULL)
+    else if(stricmp(field, "original-recipient") == 0)
     {
-      ASSERT(email->NumResentBCC > 0);
-
-      free(email->ResentBCC);
-      email->ResentBCC = NULL;
-      email->NumResentBCC = 0;
+      ExtractAddress(value, &pe);
+      email->OriginalRcpt = pe;
     }
-
-    if(email->FollowUpTo != NULL)
+    else if(stricmp(field, "return-path") == 0)
     {
-      ASSERT(email->NumFollowUpTo > 0);
-
-      free(email->FollowUpTo);
-      email->FollowUpTo = NULL;
-      email->NumFollowUpTo = 0;
+      ExtractAddress(value, &pe);
+      email->ReturnPath = pe;
     }
-
-    if(email->MailReplyTo != NULL)
+    else if(stricmp(field, "disposition-notification-to") == 0 ||
+            stricmp(field, "return-receipt-to") == 0)
     {
-      ASSERT(email->NumMailReplyTo > 0);
-
-      free(email->MailReplyTo);
-      email->MailReplyTo = NULL;
-      email->NumMailReplyTo = 0;
+      ExtractAddress(value, &pe);
+      email->ReceiptTo = pe;
+      setFlag(mail->mflags, MFLAG_SENDMDN);
     }
+    else if(stricmp(field, "to") == 0)
+    {
+      if(foundTo == FALSE)
+      {
+        char *p;
 
-    free(email);
-  }
+        foundTo = TRUE;
 
-  LEAVE();
-}
+        if((p = MyStrChr(value, ',')) != NULL)
+          *p++ = '\0';
 
-///
-/// MA_GetRecipients
-//  Extracts recipients from a header field
-static int MA_GetRecipients(char *h, struct Person **per)
-{
-  int cnt = 0;
-  char *p = h;
+        ExtractAddress(value, &pe);
+        SetMailPerson(&mail->To, pe.Address, pe.RealName);
 
-  ENTER();
+        // we have to check if we can match the user identity
+        // from the email address
+        if(deep == TRUE)
+        {
+          toUIN = FindUserIdentityByAddress(&C->userIdentityList, mail->To.Address);
+          D(DBF_MAIL, "finduinByAddr (to): '%s' %08lx", mail->To.Address, toUIN);
+        }
 
-  while(*p != '\0')
-  {
-    cnt++;
-    if((p = MyStrChr(p, ',')) != NULL)
-      p++;
-    else
-      break;
-  }
+        if(p != NULL)
+        {
+          if(deep == TRUE)
+          {
+            if(email->NumSTo == 0)
+              email->NumSTo = MA_GetRecipients(p, &(email->STo));
 
-  if(cnt > 0)
-  {
-    // allocate enough memory to carry all
-    // found recipients in an array of struct Person
-    // structures.
-    if((*per = calloc(cnt, sizeof(struct Person))) != NULL)
-    {
-      struct Person *cur = *per;
+            if(email->NumSTo > 0)
+            {
+              int i;
+
+              // if we haven't found the identity yet we process the
+              // other from addresses
+              for(i=0; toUIN == NULL && i < email->NumSTo; i++)
+              {
+                toUIN = FindUserIdentityByAddress(&C->userIdentityList, email->STo[i].Address);
+                D(DBF_MAIL, "finduinByAddr (to): '%s' %08lx", email->STo[i].Address, toUIN);
+              }
+
+              setFlag(mail->mflags, MFLAG_MULTIRCPT);
+            }
+          }
+          else if(strlen(p) >= 7) // minimum rcpts size "a@bc.de"
+            setFlag(mail->mflags, MFLAG_MULTIRCPT);
+        }
 
-      for(p=h; *p; cur++)
+        D(DBF_MIME, "'To:' recipients: %ld", email->NumSTo+1);
+      }
+    }
+    else if(stricmp(field, "cc") == 0)
+    {
+      if(deep == TRUE)
       {
-        char *next;
+        if(email->NumCC == 0)
+          email->NumCC = MA_GetRecipients(value, &(email->CC));
 
-        if((next = MyStrChr(p, ',')) != NULL)
-          *next++ = '\0';
+        D(DBF_MIME, "'Cc:' recipients: %ld", email->NumCC);
 
-        ExtractAddress(p, cur);
+        if(email->NumCC > 0)
+        {
+          int i;
 
-        D(DBF_MIME, "extracted rcpt: '%s' '%s'", cur->RealName, cur->Address);
+          // if we haven't found the identity yet we process the
+          // other from addresses
+          for(i=0; ccUIN == NULL && i < email->NumCC; i++)
+          {
+            ccUIN = FindUserIdentityByAddress(&C->userIdentityList, email->CC[i].Address);
+            D(DBF_MAIL, "finduinByAddr (cc): '%s' %08lx", email->CC[i].Address, ccUIN);
+          }
 
-        p = next;
-        if(p == NULL)
-          break;
+          setFlag(mail->mflags, MFLAG_MULTIRCPT);
+        }
       }
+      else if(strlen(value) >= 7) // minimum rcpts size "a@bc.de"
+        setFlag(mail->mflags, MFLAG_MULTIRCPT);
     }
-    else
-      cnt = 0;
-  }
-  else
-    *per = NULL;
-
-  RETURN(cnt);
-  return cnt;
-}
+    else if(stricmp(field, "bcc") == 0)
+    {
+      if(deep == TRUE)
+      {
+        if(email->NumBCC == 0)
+          email->NumBCC = MA_GetRecipients(value, &(email->BCC));
 
-///
-/// MA_ScanDate
-//  Converts textual date header into datestamp format
-static BOOL MA_ScanDate(struct Mail *mail, const char *date)
-{
-  BOOL success = FALSE;
-  int count = 0;
-  int day = 0;
-  int mon = 0;
-  int year = 0;
-  int hour = 0;
-  int min = 0;
-  int sec = 0;
-  int gmtOffset = INT_MIN; // INT_MIN means not set
-  char *s;
-  char tdate[SIZE_SMALL];
-  char ttime[SIZE_SMALL];
-  char tzAbbr[SIZE_SMALL];
-  struct DateTime dt;
-  BOOL nonRFC2822 = FALSE;
+        D(DBF_MIME, "'BCC:' recipients: %ld", email->NumBCC);
 
-  ENTER();
+        if(email->NumBCC > 0)
+        {
+          int i;
 
-  D(DBF_MAIL, "parse date from '%s'", date);
+          // if we haven't found the identity yet we process the
+          // other from addresses
+          for(i=0; bccUIN == NULL && i < email->NumBCC; i++)
+          {
+            bccUIN = FindUserIdentityByAddress(&C->userIdentityList, email->BCC[i].Address);
+            D(DBF_MAIL, "finduinByAddr (bcc): '%s' %08lx", email->BCC[i].Address, bccUIN);
+          }
 
-  // make sure to skip the weekday definition if it exists
-  if((s = strpbrk(date, " |;,")) != NULL)
-  {
-    // check if we did reach here because the whole
-    // weekday definition was missing
-    if(isspace(*s) && isdigit(*date))
-      s = (char *)date;
-    else
-      s++;
-  }
-  else
-  {
-    W(DBF_MAIL, "no starting separator found");
+          setFlag(mail->mflags, MFLAG_MULTIRCPT);
+        }
+      }
+      else if(strlen(value) >= 7) // minimum rcpts size "a@bc.de"
+        setFlag(mail->mflags, MFLAG_MULTIRCPT);
+    }
+    else if(stricmp(field, "resent-to") == 0)
+    {
+      if(email->NumResentTo == 0)
+        email->NumResentTo = MA_GetRecipients(value, &(email->ResentTo));
 
-    s = (char *)date;
-  }
+      D(DBF_MIME, "'Resent-To:' recipients: %ld", email->NumResentTo);
+    }
+    else if(stricmp(field, "resent-cc") == 0)
+    {
+      if(email->NumResentCC == 0)
+        email->NumResentCC = MA_GetRecipients(value, &(email->ResentCC));
 
-  // ensure a valid time zone abbreviation string
-  // in case the parsing process fails to find one
-  tzAbbr[0] = '\0';
+      D(DBF_MIME, "'Resent-CC:' recipients: %ld", email->NumResentCC);
+    }
+    else if(stricmp(field, "resent-bcc") == 0)
+    {
+      if(email->NumResentBCC == 0)
+        email->NumResentBCC = MA_GetRecipients(value, &(email->ResentBCC));
 
-  // skip leading spaces
-  while(*s && isspace(*s))
-    s++;
+      D(DBF_MIME, "'Resent-BCC:' recipients: %ld", email->NumResentBCC);
+    }
+    else if(stricmp(field, "mail-followup-to") == 0)
+    {
+      if(email->NumFollowUpTo == 0)
+        email->NumFollowUpTo = MA_GetRecipients(value, &(email->FollowUpTo));
 
-  while(*s)
-  {
-    char *e;
+      D(DBF_MIME, "'Mail-Followup-To:' recipients: %ld", email->NumFollowUpTo);
+    }
+    else if(stricmp(field, "mail-reply-to") == 0)
+    {
+      if(email->NumMailReplyTo == 0)
+        email->NumMailReplyTo = MA_GetRecipients(value, &(email->MailReplyTo));
 
-    if((e = strpbrk(s, " |;,")) == NULL)
-      e = s+strlen(s);
+      D(DBF_MIME, "'Mail-Reply-To:' recipients: %ld", email->NumMailReplyTo);
+    }
+    else if(stricmp(field, "subject") == 0)
+    {
+      SetMailSubject(mail, Trim(value));
+    }
+    else if(stricmp(field, "message-id") == 0)
+    {
+      dstrcat(&email->messageID, Trim(value));
+      mail->cMsgID = CompressMsgID(email->messageID);
 
-    switch(count)
+      // keep the full ID as well, it will be saved in the index
+      free(mail->MsgID);
+      mail->MsgID = strdup(email->messageID);
+    }
+    else if(stricmp(field, "in-reply-to") == 0)
     {
-      // get the day
-      case 0:
+      dstrcat(&email->inReplyToMsgID, Trim(value));
+      mail->cIRTMsgID = CompressMsgID(email->inReplyToMsgID);
+    }
+    else if(stricmp(field, "references") == 0)
+    {
+      dstrcat(&email->references, Trim(value));
+      D(DBF_MAIL, "References: '%s'", email->references);
+    }
+    else if(stricmp(field, "date") == 0)
+    {
+      dateFound = MA_ScanDate(mail, value);
+    }
+    else if(stricmp(field, "importance") == 0)
+    {
+      if(getImportanceLevel(mail) == IMP_NORMAL)
       {
-        char *end;
+        char *p = Trim(value);
 
-        day = strtol(s, &end, 10);
-        if(day <= 0 || day > 31)
-        {
-          W(DBF_MAIL, "couldn't parse day from '%s'", s);
+        if(stricmp(p, "high") == 0)
+          setImportanceLevel(mail, IMP_HIGH);
+        else if(stricmp(p, "low") == 0)
+          setImportanceLevel(mail, IMP_LOW);
+      }
+    }
+    else if(stricmp(field, "priority") == 0)
+    {
+      if(getImportanceLevel(mail) == IMP_NORMAL)
+      {
+        char *p = Trim(value);
 
-          day = 1;
-        }
+        if(stricmp(p, "urgent") == 0)
+          setImportanceLevel(mail, IMP_HIGH);
+        else if(stricmp(p, "non-urgent") == 0)
+          setImportanceLevel(mail, IMP_HIGH);
+      }
+    }
+    else if(stricmp(field, "content-type") == 0)
+    {
+      char *p = Trim(value);
 
-        // gracefully handle possible non RFC-2822 conformant dates which use
-        // a '-' character instead of a space as separator
-        if(end != e && end[0] == '-')
+      if(strnicmp(p, "multipart", 9) == 0)
+      {
+        p += 10;
+
+        // we do specify the multipart content-type in
+        // accordance to RFC 2046/RFC2387
+        if(strnicmp(p, "mixed", 5) == 0)             // RFC 2046 (5.1.3)
+          setFlag(mail->mflags, MFLAG_MP_MIXED);
+        else if(strnicmp(p, "alternative", 11) == 0) // RFC 2046 (5.1.4)
+          setFlag(mail->mflags, MFLAG_MP_ALTERN);
+        else if(strnicmp(p, "report", 6) == 0)       // RFC 3462
+          setFlag(mail->mflags, MFLAG_MP_REPORT);
+        else if(strnicmp(p, "encrypted", 9) == 0)    // RFC 1847 (2.2)
+          setFlag(mail->mflags, MFLAG_MP_CRYPT);
+        else if(strnicmp(p, "signed", 6) == 0)       // RFC 1847 (2.1)
+          setFlag(mail->mflags, MFLAG_MP_SIGNED);
+        else
         {
-          W(DBF_MAIL, "non RFC 2822 conformant date string '%s'", date);
-          nonRFC2822 = TRUE;
-          e = &end[1];
+          // "mixed" is the primary subtype and in fact RFC 2046 (5.1.7)
+          // suggests to fall back to mixed if a MIME subtype is unknown
+          // to a MIME parser, which we do here now.
+          setFlag(mail->mflags, MFLAG_MP_MIXED);
         }
       }
-      break;
-
-      // get the month
-      case 1:
+      else if(strnicmp(p, "message/partial", 15) == 0) // RFC 2046 (5.2.2)
       {
-        for(mon = 1; mon <= 12; mon++)
+        setFlag(mail->mflags, MFLAG_PARTIAL);
+      }
+    }
+    else if(stricmp(field, "x-senderinfo") == 0)
+    {
+      setFlag(mail->mflags, MFLAG_SENDERINFO);
+      if(deep == TRUE)
+        dstrcat(&email->SenderInfo, value);
+    }
+    else if(stricmp(field, "x-yam-mailaccount") == 0)
+    {
+      SetPooledString(&mail->MailAccount, value, SIZE_DEFAULT);
+    }
+    else if(deep == TRUE) // and if we end up here we check if we really have to go further
+    {
+      if(stricmp(field, "x-yam-options") == 0)
+      {
+        char *p;
+        int sec;
+
+        // check for the delsent flag
+        if(strcasestr(value, "delsent") != NULL)
         {
-          if(strnicmp(s, months[mon-1], 3) == 0)
-            break;
+          D(DBF_MIME, "delsent found");
+          email->DelSent = TRUE;
         }
 
-        if(mon > 12)
+        // check for the redirect flag
+        if(strcasestr(value, "redirect") != NULL)
         {
-          W(DBF_MAIL, "couldn't parse month from '%s'", s);
-          mon = 1;
+          D(DBF_MIME, "redirect found");
+          email->Redirect = TRUE;
         }
 
-        // gracefully handle possible non RFC-2822 conformant dates which use
-        // a '-' character instead of a space as separator
-        if(nonRFC2822 == TRUE && strlen(s) >= 4 && s[3] == '-')
-          e = &s[4];
-      }
-      break;
+        // check for the signature flag
+        if((p = strcasestr(value, "signature=")) != NULL)
+        {
+          char idStr[9] = ""; // the signature ID is only 8 chars long + 1 NUL
 
-      // get the year
-      case 2:
-      {
-        char *end;
+          strlcpy(idStr, &p[10], sizeof(idStr));
+          email->signatureID = strtoul(idStr, NULL, 16);
 
-        year = strtol(s, &end, 10);
-        // gracefully handle the obsolete 2-digit year specs
-        if(year < 100)
-        {
-          W(DBF_MAIL, "obsolete year spec '%s' found", s);
-          // numbers from 78 to 99 are considered to be 1978 to 1999,
-          // everything else is 2000 to 2077
-          if(year >= 78)
-            year += 1900;
-          else
-            year += 2000;
+          // try to get the signature structure
+          if(email->signatureID != 0)
+          {
+            email->signature = FindSignatureByID(&C->signatureList, email->signatureID);
+            D(DBF_MAIL, "findSignatureById: '%08x' %08lx", email->signatureID, email->signature);
+          }
+
+          D(DBF_MAIL, "found signature: '%s' %08x %08x", idStr, email->signatureID, email->signature != NULL ? email->signature->id : 0);
         }
 
-        if(year < 1978 || year > 2038)
+        // check if the identity is listed and if so this has
+        // absolute priority (so we overwrite any previously
+        // set email->identity ptr)
+        if((p = strcasestr(value, "identity=")) != NULL)
         {
-          W(DBF_MAIL, "couldn't parse year from '%s'", s);
-          year = 1978;
-        }
+          char idStr[9] = ""; // the identity ID is only 8 chars long + 1 NUL
 
-        // no further special handling for non RFC 2822 conformant dates required
-      }
-      break;
+          strlcpy(idStr, &p[9], sizeof(idStr));
+          email->identityID = strtoul(idStr, NULL, 16);
 
-      // get the time values
-      case 3:
-      {
-        if(sscanf(s, "%d:%d:%d", &hour, &min, &sec) != 3)
-        {
-          if(sscanf(s, "%d:%d", &hour, &min) == 2)
-            sec = 0;
-          else
+          // try to get the identity structure
+          if(email->identityID != 0)
           {
-            W(DBF_MAIL, "couldn't parse time from '%s'", s);
-
-            hour = 0;
-            min = 0;
-            sec = 0;
+            email->identity = FindUserIdentityByID(&C->userIdentityList, email->identityID);
+            D(DBF_MAIL, "finduinById: '%08x' %08lx", email->identityID, email->identity);
           }
-        }
-      }
-      break;
 
-      // get the gmt offset (+0000 / -0000)
-      case 4:
-      {
-        // skip any leading parentheses
-        while(*s && *s == '(')
-          s++;
+          D(DBF_MAIL, "found identity: '%s' %08x %08x", idStr, email->identityID, email->identity != NULL ? email->identity->id : 0);
+        }
 
-        // check that the gmtOffset string starts with "+" or "-" or
-        // with a numeric value or otherwise the date string doesn't
-        // have a GMT offset but comes with a timezone abbreviation
-        if(*s == '+' || *s == '-' || isdigit(*s))
+        // check security flags
+        if((p = strcasestr(value, "security=")) != NULL)
         {
-          if(isdigit(*s))
-            gmtOffset = atoi(s);
-          else
-            gmtOffset = atoi(&s[1]);
-
-          if(gmtOffset != 0 && gmtOffset/100 == 0)
+          // check for the security flags for signing/encrypting a mail
+          // but walk backwards here otherwise we can't use break
+          for(sec = SEC_DEFAULTS; sec >= SEC_NONE; sec--)
           {
-            char *c;
+            if(strcasestr(&p[9], SecCodes[sec]) != NULL)
+            {
+              email->Security = sec;
+              D(DBF_MIME, "found security: %d (%s)", email->Security, SecCodes[sec]);
+              break;
+            }
+          }
+        }
+      }
+      else if(strnicmp(field, "x-yam-header-", 13) == 0)
+      {
+        dstrcat(&email->extraHeaders, &field[13]);
+        dstrcat(&email->extraHeaders, ":");
+        dstrcat(&email->extraHeaders, value);
+        dstrcat(&email->extraHeaders, "\\n");
+      }
+    }
+  }
 
-            // multiply by 100 so that we have now a correct format
-            gmtOffset *= 100;
+  // remember the references, they are needed to thread the mail
+  mail->cRefMsgIDs = CompressReferences(email->references, mail->cIRTMsgID);
 
-            // then check if we have a : to seperate HH:MM and add the minutes
-            // to tzcorr
-            if((c = strchr(s, ':')))
-              gmtOffset += atoi(c);
-          }
+  // in case we found no From: head line we try to construct a name
+  // from a possible Sender: line
+  if(foundFrom == FALSE)
+  {
+    D(DBF_MIME, "no From: header");
 
-          // now we have to distingush between + and -
-          if(s[0] == '-')
-            gmtOffset = -gmtOffset;
+    if((hdrNode = FindHeader(headerList, "sender")) != NULL)
+    {
+      char *value = hdrNode->content;
+      char *p;
 
-          // convert to minutes now
-          gmtOffset = (gmtOffset/100)*60 + (gmtOffset%100);
-        }
-        else
-        {
-          W(DBF_MAIL, "no GMT offset found in date string '%s'", date);
+      // find out if there are more than one From: address
+      if((p = MyStrChr(value, ',')) != NULL)
+       *p++ = '\0';
 
-          // make sure the next iteration ends up at the same position
-          e = s;
-        }
-      }
-      break;
+      // extract the main mail address
+      ExtractAddress(value, &pe);
+      SetMailPerson(&mail->From, pe.Address, pe.RealName);
 
-      // the textual timezone abbreviation (e.g. 'CET')
-      case 5:
+      // we have to check if we can match the user identity
+      // from the email address
+      if(deep == TRUE)
       {
-        // skip any leading parentheses
-        while(*s && *s == '(')
-          s++;
+        fromUIN = FindUserIdentityByAddress(&C->userIdentityList, mail->From.Address);
+        D(DBF_MAIL, "finduinByAddr (sender): '%s' %08lx", mail->From.Address, fromUIN);
+      }
 
-        // make sure the first char is A-Za-z
-        if(isalpha(*s))
+      D(DBF_MIME, "From: address obtained from Sender: header");
+
+      // if we have more addresses waiting we
+      // go and process them yet
+      if(p != NULL)
+      {
+        if(deep == TRUE)
         {
-          // remove any ending parentheses
-          while(*(e-1) && *(e-1) == ')')
-            e--;
+          if(email->NumSFrom == 0)
+            email->NumSFrom = MA_GetRecipients(p, &(email->SFrom));
 
-          strlcpy(tzAbbr, s, MIN(sizeof(tzAbbr), (unsigned int)(e-s+1)));
+          if(email->NumSFrom > 0)
+          {
+            int i;
+
+            // if we haven't found the identity yet we process the
+            // other from addresses
+            for(i=0; fromUIN == NULL && i < email->NumSFrom; i++)
+            {
+              fromUIN = FindUserIdentityByAddress(&C->userIdentityList, email->SFrom[i].Address);
+              D(DBF_MAIL, "finduinByAddr (sender): '%s' %08lx", email->SFrom[i].Address, fromUIN);
+            }
+
+            setFlag(mail->mflags, MFLAG_MULTISENDER);
+          }
         }
-        else
-          W(DBF_MAIL, "no timezone abbreviation found in date string '%s'", date);
+        else if(strlen(p) >= 7) // minimum rcpts size "a@bc.de"
+          setFlag(mail->mflags, MFLAG_MULTISENDER);
       }
-      break;
-    }
 
-    // if we iterated until 4 we can break out
-    if(count == 5)
-      break;
+      D(DBF_MIME, "'Sender' senders: %ld", email->NumSFrom+1);
 
-    count++;
+      foundFrom = TRUE;
+    }
+  }
 
-    // set the next start to our last search
-    if(*e)
+  // Now choose the user identity from the identities found in the loop
+  // above. We start with the identity found by the To: header line, as
+  // this is the one which should match best. Next are the other possible
+  // "receiving" addresses and finally the possible sender addresses.
+  if(toUIN != NULL)
+    email->identity = toUIN;
+  else if(ccUIN != NULL)
+    email->identity = ccUIN;
+  else if(bccUIN != NULL)
+    email->identity = bccUIN;
+  else if(replyToUIN != NULL)
+    email->identity = replyToUIN;
+  else if(fromUIN != NULL)
+    email->identity = fromUIN;
+
+  // if we still don't have identified a potential user identity
+  // that matches the From:/To:/Reply-To:, etc. headers contents
+  // (e.g. because deep==FALSE) then we set the default identity
+  if(email->identity == NULL)
+    email->identity = GetUserIdentity(&C->userIdentityList, 0, TRUE);
+
+  if(email->identity != NULL)
+    D(DBF_MAIL, "final identity: %08x '%s'", email->identity->id, email->identity->description);
+  else
+    E(DBF_MAIL, "no identities configured");
+
+  // in case the replyTo recipient doesn't have a realname yet and it is
+  // completly the same like the from address we go and copy the realname as both
+  // are the same.
+  if(foundReplyTo == TRUE && mail->ReplyTo.RealName[0] != '\0' && stricmp(mail->ReplyTo.Address, mail->From.Address) == 0)
+    SetPooledString(&mail->ReplyTo.RealName, mail->From.RealName, SIZE_REALNAME);
+
+  // if this function call has a folder of NULL then we are examining a virtual mail
+  // which means this mail doesn't have any folder and also no filename that may contain
+  // any usable date or stuff
+  if(folder != NULL)
+  {
+    char *timebuf = NULL;
+
+    // now we take the filename of our mailfile into account to check for
+    // the transfer date at the start of the name and for the set status
+    // flags at the end of it.
+    strlcpy(dateFilePart, mail->MailFile, sizeof(dateFilePart));
+
+    // make sure there is no "-" in the base64 encoded part as we just mapped
+    // the not allowed "/" to "-" to make it possible to use base64 for
+    // the timeval encoding
+    ptr = dateFilePart;
+    while((ptr = strchr(ptr, '-')) != NULL)
+      *ptr = '/';
+
+    // lets decode the base64 encoded timestring in a temporary buffer
+    if(base64decode(&timebuf, dateFilePart, strlen(dateFilePart)) <= 0)
     {
-      // skip leading spaces
-      while(*e && isspace(*e))
-        e++;
+      W(DBF_FOLDER, "WARNING: failure in decoding the encoded date from mailfile: '%s'", mail->MailFile);
 
-      s = e;
+      // if we weren't able to decode the base64 encoded string
+      // we have to validate the transDate so that the calling function
+      // recognizes to rewrite the comment with a valid string.
+      mail->transDate.Seconds      = 0;
+      mail->transDate.Microseconds = 0;
     }
     else
-      break;
-  }
+    {
+      // everything seems to have worked so lets copy the binary data in our
+      // transDate structure
+      memcpy(&mail->transDate, timebuf, sizeof(mail->transDate));
 
-  // then format a standard DateStamp string like string
-  // so that we can use StrToDate()
-  snprintf(tdate, sizeof(tdate), "%02d-%02d-%02d", mon, day, year % 100);
-  snprintf(ttime, sizeof(ttime), "%02d:%02d:%02d", hour, min, sec);
-  dt.dat_Format  = FORMAT_USA;
-  dt.dat_Flags   = 0;
-  dt.dat_StrDate = tdate;
-  dt.dat_StrTime = ttime;
-  if(StrToDate(&dt))
-  {
-    struct DateStamp *ds = &dt.dat_Stamp;
+      free(timebuf);
+    }
 
-    // lets see if we found a valid GMT offset
-    if(gmtOffset != INT_MIN)
-      mail->gmtOffset = gmtOffset;
-    else if(tzAbbr[0] != '\0')
-      mail->gmtOffset = TZtoMinutes(tzAbbr);
+    // now grab the status out of the end of the mailfilename
+    ptr = &mail->MailFile[17];
+    while(*ptr != '\0')
+    {
+      if(*ptr >= '1' && *ptr <= '7')
+      {
+        setPERValue(mail, *ptr-'1'+1);
+      }
+      else
+      {
+        switch(*ptr)
+        {
+          case SCHAR_READ:
+            setFlag(mail->sflags, SFLAG_READ);
+          break;
 
-    // save the tzone abbreviation
-    strlcpy(mail->tzAbbr, tzAbbr, sizeof(mail->tzAbbr));
+          case SCHAR_REPLIED:
+            setFlag(mail->sflags, SFLAG_REPLIED);
+          break;
 
-    // bring the date in relation to UTC
-    ds->ds_Minute -= mail->gmtOffset;
+          case SCHAR_FORWARDED:
+            setFlag(mail->sflags, SFLAG_FORWARDED);
+          break;
 
-    // we need to check the datestamp variable that it is still in it's borders
-    // after the UTC correction
-    while(ds->ds_Minute < 0)     { ds->ds_Minute += 1440; ds->ds_Days--; }
-    while(ds->ds_Minute >= 1440) { ds->ds_Minute -= 1440; ds->ds_Days++; }
+          case SCHAR_NEW:
+            setFlag(mail->sflags, SFLAG_NEW);
+          break;
 
-    // now we do copy the datestamp stuff over the one from our mail
-    memcpy(&mail->Date, ds, sizeof(mail->Date));
+          case SCHAR_HOLD:
+            setFlag(mail->sflags, SFLAG_HOLD);
+          break;
 
-    success = TRUE;
+          case SCHAR_SENT:
+            setFlag(mail->sflags, SFLAG_SENT);
+          break;
+
+          case SCHAR_MARKED:
+            setFlag(mail->sflags, SFLAG_MARKED);
+          break;
+
+          case SCHAR_ERROR:
+            setFlag(mail->sflags, SFLAG_ERROR);
+          break;
+
+          case SCHAR_USERSPAM:
+            setFlag(mail->sflags, SFLAG_USERSPAM);
+          break;
+
+          case SCHAR_AUTOSPAM:
+            setFlag(mail->sflags, SFLAG_AUTOSPAM);
+          break;
+
+          case SCHAR_HAM:
+            setFlag(mail->sflags, SFLAG_HAM);
+          break;
+
+          default:
+            W(DBF_FOLDER, "invalid mail status character '%lc' found", *ptr);
+          break;
+        }
+      }
+
+      ptr++;
+    }
   }
 
-  RETURN(success);
-  return success;
+  // if we didn't find a Date: header we take the transfered date (if found)
+  if(dateFound == FALSE)
+  {
+    if(mail->transDate.Seconds > 0)
+    {
+      // convert the UTC transDate to a UTC mail Date
+      TimeVal2DateStamp(&mail->transDate, &mail->Date, TZC_NONE);
+    }
+    else
+    {
+      // and as a fallback we take the date of the mail file
+      if(ObtainFileInfo(mail->MailFile, FI_DATE, &mail->Date) == TRUE)
+      {
+        // we store the mail date in UTC, thus convert it to
+        // a UTC relative DateStamp accordingly.
+        DateStampTZConvert(&mail->Date, TZC_LOCAL2UTC);
+      }
+    }
+
+    // set the timeZone to our local one
+    mail->gmtOffset = G->gmtOffset;
+    SetPooledString(&mail->tzAbbr, G->tzAbbr, SIZE_SMALL);
+  }
+
+  LEAVE();
 }
+
 ///
 /// MA_ExamineMail
 //  Parses the header lines of a message and fills email structure
 struct ExtendedMail *MA_ExamineMail(const struct Folder *folder, const char *file, const BOOL deep)
 {
   struct ExtendedMail *email;
-  static struct Person pe;
   struct MinList headerList;
   struct Mail *mail;
   char fullfile[SIZE_PATHFILE];
-  BOOL dateFound = FALSE;
   FILE *fh;
 
   ENTER();
@@ -2254,7 +4796,7 @@ struct ExtendedMail *MA_ExamineMail(const struct Folder *folder, const char *fil
   D(DBF_MAIL, "Examining mail file '%s' from folder '%s' with deep %d", file, folder != NULL ? folder->Name : "<NULL>", deep);
 
   // first we generate a new ExtendedMail buffer
-  if((email = calloc(1, sizeof(*email))) == NULL)
+  if((email = AllocExtendedMail()) == NULL)
   {
     RETURN(NULL);
     return NULL;
@@ -2293,728 +4835,855 @@ struct ExtendedMail *MA_ExamineMail(const struct Folder *folder, const char *fil
       if((fh = fopen(fullfile, "r")) != NULL)
         setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
     }
-    else
-      rewind(fh); // rewind the file handle to the start
+    else
+      rewind(fh); // rewind the file handle to the start
+  }
+  else
+    E(DBF_MAIL, "couldn't open mail file for reading main header");
+
+  // check if the file handle is valid and then immediatly read in the
+  // header lines
+  if(fh != NULL && MA_ReadHeader(fullfile, fh, &headerList, RHM_MAINHEADER) == TRUE)
+  {
+    LONG size;
+
+    ExamineMailHeaders(email, folder, &headerList, deep);
+
+    // if now the mail is still not MULTIPART we have to check for uuencoded attachments
+    if(!isMP_MixedMail(mail) && MA_DetectUUE(fh) == TRUE)
+      setFlag(mail->mflags, MFLAG_MP_MIXED);
+
+    // And now we close the Mailfile and clear the temporary headerList again
+    fclose(fh);
+    ClearHeaderList(&headerList);
+
+    // lets calculate the mailSize out of the FileSize() function
+    if(ObtainFileInfo(fullfile, FI_SIZE, &size) == TRUE)
+      mail->Size = size;
+    else
+      mail->Size = -1;
+
+    FinishUnpack(fullfile);
+
+    RETURN(email);
+    return email;
+  }
+  else
+    E(DBF_MAIL, "couldn't read/parse mail header of mail file '%s'", fullfile);
+
+  FinishUnpack(fullfile);
+
+  // finish up everything before we exit with an error
+  if(fh != NULL)
+    fclose(fh);
+
+  MA_FreeEMailStruct(email);
+
+  RETURN(NULL);
+  return NULL;
+}
+
+///
+/// MA_InitMailStream
+//  Prepares examining a mail while it is being written
+void MA_InitMailStream(struct MailStream *ms, const char *mailFile)
+{
+  ENTER();
+
+  memset(ms, 0, sizeof(*ms));
+  InitHeaderParser(&ms->parser, mailFile, &ms->headerList);
+  ms->inHeader = TRUE;
+  ms->lineStart = TRUE;
+
+  LEAVE();
+}
+
+///
+/// FinishMailStreamLine
+//  Parses a complete header line of a mail stream, an empty line
+//  terminates the header
+static void FinishMailStreamLine(struct MailStream *ms)
+{
+  ENTER();
+
+  // strip the line end just like GetLine() does
+  if(ms->lineLength > 0 && ms->line[ms->lineLength-1] == '\n')
+  {
+    ms->lineLength--;
+    if(ms->lineLength > 0 && ms->line[ms->lineLength-1] == '\r')
+      ms->lineLength--;
+  }
+  ms->line[ms->lineLength] = '\0';
+
+  if(ms->lineLength == 0)
+  {
+    // the header is complete
+    ms->inHeader = FALSE;
+  }
+  else if(ParseHeaderLine(&ms->parser, ms->line) == FALSE)
+  {
+    // treat everything else as body
+    ms->failed = TRUE;
+    ms->inHeader = FALSE;
+  }
+
+  ms->lineLength = 0;
+
+  LEAVE();
+}
+
+///
+/// MA_WriteMailStream
+//  Examines the next bytes of a mail which are written to disk. The header
+//  lines are parsed as soon as they are complete, the body is just checked
+//  for uuencoded data.
+void MA_WriteMailStream(struct MailStream *ms, const char *data, size_t len)
+{
+  ENTER();
+
+  ms->size += len;
+
+  while(len > 0)
+  {
+    const char *eol = memchr(data, '\n', len);
+    size_t partLen = (eol != NULL) ? (size_t)(eol - data) + 1 : len;
+
+    if(ms->inHeader == TRUE)
+    {
+      size_t copyLen = partLen;
+
+      // truncate overlong header lines
+      if(ms->lineLength + copyLen > MAILSTREAM_MAX_LINE)
+      {
+        if(ms->lineLength < MAILSTREAM_MAX_LINE)
+          W(DBF_MAIL, "truncating header line of mail '%s' to %ld bytes", ms->parser.mailFile, MAILSTREAM_MAX_LINE);
+
+        copyLen = MAILSTREAM_MAX_LINE - ms->lineLength;
+      }
+
+      // collect the header line until it is complete, the buffer
+      // grows by doubling its size to avoid copying long lines
+      // over and over again
+      if(ms->lineLength + copyLen + 1 > ms->lineSize)
+      {
+        size_t newSize = MAX(ms->lineSize * 2, SIZE_LINE);
+        char *newLine;
+
+        while(newSize < ms->lineLength + copyLen + 1)
+          newSize *= 2;
+
+        if(newSize > MAILSTREAM_MAX_LINE + 1)
+          newSize = MAILSTREAM_MAX_LINE + 1;
+
+        if((newLine = realloc(ms->line, newSize)) == NULL)
+        {
+          ms->failed = TRUE;
+          ms->inHeader = FALSE;
+          continue;
+        }
+
+        ms->line = newLine;
+        ms->lineSize = newSize;
+      }
+
+      memcpy(&ms->line[ms->lineLength], data, copyLen);
+      ms->lineLength += copyLen;
+
+      if(eol != NULL)
+        FinishMailStreamLine(ms);
+    }
+    else if(ms->lineStart == TRUE && ms->uuencoded == FALSE)
+    {
+      // check for a line starting with "begin xxx", like MA_DetectUUE() does
+      if(partLen >= 7 && isdigit((int)data[6]) && strncmp(data, "begin ", 6) == 0)
+        ms->uuencoded = TRUE;
+    }
+
+    ms->lineStart = (eol != NULL);
+    data += partLen;
+    len -= partLen;
+  }
+
+  LEAVE();
+}
+
+///
+/// MA_ExamineMailStream
+//  Fills an email structure from the header parsed while the mail was
+//  written. Returns NULL if the header could not be parsed.
+struct ExtendedMail *MA_ExamineMailStream(struct MailStream *ms, const struct Folder *folder, const char *file, const BOOL deep)
+{
+  struct ExtendedMail *email = NULL;
+  BOOL success;
+
+  ENTER();
+
+  D(DBF_MAIL, "Examining streamed mail file '%s' from folder '%s' with deep %d", file, folder != NULL ? folder->Name : "<NULL>", deep);
+
+  // a mail without body ends within the header
+  if(ms->inHeader == TRUE)
+  {
+    if(ms->lineLength > 0)
+      FinishMailStreamLine(ms);
+
+    ms->inHeader = FALSE;
+  }
+
+  success = FinishHeaderParser(&ms->parser, ms->failed == FALSE);
+
+  if(success == TRUE && IsMinListEmpty(&ms->headerList) == FALSE)
+  {
+    RepairAddressHeaders(&ms->headerList);
+
+    if((email = AllocExtendedMail()) != NULL)
+    {
+      struct Mail *mail = &email->Mail;
+
+      strlcpy(mail->MailFile, file, sizeof(mail->MailFile));
+
+      ExamineMailHeaders(email, folder, &ms->headerList, deep);
+
+      // if now the mail is still not MULTIPART we have to check for uuencoded attachments
+      if(!isMP_MixedMail(mail) && ms->uuencoded == TRUE)
+        setFlag(mail->mflags, MFLAG_MP_MIXED);
+
+      // the size is known without asking the file system
+      mail->Size = ms->size;
+    }
+  }
+  else
+    E(DBF_MAIL, "couldn't parse streamed mail header of mail file '%s'", file);
+
+  ClearHeaderList(&ms->headerList);
+
+  RETURN(email);
+  return email;
+}
+
+///
+/// MA_CleanupMailStream
+//  Frees all resources of a mail stream
+void MA_CleanupMailStream(struct MailStream *ms)
+{
+  ENTER();
+
+  FinishHeaderParser(&ms->parser, FALSE);
+  ClearHeaderList(&ms->headerList);
+
+  free(ms->line);
+  ms->line = NULL;
+
+  LEAVE();
+}
+
+///
+/// AddScanMailFile
+//  Adds a mail file to the list of files to be examined during a folder scan
+static BOOL AddScanMailFile(struct ScanMailBoxData *data, struct Folder *folder, const char *fileName)
+{
+  BOOL success = FALSE;
+
+  ENTER();
+
+  // enlarge the array if necessary
+  if(data->numFiles >= data->maxFiles)
+  {
+    ULONG newMax = (data->maxFiles > 0) ? data->maxFiles * 2 : 256;
+    struct ScanMailFile *newFiles;
+
+    if((newFiles = realloc(data->files, newMax * sizeof(*newFiles))) != NULL)
+    {
+      data->files = newFiles;
+      data->maxFiles = newMax;
+    }
   }
-  else
-    E(DBF_MAIL, "couldn't open mail file for reading main header");
 
-  // check if the file handle is valid and then immediatly read in the
-  // header lines
-  if(fh != NULL && MA_ReadHeader(fullfile, fh, &headerList, RHM_MAINHEADER) == TRUE)
+  if(data->numFiles < data->maxFiles)
   {
-    BOOL foundFrom = FALSE;
-    BOOL foundTo = FALSE;
-    BOOL foundReplyTo = FALSE;
-    char *ptr;
-    char dateFilePart[12+1];
-    LONG size;
-    struct HeaderNode *hdrNode;
-    struct UserIdentityNode *fromUIN = NULL;
-    struct UserIdentityNode *toUIN = NULL;
-    struct UserIdentityNode *replyToUIN = NULL;
-    struct UserIdentityNode *ccUIN = NULL;
-    struct UserIdentityNode *bccUIN = NULL;
-
-    // Now we process the read header to set all flags accordingly.
-    // The identities found within this loop must not be used immediately
-    // for the mail's identity pointer as the single header lines might
-    // appear in arbitrary order.
-    IterateList(&headerList, struct HeaderNode *, hdrNode)
-    {
-      char *field = hdrNode->name;
-      char *value = hdrNode->content;
+    struct ScanMailFile *file = &data->files[data->numFiles];
 
-      if(stricmp(field, "from") == 0)
-      {
-        char *p;
-        foundFrom = TRUE;
+    memset(file, 0, sizeof(*file));
+    file->folder = folder;
+    strlcpy(file->fileName, fileName, sizeof(file->fileName));
+    data->numFiles++;
 
-        // find out if there are more than one From: address
-        if((p = MyStrChr(value, ',')) != NULL)
-         *p++ = '\0';
+    success = TRUE;
+  }
 
-        // extract the main mail address
-        ExtractAddress(value, &pe);
-        mail->From = pe;
+  RETURN(success);
+  return success;
+}
 
-        // we have to check if we can match the user identity
-        // from the email address
-        if(deep == TRUE)
-        {
-          fromUIN = FindUserIdentityByAddress(&C->userIdentityList, mail->From.Address);
-          D(DBF_MAIL, "finduinByAddr (from): '%s' %08lx", mail->From.Address, fromUIN);
-        }
+///
+/// CollectMailFiles
+//  Collects all mail files of a folder directory. Old style and unknown files
+//  are converted upon request and empty files are deleted. This must be done
+//  by the main thread as the user might be asked what to do.
+static BOOL CollectMailFiles(struct Folder *folder, struct ScanMailBoxData *data)
+{
+  BOOL result = TRUE;
+  APTR context;
 
-        // if we have more addresses waiting we
-        // go and process them yet
-        if(p != NULL)
+  ENTER();
+
+  if((context = ObtainDirContextTags(EX_StringName, (IPTR)folder->Fullpath,
+                                     EX_DataFields, EXF_TYPE|EXF_NAME|EXF_SIZE,
+                                     TAG_DONE)) != NULL)
+  {
+    struct ExamineData *ed;
+    LONG error;
+    BOOL convertAllOld = FALSE;
+    BOOL skipAllOld = FALSE;
+    BOOL convertAllUnknown = FALSE;
+    BOOL skipAllUnknown = FALSE;
+
+    // Now that the folder is locked we go and define its loaded
+    // mode to LM_REBUILD so that others don't try to access it
+    // anymore.
+    folder->LoadedMode = LM_REBUILD;
+    // visually update this state change
+    DoMethod(G->MA->GUI.LT_FOLDERS, MUIM_NListtree_Redraw, folder->Treenode, MUIF_NONE);
+
+    while((ed = ExamineDir(context)) != NULL)
+    {
+      // give the GUI the chance to refresh
+      DoMethod(G->App,MUIM_Application_InputBuffered);
+
+      // then check whether this is a file as we don't care for subdirectories
+      if(EXD_IS_FILE(ed))
+      {
+        // check whether the filename is a valid mailfilename
+        char fbuf[SIZE_PATHFILE+1];
+        char *fname = (char *)ed->Name;
+        BOOL validMailFile = isValidMailFile(fname);
+
+        if(validMailFile == FALSE)
         {
-          if(deep == TRUE)
-          {
-            if(email->NumSFrom == 0)
-              email->NumSFrom = MA_GetRecipients(p, &(email->SFrom));
+          // ok, the file doesn't seem to have to be a valid mail filename, so
+          // let's see if it is an "old" file (<= YAM2.4) or just trash
+          int i = 0;
+          BOOL oldFound = TRUE;
 
-            if(email->NumSFrom > 0)
+          do
+          {
+            // on position 5 should be a colon
+            if(i == 5)
             {
-              int i;
-
-              // if we haven't found the identity yet we process the
-              // other from addresses
-              for(i=0; fromUIN == NULL && i < email->NumSFrom; i++)
+              if(fname[i] != '.')
               {
-                fromUIN = FindUserIdentityByAddress(&C->userIdentityList, email->SFrom[i].Address);
-                D(DBF_MAIL, "finduinByAddr (from): '%s' %08lx", email->SFrom[i].Address, fromUIN);
+                oldFound = FALSE;
+                break;
               }
-
-              setFlag(mail->mflags, MFLAG_MULTISENDER);
+            }
+            else if(!isdigit(fname[i]))
+            {
+              oldFound = FALSE;
+              break;
             }
           }
-          else if(strlen(p) >= 7) // minimum rcpts size "a@bc.de"
-            setFlag(mail->mflags, MFLAG_MULTISENDER);
-        }
-
-        D(DBF_MIME, "'From' senders: %ld", email->NumSFrom+1);
-      }
-      else if(stricmp(field, "reply-to") == 0)
-      {
-        char *p;
+          while(fname[++i] != '\0');
 
-        foundReplyTo = TRUE;
+          // check if our test was successfully and we found and old style
+          // filename
+          if(oldFound == TRUE)
+          {
+            int res;
+            BOOL convertOnce = FALSE;
 
-        // find out if there are more than one ReplyTo: address
-        if((p = MyStrChr(value, ',')) != NULL)
-         *p++ = '\0';
+            // ok we seem to have found an old-fashioned mailfile, so let's
+            // convert it to the newstyle
+            W(DBF_FOLDER, "found < v2.5 style mailfile '%s'", fname);
 
-        ExtractAddress(value, &pe);
-        mail->ReplyTo = pe;
+            // let's ask if the user wants to convert the file or not
+            if(convertAllOld == FALSE && skipAllOld == FALSE)
+            {
+              res = MUI_Request(G->App, G->MA != NULL ? G->MA->GUI.WI : NULL, MUIF_NONE,
+                                tr(MSG_MA_CREQ_OLDFILE_TITLE),
+                                tr(MSG_MA_YESNOTOALL),
+                                tr(MSG_MA_CREQUEST_OLDFILE),
+                                fname, folder->Name);
+
+              // if the user has clicked on Yes or YesToAll then
+              // set the flags accordingly
+              if(res == 0)
+                skipAllOld = TRUE;
+              else if(res == 1)
+                convertOnce = TRUE;
+              else if(res == 2)
+                convertAllOld = TRUE;
+            }
 
-        // we have to check if we can match the user identity
-        // from the email address
-        if(deep == TRUE)
-        {
-          replyToUIN = FindUserIdentityByAddress(&C->userIdentityList, mail->ReplyTo.Address);
-          D(DBF_MAIL, "finduinByAddr (replyto): '%s' %08lx", mail->ReplyTo.Address, replyToUIN);
-        }
+            if(convertAllOld == TRUE || convertOnce == TRUE)
+            {
+              char *newfname;
 
-        // if we have more addresses waiting we
-        // go and process them yet
-        if(p != NULL)
-        {
-          if(deep == TRUE)
+              // now we finally convert the file to a new style mail file
+              if((newfname = MA_ConvertOldMailFile(fname, folder)) == NULL)
+              {
+                // if there occurred any error we skip to the next file.
+                ER_NewError(tr(MSG_ER_CONVERTMFILE), fname, folder->Name);
+                continue;
+              }
+              else
+              {
+                // use the new name from now on
+                fname = newfname;
+              }
+            }
+            else
+              continue;
+          }
+          else if(fname[0] != '.')
           {
-            if(email->NumSReplyTo == 0)
-              email->NumSReplyTo = MA_GetRecipients(p, &(email->SReplyTo));
+            // to make it as convienent as possible for a user we also allow
+            // to copy mail files to a folder directory without having to take
+            // care that they have the correct filename.
+            int res;
+            BOOL convertOnce = FALSE;
 
-            if(email->NumSReplyTo > 0)
+            W(DBF_FOLDER, "found unknown file '%s'", fname);
+
+            // lets ask if the user wants to convert the file or not
+            if(convertAllUnknown == FALSE && skipAllUnknown == FALSE)
             {
-              int i;
+              res = MUI_Request(G->App, G->MA != NULL ? G->MA->GUI.WI : NULL, MUIF_NONE,
+                                tr(MSG_MA_CREQ_UNKNOWN_TITLE),
+                                tr(MSG_MA_YESNOTOALL),
+                                tr(MSG_MA_CREQUEST_UNKNOWN),
+                                fname, folder->Name);
+
+              // if the user has clicked on Yes or YesToAll then
+              // set the flags accordingly
+              if(res == 0)
+                skipAllUnknown = TRUE;
+              else if(res == 1)
+                convertOnce = TRUE;
+              else if(res == 2)
+                convertAllUnknown = TRUE;
+            }
 
-              // if we haven't found the identity yet we process the
-              // other from addresses
-              for(i=0; replyToUIN == NULL && i < email->NumSReplyTo; i++)
+            if(convertAllUnknown == TRUE || convertOnce == TRUE)
+            {
+              // now it is our job to get a new mailfile name and replace the old one
+              char oldfilePath[SIZE_PATHFILE];
+              char newfilePath[SIZE_PATHFILE];
+
+              AddPath(oldfilePath, folder->Fullpath, fname, sizeof(oldfilePath));
+              if(MA_NewMailFile(folder, newfilePath, sizeof(newfilePath)) == TRUE)
+              {
+                if(Rename(oldfilePath, newfilePath))
+                {
+                  strlcpy(fbuf, FilePart(newfilePath), sizeof(fbuf));
+                  fname = fbuf;
+                }
+                else
+                {
+                  // if there occurred any error we skip to the next file.
+                  ER_NewError(tr(MSG_ER_CONVERTMFILE), fname, folder->Name);
+                  continue;
+                }
+              }
+              else
               {
-                replyToUIN = FindUserIdentityByAddress(&C->userIdentityList, email->SReplyTo[i].Address);
-                D(DBF_MAIL, "finduinByAddr (replyto): '%s' %08lx", email->SReplyTo[i].Address, replyToUIN);
+                // if there occurred any error we skip to the next file.
+                ER_NewError(tr(MSG_ER_CONVERTMFILE), fname, folder->Name);
+                continue;
               }
-
-              setFlag(mail->mflags, MFLAG_MULTIREPLYTO);
             }
+            else
+              continue;
+          }
+          else
+          {
+            D(DBF_FOLDER, "skipping file '%s'", fname);
+            continue;
           }
-          else if(strlen(p) >= 7) // minimum rcpts size "a@bc.de"
-            setFlag(mail->mflags, MFLAG_MULTIREPLYTO);
         }
 
-        D(DBF_MIME, "'ReplyTo' recipients: %ld", email->NumSReplyTo+1);
-      }
-      else if(stricmp(field, "original-recipient") == 0)
-      {
-        ExtractAddress(value, &pe);
-        email->OriginalRcpt = pe;
-      }
-      else if(stricmp(field, "return-path") == 0)
-      {
-        ExtractAddress(value, &pe);
-        email->ReturnPath = pe;
-      }
-      else if(stricmp(field, "disposition-notification-to") == 0 ||
-              stricmp(field, "return-receipt-to") == 0)
-      {
-        ExtractAddress(value, &pe);
-        email->ReceiptTo = pe;
-        setFlag(mail->mflags, MFLAG_SENDMDN);
-      }
-      else if(stricmp(field, "to") == 0)
-      {
-        if(foundTo == FALSE)
+        // check the filesize of the mail file
+        if(ed->FileSize > 0)
         {
-          char *p;
+          // remember the file, it will be examined later
+          if(AddScanMailFile(data, folder, fname) == FALSE)
+          {
+            result = FALSE;
+            break;
+          }
+        }
+        else
+        {
+          char path[SIZE_PATHFILE+1];
 
-          foundTo = TRUE;
+          AddPath(path, folder->Fullpath, fname, sizeof(path));
+          DeleteFile(path);
 
-          if((p = MyStrChr(value, ',')) != NULL)
-            *p++ = '\0';
+          W(DBF_FOLDER, "found empty file '%s' in mail folder and deleted it", path);
+        }
+      }
+    }
 
-          ExtractAddress(value, &pe);
-          mail->To = pe;
+    error = IoErr();
+    if(error != 0 && error != ERROR_NO_MORE_ENTRIES)
+      E(DBF_FOLDER, "ExamineDir() failed, error %ld", error);
 
-          // we have to check if we can match the user identity
-          // from the email address
-          if(deep == TRUE)
-          {
-            toUIN = FindUserIdentityByAddress(&C->userIdentityList, mail->To.Address);
-            D(DBF_MAIL, "finduinByAddr (to): '%s' %08lx", mail->To.Address, toUIN);
-          }
+    ReleaseDirContext(context);
+  }
+  else
+  {
+    W(DBF_FOLDER, "couldn't allocate DirContext structure for directory '%s', IoErr()=%ld", folder->Fullpath, IoErr());
+    result = FALSE;
+  }
 
-          if(p != NULL)
-          {
-            if(deep == TRUE)
-            {
-              if(email->NumSTo == 0)
-                email->NumSTo = MA_GetRecipients(p, &(email->STo));
+  RETURN(result);
+  return result;
+}
 
-              if(email->NumSTo > 0)
-              {
-                int i;
+///
+/// ExamineScanMailFile
+//  Examines a single file of a folder scan, this is called by several
+//  threads at once.
+static void ExamineScanMailFile(APTR userData, ULONG index)
+{
+  struct ScanMailBoxData *data = (struct ScanMailBoxData *)userData;
+  struct ScanMailFile *file = &data->files[index];
+  struct ExtendedMail *email;
 
-                // if we haven't found the identity yet we process the
-                // other from addresses
-                for(i=0; toUIN == NULL && i < email->NumSTo; i++)
-                {
-                  toUIN = FindUserIdentityByAddress(&C->userIdentityList, email->STo[i].Address);
-                  D(DBF_MAIL, "finduinByAddr (to): '%s' %08lx", email->STo[i].Address, toUIN);
-                }
+  ENTER();
 
-                setFlag(mail->mflags, MFLAG_MULTIRCPT);
-              }
-            }
-            else if(strlen(p) >= 7) // minimum rcpts size "a@bc.de"
-              setFlag(mail->mflags, MFLAG_MULTIRCPT);
-          }
+  D(DBF_FOLDER, "examining mail file '%s'", file->fileName);
 
-          D(DBF_MIME, "'To:' recipients: %ld", email->NumSTo+1);
-        }
-      }
-      else if(stricmp(field, "cc") == 0)
-      {
-        if(deep == TRUE)
-        {
-          if(email->NumCC == 0)
-            email->NumCC = MA_GetRecipients(value, &(email->CC));
+  // each file is touched by exactly one thread, hence no locking is
+  // required to store the result
+  if((email = MA_ExamineMail(file->folder, file->fileName, FALSE)) != NULL)
+  {
+    // keep a clone of the examined mail only, the extended data is not needed
+    file->mail = CloneMail(&email->Mail);
+    MA_FreeEMailStruct(email);
+  }
 
-          D(DBF_MIME, "'Cc:' recipients: %ld", email->NumCC);
+  LEAVE();
+}
 
-          if(email->NumCC > 0)
-          {
-            int i;
+///
+/// ScanProgress
+//  Updates the progress gauge of a folder scan, returns FALSE if the user
+//  aborted the scan.
+static BOOL ScanProgress(APTR userData, ULONG done, ULONG count)
+{
+  struct ScanMailBoxData *data = (struct ScanMailBoxData *)userData;
+  BOOL result = TRUE;
 
-            // if we haven't found the identity yet we process the
-            // other from addresses
-            for(i=0; ccUIN == NULL && i < email->NumCC; i++)
-            {
-              ccUIN = FindUserIdentityByAddress(&C->userIdentityList, email->CC[i].Address);
-              D(DBF_MAIL, "finduinByAddr (cc): '%s' %08lx", email->CC[i].Address, ccUIN);
-            }
+  ENTER();
 
-            setFlag(mail->mflags, MFLAG_MULTIRCPT);
-          }
-        }
-        else if(strlen(value) >= 7) // minimum rcpts size "a@bc.de"
-          setFlag(mail->mflags, MFLAG_MULTIRCPT);
-      }
-      else if(stricmp(field, "bcc") == 0)
-      {
-        if(deep == TRUE)
-        {
-          if(email->NumBCC == 0)
-            email->NumBCC = MA_GetRecipients(value, &(email->BCC));
+  // set the gauge and check the stopButton status as well.
+  if(BusyProgress(data->busy, done, count) == FALSE)
+  {
+    D(DBF_FOLDER, "scan process aborted by user");
+    result = FALSE;
+  }
 
-          D(DBF_MIME, "'BCC:' recipients: %ld", email->NumBCC);
+  // give the GUI the chance to refresh
+  DoMethod(G->App, MUIM_Application_InputBuffered);
 
-          if(email->NumBCC > 0)
-          {
-            int i;
+  RETURN(result);
+  return result;
+}
 
-            // if we haven't found the identity yet we process the
-            // other from addresses
-            for(i=0; bccUIN == NULL && i < email->NumBCC; i++)
-            {
-              bccUIN = FindUserIdentityByAddress(&C->userIdentityList, email->BCC[i].Address);
-              D(DBF_MAIL, "finduinByAddr (bcc): '%s' %08lx", email->BCC[i].Address, bccUIN);
-            }
+///
+/// ExamineMailFiles
+//  Examines all collected files of a folder scan. The files are handed out to
+//  a number of threads, while the main thread takes part in the work as well
+//  and keeps the progress gauge and the GUI up to date.
+static BOOL ExamineMailFiles(struct ScanMailBoxData *data)
+{
+  BOOL result;
 
-            setFlag(mail->mflags, MFLAG_MULTIRCPT);
-          }
-        }
-        else if(strlen(value) >= 7) // minimum rcpts size "a@bc.de"
-          setFlag(mail->mflags, MFLAG_MULTIRCPT);
-      }
-      else if(stricmp(field, "resent-to") == 0)
-      {
-        if(email->NumResentTo == 0)
-          email->NumResentTo = MA_GetRecipients(value, &(email->ResentTo));
+  ENTER();
 
-        D(DBF_MIME, "'Resent-To:' recipients: %ld", email->NumResentTo);
-      }
-      else if(stricmp(field, "resent-cc") == 0)
-      {
-        if(email->NumResentCC == 0)
-          email->NumResentCC = MA_GetRecipients(value, &(email->ResentCC));
+  STARTCLOCK(DBF_FOLDER);
 
-        D(DBF_MIME, "'Resent-CC:' recipients: %ld", email->NumResentCC);
-      }
-      else if(stricmp(field, "resent-bcc") == 0)
-      {
-        if(email->NumResentBCC == 0)
-          email->NumResentBCC = MA_GetRecipients(value, &(email->ResentBCC));
+  result = RunParallel(data->numFiles, SCAN_THREADS, SCAN_FILES_PER_THREAD, ExamineScanMailFile, ScanProgress, data);
 
-        D(DBF_MIME, "'Resent-BCC:' recipients: %ld", email->NumResentBCC);
-      }
-      else if(stricmp(field, "mail-followup-to") == 0)
-      {
-        if(email->NumFollowUpTo == 0)
-          email->NumFollowUpTo = MA_GetRecipients(value, &(email->FollowUpTo));
+  STOPCLOCK(DBF_FOLDER, "examining mail files");
 
-        D(DBF_MIME, "'Mail-Followup-To:' recipients: %ld", email->NumFollowUpTo);
-      }
-      else if(stricmp(field, "mail-reply-to") == 0)
-      {
-        if(email->NumMailReplyTo == 0)
-          email->NumMailReplyTo = MA_GetRecipients(value, &(email->MailReplyTo));
+  RETURN(result);
+  return result;
+}
 
-        D(DBF_MIME, "'Mail-Reply-To:' recipients: %ld", email->NumMailReplyTo);
-      }
-      else if(stricmp(field, "subject") == 0)
-      {
-        strlcpy(mail->Subject, Trim(value), sizeof(mail->Subject));
-      }
-      else if(stricmp(field, "message-id") == 0)
-      {
-        dstrcat(&email->messageID, Trim(value));
-        mail->cMsgID = CompressMsgID(email->messageID);
-      }
-      else if(stricmp(field, "in-reply-to") == 0)
-      {
-        dstrcat(&email->inReplyToMsgID, Trim(value));
-        mail->cIRTMsgID = CompressMsgID(email->inReplyToMsgID);
-      }
-      else if(stricmp(field, "references") == 0)
-      {
-        dstrcat(&email->references, Trim(value));
-        D(DBF_MAIL, "References: '%s'", email->references);
-      }
-      else if(stricmp(field, "date") == 0)
-      {
-        dateFound = MA_ScanDate(mail, value);
-      }
-      else if(stricmp(field, "importance") == 0)
-      {
-        if(getImportanceLevel(mail) == IMP_NORMAL)
-        {
-          char *p = Trim(value);
+///
+/// CompareScanMailFiles
+//  qsort() callback to sort the examined files by their names
+static int CompareScanMailFiles(const void *p1, const void *p2)
+{
+  const struct ScanMailFile *file1 = (const struct ScanMailFile *)p1;
+  const struct ScanMailFile *file2 = (const struct ScanMailFile *)p2;
 
-          if(stricmp(p, "high") == 0)
-            setImportanceLevel(mail, IMP_HIGH);
-          else if(stricmp(p, "low") == 0)
-            setImportanceLevel(mail, IMP_LOW);
-        }
-      }
-      else if(stricmp(field, "priority") == 0)
-      {
-        if(getImportanceLevel(mail) == IMP_NORMAL)
-        {
-          char *p = Trim(value);
+  return strcmp(file1->fileName, file2->fileName);
+}
 
-          if(stricmp(p, "urgent") == 0)
-            setImportanceLevel(mail, IMP_HIGH);
-          else if(stricmp(p, "non-urgent") == 0)
-            setImportanceLevel(mail, IMP_HIGH);
-        }
-      }
-      else if(stricmp(field, "content-type") == 0)
-      {
-        char *p = Trim(value);
+///
+/// MergeMailFiles
+//  Adds the examined mail files of a folder to the folder in file name order.
+//  Files which could not be examined are handled as requested by the user.
+static BOOL MergeMailFiles(struct Folder *folder, struct ScanMailFile *files, ULONG numFiles)
+{
+  BOOL result = FALSE;
+  struct Folder *tempFolder;
 
-        if(strnicmp(p, "multipart", 9) == 0)
-        {
-          p += 10;
-
-          // we do specify the multipart content-type in
-          // accordance to RFC 2046/RFC2387
-          if(strnicmp(p, "mixed", 5) == 0)             // RFC 2046 (5.1.3)
-            setFlag(mail->mflags, MFLAG_MP_MIXED);
-          else if(strnicmp(p, "alternative", 11) == 0) // RFC 2046 (5.1.4)
-            setFlag(mail->mflags, MFLAG_MP_ALTERN);
-          else if(strnicmp(p, "report", 6) == 0)       // RFC 3462
-            setFlag(mail->mflags, MFLAG_MP_REPORT);
-          else if(strnicmp(p, "encrypted", 9) == 0)    // RFC 1847 (2.2)
-            setFlag(mail->mflags, MFLAG_MP_CRYPT);
-          else if(strnicmp(p, "signed", 6) == 0)       // RFC 1847 (2.1)
-            setFlag(mail->mflags, MFLAG_MP_SIGNED);
-          else
-          {
-            // "mixed" is the primary subtype and in fact RFC 2046 (5.1.7)
-            // suggests to fall back to mixed if a MIME subtype is unknown
-            // to a MIME parser, which we do here now.
-            setFlag(mail->mflags, MFLAG_MP_MIXED);
-          }
-        }
-        else if(strnicmp(p, "message/partial", 15) == 0) // RFC 2046 (5.2.2)
-        {
-          setFlag(mail->mflags, MFLAG_PARTIAL);
-        }
-      }
-      else if(stricmp(field, "x-senderinfo") == 0)
-      {
-        setFlag(mail->mflags, MFLAG_SENDERINFO);
-        if(deep == TRUE)
-          dstrcat(&email->SenderInfo, value);
-      }
-      else if(stricmp(field, "x-yam-mailaccount") == 0)
-      {
-        strlcpy(mail->MailAccount, value, sizeof(mail->MailAccount));
-      }
-      else if(deep == TRUE) // and if we end up here we check if we really have to go further
+  ENTER();
+
+  // allocate a temporary folder structure to avoid having to lock the real folder's
+  // mail list for each single mail we get from the index
+  if((tempFolder = AllocFolder()) != NULL)
+  {
+    BOOL ignoreInvalids = FALSE;
+    ULONG i;
+
+    result = TRUE;
+
+    // the threads finished the files in random order
+    qsort(files, numFiles, sizeof(*files), CompareScanMailFiles);
+
+    for(i=0; i < numFiles; i++)
+    {
+      struct ScanMailFile *file = &files[i];
+
+      if(file->mail == NULL && ignoreInvalids == FALSE)
       {
-        if(stricmp(field, "x-yam-options") == 0)
+        struct ExtendedMail *email;
+
+        // give the file another try and ask the user what to do if it
+        // still fails
+        while((email = MA_ExamineMail(folder, file->fileName, FALSE)) == NULL &&
+              ignoreInvalids == FALSE)
         {
-          char *p;
-          int sec;
+          // if the MA_ExamineMail() operation failed we
+          // warn the user and ask him how to proceed with
+          // the file
 
-          // check for the delsent flag
-          if(strcasestr(value, "delsent") != NULL)
-          {
-            D(DBF_MIME, "delsent found");
-            email->DelSent = TRUE;
-          }
+          int res = MUI_Request(G->App, G->MA != NULL ? G->MA->GUI.WI : NULL, MUIF_NONE,
+                               tr(MSG_MA_INVALIDMFILE_TITLE),
+                               tr(MSG_MA_INVALIDMFILE_BT),
+                               tr(MSG_MA_INVALIDMFILE),
+                               file->fileName, folder->Name);
 
-          // check for the redirect flag
-          if(strcasestr(value, "redirect") != NULL)
+          if(res == 0) // cancel/ESC
           {
-            D(DBF_MIME, "redirect found");
-            email->Redirect = TRUE;
+            result = FALSE;
+            break;
           }
-
-          // check for the signature flag
-          if((p = strcasestr(value, "signature=")) != NULL)
+          else if(res == 1) // Retry
+            continue;
+          else if(res == 2) // Ignore
+            break;
+          else if(res == 3) // Ignore All
           {
-            char idStr[9] = ""; // the signature ID is only 8 chars long + 1 NUL
-
-            strlcpy(idStr, &p[10], sizeof(idStr));
-            email->signatureID = strtoul(idStr, NULL, 16);
-
-            // try to get the signature structure
-            if(email->signatureID != 0)
-            {
-              email->signature = FindSignatureByID(&C->signatureList, email->signatureID);
-              D(DBF_MAIL, "findSignatureById: '%08x' %08lx", email->signatureID, email->signature);
-            }
-
-            D(DBF_MAIL, "found signature: '%s' %08x %08x", idStr, email->signatureID, email->signature != NULL ? email->signature->id : 0);
+            ignoreInvalids = TRUE;
+            break;
           }
-
-          // check if the identity is listed and if so this has
-          // absolute priority (so we overwrite any previously
-          // set email->identity ptr)
-          if((p = strcasestr(value, "identity=")) != NULL)
+          else if(res == 4) // Delete
           {
-            char idStr[9] = ""; // the identity ID is only 8 chars long + 1 NUL
-
-            strlcpy(idStr, &p[9], sizeof(idStr));
-            email->identityID = strtoul(idStr, NULL, 16);
-
-            // try to get the identity structure
-            if(email->identityID != 0)
-            {
-              email->identity = FindUserIdentityByID(&C->userIdentityList, email->identityID);
-              D(DBF_MAIL, "finduinById: '%08x' %08lx", email->identityID, email->identity);
-            }
+            char path[SIZE_PATHFILE+1];
 
-            D(DBF_MAIL, "found identity: '%s' %08x %08x", idStr, email->identityID, email->identity != NULL ? email->identity->id : 0);
-          }
+            AddPath(path, folder->Fullpath, file->fileName, sizeof(path));
+            DeleteFile(path);
 
-          // check security flags
-          if((p = strcasestr(value, "security=")) != NULL)
-          {
-            // check for the security flags for signing/encrypting a mail
-            // but walk backwards here otherwise we can't use break
-            for(sec = SEC_DEFAULTS; sec >= SEC_NONE; sec--)
-            {
-              if(strcasestr(&p[9], SecCodes[sec]) != NULL)
-              {
-                email->Security = sec;
-                D(DBF_MIME, "found security: %d (%s)", email->Security, SecCodes[sec]);
-                break;
-              }
-            }
+            break;
           }
         }
-        else if(strnicmp(field, "x-yam-header-", 13) == 0)
+
+        if(email != NULL)
         {
-          dstrcat(&email->extraHeaders, &field[13]);
-          dstrcat(&email->extraHeaders, ":");
-          dstrcat(&email->extraHeaders, value);
-          dstrcat(&email->extraHeaders, "\\n");
+          file->mail = CloneMail(&email->Mail);
+          MA_FreeEMailStruct(email);
         }
-      }
-    }
-
-    // if now the mail is still not MULTIPART we have to check for uuencoded attachments
-    if(!isMP_MixedMail(mail) && MA_DetectUUE(fh) == TRUE)
-      setFlag(mail->mflags, MFLAG_MP_MIXED);
 
-    // in case we found no From: head line we try to construct a name
-    // from a possible Sender: line
-    if(foundFrom == FALSE)
-    {
-      D(DBF_MIME, "no From: header");
+        if(result == FALSE)
+          break;
+      }
 
-      if((hdrNode = FindHeader(&headerList, "sender")) != NULL)
+      if(file->mail != NULL)
       {
-        char *value = hdrNode->content;
-        char *p;
-
-        // find out if there are more than one From: address
-        if((p = MyStrChr(value, ',')) != NULL)
-         *p++ = '\0';
+        struct Mail *newMail = file->mail;
 
-        // extract the main mail address
-        ExtractAddress(value, &pe);
-        mail->From = pe;
+        // the mail belongs to the folder from now on
+        file->mail = NULL;
 
-        // we have to check if we can match the user identity
-        // from the email address
-        if(deep == TRUE)
-        {
-          fromUIN = FindUserIdentityByAddress(&C->userIdentityList, mail->From.Address);
-          D(DBF_MAIL, "finduinByAddr (sender): '%s' %08lx", mail->From.Address, fromUIN);
-        }
+        // add the mail to the temporary folder
+        AddMailToFolderSimple(newMail, tempFolder);
 
-        D(DBF_MIME, "From: address obtained from Sender: header");
+        // the AddMailToFolderSimple() call set the mail's folder pointer to the
+        // temporary folder. But since this is a temporary one only and will be
+        // invalid after leaving this function we must set the mail's folder
+        // pointer to the correct current folder.
+        newMail->Folder = folder;
 
-        // if we have more addresses waiting we
-        // go and process them yet
-        if(p != NULL)
+        // if this new mail hasn't got a valid transDate we have to check if we
+        // have to take the fileDate as a fallback value.
+        if(newMail->transDate.Seconds == 0)
         {
-          if(deep == TRUE)
+          // only if it is _not_ a "waitforsend" and "hold" message we can take the fib_Date
+          // as the fallback
+          if(isDraftsFolder(folder) == FALSE && isOutgoingFolder(folder) == FALSE)
           {
-            if(email->NumSFrom == 0)
-              email->NumSFrom = MA_GetRecipients(p, &(email->SFrom));
+            char mailfile[SIZE_PATHFILE];
+            struct DateStamp ds;
 
-            if(email->NumSFrom > 0)
-            {
-              int i;
+            W(DBF_FOLDER, "no transfer date information found in mail file, using file date...");
 
-              // if we haven't found the identity yet we process the
-              // other from addresses
-              for(i=0; fromUIN == NULL && i < email->NumSFrom; i++)
-              {
-                fromUIN = FindUserIdentityByAddress(&C->userIdentityList, email->SFrom[i].Address);
-                D(DBF_MAIL, "finduinByAddr (sender): '%s' %08lx", email->SFrom[i].Address, fromUIN);
-              }
+            GetMailFile(mailfile, sizeof(mailfile), NULL, newMail);
 
-              setFlag(mail->mflags, MFLAG_MULTISENDER);
+            // now we take the filedate of the mail as the transDate
+            if(ObtainFileInfo(mailfile, FI_DATE, &ds) == TRUE)
+            {
+              // now convert the local TZ fib_Date to a UTC transDate
+              DateStamp2TimeVal(&ds, &newMail->transDate, TZC_LOCAL2UTC);
             }
+
+            // then we update the mailfilename
+            MA_UpdateMailFile(newMail);
           }
-          else if(strlen(p) >= 7) // minimum rcpts size "a@bc.de"
-            setFlag(mail->mflags, MFLAG_MULTISENDER);
         }
-
-        D(DBF_MIME, "'Sender' senders: %ld", email->NumSFrom+1);
-
-        foundFrom = TRUE;
       }
     }
 
-    // And now we close the Mailfile and clear the temporary headerList again
-    fclose(fh);
-    ClearHeaderList(&headerList);
-
-    // Now choose the user identity from the identities found in the loop
-    // above. We start with the identity found by the To: header line, as
-    // this is the one which should match best. Next are the other possible
-    // "receiving" addresses and finally the possible sender addresses.
-    if(toUIN != NULL)
-      email->identity = toUIN;
-    else if(ccUIN != NULL)
-      email->identity = ccUIN;
-    else if(bccUIN != NULL)
-      email->identity = bccUIN;
-    else if(replyToUIN != NULL)
-      email->identity = replyToUIN;
-    else if(fromUIN != NULL)
-      email->identity = fromUIN;
-
-    // if we still don't have identified a potential user identity
-    // that matches the From:/To:/Reply-To:, etc. headers contents
-    // (e.g. because deep==FALSE) then we set the default identity
-    if(email->identity == NULL)
-      email->identity = GetUserIdentity(&C->userIdentityList, 0, TRUE);
-
-    if(email->identity != NULL)
-      D(DBF_MAIL, "final identity: %08x '%s'", email->identity->id, email->identity->description);
-    else
-      E(DBF_MAIL, "no identities configured");
-
-    // in case the replyTo recipient doesn't have a realname yet and it is
-    // completly the same like the from address we go and copy the realname as both
-    // are the same.
-    if(foundReplyTo == TRUE && mail->ReplyTo.RealName[0] != '\0' && stricmp(mail->ReplyTo.Address, mail->From.Address) == 0)
-      strlcpy(mail->ReplyTo.RealName, mail->From.RealName, sizeof(mail->ReplyTo.RealName));
-
-    // if this function call has a folder of NULL then we are examining a virtual mail
-    // which means this mail doesn't have any folder and also no filename that may contain
-    // any usable date or stuff
-    if(folder != NULL)
+    // if everything went well then move all mails from the temporary folder
+    // to the real folder
+    if(result == TRUE)
     {
-      char *timebuf = NULL;
+      MoveFolderContents(folder, tempFolder);
 
-      // now we take the filename of our mailfile into account to check for
-      // the transfer date at the start of the name and for the set status
-      // flags at the end of it.
-      strlcpy(dateFilePart, mail->MailFile, sizeof(dateFilePart));
-
-      // make sure there is no "-" in the base64 encoded part as we just mapped
-      // the not allowed "/" to "-" to make it possible to use base64 for
-      // the timeval encoding
-      ptr = dateFilePart;
-      while((ptr = strchr(ptr, '-')) != NULL)
-        *ptr = '/';
+      // the examined mails know their references, so the threads can be
+      // rebuilt right now without reading the mail files again later
+      LockMailList(folder->messages);
+      MailThreadsRebuild(folder);
+      UnlockMailList(folder->messages);
+    }
 
-      // lets decode the base64 encoded timestring in a temporary buffer
-      if(base64decode(&timebuf, dateFilePart, strlen(dateFilePart)) <= 0)
-      {
-        W(DBF_FOLDER, "WARNING: failure in decoding the encoded date from mailfile: '%s'", mail->MailFile);
+    // free the temporary folder again
+    FreeFolder(tempFolder);
+  }
 
-        // if we weren't able to decode the base64 encoded string
-        // we have to validate the transDate so that the calling function
-        // recognizes to rewrite the comment with a valid string.
-        mail->transDate.Seconds      = 0;
-        mail->transDate.Microseconds = 0;
-      }
-      else
-      {
-        // everything seems to have worked so lets copy the binary data in our
-        // transDate structure
-        memcpy(&mail->transDate, timebuf, sizeof(mail->transDate));
+  RETURN(result);
+  return result;
+}
 
-        free(timebuf);
-      }
+///
+/// ScanMailBoxes
+//  Scans the directories of several folders for message files at once. The
+//  files of all folders are examined in parallel. 'results' receives the
+//  success state of each folder.
+static BOOL ScanMailBoxes(struct Folder **folders, BOOL *results, ULONG numFolders)
+{
+  BOOL result = FALSE;
+  static BOOL alreadyScanning = FALSE;
+  ULONG i;
 
-      // now grab the status out of the end of the mailfilename
-      ptr = &mail->MailFile[17];
-      while(*ptr != '\0')
-      {
-        if(*ptr >= '1' && *ptr <= '7')
-        {
-          setPERValue(mail, *ptr-'1'+1);
-        }
-        else
-        {
-          switch(*ptr)
-          {
-            case SCHAR_READ:
-              setFlag(mail->sflags, SFLAG_READ);
-            break;
+  ENTER();
 
-            case SCHAR_REPLIED:
-              setFlag(mail->sflags, SFLAG_REPLIED);
-            break;
+  for(i=0; i < numFolders; i++)
+    results[i] = FALSE;
 
-            case SCHAR_FORWARDED:
-              setFlag(mail->sflags, SFLAG_FORWARDED);
-            break;
+  // check if we are already in this function or not
+  // (due to a previously started scanning
+  if(alreadyScanning == FALSE)
+  {
+    struct MA_GUIData *gui = &G->MA->GUI;
+    struct ScanMailBoxData data;
+    ULONG *firstFiles;
 
-            case SCHAR_NEW:
-              setFlag(mail->sflags, SFLAG_NEW);
-            break;
+    // make sure others notice that an index scanning already
+    // runs
+    alreadyScanning = TRUE;
 
-            case SCHAR_HOLD:
-              setFlag(mail->sflags, SFLAG_HOLD);
-            break;
+    memset(&data, 0, sizeof(data));
 
-            case SCHAR_SENT:
-              setFlag(mail->sflags, SFLAG_SENT);
-            break;
+    if((firstFiles = calloc(numFolders + 1, sizeof(*firstFiles))) != NULL)
+    {
+      struct BusyNode *busy;
 
-            case SCHAR_MARKED:
-              setFlag(mail->sflags, SFLAG_MARKED);
-            break;
+      busy = BusyBegin(BUSY_PROGRESS_ABORT);
+      data.busy = busy;
 
-            case SCHAR_ERROR:
-              setFlag(mail->sflags, SFLAG_ERROR);
-            break;
+      for(i=0; i < numFolders; i++)
+      {
+        struct Folder *folder = folders[i];
 
-            case SCHAR_USERSPAM:
-              setFlag(mail->sflags, SFLAG_USERSPAM);
-            break;
+        // now we make sure some GUI components will be disabled
+        // or cleared if the rescanning folder is the current one
+        if(GetCurrentFolder() == folder)
+        {
+          // before we go and rebuild the index of the folder we make
+          // sure all major GUI components of it are disabled for the
+          // time being...
+          xset(gui->PG_MAILLIST, MUIA_Disabled, TRUE);
+          DoMethod(gui->PG_MAILLIST, MUIM_NList_Clear);
+
+          // and now we also make sure an eventually enabled quicksearch bar
+          // is enabled again as well.
+          if(C->QuickSearchBarPos != QSB_POS_OFF)
+            set(gui->GR_QUICKSEARCHBAR, MUIA_Disabled, TRUE);
+
+          // also set an embedded read pane as disabled.
+          if(C->EmbeddedReadPane == TRUE)
+          {
+            DoMethod(gui->MN_EMBEDDEDREADPANE, MUIM_ReadMailGroup_Clear, MUIF_NONE);
+            set(gui->MN_EMBEDDEDREADPANE, MUIA_Disabled, TRUE);
+          }
+        }
 
-            case SCHAR_AUTOSPAM:
-              setFlag(mail->sflags, SFLAG_AUTOSPAM);
-            break;
+        BusyText(busy, tr(MSG_BusyScanning), folder->Name);
 
-            case SCHAR_HAM:
-              setFlag(mail->sflags, SFLAG_HAM);
-            break;
+        D(DBF_FOLDER, "Scanning folder: '%s' (path '%s')...", folder->Name, folder->Fullpath);
 
-            default:
-              W(DBF_FOLDER, "invalid mail status character '%lc' found", *ptr);
-            break;
-          }
+        firstFiles[i] = data.numFiles;
+        if((results[i] = CollectMailFiles(folder, &data)) == FALSE)
+        {
+          // forget about the files of a failed folder
+          data.numFiles = firstFiles[i];
         }
-
-        ptr++;
       }
-    }
+      firstFiles[numFolders] = data.numFiles;
 
-    // if we didn't find a Date: header we take the transfered date (if found)
-    if(dateFound == FALSE)
-    {
-      if(mail->transDate.Seconds > 0)
+      // now examine the files of all folders in parallel
+      if(ExamineMailFiles(&data) == TRUE)
       {
-        // convert the UTC transDate to a UTC mail Date
-        TimeVal2DateStamp(&mail->transDate, &mail->Date, TZC_NONE);
+        result = TRUE;
+
+        for(i=0; i < numFolders; i++)
+        {
+          if(results[i] == TRUE)
+          {
+            BusyText(busy, tr(MSG_BusyScanning), folders[i]->Name);
+
+            results[i] = MergeMailFiles(folders[i], &data.files[firstFiles[i]], firstFiles[i+1] - firstFiles[i]);
+          }
+
+          D(DBF_FOLDER, "scanning of folder '%s' finished %s", folders[i]->Name, results[i] ? "successfully" : "unsuccessfully");
+        }
       }
       else
       {
-        // and as a fallback we take the date of the mail file
-        if(ObtainFileInfo(mail->MailFile, FI_DATE, &mail->Date) == TRUE)
-        {
-          // we store the mail date in UTC, thus convert it to
-          // a UTC relative DateStamp accordingly.
-          DateStampTZConvert(&mail->Date, TZC_LOCAL2UTC);
-        }
+        for(i=0; i < numFolders; i++)
+          results[i] = FALSE;
       }
 
-      // set the timeZone to our local one
-      mail->gmtOffset = G->gmtOffset;
-      strlcpy(mail->tzAbbr, G->tzAbbr, sizeof(mail->tzAbbr));
+      BusyEnd(busy);
     }
 
-    // lets calculate the mailSize out of the FileSize() function
-    if(ObtainFileInfo(fullfile, FI_SIZE, &size) == TRUE)
-      mail->Size = size;
-    else
-      mail->Size = -1;
+    // free the mails which didn't make it into a folder
+    for(i=0; i < data.numFiles; i++)
+      FreeMail(data.files[i].mail);
 
-    FinishUnpack(fullfile);
+    free(data.files);
+    free(firstFiles);
 
-    RETURN(email);
-    return email;
+    // make sure others can use this function again
+    alreadyScanning = FALSE;
   }
-  else
-    E(DBF_MAIL, "couldn't read/parse mail header of mail file '%s'", fullfile);
-
-  FinishUnpack(fullfile);
-
-  // finish up everything before we exit with an error
-  if(fh != NULL)
-    fclose(fh);
-
-  MA_FreeEMailStruct(email);
 
-  RETURN(NULL);
-  return NULL;
+  RETURN(result);
+  return result;
 }
 
 ///
@@ -3024,7 +5693,6 @@ static BOOL MA_ScanMailBox(struct Folder *folder)
 {
   long filecount;
   BOOL result = TRUE;
-  static BOOL alreadyScanning = FALSE;
 
   ENTER();
 
@@ -3043,370 +5711,9 @@ static BOOL MA_ScanMailBox(struct Folder *folder)
   }
   else
   {
-    // check if we are already in this function or not
-    // (due to a previously started scanning
-    if(alreadyScanning == TRUE)
-    {
-      result = FALSE;
-    }
-    else
-    {
-      struct MA_GUIData *gui = &G->MA->GUI;
-      struct BusyNode *busy;
-      struct Folder *tempFolder;
-
-      // make sure others notice that an index scanning already
-      // runs
-      alreadyScanning = TRUE;
-
-      // now we make sure some GUI components will be disabled
-      // or cleared if the rescanning folder is the current one
-      if(GetCurrentFolder() == folder)
-      {
-        // before we go and rebuild the index of the folder we make
-        // sure all major GUI components of it are disabled for the
-        // time being...
-        xset(gui->PG_MAILLIST, MUIA_Disabled, TRUE);
-        DoMethod(gui->PG_MAILLIST, MUIM_NList_Clear);
-
-        // and now we also make sure an eventually enabled quicksearch bar
-        // is enabled again as well.
-        if(C->QuickSearchBarPos != QSB_POS_OFF)
-          set(gui->GR_QUICKSEARCHBAR, MUIA_Disabled, TRUE);
-
-        // also set an embedded read pane as disabled.
-        if(C->EmbeddedReadPane == TRUE)
-        {
-          DoMethod(gui->MN_EMBEDDEDREADPANE, MUIM_ReadMailGroup_Clear, MUIF_NONE);
-          set(gui->MN_EMBEDDEDREADPANE, MUIA_Disabled, TRUE);
-        }
-      }
-
-      busy = BusyBegin(BUSY_PROGRESS_ABORT);
-      BusyText(busy, tr(MSG_BusyScanning), folder->Name);
-
-      // allocate a temporary folder structure to avoid having to lock the real folder's
-      // mail list for each single mail we get from the index
-      if((tempFolder = AllocFolder()) != NULL)
-      {
-        APTR context;
-
-        D(DBF_FOLDER, "Scanning folder: '%s' (path '%s', %ld files)...", folder->Name, folder->Fullpath, filecount);
-
-        if((context = ObtainDirContextTags(EX_StringName, (IPTR)folder->Fullpath,
-                                           EX_DataFields, EXF_TYPE|EXF_NAME|EXF_SIZE,
-                                           TAG_DONE)) != NULL)
-        {
-          struct ExamineData *ed;
-          LONG error;
-          long processedFiles = 0;
-          BOOL convertAllOld = FALSE;
-          BOOL skipAllOld = FALSE;
-          BOOL convertAllUnknown = FALSE;
-          BOOL skipAllUnknown = FALSE;
-          BOOL ignoreInvalids = FALSE;
-
-          // Now that the folder is locked we go and define its loaded
-          // mode to LM_REBUILD so that others don't try to access it
-          // anymore.
-          folder->LoadedMode = LM_REBUILD;
-          // visually update this state change
-          DoMethod(gui->LT_FOLDERS, MUIM_NListtree_Redraw, folder->Treenode, MUIF_NONE);
-
-          while((ed = ExamineDir(context)) != NULL)
-          {
-            // set the gauge and check the stopButton status as well.
-            if(BusyProgress(busy, ++processedFiles, filecount) == FALSE)
-            {
-              D(DBF_FOLDER, "scan process aborted by user");
-              result = FALSE;
-              break;
-            }
-
-            // give the GUI the chance to refresh
-            DoMethod(G->App,MUIM_Application_InputBuffered);
-
-            // then check whether this is a file as we don't care for subdirectories
-            if(EXD_IS_FILE(ed))
-            {
-              // check whether the filename is a valid mailfilename
-              char fbuf[SIZE_PATHFILE+1];
-              char *fname = (char *)ed->Name;
-              BOOL validMailFile = isValidMailFile(fname);
-
-              if(validMailFile == FALSE)
-              {
-                // ok, the file doesn't seem to have to be a valid mail filename, so
-                // let's see if it is an "old" file (<= YAM2.4) or just trash
-                int i = 0;
-                BOOL oldFound = TRUE;
-
-                do
-                {
-                  // on position 5 should be a colon
-                  if(i == 5)
-                  {
-                    if(fname[i] != '.')
-                    {
-                      oldFound = FALSE;
-                      break;
-                    }
-                  }
-                  else if(!isdigit(fname[i]))
-                  {
-                    oldFound = FALSE;
-                    break;
-                  }
-                }
-                while(fname[++i] != '\0');
-
-                // check if our test was successfully and we found and old style
-                // filename
-                if(oldFound == TRUE)
-                {
-                  int res;
-                  BOOL convertOnce = FALSE;
-
-                  // ok we seem to have found an old-fashioned mailfile, so let's
-                  // convert it to the newstyle
-                  W(DBF_FOLDER, "found < v2.5 style mailfile '%s'", fname);
-
-                  // let's ask if the user wants to convert the file or not
-                  if(convertAllOld == FALSE && skipAllOld == FALSE)
-                  {
-                    res = MUI_Request(G->App, G->MA != NULL ? G->MA->GUI.WI : NULL, MUIF_NONE,
-                                      tr(MSG_MA_CREQ_OLDFILE_TITLE),
-                                      tr(MSG_MA_YESNOTOALL),
-                                      tr(MSG_MA_CREQUEST_OLDFILE),
-                                      fname, folder->Name);
-
-                    // if the user has clicked on Yes or YesToAll then
-                    // set the flags accordingly
-                    if(res == 0)
-                      skipAllOld = TRUE;
-                    else if(res == 1)
-                      convertOnce = TRUE;
-                    else if(res == 2)
-                      convertAllOld = TRUE;
-                  }
-
-                  if(convertAllOld == TRUE || convertOnce == TRUE)
-                  {
-                    char *newfname;
-
-                    // now we finally convert the file to a new style mail file
-                    if((newfname = MA_ConvertOldMailFile(fname, folder)) == NULL)
-                    {
-                      // if there occurred any error we skip to the next file.
-                      ER_NewError(tr(MSG_ER_CONVERTMFILE), fname, folder->Name);
-                      continue;
-                    }
-                    else
-                    {
-                      // use the new name from now on
-                      fname = newfname;
-                    }
-                  }
-                  else
-                    continue;
-                }
-                else if(fname[0] != '.')
-                {
-                  // to make it as convienent as possible for a user we also allow
-                  // to copy mail files to a folder directory without having to take
-                  // care that they have the correct filename.
-                  int res;
-                  BOOL convertOnce = FALSE;
-
-                  W(DBF_FOLDER, "found unknown file '%s'", fname);
-
-                  // lets ask if the user wants to convert the file or not
-                  if(convertAllUnknown == FALSE && skipAllUnknown == FALSE)
-                  {
-                    res = MUI_Request(G->App, G->MA != NULL ? G->MA->GUI.WI : NULL, MUIF_NONE,
-                                      tr(MSG_MA_CREQ_UNKNOWN_TITLE),
-                                      tr(MSG_MA_YESNOTOALL),
-                                      tr(MSG_MA_CREQUEST_UNKNOWN),
-                                      fname, folder->Name);
-
-                    // if the user has clicked on Yes or YesToAll then
-                    // set the flags accordingly
-                    if(res == 0)
-                      skipAllUnknown = TRUE;
-                    else if(res == 1)
-                      convertOnce = TRUE;
-                    else if(res == 2)
-                      convertAllUnknown = TRUE;
-                  }
-
-                  if(convertAllUnknown == TRUE || convertOnce == TRUE)
-                  {
-                    // now it is our job to get a new mailfile name and replace the old one
-                    char oldfilePath[SIZE_PATHFILE];
-                    char newfilePath[SIZE_PATHFILE];
-
-                    AddPath(oldfilePath, folder->Fullpath, fname, sizeof(oldfilePath));
-                    if(MA_NewMailFile(folder, newfilePath, sizeof(newfilePath)) == TRUE)
-                    {
-                      if(Rename(oldfilePath, newfilePath))
-                      {
-                        strlcpy(fbuf, FilePart(newfilePath), sizeof(fbuf));
-                        fname = fbuf;
-                      }
-                      else
-                      {
-                        // if there occurred any error we skip to the next file.
-                        ER_NewError(tr(MSG_ER_CONVERTMFILE), fname, folder->Name);
-                        continue;
-                      }
-                    }
-                    else
-                    {
-                      // if there occurred any error we skip to the next file.
-                      ER_NewError(tr(MSG_ER_CONVERTMFILE), fname, folder->Name);
-                      continue;
-                    }
-                  }
-                  else
-                    continue;
-                }
-                else
-                {
-                  D(DBF_FOLDER, "skipping file '%s'", fname);
-                  continue;
-                }
-              }
-
-              // check the filesize of the mail file
-              if(ed->FileSize > 0)
-              {
-                struct ExtendedMail *email;
-
-                D(DBF_FOLDER, "examining mail file '%s'", fname);
-
-                while((email = MA_ExamineMail(folder, fname, FALSE)) == NULL &&
-                      ignoreInvalids == FALSE)
-                {
-                  // if the MA_ExamineMail() operation failed we
-                  // warn the user and ask him how to proceed with
-                  // the file
-
-                  int res = MUI_Request(G->App, G->MA != NULL ? G->MA->GUI.WI : NULL, MUIF_NONE,
-                                       tr(MSG_MA_INVALIDMFILE_TITLE),
-                                       tr(MSG_MA_INVALIDMFILE_BT),
-                                       tr(MSG_MA_INVALIDMFILE),
-                                       fname, folder->Name);
-
-                  if(res == 0) // cancel/ESC
-                  {
-                    result = FALSE;
-                    break;
-                  }
-                  else if(res == 1) // Retry
-                    continue;
-                  else if(res == 2) // Ignore
-                    break;
-                  else if(res == 3) // Ignore All
-                  {
-                    ignoreInvalids = TRUE;
-                    break;
-                  }
-                  else if(res == 4) // Delete
-                  {
-                    char path[SIZE_PATHFILE+1];
+    D(DBF_FOLDER, "%ld files found in folder '%s'", filecount, folder->Name);
 
-                    AddPath(path, folder->Fullpath, fname, sizeof(path));
-                    DeleteFile(path);
-
-                    break;
-                  }
-                }
-
-                if(email != NULL)
-                {
-                  struct Mail *newMail;
-
-                  if((newMail = CloneMail(&email->Mail)) != NULL)
-                  {
-                    // add the mail to the temporary folder
-                    AddMailToFolderSimple(newMail, tempFolder);
-
-                    // the AddMailToFolderSimple() call set the mail's folder pointer to the
-                    // temporary folder. But since this is a temporary one only and will be
-                    // invalid after leaving this function we must set the mail's folder
-                    // pointer to the correct current folder.
-                    newMail->Folder = folder;
-
-                    // if this new mail hasn't got a valid transDate we have to check if we
-                    // have to take the fileDate as a fallback value.
-                    if(newMail->transDate.Seconds == 0)
-                    {
-                      // only if it is _not_ a "waitforsend" and "hold" message we can take the fib_Date
-                      // as the fallback
-                      if(isDraftsFolder(folder) == FALSE && isOutgoingFolder(folder) == FALSE)
-                      {
-                        char mailfile[SIZE_PATHFILE];
-                        struct DateStamp ds;
-
-                        W(DBF_FOLDER, "no transfer date information found in mail file, using file date...");
-
-                        GetMailFile(mailfile, sizeof(mailfile), NULL, newMail);
-                        // obtain the datestamp information from  and as a fallback we take the date of the mail file
-                        if(ObtainFileInfo(mailfile, FI_DATE, &ds) == TRUE)
-                        {
-                          // now convert the local TZ fib_Date to a UTC transDate
-                          DateStamp2TimeVal(&ds, &newMail->transDate, TZC_LOCAL2UTC);
-                        }
-
-                        // then we update the mailfilename
-                        MA_UpdateMailFile(newMail);
-                      }
-                    }
-                  }
-
-                  MA_FreeEMailStruct(email);
-                }
-              }
-              else
-              {
-                char path[SIZE_PATHFILE+1];
-
-                AddPath(path, folder->Fullpath, fname, sizeof(path));
-                DeleteFile(path);
-
-                W(DBF_FOLDER, "found empty file '%s' in mail folder and deleted it", path);
-              }
-            }
-          }
-
-          error = IoErr();
-          if(error != 0 && error != ERROR_NO_MORE_ENTRIES)
-            E(DBF_FOLDER, "ExamineDir() failed, error %ld", error);
-
-          ReleaseDirContext(context);
-        }
-        else
-        {
-          W(DBF_FOLDER, "couldn't allocate DirContext structure for directory '%s', IoErr()=%ld", folder->Fullpath, IoErr());
-          result = FALSE;
-        }
-
-        // if everything went well then move all mails from the temporary folder
-        // to the real folder
-        if(result == TRUE)
-          MoveFolderContents(folder, tempFolder);
-
-        // free the temporary folder again
-        FreeFolder(tempFolder);
-      }
-
-      D(DBF_FOLDER, "scanning finished %s", result ? "successfully" : "unsuccessfully");
-
-      BusyEnd(busy);
-
-      // make sure others can use this function again
-      alreadyScanning = FALSE;
-    }
+    ScanMailBoxes(&folder, &result, 1);
   }
 
   RETURN(result);
@@ -3425,7 +5732,10 @@ void MoveHeldMailsToDraftsFolder(void)
 
   if((outgoing = FO_GetFolderByType(FT_OUTGOING, NULL)) != NULL && (drafts = FO_GetFolderByType(FT_DRAFTS, NULL)) != NULL)
   {
-    if(MA_GetIndex(outgoing) == TRUE && MA_GetIndex(drafts) == TRUE)
+    // an outgoing folder known to be empty from its .index header needs not
+    // to be loaded here, this is left to the index preloading
+    if((outgoing->LoadedMode != LM_FLUSHED || outgoing->Total > 0) &&
+       MA_GetIndex(outgoing) == TRUE && MA_GetIndex(drafts) == TRUE)
     {
       struct MailList *mlist = NULL;
 
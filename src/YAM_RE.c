@@ -98,8 +98,13 @@
 /* local defines */
 enum SMsgType { SMT_NORMAL=0, SMT_MDN, SMT_SIGNED, SMT_ENCRYPTED };
 
+// parts which are kept in memory during quiet parsing are written
+// to their part file if they are larger than this
+#define MAX_MEMORY_PART_SIZE (256*1024)
+
 /* local protos */
 static BOOL RE_HandleMDNReport(const struct Part *frp);
+static void RE_UndoPart(struct Part *rp);
 
 /***************************************************************************
  Module: Read
@@ -1391,12 +1396,71 @@ static BOOL RE_ScanHeader(struct Part *rp, FILE *in, FILE *out, enum ReadHeaderM
   RETURN(TRUE);
   return TRUE;
 }
+///
+/// RE_ConvertPartText
+//  Converts the text in a dynamic string from the given codeset to UTF-8
+static void RE_ConvertPartText(char **dstr, const struct codeset *srcCodeset, const BOOL allowAutoDetect)
+{
+  ENTER();
+
+  // in case the user wants us to detect the correct codeset we do it now
+  if(allowAutoDetect == TRUE)
+  {
+    if(srcCodeset == NULL ||
+       (C->DetectCyrillic == TRUE && srcCodeset->name != NULL && stricmp(srcCodeset->name, "utf-8") != 0))
+    {
+      struct codeset *cs = CodesetsFindBest(CSA_Source,            *dstr,
+                                            CSA_SourceLen,         dstrlen(*dstr),
+                                            CSA_CodesetFamily,     C->DetectCyrillic == TRUE ? CSV_CodesetFamily_Cyrillic : CSV_CodesetFamily_Latin,
+                                            CSA_FallbackToDefault, FALSE,
+                                            TAG_DONE);
+
+      if(cs != NULL && cs != srcCodeset)
+      {
+        D(DBF_MAIL, "Detected [%s] codeset using CodesetsFindBest()", cs->name);
+        srcCodeset = cs;
+      }
+      else
+        W(DBF_MAIL, "Couldn't autodetect codeset for supplied src text");
+    }
+  }
+
+  // if this function was invoked with a source Codeset we have to make sure
+  // we convert from the supplied source Codeset to our current local codeset with
+  // help of the functions codesets.library provides.
+  if(srcCodeset != NULL && srcCodeset->name != NULL && stricmp(srcCodeset->name, "utf-8") != 0)
+  {
+    ULONG utf8len = 0;
+
+    // convert from the srcCodeset to UTF8
+    UTF8 *utf8str = CodesetsUTF8Create(CSA_Source,          *dstr,
+                                       CSA_SourceLen,       dstrlen(*dstr),
+                                       CSA_SourceCodeset,   srcCodeset,
+                                       CSA_DestLenPtr,      &utf8len,
+                                       TAG_DONE);
+
+    // check if operations succeeded and replace the text
+    if(utf8str != NULL && utf8len > 0)
+      dstrmemcpy(dstr, (char *)utf8str, utf8len);
+    else
+      W(DBF_MAIL, "couldn't convert dstr with CodesetsUTF8Create(): %08lx %ld", *dstr, dstrlen(*dstr));
+
+    if(utf8str != NULL)
+      CodesetsFreeA(utf8str, NULL);
+  }
+  else
+    D(DBF_MAIL, "srcCodeset is [%s], no codeset conversion performed/necessary", srcCodeset == NULL ? "<NULL>" : srcCodeset->name);
+
+  LEAVE();
+}
+
 ///
 /// RE_ConsumeRestOfPart
 //  Processes body of a message part and takes care to convert the text
 //  to UTF-8 if a srcCodeset has been supplied and the encoding of the part is
-//  either 7bit or 8bit which should signal that it is actually readable text
-static BOOL RE_ConsumeRestOfPart(FILE *ifh, FILE *ofh, const struct codeset *srcCodeset,
+//  either 7bit or 8bit which should signal that it is actually readable text.
+//  The text is either written to 'ofh' or returned as dynamic string in 'data'
+static BOOL RE_ConsumeRestOfPart(FILE *ifh, FILE *ofh, char **data, const struct codeset *srcCodeset,
                                  const struct Part *rp, const BOOL allowAutoDetect)
 {
   BOOL result = FALSE;
@@ -1429,7 +1493,7 @@ static BOOL RE_ConsumeRestOfPart(FILE *ifh, FILE *ofh, const struct codeset *src
         skipCodesets = TRUE;
       }
 
-      if(ofh != NULL)
+      if(ofh != NULL || data != NULL)
       {
         // preallocate a buffer for the part
         size_t encodedSize = 0;
@@ -1561,7 +1625,7 @@ static BOOL RE_ConsumeRestOfPart(FILE *ifh, FILE *ofh, const struct codeset *src
       // or if we plainly read data only. If we should write out later we stuff
       // all our data into a dynamic array first so that we can do any potential
       // codeset conversion in one run.
-      if(ofh != NULL)
+      if(ofh != NULL || data != NULL)
       {
         // as we use GetLine() above (with no LF) we have to output a LF before we
         // go on. This will in fact strip the last newline right where the mime boundary
@@ -1582,7 +1646,7 @@ static BOOL RE_ConsumeRestOfPart(FILE *ifh, FILE *ofh, const struct codeset *src
     if(result == FALSE && curlen == -1 && feof(ifh) != 0)
     {
       // if we read at least one line we must add a line feed, because GetLine() strips these
-      if(numLines > 1 && ofh != NULL)
+      if(numLines > 1 && (ofh != NULL || data != NULL))
         dstrcat(&dstr, "\n");
 
       result = TRUE;
@@ -1590,84 +1654,23 @@ static BOOL RE_ConsumeRestOfPart(FILE *ifh, FILE *ofh, const struct codeset *src
 
     // now that we have the whole text in dstr we can check if we need to convert it to
     // a different codeset or write it out right away.
+    if(dstr != NULL && skipCodesets == FALSE && (ofh != NULL || data != NULL))
+      RE_ConvertPartText(&dstr, srcCodeset, allowAutoDetect);
+
     if(ofh != NULL)
     {
-      char *dststr = NULL;
-      size_t dstlen = 0;
-      BOOL codesetConverted = FALSE;
-
-      if(skipCodesets == FALSE)
-      {
-        // in case the user wants us to detect the correct codeset we do it now
-        if(allowAutoDetect == TRUE)
-        {
-          if(srcCodeset == NULL ||
-             (C->DetectCyrillic == TRUE && srcCodeset->name != NULL && stricmp(srcCodeset->name, "utf-8") != 0))
-          {
-            struct codeset *cs = CodesetsFindBest(CSA_Source,            dstr,
-                                                  CSA_SourceLen,         dstrlen(dstr),
-                                                  CSA_CodesetFamily,     C->DetectCyrillic == TRUE ? CSV_CodesetFamily_Cyrillic : CSV_CodesetFamily_Latin,
-                                                  CSA_FallbackToDefault, FALSE,
-                                                  TAG_DONE);
-
-            if(cs != NULL && cs != srcCodeset)
-            {
-              D(DBF_MAIL, "Detected [%s] codeset using CodesetsFindBest()", cs->name);
-              srcCodeset = cs;
-            }
-            else
-              W(DBF_MAIL, "Couldn't autodetect codeset for supplied src text");
-          }
-        }
-
-        // if this function was invoked with a source Codeset we have to make sure
-        // we convert from the supplied source Codeset to our current local codeset with
-        // help of the functions codesets.library provides.
-        if(srcCodeset != NULL && srcCodeset->name != NULL && stricmp(srcCodeset->name, "utf-8") != 0)
-        {
-          ULONG utf8len = 0;
-
-          // convert from the srcCodeset to UTF8
-          UTF8 *utf8str = CodesetsUTF8Create(CSA_Source,          dstr,
-                                             CSA_SourceLen,       dstrlen(dstr),
-                                             CSA_SourceCodeset,   srcCodeset,
-                                             CSA_DestLenPtr,      &utf8len,
-                                             TAG_DONE);
-
-          // check if operations succeeded
-          if(utf8str != NULL && utf8len > 0)
-          {
-            dststr = (char *)utf8str;
-            dstlen = utf8len;
-
-            // signal that the destination string had
-            // been converted
-            codesetConverted = TRUE;
-          }
-          else
-            W(DBF_MAIL, "couldn't convert dstr with CodesetsUTF8Create(): %08lx %ld", dstr, dstrlen(dstr));
-        }
-        else
-          D(DBF_MAIL, "srcCodeset is [%s], no codeset conversion performed/necessary", srcCodeset == NULL ? "<NULL>" : srcCodeset->name);
-      }
-
-      // make sure we fallback to dstr
-      if(codesetConverted == FALSE)
-      {
-        dststr = dstr;
-        dstlen = dstrlen(dstr);
-      }
-
       // now write back exactly the same amount of bytes we read previously
-      if(fwrite(dststr, dstlen, 1, ofh) <= 0)
+      if(fwrite(dstr, dstrlen(dstr), 1, ofh) <= 0)
       {
         E(DBF_MAIL, "error during write operation!");
         result = FALSE;
       }
-
-      // free the codesets converted string
-      if(codesetConverted == TRUE)
-        CodesetsFreeA(dststr, NULL);
+    }
+    else if(data != NULL)
+    {
+      // hand over the text to the caller
+      *data = dstr;
+      dstr = NULL;
     }
 
     // free the dynamic string
@@ -1679,8 +1682,9 @@ static BOOL RE_ConsumeRestOfPart(FILE *ifh, FILE *ofh, const struct codeset *src
 }
 ///
 /// RE_DecodeStream
-//  Decodes contents of a part
-static BOOL RE_DecodeStream(struct Part *rp, FILE *in, FILE *out)
+//  Decodes contents of a part, either from stream 'in' to stream 'out' or for
+//  parts kept in memory from the part's data to the dynamic string 'data'
+static BOOL RE_DecodeStream(struct Part *rp, FILE *in, FILE *out, char **data)
 {
   BOOL decodeResult = FALSE;
   struct codeset *sourceCodeset = NULL;
@@ -1728,7 +1732,13 @@ static BOOL RE_DecodeStream(struct Part *rp, FILE *in, FILE *out)
     // process a base64 decoding.
     case ENC_B64:
     {
-      long decoded = base64decode_file(in, out, sourceCodeset, isText, isPrintable(rp));
+      long decoded;
+
+      if(data != NULL)
+        decoded = base64decode_buffer(data, rp->Data, dstrlen(rp->Data), sourceCodeset, isText, isPrintable(rp));
+      else
+        decoded = base64decode_file(in, out, sourceCodeset, isText, isPrintable(rp));
+
       D(DBF_MAIL, "base64 decoded %ld bytes of part %ld.", decoded, rp->Nr);
 
       if(decoded > 0)
@@ -1767,7 +1777,13 @@ static BOOL RE_DecodeStream(struct Part *rp, FILE *in, FILE *out)
     // process a Quoted-Printable decoding
     case ENC_QP:
     {
-      long decoded = qpdecode_file(in, out, sourceCodeset, isText);
+      long decoded;
+
+      if(data != NULL)
+        decoded = qpdecode_buffer(data, rp->Data, dstrlen(rp->Data), sourceCodeset, isText);
+      else
+        decoded = qpdecode_file(in, out, sourceCodeset, isText);
+
       D(DBF_MAIL, "quoted-printable decoded %ld chars of part %ld.", decoded, rp->Nr);
 
       if(decoded >= 0)
@@ -1893,7 +1909,30 @@ static BOOL RE_DecodeStream(struct Part *rp, FILE *in, FILE *out)
 
     default:
     {
-      if(RE_ConsumeRestOfPart(in, out, sourceCodeset, NULL, TRUE))
+      if(data != NULL)
+      {
+        const char *text = rp->Data != NULL ? rp->Data : "";
+        size_t len = dstrlen(rp->Data);
+        BOOL multiLine = (len > 1 && memchr(text, '\n', len-1) != NULL);
+
+        // produce the same text as reading the part line by line does, that
+        // is a single line loses its trailing newline while several lines
+        // always end with one
+        if(len > 0 && text[len-1] == '\n' && multiLine == FALSE)
+          len--;
+
+        if(dstrmemcpy(data, text, len) != NULL)
+        {
+          if(len > 0 && text[len-1] != '\n' && multiLine == TRUE)
+            dstrcat(data, "\n");
+
+          if(len > 0)
+            RE_ConvertPartText(data, sourceCodeset, TRUE);
+
+          decodeResult = TRUE;
+        }
+      }
+      else if(RE_ConsumeRestOfPart(in, out, NULL, sourceCodeset, NULL, TRUE))
         decodeResult = TRUE;
     }
     break;
@@ -1903,14 +1942,12 @@ static BOOL RE_DecodeStream(struct Part *rp, FILE *in, FILE *out)
   return decodeResult;
 }
 ///
-/// RE_OpenNewPart
+/// RE_NewPart
 //  Adds a new entry to the message part list
-static FILE *RE_OpenNewPart(struct ReadMailData *rmData,
-                            struct Part **new,
-                            struct Part *prev,
-                            struct Part *first)
+static struct Part *RE_NewPart(struct ReadMailData *rmData,
+                               struct Part *prev,
+                               struct Part *first)
 {
-  FILE *fp = NULL;
   struct Part *newPart;
 
   ENTER();
@@ -1967,7 +2004,26 @@ static FILE *RE_OpenNewPart(struct ReadMailData *rmData,
     D(DBF_MAIL, "  Prevptr....: %08lx",  newPart->Prev);
     D(DBF_MAIL, "  Parentptr..: %08lx",  newPart->Parent);
     D(DBF_MAIL, "  MainAltPart: %08lx",  newPart->MainAltPart);
+  }
+
+  RETURN(newPart);
+  return newPart;
+}
+///
+/// RE_OpenNewPart
+//  Adds a new entry to the message part list and opens its part file
+static FILE *RE_OpenNewPart(struct ReadMailData *rmData,
+                            struct Part **new,
+                            struct Part *prev,
+                            struct Part *first)
+{
+  FILE *fp = NULL;
+  struct Part *newPart;
+
+  ENTER();
 
+  if((newPart = RE_NewPart(rmData, prev, first)) != NULL)
+  {
     if((fp = fopen(newPart->Filename, "w")) != NULL)
     {
       setvbuf(fp, NULL, _IOFBF, SIZE_FILEBUF);
@@ -1975,7 +2031,7 @@ static FILE *RE_OpenNewPart(struct ReadMailData *rmData,
     else
     {
       // opening the file failed, so we return failure
-      free(newPart);
+      RE_UndoPart(newPart);
       newPart = NULL;
     }
   }
@@ -1988,6 +2044,84 @@ static FILE *RE_OpenNewPart(struct ReadMailData *rmData,
   return fp;
 }
 ///
+/// RE_NewMemoryPart
+//  Adds a new entry to the message part list which keeps its data in memory
+static struct Part *RE_NewMemoryPart(struct ReadMailData *rmData,
+                                     struct Part *prev,
+                                     struct Part *first)
+{
+  struct Part *newPart;
+
+  ENTER();
+
+  if((newPart = RE_NewPart(rmData, prev, first)) != NULL)
+    setFlag(newPart->Flags, PFLAG_MEMORY);
+  else
+    E(DBF_MAIL, "Error: Couldn't create a new Part!");
+
+  RETURN(newPart);
+  return newPart;
+}
+///
+/// RE_SpillPart
+//  Writes the data of a part kept in memory to its part file, the file has the
+//  same layout as the ones written while parsing or decoding a message
+static BOOL RE_SpillPart(struct Part *rp)
+{
+  BOOL result = TRUE;
+
+  ENTER();
+
+  if(isMemoryPart(rp) == TRUE)
+  {
+    FILE *out;
+
+    D(DBF_MAIL, "writing part #%ld with %ld bytes to '%s'", rp->Nr, dstrlen(rp->Data), rp->Filename);
+
+    if((out = fopen(rp->Filename, "w")) != NULL)
+    {
+      size_t len = dstrlen(rp->Data);
+
+      setvbuf(out, NULL, _IOFBF, SIZE_FILEBUF);
+
+      // undecoded parts start with their headers
+      if(isDecoded(rp) == FALSE && rp->headerList != NULL)
+      {
+        struct HeaderNode *hdrNode;
+
+        IterateList(rp->headerList, struct HeaderNode *, hdrNode)
+          fprintf(out, "%s: %s\n", hdrNode->name, hdrNode->content);
+
+        if(rp->Nr != PART_RAW)
+          fputc('\n', out);
+      }
+
+      if(len > 0 && fwrite(rp->Data, len, 1, out) != 1)
+        result = FALSE;
+
+      if(fclose(out) != 0)
+        result = FALSE;
+
+      if(result == TRUE)
+      {
+        dstrfree(rp->Data);
+        rp->Data = NULL;
+        clearFlag(rp->Flags, PFLAG_MEMORY);
+      }
+      else
+      {
+        E(DBF_MAIL, "error while writing '%s'", rp->Filename);
+        DeleteFile(rp->Filename);
+      }
+    }
+    else
+      result = FALSE;
+  }
+
+  RETURN(result);
+  return result;
+}
+///
 /// RE_UndoPart
 //  Removes an entry from the message part list
 static void RE_UndoPart(struct Part *rp)
@@ -1999,7 +2133,10 @@ static void RE_UndoPart(struct Part *rp)
   D(DBF_MAIL, "Undoing part #%ld [%08lx]", rp->Nr, rp);
 
   // lets delete the file first so that we can cleanly "undo" the part
-  DeleteFile(rp->Filename);
+  if(isMemoryPart(rp) == TRUE)
+    dstrfree(rp->Data);
+  else
+    DeleteFile(rp->Filename);
 
   // we only iterate through our partlist if there is
   // a next item, if not we can simply relink it
@@ -2019,7 +2156,8 @@ static void RE_UndoPart(struct Part *rp)
       trp->Nr--;
 
       // Now we also have to rename the temporary filename also
-      Rename(trp->Filename, trp->Prev->Filename);
+      if(isMemoryPart(trp) == FALSE)
+        Rename(trp->Filename, trp->Prev->Filename);
 
     }
     while(trp->Next != NULL);
@@ -2175,7 +2313,10 @@ static void RE_SetPartInfo(struct Part *rp)
   ENTER();
 
   // get the part's filesize
-  ObtainFileInfo(rp->Filename, FI_SIZE, &size);
+  if(isMemoryPart(rp) == TRUE)
+    size = dstrlen(rp->Data);
+  else
+    ObtainFileInfo(rp->Filename, FI_SIZE, &size);
 
   // let's calculate the partsize of an undecoded part, if this
   // part isn't the RAW part and we found a positive size.
@@ -2274,7 +2415,8 @@ static void RE_SetPartInfo(struct Part *rp)
       comment = rp->ContentType;
   }
 
-  SetComment(rp->Filename, comment);
+  if(isMemoryPart(rp) == FALSE)
+    SetComment(rp->Filename, comment);
 
   LEAVE();
 }
@@ -2300,20 +2442,31 @@ static struct Part *RE_ParseMessage(struct ReadMailData *rmData,
   {
     FILE *out = NULL;
     struct Part *rp;
+    // when parsing quietly (filters, spam classification) nobody will look at
+    // the part files, hence we keep the parts in memory as long as possible
+    BOOL inMemory = isAnyFlagSet(rmData->parseFlags, PM_QUIET);
 
     if(hrp == NULL)
     {
-      if((out = RE_OpenNewPart(rmData, &hrp, NULL, NULL)) != NULL)
+      if(inMemory == TRUE)
+        hrp = RE_NewMemoryPart(rmData, NULL, NULL);
+      else
+        out = RE_OpenNewPart(rmData, &hrp, NULL, NULL);
+
+      if(hrp != NULL)
       {
         BOOL parse_ok = RE_ScanHeader(hrp, in, out, RHM_MAINHEADER);
 
-        fclose(out);
-        out = NULL;
+        if(out != NULL)
+        {
+          fclose(out);
+          out = NULL;
+        }
 
         if(parse_ok == TRUE)
           RE_SetPartInfo(hrp);
       }
-      else if(isAnyFlagSet(rp->rmData->parseFlags, PM_QUIET) == FALSE)
+      else if(inMemory == FALSE)
         ER_NewError(tr(MSG_ER_CantCreateTempfile));
     }
 
@@ -2326,7 +2479,7 @@ static struct Part *RE_ParseMessage(struct ReadMailData *rmData,
       if(isMIMEconform(hrp) == TRUE &&
          hrp->CParBndr != NULL && strnicmp(hrp->ContentType, "multipart", 9) == 0)
       {
-        BOOL done = RE_ConsumeRestOfPart(in, NULL, NULL, hrp, FALSE);
+        BOOL done = RE_ConsumeRestOfPart(in, NULL, NULL, NULL, hrp, FALSE);
 
         rp = hrp;
 
@@ -2334,14 +2487,21 @@ static struct Part *RE_ParseMessage(struct ReadMailData *rmData,
         {
           struct Part *prev = rp;
 
-          out = RE_OpenNewPart(rmData, &rp, prev, hrp);
-          if(out == NULL)
+          if(inMemory == TRUE)
+            rp = RE_NewMemoryPart(rmData, prev, hrp);
+          else
+            out = RE_OpenNewPart(rmData, &rp, prev, hrp);
+
+          if(rp == NULL)
             break;
 
           if(RE_ScanHeader(rp, in, out, RHM_SUBHEADER) == FALSE)
           {
-            fclose(out);
-            out = NULL;
+            if(out != NULL)
+            {
+              fclose(out);
+              out = NULL;
+            }
 
             RE_UndoPart(rp);
             break;
@@ -2349,8 +2509,11 @@ static struct Part *RE_ParseMessage(struct ReadMailData *rmData,
 
           if(strnicmp(rp->ContentType, "multipart", 9) == 0)
           {
-            fclose(out);
-            out = NULL;
+            if(out != NULL)
+            {
+              fclose(out);
+              out = NULL;
+            }
 
             if(RE_ParseMessage(rmData, in, NULL, rp) != NULL)
             {
@@ -2358,44 +2521,75 @@ static struct Part *RE_ParseMessage(struct ReadMailData *rmData,
               RE_UndoPart(rp);
 
               // but consume all rest of the part
-              done = RE_ConsumeRestOfPart(in, NULL, NULL, prev, FALSE);
+              done = RE_ConsumeRestOfPart(in, NULL, NULL, NULL, prev, FALSE);
               for(rp = prev; rp->Next; rp = rp->Next)
                 ;
             }
           }
           else if(RE_SaveThisPart(rp) == TRUE || RE_RequiresSpecialHandling(hrp) == SMT_ENCRYPTED)
           {
-            fputc('\n', out);
-            done = RE_ConsumeRestOfPart(in, out, NULL, rp, FALSE);
-            fclose(out);
-            out = NULL;
+            if(out != NULL)
+            {
+              fputc('\n', out);
+              done = RE_ConsumeRestOfPart(in, out, NULL, NULL, rp, FALSE);
+              fclose(out);
+              out = NULL;
+            }
+            else
+            {
+              done = RE_ConsumeRestOfPart(in, NULL, &rp->Data, NULL, rp, FALSE);
+
+              if(dstrlen(rp->Data) > MAX_MEMORY_PART_SIZE)
+                RE_SpillPart(rp);
+            }
+
             RE_SetPartInfo(rp);
           }
           else
           {
-            fclose(out);
-            out = NULL;
-            done = RE_ConsumeRestOfPart(in, NULL, NULL, rp, FALSE);
+            if(out != NULL)
+            {
+              fclose(out);
+              out = NULL;
+            }
+
+            done = RE_ConsumeRestOfPart(in, NULL, NULL, NULL, rp, FALSE);
             RE_UndoPart(rp);
             rp = prev;
           }
         }
       }
-      else if((out = RE_OpenNewPart(rmData, &rp, hrp, hrp)) != NULL)
+      else if((inMemory == TRUE && (rp = RE_NewMemoryPart(rmData, hrp, hrp)) != NULL) ||
+              (inMemory == FALSE && (out = RE_OpenNewPart(rmData, &rp, hrp, hrp)) != NULL))
       {
         if(RE_SaveThisPart(rp) == TRUE || RE_RequiresSpecialHandling(hrp) == SMT_ENCRYPTED)
         {
-          RE_ConsumeRestOfPart(in, out, NULL, NULL, FALSE);
-          fclose(out);
-          out = NULL;
+          if(out != NULL)
+          {
+            RE_ConsumeRestOfPart(in, out, NULL, NULL, NULL, FALSE);
+            fclose(out);
+            out = NULL;
+          }
+          else
+          {
+            RE_ConsumeRestOfPart(in, NULL, &rp->Data, NULL, NULL, FALSE);
+
+            if(dstrlen(rp->Data) > MAX_MEMORY_PART_SIZE)
+              RE_SpillPart(rp);
+          }
+
           RE_SetPartInfo(rp);
         }
         else
         {
-          fclose(out);
-          out = NULL;
+          if(out != NULL)
+          {
+            fclose(out);
+            out = NULL;
+          }
+
           RE_UndoPart(rp);
-          RE_ConsumeRestOfPart(in, NULL, NULL, NULL, FALSE);
+          RE_ConsumeRestOfPart(in, NULL, NULL, NULL, NULL, FALSE);
         }
       }
     }
@@ -2447,6 +2641,119 @@ static struct Part *RE_ParseMessage(struct ReadMailData *rmData,
   return hrp;
 }
 
+///
+/// RE_GetDecodedFilename
+//  Builds the file name of a decoded part including a proper file extension
+static void RE_GetDecodedFilename(const struct Part *rp, char *filepath, size_t size)
+{
+  char file[SIZE_FILE];
+  char ext[SIZE_FILE];
+
+  ENTER();
+
+  // start with an empty extension string
+  ext[0] = '\0';
+
+  // we try to get a proper file extension for our decoded part which we
+  // in fact first try to get out of the user's MIME configuration.
+  if(rp->Nr != PART_RAW)
+  {
+    // we first try to identify the file extension via the user
+    // definable MIME type list configuration.
+    if(IsStrEmpty(rp->ContentType) == FALSE)
+    {
+      struct MimeTypeNode *curType;
+
+      IterateList(&C->mimeTypeList, struct MimeTypeNode *, curType)
+      {
+        if(MatchNoCase(rp->ContentType, curType->ContentType))
+        {
+          char *s = TrimStart(curType->Extension);
+          char *e;
+
+          if((e = strpbrk(s, " |;,")) == NULL)
+            e = s + strlen(s);
+
+          // break out of the loop only if we found a non-empty extension string
+          if(s[0] != '\0')
+          {
+            strlcpy(ext, s, MIN(sizeof(ext), (size_t)(e - s + 1)));
+
+            D(DBF_MIME, "identified file extension '%s' via user MIME list entry '%s'", ext, curType->ContentType);
+
+            break;
+          }
+        }
+      }
+    }
+
+    // if we still don't have a valid extension, we try to take it from
+    // and eventually existing part name
+    if(ext[0] == '\0' && rp->Name[0] != '\0')
+    {
+      // get the file extension name
+      stcgfe(ext, rp->Name);
+
+      // if the file extension is longer than 5 chars lets use "tmp"
+      if(strlen(ext) > 5)
+        ext[0] = '\0';
+      else
+        D(DBF_MIME, "identified file extension '%s' via part name '%s' %s", ext, rp->Name, rp->Filename);
+    }
+
+    // and last, but not least we try to identify the proper file extension
+    // via our internal fallback mime type list
+    if(ext[0] == '\0' &&
+       IsStrEmpty(rp->ContentType) == FALSE)
+    {
+      int i;
+
+      for(i=0; IntMimeTypeArray[i].ContentType != NULL; i++)
+      {
+        if(stricmp(rp->ContentType, IntMimeTypeArray[i].ContentType) == 0)
+        {
+          char *extension = (char *)IntMimeTypeArray[i].Extension;
+
+          if(extension != NULL)
+          {
+            char *e;
+
+            // search for a space
+            if((e = strchr(extension, ' ')))
+            {
+              strlcpy(ext, extension, (size_t)(e-extension+1));
+            }
+            else
+              strlcpy(ext, extension, sizeof(ext));
+
+            D(DBF_MIME, "identified file extension '%s' via internal MIME list", ext);
+          }
+          else
+            ext[0] = '\0';
+
+          break;
+        }
+      }
+    }
+  }
+
+  // if we still haven't identified a proper extension
+  // we go and check if the part is printable or not
+  if(ext[0] == '\0')
+  {
+    if(isPrintable(rp))
+      strlcpy(ext, "txt", sizeof(ext));
+    else
+      strlcpy(ext, "tmp", sizeof(ext));
+  }
+
+  // lets generate the destination file name for the decoded part
+  snprintf(file, sizeof(file), "YAMm%08x-p%d.%s", (unsigned int)rp->rmData->uniqueID, rp->Nr, ext);
+  AddPath(filepath, C->TempDir, file, size);
+
+  LEAVE();
+}
+
 ///
 /// RE_DecodePart
 //  Decodes a single message part
@@ -2461,13 +2768,39 @@ BOOL RE_DecodePart(struct Part *rp)
     FILE *in;
     FILE *out;
     char filepath[SIZE_PATHFILE];
-    char file[SIZE_FILE];
-    char ext[SIZE_FILE];
 
-    // start with an empty extension string
-    ext[0] = '\0';
+    // uuencoded data can only be decoded from a file
+    if(isMemoryPart(rp) == TRUE && rp->EncodingCode == ENC_UUE && RE_SpillPart(rp) == FALSE)
+    {
+      RETURN(FALSE);
+      return FALSE;
+    }
+
+    RE_GetDecodedFilename(rp, filepath, sizeof(filepath));
+
+    if(isMemoryPart(rp) == TRUE)
+    {
+      char *data = NULL;
+
+      D(DBF_MAIL, "decoding part #%ld in memory", rp->Nr);
+
+      if(RE_DecodeStream(rp, NULL, NULL, &data) == TRUE)
+      {
+        dstrfree(rp->Data);
+        rp->Data = data;
+        setFlag(rp->Flags, PFLAG_DECODED);
 
-    if((in = fopen(rp->Filename, "r")) != NULL)
+        // keep the name of the decoded file for reference
+        strlcpy(rp->Filename, filepath, sizeof(rp->Filename));
+        RE_SetPartInfo(rp);
+      }
+      else
+      {
+        E(DBF_MAIL, "error during RE_DecodeStream()");
+        dstrfree(data);
+      }
+    }
+    else if((in = fopen(rp->Filename, "r")) != NULL)
     {
       setvbuf(in, NULL, _IOFBF, SIZE_FILEBUF);
 
@@ -2502,103 +2835,6 @@ BOOL RE_DecodePart(struct Part *rp)
         }
       }
 
-      // we try to get a proper file extension for our decoded part which we
-      // in fact first try to get out of the user's MIME configuration.
-      if(rp->Nr != PART_RAW)
-      {
-        // we first try to identify the file extension via the user
-        // definable MIME type list configuration.
-        if(IsStrEmpty(rp->ContentType) == FALSE)
-        {
-          struct MimeTypeNode *curType;
-
-          IterateList(&C->mimeTypeList, struct MimeTypeNode *, curType)
-          {
-            if(MatchNoCase(rp->ContentType, curType->ContentType))
-            {
-              char *s = TrimStart(curType->Extension);
-              char *e;
-
-              if((e = strpbrk(s, " |;,")) == NULL)
-                e = s + strlen(s);
-
-              // break out of the loop only if we found a non-empty extension string
-              if(s[0] != '\0')
-              {
-                strlcpy(ext, s, MIN(sizeof(ext), (size_t)(e - s + 1)));
-
-                D(DBF_MIME, "identified file extension '%s' via user MIME list entry '%s'", ext, curType->ContentType);
-
-                break;
-              }
-            }
-          }
-        }
-
-        // if we still don't have a valid extension, we try to take it from
-        // and eventually existing part name
-        if(ext[0] == '\0' && rp->Name[0] != '\0')
-        {
-          // get the file extension name
-          stcgfe(ext, rp->Name);
-
-          // if the file extension is longer than 5 chars lets use "tmp"
-          if(strlen(ext) > 5)
-            ext[0] = '\0';
-          else
-            D(DBF_MIME, "identified file extension '%s' via part name '%s' %s", ext, rp->Name, rp->Filename);
-        }
-
-        // and last, but not least we try to identify the proper file extension
-        // via our internal fallback mime type list
-        if(ext[0] == '\0' &&
-           IsStrEmpty(rp->ContentType) == FALSE)
-        {
-          int i;
-
-          for(i=0; IntMimeTypeArray[i].ContentType != NULL; i++)
-          {
-            if(stricmp(rp->ContentType, IntMimeTypeArray[i].ContentType) == 0)
-            {
-              char *extension = (char *)IntMimeTypeArray[i].Extension;
-
-              if(extension != NULL)
-              {
-                char *e;
-
-                // search for a space
-                if((e = strchr(extension, ' ')))
-                {
-                  strlcpy(ext, extension, (size_t)(e-extension+1));
-                }
-                else
-                  strlcpy(ext, extension, sizeof(ext));
-
-                D(DBF_MIME, "identified file extension '%s' via internal MIME list", ext);
-              }
-              else
-                ext[0] = '\0';
-
-              break;
-            }
-          }
-        }
-      }
-
-      // if we still haven't identified a proper extension
-      // we go and check if the part is printable or not
-      if(ext[0] == '\0')
-      {
-        if(isPrintable(rp))
-          strlcpy(ext, "txt", sizeof(ext));
-        else
-          strlcpy(ext, "tmp", sizeof(ext));
-      }
-
-      // lets generate the destination file name for the decoded part
-      snprintf(file, sizeof(file), "YAMm%08x-p%d.%s", (unsigned int)rp->rmData->uniqueID, rp->Nr, ext);
-      AddPath(filepath, C->TempDir, file, sizeof(filepath));
-
       D(DBF_MAIL, "decoding '%s' to '%s'", rp->Filename, filepath);
 
       // now open the stream and decode it afterwards.
@@ -2609,7 +2845,7 @@ BOOL RE_DecodePart(struct Part *rp)
         setvbuf(out, NULL, _IOFBF, SIZE_FILEBUF);
 
         // decode the stream
-        decodeResult = RE_DecodeStream(rp, in, out);
+        decodeResult = RE_DecodeStream(rp, in, out, NULL);
 
         // close the streams
         fclose(out);
@@ -2836,10 +3072,23 @@ static void RE_HandleEncryptedMessage(struct Part *frp)
 static void RE_LoadMessagePart(struct ReadMailData *rmData, struct Part *part)
 {
   BOOL decodePart = TRUE;
+  enum SMsgType type;
 
   ENTER();
 
-  switch(RE_RequiresSpecialHandling(part))
+  type = RE_RequiresSpecialHandling(part);
+
+  // signed, encrypted and MDN messages are processed using the part files,
+  // hence any part kept in memory must be written out first
+  if(type != SMT_NORMAL)
+  {
+    struct Part *rp;
+
+    for(rp = part; rp != NULL; rp = rp->Next)
+      RE_SpillPart(rp);
+  }
+
+  switch(type)
   {
     case SMT_SIGNED:
     {
@@ -2953,7 +3202,9 @@ BOOL RE_LoadMessage(struct ReadMailData *rmData)
 
         D(DBF_MAIL, "renaming '%s' to '%s'", part->Filename, tmpFile);
 
-        RenameFile(part->Filename, tmpFile);
+        if(isMemoryPart(part) == FALSE)
+          RenameFile(part->Filename, tmpFile);
+
         strlcpy(part->Filename, tmpFile, sizeof(part->Filename));
       }
     }
@@ -3160,15 +3411,16 @@ char *RE_ReadInMessage(struct ReadMailData *rmData, enum ReadInMode mode)
       // to parse anything at all.
       if(dodisp == TRUE && part->Size > 0)
       {
-        FILE *fh;
+        FILE *fh = NULL;
 
         D(DBF_MAIL, "  adding text of [%s] to display", part->Filename);
 
-        if((fh = fopen(part->Filename, "r")) != NULL)
+        if(isMemoryPart(part) == TRUE || (fh = fopen(part->Filename, "r")) != NULL)
         {
           char *msg;
 
-          setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
+          if(fh != NULL)
+            setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
 
           // allocate memory for the complete part plus a trailing NUL byte
           if((msg = dstralloc(part->Size+1)) != NULL)
@@ -3182,10 +3434,17 @@ char *RE_ReadInMessage(struct ReadMailData *rmData, enum ReadInMode mode)
             BOOL signatureFound = FALSE;
 
             // read the part into a dynamic string
-            nread = dstrfread(&msg, part->Size, fh);
+            if(fh != NULL)
+              nread = dstrfread(&msg, part->Size, fh);
+            else
+            {
+              // the part's data is kept in memory
+              dstrmemcpy(&msg, part->Data, dstrlen(part->Data));
+              nread = dstrlen(msg);
+            }
 
             // lets check if an error or short item count occurred
-            if(nread == 0 || nread != part->Size)
+            if(fh != NULL && (nread == 0 || nread != part->Size))
             {
               W(DBF_MAIL, "Warning: EOF or short item count detected: feof()=%ld ferror()=%ld", feof(fh), ferror(fh));
 
@@ -3637,7 +3896,8 @@ char *RE_ReadInMessage(struct ReadMailData *rmData, enum ReadInMode mode)
             dstrfree(msg);
           }
 
-          fclose(fh);
+          if(fh != NULL)
+            fclose(fh);
         }
       }
     }
@@ -4781,7 +5041,9 @@ BOOL CleanupReadMailData(struct ReadMailData *rmData, BOOL fullCleanup)
 
     D(DBF_MAIL, "freeing mail part %08lx, next %08lx", part, next);
 
-    if(part->Filename[0] != '\0')
+    if(isMemoryPart(part) == TRUE)
+      dstrfree(part->Data);
+    else if(part->Filename[0] != '\0')
     {
       if(DeleteFile(part->Filename) == 0)
         AddZombieFile(part->Filename);
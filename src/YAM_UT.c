@@ -105,13 +105,17 @@
 #include "mui/YAMApplication.h"
 
 #include "AppIcon.h"
+#include "BodyIndex.h"
 #include "Busy.h"
 #include "Config.h"
+#include "FetchScheduler.h"
 #include "FileInfo.h"
 #include "FolderList.h"
+#include "HashTable.h"
 #include "Locale.h"
 #include "MailList.h"
 #include "MailServers.h"
+#include "MailThreads.h"
 #include "MethodStack.h"
 #include "MimeTypes.h"
 #include "MUIObjects.h"
@@ -1729,7 +1733,9 @@ BOOL DeleteMailDir(const char *dir, BOOL isroot)
         if(isValidMailFile(filename) == TRUE  ||
            stricmp(filename, ".fconfig") == 0 ||
            stricmp(filename, ".fimage") == 0  ||
-           stricmp(filename, ".index") == 0)
+           stricmp(filename, ".index") == 0   ||
+           stricmp(filename, ".journal") == 0 ||
+           stricmp(filename, ".bodyindex") == 0)
         {
           if(DeleteFile(fname) == 0)
           {
@@ -1977,6 +1983,27 @@ void GetMailFile(char *string, const size_t stringSize, const struct Folder *fol
   LEAVE();
 }
 
+///
+/// GetMailKey
+//  Gets the unique part of a mail's file name, which does not change with
+//  the mail's status. Returns FALSE for files not created by YAM.
+BOOL GetMailKey(const struct Mail *mail, char *key)
+{
+  BOOL valid = FALSE;
+
+  ENTER();
+
+  if(isValidMailFile(mail->MailFile))
+  {
+    memcpy(key, mail->MailFile, MAILKEY_LEN);
+    key[MAILKEY_LEN] = '\0';
+    valid = TRUE;
+  }
+
+  RETURN(valid);
+  return valid;
+}
+
 ///
 /// BuildAddress
 // Creates "Real Name <E-mail>" string from a given address and name
@@ -3542,10 +3569,47 @@ void AddMailToFolder(struct Mail *mail, struct Folder *folder)
     // add the cloned message to the folder
     LockMailList(folder->messages);
     AddMailToFolderSimple(mail, folder);
+    MailThreadsAddMail(folder, mail);
     UnlockMailList(folder->messages);
 
-    // expire the folder's index as we just added a new message
-    MA_ExpireIndex(folder);
+    // record the new message in the folder's index journal
+    MA_JournalIndex(folder, IJT_ADD, mail->MailFile, mail);
+  }
+
+  LEAVE();
+}
+
+///
+/// AddMailsToFolder
+//  Adds all mails of a list to a folder at once. If journal is FALSE the
+//  mails are not recorded in the index journal but the index is expired,
+//  the caller is expected to save it when all changes are done. Otherwise
+//  the journal is written while the folder is still locked, this keeps the
+//  records in order if several threads add mails to the same folder.
+void AddMailsToFolder(const struct MailList *mlist, struct Folder *folder, const BOOL journal)
+{
+  ENTER();
+
+  // make sure we have a valid index as it might have been flushed inbetween
+  if(MA_GetIndex(folder) == TRUE)
+  {
+    struct MailNode *mnode;
+
+    LockMailList(folder->messages);
+
+    ForEachMailNode(mlist, mnode)
+    {
+      AddMailToFolderSimple(mnode->mail, folder);
+      MailThreadsAddMail(folder, mnode->mail);
+
+      if(journal == TRUE)
+        MA_JournalIndex(folder, IJT_ADD, mnode->mail->MailFile, mnode->mail);
+    }
+
+    UnlockMailList(folder->messages);
+
+    if(journal == FALSE)
+      MA_ExpireIndex(folder);
   }
 
   LEAVE();
@@ -3562,6 +3626,7 @@ void AddMailToFolderSimple(struct Mail *mail, struct Folder *folder)
 
   // let's add the new message to the folder's message list
   AddNewMailNode(folder->messages, mail);
+  AddMailToMsgIDTables(folder, mail);
 
   // let's summarize the stats
   folder->Total++;
@@ -3579,14 +3644,128 @@ void AddMailToFolderSimple(struct Mail *mail, struct Folder *folder)
   LEAVE();
 }
 
+///
+/// ForgetRemovedMail
+//  Removes a mail which was just removed from its folder from the search
+//  window and, if requested, from the lists of just downloaded mails
+static void ForgetRemovedMail(struct Mail *mail, const BOOL checkConnections)
+{
+  ENTER();
+
+  // remove the mail from the search window's mail list as well, if the
+  // search window exists at all
+  if(G->SearchMailWinObject != NULL)
+    DoMethod(G->SearchMailWinObject, MUIM_SearchMailWindow_RemoveMail, mail);
+
+  if(checkConnections == TRUE)
+  {
+    int activeConnections;
+
+    // now check if the mail to be removed has just been downloaded, but not yet filtered
+    ObtainSemaphoreShared(G->connectionSemaphore);
+    activeConnections = G->activeConnections;
+    ReleaseSemaphore(G->connectionSemaphore);
+
+    // we need to check only if there are any active connections
+    if(activeConnections > 0)
+    {
+      struct MailServerNode *msn;
+      int i = 0;
+      BOOL mailFound = FALSE;
+
+      while(mailFound == FALSE && (msn = GetMailServer(&C->pop3ServerList, i)) != NULL)
+      {
+        int useCount;
+
+        LockMailServer(msn);
+        useCount = msn->useCount;
+        UnlockMailServer(msn);
+
+        if(useCount != 0)
+        {
+          struct MailNode *mnode;
+
+          LockMailList(msn->downloadedMails);
+
+          if((mnode = FindMailByAddress(msn->downloadedMails, mail)) != NULL)
+          {
+            // remove the mail from the list of just downloaded mails,
+            // so it will not be filtered anymore when the download
+            // process finishes
+            D(DBF_UTIL, "removing mail with subject '%s' from download list", mail->Subject);
+            RemoveMailNode(msn->downloadedMails, mnode);
+            DeleteMailNode(mnode);
+
+            // we found the mail, but it cannot be part of more than one list thus we
+            // can exit this loop
+            mailFound = TRUE;
+          }
+
+          UnlockMailList(msn->downloadedMails);
+        }
+
+        i++;
+      }
+    }
+
+    // the mail might also belong to a finished download whose mails are
+    // filtered after the other downloads have finished
+    ForgetFetchedMail(mail);
+  }
+
+  LEAVE();
+}
+
+///
+/// ReleaseRemovedMail
+//  Lets all read windows forget about a mail which was removed from its folder
+static void ReleaseRemovedMail(struct Mail *mail, const BOOL closeWindows)
+{
+  struct ReadMailData *rmData;
+  struct ReadMailData *next;
+
+  ENTER();
+
+  // Now we check if there is any read window with that very same
+  // mail currently open and if so we have to close it.
+  SafeIterateList(&G->readMailDataList, struct ReadMailData *, rmData, next)
+  {
+    if(rmData->mail == mail)
+    {
+      if(closeWindows == TRUE && rmData->readWindow != NULL)
+      {
+        // Just ask the window to close itself, this will effectively clear the pointer.
+        // We cannot set the attribute directly, because a DoMethod() call is synchronous
+        // and then the read window would modify the list we are currently walking through
+        // by calling CleanupReadMailData(). Hence we just let the application do the dirty
+        // work as soon as it has the possibility to do that, but not before this loop is
+        // finished. This works, because the ReadWindow class catches any modification to
+        // MUIA_Window_CloseRequest itself. A simple set(win, MUIA_Window_Open, FALSE) would
+        // visibly close the window, but it would not invoke the associated hook which gets
+        // invoked when you close the window by clicking on the close gadget.
+        DoMethod(_app(rmData->readWindow), MUIM_Application_PushMethod, rmData->readWindow, 3, MUIM_Set, MUIA_Window_CloseRequest, TRUE);
+      }
+      else
+      {
+        // Just clear pointer to this mail if we don't want to close the window or if
+        // there is no window to close at all.
+        rmData->mail = NULL;
+      }
+    }
+  }
+
+  // erase the mail's folder pointer
+  mail->Folder = NULL;
+
+  LEAVE();
+}
+
 ///
 /// RemoveMailFromFolder
 //  Removes a message from a folder
 void RemoveMailFromFolder(struct Mail *mail, const BOOL closeWindows, const BOOL checkConnections)
 {
   struct Folder *folder = mail->Folder;
-  struct ReadMailData *rmData;
-  struct ReadMailData *next;
 
   ENTER();
 
@@ -3602,11 +3781,6 @@ void RemoveMailFromFolder(struct Mail *mail, const BOOL closeWindows, const BOOL
     if(folder == GetCurrentFolder())
       DoMethod(G->MA->GUI.PG_MAILLIST, MUIM_MainMailListGroup_RemoveMail, mail);
 
-    // remove the mail from the search window's mail list as well, if the
-    // search window exists at all
-    if(G->SearchMailWinObject != NULL)
-      DoMethod(G->SearchMailWinObject, MUIM_SearchMailWindow_RemoveMail, mail);
-
     // lets decrease the folder statistics first
     folder->Total--;
     folder->Size -= mail->Size;
@@ -3628,99 +3802,141 @@ void RemoveMailFromFolder(struct Mail *mail, const BOOL closeWindows, const BOOL
       D(DBF_UTIL, "removing mail with subject '%s' from folder '%s'", mail->Subject, folder->Name);
       RemoveMailNode(folder->messages, mnode);
       DeleteMailNode(mnode);
+      RemoveMailFromMsgIDTables(folder, mail);
+      MailThreadsRemoveMail(folder, mail);
+      BodyIndexRemoveMail(mail);
     }
 
     UnlockMailList(folder->messages);
 
-    if(checkConnections == TRUE)
-    {
-      int activeConnections;
+    ForgetRemovedMail(mail, checkConnections);
+
+    // then we have to record the removal in the folder's index
+    // journal so that it will be part of the index next time.
+    MA_JournalIndex(folder, IJT_REMOVE, mail->MailFile, mail);
+  }
+  else
+  {
+    E(DBF_ALWAYS, "no index");
+  }
 
-      // now check if the mail to be removed has just been downloaded, but not yet filtered
-      ObtainSemaphoreShared(G->connectionSemaphore);
-      activeConnections = G->activeConnections;
-      ReleaseSemaphore(G->connectionSemaphore);
+  ReleaseRemovedMail(mail, closeWindows);
 
-      // we need to check only if there are any active connections
-      if(activeConnections > 0)
-      {
-        struct MailServerNode *msn;
-        int i = 0;
-        BOOL mailFound = FALSE;
+  LEAVE();
+}
 
-        while(mailFound == FALSE && (msn = GetMailServer(&C->pop3ServerList, i)) != NULL)
-        {
-          int useCount;
+///
+/// RemoveMailsFromFolder
+//  Removes all mails of a list which belong to the given folder with a
+//  single pass over the folder's mail list. Instead of recording every
+//  single removal in the index journal the index is expired, the caller
+//  is expected to save it when all changes are done.
+void RemoveMailsFromFolder(const struct MailList *mlist, struct Folder *folder, const BOOL closeWindows, const BOOL checkConnections)
+{
+  struct HashTable *mailTable;
 
-          LockMailServer(msn);
-          useCount = msn->useCount;
-          UnlockMailServer(msn);
+  ENTER();
 
-          if(useCount != 0)
-          {
-            LockMailList(msn->downloadedMails);
+  if(MA_GetIndex(folder) == FALSE)
+  {
+    E(DBF_ALWAYS, "no index");
+  }
+  else if((mailTable = HashTableNew(HashTableGetDefaultOps(), NULL, sizeof(struct HashEntry), mlist->count)) != NULL)
+  {
+    BOOL redisplay = FALSE;
+    struct MailNode *mnode;
+    struct MailNode *succ;
+    ULONG removed = 0;
 
-            if((mnode = FindMailByAddress(msn->downloadedMails, mail)) != NULL)
-            {
-              // remove the mail from the list of just downloaded mails,
-              // so it will not be filtered anymore when the download
-              // process finishes
-              D(DBF_UTIL, "removing mail with subject '%s' from download list", mail->Subject);
-              RemoveMailNode(msn->downloadedMails, mnode);
-              DeleteMailNode(mnode);
-
-              // we found the mail, but it cannot be part of more than one list thus we
-              // can exit this loop
-              mailFound = TRUE;
-            }
+    ForEachMailNode(mlist, mnode)
+    {
+      struct HashEntryHeader *entry;
 
-            UnlockMailList(msn->downloadedMails);
-          }
+      if(mnode->mail->Folder == folder && (entry = HashTableOperate(mailTable, mnode->mail, htoAdd)) != NULL)
+        ((struct HashEntry *)entry)->key = mnode->mail;
+    }
 
-          i++;
+    // the main mail list is displayed again afterwards, only a quick
+    // view is updated mail by mail
+    if(folder == GetCurrentFolder())
+    {
+      if(xget(G->MA->GUI.PG_MAILLIST, MUIA_MainMailListGroup_ActiveList) == LT_MAIN)
+      {
+        redisplay = TRUE;
+      }
+      else
+      {
+        ForEachMailNode(mlist, mnode)
+        {
+          if(mnode->mail->Folder == folder)
+            DoMethod(G->MA->GUI.PG_MAILLIST, MUIM_MainMailListGroup_RemoveMail, mnode->mail);
         }
       }
     }
 
-    // then we have to mark the folder index as expired so
-    // that it will be saved next time.
-    MA_ExpireIndex(folder);
-  }
-  else
-  {
-    E(DBF_ALWAYS, "no index");
-  }
+    LockMailList(folder->messages);
 
-  // Now we check if there is any read window with that very same
-  // mail currently open and if so we have to close it.
-  SafeIterateList(&G->readMailDataList, struct ReadMailData *, rmData, next)
-  {
-    if(rmData->mail == mail)
+    SafeIterateList(&folder->messages->list, struct MailNode *, mnode, succ)
     {
-      if(closeWindows == TRUE && rmData->readWindow != NULL)
+      struct Mail *mail = mnode->mail;
+      struct HashEntryHeader *entry;
+
+      if((entry = HashTableOperate(mailTable, mail, htoLookup)) != NULL && HASH_ENTRY_IS_LIVE(entry))
       {
-        // Just ask the window to close itself, this will effectively clear the pointer.
-        // We cannot set the attribute directly, because a DoMethod() call is synchronous
-        // and then the read window would modify the list we are currently walking through
-        // by calling CleanupReadMailData(). Hence we just let the application do the dirty
-        // work as soon as it has the possibility to do that, but not before this loop is
-        // finished. This works, because the ReadWindow class catches any modification to
-        // MUIA_Window_CloseRequest itself. A simple set(win, MUIA_Window_Open, FALSE) would
-        // visibly close the window, but it would not invoke the associated hook which gets
-        // invoked when you close the window by clicking on the close gadget.
-        DoMethod(_app(rmData->readWindow), MUIM_Application_PushMethod, rmData->readWindow, 3, MUIM_Set, MUIA_Window_CloseRequest, TRUE);
+        folder->Total--;
+        folder->Size -= mail->Size;
+
+        if(hasStatusNew(mail))
+          folder->New--;
+
+        if(!hasStatusRead(mail))
+          folder->Unread--;
+
+        if(hasStatusSent(mail))
+          folder->Sent--;
+
+        // the mail itself is still referenced by the list to be removed
+        RemoveMailNode(folder->messages, mnode);
+        DeleteMailNode(mnode);
+        RemoveMailFromMsgIDTables(folder, mail);
+        MailThreadsRemoveMail(folder, mail);
+        BodyIndexRemoveMail(mail);
+
+        removed++;
       }
-      else
+    }
+
+    UnlockMailList(folder->messages);
+
+    HashTableDestroy(mailTable);
+
+    D(DBF_UTIL, "removed %ld mails from folder '%s'", removed, folder->Name);
+
+    ForEachMailNode(mlist, mnode)
+    {
+      if(mnode->mail->Folder == folder)
       {
-        // Just clear pointer to this mail if we don't want to close the window or if
-        // there is no window to close at all.
-        rmData->mail = NULL;
+        ForgetRemovedMail(mnode->mail, checkConnections);
+        ReleaseRemovedMail(mnode->mail, closeWindows);
       }
     }
+
+    if(redisplay == TRUE)
+      DoMethod(G->MA->GUI.PG_MAILLIST, MUIM_MainMailListGroup_DisplayMailsOfFolder, folder);
+
+    MA_ExpireIndex(folder);
   }
+  else
+  {
+    struct MailNode *mnode;
 
-  // erase the mail's folder pointer
-  mail->Folder = NULL;
+    // fall back to removing the mails one by one
+    ForEachMailNode(mlist, mnode)
+    {
+      if(mnode->mail->Folder == folder)
+        RemoveMailFromFolder(mnode->mail, closeWindows, checkConnections);
+    }
+  }
 
   LEAVE();
 }
@@ -3770,8 +3986,12 @@ struct Mail *ReplaceMailInFolder(const char *mailFile, struct Mail *mail, struct
 
       // replace the mail in the list and set its folder, but don't
       // dereference the replaced mail here, this is done outside
+      RemoveMailFromMsgIDTables(folder, replacedMail);
+      MailThreadsRemoveMail(folder, replacedMail);
       mnode->mail = mail;
       mail->Folder = folder;
+      AddMailToMsgIDTables(folder, mail);
+      MailThreadsAddMail(folder, mail);
 
       // increase the reference counter
       ReferenceMail(mail);
@@ -3779,6 +3999,7 @@ struct Mail *ReplaceMailInFolder(const char *mailFile, struct Mail *mail, struct
     else
     {
       AddMailToFolderSimple(mail, folder);
+      MailThreadsAddMail(folder, mail);
     }
 
     UnlockMailList(folder->messages);
@@ -3838,6 +4059,8 @@ BOOL ClearFolderMails(struct Folder *folder, BOOL resetstats)
   {
     LockMailList(folder->messages);
     ClearMailList(folder->messages);
+    ClearMsgIDTables(folder);
+    MailThreadsFree(folder);
     UnlockMailList(folder->messages);
 
     if(resetstats == TRUE)
@@ -1502,6 +1502,22 @@ static char *AppendRcpt(char *sbuf, const struct Person *pe,
   return sbuf;
 }
 
+///
+/// AppendMailRcpt()
+//  Appends the sender/recipient address of a mail to a string
+static char *AppendMailRcpt(char *sbuf, const struct MailPerson *mpe,
+                            const struct UserIdentityNode *uin, const BOOL excludeme)
+{
+  struct Person pe;
+
+  ENTER();
+
+  sbuf = AppendRcpt(sbuf, GetMailPerson(mpe, &pe), uin, excludeme);
+
+  RETURN(sbuf);
+  return sbuf;
+}
+
 ///
 
 /*** ExpandText ***/
@@ -1867,7 +1883,7 @@ struct WriteMailData *NewWriteMailWindow(struct Mail *mail, const int flags)
         if(IsStrEmpty(mail->ReplyTo.Address) == FALSE)
         {
           // add the Reply-To: address as the new To: address
-          toAddr = AppendRcpt(toAddr, &mail->ReplyTo, wmData->identity, FALSE);
+          toAddr = AppendMailRcpt(toAddr, &mail->ReplyTo, wmData->identity, FALSE);
 
           // if the mail has multiple reply-to recipients
           // we have to get them and add them as well
@@ -1889,7 +1905,7 @@ struct WriteMailData *NewWriteMailWindow(struct Mail *mail, const int flags)
         else
         {
           // add the From: address as the new To: address
-          toAddr = AppendRcpt(toAddr, &mail->From, wmData->identity, FALSE);
+          toAddr = AppendMailRcpt(toAddr, &mail->From, wmData->identity, FALSE);
 
           // if the mail has multiple From: recipients
           // we have to get them and add them as well
@@ -2353,7 +2369,7 @@ struct WriteMailData *NewForwardMailWindow(struct MailList *mlist, const int fla
         // we create a generic subject line for the forward
         // action so that a forwarded mail will have a "Fwd: XXX" kinda
         // subject line instead of the original.
-        if(mail->Subject != '\0')
+        if(mail->Subject != NULL)
         {
           char buffer[SIZE_LARGE];
 
@@ -2506,22 +2522,29 @@ static BOOL FindMLIdentity(struct Folder *folder, struct ExtendedMail *email, ch
     // mailing list address
     for(k=-1; k < email->NumSTo; k++)
     {
-      struct Person *person;
+      const char *address;
+      const char *realName;
 
       if(k == -1)
-        person = &email->Mail.To;
+      {
+        address = email->Mail.To.Address;
+        realName = email->Mail.To.RealName;
+      }
       else
-        person = &email->STo[k];
+      {
+        address = email->STo[k].Address;
+        realName = email->STo[k].RealName;
+      }
 
-      if(MatchNoCase(person->Address, folder->MLPattern) == TRUE)
+      if(MatchNoCase(address, folder->MLPattern) == TRUE)
       {
-        D(DBF_MAIL, "address '%s' matches pattern '%s'", person->Address, folder->MLPattern);
+        D(DBF_MAIL, "address '%s' matches pattern '%s'", address, folder->MLPattern);
         result = TRUE;
         break;
       }
-      else if(MatchNoCase(person->RealName, folder->MLPattern) == TRUE)
+      else if(MatchNoCase(realName, folder->MLPattern) == TRUE)
       {
-        D(DBF_MAIL, "name '%s' matches pattern '%s'", person->RealName, folder->MLPattern);
+        D(DBF_MAIL, "name '%s' matches pattern '%s'", realName, folder->MLPattern);
         result = TRUE;
         break;
       }
@@ -2815,7 +2838,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
               // and as such when he presses "reply" on it we send it to
               // the To: address recipient instead.
               D(DBF_MAIL, "adding To recipient '%s'", mail->To.Address);
-              rto = AppendRcpt(rto, &mail->To, email->identity, FALSE);
+              rto = AppendMailRcpt(rto, &mail->To, email->identity, FALSE);
               for(k=0; k < email->NumSTo; k++)
               {
                 D(DBF_MAIL, "adding To recipient '%s'", email->STo[k].Address);
@@ -2864,7 +2887,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
                 else if(IsStrEmpty(mail->ReplyTo.Address) == FALSE)
                 {
                   D(DBF_MAIL, "adding To recipient '%s'", mail->ReplyTo.Address);
-                  rto = AppendRcpt(rto, &mail->ReplyTo, email->identity, FALSE);
+                  rto = AppendMailRcpt(rto, &mail->ReplyTo, email->identity, FALSE);
                   for(k=0; k < email->NumSReplyTo; k++)
                   {
                     D(DBF_MAIL, "adding To recipient '%s'", email->SReplyTo[k].Address);
@@ -2953,7 +2976,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
                   {
                     // add all From: addresses to the CC: list
                     D(DBF_MAIL, "adding CC recipient '%s'", mail->From.Address);
-                    rcc = AppendRcpt(rcc, &mail->From, email->identity, FALSE);
+                    rcc = AppendMailRcpt(rcc, &mail->From, email->identity, FALSE);
                     for(k=0; k < email->NumSFrom; k++)
                     {
                       D(DBF_MAIL, "adding CC recipient '%s'", email->SFrom[k].Address);
@@ -2973,7 +2996,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
                   case 1:
                   {
                     D(DBF_MAIL, "adding To recipient '%s'", mail->From.Address);
-                    rto = AppendRcpt(rto, &mail->From, email->identity, FALSE);
+                    rto = AppendMailRcpt(rto, &mail->From, email->identity, FALSE);
                     for(k=0; k < email->NumSFrom; k++)
                     {
                       D(DBF_MAIL, "adding To recipient '%s'", email->SFrom[k].Address);
@@ -3030,7 +3053,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
               else if(IsStrEmpty(mail->ReplyTo.Address) == FALSE && hasPrivateFlag(flags) == FALSE)
               {
                 D(DBF_MAIL, "adding To recipient '%s'", mail->ReplyTo.Address);
-                rto = AppendRcpt(rto, &mail->ReplyTo, email->identity, FALSE);
+                rto = AppendMailRcpt(rto, &mail->ReplyTo, email->identity, FALSE);
                 for(k=0; k < email->NumSReplyTo; k++)
                 {
                   D(DBF_MAIL, "adding To recipient '%s'", email->SReplyTo[k].Address);
@@ -3040,7 +3063,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
               else
               {
                 D(DBF_MAIL, "adding To recipient '%s'", mail->From.Address);
-                rto = AppendRcpt(rto, &mail->From, email->identity, FALSE);
+                rto = AppendMailRcpt(rto, &mail->From, email->identity, FALSE);
                 for(k=0; k < email->NumSFrom; k++)
                 {
                   D(DBF_MAIL, "adding To recipient '%s'", email->SFrom[k].Address);
@@ -3079,7 +3102,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
               {
                 // add Reply-To: addresses to To:
                 D(DBF_MAIL, "adding To recipient '%s'", mail->ReplyTo.Address);
-                rto = AppendRcpt(rto, &mail->ReplyTo, email->identity, FALSE);
+                rto = AppendMailRcpt(rto, &mail->ReplyTo, email->identity, FALSE);
                 for(k=0; k < email->NumSReplyTo; k++)
                 {
                   D(DBF_MAIL, "adding To recipient '%s'", email->SReplyTo[k].Address);
@@ -3090,7 +3113,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
               {
                 // add From: addresses to To:
                 D(DBF_MAIL, "adding To recipient '%s'", mail->From.Address);
-                rto = AppendRcpt(rto, &mail->From, email->identity, FALSE);
+                rto = AppendMailRcpt(rto, &mail->From, email->identity, FALSE);
                 for(k=0; k < email->NumSFrom; k++)
                 {
                   D(DBF_MAIL, "adding To recipient '%s'", email->SFrom[k].Address);
@@ -3100,7 +3123,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
 
               // add To: addresses to CC:
               D(DBF_MAIL, "adding CC recipient '%s'", mail->To.Address);
-              rcc = AppendRcpt(rcc, &mail->To, email->identity, TRUE);
+              rcc = AppendMailRcpt(rcc, &mail->To, email->identity, TRUE);
               for(k=0; k < email->NumSTo; k++)
               {
                 D(DBF_MAIL, "adding CC recipient '%s'", email->STo[k].Address);
@@ -3121,7 +3144,7 @@ struct WriteMailData *NewReplyMailWindow(struct MailList *mlist, const int flags
           {
             // now add all original To: addresses to To:
             D(DBF_MAIL, "adding To recipient '%s'", mail->To.Address);
-            rto = AppendRcpt(rto, &mail->To, email->identity, TRUE);
+            rto = AppendMailRcpt(rto, &mail->To, email->identity, TRUE);
             for(k=0; k < email->NumSTo; k++)
             {
               D(DBF_MAIL, "adding To recipient '%s'", email->STo[k].Address);
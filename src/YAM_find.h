@@ -36,6 +36,8 @@
 
 // forward declarations
 struct BoyerMooreContext;
+struct FilterMatcher;
+struct MoveCopyBatch;
 
 enum ApplyFilterMode
 {
@@ -159,6 +161,9 @@ struct Search
   struct DateTime      dateTime;
   struct MinList       patternList;               // for storing search patterns, including the embedded singlePattern
   struct BoyerMooreContext *bmContext;
+  struct BodyIndexQuery *bodyQuery;               // for ruling out mails by the body index of their folder
+  struct FilterMatcher *matcher;                  // the compiled searches of a filter list this search is part of
+  ULONG                matcherRule;               // the number of the search within the compiled searches
 };
 
 // A rule structure which is used to be placed
@@ -223,7 +228,7 @@ void DeleteFilterNode(struct FilterNode *filter);
 void DeleteFilterList(struct MinList *filterList);
 struct MinList *CloneFilterList(enum ApplyFilterMode mode);
 void FreeFilterList(struct MinList *filterList);
-BOOL ExecuteFilterAction(const struct FilterNode *filter, struct Mail *mail, struct FilterResult *result);
+BOOL ExecuteFilterAction(const struct FilterNode *filter, struct Mail *mail, struct FilterResult *result, struct MoveCopyBatch *moveBatch);
 BOOL CopyFilterData(struct FilterNode *dstFilter, struct FilterNode *srcFilter);
 void FreeFilterRuleList(struct FilterNode *filter);
 struct FilterNode *CreateNewFilter(const int actions, const int ruleFlags);
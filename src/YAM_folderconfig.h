@@ -34,6 +34,9 @@
 
 // forward declarations
 struct Config;
+struct HashTable;
+struct BodyIndex;
+struct MailThreadIndex;
 struct MailList;
 struct UserIdentityList;
 
@@ -87,6 +90,7 @@ enum LoadedMode
   LM_FLUSHED,   // flushed
   LM_VALID,     // valid index
   LM_REBUILD,   // currently rebuilding
+  LM_LOADING,   // currently loading or taking over a preloaded index
 };
 
 // Folder modes
@@ -103,8 +107,10 @@ enum FolderMode
 // flags and macros for the folder
 #define FOFL_MODIFY  (1<<0)
 #define FOFL_FREEXS  (1<<1)
+#define FOFL_COMPACT (1<<2)
 #define isModified(folder)        (isFlagSet((folder)->Flags, FOFL_MODIFY))
 #define isFreeAccess(folder)      (isFlagSet((folder)->Flags, FOFL_FREEXS))
+#define needsCompaction(folder)   (isFlagSet((folder)->Flags, FOFL_COMPACT))
 
 #define FolderName(fo) ((fo) ? (fo)->Name : "?")
 
@@ -145,6 +151,11 @@ struct Folder
   enum LoadedMode   LoadedMode;
 
   time_t            lastAccessTime;        // when the folder was last accessed/loaded
+  ULONG             journalRecords;        // number of changes recorded in the index journal
+  struct HashTable *msgIDTable;            // mails by compressed message ID, built on demand
+  struct HashTable *irtMsgIDTable;         // mails by compressed In-Reply-To message ID, built on demand
+  struct BodyIndex *bodyIndex;             // full text index of the mails' bodies, loaded on demand
+  struct MailThreadIndex *threadIndex;     // the threads of the mails, loaded on demand
 
   char              Name[SIZE_NAME];       // the name of the folder
   char              Path[SIZE_PATH];       // relative or absolute path of the folder's directory
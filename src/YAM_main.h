@@ -37,7 +37,10 @@
 
 // forward declarations
 struct Mail;
+struct MailList;
 struct Folder;
+struct BusyNode;
+struct MoveCopyBatch;
 struct Part;
 struct MUI_NListtree_TreeNode;
 
@@ -188,11 +191,12 @@ enum ForwardMode
   FWM_INLINE    // forward mail inlined
 };
 
-// flags for MA_MoveCopy and MA_MoveCopySingle
+// flags for MA_MoveCopy, MA_MoveCopyMails and MA_MoveCopySingle
 #define MVCPF_COPY              (1<<0) // copy mail instead of moving it
 #define MVCPF_CLOSE_WINDOWS     (1<<1) // close possibly open read windows
 #define MVCPF_CHECK_CONNECTIONS (1<<2) // make sure there is an active connection
 #define MVCPF_QUIET             (1<<3) // don't update the folder/icon stats
+#define MVCPF_FREE_ACCESS       (1<<4) // grant access to a protected destination folder
 
 // flags for MA_DeleteSingle
 #define DELF_AT_ONCE            (1<<0) // delete immediately, don't move to Trash folder
@@ -389,6 +393,10 @@ BOOL MA_ImportMessages(const char *fname, const ULONG flags);
 struct MA_ClassData *MA_New(void);
 void  MA_ArchiveMail(struct Mail *mail);
 void  MA_MoveCopy(struct Mail *mail, struct Folder *tobox, const char *originator, const ULONG flags);
+ULONG MA_MoveCopyMails(const struct MailList *mlist, struct Folder *to, const char *originator, const ULONG flags, struct BusyNode *busy);
+struct MoveCopyBatch *MA_CreateMoveCopyBatch(void);
+BOOL  MA_AddToMoveCopyBatch(struct MoveCopyBatch *batch, struct Mail *mail, struct Folder *to, const char *originator, const ULONG flags);
+void  MA_ExecuteMoveCopyBatch(struct MoveCopyBatch *batch, struct BusyNode *busy);
 void  MA_ExchangeMail(const ULONG receiveFlags);
 BOOL  MA_PopNow(struct MailServerNode *msn, const ULONG flags, struct DownloadResult *dlResult);
 void  MA_RemoveAttach(struct Mail *mail, struct Part **whichParts, BOOL warning);
@@ -402,12 +410,12 @@ char *MA_ToStatusHeader(struct Mail *mail);
 char *MA_ToXStatusHeader(struct Mail *mail);
 unsigned int MA_FromStatusHeader(char *statusflags);
 unsigned int MA_FromXStatusHeader(char *xstatusflags);
-char *MA_GetRealSubject(char *sub);
+const char *MA_GetRealSubject(const char *sub);
 void  MA_ChangeSelected(BOOL forceUpdate);
 
 enum NewMailMode CheckNewMailQualifier(const enum NewMailMode mode, const ULONG qualifier, int *flags);
 struct WriteMailData *NewMessage(enum NewMailMode mode, const int flags);
-struct Mail *FindThreadInFolder(const struct Mail *srcMail, const struct Folder *folder, const BOOL nextThread);
+struct Mail *FindThreadInFolder(const struct Mail *srcMail, struct Folder *folder, const BOOL nextThread);
 struct Mail *FindThread(const struct Mail *srcMail, const BOOL nextThread);
 
 BOOL ReceiveMailsFromPOP(struct MailServerNode *msn, const ULONG flags, struct DownloadResult *dlResult);
@@ -34,14 +34,25 @@
 
 // forward declarations
 struct Folder;
+struct HeaderNode;
+struct IndexPreloader;
 struct UserIdentityNode;
 
+// a mail's sender or recipient, both strings are taken from the string pool
+struct MailPerson
+{
+  const char *Address;
+  const char *RealName;
+};
+
 struct Mail
 {
   short            RefCounter; // how many struct MailNode are referencing us?
   struct Folder *  Folder;     // pointer to the folder this mail belongs to
   unsigned long    cMsgID;     // compressed message ID
   unsigned long    cIRTMsgID;  // compressed in-return-to message ID
+  char *           MsgID;      // the full message ID (malloc()'ed, NULL if unknown)
+  unsigned long *  cRefMsgIDs; // compressed References: IDs, oldest first and 0 terminated (malloc()'ed, NULL if unknown)
   long             Size;       // the message size in bytes
   unsigned int     mflags;     // internal mail flags (no status flags)
   unsigned int     sflags;     // mail status flags (read/new etc.)
@@ -49,14 +60,14 @@ struct Mail
   short            gmtOffset;  // the offset to GMT this mail is based on
   struct DateStamp Date;       // the datestamp of the mail (UTC)
   struct TimeVal   transDate;  // the date/time when this messages arrived/was sent. (UTC)
-  struct Person    From;       // The main sender (normally first entry in "From:")
-  struct Person    To;         // The main mail recipient (first entry in "To:")
-  struct Person    ReplyTo;    // The main Reply-To recipients (first entry in "Reply-To:")
-
-  char tzAbbr[SIZE_SMALL];        // copy of the timezone abbreviation
-  char MailAccount[SIZE_DEFAULT]; // name of mail account used to receive/sent mail
-  char Subject[SIZE_SUBJECT];     // copy of the mail Subject: header
-  char MailFile[SIZE_MFILE];      // name of mail file (without path)
+  struct MailPerson From;       // The main sender (normally first entry in "From:")
+  struct MailPerson To;         // The main mail recipient (first entry in "To:")
+  struct MailPerson ReplyTo;    // The main Reply-To recipients (first entry in "Reply-To:")
+  const char *     tzAbbr;      // the timezone abbreviation (pooled)
+  const char *     MailAccount; // name of mail account used to receive/sent mail (pooled)
+  const char *     Subject;     // the mail Subject: header (malloc()'ed, static "" if empty)
+
+  char MailFile[SIZE_MFILE];    // name of mail file (without path)
 };
 
 struct ExtendedMail
@@ -106,17 +117,59 @@ enum ReadHeaderMode
   RHM_SUBHEADER,    // we are reading a sub header of a mimepart of a mail
 };
 
+// the state of a mail header which is parsed line by line
+struct HeaderParser
+{
+  struct MinList *headerList;   // the list receiving the parsed header lines
+  struct HeaderNode *hdrNode;   // the header line currently being parsed
+  const char *mailFile;         // the mail file, for error messages only
+};
+
+// a mail which is examined while it is being written to disk, thus it
+// doesn't need to be read again afterwards
+struct MailStream
+{
+  struct HeaderParser parser;
+  struct MinList headerList;    // the parsed header lines
+  char *line;                   // the yet incomplete header line
+  size_t lineLength;            // the length of the incomplete header line
+  size_t lineSize;              // the size of the header line buffer
+  long size;                    // the number of bytes written so far
+  BOOL inHeader;                // TRUE as long as the header is not complete
+  BOOL lineStart;               // TRUE if the next byte starts a new line
+  BOOL failed;                  // TRUE if the header could not be parsed
+  BOOL uuencoded;               // TRUE if the body contains uuencoded data
+};
+
+// types of changes recorded in the index journal of a folder
+enum IndexJournalType
+{
+  IJT_STATUS=0, // the status (and thus the file name) of a mail changed
+  IJT_ADD,      // a mail was added to the folder
+  IJT_REMOVE    // a mail was removed from the folder
+};
+
 void  MA_ChangeFolder(struct Folder *folder, BOOL set_active);
 void  MA_ExpireIndex(struct Folder *folder);
 struct ExtendedMail *MA_ExamineMail(const struct Folder *folder, const char *file, const BOOL deep);
+void  MA_InitMailStream(struct MailStream *ms, const char *mailFile);
+void  MA_WriteMailStream(struct MailStream *ms, const char *data, size_t len);
+struct ExtendedMail *MA_ExamineMailStream(struct MailStream *ms, const struct Folder *folder, const char *file, const BOOL deep);
+void  MA_CleanupMailStream(struct MailStream *ms);
 void  MA_FreeEMailStruct(struct ExtendedMail *email);
+void  MA_CancelIndexPreload(struct Folder *folder);
+void  MA_FinishIndexPreload(struct Folder *folder);
 BOOL  MA_GetIndex(struct Folder *folder);
+void  MA_JournalIndex(struct Folder *folder, enum IndexJournalType type, const char *mailFile, const struct Mail *mail);
 enum LoadedMode MA_LoadIndex(struct Folder *folder, BOOL full);
 BOOL  MA_NewMailFile(const struct Folder *folder, char *fullPath, const size_t fullPathSize);
+LONG  MA_PreloadIndexes(struct IndexPreloader *data);
 BOOL  MA_PromptFolderPassword(struct Folder *fo, APTR win);
 BOOL  MA_ReadHeader(const char *mailFile, FILE *fh, struct MinList *headerList, enum ReadHeaderMode mode);
 BOOL  MA_SaveIndex(struct Folder *folder);
 void  MA_RebuildIndexes(void);
+void  MA_StartIndexPreload(void);
+void  MA_StopIndexPreload(void);
 void  MA_UpdateInfoBar(struct Folder *folder);
 struct Mail *FindMailByMsgID(struct Folder *folder, const char *msgid);
 void MoveHeldMailsToDraftsFolder(void);
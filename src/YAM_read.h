@@ -110,12 +110,14 @@ struct ReadMailData
 #define PFLAG_ALTPART       (1<<3)  // this part is an alternative part (multipart/alternative)
 #define PFLAG_MIME          (1<<4)  // this part conforms to the MIME standard
 #define PFLAG_ATTACHMENT    (1<<5)  // this part is explicitly declared as attachment
+#define PFLAG_MEMORY        (1<<6)  // the part's data is kept in memory instead of a file
 #define hasSubHeaders(part)     (isFlagSet((part)->Flags, PFLAG_SUBHEADERS))
 #define isPrintable(part)       (isFlagSet((part)->Flags, PFLAG_PRINTABLE))
 #define isDecoded(part)         (isFlagSet((part)->Flags, PFLAG_DECODED))
 #define isAlternativePart(part) (isFlagSet((part)->Flags, PFLAG_ALTPART))
 #define isMIMEconform(part)     (isFlagSet((part)->Flags, PFLAG_MIME))
 #define isAttachment(part)      (isFlagSet((part)->Flags, PFLAG_ATTACHMENT))
+#define isMemoryPart(part)      (isFlagSet((part)->Flags, PFLAG_MEMORY))
 
 // a struct Part is a structure for managing certain message
 // parts according to the hierarchical structuring of e-mails
@@ -137,6 +139,7 @@ struct Part
   char                *CParDesc;           // ptr to the content-type "description"
   char                *CParRType;          // ptr to the content-type "report-type"
   char                *CParCSet;           // ptr to the content-type "charset" "iso8859-1"
+  char                *Data;               // dynamic string with the part's data for PFLAG_MEMORY parts
   long                 Size;               // the calculated size in bytes
   int                  Flags;              // PFLAG_#? flags
   int                  Nr;
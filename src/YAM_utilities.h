@@ -48,6 +48,7 @@
 // forward declarations
 struct ReadMailData;
 struct Mail;
+struct MailList;
 struct codeset;
 struct TimeVal;
 
@@ -235,6 +236,7 @@ struct FileReqCache
 #define isGraph(c)            ((BOOL)(G->Locale ? (IsGraph(G->Locale, (ULONG)(c)) != 0) : (isgraph((c)) != 0)))
 #define isAlNum(c)            ((BOOL)(G->Locale ? (IsAlNum(G->Locale, (ULONG)(c)) != 0) : (isalnum((c)) != 0)))
 #define isValidMailFile(file) (!(strlen(file) < 17 || file[12] != '.' || file[16] != ',' || !isdigit(file[13])))
+#define MAILKEY_LEN           16 // the length of the status independent part of a mail file name, see GetMailKey()
 #define Bool2Txt(b)           ((b) ? "Y" : "N")
 #define Txt2Bool(t)           (BOOL)(toupper((int)*(t)) == 'Y' || (int)*(t) == '1')
 #define SafeStr(str)          (((str) != NULL) ? (str) : "<NULL>")
@@ -257,6 +259,7 @@ extern struct Hook    ExamineDirMatchHook;
 
 // all the utility prototypes
 void     AddMailToFolder(struct Mail *mail, struct Folder *folder);
+void     AddMailsToFolder(const struct MailList *mlist, struct Folder *folder, const BOOL journal);
 void     AddMailToFolderSimple(struct Mail *mail, struct Folder *folder);
 struct Mail *ReplaceMailInFolder(const char *mailFile, struct Mail *mail, struct Folder *folder);
 void     AddZombieFile(const char *fileName);
@@ -318,6 +321,7 @@ void     FormatSize(LONG size, char *buffer, int buflen, enum SizeFormat forcedP
 ULONG    GetDateStamp(void);
 ssize_t  GetLine(char **buffer, size_t *size, FILE *fh);
 void     GetMailFile(char *string, const size_t stringSize, const struct Folder *folder, const struct Mail *mail);
+BOOL     GetMailKey(const struct Mail *mail, char *key);
 ULONG    GetSimpleID(void);
 BOOL     GotoURLPossible(void);
 BOOL     GotoURL(const char *url, const BOOL newWindow);
@@ -334,6 +338,7 @@ void     PGPGetPassPhrase(void);
 BOOL     PlaySound(const char *filename);
 void     QuoteText(FILE *out, const char *src, const int len, const int line_max);
 void     RemoveMailFromFolder(struct Mail *mail, const BOOL closeWindows, const BOOL checkConnections);
+void     RemoveMailsFromFolder(const struct MailList *mlist, struct Folder *folder, const BOOL closeWindows, const BOOL checkConnections);
 BOOL     RenameFile(const char *oldname, const char *newname);
 BOOL     RepackMailFile(struct Mail *mail, enum FolderMode dstMode, const char *passwd);
 struct FileReqCache *ReqFile(enum ReqFileType num, Object *win, const char *title, int mode, const char *drawer, const char *file);
@@ -37,6 +37,7 @@
 #include "mime/base64.h"
 
 #include "Config.h"
+#include "DynamicString.h"
 
 #include "Debug.h"
 
@@ -54,6 +55,31 @@ static const unsigned char index_64[128] =
    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,255,255,255,255,255
 };
 
+// lookup table for the streaming decoder which additionally
+// classifies white spaces and the padding character
+#define B64_SKIP    0x80
+#define B64_PAD     0x81
+
+static const unsigned char decode_64[256] =
+{
+  255,255,255,255,255,255,255,255,255,128,128,128,128,128,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  128,255,255,255,255,255,255,255,255,255,255, 62,255,255,255, 63,
+   52, 53, 54, 55, 56, 57, 58, 59, 60, 61,255,255,255,129,255,255,
+  255,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+   15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,255,255,255,255,255,
+  255, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+   41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255
+};
+
 // some defines that can be usefull
 #define B64_LINELEN 72    // number of chars before the b64encode_file() issues a CRLF
 #define B64DEC_BUF  4096  // bytes to use as a base64 file decoding buffer
@@ -271,261 +297,523 @@ int base64decode(char **out, const char *in, size_t inlen)
   return result;
 }
 
+///
+/// base64encode_init()
+// initializes a streaming base64 encoder
+void base64encode_init(struct B64Encoder *enc)
+{
+  enc->restLen = 0;
+  enc->column = 0;
+  enc->encoded = 0;
+}
+
+///
+/// base64encode_stream()
+// encodes an arbitrary chunk of data and places the result including
+// the line breaks after every B64_LINELEN characters in 'out'. Up to two
+// bytes which don't form a complete group are kept until the next call.
+// 'out' must be able to hold B64ENC_OUTLEN(inlen) characters. Returns the
+// number of characters placed in 'out'.
+size_t base64encode_stream(struct B64Encoder *enc, char *out, const char *in, size_t inlen)
+{
+  const unsigned char *inp = (const unsigned char *)in;
+  const unsigned char *end = inp+inlen;
+  char *outp = out;
+  int column = enc->column;
+
+  ENTER();
+
+  // complete a group with the bytes left over from the last call
+  while(enc->restLen > 0 && enc->restLen < 3 && inp < end)
+  {
+    enc->rest[enc->restLen++] = *inp++;
+
+    if(enc->restLen == 3)
+    {
+      ULONG v = (enc->rest[0] << 16) | (enc->rest[1] << 8) | enc->rest[2];
+
+      if(column == B64_LINELEN)
+      {
+        *outp++ = '\n';
+        column = 0;
+      }
+
+      outp[0] = basis_64[(v >> 18) & 0x3f];
+      outp[1] = basis_64[(v >> 12) & 0x3f];
+      outp[2] = basis_64[(v >> 6) & 0x3f];
+      outp[3] = basis_64[v & 0x3f];
+      outp += 4;
+      column += 4;
+      enc->encoded += 4;
+      enc->restLen = 0;
+    }
+  }
+
+  // now encode all complete groups, B64_LINELEN is a multiple of 4
+  // so a group never crosses a line boundary
+  while(end-inp >= 3)
+  {
+    ULONG v = (inp[0] << 16) | (inp[1] << 8) | inp[2];
+
+    if(column == B64_LINELEN)
+    {
+      *outp++ = '\n';
+      column = 0;
+    }
+
+    outp[0] = basis_64[(v >> 18) & 0x3f];
+    outp[1] = basis_64[(v >> 12) & 0x3f];
+    outp[2] = basis_64[(v >> 6) & 0x3f];
+    outp[3] = basis_64[v & 0x3f];
+    outp += 4;
+    column += 4;
+    enc->encoded += 4;
+    inp += 3;
+  }
+
+  // remember the remaining bytes for the next call
+  while(inp < end)
+    enc->rest[enc->restLen++] = *inp++;
+
+  enc->column = column;
+
+  RETURN((size_t)(outp-out));
+  return (size_t)(outp-out);
+}
+
+///
+/// base64encode_finish()
+// encodes the remaining bytes of a streaming base64 encoder including
+// the padding characters. 'out' must be able to hold 5 characters.
+size_t base64encode_finish(struct B64Encoder *enc, char *out)
+{
+  char *outp = out;
+
+  ENTER();
+
+  if(enc->restLen > 0)
+  {
+    ULONG v = enc->rest[0] << 16;
+
+    if(enc->restLen > 1)
+      v |= enc->rest[1] << 8;
+
+    if(enc->column == B64_LINELEN)
+    {
+      *outp++ = '\n';
+      enc->column = 0;
+    }
+
+    outp[0] = basis_64[(v >> 18) & 0x3f];
+    outp[1] = basis_64[(v >> 12) & 0x3f];
+    outp[2] = enc->restLen > 1 ? basis_64[(v >> 6) & 0x3f] : '=';
+    outp[3] = '=';
+    outp += 4;
+
+    enc->column += 4;
+    enc->encoded += 4;
+    enc->restLen = 0;
+  }
+
+  RETURN((size_t)(outp-out));
+  return (size_t)(outp-out);
+}
+
+///
+/// base64decode_init()
+// initializes a streaming base64 decoder
+void base64decode_init(struct B64Decoder *dec)
+{
+  dec->bits = 0;
+  dec->count = 0;
+  dec->problem = FALSE;
+}
+
+///
+/// flushQuantum()
+// places the bytes of an incomplete quantum in the output buffer
+static char *flushQuantum(struct B64Decoder *dec, char *outp)
+{
+  switch(dec->count)
+  {
+    case 0:
+      // nothing
+    break;
+
+    case 1:
+    {
+      // a single character doesn't give a complete byte
+      dec->problem = TRUE;
+    }
+    break;
+
+    case 2:
+    {
+      *outp++ = (dec->bits >> 4) & 0xff;
+    }
+    break;
+
+    case 3:
+    {
+      *outp++ = (dec->bits >> 10) & 0xff;
+      *outp++ = (dec->bits >> 2) & 0xff;
+    }
+    break;
+  }
+
+  dec->bits = 0;
+  dec->count = 0;
+
+  return outp;
+}
+
+///
+/// base64decode_stream()
+// decodes an arbitrary chunk of base64 encoded data in a single pass.
+// Whitespaces are skipped, invalid characters are ignored but remembered
+// as a problem and an incomplete quantum is kept until the next call.
+// Padding characters finish the current quantum, data following them is
+// decoded as well. 'out' must be able to hold B64DEC_OUTLEN(inlen) bytes.
+// Returns the number of bytes placed in 'out'.
+size_t base64decode_stream(struct B64Decoder *dec, char *out, const char *in, size_t inlen)
+{
+  const unsigned char *inp = (const unsigned char *)in;
+  const unsigned char *end = inp+inlen;
+  char *outp = out;
+
+  ENTER();
+
+  while(inp < end)
+  {
+    unsigned char c;
+
+    // fast path: decode complete groups of four valid characters until
+    // a line break or any other special character shows up
+    if(dec->count == 0)
+    {
+      while(end-inp >= 4)
+      {
+        unsigned char c0 = decode_64[inp[0]];
+        unsigned char c1 = decode_64[inp[1]];
+        unsigned char c2 = decode_64[inp[2]];
+        unsigned char c3 = decode_64[inp[3]];
+        ULONG v;
+
+        // all special values have at least one of the upper two bits set
+        if(((c0 | c1 | c2 | c3) & 0xc0) != 0)
+          break;
+
+        v = (c0 << 18) | (c1 << 12) | (c2 << 6) | c3;
+        outp[0] = (v >> 16) & 0xff;
+        outp[1] = (v >> 8) & 0xff;
+        outp[2] = v & 0xff;
+        outp += 3;
+        inp += 4;
+      }
+
+      if(inp == end)
+        break;
+    }
+
+    // slow path: process a single character
+    c = decode_64[*inp++];
+
+    if(c < 64)
+    {
+      dec->bits = (dec->bits << 6) | c;
+
+      if(++dec->count == 4)
+      {
+        outp[0] = (dec->bits >> 16) & 0xff;
+        outp[1] = (dec->bits >> 8) & 0xff;
+        outp[2] = dec->bits & 0xff;
+        outp += 3;
+
+        dec->bits = 0;
+        dec->count = 0;
+      }
+    }
+    else if(c == B64_PAD)
+      outp = flushQuantum(dec, outp);
+    else if(c != B64_SKIP)
+    {
+      W(DBF_MIME, "invalid base64 character %02lx found", inp[-1]);
+      dec->problem = TRUE;
+    }
+  }
+
+  RETURN((size_t)(outp-out));
+  return (size_t)(outp-out);
+}
+
+///
+/// base64decode_finish()
+// decodes an incomplete quantum left at the end of the encoded data,
+// 'out' must be able to hold 2 bytes
+size_t base64decode_finish(struct B64Decoder *dec, char *out)
+{
+  char *outp = out;
+
+  ENTER();
+
+  if(dec->count != 0)
+  {
+    W(DBF_MIME, "unpadded quantum of %ld chars at end of data", dec->count);
+
+    dec->problem = TRUE;
+    outp = flushQuantum(dec, outp);
+  }
+
+  RETURN((size_t)(outp-out));
+  return (size_t)(outp-out);
+}
+
+///
+/// convertToUTF8()
+// converts decoded text from the source codeset to UTF8, but binary/non-text
+// data is never touched. Returns either 'data' or a buffer allocated by
+// codesets.library which has to be freed by CodesetsFreeA()
+static char *convertToUTF8(char *data, size_t *len, struct codeset **srcCodeset, BOOL isText)
+{
+  char *result = data;
+
+  ENTER();
+
+  if(isText == TRUE && *len > 0)
+  {
+    struct codeset *cs = *srcCodeset;
+
+    // in case the user wants us to detect the correct cyrillic codeset
+    // we do it now, but just if the source codeset isn't UTF-8
+    if(C->DetectCyrillic == TRUE)
+    {
+      if(cs == NULL || (cs->name != NULL && stricmp(cs->name, "utf-8") != 0))
+      {
+        struct codeset *best = CodesetsFindBest(CSA_Source,         data,
+                                                CSA_SourceLen,      *len,
+                                                CSA_CodesetFamily,  CSV_CodesetFamily_Cyrillic,
+                                                TAG_DONE);
+
+        if(best != NULL && best != cs)
+        {
+          D(DBF_MIME, "using codeset '%s' instead of '%s'", cs != NULL ? cs->name : "none", best->name);
+          cs = best;
+          *srcCodeset = cs;
+        }
+      }
+    }
+
+    if(cs != NULL && stricmp(cs->name, "utf-8") != 0)
+    {
+      ULONG strLen = 0;
+
+      UTF8 *str = CodesetsUTF8Create(CSA_Source,          data,
+                                     CSA_SourceLen,       *len,
+                                     CSA_SourceCodeset,   cs,
+                                     CSA_DestLenPtr,      &strLen,
+                                     TAG_DONE);
+
+      if(str != NULL && strLen > 0)
+      {
+        result = (char *)str;
+        *len = strLen;
+      }
+      else
+        W(DBF_MIME, "error while trying to convert base64decoded string to UTF8");
+    }
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// removeCRLF()
+// converts all CRLF line endings to LF and returns the new length
+static size_t removeCRLF(char *data, size_t len)
+{
+  char *rc;
+
+  ENTER();
+
+  // nothing to do for data without any CR
+  if((rc = memchr(data, '\r', len)) != NULL)
+  {
+    char *wc = rc;
+    char *end = data+len;
+
+    while(rc < end)
+    {
+      // skip the \r of a CRLF
+      if(rc[0] != '\r' || rc+1 >= end || rc[1] != '\n')
+        *wc++ = *rc;
+
+      rc++;
+    }
+
+    len = wc-data;
+  }
+
+  RETURN(len);
+  return len;
+}
+
 ///
 /// base64encode_file()
 //  Encodes a file in base64 format. It reads in a file from a supplied FILE*
-//  pointer stepwise by filling up a buffer, encoding it and writing it down
-//  as soon as it reached the length of 72 characters. This makes sure the
-//  base64 encoded parts can be embeded into an RFC822 compliant mail
-//  It returns the total number of encoded characters written to the destination
-//  file.
+//  pointer stepwise by filling up a buffer and encodes it with a streaming
+//  encoder which already inserts a newline after every 72 characters. This
+//  makes sure the base64 encoded parts can be embeded into an RFC822 compliant
+//  mail. It returns the total number of encoded characters written to the
+//  destination file.
 long base64encode_file(FILE *in, FILE *out, BOOL convLF)
 {
-  char inbuffer[B64ENC_BUF*2+2];  // we use a buffer of 8192 bytes here because we read out
-                                  // data in 4095 byte chunks out of file 'in' and as we
-                                  // probably need to convert each LF into a CRLF we have to
-                                  // have a buffer with a maximum space of 8190 bytes.
-                                  // the other 2 bytes are to be safe. :)
-  char *outbuffer = NULL;
-  char *optr;
+  char inbuffer[B64ENC_BUF];
+  char convbuffer[B64ENC_BUF*2];  // as we probably need to convert each LF into
+                                  // a CRLF we need a buffer of twice the size
+  char *outbuffer;
+  struct B64Encoder enc;
   BOOL eof_reached = FALSE;
-  int next_unget = 0;
-  int missing_chars = 0;
-  int sumencoded = 0;
-  int towrite;
-  int encoded;
-  size_t read = 0;
+  long result = -1;
 
   ENTER();
   SHOWVALUE(DBF_MIME, convLF);
 
+  // the output buffer is allocated only once for the whole file
+  if((outbuffer = malloc(B64ENC_OUTLEN(sizeof(convbuffer)))) == NULL)
+  {
+    E(DBF_MIME, "couldn't allocate output buffer");
+
+    RETURN(-1);
+    return -1;
+  }
+
+  base64encode_init(&enc);
+
   while(eof_reached == FALSE)
   {
-    // before we go on with reading in more data we move
-    // the last next_unget characters of inbuffer to the start
-    // of inbuffer
-    if(next_unget > 0)
-      memmove(inbuffer, &inbuffer[read], next_unget);
+    size_t read;
+    size_t encoded;
+    char *data = inbuffer;
 
     // read in 4095 byte chunks
-    read = fread(&inbuffer[0]+next_unget, 1, B64ENC_BUF-next_unget, in);
-    read += next_unget;
-    next_unget = 0;
+    read = fread(inbuffer, 1, sizeof(inbuffer), in);
 
     // on a short item count we check for a potential
     // error and return immediatly.
-    if(read != B64ENC_BUF)
+    if(read != sizeof(inbuffer))
     {
       if(feof(in) != 0)
       {
         D(DBF_MIME, "EOF file at %ld", ftell(in));
 
         eof_reached = TRUE; // we found an EOF
-
-        // if the last read was zero we can exit immediatly
-        if(read == 0)
-          break;
       }
       else
       {
         E(DBF_MIME, "error on reading data!");
 
         // an error occurred, lets return -1
-        RETURN(-1);
-        return -1;
+        break;
       }
     }
 
     // now we check whether the user want to convert each LF into a CRLF
     // and if so we need to parse the whole read bytes for \n and convert
     // them to \r\n before the base64 encoding.
-    if(convLF)
+    if(convLF == TRUE && read > 0)
     {
-      char convbuffer[B64ENC_BUF*2+2];
-      char *sptr = convbuffer;
-      char *dptr = inbuffer;
-      long toconvert = read;
-      long converted = 0;
-
-      // lets fill the convbuffer with the data
-      // of inbuffer first
-      memcpy(convbuffer, inbuffer, toconvert);
+      char *sptr = inbuffer;
+      char *send = inbuffer+read;
+      char *dptr = convbuffer;
 
-      while(toconvert--)
+      while(sptr < send)
       {
         if(*sptr == '\n')
-        {
-          // now write a \r first
-          *dptr = '\r';
-          dptr++;
-
-          converted++;
-        }
+          *dptr++ = '\r';
 
-        // copy the current character;
-        *dptr = *sptr;
-
-        // increase the pointers
-        dptr++;
-        sptr++;
+        *dptr++ = *sptr++;
       }
 
-      // increase the read counter
-      read += converted;
-
-      // now that we have converted something we have to
-      // make sure that read is still a multiple of 3 if this
-      // isn`t an EOF run.
-      if(eof_reached == FALSE)
-      {
-        // lets check how many chars we have to skip and move
-        // back later
-        next_unget = read % 3;
-        read -= next_unget;
-      }
+      data = convbuffer;
+      read = dptr-convbuffer;
     }
 
-    // now everything should be prepared so that we can call the
-    // base64 encoding routine and let it convert our inbuffer to
-    // the apropiate outbuffer
-    encoded = base64encode(&outbuffer, inbuffer, read);
-    sumencoded += encoded;
+    encoded = base64encode_stream(&enc, outbuffer, data, read);
+
+    // encode the remaining bytes including the padding at the end
+    if(eof_reached == TRUE)
+      encoded += base64encode_finish(&enc, &outbuffer[encoded]);
 
-    // if the base64encoding routine returns <= 0 then there is obviously
-    // something wrong
-    if(encoded <= 0)
+    // now we do a binary write of the data
+    if(encoded > 0 && fwrite(outbuffer, 1, encoded, out) != encoded)
     {
-      E(DBF_MIME, "error on encoding data!");
+      E(DBF_MIME, "error on writing data!");
 
-      RETURN(-1);
-      return -1;
+      // an error must have occurred.
+      break;
     }
 
-    // now that we seem to have everything encoded we write out
-    // the encoded sting in 72 character long chunks followed by
-    // a newline
-    optr = outbuffer;
-    towrite = encoded;
-
-    while(towrite > 0)
+    // if there was nothing to encode at all we signal an error
+    if(eof_reached == TRUE)
     {
-      size_t todo;
-
-      // how many chars should be written?
-      if(missing_chars == 0)
-      {
-        if(towrite >= B64_LINELEN)
-        {
-          todo = B64_LINELEN;
-        }
-        else
-          todo = towrite;
-      }
-      else
-        todo = towrite < missing_chars ? towrite : missing_chars;
-
-      // now we do a binary write of the data
-      if(fwrite(optr, 1, todo, out) != todo)
-      {
-        E(DBF_MIME, "error on writing data!");
-
-        free(outbuffer);
-
-        // an error must have occurred.
-        RETURN(-1);
-        return -1;
-      }
-
-      // lets modify our counters
-      towrite -= todo;
-      optr += todo;
-
-      // then we have to check whether we have written
-      // a full 72 char long line or not and if so we can attach
-      // a newline.
-      if(missing_chars == 0 &&
-         todo < B64_LINELEN && eof_reached == FALSE)
-      {
-        // if we end up here we don`t write any newline,
-        // but we remember how many characters we are
-        // going to write in advance next time.
-        missing_chars = B64_LINELEN-todo;
-      }
-      else if((towrite > 0 || eof_reached == FALSE) && fputc('\n', out) == EOF)
-      {
-        E(DBF_MIME, "error on writing newline");
-
-        free(outbuffer);
-
-        RETURN(-1);
-        return -1;
-      }
+      if(enc.encoded > 0)
+        result = enc.encoded;
       else
-        missing_chars = 0;
+        E(DBF_MIME, "error on encoding data!");
     }
-
-    free(outbuffer);
-    outbuffer = NULL;
   }
 
-  RETURN(sumencoded);
-  return sumencoded;
+  free(outbuffer);
+
+  RETURN(result);
+  return result;
 }
 
 ///
 /// base64decode_file()
 //  Decodes a file in base64 format. Takes care of an eventually specified translation
 //  table as well as a CRLF->LF translation for printable text. It reads in the base64
-//  strings line by line from the in file stream, decodes it and writes out the
-//  decoded data with fwrite() to the out stream. It returns the total bytes of
-//  written (decoded) data. In case of an error it returns -1 and in case it
+//  data in chunks from the in file stream, decodes it with a streaming decoder and
+//  writes out the decoded data with fwrite() to the out stream. It returns the total
+//  bytes of written (decoded) data. In case of an error it returns -1 and in case it
 //  found a short item count during decoding it return -2 asking the user
 //  to still consider the string decoded (however it should be treated with
 //  care)
 long base64decode_file(FILE *in, FILE *out,
                        struct codeset *srcCodeset, BOOL isText, BOOL convCRLF)
 {
-  char inbuffer[B64DEC_BUF+1];
-  char *outbuffer = NULL;
-  char ungetbuf[3];
+  char inbuffer[B64DEC_BUF];
+  char outbuffer[B64DEC_OUTLEN(B64DEC_BUF)];
+  struct B64Decoder dec;
   long decodedChars = 0;
-  size_t next_unget = 0;
   BOOL eof_reached = FALSE;
-  BOOL problemDuringDecode = FALSE;
+  BOOL pendingCR = FALSE;
 
   ENTER();
 
   D(DBF_MIME, "codeset '%s'", srcCodeset != NULL ? srcCodeset->name : "none");
 
+  base64decode_init(&dec);
+
   while(eof_reached == FALSE)
   {
-    int outLength = 0;
-    char *sptr;
-    char *dptr;
     size_t read;
-    size_t todo;
-
-    // if we do have some unget chars lets copy them first at the
-    // beginning of the inbuffer
-    if(next_unget > 0)
-      memcpy(inbuffer, ungetbuf, next_unget);
+    size_t outLength;
+    char *dptr;
 
     // do a binary read of ~4096 chunks
-    read = fread(&inbuffer[next_unget], sizeof(char), B64DEC_BUF-next_unget, in);
+    read = fread(inbuffer, sizeof(char), sizeof(inbuffer), in);
 
     // on a short item count we check for a potential
     // error and return immediatly.
-    if(read != B64DEC_BUF-next_unget)
+    if(read != sizeof(inbuffer))
     {
       if(feof(in) != 0)
       {
         D(DBF_MIME, "EOF file at %ld", ftell(in));
 
         eof_reached = TRUE; // we found an EOF
-
-        // if the last read was zero we can exit immediatly
-        if(read == 0 && next_unget == 0)
-          break;
       }
       else
       {
@@ -537,196 +825,84 @@ long base64decode_file(FILE *in, FILE *out,
       }
     }
 
-    // increase/reset the counters
-    read += next_unget;
-    next_unget = 0;
-
-    // now that we have read 4096 bytes into our buffer
-    // we have to iterate through this buffer and "eliminate"
-    // white spaces which aren`t normally part of base64 encoded
-    // string and can be safely skipped without
-    // corrupting the decoded file.
-    sptr = inbuffer;
-    dptr = inbuffer;
-    todo = read;
-
-    while(todo > 0)
-    {
-      if(!isspace(*sptr))
-      {
-        *dptr = *sptr;
-        dptr++;
-      }
-      else read--;
+    // decode the chunk regardless of any quantum or line boundaries
+    outLength = base64decode_stream(&dec, outbuffer, inbuffer, read);
 
-      sptr++;
-      todo--;
-    }
+    if(eof_reached == TRUE)
+      outLength += base64decode_finish(&dec, &outbuffer[outLength]);
 
-    // if we end up with read == 0 we had only spaces in our
-    // source string, so lets skip to the next iteration
-    if(read == 0)
+    if(outLength == 0)
       continue;
 
-    // before we going to decode the string we have to make sure
-    // that the encoded string is a multiple of 4 as 4 encoded
-    // base64 chars will get out 2 unencoded ones.
-    next_unget = read % 4;
-    if(next_unget > 0)
-    {
-      if(eof_reached == FALSE)
-      {
-        read -= next_unget;
-        memcpy(ungetbuf, &inbuffer[read], next_unget);
-      }
-      else
-      {
-        W(DBF_MIME, "unget chars at EOF???");
-
-        problemDuringDecode = TRUE;
-      }
-    }
+    // make sure we convert our outbuffer to UTF8 before writing it out
+    // to the file
+    dptr = convertToUTF8(outbuffer, &outLength, &srcCodeset, isText);
 
-    // now that we have a whitespace free somewhat base64 encoded
-    // string, we can call the base64decode() function to finally
-    // decode the string
-    if(read <= 0 ||
-       (outLength = base64decode(&outbuffer, inbuffer, read)) <= 0)
+    // if the user also wants to convert CRLF to LF only,
+    // we do it right now
+    if(convCRLF == TRUE)
     {
-      E(DBF_MIME, "error on decoding: %ld %ld", read, outLength);
-
-      if(outLength < 0)
-      {
-        // we faced a short item count. That can actually be a sign that the text
-        // in question is not a fully base64 compliant string. However, to
-        // at least display the text to the user we redefine the outLength and
-        // let the write function output that string (even if not correctly
-        // decoded)
-        outLength = -outLength;
-
-        problemDuringDecode = TRUE;
-      }
-      else
+      // a CR at the end of the last chunk is only written if it isn't followed by a LF
+      if(pendingCR == TRUE && dptr[0] != '\n')
       {
-        // it should not happen that we face a shortCount
-        // or error
-        free(outbuffer);
-        RETURN(-1);
-        return -1;
-      }
-    }
+        if(fputc('\r', out) == EOF)
+        {
+          E(DBF_MIME, "error on writing data!");
 
-    // in case the user wants us to detect the correct cyrillic codeset
-    // we do it now, but just if the source codeset isn't UTF-8
-    if(C->DetectCyrillic == TRUE && isText == TRUE)
-    {
-      if(srcCodeset == NULL || (srcCodeset->name != NULL && stricmp(srcCodeset->name, "utf-8") != 0))
-      {
-        struct codeset *cs = CodesetsFindBest(CSA_Source,         outbuffer,
-                                              CSA_SourceLen,      outLength,
-                                              CSA_CodesetFamily,  CSV_CodesetFamily_Cyrillic,
-                                              TAG_DONE);
+          if(dptr != outbuffer)
+            CodesetsFreeA(dptr, NULL);
 
-        if(cs != NULL && cs != srcCodeset)
-        {
-          D(DBF_MIME, "using codeset '%s' instead of '%s'", srcCodeset != NULL ? srcCodeset->name : "none", cs->name);
-          srcCodeset = cs;
+          RETURN(-1);
+          return -1;
         }
+
+        decodedChars++;
       }
-    }
 
-    // if the caller supplied a source codeset, we have to
-    // make sure we convert our outbuffer before writing it out
-    // to the file in UTF8, but we must not touch binary/non-text data
-    if(isText == TRUE && srcCodeset != NULL && stricmp(srcCodeset->name, "utf-8") != 0)
-    {
-      ULONG strLen = 0;
+      pendingCR = FALSE;
 
-      UTF8 *str = CodesetsUTF8Create(CSA_Source,          outbuffer,
-                                     CSA_SourceLen,       outLength,
-                                     CSA_SourceCodeset,   srcCodeset,
-                                     CSA_DestLenPtr,      &strLen,
-                                     TAG_DONE);
+      outLength = removeCRLF(dptr, outLength);
 
-      if(str != NULL && strLen > 0)
-      {
-        // if we end up here we successfully converted the
-        // sourcebuffer to a destination buffer which complies to our local
-        // charset
-        dptr = (char *)str;
-        outLength = strLen;
-      }
-      else
+      if(eof_reached == FALSE && outLength > 0 && dptr[outLength-1] == '\r')
       {
-        W(DBF_MIME, "error while trying to convert base64decoded string to UTF8");
-        dptr = outbuffer;
+        pendingCR = TRUE;
+        outLength--;
       }
     }
-    else
-      dptr = outbuffer;
 
-    if(dptr != NULL)
+    // now that we got the string decoded we write it into
+    // our file
+    if(outLength > 0 && fwrite(dptr, sizeof(char), outLength, out) != outLength)
     {
-      // if the user also wants to convert CRLF to LF only,
-      // we do it right now
-      if(convCRLF == TRUE)
-      {
-        long r;
-        char *rc = dptr;
-        char *wc = dptr;
-
-        for(r=0; r < outLength; r++, rc++)
-        {
-          // check if this is a CRLF
-          if(*rc == '\r' &&
-             outLength-r > 1 && rc[1] == '\n')
-          {
-            // if so, skip the \r
-            continue;
-          }
-          else
-          {
-            // if no CRLF is found, lets copy
-            // the plain character
-            *wc = *rc;
-
-            // increase the write counter
-            wc++;
-          }
-        }
+      E(DBF_MIME, "error on writing data!");
 
-        // make sure we reduce outLength by the
-        // number of "overjumped" chars.
-        outLength -= (rc-wc);
-      }
-
-      // now that we got the string decoded we write it into
-      // our file
-      if(fwrite(dptr, sizeof(char), (size_t)outLength, out) != (size_t)outLength)
-      {
-        E(DBF_MIME, "error on writing data!");
+      if(dptr != outbuffer)
+        CodesetsFreeA(dptr, NULL);
 
-        // an error occurred while writing...
-        RETURN(-1);
-        return -1;
-      }
+      // an error occurred while writing...
+      RETURN(-1);
+      return -1;
     }
 
     // in case the dptr buffer was allocated by codesets.library,
     // we have to free it now
-    if(dptr != outbuffer && dptr != NULL)
+    if(dptr != outbuffer)
       CodesetsFreeA(dptr, NULL);
 
-    free(outbuffer);
-
     // increase the decodedChars counter
     decodedChars += outLength;
   }
 
+  if(pendingCR == TRUE)
+  {
+    fputc('\r', out);
+    decodedChars++;
+  }
+
   // if there was a problem during
   // the decoding phase we go and warn the user with a
   // return value of -2
-  if(problemDuringDecode == TRUE)
+  if(dec.problem == TRUE)
     decodedChars = -2;
 
   RETURN(decodedChars);
@@ -734,3 +910,57 @@ long base64decode_file(FILE *in, FILE *out,
 }
 
 ///
+/// base64decode_buffer()
+//  Decodes a whole base64 encoded memory buffer and places the result in the
+//  dynamic string 'out'. The return values are the same as for base64decode_file()
+long base64decode_buffer(char **out, const char *in, size_t inlen,
+                         struct codeset *srcCodeset, BOOL isText, BOOL convCRLF)
+{
+  char *outbuffer;
+  long decodedChars = -1;
+
+  ENTER();
+
+  D(DBF_MIME, "codeset '%s'", srcCodeset != NULL ? srcCodeset->name : "none");
+
+  if((outbuffer = malloc(B64DEC_OUTLEN(inlen))) != NULL)
+  {
+    struct B64Decoder dec;
+    size_t outLength;
+    char *dptr;
+
+    base64decode_init(&dec);
+
+    outLength = base64decode_stream(&dec, outbuffer, in, inlen);
+    outLength += base64decode_finish(&dec, &outbuffer[outLength]);
+
+    dptr = convertToUTF8(outbuffer, &outLength, &srcCodeset, isText);
+
+    // if the user also wants to convert CRLF to LF only,
+    // we do it right now
+    if(convCRLF == TRUE)
+      outLength = removeCRLF(dptr, outLength);
+
+    if(dstrmemcpy(out, dptr, outLength) != NULL)
+    {
+      if(dec.problem == TRUE)
+        decodedChars = -2;
+      else
+        decodedChars = outLength;
+    }
+    else
+      E(DBF_MIME, "error on copying data!");
+
+    // in case the dptr buffer was allocated by codesets.library,
+    // we have to free it now
+    if(dptr != outbuffer)
+      CodesetsFreeA(dptr, NULL);
+
+    free(outbuffer);
+  }
+
+  RETURN(decodedChars);
+  return decodedChars;
+}
+
+///
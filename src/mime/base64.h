@@ -36,11 +36,40 @@ struct codeset;
 // static variables
 static const char basis_64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
+// state of a streaming base64 encoder
+struct B64Encoder
+{
+  unsigned char rest[3];  // bytes not yet forming a complete group
+  int restLen;            // number of bytes in rest[]
+  int column;             // current column of the output line
+  long encoded;           // number of encoded characters without line breaks
+};
+
+// state of a streaming base64 decoder
+struct B64Decoder
+{
+  ULONG bits;             // bits of the current quantum
+  int count;              // number of characters in the current quantum
+  BOOL problem;           // invalid characters or an incomplete quantum found
+};
+
+// maximum output sizes of the streaming routines for 'len' input bytes
+#define B64ENC_OUTLEN(len)  ((((len)+2)/3)*4 + (((len)+2)/3)*4/72 + 8)
+#define B64DEC_OUTLEN(len)  (((len)/4)*3 + 8)
+
 // base64 encoding/decoding routines
 int base64encode(char **out, const char *in, size_t inlen);
 int base64decode(char **out, const char *in, size_t inlen);
+void base64encode_init(struct B64Encoder *enc);
+size_t base64encode_stream(struct B64Encoder *enc, char *out, const char *in, size_t inlen);
+size_t base64encode_finish(struct B64Encoder *enc, char *out);
+void base64decode_init(struct B64Decoder *dec);
+size_t base64decode_stream(struct B64Decoder *dec, char *out, const char *in, size_t inlen);
+size_t base64decode_finish(struct B64Decoder *dec, char *out);
 long base64encode_file(FILE *in, FILE *out, BOOL convLF);
 long base64decode_file(FILE *in, FILE *out,
                        struct codeset *srcCodeset, BOOL isText, BOOL convCRLF);
+long base64decode_buffer(char **out, const char *in, size_t inlen,
+                         struct codeset *srcCodeset, BOOL isText, BOOL convCRLF);
 
 #endif // BASE64_H
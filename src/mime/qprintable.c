@@ -37,6 +37,7 @@
 #include "mime/qprintable.h"
 
 #include "Config.h"
+#include "DynamicString.h"
 
 #include "Debug.h"
 
@@ -224,275 +225,301 @@ long qpencode_file(FILE *in, FILE *out)
 }
 
 ///
-/// qpdecode_file()
-// Decodes a whole file using the quoted-printable format defined in
-// RFC 2045 (page 19)
-long qpdecode_file(FILE *in, FILE *out, struct codeset *srcCodeset, BOOL isText)
+/// qpdecode_init()
+// initializes a streaming quoted-printable decoder
+void qpdecode_init(struct QPDecoder *dec)
 {
-  unsigned char inbuffer[QPDEC_BUF+1]; // lets use a 4096 byte large input buffer
-  unsigned char outbuffer[QPDEC_BUF+1];// to speed things up we use the same amount
-                                       // of memory for an output buffer as the
-                                       // decoded string can't be larger than
-                                       // the encoded one.
+  dec->state = QPDEC_TEXT;
+  dec->hex = 0;
+  dec->decoded = 0;
+  dec->result = 0;
+}
 
-  unsigned char *iptr;
-  unsigned char *optr = outbuffer;
-  unsigned char c;
-  size_t read = 0;
-  size_t next_unget = 0;
-  long decoded = 0;
-  int result = 0;
-  BOOL eof_reached = FALSE;
+///
+/// qpdecode_stream()
+// decodes an arbitrary chunk of quoted-printable data in a single pass.
+// An encoded sequence or a CR which is split across two chunks is kept in
+// the decoder state until the next call. Like suggested by RFC 2045 the
+// decoding is continued even if invalid data is found, but the problem is
+// remembered. 'out' must be able to hold QPDEC_OUTLEN(inlen) bytes.
+// Returns the number of bytes placed in 'out'.
+size_t qpdecode_stream(struct QPDecoder *dec, char *out, const char *in, size_t inlen)
+{
+  const unsigned char *iptr = (const unsigned char *)in;
+  const unsigned char *iend = iptr+inlen;
+  unsigned char *optr = (unsigned char *)out;
+  int state = dec->state;
 
   ENTER();
 
-  D(DBF_MIME, "codeset '%s'", srcCodeset != NULL ? srcCodeset->name : "none");
-
-  while(eof_reached == FALSE)
+  while(iptr < iend)
   {
-    // do a binary read of ~4096 chunks
-    read = fread(&inbuffer[next_unget], sizeof(char), QPDEC_BUF-next_unget, in);
+    unsigned char c = *iptr++;
 
-    // on a short item count we check for a potential
-    // error and return immediatly.
-    if(read != QPDEC_BUF-next_unget)
+    switch(state)
     {
-      if(feof(in) != 0)
+      case QPDEC_TEXT:
       {
-        D(DBF_MIME, "EOF file at %ld", ftell(in));
+        // copy a whole run of plain chars at once
+        while(c != '=' && c != '\r' && isascii(c))
+        {
+          *optr++ = c;
 
-        eof_reached = TRUE; // we found an EOF
+          if(iptr == iend)
+            break;
 
-        // if the last read was zero we can exit immediatly
-        if(read == 0 && next_unget == 0)
-          break;
-      }
-      else
-      {
-        E(DBF_MIME, "error on reading data!");
+          c = *iptr++;
+        }
 
-        // an error occurred, lets return -1
-        RETURN(-1);
-        return -1;
+        if(c == '=')
+          state = QPDEC_EQUAL;
+        else if(c == '\r')
+          state = QPDEC_CR;
+        else if(!isascii(c))
+        {
+          // we found some not allowed char, so lets ignore it
+          // but warn the user
+          W(DBF_MIME, "nonallowed character '%lc' (%02lx) found", c, c);
+          dec->result = -4; // indicate a "unallowed control chars" warning
+        }
       }
-    }
-
-    // increase/reset the counters
-    read += next_unget;
-    next_unget = 0;
-
-    // now that we have read in our buffer we have to parse through
-    // it and decode eventually existing quoted printable encoded
-    // chunks. The routines also analyze the data and returns an
-    // error if non quoted-printable safe data is found, however
-    // it still tries to decode the data until the end. This fail-safe
-    // behaviour is suggested in RFC 2045 on page 22.
-    iptr = inbuffer;
-
-    while(read != 0)
-    {
-      c = *iptr++;
-      read--;
+      break;
 
-      if(c == '=')
+      case QPDEC_EQUAL:
       {
-        // check if the next char is a newline so that
-        // we can skip the current =
-        if(read != 0 && *iptr == '\n')
+        // a newline right after the '=' is a soft line break
+        if(c == '\n')
+          state = QPDEC_TEXT;
+        else
         {
-          // skip the newline..
-          iptr++;
-          read--;
-
-          continue;
+          dec->hex = c;
+          state = QPDEC_EQUAL_HEX;
         }
+      }
+      break;
+
+      case QPDEC_EQUAL_HEX:
+      {
+        unsigned char c1 = hexchar(dec->hex);
+        unsigned char c2 = hexchar(c);
 
-        // a '=' is the sign that a encoded string is following, so
-        // let us check if we have enough space in our input buffer
-        // and then decode it accordingly
-        if(read >= 2)
+        // check if the two chars are really hexadecimal chars
+        if(c1 != 255 && c2 != 255)
         {
-          unsigned char c1 = hexchar(*iptr);
-          unsigned char c2 = hexchar(*(iptr+1));
-
-          // so we have enough space, lets decode it, but let us
-          // check if the two chars are really hexadecimal chars
-          if(c1 != 255 && c2 != 255)
-          {
-            *optr++ = c1<<4 | c2;
-
-            // increase the counters
-            iptr += 2;
-            read -= 2;
-
-            // count the decoded chars
-            decoded++;
-          }
-          else
-          {
-            // as suggested by RFC 2045 we keep the =XX sequence
-            // and report a warning later to the user
-            *optr++ = c;
-            *optr++ = *iptr++;
-            *optr++ = *iptr++;
-            read -= 2;
-            result = -3; // indicate a "decoding warning"
-          }
+          *optr++ = c1<<4 | c2;
+
+          // count the decoded chars
+          dec->decoded++;
         }
         else
         {
-          // ok, there isn't enough space in the input buffer
-          // so we break out here and parse the stuff on
-          // the next iteration
-          next_unget = read+1;
-          memcpy(inbuffer, iptr-1, next_unget);
-
-          break;
+          // as suggested by RFC 2045 we keep the =XX sequence
+          // and report a warning later to the user
+          *optr++ = '=';
+          *optr++ = dec->hex;
+          *optr++ = c;
+          dec->result = -3; // indicate a "decoding warning"
         }
+
+        state = QPDEC_TEXT;
       }
-      else if(!isascii(c) ||
-              (is_ctrl(c) && c != '\t' && c != '\n' &&
-               c == '\r' && *iptr != '\n'))
-      {
-        // we found some not allowed char, so lets ignore it
-        // but warn the user
-        W(DBF_MIME, "nonallowed character '%lc' (%02lx) found", c, c);
-        result = -4; // indicate a "unallowed control chars" warning
-      }
-      else
-      {
-        // the current char seems to be a normal
-        // char, so lets output it
-        *optr++ = c;
-      }
+      break;
 
-      // let us now check if our outbuffer is filled up so that we can write
-      // out the data to our out stream.
-      if(optr-outbuffer >= QPDEC_BUF)
+      case QPDEC_CR:
       {
-        unsigned char *dptr = outbuffer;
-        size_t todo = optr-outbuffer;
-
-        // in case the user wants us to detect the correct cyrillic codeset
-        // we do it now
-        if(C->DetectCyrillic == TRUE && isText == TRUE)
+        // only a CR which is part of a CRLF is allowed
+        if(c == '\n')
         {
-          if(srcCodeset == NULL || (srcCodeset->name != NULL && stricmp(srcCodeset->name, "utf-8") != 0))
-          {
-            struct codeset *cs = CodesetsFindBest(CSA_Source,         dptr,
-                                                  CSA_SourceLen,      todo,
-                                                  CSA_CodesetFamily,  CSV_CodesetFamily_Cyrillic,
-                                                  TAG_DONE);
-
-            if(cs != NULL && cs != srcCodeset)
-            {
-              D(DBF_MIME, "using codeset '%s' instead of '%s'", srcCodeset != NULL ? srcCodeset->name : "none", cs->name);
-              srcCodeset = cs;
-            }
-          }
+          *optr++ = '\r';
+          *optr++ = '\n';
+          state = QPDEC_TEXT;
         }
-
-        // if the caller supplied a source codeset, we have to
-        // make sure we convert our outbuffer before writing it out
-        // to the file in UTF8, but we must not touch binary/non-text data
-        if(isText == TRUE && srcCodeset != NULL && stricmp(srcCodeset->name, "utf-8") != 0)
+        else
         {
-          ULONG strLen = 0;
-
-          UTF8 *str = CodesetsUTF8Create(CSA_Source,          dptr,
-                                         CSA_SourceLen,       todo,
-                                         CSA_SourceCodeset,   srcCodeset,
-                                         CSA_DestLenPtr,      &strLen,
-                                         TAG_DONE);
-
-          if(str != NULL && strLen > 0)
-          {
-            // if we end up here we successfully converted the
-            // sourcebuffer to a destination buffer which complies to our local
-            // charset
-            dptr = (unsigned char *)str;
-            todo = strLen;
-          }
-          else
-            W(DBF_MIME, "error while trying to convert qpdecoded string to UTF8");
+          W(DBF_MIME, "nonallowed character '%lc' (%02lx) found", '\r', '\r');
+          dec->result = -4; // indicate a "unallowed control chars" warning
+
+          // process the current char again as normal text
+          iptr--;
+          state = QPDEC_TEXT;
         }
+      }
+      break;
+    }
+  }
 
-        // now we do a binary write of the data
-        if(fwrite(dptr, 1, todo, out) != todo)
-        {
-          E(DBF_MIME, "error on writing data!");
+  dec->state = state;
 
-          // in case the dptr buffer was allocated by codesets.library,
-          // we have to free it now
-          if(dptr != outbuffer)
-            CodesetsFreeA(dptr, NULL);
+  RETURN((size_t)(optr-(unsigned char *)out));
+  return (size_t)(optr-(unsigned char *)out);
+}
 
-          // an error must have occurred.
-          RETURN(-1);
-          return -1;
-        }
+///
+/// qpdecode_finish()
+// finishes a streaming quoted-printable decoder and places a CR which
+// might still be pending at the very end in 'out'. Returns the number of
+// bytes placed in 'out'
+size_t qpdecode_finish(struct QPDecoder *dec, char *out)
+{
+  size_t len = 0;
 
-        // in case the dptr buffer was allocated by codesets.library,
-        // we have to free it now
-        if(dptr != outbuffer)
-          CodesetsFreeA(dptr, NULL);
+  ENTER();
 
-        // now reset the outbuffer and stuff
-        optr = outbuffer;
-      }
+  switch(dec->state)
+  {
+    case QPDEC_TEXT:
+      // nothing
+    break;
+
+    case QPDEC_CR:
+    {
+      out[len++] = '\r';
     }
+    break;
+
+    case QPDEC_EQUAL:
+    case QPDEC_EQUAL_HEX:
+    {
+      // the data ended within an encoded char
+      W(DBF_MIME, "unfinished quoted-printable sequence at end of data");
+      dec->result = -2; // -2 means "unfinished decoding"
+    }
+    break;
   }
 
-  // check if there is something in the outbuffer that
-  // hasn't been written out yet
-  if(optr-outbuffer > 0)
+  dec->state = QPDEC_TEXT;
+
+  RETURN(len);
+  return len;
+}
+
+///
+/// qpdecode_result()
+// returns the final result of a streaming quoted-printable decoder, which
+// is either the number of decoded chars or a negative error code
+static long qpdecode_result(const struct QPDecoder *dec)
+{
+  return dec->result == 0 ? dec->decoded : dec->result;
+}
+
+///
+/// convertToUTF8()
+// converts decoded text from the source codeset to UTF8, but binary/non-text
+// data is never touched. Returns either 'data' or a buffer allocated by
+// codesets.library which has to be freed by CodesetsFreeA()
+static char *convertToUTF8(char *data, size_t *len, struct codeset **srcCodeset, BOOL isText)
+{
+  char *result = data;
+
+  ENTER();
+
+  if(isText == TRUE && *len > 0)
   {
-    unsigned char *dptr = outbuffer;
-    size_t todo = optr-outbuffer;
+    struct codeset *cs = *srcCodeset;
 
     // in case the user wants us to detect the correct cyrillic codeset
     // we do it now
-    if(C->DetectCyrillic == TRUE && isText == TRUE)
+    if(C->DetectCyrillic == TRUE)
     {
-      if(srcCodeset == NULL || (srcCodeset->name != NULL && stricmp(srcCodeset->name, "utf-8") != 0))
+      if(cs == NULL || (cs->name != NULL && stricmp(cs->name, "utf-8") != 0))
       {
-        struct codeset *cs = CodesetsFindBest(CSA_Source,         dptr,
-                                              CSA_SourceLen,      todo,
-                                              CSA_CodesetFamily,  CSV_CodesetFamily_Cyrillic,
-                                              TAG_DONE);
+        struct codeset *best = CodesetsFindBest(CSA_Source,         data,
+                                                CSA_SourceLen,      *len,
+                                                CSA_CodesetFamily,  CSV_CodesetFamily_Cyrillic,
+                                                TAG_DONE);
 
-        if(cs != NULL && cs != srcCodeset)
+        if(best != NULL && best != cs)
         {
-          D(DBF_MIME, "using codeset '%s' instead of '%s'", srcCodeset != NULL ? srcCodeset->name : "none", cs->name);
-          srcCodeset = cs;
+          D(DBF_MIME, "using codeset '%s' instead of '%s'", cs != NULL ? cs->name : "none", best->name);
+          cs = best;
+          *srcCodeset = cs;
         }
       }
     }
 
     // if the caller supplied a source codeset, we have to
-    // make sure we convert our outbuffer before writing it out
-    // to the file in UTF8, but we must not touch binary/non-text data
-    if(isText == TRUE && srcCodeset != NULL && stricmp(srcCodeset->name, "utf-8") != 0)
+    // make sure we convert our outbuffer to UTF8
+    if(cs != NULL && stricmp(cs->name, "utf-8") != 0)
     {
       ULONG strLen = 0;
 
-      UTF8 *str = CodesetsUTF8Create(CSA_Source,          dptr,
-                                     CSA_SourceLen,       todo,
-                                     CSA_SourceCodeset,   srcCodeset,
+      UTF8 *str = CodesetsUTF8Create(CSA_Source,          data,
+                                     CSA_SourceLen,       *len,
+                                     CSA_SourceCodeset,   cs,
                                      CSA_DestLenPtr,      &strLen,
                                      TAG_DONE);
 
       if(str != NULL && strLen > 0)
       {
-        // if we end up here we successfully converted the
-        // sourcebuffer to a destination buffer which complies to our local
-        // charset
-        dptr = (unsigned char *)str;
-        todo = strLen;
+        result = (char *)str;
+        *len = strLen;
       }
       else
         W(DBF_MIME, "error while trying to convert qpdecoded string to UTF8");
     }
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// qpdecode_file()
+// Decodes a whole file using the quoted-printable format defined in
+// RFC 2045 (page 19)
+long qpdecode_file(FILE *in, FILE *out, struct codeset *srcCodeset, BOOL isText)
+{
+  char inbuffer[QPDEC_BUF];
+  char outbuffer[QPDEC_OUTLEN(QPDEC_BUF)];
+  struct QPDecoder dec;
+  BOOL eof_reached = FALSE;
+
+  ENTER();
+
+  D(DBF_MIME, "codeset '%s'", srcCodeset != NULL ? srcCodeset->name : "none");
+
+  qpdecode_init(&dec);
+
+  while(eof_reached == FALSE)
+  {
+    size_t read;
+    size_t todo;
+    char *dptr;
+
+    // do a binary read of ~4096 chunks
+    read = fread(inbuffer, sizeof(char), sizeof(inbuffer), in);
+
+    // on a short item count we check for a potential
+    // error and return immediatly.
+    if(read != sizeof(inbuffer))
+    {
+      if(feof(in) != 0)
+      {
+        D(DBF_MIME, "EOF file at %ld", ftell(in));
+
+        eof_reached = TRUE; // we found an EOF
+      }
+      else
+      {
+        E(DBF_MIME, "error on reading data!");
+
+        // an error occurred, lets return -1
+        RETURN(-1);
+        return -1;
+      }
+    }
+
+    // decode the chunk, encoded chars crossing the chunk
+    // boundary are handled by the decoder itself
+    todo = qpdecode_stream(&dec, outbuffer, inbuffer, read);
+
+    if(eof_reached == TRUE)
+      todo += qpdecode_finish(&dec, &outbuffer[todo]);
+
+    if(todo == 0)
+      continue;
+
+    dptr = convertToUTF8(outbuffer, &todo, &srcCodeset, isText);
 
     // now we do a binary write of the data
     if(fwrite(dptr, 1, todo, out) != todo)
@@ -515,18 +542,54 @@ long qpdecode_file(FILE *in, FILE *out, struct codeset *srcCodeset, BOOL isText)
       CodesetsFreeA(dptr, NULL);
   }
 
-  // if we end up here and read > 0 then the decoding wasn't finished
-  // and we have to return an error
-  if(read > 0)
+  // on success lets return the number of decoded
+  // chars
+  RETURN(qpdecode_result(&dec));
+  return qpdecode_result(&dec);
+}
+
+///
+/// qpdecode_buffer()
+// Decodes a memory buffer using the quoted-printable format defined in
+// RFC 2045 (page 19) and places the result in the dynamic string 'out'.
+// The return values are the same as for qpdecode_file()
+long qpdecode_buffer(char **out, const char *in, size_t inlen, struct codeset *srcCodeset, BOOL isText)
+{
+  char *outbuffer;
+  long result = -1;
+
+  ENTER();
+
+  D(DBF_MIME, "codeset '%s'", srcCodeset != NULL ? srcCodeset->name : "none");
+
+  if((outbuffer = malloc(QPDEC_OUTLEN(inlen))) != NULL)
   {
-    RETURN(-2);
-    return -2; // -2 means "unfinished decoding"
+    struct QPDecoder dec;
+    size_t todo;
+    char *dptr;
+
+    qpdecode_init(&dec);
+
+    todo = qpdecode_stream(&dec, outbuffer, in, inlen);
+    todo += qpdecode_finish(&dec, &outbuffer[todo]);
+
+    dptr = convertToUTF8(outbuffer, &todo, &srcCodeset, isText);
+
+    if(dstrmemcpy(out, dptr, todo) != NULL)
+      result = qpdecode_result(&dec);
+    else
+      E(DBF_MIME, "error on copying data!");
+
+    // in case the dptr buffer was allocated by codesets.library,
+    // we have to free it now
+    if(dptr != outbuffer)
+      CodesetsFreeA(dptr, NULL);
+
+    free(outbuffer);
   }
 
-  // on success lets return the number of decoded
-  // chars
-  RETURN(result == 0 ? decoded : result);
-  return result == 0 ? decoded : result;
+  RETURN(result);
+  return result;
 }
 
 ///
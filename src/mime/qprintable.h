@@ -33,9 +33,34 @@
 // forward declarations
 struct codeset;
 
+// states of a streaming quoted-printable decoder
+enum QPDecoderState
+{
+  QPDEC_TEXT=0,     // plain text
+  QPDEC_EQUAL,      // a '=' was found
+  QPDEC_EQUAL_HEX,  // a '=' and the first hex char were found
+  QPDEC_CR          // a CR was found
+};
+
+// state of a streaming quoted-printable decoder
+struct QPDecoder
+{
+  enum QPDecoderState state;
+  unsigned char hex;  // first hex char of an encoded sequence
+  long decoded;       // number of decoded '=XX' sequences
+  int result;         // 0 or the last negative warning code
+};
+
+// maximum output size of the streaming decoder for 'len' input bytes
+#define QPDEC_OUTLEN(len)  ((len)+4)
+
 // quoted-printable encoding/decoding routines
 long qpencode_file(FILE *in, FILE *out);
+void qpdecode_init(struct QPDecoder *dec);
+size_t qpdecode_stream(struct QPDecoder *dec, char *out, const char *in, size_t inlen);
+size_t qpdecode_finish(struct QPDecoder *dec, char *out);
 long qpdecode_file(FILE *in, FILE *out, struct codeset *srcCodeset, BOOL isText);
+long qpdecode_buffer(char **out, const char *in, size_t inlen, struct codeset *srcCodeset, BOOL isText);
 
 // macros & static variables
 static const char basis_hex[] = "0123456789ABCDEF";
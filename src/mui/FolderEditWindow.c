@@ -269,6 +269,9 @@ static BOOL SaveOldFolder(struct IClass *cl, Object *obj)
         result = MUI_Request(_app(obj), obj, MUIF_NONE, NULL, tr(MSG_YesNoReq), tr(MSG_FO_MOVEFOLDERTO), data->oldFolder->Fullpath, folder.Fullpath);
         if(result == 1)
         {
+          // stop loading the index from the old place
+          MA_CancelIndexPreload(data->oldFolder);
+
           // first unload the old folder image to make it moveable/deletable
           FO_UnloadFolderImage(data->oldFolder);
 
@@ -1025,8 +1028,8 @@ DECLARE(MLAutoDetect)
     {
       #define SCANMSGS  5
       struct MailNode *mnode;
-      char *toPattern;
-      char *toAddress;
+      const char *toPattern;
+      const char *toAddress;
       char *res = NULL;
       BOOL takePattern = TRUE;
       BOOL takeAddress = TRUE;
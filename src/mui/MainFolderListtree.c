@@ -1014,6 +1014,7 @@ DECLARE(DeleteFolder)
         }
 
         delete_folder = TRUE;
+        MA_CancelIndexPreload(folder);
         DeleteMailDir(folder->Fullpath, FALSE);
       }
     }
@@ -52,6 +52,7 @@
 #include "Config.h"
 #include "Locale.h"
 #include "MailList.h"
+#include "MailSort.h"
 #include "MUIObjects.h"
 #include "Themes.h"
 
@@ -70,6 +71,7 @@ struct Data
   char sizeBuffer[SIZE_SMALL];
   char context_menu_title[SIZE_DEFAULT];
   BOOL inSearchWindow;
+  BOOL skipCompare;
   LONG helpEntry;
 };
 */
@@ -83,6 +85,58 @@ struct Data
 */
 
 /* Private Functions */
+/// GetStatusSortValue
+//  Calculates the value of a message's status for sorting
+static int GetStatusSortValue(const struct Mail *mail)
+{
+  int status = 0;
+
+  // We do not sort on other things than the real status and the Importance+Marked flag of
+  // the message because this would be confusing if you use "Status" as a sorting
+  // criteria within the folder config. Why should a MultiPart mail be sorted with
+  // other multipart messages? It`s more important to sort just for New/Unread/Read aso
+  // and then be able to sort as a second criteria for the date. Sorting the message
+  // depending on other stuff than importance will make it impossible to sort for
+  // status+date in the folder config. Perhaps we need to have a configuable way for
+  // sorting by status later, but this is future stuff..
+  status += hasStatusNew(mail) ? 512 : 0;
+  status += !hasStatusRead(mail) ? 256 : 0;
+  status += !hasStatusError(mail) ? 256 : 0;
+  status += hasStatusReplied(mail) ? 64 : 0;
+  status += hasStatusForwarded(mail) ? 32 : 0;
+  status += hasStatusSent(mail) ? 32 : 0;
+  status += hasStatusMarked(mail) ? 8  : 0;
+  status += (getImportanceLevel(mail) == IMP_HIGH) ? 16 : 0;
+
+  return status;
+}
+
+///
+/// GetSenderSortName
+//  Returns the name of a message's sender (or recipient for sent messages) for sorting
+static const char *GetSenderSortName(const struct Mail *mail)
+{
+  const struct MailPerson *pe = isSentMailFolder(mail->Folder) ? &mail->To : &mail->From;
+  const char *name = NULL;
+
+  // in case the user wants to take the additional pain
+  // of performing an addressbook lookup for every entry in the
+  // list we do it right here.
+  if(C->ABookLookup == TRUE)
+  {
+    struct ABookNode *abn;
+
+    if((abn = FindAddressInABook(&G->abook, pe->Address)) != NULL && abn->RealName[0] != '\0')
+      name = abn->RealName;
+  }
+
+  if(name == NULL)
+    name = AddrName(*pe);
+
+  return name;
+}
+
+///
 /// MailCompare
 //  Compares two messages
 static int MailCompare(struct Mail *entry1, struct Mail *entry2, LONG column)
@@ -91,82 +145,13 @@ static int MailCompare(struct Mail *entry1, struct Mail *entry2, LONG column)
   {
     case 0:
     {
-      // lets calculate each value
-      int status1 = 0;
-      int status2 = 0;
-
-      // We do not sort on other things than the real status and the Importance+Marked flag of
-      // the message because this would be confusing if you use "Status" as a sorting
-      // criteria within the folder config. Why should a MultiPart mail be sorted with
-      // other multipart messages? It`s more important to sort just for New/Unread/Read aso
-      // and then be able to sort as a second criteria for the date. Sorting the message
-      // depending on other stuff than importance will make it impossible to sort for
-      // status+date in the folder config. Perhaps we need to have a configuable way for
-      // sorting by status later, but this is future stuff..
-      status1 += hasStatusNew(entry1) ? 512 : 0;
-      status2 += hasStatusNew(entry2) ? 512 : 0;
-      status1 += !hasStatusRead(entry1) ? 256 : 0;
-      status2 += !hasStatusRead(entry2) ? 256 : 0;
-      status1 += !hasStatusError(entry1) ? 256 : 0;
-      status2 += !hasStatusError(entry2) ? 256 : 0;
-      status1 += hasStatusReplied(entry1) ? 64 : 0;
-      status2 += hasStatusReplied(entry2) ? 64 : 0;
-      status1 += hasStatusForwarded(entry1) ? 32 : 0;
-      status2 += hasStatusForwarded(entry2) ? 32 : 0;
-      status1 += hasStatusSent(entry1) ? 32 : 0;
-      status2 += hasStatusSent(entry2) ? 32 : 0;
-      status1 += hasStatusMarked(entry1) ? 8  : 0;
-      status2 += hasStatusMarked(entry2) ? 8  : 0;
-      status1 += (getImportanceLevel(entry1) == IMP_HIGH) ? 16 : 0;
-      status2 += (getImportanceLevel(entry2) == IMP_HIGH) ? 16 : 0;
-
-      return -(status1)+(status2);
+      return -GetStatusSortValue(entry1)+GetStatusSortValue(entry2);
     }
     break;
 
     case 1:
     {
-      struct Person *pe1;
-      struct Person *pe2;
-      char *addr1;
-      char *addr2;
-
-      if(isSentMailFolder(entry1->Folder))
-      {
-        pe1 = &entry1->To;
-        pe2 = &entry2->To;
-      }
-      else
-      {
-        pe1 = &entry1->From;
-        pe2 = &entry2->From;
-      }
-
-      // in case the user wants to take the additional pain
-      // of performing an addressbook lookup for every entry in the
-      // list we do it right here.
-      if(C->ABookLookup == TRUE)
-      {
-        struct ABookNode *abn1;
-        struct ABookNode *abn2;
-
-        if((abn1 = FindPersonInABook(&G->abook, pe1)) != NULL)
-          addr1 = abn1->RealName[0] != '\0' ? abn1->RealName : AddrName(*pe1);
-        else
-          addr1 = AddrName(*pe1);
-
-        if((abn2 = FindPersonInABook(&G->abook, pe2)) != NULL)
-          addr2 = abn2->RealName[0] != '\0' ? abn2->RealName : AddrName(*pe2);
-        else
-          addr2 = AddrName(*pe2);
-      }
-      else
-      {
-        addr1 = AddrName(*pe1);
-        addr2 = AddrName(*pe2);
-      }
-
-      return stricmp(addr1, addr2);
+      return stricmp(GetSenderSortName(entry1), GetSenderSortName(entry2));
     }
     break;
 
@@ -222,6 +207,246 @@ static int MailCompare(struct Mail *entry1, struct Mail *entry2, LONG column)
   return 0;
 }
 
+///
+/// GetMailSortKey
+//  Calculates the sort key of a message for a column, comparing the keys
+//  must result in the same order as MailCompare()
+static enum MailSortKeyType GetMailSortKey(const struct Mail *mail, LONG column, struct MailSortKey *key)
+{
+  enum MailSortKeyType type = MSK_NUMBER;
+
+  key->hi = 0;
+  key->lo = 0;
+  key->text = NULL;
+
+  switch(column)
+  {
+    case 0:
+    {
+      // higher status values come first
+      key->hi = 0x10000 - GetStatusSortValue(mail);
+    }
+    break;
+
+    case 1:
+    {
+      SetMailSortText(key, GetSenderSortName(mail), TRUE);
+      type = MSK_TEXT_NOCASE;
+    }
+    break;
+
+    case 2:
+    {
+      SetMailSortText(key, AddrName(mail->ReplyTo), TRUE);
+      type = MSK_TEXT_NOCASE;
+    }
+    break;
+
+    case 3:
+    {
+      SetMailSortText(key, MA_GetRealSubject(mail->Subject), TRUE);
+      type = MSK_TEXT_NOCASE;
+    }
+    break;
+
+    case 4:
+    {
+      key->hi = mail->Date.ds_Days;
+      key->lo = mail->Date.ds_Minute * 60 * TICKS_PER_SECOND + mail->Date.ds_Tick;
+    }
+    break;
+
+    case 5:
+    {
+      // flip the sign bit to get the order of signed values
+      key->hi = (ULONG)mail->Size ^ 0x80000000UL;
+    }
+    break;
+
+    case 6:
+    {
+      SetMailSortText(key, mail->MailFile, FALSE);
+      type = MSK_TEXT;
+    }
+    break;
+
+    case 7:
+    {
+      key->hi = mail->transDate.Seconds;
+      key->lo = mail->transDate.Microseconds;
+    }
+    break;
+
+    case 8:
+    {
+      SetMailSortText(key, mail->MailAccount, TRUE);
+      type = MSK_TEXT_NOCASE;
+    }
+    break;
+
+    case 9:
+    {
+      SetMailSortText(key, mail->Folder->Name, TRUE);
+      type = MSK_TEXT_NOCASE;
+    }
+    break;
+  }
+
+  return type;
+}
+
+///
+/// SortMails
+//  Sorts an array of messages according to the current sort order of the
+//  list. Instead of letting NList call our compare method for every single
+//  comparison the sort keys are calculated once for each message and the
+//  array is sorted by several threads for large folders. The original
+//  position of each message is stored in the optional 'position' array.
+static BOOL SortMails(Object *obj, struct Mail **mails, ULONG numMails, ULONG *position)
+{
+  LONG sortType1 = xget(obj, MUIA_NList_SortType);
+  LONG sortType2 = xget(obj, MUIA_NList_SortType2);
+  struct MailSortEntry *entries;
+  struct MailSortEntry **sorted;
+  BOOL result = FALSE;
+
+  ENTER();
+
+  entries = calloc(numMails, sizeof(*entries));
+  sorted = calloc(numMails, sizeof(*sorted));
+
+  if(entries != NULL && sorted != NULL)
+  {
+    LONG col1 = sortType1 & MUIV_NList_TitleMark_ColMask;
+    LONG col2 = sortType2 & MUIV_NList_TitleMark2_ColMask;
+    struct MailSortOrder order;
+    ULONG i;
+
+    // the secondary column is used only if it differs from the primary one
+    order.numKeys = (sortType1 == (LONG)MUIV_NList_SortType_None) ? 0 : (col1 == col2) ? 1 : 2;
+    order.reverse[0] = isFlagSet(sortType1, MUIV_NList_TitleMark_TypeMask);
+    order.reverse[1] = isFlagSet(sortType2, MUIV_NList_TitleMark2_TypeMask);
+
+    for(i=0; i < numMails; i++)
+    {
+      struct MailSortEntry *entry = &entries[i];
+
+      entry->mail = mails[i];
+      entry->index = i;
+
+      if(order.numKeys > 0)
+        order.type[0] = GetMailSortKey(mails[i], col1, &entry->key[0]);
+      if(order.numKeys > 1)
+        order.type[1] = GetMailSortKey(mails[i], col2, &entry->key[1]);
+
+      sorted[i] = entry;
+    }
+
+    if(order.numKeys == 0 || SortMailEntries(sorted, numMails, &order) == TRUE)
+    {
+      for(i=0; i < numMails; i++)
+      {
+        mails[i] = sorted[i]->mail;
+
+        if(position != NULL)
+          position[i] = sorted[i]->index;
+      }
+
+      result = TRUE;
+    }
+  }
+
+  free(sorted);
+  free(entries);
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// SortEntries
+//  Lets NList update the sort order without any comparisons, then sorts
+//  all entries via SortMails() and puts them back in their new order
+static IPTR SortEntries(struct IClass *cl, Object *obj, Msg msg)
+{
+  GETDATA;
+  ULONG numEntries = xget(obj, MUIA_NList_Entries);
+  struct Mail **mails = NULL;
+  ULONG *position = NULL;
+  BOOL *selected = NULL;
+  LONG active = xget(obj, MUIA_NList_Active);
+  IPTR result;
+  ULONG i;
+
+  ENTER();
+
+  // remember the current order and selection of all entries
+  if(numEntries > 1 &&
+     (mails = calloc(numEntries, sizeof(*mails))) != NULL &&
+     (position = calloc(numEntries, sizeof(*position))) != NULL &&
+     (selected = calloc(numEntries, sizeof(*selected))) != NULL)
+  {
+    for(i=0; i < numEntries; i++)
+    {
+      LONG state = MUIV_NList_Select_Off;
+
+      DoMethod(obj, MUIM_NList_GetEntry, i, &mails[i]);
+      DoMethod(obj, MUIM_NList_Select, i, MUIV_NList_Select_Ask, &state);
+      selected[i] = (state == MUIV_NList_Select_On);
+    }
+
+    // NList may change the sort order now, but it doesn't need to
+    // compare anything as we will sort the entries ourself afterwards
+    data->skipCompare = TRUE;
+  }
+
+  set(obj, MUIA_NList_Quiet, TRUE);
+
+  result = DoSuperMethodA(cl, obj, msg);
+
+  if(data->skipCompare == TRUE)
+  {
+    data->skipCompare = FALSE;
+
+    if(SortMails(obj, mails, numEntries, position) == TRUE)
+    {
+      LONG newActive = MUIV_NList_Active_Off;
+
+      for(i=0; i < numEntries; i++)
+      {
+        LONG state = MUIV_NList_Select_Off;
+
+        DoMethod(obj, MUIM_NList_ReplaceSingle, mails[i], i, NOWRAP, ALIGN_LEFT);
+
+        // restore the selection state of the mail
+        DoMethod(obj, MUIM_NList_Select, i, MUIV_NList_Select_Ask, &state);
+        if((state == MUIV_NList_Select_On) != selected[position[i]])
+          DoMethod(obj, MUIM_NList_Select, i, selected[position[i]] ? MUIV_NList_Select_On : MUIV_NList_Select_Off, NULL);
+
+        if((LONG)position[i] == active)
+          newActive = i;
+      }
+
+      // the active mail itself didn't change, only its position
+      nnset(obj, MUIA_NList_Active, newActive);
+    }
+    else
+    {
+      // we are short of memory, let NList do the sorting
+      DoSuperMethod(cl, obj, MUIM_NList_Sort);
+    }
+  }
+
+  set(obj, MUIA_NList_Quiet, FALSE);
+
+  free(selected);
+  free(position);
+  free(mails);
+
+  RETURN(result);
+  return result;
+}
+
 ///
 
 /* Overloaded Methods */
@@ -378,6 +603,7 @@ OVERLOAD(MUIM_NList_Destruct)
 //  Message listview compare method
 OVERLOAD(MUIM_NList_Compare)
 {
+  GETDATA;
   struct MUIP_NList_Compare *ncm = (struct MUIP_NList_Compare *)msg;
   struct Mail *entry1 = (struct Mail *)ncm->entry1;
   struct Mail *entry2 = (struct Mail *)ncm->entry2;
@@ -387,7 +613,7 @@ OVERLOAD(MUIM_NList_Compare)
 
   ENTER();
 
-  if(ncm->sort_type1 == (LONG)MUIV_NList_SortType_None)
+  if(ncm->sort_type1 == (LONG)MUIV_NList_SortType_None || data->skipCompare == TRUE)
   {
     RETURN(0);
     return 0;
@@ -409,6 +635,27 @@ OVERLOAD(MUIM_NList_Compare)
   return cmp;
 }
 
+///
+/// OVERLOAD(MUIM_NList_Sort)
+OVERLOAD(MUIM_NList_Sort)
+{
+  return SortEntries(cl, obj, msg);
+}
+
+///
+/// OVERLOAD(MUIM_NList_Sort2)
+OVERLOAD(MUIM_NList_Sort2)
+{
+  return SortEntries(cl, obj, msg);
+}
+
+///
+/// OVERLOAD(MUIM_NList_Sort3)
+OVERLOAD(MUIM_NList_Sort3)
+{
+  return SortEntries(cl, obj, msg);
+}
+
 ///
 /// OVERLOAD(MUIM_NList_Display)
 OVERLOAD(MUIM_NList_Display)
@@ -456,8 +703,8 @@ OVERLOAD(MUIM_NList_Display)
       if(hasMColSender(C->MessageCols) || data->inSearchWindow == TRUE)
       {
         BOOL toPrefix = FALSE;
-        struct Person *pe;
-        char *addr = NULL;
+        const struct MailPerson *pe;
+        const char *addr = NULL;
 
         if(((isCustomMixedFolder(mail->Folder) || isTrashFolder(mail->Folder) || isSpamFolder(mail->Folder)) &&
             (hasStatusSent(mail) || hasStatusError(mail))) || (data->inSearchWindow == TRUE && isSentMailFolder(mail->Folder)))
@@ -477,7 +724,7 @@ OVERLOAD(MUIM_NList_Display)
         {
           struct ABookNode *abn;
 
-          if((abn = FindPersonInABook(&G->abook, pe)) != NULL)
+          if((abn = FindAddressInABook(&G->abook, pe->Address)) != NULL)
           {
             if(abn->RealName[0] != '\0')
               addr = abn->RealName;
@@ -512,12 +759,12 @@ OVERLOAD(MUIM_NList_Display)
           ndm->strings[2] = data->replytoBuffer;
         }
         else
-          ndm->strings[2] = AddrName(mail->ReplyTo);
+          ndm->strings[2] = (char *)AddrName(mail->ReplyTo);
       }
 
       // then the Subject
       if(IsStrEmpty(mail->Subject) == FALSE)
-        ndm->strings[3] = mail->Subject;
+        ndm->strings[3] = (char *)mail->Subject;
       else
         ndm->strings[3] = (char *)tr(MSG_MA_NO_SUBJECT);
 
@@ -543,7 +790,7 @@ OVERLOAD(MUIM_NList_Display)
         ndm->strings[7] = data->date2Buffer;
       }
 
-      ndm->strings[8] = mail->MailAccount;
+      ndm->strings[8] = (char *)mail->MailAccount;
 
       // The Folder is just a dummy entry to serve the SearchMailWindow DisplayHook
       ndm->strings[9] = mail->Folder->Name;
@@ -699,7 +946,7 @@ OVERLOAD(MUIM_NList_ContextMenuBuild)
         BOOL isArchive = isArchiveFolder(fo);
         BOOL hasattach = FALSE;
         ULONG numSelected = 0;
-        struct Person *pers = isSentMail ? &mail->To : &mail->From;
+        const struct MailPerson *pers = isSentMail ? &mail->To : &mail->From;
         char address[SIZE_LARGE];
         Object *afterThis;
 
@@ -1203,8 +1450,16 @@ DECLARE(DisplayMailsOfFolder) // struct Folder *folder
     if(folder->Total != 0)
     {
       BOOL jumped = FALSE;
+      LONG insertPos;
+
+      // presort the mails ourself, this is much faster than letting NList
+      // call our compare method for every single comparison
+      if(SortMails(obj, array, folder->Total, NULL) == TRUE)
+        insertPos = MUIV_NList_Insert_Bottom;
+      else
+        insertPos = MUIV_NList_Insert_Sorted;
 
-      DoMethod(obj, MUIM_NList_Insert, array, folder->Total, MUIV_NList_Insert_Sorted,
+      DoMethod(obj, MUIM_NList_Insert, array, folder->Total, insertPos,
                      C->AutoColumnResize ? MUIF_NONE : MUIV_NList_Insert_Flag_Raw);
 
       // Now we jump to messages that are NEW
@@ -159,7 +159,7 @@ static BOOL MatchMail(const struct Mail *mail, enum ViewOptions vo,
     // check if the mail comes from a person we know
     case VO_KNOWNPEOPLE:
     {
-      foundMatch = (FindPersonInABook(&G->abook, &mail->From) != NULL);
+      foundMatch = (FindAddressInABook(&G->abook, mail->From.Address) != NULL);
       if(foundMatch == FALSE && isMultiSenderMail(mail))
       {
         struct ExtendedMail *email;
@@ -1107,7 +1107,7 @@ DECLARE(UpdateHeaderDisplay) // ULONG flags
 {
   GETDATA;
   struct ReadMailData *rmData = data->readMailData;
-  struct Person *from = &rmData->mail->From;
+  const struct MailPerson *from = &rmData->mail->From;
   struct ABookNode *ab = NULL;
   struct ABookNode abtmpl;
   BOOL foundIdentity;
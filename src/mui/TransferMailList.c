@@ -99,8 +99,8 @@ static int MailCompare(struct MailTransferNode *entry1, struct MailTransferNode
     case 3:
     {
       // sender
-      char *addr1 = AddrName(mail1->From);
-      char *addr2 = AddrName(mail2->From);
+      const char *addr1 = AddrName(mail1->From);
+      const char *addr2 = AddrName(mail2->From);
 
       return stricmp(addr1, addr2);
     }
@@ -276,7 +276,7 @@ OVERLOAD(MUIM_NList_Display)
       ndm->strings[4] = data->toBuffer;
 
       // mail subject display
-      ndm->strings[5] = mail->Subject;
+      ndm->strings[5] = (char *)mail->Subject;
 
       // display date
       data->dateBuffer[0] = '\0';
@@ -4273,7 +4273,9 @@ DECLARE(ComposeMail) // enum WriteMode mode, ULONG closeWindow
               // to the emailCache
               if(C->EmailCache > 0)
               {
-                DoMethod(_app(obj), MUIM_YAMApplication_AddToEmailCache, &newMail->To);
+                struct Person pe;
+
+                DoMethod(_app(obj), MUIM_YAMApplication_AddToEmailCache, GetMailPerson(&newMail->To, &pe));
 
                 // if this mail has more than one recipient we have to add the others too
                 if(isMultiRCPTMail(newMail))
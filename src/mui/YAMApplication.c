@@ -65,13 +65,16 @@
 
 #include "AddressBook.h"
 #include "AppIcon.h"
+#include "BodyIndex.h"
 #include "Busy.h"
 #include "Config.h"
+#include "FetchScheduler.h"
 #include "FileInfo.h"
 #include "FolderList.h"
 #include "Locale.h"
 #include "MailList.h"
 #include "MailServers.h"
+#include "MailThreads.h"
 #include "MUIObjects.h"
 #include "UpdateCheck.h"
 #include "Requesters.h"
@@ -368,10 +371,18 @@ static void FlushIndex(struct Folder *folder, time_t minAccessTime)
 {
   ENTER();
 
-  // make sure the folder index is saved
-  if(isModified(folder))
+  // make sure the folder index is saved, this also
+  // compacts a large index journal
+  if(isModified(folder) || needsCompaction(folder))
     MA_SaveIndex(folder);
 
+  // save a modified body index and the threads while the mails are still loaded
+  if(folder != NULL)
+  {
+    BodyIndexFlush(folder);
+    MailThreadsFlush(folder);
+  }
+
   // flush the index if
   // - the index is loaded at all, and
   // - the minimum access time has been exceeded
@@ -390,6 +401,7 @@ static void FlushIndex(struct Folder *folder, time_t minAccessTime)
     {
       folder->LoadedMode = LM_FLUSHED;
       clearFlag(folder->Flags, FOFL_FREEXS);
+      BodyIndexFree(folder);
     }
   }
 
@@ -909,6 +921,19 @@ DECLARE(DisplayStatistics) // struct Folder *folder, ULONG updateAppIcon
   return 0;
 }
 
+///
+/// DECLARE(FinishIndexPreload)
+// take over the mails of a folder whose index was loaded in the background
+DECLARE(FinishIndexPreload) // struct Folder *folder
+{
+  ENTER();
+
+  MA_FinishIndexPreload(msg->folder);
+
+  RETURN(0);
+  return 0;
+}
+
 ///
 /// DECLARE(CreateTransferGroup)
 DECLARE(CreateTransferGroup) // APTR thread, const char *title, struct Connection *connection, ULONG flags
@@ -1268,6 +1293,19 @@ DECLARE(FilterNewMails) // const struct MailList *mailList, struct FilterResult
   return 0;
 }
 
+///
+/// DECLARE(FinishMailFetch)
+// take over the mails of a finished download of the fetch scheduler
+DECLARE(FinishMailFetch) // struct MailServerNode *msn
+{
+  ENTER();
+
+  FinishMailFetch(msg->msn);
+
+  RETURN(0);
+  return 0;
+}
+
 ///
 /// DECLARE(UpdateAppIcon)
 DECLARE(UpdateAppIcon)
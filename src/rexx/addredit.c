@@ -149,6 +149,7 @@ void rx_addredit(UNUSED struct RexxHost *host, struct RexxParams *params, enum R
 
         G->abook.arexxABN = abn;
         G->abook.modified = TRUE;
+        InvalidateABookIndexes();
 
         // update an existing address book window as well
         if(G->ABookWinObject != NULL)
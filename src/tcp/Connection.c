@@ -1566,7 +1566,7 @@ static int ReadFromHost(struct Connection *conn, char *ptr, const int maxlen)
 // a buffered implementation of read()/recv() which is somehow compatible
 // to the I/O fgets() function. It will read out data from the socket in
 // 4096 chunks and store them into a static buffer. This function SHOULD
-// only be called by TCPReceiveLine() and TCPReceive().
+// only be called by ReceiveFromHost(), lines are read by FillLineBuffer().
 //
 // This implementation is a slightly adapted version of readline()/my_read()
 // examples from (W.Richard Stevens - Unix Network Programming) - Page 80
@@ -1620,14 +1620,73 @@ static int ReadFromHostBuffered(struct Connection *conn, char *ptr, const int ma
   return result;
 }
 
+///
+/// FillLineBuffer
+// makes sure the receive buffer contains a complete line (including the
+// terminating LF) at conn->receivePtr and returns its length without consuming
+// it. The line terminator is searched using memchr() on the buffered data only
+// and just the unfinished tail of a line is moved to the beginning of the buffer
+// before more data is read. If a line doesn't fit into the buffer the complete
+// buffer is returned as part of the line. A last line without LF is returned
+// as it is when the connection is closed. Returns 0 on EOF and -1 on an error.
+static int FillLineBuffer(struct Connection *conn)
+{
+  int result = -1;
+
+  ENTER();
+
+  // ReadFromHostBuffered() may leave a negative count after an error
+  if(conn->receiveCount < 0)
+    conn->receiveCount = 0;
+
+  while(TRUE)
+  {
+    char *eol;
+    int nread;
+
+    // check for a complete line in the buffered data
+    if(conn->receiveCount > 0 &&
+       (eol = memchr(conn->receivePtr, '\n', conn->receiveCount)) != NULL)
+    {
+      result = eol - conn->receivePtr + 1;
+      break;
+    }
+
+    // check if the buffer is full without containing a LF
+    if(conn->receiveCount >= conn->receiveBufferSize)
+    {
+      result = conn->receiveCount;
+      break;
+    }
+
+    // move the beginning of the line to the start of the buffer
+    // and append more data
+    if(conn->receiveCount > 0 && conn->receivePtr != conn->receiveBuffer)
+      memmove(conn->receiveBuffer, conn->receivePtr, conn->receiveCount);
+
+    conn->receivePtr = conn->receiveBuffer;
+
+    if((nread = ReadFromHost(conn, &conn->receiveBuffer[conn->receiveCount], conn->receiveBufferSize - conn->receiveCount)) <= 0)
+    {
+      // on EOF hand out the unfinished line, if there is any
+      if(nread == 0)
+        result = conn->receiveCount;
+
+      break;
+    }
+
+    conn->receiveCount += nread;
+  }
+
+  RETURN(result);
+  return result;
+}
+
 ///
 /// ReceiveLineFromHost
-// a buffered version of readline() that reads out charwise from the
-// socket via TCPReadBuffered and returns the amount of chars copied
-// into the provided character array or -1 on error.
-//
-// This implementation is a slightly adapted version of readline()/my_read()
-// examples from (W.Richard Stevens - Unix Network Programming) - Page 80
+// a buffered version of readline() that copies the next line from the
+// receive buffer into the provided character array and returns the amount
+// of chars copied, 0 on EOF or -1 on error.
 int ReceiveLineFromHost(struct Connection *conn, char *vptr, const int maxlen)
 {
   int result = -1;
@@ -1640,41 +1699,21 @@ int ReceiveLineFromHost(struct Connection *conn, char *vptr, const int maxlen)
     if(conn->isConnected == TRUE)
     {
       int n;
-      char *ptr = vptr;
 
       conn->error = CONNECTERR_NO_ERROR;
 
-      for(n = 1; n < maxlen; n++)
+      if((n = FillLineBuffer(conn)) > 0)
       {
-        int rc;
-        char c;
-
-        // read out one buffered char only.
-        rc = ReadFromHostBuffered(conn, &c, 1);
-        if(rc == 1)
-        {
-          *ptr++ = c;
-          if(c == '\n')
-            break;  // newline is stored, like with getline()
-        }
-        else if(rc == 0)
-        {
-          // if n==1 then EOF, no data read
-          // otherwise    EOF, some data was read
-          if(n == 1)
-            n = 0;
+        // copy at most maxlen-1 chars, the rest of an overlong line
+        // will be returned by the next call
+        n = MIN(n, maxlen-1);
 
-          break;
-        }
-        else
-        {
-          // error, errno set by readchar()
-          n = -1;
-          break;
-        }
+        memcpy(vptr, conn->receivePtr, n);
+        conn->receivePtr += n;
+        conn->receiveCount -= n;
       }
 
-      *ptr = '\0'; // null terminate like getline()
+      vptr[n > 0 ? n : 0] = '\0'; // null terminate like getline()
 
       // perform some debug output on the console if requested
       // by the user
@@ -1701,6 +1740,48 @@ int ReceiveLineFromHost(struct Connection *conn, char *vptr, const int maxlen)
   return result;
 }
 
+///
+/// ReceiveLineSpanFromHost
+// returns the next line directly within the receive buffer instead of
+// copying it. The line includes the terminating LF but is not NUL terminated
+// and remains valid until the next receive call for this connection. Lines
+// longer than the receive buffer are returned in several pieces without LF.
+// Returns the length of the line, 0 on EOF or -1 on error.
+int ReceiveLineSpanFromHost(struct Connection *conn, char **line)
+{
+  int result = -1;
+
+  ENTER();
+
+  if(conn != NULL)
+  {
+    // make sure the socket is active.
+    if(conn->isConnected == TRUE)
+    {
+      conn->error = CONNECTERR_NO_ERROR;
+
+      if((result = FillLineBuffer(conn)) > 0)
+      {
+        *line = conn->receivePtr;
+        conn->receivePtr += result;
+        conn->receiveCount -= result;
+
+        if(G->NetLog == TRUE)
+          fprintf(stderr, "SERVER['%s', %04d]: %.*s", conn->server->description, result, result, *line);
+      }
+      else if(G->NetLog == TRUE)
+        fprintf(stderr, "SERVER['%s', %04d]:\n", conn->server->description, result);
+    }
+    else
+    {
+      conn->error = CONNECTERR_NOT_CONNECTED;
+    }
+  }
+
+  RETURN(result);
+  return result;
+}
+
 ///
 /// ReceiveFromHost
 // a own wrapper function for recv()/SSL_read() that reads buffered somehow
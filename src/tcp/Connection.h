@@ -125,6 +125,7 @@ enum ConnectError ConnectToHost(struct Connection *conn, const struct MailServer
 void DisconnectFromHost(struct Connection *conn);
 int ReceiveFromHost(struct Connection *conn, char *vptr, const int maxlen);
 int ReceiveLineFromHost(struct Connection *conn, char *vptr, const int maxlen);
+int ReceiveLineSpanFromHost(struct Connection *conn, char **line);
 int SendToHost(struct Connection *conn, const char *ptr, const int len, const int flags);
 int SendLineToHost(struct Connection *conn, const char *vptr);
 int FlushConnection(struct Connection *conn);
@@ -153,7 +153,7 @@ BOOL ReceiveHTTPBody(struct TransferContext *tc, const char *filename)
       while(tc->connection->error == CONNECTERR_NO_ERROR &&
             (len = tc->receiveFunc(tc->connection, tc->requestResponse, sizeof(tc->requestResponse))) > 0)
       {
-        PushMethodOnStack(tc->transferGroup, 3, MUIM_TransferControlGroup_Update, len, tr(MSG_HTTP_RECEIVING_DATA));
+        PushCoalescedMethodOnStack(tc->transferGroup, MSC_ACCUMULATE, 3, MUIM_TransferControlGroup_Update, len, tr(MSG_HTTP_RECEIVING_DATA));
 
         if(out != NULL && fwrite(tc->requestResponse, len, 1, out) != 1)
         {
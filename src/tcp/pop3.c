@@ -84,7 +84,7 @@ enum POPCommand
   POPCMD_UIDL,
 
   // POP3 extended commands
-  POPCMD_STLS
+  POPCMD_STLS,    POPCMD_CAPA
 };
 
 static const char *const POPcmd[] =
@@ -95,16 +95,54 @@ static const char *const POPcmd[] =
   "UIDL",
 
   // POP3 extended commands
-  "STLS"
+  "STLS", "CAPA"
 };
 
 // POP responses
 #define POP_RESP_ERROR    "-ERR"
 #define POP_RESP_OKAY     "+OK"
 
+// POP3 capabilities (RFC 2449)
+#define POP3_CAPA_PIPELINING  (1<<0)
+#define POP3_CAPA_TOP         (1<<1)
+#define POP3_CAPA_UIDL        (1<<2)
+#define POP3_CAPA_LISTED      (1<<3) // the server answered the CAPA command
+#define hasPIPELINING(v)      (isFlagSet((v), POP3_CAPA_PIPELINING))
+#define hasTOP(v)             (isFlagSet((v), POP3_CAPA_TOP))
+#define hasUIDL(v)            (isFlagSet((v), POP3_CAPA_UIDL))
+#define hasCapabilityList(v)  (isFlagSet((v), POP3_CAPA_LISTED))
+// the optional commands are just tried if the server didn't list its capabilities
+#define canTOP(v)             (hasCapabilityList(v) == FALSE || hasTOP(v))
+#define canUIDL(v)            (hasCapabilityList(v) == FALSE || hasUIDL(v))
+
+// the maximum number of commands which are sent without waiting for
+// their responses if the server supports command pipelining
+#define POP3_PIPELINE_WINDOW  16
+
+// the number of downloaded mails which are added to the incoming folder
+// at once, the folder is shared with the downloads of other accounts
+#define POP3_STORE_BATCH      16
+
 /**************************************************************************/
 // local macros & defines
 
+// a command which was sent, but whose response was not yet received
+struct POP3PendingCommand
+{
+  enum POPCommand command;
+  struct MailTransferNode *tnode;
+};
+
+// the commands sent to the server in order, without pipelining the
+// window is one command only
+struct POP3Pipeline
+{
+  struct POP3PendingCommand pending[POP3_PIPELINE_WINDOW];
+  int first;   // the oldest pending command
+  int count;   // the number of pending commands
+  int window;  // the maximum number of pending commands
+};
+
 struct TransferContext
 {
   struct Connection *connection;
@@ -120,13 +158,16 @@ struct TransferContext
   char transferGroupTitle[SIZE_DEFAULT]; // the TransferControlGroup's title
   char password[SIZE_PASSWORD];
   ULONG flags;
+  ULONG capabilities;                    // the capabilities of the server (POP3_CAPA_#?)
   struct UIDLhash *UIDLhashTable;        // for maintaining all UIDLs
   struct MinList *remoteFilters;
   struct MailTransferList *transferList;
   struct MailTransferNode *firstPreselect;
   struct Folder *incomingFolder;         // the folder to place the downloaded mails into
+  struct MailList *storedMails;          // downloaded mails not yet added to the incoming folder
   BOOL useTLS;
   struct DownloadResult downloadResult;
+  long pendingDeletions;                 // mails marked as deleted, the server removes them upon QUIT only
   struct FilterResult filterResult;
   int numberOfMailsTotal;
   int numberOfMailsSkipped;
@@ -175,6 +216,67 @@ static void ApplyRemoteFilters(struct TransferContext *tc, struct MailTransferNo
   LEAVE();
 }
 
+///
+/// ReceivePOP3Response
+//  Receives the status line of the response to a previously sent command
+static char *ReceivePOP3Response(struct TransferContext *tc, const enum POPCommand command, const char *errorMsg)
+{
+  char *result = NULL;
+  int received;
+
+  ENTER();
+
+  // let us read the next line from the server and check if
+  // some status message can be retrieved.
+  if((received = ReceiveLineFromHost(tc->connection, tc->pop3Buffer, sizeof(tc->pop3Buffer))) > 0)
+  {
+    D(DBF_NET, "received POP3 answer '%s'", tc->pop3Buffer);
+
+    if(strncmp(tc->pop3Buffer, POP_RESP_OKAY, strlen(POP_RESP_OKAY)) == 0)
+    {
+      // everything worked out fine so lets set
+      // the result to our allocated buffer
+      result = tc->pop3Buffer;
+    }
+  }
+
+  if(result == NULL)
+  {
+    BOOL showError;
+
+    // don't show an error message for a failed QUIT command with no answer at all
+    if(command == POPCMD_QUIT && received == -1)
+      showError = FALSE;
+    else
+      showError = TRUE;
+
+    // only report an error if explicitly wanted
+    if(showError == TRUE && errorMsg != NULL)
+    {
+      // if we just issued a PASS command and that failed, then overwrite the visible
+      // password with X chars now, so that nobody else can read your password
+      if(command == POPCMD_PASS)
+      {
+        char *p;
+
+        // find the beginning of the password
+        if((p = strstr(tc->pop3Buffer, POPcmd[POPCMD_PASS])) != NULL &&
+           (p = strchr(p, ' ')) != NULL)
+        {
+          // now cross it out
+          while(*p != '\0' && *p != ' ' && *p != '\n' && *p != '\r')
+            *p++ = 'X';
+        }
+      }
+
+      ER_NewError(errorMsg, tc->msn->hostname, tc->msn->description, (char *)POPcmd[command], tc->pop3Buffer);
+    }
+  }
+
+  RETURN(result);
+  return result;
+}
+
 ///
 /// SendPOP3Command
 //  Sends a command to the POP3 server
@@ -196,243 +298,254 @@ static char *SendPOP3Command(struct TransferContext *tc, const enum POPCommand c
   // and for a connect we don't send something or the server will get
   // confused.
   if(command == POPCMD_CONNECT || SendLineToHost(tc->connection, tc->pop3Buffer) > 0)
+    result = ReceivePOP3Response(tc, command, errorMsg);
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// InitPOP3Pipeline
+//  Prepares sending commands ahead, this is done only if the server
+//  announced to support command pipelining (RFC 2449)
+static void InitPOP3Pipeline(struct TransferContext *tc, struct POP3Pipeline *pipe)
+{
+  ENTER();
+
+  pipe->first = 0;
+  pipe->count = 0;
+  pipe->window = hasPIPELINING(tc->capabilities) ? POP3_PIPELINE_WINDOW : 1;
+
+  LEAVE();
+}
+
+///
+/// QueuePOP3Command
+//  Puts a command for a certain mail into the send buffer of the connection
+//  without flushing it and without waiting for the response of the server
+static BOOL QueuePOP3Command(struct TransferContext *tc, struct POP3Pipeline *pipe, const enum POPCommand command, const char *parmtext, struct MailTransferNode *tnode)
+{
+  BOOL success = FALSE;
+
+  ENTER();
+
+  if(pipe->count < pipe->window)
   {
-    int received;
+    char cmdbuf[SIZE_LINE];
+
+    snprintf(cmdbuf, sizeof(cmdbuf), "%s %s\r\n", POPcmd[command], parmtext);
 
-    // let us read the next line from the server and check if
-    // some status message can be retrieved.
-    if((received = ReceiveLineFromHost(tc->connection, tc->pop3Buffer, sizeof(tc->pop3Buffer))) > 0)
+    D(DBF_NET, "queue POP3 cmd '%s' with param '%s'", POPcmd[command], parmtext);
+
+    if(SendToHost(tc->connection, cmdbuf, strlen(cmdbuf), TCPF_NONE) > 0)
     {
-      D(DBF_NET, "received POP3 answer '%s'", tc->pop3Buffer);
+      struct POP3PendingCommand *pending = &pipe->pending[(pipe->first + pipe->count) % POP3_PIPELINE_WINDOW];
 
-      if(strncmp(tc->pop3Buffer, POP_RESP_OKAY, strlen(POP_RESP_OKAY)) == 0)
-      {
-        // everything worked out fine so lets set
-        // the result to our allocated buffer
-        result = tc->pop3Buffer;
-      }
+      pending->command = command;
+      pending->tnode = tnode;
+      pipe->count++;
+
+      success = TRUE;
     }
+  }
 
-    if(result == NULL)
-    {
-      BOOL showError;
+  RETURN(success);
+  return success;
+}
 
-      // don't show an error message for a failed QUIT command with no answer at all
-      if(command == POPCMD_QUIT && received == -1)
-        showError = FALSE;
-      else
-        showError = TRUE;
+///
+/// NextPOP3Response
+//  Flushes all queued commands and receives the status line of the response
+//  to the oldest pending command. The command and its mail are returned in
+//  the given structure.
+static char *NextPOP3Response(struct TransferContext *tc, struct POP3Pipeline *pipe, struct POP3PendingCommand *pending, const char *errorMsg)
+{
+  char *result = NULL;
 
-      // only report an error if explicitly wanted
-      if(showError == TRUE && errorMsg != NULL)
-      {
-        // if we just issued a PASS command and that failed, then overwrite the visible
-        // password with X chars now, so that nobody else can read your password
-        if(command == POPCMD_PASS)
-        {
-          char *p;
+  ENTER();
 
-          // find the beginning of the password
-          if((p = strstr(tc->pop3Buffer, POPcmd[POPCMD_PASS])) != NULL &&
-             (p = strchr(p, ' ')) != NULL)
-          {
-            // now cross it out
-            while(*p != '\0' && *p != ' ' && *p != '\n' && *p != '\r')
-              *p++ = 'X';
-          }
-        }
+  // take the oldest command from the pipeline
+  memcpy(pending, &pipe->pending[pipe->first], sizeof(*pending));
+  pipe->first = (pipe->first + 1) % POP3_PIPELINE_WINDOW;
+  pipe->count--;
 
-        ER_NewError(errorMsg, tc->msn->hostname, tc->msn->description, (char *)POPcmd[command], tc->pop3Buffer);
-      }
-    }
-  }
+  if(FlushConnection(tc->connection) >= 0)
+    result = ReceivePOP3Response(tc, pending->command, errorMsg);
+  else if(tc->connection->error == CONNECTERR_NO_ERROR)
+    tc->connection->error = CONNECTERR_UNKNOWN_ERROR;
 
   RETURN(result);
   return result;
 }
 
 ///
-/// ReceiveToFile
-static int ReceiveToFile(struct TransferContext *tc, FILE *fh, const char *filename, const BOOL isTemp)
+/// GetCapabilities
+//  Asks the server for its capabilities (RFC 2449), servers which don't
+//  know the CAPA command are treated as having no capabilities at all
+static void GetCapabilities(struct TransferContext *tc)
 {
-  int count;
-  int l=0, read, state=0;
-  BOOL error = FALSE;
-  BOOL done = FALSE;
-  char *lineptr = tc->lineBuffer;
-
   ENTER();
 
-  // get the first data the pop server returns after the TOP command
-  if((read = count = ReceiveFromHost(tc->connection, tc->pop3Buffer, sizeof(tc->pop3Buffer))) <= 0)
-    tc->connection->error = CONNECTERR_UNKNOWN_ERROR;
-  else
-  {
-    // the first line we write out to our mail file is a X-YAM-MailAccount: header in which we
-    // mark through which mail account this mail was received.
-    fprintf(fh, "X-YAM-MailAccount: %s@%s\n", tc->msn->username, tc->msn->hostname);
-  }
+  tc->capabilities = 0;
 
-  while(tc->connection->abort == FALSE && tc->connection->error == CONNECTERR_NO_ERROR)
+  if(SendPOP3Command(tc, POPCMD_CAPA, NULL, NULL) != NULL)
   {
-    char *bufptr;
+    setFlag(tc->capabilities, POP3_CAPA_LISTED);
 
-    // now we iterate through the received string
-    // and strip out the '\r' character.
-    // we iterate through it because the strings we receive
-    // from the socket can be splitted somehow.
-    for(bufptr = tc->pop3Buffer; read > 0; bufptr++, read--)
+    // the capabilities are listed line by line up to the finishing octet
+    while(ReceiveLineFromHost(tc->connection, tc->pop3Buffer, sizeof(tc->pop3Buffer)) > 0 &&
+          tc->connection->error == CONNECTERR_NO_ERROR && strncmp(tc->pop3Buffer, ".\r\n", 3) != 0)
     {
-      // first we check if our buffer is full and if so we
-      // write it to the file.
-      if(l == sizeof(tc->lineBuffer) || done == TRUE)
-      {
-        // update the transfer status during the final download
-        if(isTemp == FALSE)
-          PushMethodOnStack(tc->transferGroup, 3, MUIM_TransferControlGroup_Update, l, tr(MSG_TR_Downloading));
+      if(strnicmp(tc->pop3Buffer, "PIPELINING", 10) == 0)
+        setFlag(tc->capabilities, POP3_CAPA_PIPELINING);
+      else if(strnicmp(tc->pop3Buffer, "TOP", 3) == 0)
+        setFlag(tc->capabilities, POP3_CAPA_TOP);
+      else if(strnicmp(tc->pop3Buffer, "UIDL", 4) == 0)
+        setFlag(tc->capabilities, POP3_CAPA_UIDL);
+    }
+  }
 
-        // write the line to the file now
-        if(fwrite(tc->lineBuffer, 1, l, fh) != (size_t)l)
-        {
-          error = TRUE;
-          ER_NewError(tr(MSG_ER_ErrorWriteMailfile), filename);
-          break;
-        }
+  #if defined(DEBUG)
+  D(DBF_NET, "POP3 Server '%s' provides:", tc->msn->hostname);
+  D(DBF_NET, "  PIPELINING: %s", Bool2Txt(hasPIPELINING(tc->capabilities)));
+  D(DBF_NET, "  TOP.......: %s", Bool2Txt(hasTOP(tc->capabilities)));
+  D(DBF_NET, "  UIDL......: %s", Bool2Txt(hasUIDL(tc->capabilities)));
+  #endif
 
-        // if we end up here and done is true we have to break that iteration
-        if(done == TRUE)
-          break;
+  LEAVE();
+}
 
-        // set l to zero so that the next char gets written to the beginning
-        l = 0;
-        lineptr = tc->lineBuffer;
-      }
+///
+/// WriteMailData
+//  Writes received mail data to the mail file, if there is one, and lets
+//  the mail stream examine it on the fly
+static BOOL WriteMailData(FILE *fh, struct MailStream *ms, const char *data, const size_t len)
+{
+  BOOL success = TRUE;
 
-      // we have to analyze different states because we iterate through our
-      // received buffer char by char.
-      switch(state)
-      {
-        // stat==1 is only reached if a "\r" was found previously
-        case 1:
-        {
-          // if we previously found a \r and the actual char is not a \n, then
-          // we write the \r in the buffer and iterate to the next char.
-          if(*bufptr != '\n')
-          {
-            *lineptr++ = '\r';
-            l++;
-            read++;
-            bufptr--;
-            state = 0;
+  ENTER();
 
-            continue;
-          }
+  if(ms != NULL)
+    MA_WriteMailStream(ms, data, len);
 
-          // write the actual char "\n" in the line buffer
-          *lineptr++ = *bufptr;
-          l++;
+  if(fh != NULL && fwrite(data, 1, len, fh) != len)
+    success = FALSE;
 
-          state = 2; // we found a "\r\n" so we move to stat 2 on the next iteration.
-          continue;
-        }
-        break;
+  RETURN(success);
+  return success;
+}
 
-        // stat==2 is only reached if we previously found a "\r\n"
-        // stat==5 if we found a lonely "\n"
-        case 2:
-        case 5:
-        {
-          if(*bufptr == '.')
-          {
-            state++; // now it's 3 or 6
-            continue;
-          }
+///
+/// ReceiveToFile
+//  Receives a mail or a mail header up to the termination line. The data is
+//  written to the given file and examined by the given mail stream, either
+//  of them may be omitted.
+static int ReceiveToFile(struct TransferContext *tc, FILE *fh, const char *filename, const BOOL isTemp, struct MailStream *ms)
+{
+  int count = 0;
+  int unreported = 0;
+  BOOL lineStart = TRUE;
+  BOOL pendingCR = FALSE;
+  BOOL error = FALSE;
+  BOOL done = FALSE;
 
-          state = 0;
-        }
-        break;
+  ENTER();
 
-        // stat==3 is only reached if we previously found a "\r\n."
-        // stat==6 if we found a lonely "\n."
-        case 3:
-        case 6:
-        {
-          if(state == 3 && *bufptr == '\r')
-          {
-            state = 4; // we found a \r directly after a "\r\n.", so it can be the start of a TERM
-          }
-          else if(*bufptr == '.')
-          {
-            // (RFC 1939) - the server handles "." as "..", so we only write "."
-            *lineptr++ = '.';
-            l++;
-            state = 0;
-          }
-          else
-          {
-            // write the actual char in the line buffer
-            *lineptr++ = '.';
-            l++;
-            read++;
-            bufptr--;
-            state = 0;
-          }
+  // the first line we write out to our mail file is a X-YAM-MailAccount: header in which we
+  // mark through which mail account this mail was received.
+  snprintf(tc->lineBuffer, sizeof(tc->lineBuffer), "X-YAM-MailAccount: %s@%s\n", tc->msn->username, tc->msn->hostname);
+  if(WriteMailData(fh, ms, tc->lineBuffer, strlen(tc->lineBuffer)) == FALSE)
+  {
+    error = TRUE;
+    ER_NewError(tr(MSG_ER_ErrorWriteMailfile), filename);
+  }
 
-          continue;
-        }
-        break;
+  // we process the received data line by line directly within the receive
+  // buffer of the connection, the lines are only copied to the file
+  // after a write error the rest of the data is still read and discarded,
+  // this keeps the responses to commands sent ahead in sync
+  while(done == FALSE && tc->connection->abort == FALSE && tc->connection->error == CONNECTERR_NO_ERROR)
+  {
+    char *line;
+    int len;
 
-        // stat==4 is only reached if we previsouly found a "\r\n.\r"
-        case 4:
-        {
-          if(*bufptr != '\n')
-          {
-            *lineptr++ = '.';
-            l++;
-            read += 2;
-            bufptr -= 2;
-            state = 0;
+    if((len = ReceiveLineSpanFromHost(tc->connection, &line)) <= 0)
+    {
+      if(tc->connection->error == CONNECTERR_NO_ERROR)
+        tc->connection->error = CONNECTERR_UNKNOWN_ERROR;
 
-            continue;
-          }
+      break;
+    }
 
-          // so if we end up here we finally found our termination line "\r\n.\r\n"
-          // and make sure the buffer is written before we break out here.
-          read = 2;
-          done = TRUE;
+    count += len;
 
-          continue;
-        }
+    // a CR at the end of the previous piece of an overlong line is
+    // only kept if it isn't followed by a LF
+    if(pendingCR == TRUE)
+    {
+      if(line[0] != '\n' && error == FALSE)
+        WriteMailData(fh, ms, "\r", 1);
+
+      pendingCR = FALSE;
+    }
+
+    if(lineStart == TRUE && line[0] == '.')
+    {
+      // check for the termination line "\r\n.\r\n"
+      if(len == 3 && line[1] == '\r' && line[2] == '\n')
+      {
+        done = TRUE;
         break;
       }
 
-      // if we find a \r we set the stat to 1 and check on the next iteration if
-      // the following char is a \n and if so we have to strip it out.
-      if(*bufptr == '\r')
+      // (RFC 1939) - the server handles "." as "..", so we only write "."
+      line++;
+      len--;
+    }
+
+    if(len > 0)
+    {
+      // the next piece starts a new line only if this one has been complete
+      lineStart = (line[len-1] == '\n');
+
+      // strip the CR of the line's CRLF
+      if(lineStart == TRUE && len >= 2 && line[len-2] == '\r')
       {
-        state = 1;
-        continue;
+        line[len-2] = '\n';
+        len--;
       }
-      else if(*bufptr == '\n')
+      else if(lineStart == FALSE && line[len-1] == '\r')
+      {
+        pendingCR = TRUE;
+        len--;
+      }
+
+      if(error == FALSE && WriteMailData(fh, ms, line, len) == FALSE)
       {
-        state=5;
+        error = TRUE;
+        ER_NewError(tr(MSG_ER_ErrorWriteMailfile), filename);
       }
 
-      // write the actual char in the line buffer
-      *lineptr++ = *bufptr;
-      l++;
+      unreported += len;
     }
+    else
+      lineStart = FALSE;
 
-    // if we received the term octet we can exit the while loop now
-    if(done == TRUE || error == TRUE || tc->connection->abort == TRUE || tc->connection->error != CONNECTERR_NO_ERROR)
-      break;
+    // update the transfer status during the final download
+    if(isTemp == FALSE && unreported >= (int)sizeof(tc->lineBuffer))
+    {
+      PushCoalescedMethodOnStack(tc->transferGroup, MSC_ACCUMULATE, 3, MUIM_TransferControlGroup_Update, unreported, tr(MSG_TR_Downloading));
+      unreported = 0;
+    }
+  }
 
-    // if not, we get another bunch of data and start over again.
-    if((read = ReceiveFromHost(tc->connection, tc->pop3Buffer, sizeof(tc->pop3Buffer))) <= 0)
-      break;
+  if(isTemp == FALSE && unreported > 0)
+    PushCoalescedMethodOnStack(tc->transferGroup, MSC_ACCUMULATE, 3, MUIM_TransferControlGroup_Update, unreported, tr(MSG_TR_Downloading));
 
-    count += read;
-  }
+  // an abortion leaves the rest of the data unread, the connection is out
+  // of sync and must not be used for any further command, not even QUIT
+  if(done == FALSE && tc->connection->abort == TRUE && tc->connection->error == CONNECTERR_NO_ERROR)
+    tc->connection->error = CONNECTERR_ABORTED;
 
   if(done == FALSE || error == TRUE)
     count = 0;
@@ -441,6 +554,39 @@ static int ReceiveToFile(struct TransferContext *tc, FILE *fh, const char *filen
   return count;
 }
 
+///
+/// SkipMultiLineResponse
+//  Reads and discards the lines of a multi line response up to the
+//  termination line, this keeps commands sent ahead in sync
+static void SkipMultiLineResponse(struct TransferContext *tc)
+{
+  BOOL lineStart = TRUE;
+
+  ENTER();
+
+  while(tc->connection->error == CONNECTERR_NO_ERROR)
+  {
+    char *line;
+    int len;
+
+    if((len = ReceiveLineSpanFromHost(tc->connection, &line)) <= 0)
+    {
+      if(tc->connection->error == CONNECTERR_NO_ERROR)
+        tc->connection->error = CONNECTERR_UNKNOWN_ERROR;
+
+      break;
+    }
+
+    // check for the termination line "\r\n.\r\n"
+    if(lineStart == TRUE && len == 3 && line[0] == '.' && line[1] == '\r' && line[2] == '\n')
+      break;
+
+    lineStart = (line[len-1] == '\n');
+  }
+
+  LEAVE();
+}
+
 ///
 /// CheckAbort
 // check for an abortion while obtaining the message details
@@ -598,18 +744,94 @@ static BOOL GetMessageList(struct TransferContext *tc)
   return success;
 }
 
+///
+/// ReceiveMessageDetails
+//  Receives the header of a message stored on the POP3 server after the
+//  server accepted the TOP command. The header is examined on the fly
+//  without writing it to disk. Returns FALSE in case of an error.
+static BOOL ReceiveMessageDetails(struct TransferContext *tc, struct MailTransferNode *tnode, int lline)
+{
+  struct Mail *mail = tnode->mail;
+  BOOL success = TRUE;
+  struct MailStream ms;
+  BOOL done = FALSE;
+
+  ENTER();
+
+  MA_InitMailStream(&ms, tc->msn->hostname);
+
+  // now we call a subfunction to receive data from the POP3 server
+  // and examine it as long as there is no termination \r\n.\r\n
+  if(ReceiveToFile(tc, NULL, "", TRUE, &ms) > 0)
+    done = TRUE;
+
+  // If we end up here because of an error, abort or the upper loop wasn't finished
+  // we exit immediatly.
+  if(tc->connection->abort == TRUE || tc->connection->error != CONNECTERR_NO_ERROR || done == FALSE)
+  {
+    success = FALSE;
+  }
+  else
+  {
+    struct ExtendedMail *email;
+
+    if((email = MA_ExamineMailStream(&ms, NULL, "", TRUE)) != NULL)
+    {
+      SetMailPerson(&mail->From, email->Mail.From.Address, email->Mail.From.RealName);
+      SetMailPerson(&mail->To, email->Mail.To.Address, email->Mail.To.RealName);
+      SetMailPerson(&mail->ReplyTo, email->Mail.ReplyTo.Address, email->Mail.ReplyTo.RealName);
+      SetMailSubject(mail, email->Mail.Subject);
+      strlcpy(mail->MailFile, email->Mail.MailFile, sizeof(mail->MailFile));
+      memcpy(&mail->Date, &email->Mail.Date, sizeof(mail->Date));
+
+      // if this function was called with -1, then the POP3 server
+      // doesn't have the UIDL command and we have to generate our
+      // own one by using the MsgID.
+      if(lline == -1)
+        tnode->uidl = strdup(email->messageID);
+
+      // apply possible remote filters
+      if(isFlagClear(tnode->tflags, TRF_REMOTE_FILTER_APPLIED) && hasServerApplyRemoteFilters(tc->msn) == TRUE && IsMinListEmpty(tc->remoteFilters) == FALSE)
+        ApplyRemoteFilters(tc, tnode);
+
+      MA_FreeEMailStruct(email);
+    }
+    else
+      E(DBF_NET, "couldn't examine header of mail %ld", tnode->index);
+  }
+
+  MA_CleanupMailStream(&ms);
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// FinishMessageDetails
+//  Marks the details of a message as being obtained
+static void FinishMessageDetails(struct TransferContext *tc, struct MailTransferNode *tnode, int lline)
+{
+  ENTER();
+
+  // now we got the details
+  setFlag(tnode->tflags, TRF_GOT_DETAILS);
+
+  if(lline >= 0 && tc->preselectWindow != NULL)
+    PushMethodOnStack(tc->preselectWindow, 2, MUIM_PreselectionWindow_RefreshMail, lline);
+
+  LEAVE();
+}
+
 ///
 /// GetSingleMessageDetails
 //  Gets header from a message stored on the POP3 server
 static void GetSingleMessageDetails(struct TransferContext *tc, struct MailTransferNode *tnode, int lline)
 {
-  struct Mail *mail = tnode->mail;
-
   ENTER();
 
   D(DBF_NET, "get details for mail %ld", lline);
 
-  if(IsStrEmpty(mail->From.Address) &&
+  if(IsStrEmpty(tnode->mail->From.Address) && canTOP(tc->capabilities) &&
      tc->connection->abort == FALSE && tc->connection->error == CONNECTERR_NO_ERROR)
   {
     char cmdbuf[SIZE_SMALL];
@@ -621,67 +843,114 @@ static void GetSingleMessageDetails(struct TransferContext *tc, struct MailTrans
     snprintf(cmdbuf, sizeof(cmdbuf), "%d 1", tnode->index);
     if(SendPOP3Command(tc, POPCMD_TOP, cmdbuf, NULL) != NULL)
     {
-      struct TempFile *tf;
+      if(ReceiveMessageDetails(tc, tnode, lline) == FALSE)
+        lline = -1;
+    }
+  }
 
-      // we generate a temporary file to buffer the TOP list into
-      if((tf = OpenTempFile("w")) != NULL)
-      {
-        struct ExtendedMail *email;
-        BOOL done = FALSE;
+  FinishMessageDetails(tc, tnode, lline);
 
-        // now we call a subfunction to receive data from the POP3 server
-        // and write it in the filehandle as long as there is no termination \r\n.\r\n
-        if(ReceiveToFile(tc, tf->FP, tf->Filename, TRUE) > 0)
-          done = TRUE;
+  LEAVE();
+}
 
-        // close the filehandle now
-        fclose(tf->FP);
-        tf->FP = NULL;
+///
+/// GetMessageDetails
+//  Gets the headers of all messages from the given one up to the end of
+//  the list. The TOP commands are sent ahead if the server supports command
+//  pipelining, otherwise each command waits for the previous response.
+//  The return value is the same as for GetAllMessageDetails().
+static int GetMessageDetails(struct TransferContext *tc, struct MailTransferNode *tnode, ULONG *handledMails)
+{
+  int success = 1;
+  struct POP3Pipeline pipe;
 
-        // If we end up here because of an error, abort or the upper loop wasn't finished
-        // we exit immediatly with deleting the temp file also.
-        if(tc->connection->abort == TRUE || tc->connection->error != CONNECTERR_NO_ERROR || done == FALSE)
+  ENTER();
+
+  InitPOP3Pipeline(tc, &pipe);
+
+  while(tc->connection->error == CONNECTERR_NO_ERROR && ((success == 1 && tnode != NULL) || pipe.count > 0))
+  {
+    // send as many TOP commands ahead as possible
+    while(success == 1 && tnode != NULL && pipe.count < pipe.window)
+    {
+      // get the message details only if this has not been done before already
+      if(isFlagClear(tnode->tflags, TRF_GOT_DETAILS))
+      {
+        if(IsStrEmpty(tnode->mail->From.Address) && canTOP(tc->capabilities) && tc->connection->abort == FALSE)
         {
-          lline = -1;
+          char cmdbuf[SIZE_SMALL];
+
+          D(DBF_NET, "get details for mail %ld", tnode->index-1);
+
+          // we issue a TOP command with a one line message body.
+          snprintf(cmdbuf, sizeof(cmdbuf), "%d 1", tnode->index);
+          if(QueuePOP3Command(tc, &pipe, POPCMD_TOP, cmdbuf, tnode) == FALSE)
+          {
+            if(tc->connection->error == CONNECTERR_NO_ERROR)
+              tc->connection->error = CONNECTERR_UNKNOWN_ERROR;
+
+            success = 0;
+            break;
+          }
         }
-        else if((email = MA_ExamineMail(NULL, FilePart(tf->Filename), TRUE)) != NULL)
+        else
         {
-          memcpy(&mail->From, &email->Mail.From, sizeof(mail->From));
-          memcpy(&mail->To, &email->Mail.To, sizeof(mail->To));
-          memcpy(&mail->ReplyTo, &email->Mail.ReplyTo, sizeof(mail->ReplyTo));
-          strlcpy(mail->Subject, email->Mail.Subject, sizeof(mail->Subject));
-          strlcpy(mail->MailFile, email->Mail.MailFile, sizeof(mail->MailFile));
-          memcpy(&mail->Date, &email->Mail.Date, sizeof(mail->Date));
-
-          // if this function was called with -1, then the POP3 server
-          // doesn't have the UIDL command and we have to generate our
-          // own one by using the MsgID.
-          if(lline == -1)
-            tnode->uidl = strdup(email->messageID);
-
-          // apply possible remote filters
-          if(isFlagClear(tnode->tflags, TRF_REMOTE_FILTER_APPLIED) && hasServerApplyRemoteFilters(tc->msn) == TRUE && IsMinListEmpty(tc->remoteFilters) == FALSE)
-            ApplyRemoteFilters(tc, tnode);
-
-          MA_FreeEMailStruct(email);
+          // nothing to ask the server for
+          FinishMessageDetails(tc, tnode, tnode->index-1);
+
+          // update the progress bar
+          (*handledMails)++;
+          if(tc->preselectWindow != NULL)
+            PushCoalescedMethodOnStack(tc->preselectWindow, MSC_REPLACE, 3, MUIM_Set, MUIA_PreselectionWindow_Progress, *handledMails);
         }
-        else
-          E(DBF_NET, "couldn't examine mail file '%s'", tf->Filename);
+      }
 
-        CloseTempFile(tf);
+      if((success = CheckAbort(tc)) == 1)
+      {
+        // continue with the next mail
+        tnode = NextMailTransferNode(tnode);
+      }
+    }
+
+    if(pipe.count > 0)
+    {
+      struct POP3PendingCommand pending;
+      int lline;
+
+      // This command is optional within the RFC 1939 specification
+      // and therefore we don't throw any error
+      if(NextPOP3Response(tc, &pipe, &pending, NULL) != NULL)
+      {
+        lline = pending.tnode->index-1;
+
+        // after an abortion the pending headers are just read and discarded
+        if(tc->connection->abort == TRUE)
+          SkipMultiLineResponse(tc);
+        else if(ReceiveMessageDetails(tc, pending.tnode, lline) == FALSE)
+          lline = -1;
       }
       else
-        ER_NewError(tr(MSG_ER_CantCreateTempfile));
+        lline = pending.tnode->index-1;
+
+      FinishMessageDetails(tc, pending.tnode, lline);
+
+      // update the progress bar
+      (*handledMails)++;
+      if(tc->preselectWindow != NULL)
+        PushCoalescedMethodOnStack(tc->preselectWindow, MSC_REPLACE, 3, MUIM_Set, MUIA_PreselectionWindow_Progress, *handledMails);
+
+      // an early "Start" by the user still lets us receive the pending headers
+      if(success == 1)
+        success = CheckAbort(tc);
     }
   }
 
-  // now we got the details
-  setFlag(tnode->tflags, TRF_GOT_DETAILS);
-
-  if(lline >= 0 && tc->preselectWindow != NULL)
-    PushMethodOnStack(tc->preselectWindow, 2, MUIM_PreselectionWindow_RefreshMail, lline);
+  // a transmission error aborts everything
+  if(tc->connection->error != CONNECTERR_NO_ERROR)
+    success = 0;
 
-  LEAVE();
+  RETURN(success);
+  return success;
 }
 
 ///
@@ -767,32 +1036,11 @@ static int GetAllMessageDetails(struct TransferContext *tc, BOOL remoteFilters)
       D(DBF_NET, "pass %ld start at mail %ld", pass, tnode->index-1);
 
       // get all message details until the end of the list
-      do
+      if((success = GetMessageDetails(tc, tnode, &handledMails)) != 1)
       {
-        // get the message details only if this has not been done before already
-        if(isFlagClear(tnode->tflags, TRF_GOT_DETAILS))
-        {
-          GetSingleMessageDetails(tc, tnode, tnode->index-1);
-
-          // update the progress bar
-          handledMails++;
-          if(tc->preselectWindow != NULL)
-            PushMethodOnStack(tc->preselectWindow, 3, MUIM_Set, MUIA_PreselectionWindow_Progress, handledMails);
-        }
-
-        if((success = CheckAbort(tc)) != 1)
-        {
-          // bail out completely
-          tnode = NULL;
-          pass = 3;
-        }
-        else
-        {
-          // continue with the next mail
-          tnode = NextMailTransferNode(tnode);
-        }
+        // bail out completely
+        pass = 3;
       }
-      while(tnode != NULL);
     }
     else
     {
@@ -828,7 +1076,7 @@ static BOOL FilterDuplicates(struct TransferContext *tc)
 
     // before we go and request the UIDL of each message we check whether the server
     // supports the UIDL command at all
-    if(SendPOP3Command(tc, POPCMD_UIDL, NULL, NULL) != NULL)
+    if(canUIDL(tc->capabilities) && SendPOP3Command(tc, POPCMD_UIDL, NULL, NULL) != NULL)
     {
       // get the first line the pop server returns after the UIDL command
       if(ReceiveLineFromHost(tc->connection, tc->lineBuffer, sizeof(tc->lineBuffer)) > 0)
@@ -916,6 +1164,11 @@ static BOOL FilterDuplicates(struct TransferContext *tc)
             break;
           }
         }
+
+        // only a complete list tells us which of the known UIDLs belong to
+        // mails which no longer exist on the server
+        if(tc->connection->abort == FALSE && tc->connection->error == CONNECTERR_NO_ERROR && strncmp(tc->lineBuffer, ".\r\n", 3) == 0)
+          tc->UIDLhashTable->serverListComplete = TRUE;
       }
       else
         E(DBF_UIDL, "error on first readline!");
@@ -923,6 +1176,7 @@ static BOOL FilterDuplicates(struct TransferContext *tc)
     else
     {
       struct MailTransferNode *tnode;
+      BOOL complete = TRUE;
 
       W(DBF_UIDL, "POP3 server '%s' doesn't support UIDL command!", tc->msn->hostname);
 
@@ -957,10 +1211,15 @@ static BOOL FilterDuplicates(struct TransferContext *tc)
             }
           }
         }
+        else
+          complete = FALSE;
 
         if(tc->connection->abort == TRUE || tc->connection->error != CONNECTERR_NO_ERROR)
           break;
       }
+
+      if(complete == TRUE && tc->connection->abort == FALSE && tc->connection->error == CONNECTERR_NO_ERROR)
+        tc->UIDLhashTable->serverListComplete = TRUE;
     }
 
     result = (tc->connection->abort == FALSE && tc->connection->error == CONNECTERR_NO_ERROR);
@@ -1171,6 +1430,10 @@ static int ConnectToPOP3(struct TransferContext *tc)
       goto out;
   }
 
+  // find out whether the server supports command pipelining, the
+  // capabilities may change after the authentication (RFC 2449)
+  GetCapabilities(tc);
+
   PushMethodOnStack(tc->transferGroup, 2, MUIM_TransferControlGroup_ShowStatus, tr(MSG_TR_GetStats));
   if((resp = SendPOP3Command(tc, POPCMD_STAT, NULL, tr(MSG_ER_BADRESPONSE_POP3))) == NULL)
     goto out;
@@ -1203,7 +1466,21 @@ static void DisconnectFromPOP3(struct TransferContext *tc)
   D(DBF_NET, "disconnecting from POP3 server '%s'", tc->msn->hostname);
   PushMethodOnStack(tc->transferGroup, 2, MUIM_TransferControlGroup_ShowStatus, tr(MSG_TR_Disconnecting));
   if(tc->connection->error == CONNECTERR_NO_ERROR)
-    SendPOP3Command(tc, POPCMD_QUIT, NULL, tr(MSG_ER_BADRESPONSE_POP3));
+  {
+    // the mails marked as deleted are removed only after a successful QUIT
+    // command, otherwise the server keeps them (RFC 1939)
+    if(SendPOP3Command(tc, POPCMD_QUIT, NULL, tr(MSG_ER_BADRESPONSE_POP3)) != NULL)
+    {
+      tc->downloadResult.deleted += tc->pendingDeletions;
+      tc->pendingDeletions = 0;
+    }
+  }
+
+  if(tc->pendingDeletions > 0)
+  {
+    W(DBF_NET, "QUIT failed or was skipped, %ld mails are kept on the server", tc->pendingDeletions);
+    tc->pendingDeletions = 0;
+  }
 
   DisconnectFromHost(tc->connection);
 
@@ -1214,8 +1491,39 @@ static void DisconnectFromPOP3(struct TransferContext *tc)
 }
 
 ///
-/// LoadMessage
-static BOOL LoadMessage(struct TransferContext *tc, struct Folder *inFolder, const int number)
+/// StoreDownloadedMails
+//  Adds the downloaded mails to the incoming folder. This locks the folder
+//  once per batch of mails instead of once per mail.
+static void StoreDownloadedMails(struct TransferContext *tc)
+{
+  ENTER();
+
+  if(IsMailListEmpty(tc->storedMails) == FALSE)
+  {
+    D(DBF_NET, "adding %ld downloaded mails to folder '%s'", tc->storedMails->count, tc->incomingFolder->Name);
+
+    AddMailsToFolder(tc->storedMails, tc->incomingFolder, TRUE);
+
+    // if the current folder is the inbox we can go and add the mails instantly to the maillist
+    if(tc->incomingFolder == GetCurrentFolder())
+    {
+      struct MailNode *mnode;
+
+      ForEachMailNode(tc->storedMails, mnode)
+        PushMethodOnStack(G->MA->GUI.PG_MAILLIST, 3, MUIM_NList_InsertSingle, mnode->mail, MUIV_NList_Insert_Sorted);
+    }
+
+    // add the mails to the list of downloaded mails
+    MoveMailList(tc->msn->downloadedMails, tc->storedMails);
+  }
+
+  LEAVE();
+}
+
+///
+/// ReceiveMessage
+//  Receives a message after the server accepted the RETR command
+static BOOL ReceiveMessage(struct TransferContext *tc, struct Folder *inFolder)
 {
   BOOL result = FALSE;
   char msgfile[SIZE_PATHFILE];
@@ -1229,32 +1537,33 @@ static BOOL LoadMessage(struct TransferContext *tc, struct Folder *inFolder, con
   // data
   if((fh = fopen(msgfile, "w")) != NULL)
   {
-    char msgnum[SIZE_SMALL];
     BOOL done = FALSE;
+    struct MailStream ms;
 
     setvbuf(fh, NULL, _IOFBF, SIZE_FILEBUF);
 
-    snprintf(msgnum, sizeof(msgnum), "%d", number);
-    if(SendPOP3Command(tc, POPCMD_RETR, msgnum, tr(MSG_ER_BADRESPONSE_POP3)) != NULL)
-    {
-      // now we call a subfunction to receive data from the POP3 server
-      // and write it in the filehandle as long as there is no termination \r\n.\r\n
-      if(ReceiveToFile(tc, fh, msgfile, FALSE) > 0)
-        done = TRUE;
-    }
+    // the header is parsed while the mail is written, thus the mail
+    // file doesn't need to be read again
+    MA_InitMailStream(&ms, msgfile);
+
+    // now we call a subfunction to receive data from the POP3 server
+    // and write it in the filehandle as long as there is no termination \r\n.\r\n
+    if(ReceiveToFile(tc, fh, msgfile, FALSE, &ms) > 0)
+      done = TRUE;
+
     fclose(fh);
 
     if(tc->connection->abort == FALSE && tc->connection->error == CONNECTERR_NO_ERROR && done == TRUE)
     {
       struct ExtendedMail *email;
 
-      if((email = MA_ExamineMail(inFolder, FilePart(msgfile), FALSE)) != NULL)
+      if((email = MA_ExamineMailStream(&ms, inFolder, FilePart(msgfile), FALSE)) != NULL)
       {
         struct Mail *mail;
 
         if((mail = CloneMail(&email->Mail)) != NULL)
         {
-          AddMailToFolder(mail, inFolder);
+          mail->Folder = inFolder;
 
           // we have to get the actual Time and place it in the transDate, so that we know at
           // which time this mail arrived
@@ -1263,15 +1572,12 @@ static BOOL LoadMessage(struct TransferContext *tc, struct Folder *inFolder, con
           mail->sflags = SFLAG_NEW;
           MA_UpdateMailFile(mail);
 
-          D(DBF_NET, "adding mail to downloaded list");
-          // add the mail to the list of downloaded mails
-          LockMailList(tc->msn->downloadedMails);
-          AddNewMailNode(tc->msn->downloadedMails, mail);
-          UnlockMailList(tc->msn->downloadedMails);
+          // the mail is added to the folder together with the next ones
+          D(DBF_NET, "adding mail to stored list");
+          AddNewMailNode(tc->storedMails, mail);
 
-          // if the current folder is the inbox we can go and add the mail instantly to the maillist
-          if(inFolder == GetCurrentFolder())
-            PushMethodOnStack(G->MA->GUI.PG_MAILLIST, 3, MUIM_NList_InsertSingle, mail, MUIV_NList_Insert_Sorted);
+          if(tc->storedMails->count >= POP3_STORE_BATCH)
+            StoreDownloadedMails(tc);
 
           AppendToLogfile(LF_VERBOSE, 32, tr(MSG_LOG_RetrievingVerbose), AddrName(mail->From), mail->Subject, mail->Size);
 
@@ -1291,31 +1597,38 @@ static BOOL LoadMessage(struct TransferContext *tc, struct Folder *inFolder, con
       // we need to set the folder flags to modified so that the .index will be saved later.
       setFlag(inFolder->Flags, FOFL_MODIFY);
     }
+
+    MA_CleanupMailStream(&ms);
   }
   else
+  {
     ER_NewError(tr(MSG_ER_ErrorWriteMailfile), msgfile);
 
+    // the message must be read nevertheless
+    SkipMultiLineResponse(tc);
+  }
+
   RETURN(result);
   return result;
 }
 
 ///
-/// DeleteMessage
-static BOOL DeleteMessage(struct TransferContext *tc, const int number)
+/// QueueRetrieveOrDelete
+//  Sends the command to retrieve or to delete a message ahead
+static BOOL QueueRetrieveOrDelete(struct TransferContext *tc, struct POP3Pipeline *pipe, const enum POPCommand command, struct MailTransferNode *tnode)
 {
-  BOOL result = FALSE;
+  BOOL result;
   char msgnum[SIZE_SMALL];
 
   ENTER();
 
-  // update the transfer status
-  PushMethodOnStack(tc->transferGroup, 3, MUIM_TransferControlGroup_Update, TCG_SETMAX, tr(MSG_TR_DeletingServerMail));
-
-  snprintf(msgnum, sizeof(msgnum), "%d", number);
-  if(SendPOP3Command(tc, POPCMD_DELE, msgnum, tr(MSG_ER_BADRESPONSE_POP3)) != NULL)
+  snprintf(msgnum, sizeof(msgnum), "%d", tnode->index);
+  if((result = QueuePOP3Command(tc, pipe, command, msgnum, tnode)) == FALSE)
   {
-    tc->downloadResult.deleted++;
-    result = TRUE;
+    ER_NewError(tr(MSG_ER_CONNECTIONBROKEN), tc->msn->hostname, (char *)POPcmd[command]);
+
+    if(tc->connection->error == CONNECTERR_NO_ERROR)
+      tc->connection->error = CONNECTERR_UNKNOWN_ERROR;
   }
 
   RETURN(result);
@@ -1323,95 +1636,197 @@ static BOOL DeleteMessage(struct TransferContext *tc, const int number)
 }
 
 ///
-/// DownloadMails
-static void DownloadMails(struct TransferContext *tc)
+/// RetrieveResponse
+//  Handles the response to a RETR command, a successfully downloaded
+//  message is deleted on the server afterwards if requested
+static void RetrieveResponse(struct TransferContext *tc, struct POP3Pipeline *pipe)
 {
-  struct MailTransferNode *tnode;
+  struct MailTransferNode *tnode = pipe->pending[pipe->first].tnode;
+  struct Mail *mail = tnode->mail;
+  struct POP3PendingCommand pending;
 
   ENTER();
 
-  // Now we are actually downloading, so lets change the busy text
-  BusyText(tc->busy, tr(MSG_TR_MailTransferFrom), tc->msn->description);
+  D(DBF_NET, "downloading mail with subject '%s' and size %ld", mail->Subject, mail->Size);
 
-  GetSysTime(TIMEVAL(&tc->lastUpdateTime));
+  // update the transfer status
+  PushMethodOnStack(tc->transferGroup, 5, MUIM_TransferControlGroup_Next, tnode->index - tc->numberOfMailsSkipped, tnode->position, mail->Size, tr(MSG_TR_Downloading));
 
-  ForEachMailTransferNode(tc->transferList, tnode)
+  if(NextPOP3Response(tc, pipe, &pending, tr(MSG_ER_BADRESPONSE_POP3)) != NULL &&
+     ReceiveMessage(tc, tc->incomingFolder) == TRUE)
   {
-    struct Mail *mail = tnode->mail;
+    if(TimeHasElapsed(&tc->lastUpdateTime, 250000) == TRUE)
+    {
+      // redraw the folderentry in the listtree 4 times per second at most
+      PushMethodOnStack(G->MA->GUI.LT_FOLDERS, 3, MUIM_NListtree_Redraw, tc->incomingFolder->Treenode, MUIF_NONE);
+    }
 
-    D(DBF_NET, "download flags %08lx=%s%s%s for mail with subject '%s' and size %ld", tnode->tflags, isFlagSet(tnode->tflags, TRF_TRANSFER) ? "TR_TRANSFER " : "" , isFlagSet(tnode->tflags, TRF_DELETE) ? "TR_DELETE " : "", isFlagSet(tnode->tflags, TRF_PRESELECT) ? "TR_PRESELECT " : "", mail->Subject, mail->Size);
-    if(isFlagSet(tnode->tflags, TRF_TRANSFER))
+    // put the transferStat for this mail to 100%
+    PushMethodOnStack(tc->transferGroup, 3, MUIM_TransferControlGroup_Update, TCG_SETMAX, tr(MSG_TR_Downloading));
+
+    tc->downloadResult.downloaded++;
+
+    // Remember the UIDL of this mail, no matter if it is going
+    // to be deleted or not. Some servers don't delete a mail
+    // right after the DELETE command, but only after a successful
+    // QUIT command. Personal experience shows that pop.gmx.de is
+    // one of these servers.
+    if(hasServerAvoidDuplicates(tc->msn) == TRUE)
     {
-      D(DBF_NET, "downloading mail with subject '%s' and size %ld", mail->Subject, mail->Size);
+      D(DBF_NET, "adding mail with subject '%s' to UIDL hash", mail->Subject);
+      // add the UIDL to the hash table or update an existing entry
+      AddUIDLtoHash(tc->UIDLhashTable, tnode->uidl, UIDLF_NEW);
+    }
 
-      // update the transfer status
-      PushMethodOnStack(tc->transferGroup, 5, MUIM_TransferControlGroup_Next, tnode->index - tc->numberOfMailsSkipped, tnode->position, mail->Size, tr(MSG_TR_Downloading));
+    // the mail is deleted only after it has been stored successfully,
+    // hence the DELE command follows the RETR commands already sent ahead
+    if(isFlagSet(tnode->tflags, TRF_DELETE))
+    {
+      D(DBF_NET, "deleting mail with subject '%s' on server", mail->Subject);
 
-      if(LoadMessage(tc, tc->incomingFolder, tnode->index) == TRUE)
-      {
-        if(TimeHasElapsed(&tc->lastUpdateTime, 250000) == TRUE)
-        {
-          // redraw the folderentry in the listtree 4 times per second at most
-          PushMethodOnStack(G->MA->GUI.LT_FOLDERS, 3, MUIM_NListtree_Redraw, tc->incomingFolder->Treenode, MUIF_NONE);
-        }
+      if(tc->connection->abort == FALSE)
+        QueueRetrieveOrDelete(tc, pipe, POPCMD_DELE, tnode);
+    }
+    else
+      D(DBF_NET, "leaving mail with subject '%s' and size %ld on server to be downloaded again", mail->Subject, mail->Size);
+  }
 
-        // put the transferStat for this mail to 100%
-        PushMethodOnStack(tc->transferGroup, 3, MUIM_TransferControlGroup_Update, TCG_SETMAX, tr(MSG_TR_Downloading));
+  LEAVE();
+}
 
-        tc->downloadResult.downloaded++;
+///
+/// DeleteResponse
+//  Handles the response to a DELE command
+static void DeleteResponse(struct TransferContext *tc, struct POP3Pipeline *pipe)
+{
+  struct MailTransferNode *tnode = pipe->pending[pipe->first].tnode;
+  struct POP3PendingCommand pending;
 
-        // Remember the UIDL of this mail, no matter if it is going
-        // to be deleted or not. Some servers don't delete a mail
-        // right after the DELETE command, but only after a successful
-        // QUIT command. Personal experience shows that pop.gmx.de is
-        // one of these servers.
-        if(hasServerAvoidDuplicates(tc->msn) == TRUE)
-        {
-          D(DBF_NET, "adding mail with subject '%s' to UIDL hash", mail->Subject);
-          // add the UIDL to the hash table or update an existing entry
-          AddUIDLtoHash(tc->UIDLhashTable, tnode->uidl, UIDLF_NEW);
-        }
+  ENTER();
 
-        if(isFlagSet(tnode->tflags, TRF_DELETE))
-        {
-          D(DBF_NET, "deleting mail with subject '%s' on server", mail->Subject);
+  // mails which are not downloaded at all are just deleted
+  if(isFlagClear(tnode->tflags, TRF_TRANSFER))
+  {
+    // update the transfer status, use a zero mail size
+    PushMethodOnStack(tc->transferGroup, 5, MUIM_TransferControlGroup_Next, tnode->index - tc->numberOfMailsSkipped, tnode->position, 0, tr(MSG_TR_DeletingServerMail));
 
-          DeleteMessage(tc, tnode->index);
-        }
-        else
-          D(DBF_NET, "leaving mail with subject '%s' and size %ld on server to be downloaded again", mail->Subject, mail->Size);
-      }
+    // now we "know" that this mail had existed, don't forget this in case
+    // the delete operation fails
+    if(hasServerAvoidDuplicates(tc->msn) == TRUE)
+    {
+      D(DBF_NET, "adding mail with subject '%s' to UIDL hash", tnode->mail->Subject);
+      // add the UIDL to the hash table or update an existing entry
+      AddUIDLtoHash(tc->UIDLhashTable, tnode->uidl, UIDLF_NEW);
     }
-    else if(isFlagSet(tnode->tflags, TRF_DELETE))
+  }
+
+  // update the transfer status
+  PushMethodOnStack(tc->transferGroup, 3, MUIM_TransferControlGroup_Update, TCG_SETMAX, tr(MSG_TR_DeletingServerMail));
+
+  if(NextPOP3Response(tc, pipe, &pending, tr(MSG_ER_BADRESPONSE_POP3)) != NULL)
+    tc->pendingDeletions++;
+
+  LEAVE();
+}
+
+///
+/// DrainPOP3Pipeline
+//  Reads the responses to the commands which are still pending after an
+//  abortion. Pending mails are not downloaded anymore, instead the connection
+//  is marked as failed, hence QUIT is skipped and the server keeps all mails
+//  (RFC 1939), including those whose DELE command was acknowledged already.
+static void DrainPOP3Pipeline(struct TransferContext *tc, struct POP3Pipeline *pipe)
+{
+  ENTER();
+
+  while(pipe->count > 0 && tc->connection->error == CONNECTERR_NO_ERROR)
+  {
+    if(pipe->pending[pipe->first].command == POPCMD_DELE)
     {
-      D(DBF_NET, "deleting mail with subject '%s' on server", mail->Subject);
+      struct POP3PendingCommand pending;
+
+      if(NextPOP3Response(tc, pipe, &pending, NULL) != NULL)
+        tc->pendingDeletions++;
+    }
+    else
+    {
+      W(DBF_NET, "%ld commands still pending, skipping QUIT", pipe->count);
+      tc->connection->error = CONNECTERR_ABORTED;
+    }
+  }
+
+  LEAVE();
+}
+
+///
+/// DownloadMails
+//  Downloads and deletes the mails on the server. If the server supports
+//  command pipelining (RFC 2449) the RETR and DELE commands for the next
+//  mails are sent ahead and the responses are handled in the same order.
+static void DownloadMails(struct TransferContext *tc)
+{
+  struct MailTransferNode *tnode;
+  struct POP3Pipeline pipe;
+
+  ENTER();
+
+  // Now we are actually downloading, so lets change the busy text
+  BusyText(tc->busy, tr(MSG_TR_MailTransferFrom), tc->msn->description);
+
+  GetSysTime(TIMEVAL(&tc->lastUpdateTime));
 
-      // update the transfer status, use a zero mail size
-      PushMethodOnStack(tc->transferGroup, 5, MUIM_TransferControlGroup_Next, tnode->index - tc->numberOfMailsSkipped, tnode->position, 0, tr(MSG_TR_DeletingServerMail));
+  InitPOP3Pipeline(tc, &pipe);
 
-      // now we "know" that this mail had existed, don't forget this in case
-      // the delete operation fails
-      if(hasServerAvoidDuplicates(tc->msn) == TRUE)
+  tnode = FirstMailTransferNode(tc->transferList);
+  while(tc->connection->abort == FALSE && tc->connection->error == CONNECTERR_NO_ERROR && (tnode != NULL || pipe.count > 0))
+  {
+    // send the commands for the next mails ahead as far as possible
+    while(tnode != NULL && pipe.count < pipe.window)
+    {
+      struct Mail *mail = tnode->mail;
+
+      D(DBF_NET, "download flags %08lx=%s%s%s for mail with subject '%s' and size %ld", tnode->tflags, isFlagSet(tnode->tflags, TRF_TRANSFER) ? "TR_TRANSFER " : "" , isFlagSet(tnode->tflags, TRF_DELETE) ? "TR_DELETE " : "", isFlagSet(tnode->tflags, TRF_PRESELECT) ? "TR_PRESELECT " : "", mail->Subject, mail->Size);
+      if(isFlagSet(tnode->tflags, TRF_TRANSFER))
       {
-        D(DBF_NET, "adding mail with subject '%s' to UIDL hash", mail->Subject);
-        // add the UIDL to the hash table or update an existing entry
-        AddUIDLtoHash(tc->UIDLhashTable, tnode->uidl, UIDLF_NEW);
+        if(QueueRetrieveOrDelete(tc, &pipe, POPCMD_RETR, tnode) == FALSE)
+          break;
       }
+      else if(isFlagSet(tnode->tflags, TRF_DELETE))
+      {
+        D(DBF_NET, "deleting mail with subject '%s' on server", mail->Subject);
 
-      DeleteMessage(tc, tnode->index);
+        if(QueueRetrieveOrDelete(tc, &pipe, POPCMD_DELE, tnode) == FALSE)
+          break;
+      }
+      else
+      {
+        D(DBF_NET, "leaving mail with subject '%s' and size %ld on server to be downloaded again", mail->Subject, mail->Size);
+        // Do not modify the UIDL hash here!
+        // The mail was marked as "don't download", but here we don't know if that
+        // is due to the duplicates checking or if the user did that himself.
+      }
+
+      tnode = NextMailTransferNode(tnode);
     }
-    else
+
+    // now handle the response to the oldest command
+    if(pipe.count > 0 && tc->connection->error == CONNECTERR_NO_ERROR)
     {
-      D(DBF_NET, "leaving mail with subject '%s' and size %ld on server to be downloaded again", mail->Subject, mail->Size);
-      // Do not modify the UIDL hash here!
-      // The mail was marked as "don't download", but here we don't know if that
-      // is due to the duplicates checking or if the user did that himself.
+      if(pipe.pending[pipe.first].command == POPCMD_RETR)
+        RetrieveResponse(tc, &pipe);
+      else
+        DeleteResponse(tc, &pipe);
     }
-
-    if(tc->connection->abort == TRUE || tc->connection->error != CONNECTERR_NO_ERROR)
-      break;
   }
 
+  // the responses to the commands sent ahead are still pending after an abortion
+  if(pipe.count > 0 && tc->connection->error == CONNECTERR_NO_ERROR)
+    DrainPOP3Pipeline(tc, &pipe);
+
+  // add the remaining mails to the incoming folder, the mail files
+  // exist already, no matter if the transfer was aborted or not
+  StoreDownloadedMails(tc);
+
   PushMethodOnStack(tc->transferGroup, 1, MUIM_TransferControlGroup_Finish);
 
   // update the stats
@@ -1557,7 +1972,8 @@ BOOL ReceiveMails(struct MailServerNode *msn, const ULONG flags, struct Download
         // the connection
         tc->connection->server = tc->msn;
 
-        if((tc->transferList = CreateMailTransferList()) != NULL)
+        if((tc->transferList = CreateMailTransferList()) != NULL &&
+           (tc->storedMails = CreateMailList()) != NULL)
         {
           if(hasServerApplyRemoteFilters(tc->msn) == FALSE || (tc->remoteFilters = CloneFilterList(APPLY_REMOTE)) != NULL)
           {
@@ -1729,28 +2145,34 @@ BOOL ReceiveMails(struct MailServerNode *msn, const ULONG flags, struct Download
 
             AppendToLogfile(LF_ALL, 30, tr(MSG_LOG_RETRIEVED_POP3), tc->downloadResult.downloaded, msn->description);
 
-            // we only apply the filters if we downloaded something, or it's wasted
-            D(DBF_NET, "filter %ld downloaded mails", tc->downloadResult.downloaded);
-            if(tc->downloadResult.downloaded > 0)
+            // scheduled downloads leave the filtering to the fetch scheduler, which
+            // filters the mails of all accounts at once
+            if(isFlagClear(tc->flags, RECEIVEF_SCHEDULED))
             {
-              PushMethodOnStackWait(G->App, 3, MUIM_YAMApplication_FilterNewMails, tc->msn->downloadedMails, &tc->filterResult);
-              PushMethodOnStackWait(G->App, 5, MUIM_YAMApplication_NewMailAlert, tc->msn, &tc->downloadResult, &tc->filterResult, tc->flags);
-            }
+              // we only apply the filters if we downloaded something, or it's wasted
+              D(DBF_NET, "filter %ld downloaded mails", tc->downloadResult.downloaded);
+              if(tc->downloadResult.downloaded > 0)
+              {
+                PushMethodOnStackWait(G->App, 3, MUIM_YAMApplication_FilterNewMails, tc->msn->downloadedMails, &tc->filterResult);
+                PushMethodOnStackWait(G->App, 5, MUIM_YAMApplication_NewMailAlert, tc->msn, &tc->downloadResult, &tc->filterResult, tc->flags);
+              }
 
-            // forget about the downloaded mails again
-            LockMailList(tc->msn->downloadedMails);
-            ClearMailList(tc->msn->downloadedMails);
-            UnlockMailList(tc->msn->downloadedMails);
+              // forget about the downloaded mails again
+              LockMailList(tc->msn->downloadedMails);
+              ClearMailList(tc->msn->downloadedMails);
+              UnlockMailList(tc->msn->downloadedMails);
+            }
           }
           else
           {
             // signal failure
             success = FALSE;
           }
-
-          // clean up the transfer list
-          DeleteMailTransferList(tc->transferList);
         }
+
+        // clean up the transfer list
+        DeleteMailTransferList(tc->transferList);
+        DeleteMailList(tc->storedMails);
       }
 
       DeleteConnection(tc->connection);
@@ -1767,6 +2189,12 @@ BOOL ReceiveMails(struct MailServerNode *msn, const ULONG flags, struct Download
     free(tc);
   }
 
+  // let the fetch scheduler take over the downloaded mails and start the
+  // next download. This must happen while the server is still "in use",
+  // otherwise the mails could not be removed from the list anymore.
+  if(isFlagSet(flags, RECEIVEF_SCHEDULED))
+    PushMethodOnStackWait(G->App, 2, MUIM_YAMApplication_FinishMailFetch, msn);
+
   // mark the server as being no longer "in use"
   LockMailServer(msn);
   msn->useCount--;
@@ -48,6 +48,7 @@ struct DownloadResult
 #define RECEIVEF_AREXX           (1<<3) // transfer initiated by ARexx
 #define RECEIVEF_SIGNAL          (1<<4) // wakeup a waiting thread after the transfer
 #define RECEIVEF_TEST_CONNECTION (1<<5) // just test the connection, don't download any mails
+#define RECEIVEF_SCHEDULED       (1<<6) // transfer started by the fetch scheduler
 
 // prototypes
 BOOL ReceiveMails(struct MailServerNode *msn, const ULONG flags, struct DownloadResult *dlResult);
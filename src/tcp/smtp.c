@@ -124,6 +124,9 @@ static const char *const SMTPcmd[] =
 // help macros for SMTP routines
 #define getResponseCode(str)          ((int)strtol((str), NULL, 10))
 
+// the maximum number of pipelined envelope commands awaiting their replies
+#define SMTP_PIPELINE_WINDOW          16
+
 struct TransferContext
 {
   struct Connection *conn;
@@ -139,160 +142,202 @@ struct TransferContext
   BOOL useTLS;
 };
 
-/// SendSMTPCommand
-//  Sends a command to the SMTP server and returns the response message
-//  described in (RFC 2821)
-static char *SendSMTPCommand(struct TransferContext *tc, const enum SMTPCommand command, const char *parmtext, const char *errorMsg)
+/// ReceiveSMTPReply
+//  Receives the response message of the SMTP server to a command which has
+//  been sent before and checks it (RFC 2821). The command text is used to
+//  report errors.
+static char *ReceiveSMTPReply(struct TransferContext *tc, const enum SMTPCommand command, const char *commandText, const char *errorMsg)
 {
   BOOL success = FALSE;
   char *result = tc->smtpBuffer;
+  int len = 0;
 
   ENTER();
 
-  // first we check if the socket is ready
-  // now we prepare the SMTP command
-  if(IsStrEmpty(parmtext))
-    snprintf(tc->smtpBuffer, sizeof(tc->smtpBuffer), "%s\r\n", SMTPcmd[command]);
-  else
-    snprintf(tc->smtpBuffer, sizeof(tc->smtpBuffer), "%s %s\r\n", SMTPcmd[command], parmtext);
-
-  D(DBF_NET, "TCP: send SMTP cmd '%s' with param '%s'", SMTPcmd[command], SafeStr(parmtext));
-
-  // lets send the command via TR_WriteLine, but not if we are in connection
-  // state
-  if(command == SMTP_CONNECT || SendLineToHost(tc->conn, tc->smtpBuffer) > 0)
+  // after issuing the SMTP command we read out the server response to it
+  // but only if this wasn't the SMTP_QUIT command.
+  if((len = ReceiveLineFromHost(tc->conn, tc->smtpBuffer, sizeof(tc->smtpBuffer))) > 0)
   {
-    int len = 0;
+    // get the response code
+    int rc = strtol(tc->smtpBuffer, NULL, 10);
 
-    // after issuing the SMTP command we read out the server response to it
-    // but only if this wasn't the SMTP_QUIT command.
-    if((len = ReceiveLineFromHost(tc->conn, tc->smtpBuffer, sizeof(tc->smtpBuffer))) > 0)
-    {
-      // get the response code
-      int rc = strtol(tc->smtpBuffer, NULL, 10);
+    D(DBF_NET, "received SMTP answer '%s'", tc->smtpBuffer);
 
-      D(DBF_NET, "received SMTP answer '%s'", tc->smtpBuffer);
+    // if the response is a multiline response we have to get out more
+    // from the socket
+    if(tc->smtpBuffer[3] == '-') // (RFC 2821) - section 4.2.1
+    {
+      char tbuf[SIZE_LINE];
 
-      // if the response is a multiline response we have to get out more
-      // from the socket
-      if(tc->smtpBuffer[3] == '-') // (RFC 2821) - section 4.2.1
+      // now we concatenate the multiline reply to
+      // out main buffer
+      do
       {
-        char tbuf[SIZE_LINE];
-
-        // now we concatenate the multiline reply to
-        // out main buffer
-        do
+        // lets get out the next line from the socket
+        if((len = ReceiveLineFromHost(tc->conn, tbuf, sizeof(tbuf))) > 0)
         {
-          // lets get out the next line from the socket
-          if((len = ReceiveLineFromHost(tc->conn, tbuf, sizeof(tbuf))) > 0)
-          {
-            // get the response code
-            int rc2 = strtol(tbuf, NULL, 10);
+          // get the response code
+          int rc2 = strtol(tbuf, NULL, 10);
 
-            // check if the response code matches the one
-            // of the first line
-            if(rc == rc2)
-            {
-              // lets concatenate both strings while stripping the
-              // command code and make sure we didn't reach the end
-              // of the buffer
-              if(strlcat(tc->smtpBuffer, tbuf, sizeof(tc->smtpBuffer)) >= sizeof(tc->smtpBuffer))
-                W(DBF_NET, "buffer overrun on trying to concatenate a multiline reply!");
-            }
-            else
-            {
-              E(DBF_NET, "response codes of multiline reply doesn't match!");
-
-              errorMsg = NULL;
-              len = 0;
-              break;
-            }
+          // check if the response code matches the one
+          // of the first line
+          if(rc == rc2)
+          {
+            // lets concatenate both strings while stripping the
+            // command code and make sure we didn't reach the end
+            // of the buffer
+            if(strlcat(tc->smtpBuffer, tbuf, sizeof(tc->smtpBuffer)) >= sizeof(tc->smtpBuffer))
+              W(DBF_NET, "buffer overrun on trying to concatenate a multiline reply!");
           }
           else
           {
-            errorMsg = tr(MSG_ER_CONNECTIONBROKEN);
+            E(DBF_NET, "response codes of multiline reply doesn't match!");
+
+            errorMsg = NULL;
+            len = 0;
             break;
           }
         }
-        while(tbuf[3] == '-');
-      }
-
-      // check that the concatentation worked
-      // out fine and that the rc is valid
-      if(len > 0 && rc >= 100)
-      {
-        // Now we check if we got the correct response code for the command
-        // we issued
-        switch(command)
+        else
         {
-          //  Reponse    Description (RFC 2821 - section 4.2.1)
-          //  1xx        Positive Preliminary reply
-          //  2xx        Positive Completion reply
-          //  3xx        Positive Intermediate reply
-          //  4xx        Transient Negative Completion reply
-          //  5xx        Permanent Negative Completion reply
-
-          case SMTP_HELP:    { success = (rc == 211 || rc == 214); } break;
-          case SMTP_VRFY:    { success = (rc == 250 || rc == 251); } break;
-          case SMTP_CONNECT: { success = (rc == 220); } break;
-          case SMTP_QUIT:    { success = (rc == 221); } break;
-          case SMTP_DATA:    { success = (rc == 354); } break;
-
-          // all codes that accept 250 response code
-          case SMTP_HELO:
-          case SMTP_MAIL:
-          case SMTP_RCPT:
-          case SMTP_FINISH:
-          case SMTP_RSET:
-          case SMTP_SEND:
-          case SMTP_SOML:
-          case SMTP_SAML:
-          case SMTP_EXPN:
-          case SMTP_NOOP:
-          case SMTP_TURN:    { success = (rc == 250); } break;
-
-          // ESMTP commands & response codes
-          case ESMTP_EHLO:            { success = (rc == 250); } break;
-          case ESMTP_STARTTLS:        { success = (rc == 220); } break;
-
-          // ESMTP_AUTH command responses
-          case ESMTP_AUTH_CRAM_MD5:
-          case ESMTP_AUTH_DIGEST_MD5:
-          case ESMTP_AUTH_LOGIN:
-          case ESMTP_AUTH_PLAIN:      { success = (rc == 334); } break;
+          errorMsg = tr(MSG_ER_CONNECTIONBROKEN);
+          break;
         }
       }
+      while(tbuf[3] == '-');
     }
-    else
+
+    // check that the concatentation worked
+    // out fine and that the rc is valid
+    if(len > 0 && rc >= 100)
     {
-      // Unfortunately, there are broken SMTP server implementations out there
-      // like the one used by "smtp.googlemail.com" or "smtp.gmail.com".
-      //
-      // It seems these broken SMTP servers do automatically drop the
-      // data connection right after the 'QUIT' command was send and don't
-      // reply with a status message like it is clearly defined in RFC 2821
-      // (section 4.1.1.10). Unfortunately we can't do anything about
-      // it really and have to consider this a bad and ugly workaround. :(
-      if(command == SMTP_QUIT)
+      // Now we check if we got the correct response code for the command
+      // we issued
+      switch(command)
       {
-        W(DBF_NET, "broken SMTP server implementation found on QUIT, keeping quiet...");
-
-        success = TRUE;
-        tc->smtpBuffer[0] = '\0';
+        //  Reponse    Description (RFC 2821 - section 4.2.1)
+        //  1xx        Positive Preliminary reply
+        //  2xx        Positive Completion reply
+        //  3xx        Positive Intermediate reply
+        //  4xx        Transient Negative Completion reply
+        //  5xx        Permanent Negative Completion reply
+
+        case SMTP_HELP:    { success = (rc == 211 || rc == 214); } break;
+        case SMTP_VRFY:    { success = (rc == 250 || rc == 251); } break;
+        case SMTP_CONNECT: { success = (rc == 220); } break;
+        case SMTP_QUIT:    { success = (rc == 221); } break;
+        case SMTP_DATA:    { success = (rc == 354); } break;
+
+        // all codes that accept 250 response code
+        case SMTP_HELO:
+        case SMTP_MAIL:
+        case SMTP_RCPT:
+        case SMTP_FINISH:
+        case SMTP_RSET:
+        case SMTP_SEND:
+        case SMTP_SOML:
+        case SMTP_SAML:
+        case SMTP_EXPN:
+        case SMTP_NOOP:
+        case SMTP_TURN:    { success = (rc == 250); } break;
+
+        // ESMTP commands & response codes
+        case ESMTP_EHLO:            { success = (rc == 250); } break;
+        case ESMTP_STARTTLS:        { success = (rc == 220); } break;
+
+        // ESMTP_AUTH command responses
+        case ESMTP_AUTH_CRAM_MD5:
+        case ESMTP_AUTH_DIGEST_MD5:
+        case ESMTP_AUTH_LOGIN:
+        case ESMTP_AUTH_PLAIN:      { success = (rc == 334); } break;
       }
-      else
-        errorMsg = tr(MSG_ER_CONNECTIONBROKEN);
     }
   }
   else
-    errorMsg = tr(MSG_ER_CONNECTIONBROKEN);
+  {
+    // Unfortunately, there are broken SMTP server implementations out there
+    // like the one used by "smtp.googlemail.com" or "smtp.gmail.com".
+    //
+    // It seems these broken SMTP servers do automatically drop the
+    // data connection right after the 'QUIT' command was send and don't
+    // reply with a status message like it is clearly defined in RFC 2821
+    // (section 4.1.1.10). Unfortunately we can't do anything about
+    // it really and have to consider this a bad and ugly workaround. :(
+    if(command == SMTP_QUIT)
+    {
+      W(DBF_NET, "broken SMTP server implementation found on QUIT, keeping quiet...");
+
+      success = TRUE;
+      tc->smtpBuffer[0] = '\0';
+    }
+    else
+      errorMsg = tr(MSG_ER_CONNECTIONBROKEN);
+  }
 
   // the rest of the responses throws an error
   if(success == FALSE)
   {
     if(errorMsg != NULL)
-      ER_NewError(errorMsg, tc->msn->hostname, (char *)SMTPcmd[command], tc->smtpBuffer);
+      ER_NewError(errorMsg, tc->msn->hostname, (char *)commandText, tc->smtpBuffer);
+
+    result = NULL;
+  }
+
+  RETURN(result);
+  return result;
+}
+
+///
+/// QueueSMTPCommand
+//  Puts a command into the send buffer of the connection without flushing it
+//  and without waiting for the response of the server
+static BOOL QueueSMTPCommand(struct TransferContext *tc, const enum SMTPCommand command, const char *parmtext)
+{
+  BOOL success;
+
+  ENTER();
 
+  if(IsStrEmpty(parmtext))
+    snprintf(tc->smtpBuffer, sizeof(tc->smtpBuffer), "%s\r\n", SMTPcmd[command]);
+  else
+    snprintf(tc->smtpBuffer, sizeof(tc->smtpBuffer), "%s %s\r\n", SMTPcmd[command], parmtext);
+
+  D(DBF_NET, "TCP: queue SMTP cmd '%s' with param '%s'", SMTPcmd[command], SafeStr(parmtext));
+
+  success = (SendToHost(tc->conn, tc->smtpBuffer, strlen(tc->smtpBuffer), TCPF_NONE) > 0);
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// SendSMTPCommand
+//  Sends a command to the SMTP server and returns the response message
+//  described in (RFC 2821)
+static char *SendSMTPCommand(struct TransferContext *tc, const enum SMTPCommand command, const char *parmtext, const char *errorMsg)
+{
+  char *result;
+
+  ENTER();
+
+  // first we check if the socket is ready
+  // now we prepare the SMTP command
+  if(IsStrEmpty(parmtext))
+    snprintf(tc->smtpBuffer, sizeof(tc->smtpBuffer), "%s\r\n", SMTPcmd[command]);
+  else
+    snprintf(tc->smtpBuffer, sizeof(tc->smtpBuffer), "%s %s\r\n", SMTPcmd[command], parmtext);
+
+  D(DBF_NET, "TCP: send SMTP cmd '%s' with param '%s'", SMTPcmd[command], SafeStr(parmtext));
+
+  // lets send the command via TR_WriteLine, but not if we are in connection
+  // state
+  if(command == SMTP_CONNECT || SendLineToHost(tc->conn, tc->smtpBuffer) > 0)
+  {
+    result = ReceiveSMTPReply(tc, command, SMTPcmd[command], errorMsg);
+  }
+  else
+  {
+    ER_NewError(tr(MSG_ER_CONNECTIONBROKEN), tc->msn->hostname, (char *)SMTPcmd[command], tc->smtpBuffer);
     result = NULL;
   }
 
@@ -1101,6 +1146,200 @@ static BOOL InitSMTPAUTH(struct TransferContext *tc)
   return (BOOL)(rc == SMTP_ACTION_OK);
 }
 
+///
+/// CollectRecipients
+// collect the addresses of all recipients of a mail. "Resent-" recipients
+// take precedence over the recipients of the original mail.
+static const char **CollectRecipients(const struct Mail *mail, const struct ExtendedMail *email, int *numRcpts)
+{
+  const char **rcpts;
+  int n = 0;
+
+  ENTER();
+
+  if((rcpts = malloc((1 + email->NumSTo + email->NumCC + email->NumBCC + email->NumResentTo + email->NumResentCC + email->NumResentBCC) * sizeof(*rcpts))) != NULL)
+  {
+    int j;
+
+    if(email->NumResentTo > 0)
+    {
+      for(j=0; j < email->NumResentTo; j++)
+        rcpts[n++] = email->ResentTo[j].Address;
+    }
+    else
+    {
+      // the main 'To:' recipient plus the additional ones
+      rcpts[n++] = mail->To.Address;
+
+      for(j=0; j < email->NumSTo; j++)
+        rcpts[n++] = email->STo[j].Address;
+    }
+
+    if(email->NumResentCC > 0)
+    {
+      for(j=0; j < email->NumResentCC; j++)
+        rcpts[n++] = email->ResentCC[j].Address;
+    }
+    else
+    {
+      for(j=0; j < email->NumCC; j++)
+        rcpts[n++] = email->CC[j].Address;
+    }
+
+    if(email->NumResentBCC > 0)
+    {
+      for(j=0; j < email->NumResentBCC; j++)
+        rcpts[n++] = email->ResentBCC[j].Address;
+    }
+    else
+    {
+      for(j=0; j < email->NumBCC; j++)
+        rcpts[n++] = email->BCC[j].Address;
+    }
+  }
+
+  *numRcpts = n;
+
+  RETURN(rcpts);
+  return rcpts;
+}
+
+///
+/// ReceiveEnvelopeReply
+// check the server's reply to the MAIL command (index 0) or to the RCPT
+// command of a single recipient (index > 0). A bad reply is reported to
+// the user unless quiet is TRUE.
+static BOOL ReceiveEnvelopeReply(struct TransferContext *tc, const int index, const char **rcpts, const BOOL quiet)
+{
+  const char *errorMsg = (quiet == TRUE) ? NULL : tr(MSG_ER_BADRESPONSE_SMTP);
+  BOOL success;
+
+  ENTER();
+
+  if(index == 0)
+  {
+    success = (ReceiveSMTPReply(tc, SMTP_MAIL, SMTPcmd[SMTP_MAIL], errorMsg) != NULL);
+  }
+  else
+  {
+    // name the refused recipient in the error message
+    snprintf(tc->tempBuffer, sizeof(tc->tempBuffer), "%s TO:<%s>", SMTPcmd[SMTP_RCPT], rcpts[index-1]);
+
+    success = (ReceiveSMTPReply(tc, SMTP_RCPT, tc->tempBuffer, errorMsg) != NULL);
+  }
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// ReceiveEnvelopeReplies
+// check the replies to the envelope commands until the reply to command
+// 'last' has been received. The server replies to every single command,
+// hence all replies must be read even if one of them signals an error to
+// stay in sync. If the MAIL command was refused all RCPT commands fail as
+// a consequence, so only the refused MAIL command is reported to the user.
+static BOOL ReceiveEnvelopeReplies(struct TransferContext *tc, const int last, const char **rcpts, int *numReceived, BOOL *mailRefused)
+{
+  BOOL success = TRUE;
+
+  ENTER();
+
+  while(*numReceived <= last && tc->conn->error == CONNECTERR_NO_ERROR)
+  {
+    if(ReceiveEnvelopeReply(tc, *numReceived, rcpts, *mailRefused) == FALSE)
+    {
+      success = FALSE;
+
+      if(*numReceived == 0)
+        *mailRefused = TRUE;
+    }
+
+    (*numReceived)++;
+  }
+
+  if(*numReceived <= last)
+    success = FALSE;
+
+  RETURN(success);
+  return success;
+}
+
+///
+/// SendEnvelope
+// send the MAIL command and the RCPT commands for all recipients of a mail.
+// If the server supports command pipelining (RFC 2920) up to a window of
+// SMTP_PIPELINE_WINDOW commands is sent before the oldest reply is checked,
+// otherwise we wait for the reply to each command in turn.
+static BOOL SendEnvelope(struct TransferContext *tc, const char *from, const char **rcpts, const int numRcpts)
+{
+  BOOL success = TRUE;
+  BOOL mailRefused = FALSE;
+  int window = hasPIPELINING(tc->msn->smtpFlags) ? SMTP_PIPELINE_WINDOW : 1;
+  int numSent = 0;
+  int numReceived = 0;
+  int i;
+
+  ENTER();
+
+  D(DBF_NET, "sending envelope with %ld recipients, pipeline window %ld", numRcpts, window);
+
+  // index 0 is the MAIL command, all others are the RCPT commands
+  for(i=0; i <= numRcpts && success == TRUE; i++)
+  {
+    BOOL queued;
+
+    if(i == 0)
+      queued = QueueSMTPCommand(tc, SMTP_MAIL, from);
+    else
+    {
+      snprintf(tc->tempBuffer, sizeof(tc->tempBuffer), "TO:<%s>", rcpts[i-1]);
+      queued = QueueSMTPCommand(tc, SMTP_RCPT, tc->tempBuffer);
+    }
+
+    if(queued == FALSE)
+    {
+      ER_NewError(tr(MSG_ER_CONNECTIONBROKEN), tc->msn->hostname, (char *)SMTPcmd[(i == 0) ? SMTP_MAIL : SMTP_RCPT]);
+      success = FALSE;
+    }
+    else
+    {
+      numSent++;
+
+      // don't let the replies pile up unread, otherwise both sides may end
+      // up blocked while writing once the server stops reading commands
+      if(numSent - numReceived >= window)
+      {
+        if(FlushConnection(tc->conn) < 0)
+        {
+          ER_NewError(tr(MSG_ER_CONNECTIONBROKEN), tc->msn->hostname, (char *)SMTPcmd[(i == 0) ? SMTP_MAIL : SMTP_RCPT]);
+          success = FALSE;
+        }
+        else
+          success = ReceiveEnvelopeReplies(tc, numSent - window, rcpts, &numReceived, &mailRefused);
+      }
+    }
+  }
+
+  // check the replies to the commands which are still outstanding
+  if(numReceived < numSent && tc->conn->error == CONNECTERR_NO_ERROR)
+  {
+    if(FlushConnection(tc->conn) < 0)
+    {
+      ER_NewError(tr(MSG_ER_CONNECTIONBROKEN), tc->msn->hostname, (char *)SMTPcmd[(numSent == 1) ? SMTP_MAIL : SMTP_RCPT]);
+      success = FALSE;
+    }
+    else if(ReceiveEnvelopeReplies(tc, numSent - 1, rcpts, &numReceived, &mailRefused) == FALSE)
+      success = FALSE;
+  }
+
+  if(numReceived < numSent)
+    success = FALSE;
+
+  RETURN(success);
+  return success;
+}
+
 ///
 /// SendMessage
 // Sends a single message (-1 signals an error in DATA phase, 0 signals
@@ -1110,6 +1349,7 @@ static int SendMessage(struct TransferContext *tc, struct Mail *mail)
   int result = 0;
   char mailfile[SIZE_PATHFILE];
   FILE *fh = NULL;
+  struct ExtendedMail *email;
   char *buf = NULL;
   size_t buflen = SIZE_LINE;
 
@@ -1140,85 +1380,19 @@ static int SendMessage(struct TransferContext *tc, struct Mail *mail)
     if(has8BITMIME(tc->msn->smtpFlags))
       snprintf(buf, buflen, "%s BODY=%s", buf, hasServer8bit(tc->msn) ? "8BITMIME" : "7BIT");
 
-    // send the MAIL command with the FROM: message
-    if(SendSMTPCommand(tc, SMTP_MAIL, buf, tr(MSG_ER_BADRESPONSE_SMTP)) != NULL)
+    if((email = MA_ExamineMail(tc->outFolder, mail->MailFile, TRUE)) != NULL)
     {
-      struct ExtendedMail *email = MA_ExamineMail(tc->outFolder, mail->MailFile, TRUE);
+      const char **rcpts;
+      int numRcpts;
 
-      if(email != NULL)
+      if((rcpts = CollectRecipients(mail, email, &numRcpts)) != NULL)
       {
-        BOOL rcptok = TRUE;
-        int j;
+        BOOL rcptok;
 
-        // if the mail in question has some "Resent-To:" mail
-        // header information we use that information instead
-        // of the one of the original mail
-        if(email->NumResentTo > 0)
-        {
-          for(j=0; j < email->NumResentTo; j++)
-          {
-            snprintf(buf, buflen, "TO:<%s>", email->ResentTo[j].Address);
-            if(SendSMTPCommand(tc, SMTP_RCPT, buf, tr(MSG_ER_BADRESPONSE_SMTP)) == NULL)
-              rcptok = FALSE;
-          }
-        }
-        else
-        {
-          // specify the main 'To:' recipient
-          snprintf(buf, buflen, "TO:<%s>", mail->To.Address);
-          if(SendSMTPCommand(tc, SMTP_RCPT, buf, tr(MSG_ER_BADRESPONSE_SMTP)) == NULL)
-            rcptok = FALSE;
+        // send the MAIL command with the FROM: message and all RCPT commands
+        rcptok = SendEnvelope(tc, buf, rcpts, numRcpts);
 
-          // now add the additional 'To:' recipients of the mail
-          for(j=0; j < email->NumSTo && rcptok; j++)
-          {
-            snprintf(buf, buflen, "TO:<%s>", email->STo[j].Address);
-            if(SendSMTPCommand(tc, SMTP_RCPT, buf, tr(MSG_ER_BADRESPONSE_SMTP)) == NULL)
-              rcptok = FALSE;
-          }
-        }
-
-        // Add "Resent-CC:" recipients first
-        if(email->NumResentCC > 0)
-        {
-          for(j=0; j < email->NumResentCC; j++)
-          {
-            snprintf(buf, buflen, "TO:<%s>", email->ResentCC[j].Address);
-            if(SendSMTPCommand(tc, SMTP_RCPT, buf, tr(MSG_ER_BADRESPONSE_SMTP)) == NULL)
-              rcptok = FALSE;
-          }
-        }
-        else
-        {
-          // add the 'Cc:' recipients
-          for(j=0; j < email->NumCC && rcptok; j++)
-          {
-            snprintf(buf, buflen, "TO:<%s>", email->CC[j].Address);
-            if(SendSMTPCommand(tc, SMTP_RCPT, buf, tr(MSG_ER_BADRESPONSE_SMTP)) == NULL)
-              rcptok = FALSE;
-          }
-        }
-
-        // Add "Resent-BCC" recipients first
-        if(email->NumResentBCC > 0)
-        {
-          for(j=0; j < email->NumResentBCC; j++)
-          {
-            snprintf(buf, buflen, "TO:<%s>", email->ResentBCC[j].Address);
-            if(SendSMTPCommand(tc, SMTP_RCPT, buf, tr(MSG_ER_BADRESPONSE_SMTP)) == NULL)
-              rcptok = FALSE;
-          }
-        }
-        else
-        {
-          // add the 'BCC:' recipients
-          for(j=0; j < email->NumBCC && rcptok; j++)
-          {
-            snprintf(buf, buflen, "TO:<%s>", email->BCC[j].Address);
-            if(SendSMTPCommand(tc, SMTP_RCPT, buf, tr(MSG_ER_BADRESPONSE_SMTP)) == NULL)
-              rcptok = FALSE;
-          }
-        }
+        free(rcpts);
 
         if(rcptok == TRUE)
         {
@@ -1320,7 +1494,7 @@ static int SendMessage(struct TransferContext *tc, struct Mail *mail)
                   sentbytes += 2;
               }
 
-              PushMethodOnStack(tc->transferGroup, 3, MUIM_TransferControlGroup_Update, proclen, tr(MSG_TR_Sending));
+              PushCoalescedMethodOnStack(tc->transferGroup, MSC_ACCUMULATE, 3, MUIM_TransferControlGroup_Update, proclen, tr(MSG_TR_Sending));
             }
 
             D(DBF_NET, "transfered %ld bytes (raw: %ld bytes) error: %ld/%ld", sentbytes, mail->Size, tc->conn->abort, tc->conn->error);
@@ -1363,12 +1537,12 @@ static int SendMessage(struct TransferContext *tc, struct Mail *mail)
               result = -1; // signal the caller that we aborted within the DATA part
           }
         }
-
-        MA_FreeEMailStruct(email);
       }
-      else
-        ER_NewError(tr(MSG_ER_CantOpenFile), mailfile);
+
+      MA_FreeEMailStruct(email);
     }
+    else
+      ER_NewError(tr(MSG_ER_CantOpenFile), mailfile);
 
     fclose(fh);
   }